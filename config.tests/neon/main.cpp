@@ -0,0 +1,12 @@
+#if !defined(__ARM_NEON__) && !defined(__ARM_NEON)
+#error "NEON is not enabled for this CPU and float ABI"
+#endif
+
+#include <arm_neon.h>
+
+int main( int, char ** )
+{
+    uint32x4_t v = vdupq_n_u32( 1 );
+    v = vaddq_u32( v, v );
+    return vgetq_lane_u32( v, 0 ) == 2 ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+TEMPLATE=app
+CONFIG+=embedded
+TARGET=neon
+SOURCES=main.cpp
+MKSPEC.CXXFLAGS+=-mfpu=neon
@@ -24,6 +24,13 @@ data [
     path=/etc/themes/classic
 ]
 
+compiled [
+    hint=theme
+    files=*.xml
+    depends=install_data
+    path=/etc/themes/classic
+]
+
 pics [
     hint=pics
     files=pics/*
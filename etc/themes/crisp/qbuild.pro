@@ -24,6 +24,13 @@ data [
     path=/etc/themes/crisp
 ]
 
+compiled [
+    hint=theme
+    files=*.xml
+    depends=install_data
+    path=/etc/themes/crisp
+]
+
 pics [
     hint=pics
     files=pics/*
@@ -24,6 +24,13 @@ data [
     path=/etc/themes/deskphone
 ]
 
+compiled [
+    hint=theme
+    files=*.xml
+    depends=install_data
+    path=/etc/themes/deskphone
+]
+
 pics [
     hint=pics
     files=pics/*
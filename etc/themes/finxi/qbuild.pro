@@ -24,6 +24,13 @@ data [
     path=/etc/themes/finxi
 ]
 
+compiled [
+    hint=theme
+    files=*.xml
+    depends=install_data
+    path=/etc/themes/finxi
+]
+
 pics [
     hint=pics
     files=pics/*
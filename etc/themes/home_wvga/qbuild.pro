@@ -24,6 +24,13 @@ data [
     path=/etc/themes/home_wvga
 ]
 
+compiled [
+    hint=theme
+    files=*.xml
+    depends=install_data
+    path=/etc/themes/home_wvga
+]
+
 pics [
     hint=pics
     files=pics/*
@@ -24,6 +24,13 @@ data [
     path=/etc/themes/qtopia
 ]
 
+compiled [
+    hint=theme
+    files=*.xml
+    depends=install_data
+    path=/etc/themes/qtopia
+]
+
 pics [
     hint=pics
     files=pics/*
@@ -24,6 +24,13 @@ data [
     path=/etc/themes/smart
 ]
 
+compiled [
+    hint=theme
+    files=*.xml
+    depends=install_data
+    path=/etc/themes/smart
+]
+
 pics [
     hint=pics
     files=pics/*
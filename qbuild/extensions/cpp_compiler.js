@@ -56,6 +56,10 @@ The cpp_compiler creates the following rules.
 \row \o Input
      \o COMPILER.OUTPUT
      \o exe, lib or staticlib
+\row \o Input
+     \o TYPE == CPP_SOURCES
+     \o Additional sources.  CFLAGS and CXXFLAGS set on an object that is not also
+        COMPILER_CONFIG apply to its own SOURCES only.
 
 \row \o Output
      \o COMPILER.CFLAGS
@@ -528,15 +532,41 @@ function cpp_compiler_object_args(objdir)
          create a file with dependency information.
  */
 
+/*
+  Append the flags of a source object to the compiler command lines
+*/
+function cpp_compiler_source_flags(commands, flags)
+{
+    if (!flags || !flags.length)
+        return commands;
+
+    var extra = " " + flags.join(" ");
+    var result = new Array();
+    for (var ii in commands) {
+        result.push(commands[ii].replace(/\$\$\{COMPILER\.C(XX)?FLAGS\}/, function(match) {
+            return match + extra;
+        }));
+    }
+    return result;
+}
+
 /*
    Creates a rule to build a source object based on the \a filename.
  */
-function cpp_compiler_object_rule(filename, sourcedesc, objdir)
+function cpp_compiler_object_rule(filename, sourcedesc, objdir, baseobj)
 {
     var file = File(filename);
     var type = cpp_compiler_c_type(filename);
     var name = file.stripextension().name();
 
+    // Flags that apply to this object's sources only, eg. to enable an instruction set
+    var flags = null;
+    if (baseobj && !baseobj.property("TYPE").contains("COMPILER_CONFIG")) {
+        var flagsname = (type == "CC" ? "CFLAGS" : "CXXFLAGS");
+        if (baseobj.isProperty(flagsname))
+            flags = baseobj.property(flagsname).value();
+    }
+
     var dependencyFileName = cpp_compiler_dep_file(filename);
     var outputFileName = objdir + "/" + name + ".o";
     var ppFileName = objdir + "/" + name + (type=="CC"?".i":".ii");
@@ -550,7 +580,7 @@ function cpp_compiler_object_rule(filename, sourcedesc, objdir)
     if (sourcedesc != null && sourcedesc.isProperty("DEPENDS_DEPENDS"))
         compileRule.inputFiles.append(sourcedesc.property("DEPENDS_DEPENDS").value());
     compileRule.inputFiles.append("#(f)$${COMPILER.ARGS_TEST_FILE}");
-    compileRule.commands = project.property("QBUILD_" + type + "_IMP").value();
+    compileRule.commands = cpp_compiler_source_flags(project.property("QBUILD_" + type + "_IMP").value(), flags);
     compileRule.prerequisiteActions.append("#(oh)ensure_objdir");
     compileRule.inputFiles.append(project.property("COMPILER.SOURCE_DEPENDS").value());
     compileRule.prerequisiteActions.append("compiler_depends_depends");
@@ -562,7 +592,7 @@ function cpp_compiler_object_rule(filename, sourcedesc, objdir)
     ppRule.inputFiles = filename;
     ppRule.inputFiles.append("#(f)$$include_depends_rule($$[OUTPUT.1.ABS])");
     ppRule.inputFiles.append("#(f)$${COMPILER.ARGS_TEST_FILE}");
-    ppRule.commands = project.property("QBUILD_" + type + "_PP_IMP").value();
+    ppRule.commands = cpp_compiler_source_flags(project.property("QBUILD_" + type + "_PP_IMP").value(), flags);
     ppRule.prerequisiteActions.append("#(oh)ensure_objdir");
     ppRule.category = "Compiler";
 
@@ -571,7 +601,7 @@ function cpp_compiler_object_rule(filename, sourcedesc, objdir)
     asmRule.inputFiles = filename;
     asmRule.inputFiles.append("#(f)$$include_depends_rule($$[OUTPUT.1.ABS])");
     asmRule.inputFiles.append("#(f)$${COMPILER.ARGS_TEST_FILE}");
-    asmRule.commands = project.property("QBUILD_" + type + "_ASM_IMP").value();
+    asmRule.commands = cpp_compiler_source_flags(project.property("QBUILD_" + type + "_ASM_IMP").value(), flags);
     asmRule.prerequisiteActions.append("#(oh)ensure_objdir");
     asmRule.category = "Compiler";
 
@@ -624,7 +654,7 @@ function cpp_compiler_objects(objdir)
             if (obj.isProperty("~" + jj))
                 sourcedesc = obj.property("~" + jj);
 
-            cpp_compiler_object_rule(filename, sourcedesc, objdir);
+            cpp_compiler_object_rule(filename, sourcedesc, objdir, baseobj);
         }
     }
 }
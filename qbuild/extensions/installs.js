@@ -367,6 +367,10 @@ function installs_hints()
             installs_hint_dawg(obj);
             handled = true;
         }
+        if ( hint.contains("theme") ) {
+            installs_hint_theme(obj);
+            handled = true;
+        }
         if ( hint.contains("background") ) {
             if ( !project.property("QTOPIA_DISP_WIDTH").isEmpty() && !project.property("QTOPIA_DISP_HEIGHT").isEmpty())
                 installs_hint_background(obj);
@@ -892,6 +896,70 @@ function installs_hint_dawg(obj)
 
 /*!
 
+\hint theme
+
+Compiles theme XML files into the memory mapped .qtb format, which the theme
+loaders use instead of parsing the XML when it matches. The XML files must also
+be installed to the same path, eg. with \l{hint image}, and the rule should
+depend on that install. The installed copies are compiled so that the
+recorded modification times match the files on the device.
+
+*/
+function installs_hint_theme(obj)
+{
+    var data = {
+        files: {
+            optional: true,
+            value: null,
+            type: "existingFiles"
+        },
+        path: {
+            optional: true,
+            value: null,
+            type: "imagePath"
+        },
+        commands: {
+            optional: true,
+            value: Array(),
+            type: "array"
+        }
+    };
+    if ( !installs.fetchdata(obj, data) ) return;
+
+    var themecompiler = project.buildPath("QtopiaSdk:/bin/themecompiler");
+    // themecompiler needs the -e switch when installing for target systems that have a different endianness to the host
+    if (project.config("embedded") && project.property("QTOPIA_HOST_ENDIAN").strValue() != project.property("QTOPIA_TARGET_ENDIAN").strValue())
+        themecompiler+=" -e";
+
+    var rule = project.rule("install_"+obj.name);
+
+    if ( data.path.value ) {
+        rule.other = data.path.value;
+        rule.commands.append("#(e)$$MKSPEC.MKDIR $$[OTHER.0]");
+    }
+
+    if ( data.files.value ) {
+        for ( var ii in data.files.value ) {
+            var file = data.files.value[ii];
+            rule.inputFiles.append(file);
+            rule.commands.append(themecompiler+" $$[OTHER.0] $$[OTHER.0]/"+basename(file));
+        }
+    }
+    for ( var ii in data.commands.value ) {
+        rule.commands.append(data.commands.value[ii]);
+    }
+
+    // We need to ensure themecompiler has been built before it is run!
+    installs_buildBeforeRule(rule, "/src/tools/themecompiler");
+
+    var install = installs_getImage();
+    install.prerequisiteActions.append(rule.name);
+    installs_process_depends(rule, obj);
+    project.property("pkg.default_targets").unite(rule.name);
+}
+
+/*!
+
 \hint background
 
 */
@@ -20,6 +20,7 @@
 #include "camerastateprocessor.h"
 #include "cameravideosurface.h"
 #include <qcameratools.h>
+#include <QVideoFramePool>
 #include <QSet>
 #include <QDebug>
 
@@ -45,6 +46,7 @@ CameraStateProcessor::CameraStateProcessor(QCameraDevice *device, QObject* paren
     m_busy = false;
     m_selfStill = false;
     m_doConversion = false;
+    m_directConversion = false;
 
     preview_active = false;
 
@@ -78,10 +80,11 @@ bool CameraStateProcessor::initialize(int rotation)
 
         if (m_surface->isDefaultSurface()) {
             // a nateive camera format is not supported
-            // can we do a color conversion to this default video surface?
-            foreach(unsigned int format, CameraFormatConverter::supportedFormats()) {
-                if (preview->formats().keys().contains( format )) {
+            // prefer YUV formats converted together with the zoom in one pass
+            foreach(unsigned int format, keys) {
+                if (m_transform.isTransformationSupported(qFourccToVideoFormat(format), QVideoFrame::Format_RGB565)) {
                     m_doConversion = true;
+                    m_directConversion = true;
                     m_fourccSrcFormat = format;
                     m_fourccDestFormat = QtopiaCamera::RGB565;
 
@@ -90,6 +93,20 @@ bool CameraStateProcessor::initialize(int rotation)
                     break;
                 }
             }
+            // can we do a color conversion to this default video surface?
+            if (!m_doConversion) {
+                foreach(unsigned int format, CameraFormatConverter::supportedFormats()) {
+                    if (preview->formats().keys().contains( format )) {
+                        m_doConversion = true;
+                        m_fourccSrcFormat = format;
+                        m_fourccDestFormat = QtopiaCamera::RGB565;
+
+                        m_videoFrameFormatSrc = qFourccToVideoFormat(format);
+                        m_videoFrameFormatDest = QVideoFrame::Format_RGB565;
+                        break;
+                    }
+                }
+            }
             if (!m_doConversion) {
                 qWarning()<<"Camera: Color conversion from " << m_videoFrameFormatSrc << " to "
                             << m_videoFrameFormatDest << " not supported";
@@ -167,7 +184,7 @@ void CameraStateProcessor::startPreview()
     if(preview_active ) return;
     m_preview_fps = preview->framerate();
     m_preview_size = preview->resolution();
-    if(m_doConversion) {
+    if(m_doConversion && !m_directConversion) {
         releaseFormatConverter();
         initFormatConverter(m_preview_size);
     }
@@ -328,16 +345,19 @@ void CameraStateProcessor::releaseFormatConverter()
 
 void CameraStateProcessor::frameReady(QVideoFrame const& frame)
 {
-    if (m_doConversion) {
+    if (m_directConversion) {
+        // crop, scale and convert in one pass
+        emit previewFrameReady(doPreviewZoom(frame, m_videoFrameFormatDest));
+    } else if (m_doConversion) {
         QVideoFrame vframe (m_videoFrameFormatDest, frame.size(), m_converter->convert(reinterpret_cast<unsigned char*>(const_cast<unsigned char*>(frame.planeData(0)))));
 
         if(m_doZoom)
-            emit previewFrameReady(doPreviewZoom(vframe));
+            emit previewFrameReady(doPreviewZoom(vframe, m_videoFrameFormatDest));
         else
             emit previewFrameReady(vframe);
     } else {
         if (m_doZoom)
-             emit previewFrameReady(doPreviewZoom(frame));
+             emit previewFrameReady(doPreviewZoom(frame, frame.format()));
         else
             emit previewFrameReady(frame);
     }
@@ -424,23 +444,29 @@ void CameraStateProcessor::doStillZoom(QImage& frame)
 
 }
 
-QVideoFrame CameraStateProcessor::doPreviewZoom(QVideoFrame const& frame)
+QVideoFrame CameraStateProcessor::doPreviewZoom(QVideoFrame const& frame, QVideoFrame::PixelFormat format)
 {
     int fw=frame.size().width(), fh=frame.size().height();
 
-    int w = (int)(fw * m_zoomfactor);
-    int h = (int)(fh * m_zoomfactor);
+    QRect d (0, 0, fw, fh);
+    if (m_doZoom) {
+        int w = (int)(fw * m_zoomfactor);
+        int h = (int)(fh * m_zoomfactor);
+        d = QRect((fw-w)>>1,(fh-h)>>1 , w, h);
+    }
 
-    QRect d ((fw-w)>>1,(fh-h)>>1 , w, h);
-    QVideoFrame crop(QVideoFrame::Format_RGB565, QSize(fw,fh));
+    // recycled once the viewfinder has displayed it
+    QVideoFrame crop = QVideoFramePool::instance()->allocateFrame(format, QSize(fw,fh));
     uchar *croppedData = crop.planeData(0);
 
+    // line steps are in pixels of the first plane
+    int srcLineStep = frame.bytesPerLine(0) / (QVideoFrame::colorDepth(frame.format(), 0) / 8);
+    int dstLineStep = crop.bytesPerLine(0) / (QVideoFrame::colorDepth(format, 0) / 8);
 
-    m_transform.setSrcGeometry(d, QRect(0, 0, fw,fh), fw);
-    m_transform.setDstGeometry(QRect(0,0,fw,fh), QRect(0,0,fw,fh), fw);
+    m_transform.setSrcGeometry(d, QRect(0, 0, fw,fh), srcLineStep);
+    m_transform.setDstGeometry(QRect(0,0,fw,fh), QRect(0,0,fw,fh), dstLineStep);
 
-    m_transform.transformPlane(frame.planeData(0), QVideoFrame::Format_RGB565,
-                               croppedData, QVideoFrame::Format_RGB565);
+    m_transform.transformPlane(frame, croppedData, format);
 
     return crop;
 }
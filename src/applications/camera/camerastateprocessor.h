@@ -112,7 +112,7 @@ private:
     // from viewfinder
     void initFormatConverter(QSize size);
     void releaseFormatConverter();
-    QVideoFrame doPreviewZoom(QVideoFrame const& frame);
+    QVideoFrame doPreviewZoom(QVideoFrame const& frame, QVideoFrame::PixelFormat format);
     void doStillZoom(QImage& img);
     QImage m_frame;
     CameraFormatConverter *m_converter;
@@ -126,6 +126,7 @@ private:
     int m_preview_fps;
     unsigned int m_fourccDestFormat;
     bool m_doConversion;
+    bool m_directConversion;
 
     //zoom
     int m_zoomlevel;
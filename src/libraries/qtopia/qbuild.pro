@@ -139,6 +139,7 @@ PRIVATE_HEADERS=\
     qcontentsetengine_p.h \
     qfscontentengine_p.h \
     qsqlcontentsetengine_p.h \
+    qsqlpagedcontentsetengine_p.h \
     qdrmcontentengine_p.h \
     qcategorystore_p.h \
     qsqlcategorystore_p.h \
@@ -171,6 +172,7 @@ SEMI_PRIVATE_HEADERS=\
     qsmoothlistwidget_p.h\
     qthumbstyle_p.h\
     pred_p.h\
+    qthumbnailcache_p.h\
     qtopiainputdialog_p.h\
     qtopiasqlmigrateplugin_p.h
 
@@ -197,6 +199,7 @@ SOURCES=\
     qwaitwidget.cpp\
     qtimezone.cpp\
     qthumbnail.cpp\
+    qthumbnailcache.cpp\
     qimagedocumentselector.cpp\
     qimagedocumentselector_p.cpp\
     thumbnailview_p.cpp\
@@ -248,6 +251,7 @@ SOURCES=\
     qsqlcontentstore.cpp \
     qcontentsetengine.cpp \
     qsqlcontentsetengine.cpp \
+    qsqlpagedcontentsetengine.cpp \
     qdrmcontentengine.cpp \
     qcategorystore.cpp \
     qsqlcategorystore.cpp \
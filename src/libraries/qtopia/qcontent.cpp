@@ -477,6 +477,18 @@ void QContent::uninstallBatch( const QList<QContentId> &batch )
     QContentStore::instance()->batchUninstallContent( batch );
 }
 
+/*!
+  Commits changes to a \a batch of content, committing to the database only once.  This achieves a
+  significant performance boost over calling commit() on each item.
+
+  \sa commit(), installBatch()
+ */
+
+void QContent::commitBatch( const QList<QContent> &batch )
+{
+    QContentStore::instance()->batchCommitContent( batch );
+}
+
 /*!
   Clear all error flags and errors strings on all QContent objects.
   Note: this method clears the global error cache for all QContent objects
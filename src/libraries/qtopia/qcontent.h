@@ -82,6 +82,7 @@ public:
     static void uninstall( QContentId );
     static void installBatch( const QList<QFileInfo> & );
     static void uninstallBatch( const QList<QContentId> & );
+    static void commitBatch( const QList<QContent> & );
     static void clearErrors();
     static QContentId execToContent( const QString& );
 
@@ -109,6 +109,21 @@ Q_GLOBAL_STATIC(NullQContentSetEngine,nullQContentSetEngine);
     asynchronous update mode should be preferred, while the synchronous mode is
     more suited for one off queries.
 
+    \section1 Paged updates
+
+    Paged QContentSets are updated in a background thread like asynchronous sets, but
+    rather than holding a record of every item in the set they only count the matching
+    content and load the content in a window around the most recently accessed indices.
+    Content outside of the window is returned as a null QContent while it is loaded, once
+    it is available the contentChanged() signal is emitted for its indices.  When the
+    backing store changes only the window is reloaded, content inserted or removed within
+    the window is signalled individually and other changes are signalled as insertions or
+    removals following the window.
+
+    The paged update mode is suited to very large sets that are viewed a portion at a time,
+    such as a list of every image on a device.  Paged QContentSets do not support explicit
+    content.
+
     \section1 Explicit content
 
     In addition to the filtered content a QContentSet has an internal list of explicitly
@@ -162,10 +177,11 @@ Q_GLOBAL_STATIC(NullQContentSetEngine,nullQContentSetEngine);
 /*!
     \enum QContentSet::UpdateMode
 
-    Indicates whether the contents of a content set should be updated synchronously or asynchronously.
+    Indicates whether the contents of a content set should be updated synchronously, asynchronously or a page at a time.
 
     \value Synchronous Update the content set in the current thread of execution.
     \value Asynchronous Update the content set in a background thread.
+    \value Paged Update the content set in a background thread and only load content in the vicinity of the accessed indices.
 */
 
 /*!
@@ -776,7 +792,7 @@ QContentSet &QContentSet::operator=(const QContentSet& contentset)
 }
 
 /*!
-    Returns the update mode of the content set; either Synchronous or Asynchronous.
+    Returns the update mode of the content set; either Synchronous, Asynchronous or Paged.
 */
 QContentSet::UpdateMode QContentSet::updateMode() const
 {
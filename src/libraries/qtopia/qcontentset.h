@@ -41,7 +41,8 @@ public:
     enum UpdateMode
     {
         Asynchronous,
-        Synchronous
+        Synchronous,
+        Paged
     };
 
     explicit QContentSet( QObject *parent = 0 );
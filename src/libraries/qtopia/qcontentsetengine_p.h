@@ -50,7 +50,7 @@ public:
         , m_flushTimerId(-1)
         , m_updateInProgress( false )
     {
-        if (updateMode() == QContentSet::Asynchronous)
+        if (updateMode() != QContentSet::Synchronous)
             connect(this, SIGNAL(updateFinished()), this, SIGNAL(contentChanged()));
     }
 
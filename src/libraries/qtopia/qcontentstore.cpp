@@ -25,6 +25,7 @@
 #ifndef QTOPIA_CONTENT_INSTALLER
 #include "qdocumentservercontentstore_p.h"
 #include "contentpluginmanager_p.h"
+#include "qthumbnailcache_p.h"
 #include <QApplication>
 #include <QThreadStorage>
 #include <QImageReader>
@@ -146,7 +147,10 @@ QContentStore::~QContentStore()
 */
 QImage QContentStore::thumbnail(const QContent &content, const QSize &size, Qt::AspectRatioMode mode)
 {
-    QImage thumbnail;
+    QImage thumbnail = QThumbnailCache::thumbnail(content, size, mode);
+
+    if (!thumbnail.isNull())
+        return thumbnail;
 
     QString thumbPath = thumbnailPath(content.fileName());
 
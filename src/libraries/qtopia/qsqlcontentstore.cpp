@@ -31,6 +31,7 @@
 #include "qdrmcontentengine_p.h"
 #endif
 #include "qsqlcontentsetengine_p.h"
+#include "qsqlpagedcontentsetengine_p.h"
 #include "qmimetypedata_p.h"
 #include "contentpluginmanager_p.h"
 #include <qtopianamespace.h>
@@ -39,8 +40,96 @@
 #include "qcontent_p.h"
 #endif
 
+#include <QMutex>
+#include <QMutexLocker>
+
 #include <string.h>
 
+// Maximum number of prepared content filter queries kept across all databases.
+static const int MaxPreparedQueries = 48;
+
+// Number of prepared query cache lookups between reports of the hit rate.
+static const int PreparedQueryReportInterval = 100;
+
+/*
+    Keeps prepared content filter queries for reuse, keyed by the database they
+    were prepared on and their SQL.
+
+    A query is taken out of the cache while it is in use so it can't be used by
+    two threads at once.  Queries for a database are released before it is
+    detached as SQLite can't close a connection with statements outstanding;
+    the generation prevents queries in use at the time from being returned to
+    the cache afterwards.
+*/
+class QSqlContentQueryCache
+{
+public:
+    QSqlContentQueryCache()
+        : generation( 0 )
+        , hits( 0 )
+        , misses( 0 )
+    {
+        queries.setMaxCost( MaxPreparedQueries );
+    }
+
+    QSqlQuery *take( QtopiaDatabaseId databaseId, const QString &statement, int *queryGeneration )
+    {
+        QMutexLocker locker( &mutex );
+
+        QSqlQuery *query = queries.take( qMakePair( databaseId, statement ) );
+
+        *queryGeneration = generation;
+
+        if( query )
+            ++hits;
+        else
+            ++misses;
+
+#ifndef QTOPIA_CONTENT_INSTALLER
+        if( !query || (hits + misses) % PreparedQueryReportInterval == 0 )
+        {
+            qLog(DocAPI) << "Prepared query cache" << (query ? "hit" : "miss")
+                    << "hits" << hits << "misses" << misses
+                    << "hit rate" << (hits * 100 / (hits + misses)) << "%";
+        }
+#endif
+
+        return query;
+    }
+
+    void release( QtopiaDatabaseId databaseId, const QString &statement, QSqlQuery *query, int queryGeneration )
+    {
+        QMutexLocker locker( &mutex );
+
+        if( queryGeneration == generation )
+            queries.insert( qMakePair( databaseId, statement ), query );
+        else
+            delete query;
+    }
+
+    void clear( QtopiaDatabaseId databaseId )
+    {
+        QMutexLocker locker( &mutex );
+
+        foreach( const Key &key, queries.keys() )
+            if( key.first == databaseId )
+                queries.remove( key );
+
+        ++generation;
+    }
+
+private:
+    typedef QPair< QtopiaDatabaseId, QString > Key;
+
+    QMutex mutex;
+    QCache< Key, QSqlQuery > queries;
+    int generation;
+    int hits;
+    int misses;
+};
+
+Q_GLOBAL_STATIC(QSqlContentQueryCache, preparedQueries);
+
 /*!
     \class QSqlContentStore
     \inpublicgroup QtBaseModule
@@ -1011,6 +1100,9 @@ QContentSetEngine *QSqlContentStore::contentSet( const QContentFilter &filter, c
 {
     qLog(DocAPI) << __PRETTY_FUNCTION__ << filter;
 
+    if( mode == QContentSet::Paged )
+        return new QSqlPagedContentSetEngine( filter, order, this );
+
     return new QSqlContentSetEngine( filter, order, mode, this );
 }
 
@@ -1053,38 +1145,49 @@ int QSqlContentStore::contentCount( const QContentFilter &filter )
     if( !filter.isValid() )
         return count;
 
-    int insertAt = 0;
+    foreach(QtopiaDatabaseId dbid, QtopiaSql::instance()->databaseIds())
+        count += contentCount( dbid, filter );
+
+    return count;
+}
+
+/*!
+    Returns the number of content records in the database \a databaseId that match the content filter \a filter.
+*/
+int QSqlContentStore::contentCount( QtopiaDatabaseId databaseId, const QContentFilter &filter )
+{
+    int count = 0;
+
+    if( !filter.isValid() || !QtopiaSql::instance()->isValidDatabaseId( databaseId ) )
+        return count;
+
     QList< Parameter > parameters;
-    QStringList joins;
 
-    QString whereString = QLatin1String(" WHERE ")
-            + buildWhereClause( filter, &parameters, &insertAt, &joins );
+    QString selectString = buildFilterQuery( CountQuery, filter, QContentSortCriteria(), &parameters );
 
-    QString selectString
-            = QLatin1String( "SELECT count(DISTINCT content.cid) FROM " )
-            + buildFrom( filter, joins )
-            + whereString;
+    int generation;
 
-    foreach(QtopiaDatabaseId dbid, QtopiaSql::instance()->databaseIds())
-    {
-        QSqlQuery selectQuery( QtopiaSql::instance()->database(dbid) );
-        selectQuery.prepare( selectString );
+    QSqlQuery *selectQuery = prepareFilterQuery( databaseId, selectString, parameters, &generation );
 
-        bindParameters( &selectQuery, parameters );
+    if( !selectQuery )
+        return count;
 
-        QtopiaSql::instance()->logQuery( selectQuery );
+    QtopiaSql::instance()->logQuery( *selectQuery );
 
-        if ( !selectQuery.exec() )
-        {
-            logError( __PRETTY_FUNCTION__, "selectQuery", dbid, selectQuery.lastError() );
+    if ( !selectQuery->exec() )
+    {
+        logError( __PRETTY_FUNCTION__, "selectQuery", databaseId, selectQuery->lastError() );
 
-            continue;
-        }
+        delete selectQuery;
 
-        if( selectQuery.first() )
-            count += selectQuery.value( 0 ).toInt();
+        return count;
     }
 
+    if( selectQuery->first() )
+        count = selectQuery->value( 0 ).toInt();
+
+    releaseFilterQuery( databaseId, selectString, selectQuery, generation );
+
     return count;
 }
 
@@ -1098,78 +1201,59 @@ QContentIdList QSqlContentStore::matches( const QContentFilter &filter, const QC
     if( !filter.isValid() )
         return matches;
 
-    int insertAt = 0;
-    QList< Parameter > parameters;
-    QStringList joins;
-
-    QString whereString = QLatin1String(" WHERE ")
-            + buildWhereClause( filter, &parameters, &insertAt, &joins );
-
-    QString orderString = buildOrderBy( order, &parameters, &insertAt, &joins );
-    QString selectString
-            = QLatin1String( "SELECT DISTINCT content.cid FROM " )
-            + buildFrom( filter, joins )
-            + whereString
-            + orderString;
-
     foreach(QtopiaDatabaseId dbid, QtopiaSql::instance()->databaseIds())
-    {
-        QSqlQuery selectQuery( QtopiaSql::instance()->database(dbid) );
-        selectQuery.prepare( selectString );
-
-        bindParameters( &selectQuery, parameters );
-
-        QtopiaSql::instance()->logQuery( selectQuery );
-
-        if ( !selectQuery.exec() )
-        {
-            logError( __PRETTY_FUNCTION__, "selectQuery", dbid, selectQuery.lastError() );
-
-            continue;
-        }
-
-        while ( selectQuery.next() )
-            matches.append( QContentId( dbid, selectQuery.value( 0 ).toULongLong() ) );
-    }
+        matches += this->matches( dbid, filter, order );
 
     return matches;
 }
 
-QContentIdList QSqlContentStore::matches( QtopiaDatabaseId databaseId, const QContentFilter &filter, const QContentSortCriteria &order )
+/*!
+    Returns a list of content ids in the database \a databaseId that match the content filter \a filter, sorted in the
+    given \a order.
+
+    If \a limit is not negative at most \a limit ids are returned, starting from the id at \a offset in the sorted
+    list.
+*/
+QContentIdList QSqlContentStore::matches( QtopiaDatabaseId databaseId, const QContentFilter &filter, const QContentSortCriteria &order, int offset, int limit )
 {
     QContentIdList matches;
 
     if( !filter.isValid() || !QtopiaSql::instance()->isValidDatabaseId( databaseId ) )
         return matches;
 
-    int insertAt = 0;
+    const FilterQuery type = limit < 0 ? MatchQuery : PageQuery;
+
     QList< Parameter > parameters;
-    QStringList joins;
 
-    QString whereString = QLatin1String(" WHERE ")
-            + buildWhereClause( filter, &parameters, &insertAt, &joins );
-    QString orderString = buildOrderBy( order, &parameters, &insertAt, &joins );
-    QString selectString
-            = QLatin1String( "SELECT DISTINCT content.cid FROM " )
-            + buildFrom( filter, joins )
-            + whereString
-            + orderString;
+    QString selectString = buildFilterQuery( type, filter, order, &parameters );
 
-    QSqlQuery selectQuery( QtopiaSql::instance()->database( databaseId ) );
-    selectQuery.prepare( selectString );
+    int generation;
 
-    bindParameters( &selectQuery, parameters );
+    QSqlQuery *selectQuery = prepareFilterQuery( databaseId, selectString, parameters, &generation );
 
-    QtopiaSql::instance()->logQuery( selectQuery );
+    if( !selectQuery )
+        return matches;
 
-    if( !selectQuery.exec() )
+    if( type == PageQuery )
+    {
+        selectQuery->bindValue( QLatin1String( ":limit" ), limit );
+        selectQuery->bindValue( QLatin1String( ":offset" ), offset );
+    }
+
+    QtopiaSql::instance()->logQuery( *selectQuery );
+
+    if( !selectQuery->exec() )
     {
-        logError( __PRETTY_FUNCTION__, "selectQuery", databaseId, selectQuery.lastError() );
+        logError( __PRETTY_FUNCTION__, "selectQuery", databaseId, selectQuery->lastError() );
+
+        delete selectQuery;
     }
     else
     {
-        while ( selectQuery.next() )
-            matches.append( QContentId( databaseId, selectQuery.value( 0 ).toULongLong() ) );
+        while ( selectQuery->next() )
+            matches.append( QContentId( databaseId, selectQuery->value( 0 ).toULongLong() ) );
+
+        releaseFilterQuery( databaseId, selectString, selectQuery, generation );
     }
 
     return matches;
@@ -2475,6 +2559,104 @@ QString QSqlContentStore::buildQuery( const QString &queryTemplate, const QConte
     return queryTemplate.arg( from ).arg( where );
 }
 
+/*!
+    Constructs a query of the given \a type selecting content which matches \a filter, sorted according to \a order if
+    it is a match or page query.
+
+    Page queries additionally take \c :limit and \c :offset parameters which are not added to \a parameters, they are
+    bound by the caller each time the query is executed.
+
+    Any parameters that should be bound when executing the query are added to \a parameters.
+*/
+QString QSqlContentStore::buildFilterQuery( FilterQuery type, const QContentFilter &filter, const QContentSortCriteria &order, QList< Parameter > *parameters )
+{
+    int insertAt = 0;
+    QStringList joins;
+
+    QString whereString = QLatin1String(" WHERE ")
+            + buildWhereClause( filter, parameters, &insertAt, &joins );
+
+    if( type == CountQuery )
+    {
+        return QLatin1String( "SELECT count(DISTINCT content.cid) FROM " )
+                + buildFrom( filter, joins )
+                + whereString;
+    }
+
+    QString orderString = buildOrderBy( order, parameters, &insertAt, &joins );
+
+    // Pages are only consistent with each other if the order is total, so fall back to the id to break ties.
+    if( type == PageQuery )
+        orderString += QLatin1String( ", content.cid LIMIT :limit OFFSET :offset" );
+
+    return QLatin1String( "SELECT DISTINCT content.cid FROM " )
+            + buildFrom( filter, joins )
+            + whereString
+            + orderString;
+}
+
+/*!
+    Returns a query for the database \a databaseId prepared from the SQL \a statement built by buildFilterQuery(),
+    with the \a parameters built with it bound.
+
+    Filters which differ only in the values compared against produce the same statement with different parameters,
+    so a query previously prepared from the same \a statement is reused if there is one in the cache.  The query should
+    be returned with releaseFilterQuery() along with the \a generation of the cache it was taken from once it has been
+    executed.
+
+    Returns 0 if the query could not be prepared.
+*/
+QSqlQuery *QSqlContentStore::prepareFilterQuery( QtopiaDatabaseId databaseId, const QString &statement, const QList< Parameter > &parameters, int *generation )
+{
+    // Get the database before using the cache so the cache is destroyed before the database connections are.
+    QSqlDatabase &database = QtopiaSql::instance()->database( databaseId );
+
+    QSqlQuery *query = preparedQueries()->take( databaseId, statement, generation );
+
+    if( !query )
+    {
+        query = new QSqlQuery( database );
+
+        if( !query->prepare( statement ) )
+        {
+            logError( __PRETTY_FUNCTION__, "selectQuery", databaseId, query->lastError() );
+
+            delete query;
+
+            return 0;
+        }
+    }
+
+    bindParameters( query, parameters );
+
+    return query;
+}
+
+/*!
+    Returns a \a query prepared by prepareFilterQuery() from the given \a statement to the cache of prepared queries for
+    the database \a databaseId.
+
+    The query is deleted instead if the cache has been cleared since the query was taken from it at \a generation.
+*/
+void QSqlContentStore::releaseFilterQuery( QtopiaDatabaseId databaseId, const QString &statement, QSqlQuery *query, int generation )
+{
+    // Release any locks held by the query before it sits idle in the cache.
+    query->finish();
+
+    if( generation < 0 )
+        delete query;
+    else
+        preparedQueries()->release( databaseId, statement, query, generation );
+}
+
+/*!
+    Destroys any prepared queries on the database \a databaseId.  This must be called before the database is closed.
+*/
+void QSqlContentStore::releasePreparedQueries( QtopiaDatabaseId databaseId )
+{
+    preparedQueries()->clear( databaseId );
+}
+
 /*!
     Binds the parameters in \a parameters to a \a query.
 */
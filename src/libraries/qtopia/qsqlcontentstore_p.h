@@ -76,9 +76,11 @@ public:
 
     virtual int contentCount( const QContentFilter &filter );
 
+    int contentCount( QtopiaDatabaseId databaseId, const QContentFilter &filter );
+
     QContentIdList matches( const QContentFilter &filter, const QContentSortCriteria &order );
 
-    QContentIdList matches( QtopiaDatabaseId databaseId, const QContentFilter &filter, const QContentSortCriteria &order );
+    QContentIdList matches( QtopiaDatabaseId databaseId, const QContentFilter &filter, const QContentSortCriteria &order, int offset = 0, int limit = -1 );
 
     QContentList contentFromIds( QtopiaDatabaseId databaseId, const QContentIdList &contentIds );
     QContentList contentFromIds( const QContentIdList &contentIds );
@@ -90,9 +92,18 @@ public:
     virtual QList<QMimeEngineData> associationsForApplication(const QString& application );
     virtual QList<QMimeEngineData> associationsForMimeType(const QString& mimeType );
 
+    static void releasePreparedQueries( QtopiaDatabaseId databaseId );
+
 private:
     typedef QPair< QString, QVariant > Parameter;
 
+    enum FilterQuery
+    {
+        CountQuery,
+        MatchQuery,
+        PageQuery
+    };
+
     QContentEngine *installContent( QContent *content );
     QContentEngine *refreshContent( QContent *content );
 
@@ -144,12 +155,16 @@ private:
     QString buildNames( const QStringList &names, const QString &conjunct, QList< Parameter > *parameters );
     QString buildOrderBy( const QContentSortCriteria &, QList< Parameter > *, int *, QStringList * );
 
+    QString buildFilterQuery( FilterQuery type, const QContentFilter &filter, const QContentSortCriteria &order, QList< Parameter > *parameters );
     QString buildQuery( const QString &queryTemplate, const QContentFilter &filter, QList< Parameter > *parameters );
     QString buildQuery( const QString &queryTemplate, const QContentFilter &filter, const QContentSortCriteria &sortOrder, QList< Parameter > *parameters );
     void bindParameters( QSqlQuery *query, const QList< Parameter > &parameters );
     QString addParameter( const QVariant &parameter, QList< Parameter > *parameters );
     QString addParameter( const QVariant &parameter, QList< Parameter > *parameters, int *insertAt );
 
+    QSqlQuery *prepareFilterQuery( QtopiaDatabaseId databaseId, const QString &statement, const QList< Parameter > &parameters, int *generation );
+    void releaseFilterQuery( QtopiaDatabaseId databaseId, const QString &statement, QSqlQuery *query, int generation );
+
     QSet< QContentFilter::FilterType > getAllFilterTypes( const QContentFilter &filter );
     QSet< QString > getAllSyntheticKeys( const QContentFilter &filter );
 
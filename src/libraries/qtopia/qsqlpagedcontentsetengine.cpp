@@ -0,0 +1,833 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+#include "qsqlpagedcontentsetengine_p.h"
+#include "qsqlcontentstore_p.h"
+#include "qcontent_p.h"
+#include <QtopiaApplication>
+#include <QMetaObject>
+#include <QPointer>
+#include <QThread>
+#include <qtopialog.h>
+
+class QSqlPagedContentSetLoader : public QThread
+{
+    Q_OBJECT
+public:
+    QSqlPagedContentSetLoader( QSqlPagedContentSetEngine *contentSet )
+        : QThread( contentSet )
+        , m_contentSet( contentSet )
+    {
+    }
+
+protected:
+    virtual void run()
+    {
+        while( m_contentSet->load() )
+            ;
+    }
+
+private:
+    QPointer< QSqlPagedContentSetEngine > m_contentSet;
+};
+
+/*!
+    \class QSqlPagedContentSetEngine
+    \inpublicgroup QtBaseModule
+
+    \brief The QSqlPagedContentSetEngine is an implementation of the QContentSetEngine interface for QContentSet::Paged
+    content sets of content stored in QSqlContentStore.
+
+    Rather than holding the ids of every content record matching the filter the engine holds the number of matching
+    records in each database and a window of ids around the most recently accessed indices.  Content outside the
+    window is returned as a null QContent and the page containing it is loaded in a background thread, once loaded the
+    contentChanged() signal is emitted for the page.
+
+    Pages are selected from a single database with an SQL LIMIT and OFFSET.  When content is spread across multiple
+    databases the pages are merged from each database in sort order and the offset into each database at the start of
+    every page visited is recorded so later pages can resume the merge without starting from the beginning of the set.
+
+    Only content within the window is cached.  When content in the database changes the window is reloaded and
+    compared with the previous window, and content inserted, removed or updated within the window is signalled
+    individually.  Changes outside of the window are signalled as insertions or removals immediately after the window.
+
+    \internal
+*/
+
+/*!
+    Constructs a new paged sql content set engine for content in the given content \a store with the filtering
+    criteria \a filter, and sort order \a order.
+*/
+QSqlPagedContentSetEngine::QSqlPagedContentSetEngine( const QContentFilter &filter, const QContentSortCriteria &order, QSqlContentStore *store )
+    : QContentSetEngine( filter, order, QContentSet::Paged )
+    , m_store( store )
+    , m_filter( filter )
+    , m_order( order )
+    , m_loadedStart( 0 )
+    , m_loadedCount( 0 )
+    , m_criteriaChanged( filter.isValid() )
+    , m_contentChanged( false )
+    , m_resetPending( false )
+    , m_syncPending( false )
+    , m_deletePending( false )
+    , m_loader( 0 )
+    , m_loaderCount( 0 )
+    , m_loaderGeneration( 0 )
+    , m_windowStart( 0 )
+    , m_count( 0 )
+    , m_generation( 0 )
+{
+#ifndef QTOPIA_CONTENT_INSTALLER
+    connect(qApp, SIGNAL(contentChanged(QContentIdList,QContent::ChangeType)),
+            this, SLOT(contentChangedEvent(QContentIdList,QContent::ChangeType)));
+    connect(QContentUpdateManager::instance(), SIGNAL(refreshRequested()),
+            this, SLOT(contentChangedEvent()));
+#endif
+}
+
+QSqlPagedContentSetEngine::~QSqlPagedContentSetEngine()
+{
+    {
+        QMutexLocker locker( &m_mutex );
+
+        m_deletePending = true; // Tell the loader thread to quit.
+    }
+
+    if( m_loader )
+    {
+        do
+        {
+            m_loadCondition.wakeAll();
+        }
+        while( !m_loader->wait( 300 ) );
+
+        delete m_loader;
+    }
+}
+
+/*!
+    \reimp
+*/
+int QSqlPagedContentSetEngine::count() const
+{
+    return m_count;
+}
+
+/*!
+    \reimp
+
+    Paged content sets only contain content matching the filter, explicitly added content is ignored.
+*/
+void QSqlPagedContentSetEngine::insertContent( const QContent &content )
+{
+    Q_UNUSED( content );
+
+    qWarning() << "QContentSet::add() is not supported by paged content sets";
+}
+
+/*!
+    \reimp
+
+    Paged content sets only contain content matching the filter, explicitly added content is ignored.
+*/
+void QSqlPagedContentSetEngine::removeContent( const QContent &content )
+{
+    Q_UNUSED( content );
+
+    qWarning() << "QContentSet::remove() is not supported by paged content sets";
+}
+
+/*!
+    \reimp
+*/
+void QSqlPagedContentSetEngine::clear()
+{
+    setSortCriteria( QContentSortCriteria() );
+    setFilter( QContentFilter() );
+}
+
+/*!
+    \reimp
+*/
+void QSqlPagedContentSetEngine::commitChanges()
+{
+    {
+        QMutexLocker locker( &m_mutex );
+
+        if( m_criteriaChanged )
+        {
+            m_resetPending = true;
+            m_criteriaChanged = false;
+            m_contentChanged = false;
+        }
+        else if( m_contentChanged )
+        {
+            m_syncPending = true;
+            m_contentChanged = false;
+        }
+        else
+        {
+            return;
+        }
+
+        m_loadCondition.wakeAll();
+    }
+
+    if( !m_loader )
+    {
+        m_loader = new QSqlPagedContentSetLoader( this );
+        m_loader->start( QThread::LowPriority );
+    }
+}
+
+/*!
+    \reimp
+*/
+bool QSqlPagedContentSetEngine::contains( const QContent &content ) const
+{
+    return filter().test( content );
+}
+
+/*!
+    \reimp
+*/
+void QSqlPagedContentSetEngine::filterChanged( const QContentFilter &filter )
+{
+    QMutexLocker locker( &m_mutex );
+
+    m_criteriaChanged = true;
+    m_filter = filter;
+}
+
+/*!
+    \reimp
+*/
+void QSqlPagedContentSetEngine::sortCriteriaChanged( const QContentSortCriteria &sort )
+{
+    QMutexLocker locker( &m_mutex );
+
+    m_criteriaChanged = true;
+    m_order = sort;
+}
+
+void QSqlPagedContentSetEngine::contentChangedEvent()
+{
+    QMutexLocker locker( &m_mutex );
+
+    m_contentChanged = true;
+}
+
+void QSqlPagedContentSetEngine::contentChangedEvent(const QContentIdList &contentIds, QContent::ChangeType type)
+{
+    QMutexLocker locker( &m_mutex );
+
+    m_contentChanged = true;
+
+    if (type == QContent::Updated)
+        m_updatedIds += contentIds;
+}
+
+int QSqlPagedContentSetEngine::valueCount() const
+{
+    return m_count;
+}
+
+/*!
+    Returns the content between \a index and \a index + \a count.  Content which isn't in the loaded window is returned
+    as a null QContent and the pages containing it are queued for loading.
+*/
+QList< QContent > QSqlPagedContentSetEngine::values( int index, int count )
+{
+    const int windowStart = qMax( index, m_windowStart );
+    const int windowEnd = qMin( index + count, m_windowStart + m_windowIds.count() );
+
+    QContentList content;
+
+    if( windowStart < windowEnd )
+        content = m_store->contentFromIds( m_windowIds.mid( windowStart - m_windowStart, windowEnd - windowStart ) );
+
+    QList< QContent > values;
+
+    for( int i = index; i < index + count; i++ )
+    {
+        if( i >= windowStart && i < windowEnd )
+        {
+            values.append( content.at( i - windowStart ) );
+        }
+        else
+        {
+            requestPage( i / PageSize );
+
+            values.append( QContent() );
+        }
+    }
+
+    return values;
+}
+
+/*!
+    Queues the \a page for loading by the loader thread if it hasn't been requested already.  The most recently
+    requested pages are loaded first.
+*/
+void QSqlPagedContentSetEngine::requestPage( int page )
+{
+    if( m_requestedPages.contains( page ) )
+        return;
+
+    m_requestedPages.insert( page );
+
+    QMutexLocker locker( &m_mutex );
+
+    m_pageQueue.append( page );
+
+    m_loadCondition.wakeAll();
+}
+
+/*!
+    Performs the next job queued for the loader thread, waiting until one is queued if necessary.
+
+    Returns false if the engine is being destroyed and the loader thread should exit.
+*/
+bool QSqlPagedContentSetEngine::load()
+{
+    Result result;
+
+    {
+        QMutexLocker locker( &m_mutex );
+
+        while( !m_deletePending && !m_resetPending && !m_syncPending && m_pageQueue.isEmpty() )
+            m_loadCondition.wait( &m_mutex );
+
+        if( m_deletePending )
+            return false;
+
+        if( m_resetPending )
+        {
+            result.type = ResetResult;
+
+            m_loaderFilter = m_filter;
+            m_loaderOrder = m_order;
+
+            m_resetPending = false;
+            m_syncPending = false;
+            m_updatedIds.clear();
+            m_pageQueue.clear();
+        }
+        else if( m_syncPending )
+        {
+            result.type = SyncResult;
+            result.start = m_loadedStart;
+            result.count = m_loadedCount;
+            result.updatedIds = m_updatedIds;
+
+            m_syncPending = false;
+            m_updatedIds.clear();
+        }
+        else
+        {
+            result.type = PageResult;
+            result.start = m_pageQueue.takeLast() * PageSize;
+            result.count = PageSize;
+        }
+    }
+
+    switch( result.type )
+    {
+    case ResetResult:
+        recount();
+
+        result.start = 0;
+        result.contentIds = fetch( 0, PageSize );
+        break;
+    case SyncResult:
+        recount();
+
+        result.start = qMin( result.start, m_loaderCount );
+        result.contentIds = fetch( result.start, result.count );
+        break;
+    case PageResult:
+        result.contentIds = fetch( result.start, result.count );
+        break;
+    }
+
+    result.generation = m_loaderGeneration;
+    result.count = m_loaderCount;
+
+    postResult( result );
+
+    return true;
+}
+
+/*!
+    Queries the number of content records in each database matching the filter and invalidates the pages loaded
+    for the previous counts.
+*/
+void QSqlPagedContentSetEngine::recount()
+{
+    m_databaseIds.clear();
+    m_databaseCounts.clear();
+    m_checkpoints.clear();
+    m_loaderCount = 0;
+
+    foreach( QtopiaDatabaseId databaseId, QtopiaSql::instance()->databaseIds() )
+    {
+        int count = m_store->contentCount( databaseId, m_loaderFilter );
+
+        if( count > 0 )
+        {
+            m_databaseIds.append( databaseId );
+            m_databaseCounts.append( count );
+
+            m_loaderCount += count;
+        }
+    }
+
+    m_checkpoints.insert( 0, QVector< int >( m_databaseIds.count(), 0 ) );
+
+    m_loaderGeneration++;
+}
+
+/*!
+    Returns the ids of up to \a count content records starting at \a start.
+
+    With a single database the ids are selected directly, otherwise the ids selected from each database are merged
+    starting from the nearest recorded page offsets preceding \a start.
+*/
+QContentIdList QSqlPagedContentSetEngine::fetch( int start, int count )
+{
+    if( m_databaseIds.isEmpty() || start >= m_loaderCount )
+        return QContentIdList();
+    else if( m_databaseIds.count() == 1 )
+        return m_store->matches( m_databaseIds.first(), m_loaderFilter, m_loaderOrder, start, count );
+
+    QMap< int, QVector< int > >::const_iterator checkpoint = m_checkpoints.upperBound( start / PageSize );
+
+    --checkpoint;
+
+    const int sets = m_databaseIds.count();
+    const int end = qMin( start + count, m_loaderCount );
+
+    int index = checkpoint.key() * PageSize;
+
+    QVector< int > offsets = checkpoint.value();
+    QVector< QContentIdList > contentIds( sets );
+    QVector< QContentList > content( sets );
+    QVector< int > cursors( sets, 0 );
+
+    QContentIdList ids;
+
+    while( index < end )
+    {
+        if( index % PageSize == 0 && !m_checkpoints.contains( index / PageSize ) )
+            m_checkpoints.insert( index / PageSize, offsets );
+
+        int minimumSet = -1;
+
+        for( int set = 0; set < sets; set++ )
+        {
+            if( cursors.at( set ) == contentIds.at( set ).count() && offsets.at( set ) < m_databaseCounts.at( set ) )
+            {
+                contentIds[ set ] = m_store->matches(
+                        m_databaseIds.at( set ), m_loaderFilter, m_loaderOrder, offsets.at( set ), PageSize );
+                content[ set ] = m_store->contentFromIds( m_databaseIds.at( set ), contentIds.at( set ) );
+                cursors[ set ] = 0;
+
+                // The database has changed since it was counted, a sync will follow.
+                if( contentIds.at( set ).isEmpty() )
+                    m_databaseCounts[ set ] = offsets.at( set );
+            }
+
+            if( cursors.at( set ) < contentIds.at( set ).count() && (minimumSet == -1 || m_loaderOrder.lessThan(
+                    content.at( set ).at( cursors.at( set ) ),
+                    content.at( minimumSet ).at( cursors.at( minimumSet ) ) ) ) )
+            {
+                minimumSet = set;
+            }
+        }
+
+        if( minimumSet == -1 )
+            break;
+
+        if( index >= start )
+            ids.append( contentIds.at( minimumSet ).at( cursors.at( minimumSet ) ) );
+
+        cursors[ minimumSet ]++;
+        offsets[ minimumSet ]++;
+        index++;
+    }
+
+    return ids;
+}
+
+/*!
+    Queues a \a result from the loader thread to be applied by the thread the engine lives in.
+*/
+void QSqlPagedContentSetEngine::postResult( const Result &result )
+{
+    QMutexLocker locker( &m_mutex );
+
+    m_results.append( result );
+
+    if( m_results.count() == 1 )
+        QMetaObject::invokeMethod( this, "processResults", Qt::QueuedConnection );
+}
+
+/*!
+    Applies the results posted by the loader thread.
+*/
+void QSqlPagedContentSetEngine::processResults()
+{
+    QList< Result > results;
+
+    {
+        QMutexLocker locker( &m_mutex );
+
+        results = m_results;
+
+        m_results.clear();
+    }
+
+    foreach( const Result &result, results )
+    {
+        switch( result.type )
+        {
+        case ResetResult:
+            applyReset( result );
+            break;
+        case SyncResult:
+            applySync( result );
+            break;
+        case PageResult:
+            applyPage( result );
+            break;
+        }
+    }
+
+    QMutexLocker locker( &m_mutex );
+
+    m_loadedStart = m_windowStart;
+    m_loadedCount = m_windowIds.count();
+}
+
+/*!
+    Replaces the entire content of the set with the first page of the \a result of a change in filter or sort
+    criteria.
+*/
+void QSqlPagedContentSetEngine::applyReset( const Result &result )
+{
+    startUpdate();
+
+    if( m_count > 0 )
+    {
+        emit contentAboutToBeRemoved( 0, m_count - 1 );
+
+        removeRange( 0, m_count );
+
+        m_count = 0;
+
+        emit contentRemoved();
+    }
+
+    m_generation = result.generation;
+    m_requestedPages.clear();
+
+    m_windowStart = 0;
+    m_windowIds = result.contentIds;
+
+    if( result.count > 0 )
+    {
+        emit contentAboutToBeInserted( 0, result.count - 1 );
+
+        insertRange( 0, result.count );
+
+        m_count = result.count;
+
+        emit contentInserted();
+    }
+
+    finishUpdate();
+}
+
+/*!
+    Updates the set to reflect the \a result of a change in the content database.
+
+    The reloaded window is compared with the current window and any content inserted or removed is signalled
+    individually.  The remaining difference in the size of the set is signalled immediately after the window.
+*/
+void QSqlPagedContentSetEngine::applySync( const Result &result )
+{
+    startUpdate();
+
+    m_generation = result.generation;
+
+    // Pages requested before the sync have been discarded, so the placeholders cached for them have to be requested
+    // again.
+    bool changed = !m_requestedPages.isEmpty();
+
+    m_requestedPages.clear();
+
+    // If the window has moved since the sync was requested the reloaded content can't be compared with it, instead
+    // the window is replaced after the size of the set has been updated.
+    const bool comparable = result.start == m_windowStart;
+
+    const QContentIdList contentIds = comparable ? result.contentIds : QContentIdList();
+
+    if( !comparable )
+        m_windowIds.clear();
+    else if( m_windowIds.count() > contentIds.count() && result.start + contentIds.count() < result.count )
+        m_windowIds = m_windowIds.mid( 0, contentIds.count() ); // The window was extended after the sync was requested.
+
+    QSet< QContentId > remainingIds;
+    QSet< QContentId > newIds;
+
+    for( int i = 0; i < m_windowIds.count(); i++ )
+        remainingIds.insert( m_windowIds.at( i ) );
+    for( int i = 0; i < contentIds.count(); i++ )
+        newIds.insert( contentIds.at( i ) );
+
+    int index = 0;
+
+    while( index < m_windowIds.count() && index < contentIds.count() )
+    {
+        const QContentId oldId = m_windowIds.at( index );
+
+        if( oldId == contentIds.at( index ) )
+        {
+            remainingIds.remove( oldId );
+
+            if( result.updatedIds.contains( oldId ) )
+                windowRefresh( m_windowStart + index, 1 );
+
+            index++;
+        }
+        else if( !remainingIds.contains( contentIds.at( index ) ) )
+        {
+            int insertCount = 1;
+
+            while( index + insertCount < contentIds.count() && !remainingIds.contains( contentIds.at( index + insertCount ) ) )
+                insertCount++;
+
+            windowInsert( m_windowStart + index, contentIds.mid( index, insertCount ) );
+
+            index += insertCount;
+
+            changed = true;
+        }
+        else
+        {
+            // Either removed or moved to a later position, in which case it will be inserted again there.
+            int removeCount = 1;
+
+            remainingIds.remove( oldId );
+
+            while( index + removeCount < m_windowIds.count()
+                   && m_windowIds.at( index + removeCount ) != contentIds.at( index )
+                   && !newIds.contains( m_windowIds.at( index + removeCount ) ) )
+            {
+                remainingIds.remove( m_windowIds.at( index + removeCount ) );
+
+                removeCount++;
+            }
+
+            windowRemove( m_windowStart + index, removeCount );
+
+            changed = true;
+        }
+    }
+
+    if( index < m_windowIds.count() )
+    {
+        windowRemove( m_windowStart + index, m_windowIds.count() - index );
+
+        changed = true;
+    }
+
+    if( index < contentIds.count() )
+    {
+        windowInsert( m_windowStart + index, contentIds.mid( index ) );
+
+        changed = true;
+    }
+
+    const int windowEnd = m_windowStart + m_windowIds.count();
+
+    if( result.count > m_count )
+    {
+        emit contentAboutToBeInserted( windowEnd, windowEnd + result.count - m_count - 1 );
+
+        insertRange( windowEnd, result.count - m_count );
+
+        m_count = result.count;
+
+        emit contentInserted();
+
+        changed = true;
+    }
+    else if( result.count < m_count )
+    {
+        emit contentAboutToBeRemoved( windowEnd, windowEnd + m_count - result.count - 1 );
+
+        removeRange( windowEnd, m_count - result.count );
+
+        m_count = result.count;
+
+        emit contentRemoved();
+
+        changed = true;
+    }
+
+    if( !comparable )
+    {
+        m_windowStart = result.start;
+        m_windowIds = result.contentIds;
+
+        changed = true;
+    }
+
+    // Content outside the window may have moved without changing the size of the set, so the placeholders cached
+    // outside the window are discarded and requested again.
+    if( changed && m_count > 0 )
+    {
+        clearCache();
+
+        emit contentChanged( 0, m_count - 1 );
+    }
+
+    finishUpdate();
+}
+
+/*!
+    Merges a page loaded by the loader thread into the window, and refreshes any cached content for the page.
+
+    Pages adjacent to the window extend it up to the maximum window size, after which content on the opposite side
+    of the window is discarded.  Pages which aren't adjacent to the window replace it.
+*/
+void QSqlPagedContentSetEngine::applyPage( const Result &result )
+{
+    if( result.generation != m_generation )
+        return;
+
+    m_requestedPages.remove( result.start / PageSize );
+
+    if( result.contentIds.isEmpty() )
+        return;
+
+    const int start = result.start;
+    const int end = start + result.contentIds.count();
+    const int windowEnd = m_windowStart + m_windowIds.count();
+
+    // Only content within the window is cached so updates to content outside of it don't need to be tracked.
+    bool discarded = true;
+
+    if( m_windowIds.isEmpty() || start > windowEnd || end < m_windowStart )
+    {
+        m_windowStart = start;
+        m_windowIds = result.contentIds;
+    }
+    else
+    {
+        const int mergedStart = qMin( start, m_windowStart );
+        const int mergedEnd = qMax( end, windowEnd );
+
+        QContentIdList contentIds;
+
+        for( int i = mergedStart; i < mergedEnd; i++ )
+        {
+            if( i >= start && i < end )
+                contentIds.append( result.contentIds.at( i - start ) );
+            else
+                contentIds.append( m_windowIds.at( i - m_windowStart ) );
+        }
+
+        m_windowStart = mergedStart;
+        m_windowIds = contentIds;
+
+        discarded = m_windowIds.count() > MaximumWindowSize;
+
+        if( discarded )
+        {
+            if( start < m_windowStart + MaximumWindowSize / 2 )
+            {
+                m_windowIds = m_windowIds.mid( 0, MaximumWindowSize );
+            }
+            else
+            {
+                int discard = m_windowIds.count() - MaximumWindowSize;
+
+                m_windowIds = m_windowIds.mid( discard );
+                m_windowStart += discard;
+            }
+        }
+    }
+
+    if( discarded )
+        clearCache();
+    else
+        refreshRange( start, end - start );
+
+    emit contentChanged( start, end - 1 );
+}
+
+/*!
+    Inserts \a contentIds into the window at the set \a index, and signals the insertion.
+*/
+void QSqlPagedContentSetEngine::windowInsert( int index, const QContentIdList &contentIds )
+{
+    emit contentAboutToBeInserted( index, index + contentIds.count() - 1 );
+
+    for( int i = 0; i < contentIds.count(); i++ )
+        m_windowIds.insert( index - m_windowStart + i, contentIds.at( i ) );
+
+    insertRange( index, contentIds.count() );
+
+    m_count += contentIds.count();
+
+    emit contentInserted();
+}
+
+/*!
+    Removes \a count ids from the window at the set \a index, and signals the removal.
+*/
+void QSqlPagedContentSetEngine::windowRemove( int index, int count )
+{
+    if( count <= 0 )
+        return;
+
+    emit contentAboutToBeRemoved( index, index + count - 1 );
+
+    for( int i = 0; i < count; i++ )
+        m_windowIds.removeAt( index - m_windowStart );
+
+    removeRange( index, count );
+
+    m_count -= count;
+
+    emit contentRemoved();
+}
+
+/*!
+    Ensure the contents of the cache are up to date in the range starting at \a index with \a count items.
+*/
+void QSqlPagedContentSetEngine::windowRefresh( int index, int count )
+{
+    refreshRange( index, count );
+
+    emit contentChanged( index, index + count - 1 );
+}
+
+#include "qsqlpagedcontentsetengine.moc"
@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+#ifndef QSQLPAGEDCONTENTSETENGINE_P_H
+#define QSQLPAGEDCONTENTSETENGINE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Extended API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qcontentsetengine_p.h"
+#include <QContent>
+#include <QMap>
+#include <QMutex>
+#include <QSet>
+#include <QWaitCondition>
+#include <QVector>
+
+class QSqlContentStore;
+class QSqlPagedContentSetLoader;
+
+class QSqlPagedContentSetEngine : public QContentSetEngine
+{
+    Q_OBJECT
+public:
+    QSqlPagedContentSetEngine( const QContentFilter &filter, const QContentSortCriteria &order, QSqlContentStore *store );
+    virtual ~QSqlPagedContentSetEngine();
+    virtual int count() const;
+
+    virtual void insertContent( const QContent &content );
+    virtual void removeContent( const QContent &content );
+
+    virtual void clear();
+
+    virtual void commitChanges();
+
+    virtual bool contains( const QContent &content ) const;
+
+protected:
+    virtual void filterChanged( const QContentFilter &filter );
+    virtual void sortCriteriaChanged( const QContentSortCriteria &sort );
+
+private slots:
+    void contentChangedEvent();
+    void contentChangedEvent(const QContentIdList &contentIds, QContent::ChangeType type);
+
+    void processResults();
+
+private:
+    enum
+    {
+        PageSize = 64,
+        MaximumWindowSize = 8 * PageSize
+    };
+
+    enum ResultType
+    {
+        ResetResult,
+        SyncResult,
+        PageResult
+    };
+
+    struct Result
+    {
+        ResultType type;
+        int generation;
+        int count;
+        int start;
+        QContentIdList contentIds;
+        QContentIdList updatedIds;
+    };
+
+    virtual int valueCount() const;
+    virtual QList< QContent > values( int index, int count );
+
+    bool load();
+    void recount();
+    QContentIdList fetch( int start, int count );
+    void postResult( const Result &result );
+
+    void requestPage( int page );
+
+    void applyReset( const Result &result );
+    void applySync( const Result &result );
+    void applyPage( const Result &result );
+
+    void windowInsert( int index, const QContentIdList &contentIds );
+    void windowRemove( int index, int count );
+    void windowRefresh( int index, int count );
+
+    QSqlContentStore *m_store;
+
+    // Shared with the loader thread, guarded by m_mutex.
+    QContentFilter m_filter;
+    QContentSortCriteria m_order;
+    QContentIdList m_updatedIds;
+    QList< int > m_pageQueue;
+    QList< Result > m_results;
+    int m_loadedStart;
+    int m_loadedCount;
+    bool m_criteriaChanged;
+    bool m_contentChanged;
+    bool m_resetPending;
+    bool m_syncPending;
+    bool m_deletePending;
+    mutable QMutex m_mutex;
+    QWaitCondition m_loadCondition;
+    QSqlPagedContentSetLoader *m_loader;
+
+    // Owned by the loader thread.
+    QContentFilter m_loaderFilter;
+    QContentSortCriteria m_loaderOrder;
+    QList< QtopiaDatabaseId > m_databaseIds;
+    QVector< int > m_databaseCounts;
+    QMap< int, QVector< int > > m_checkpoints;
+    int m_loaderCount;
+    int m_loaderGeneration;
+
+    // Owned by the thread the engine lives in.
+    QContentIdList m_windowIds;
+    QSet< int > m_requestedPages;
+    int m_windowStart;
+    int m_count;
+    int m_generation;
+
+    friend class QSqlPagedContentSetLoader;
+};
+
+#endif
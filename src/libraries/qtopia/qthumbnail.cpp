@@ -33,6 +33,10 @@
   are loaded by methods more efficient than the naive method of simply loading the entire image
   and scaling it down. For other formats, the naive method is used.
 
+  Thumbnails of images in the documents system are pre-generated by the content server, and
+  where a thumbnail of a file is available at a suitable size it is used without decoding the
+  image at all.
+
   This code paints the contents of \c image.jpg centered on the calling widget:
 
   \code
@@ -47,6 +51,7 @@
 */
 
 #include "qthumbnail.h"
+#include "qthumbnailcache_p.h"
 
 #include <QByteArray>
 #include <QFile>
@@ -61,6 +66,7 @@ class QThumbnailPrivate
 {
 public:
     QImageReader *reader;
+    QString fileName;
 };
 
 #define JPEG_DECOMPRESSION_QUALITY 10
@@ -74,6 +80,7 @@ QThumbnail::QThumbnail( const QString& fileName )
     d = new QThumbnailPrivate;
 
     d->reader = new QImageReader( fileName );
+    d->fileName = fileName;
 
     // Enable fast decompression if supported
     if ( d->reader->supportsOption( QImageIOHandler::Quality ) ) {
@@ -139,9 +146,12 @@ QSize QThumbnail::actualSize( const QSize& size, Qt::AspectRatioMode mode )
         return size;
     }
 
-    QSize actual;
+    QSize actual = QThumbnailCache::sourceSize( d->fileName );
 
-    if( d->reader->supportsOption( QImageIOHandler::Size ) ) {
+    if( actual.isValid() ) {
+        if (size.isValid())
+            actual.scale( size, mode );
+    } else if( d->reader->supportsOption( QImageIOHandler::Size ) ) {
         actual = d->reader->size();
         if (size.isValid())
             actual.scale( size, mode );
@@ -170,6 +180,11 @@ QSize QThumbnail::actualSize( const QSize& size, Qt::AspectRatioMode mode )
 */
 QPixmap QThumbnail::pixmap( const QSize& size, Qt::AspectRatioMode mode, Qt::TransformationMode transformationMode )
 {
+    // Use a pre-generated thumbnail if one is cached
+    QImage cached = QThumbnailCache::thumbnail( d->fileName, size, mode, transformationMode );
+    if( !cached.isNull() )
+        return QPixmap::fromImage( cached );
+
     // If supported, use handler to scale image
     // Otherwise, load then scale image
     bool notScaled = true;
@@ -0,0 +1,1085 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qthumbnailcache_p.h"
+
+#include <qexifimageheader.h>
+#include <qtopianamespace.h>
+#include <qtopialog.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QTime>
+#include <QVector>
+#include <QtAlgorithms>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+/*
+    The thumbnail cache is a directory of packed segment files written by the
+    content server and memory mapped read-only by every process showing
+    thumbnails.  Each segment consists of a header, a table of entries sorted
+    by the hash of the file name they belong to, and the file names and raw
+    pixel data the entries refer to.  Each file has an entry for each of the
+    cached sizes, so a thumbnail can be served by copying (or at most down
+    scaling) the smallest size large enough without decoding anything.
+
+    Segments are numbered in the order they are written and a file's entries in
+    a newer segment supersede those in older ones.  A commit only writes the
+    thumbnails generated since the last as a new segment, newer segments are
+    merged once they grow to half the size of the one before them so there are
+    only ever a few, and everything is rewritten only when the cache outgrows
+    its maximum size.  Segments are never modified once written, so readers
+    holding a mapping of one are unaffected by the content server replacing or
+    removing it.
+
+    Readers record the time each file was last looked up in a small shared
+    table indexed by the hash of its name, and when the cache is full the
+    thumbnails of the files used least recently are dropped.  A file whose
+    thumbnails were dropped keeps an entry without any image data, so it is
+    not regenerated on the next scan unless it has been looked up since.
+*/
+
+static const quint32 ThumbnailCacheMagic = 0x51544843; // QTHC
+static const quint32 ThumbnailCacheVersion = 2;
+
+// Longest side of each of the sizes thumbnails are cached at, largest first.
+static const int ThumbnailSizes[] = { 128, 64, 32 };
+static const int ThumbnailSizeCount = sizeof(ThumbnailSizes) / sizeof(ThumbnailSizes[0]);
+
+// Bounds of the default cache size, which is a hundredth of the storage the
+// cache is on.
+static const qint64 MinimumCacheSize = 8 * 1024 * 1024;
+static const qint64 MaximumCacheSize = 64 * 1024 * 1024;
+
+// Number of slots in the table of last access times.  Files whose names hash
+// to the same slot share an access time.
+static const int AccessSlotCount = 16384;
+
+// Minimum number of milliseconds between checks for new cache segments.
+static const int RevalidateInterval = 1000;
+
+struct ThumbnailCacheHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 entryCount;
+    quint32 entryOffset;
+};
+
+// A file whose thumbnails have been evicted has a single entry with a width
+// and height of 0.
+struct ThumbnailCacheEntry
+{
+    quint64 documentId;
+    quint32 databaseId;
+    quint32 nameHash;
+    quint32 nameOffset;
+    quint32 nameLength;
+    quint32 lastModified;
+    quint32 added;
+    quint32 sourceWidth;
+    quint32 sourceHeight;
+    quint32 width;
+    quint32 height;
+    quint32 format;
+    quint32 bytesPerLine;
+    quint32 dataOffset;
+    quint32 reserved;
+};
+
+static bool entryHashLessThan(const ThumbnailCacheEntry &entry, quint32 hash)
+{
+    return entry.nameHash < hash;
+}
+
+static QString segmentName(quint32 segment)
+{
+    return QString::fromLatin1("%1.cache").arg(segment, 8, 16, QLatin1Char('0'));
+}
+
+/*
+    Returns the entries of the cache segment \a data of \a size bytes and sets
+    \a count to the number of entries, or returns 0 if the segment is invalid.
+*/
+static const ThumbnailCacheEntry *segmentEntries(const uchar *data, qint64 size, int *count)
+{
+    if (size < qint64(sizeof(ThumbnailCacheHeader)))
+        return 0;
+
+    const ThumbnailCacheHeader *header = reinterpret_cast<const ThumbnailCacheHeader *>(data);
+
+    if (header->magic != ThumbnailCacheMagic
+        || header->version != ThumbnailCacheVersion
+        || header->entryOffset + qint64(header->entryCount) * qint64(sizeof(ThumbnailCacheEntry)) > size) {
+        return 0;
+    }
+
+    *count = header->entryCount;
+
+    return reinterpret_cast<const ThumbnailCacheEntry *>(data + header->entryOffset);
+}
+
+/*
+    The table of the times files were last looked up in the thumbnail cache,
+    shared by every process through a writable mapping.  Entries are only
+    hints so updates are not synchronized.
+*/
+class QThumbnailAccessTable
+{
+public:
+    QThumbnailAccessTable();
+    ~QThumbnailAccessTable();
+
+    bool open(bool create);
+
+    void touch(quint32 hash);
+    quint32 lastAccess(quint32 hash) const;
+
+private:
+    QFile m_file;
+    quint32 *m_slots;
+};
+
+QThumbnailAccessTable::QThumbnailAccessTable()
+    : m_slots(0)
+{
+}
+
+QThumbnailAccessTable::~QThumbnailAccessTable()
+{
+    if (m_slots)
+        m_file.unmap(reinterpret_cast<uchar *>(m_slots));
+}
+
+/*
+    Maps the access table, creating it if \a create is true.
+*/
+bool QThumbnailAccessTable::open(bool create)
+{
+    if (m_slots)
+        return true;
+
+    const qint64 size = AccessSlotCount * sizeof(quint32);
+
+    m_file.setFileName(QThumbnailCache::cachePath() + QLatin1String("access"));
+
+    if ((!create && !m_file.exists()) || !m_file.open(QIODevice::ReadWrite))
+        return false;
+
+    if (m_file.size() == size || (create && m_file.resize(size)))
+        m_slots = reinterpret_cast<quint32 *>(m_file.map(0, size));
+
+    if (!m_slots)
+        m_file.close();
+
+    return m_slots != 0;
+}
+
+/*
+    Records that a file with the name \a hash has been looked up.
+*/
+void QThumbnailAccessTable::touch(quint32 hash)
+{
+    if (m_slots) {
+        const quint32 now = ::time(0);
+
+        // Avoid dirtying the page on every lookup.
+        if (m_slots[hash % AccessSlotCount] != now)
+            m_slots[hash % AccessSlotCount] = now;
+    }
+}
+
+/*
+    Returns the time a file with the name \a hash was last looked up, or 0 if
+    it is not known.
+*/
+quint32 QThumbnailAccessTable::lastAccess(quint32 hash) const
+{
+    return m_slots ? m_slots[hash % AccessSlotCount] : 0;
+}
+
+class QThumbnailCacheFile
+{
+public:
+    QThumbnailCacheFile();
+    ~QThumbnailCacheFile();
+
+    QImage thumbnail(
+            const QString &fileName,
+            QContentId id,
+            const QSize &size,
+            Qt::AspectRatioMode mode,
+            Qt::TransformationMode transformationMode);
+
+    QSize sourceSize(const QString &fileName);
+
+private:
+    struct Segment
+    {
+        QString name;
+        ino_t inode;
+        QFile *file;
+        const uchar *data;
+        qint64 size;
+    };
+
+    void revalidate();
+    static bool map(Segment *segment);
+    static void unmap(Segment *segment);
+    const ThumbnailCacheEntry *find(const QString &fileName, QContentId id, const uchar **data, int *count);
+
+    QMutex m_mutex;
+    QList<Segment> m_segments;
+    QThumbnailAccessTable m_access;
+    QTime m_lastCheck;
+    bool m_checked;
+};
+
+Q_GLOBAL_STATIC(QThumbnailCacheFile, thumbnailCacheFile);
+
+QThumbnailCacheFile::QThumbnailCacheFile()
+    : m_checked(false)
+{
+}
+
+QThumbnailCacheFile::~QThumbnailCacheFile()
+{
+    for (int i = 0; i < m_segments.count(); ++i)
+        unmap(&m_segments[i]);
+}
+
+QImage QThumbnailCacheFile::thumbnail(
+        const QString &fileName,
+        QContentId id,
+        const QSize &size,
+        Qt::AspectRatioMode mode,
+        Qt::TransformationMode transformationMode)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const uchar *data = 0;
+    int count = 0;
+
+    const ThumbnailCacheEntry *entry = find(fileName, id, &data, &count);
+
+    if (!entry)
+        return QImage();
+
+    QSize sourceSize(entry->sourceWidth, entry->sourceHeight);
+
+    QSize target = sourceSize;
+    target.scale(size, mode);
+
+    // Entries are sorted from smallest to largest, use the first which is
+    // either large enough or is the full size image.
+    for (int i = 0; i < count; ++i, ++entry) {
+        if (entry->width == 0 || entry->height == 0)
+            continue;
+
+        if ((entry->width >= uint(target.width()) && entry->height >= uint(target.height()))
+            || (entry->width == entry->sourceWidth && entry->height == entry->sourceHeight)) {
+            QImage image(
+                    data + entry->dataOffset,
+                    entry->width,
+                    entry->height,
+                    entry->bytesPerLine,
+                    QImage::Format(entry->format));
+
+            // Either way the returned image must not refer to the mapped file.
+            return image.size() != target
+                    ? image.scaled(target, Qt::IgnoreAspectRatio, transformationMode)
+                    : image.copy();
+        }
+    }
+
+    return QImage();
+}
+
+QSize QThumbnailCacheFile::sourceSize(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const uchar *data = 0;
+    int count = 0;
+
+    const ThumbnailCacheEntry *entry = find(fileName, QContent::InvalidId, &data, &count);
+
+    return entry ? QSize(entry->sourceWidth, entry->sourceHeight) : QSize();
+}
+
+/*
+    Returns the first of the entries for the current version of \a fileName,
+    sets \a data to the segment containing them and \a count to the number of
+    entries for it, or returns 0 if the file has no thumbnails or they are out
+    of date.
+*/
+const ThumbnailCacheEntry *QThumbnailCacheFile::find(
+        const QString &fileName, QContentId id, const uchar **data, int *count)
+{
+    revalidate();
+
+    if (m_segments.isEmpty() || fileName.isEmpty() || fileName.startsWith(QLatin1Char(':')))
+        return 0;
+
+    const quint32 hash = qHash(fileName);
+
+    m_access.touch(hash);
+
+    const int nameBytes = fileName.length() * sizeof(QChar);
+
+    // The newest segment with an entry for the file has its current entries.
+    foreach (const Segment &segment, m_segments) {
+        int entryCount = 0;
+
+        const ThumbnailCacheEntry *begin = segmentEntries(segment.data, segment.size, &entryCount);
+        const ThumbnailCacheEntry *end = begin + entryCount;
+
+        const ThumbnailCacheEntry *entry = qLowerBound(begin, end, hash, entryHashLessThan);
+
+        for (; entry != end && entry->nameHash == hash; ++entry) {
+            if (entry->nameLength != uint(fileName.length())
+                || entry->nameOffset + nameBytes > segment.size
+                || memcmp(segment.data + entry->nameOffset, fileName.unicode(), nameBytes) != 0) {
+                continue;
+            }
+
+            if (id != QContent::InvalidId && (entry->databaseId != id.first || entry->documentId != id.second))
+                return 0;
+
+            if (entry->lastModified != QFileInfo(fileName).lastModified().toTime_t())
+                return 0;
+
+            const ThumbnailCacheEntry *first = entry;
+
+            for (*count = 0; entry != end && entry->nameOffset == first->nameOffset; ++entry)
+                ++*count;
+
+            *data = segment.data;
+
+            return first;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Maps the segments written and unmaps those removed since the cache was
+    last checked.
+*/
+void QThumbnailCacheFile::revalidate()
+{
+    if (m_checked && m_lastCheck.elapsed() < RevalidateInterval)
+        return;
+
+    m_checked = true;
+    m_lastCheck.start();
+
+    const QString path = QThumbnailCache::cachePath();
+
+    m_access.open(false);
+
+    const QStringList names = QDir(path).entryList(
+            QStringList() << QLatin1String("*.cache"), QDir::Files, QDir::Name | QDir::Reversed);
+
+    QList<Segment> segments;
+
+    foreach (const QString &name, names) {
+        struct stat status;
+
+        if (::stat(QFile::encodeName(path + name).constData(), &status) != 0)
+            continue;
+
+        Segment segment;
+        segment.name = name;
+        segment.inode = status.st_ino;
+        segment.file = 0;
+        segment.data = 0;
+        segment.size = 0;
+
+        // Segments are never modified, but one may have been removed and
+        // another written with the same name.
+        for (int i = 0; i < m_segments.count(); ++i) {
+            if (m_segments.at(i).name == name && m_segments.at(i).inode == segment.inode) {
+                segment = m_segments.takeAt(i);
+
+                break;
+            }
+        }
+
+        if (segment.data || map(&segment))
+            segments.append(segment);
+    }
+
+    for (int i = 0; i < m_segments.count(); ++i)
+        unmap(&m_segments[i]);
+
+    m_segments = segments;
+}
+
+bool QThumbnailCacheFile::map(Segment *segment)
+{
+    segment->file = new QFile(QThumbnailCache::cachePath() + segment->name);
+
+    int count = 0;
+
+    if (segment->file->open(QIODevice::ReadOnly)) {
+        segment->size = segment->file->size();
+
+        if (segment->size >= qint64(sizeof(ThumbnailCacheHeader)))
+            segment->data = segment->file->map(0, segment->size);
+
+        if (segment->data && !segmentEntries(segment->data, segment->size, &count)) {
+            qWarning() << "Ignoring invalid thumbnail cache" << segment->file->fileName();
+
+            segment->file->unmap(const_cast<uchar *>(segment->data));
+            segment->data = 0;
+        }
+    }
+
+    if (!segment->data) {
+        delete segment->file;
+
+        segment->file = 0;
+        segment->size = 0;
+    }
+
+    return segment->data != 0;
+}
+
+void QThumbnailCacheFile::unmap(Segment *segment)
+{
+    if (segment->data)
+        segment->file->unmap(const_cast<uchar *>(segment->data));
+
+    delete segment->file;
+
+    segment->file = 0;
+    segment->data = 0;
+    segment->size = 0;
+}
+
+/*!
+    \class QThumbnailCache
+    \internal
+
+    Provides access to the thumbnails pre-generated by the content server.
+*/
+
+/*!
+    Returns a thumbnail of the image \a fileName scaled to \a size according to
+    \a mode from the thumbnail cache.  A null image is returned if the cache has
+    no thumbnail of the file, the thumbnail is out of date, or a thumbnail of
+    the requested size is not cached.
+*/
+QImage QThumbnailCache::thumbnail(
+        const QString &fileName,
+        const QSize &size,
+        Qt::AspectRatioMode mode,
+        Qt::TransformationMode transformationMode)
+{
+    return size.isValid()
+            ? thumbnailCacheFile()->thumbnail(fileName, QContent::InvalidId, size, mode, transformationMode)
+            : QImage();
+}
+
+/*!
+    Returns a thumbnail of \a content scaled to \a size according to \a mode
+    from the thumbnail cache.
+*/
+QImage QThumbnailCache::thumbnail(
+        const QContent &content,
+        const QSize &size,
+        Qt::AspectRatioMode mode,
+        Qt::TransformationMode transformationMode)
+{
+    return size.isValid()
+            ? thumbnailCacheFile()->thumbnail(content.fileName(), content.id(), size, mode, transformationMode)
+            : QImage();
+}
+
+/*!
+    Returns the full size of the image \a fileName if it has a cached thumbnail,
+    and an invalid size otherwise.
+*/
+QSize QThumbnailCache::sourceSize(const QString &fileName)
+{
+    return thumbnailCacheFile()->sourceSize(fileName);
+}
+
+/*!
+    Returns the path of the directory containing the thumbnail cache, including
+    a trailing separator.
+
+    The directory is always under the home path rather than a sandbox as it is
+    written by the content server for everyone.
+*/
+QString QThumbnailCache::cachePath()
+{
+    return Qtopia::homePath() + QLatin1String("/Applications/ContentServer/thumbnails/");
+}
+
+/*!
+    \class QThumbnailCacheWriter
+    \internal
+
+    Generates thumbnails and writes them to the thumbnail cache.  Only the
+    content server should write to the cache.
+*/
+
+QThumbnailCacheWriter::QThumbnailCacheWriter()
+    : m_nextSegment(1)
+    , m_maximumSize(MinimumCacheSize)
+    , m_access(new QThumbnailAccessTable)
+    , m_loaded(false)
+{
+}
+
+QThumbnailCacheWriter::~QThumbnailCacheWriter()
+{
+    delete m_access;
+}
+
+/*!
+    Returns the maximum number of bytes of thumbnails kept in the cache.
+
+    This is the \c Thumbnails/CacheSize setting in kilobytes of the
+    \c Trolltech/ContentServer configuration if it is set, and otherwise a
+    hundredth of the size of the storage the cache is on, but no less than 8MB
+    and no more than 64MB.
+*/
+qint64 QThumbnailCacheWriter::maximumSize()
+{
+    load();
+
+    return m_maximumSize;
+}
+
+/*!
+    Generates thumbnails of \a content if they are not already cached.  The
+    thumbnails are not saved until commit() is called.
+
+    Returns true if the content has cached thumbnails.
+*/
+bool QThumbnailCacheWriter::add(const QContent &content)
+{
+    const QString fileName = content.fileName();
+
+    if (content.id() == QContent::InvalidId || fileName.isEmpty()
+        || content.drmState() == QContent::Protected) {
+        return false;
+    }
+
+    QFileInfo info(fileName);
+
+    if (!info.exists())
+        return false;
+
+    load();
+
+    const uint lastModified = info.lastModified().toTime_t();
+
+    QMap<QString, Record>::iterator it = m_records.find(fileName);
+
+    if (it != m_records.end() && it->id == content.id() && it->lastModified == lastModified) {
+        if (!it->images.isEmpty())
+            return true;
+
+        // Don't regenerate evicted thumbnails until the file is used again.
+        if (m_access->lastAccess(qHash(fileName)) <= it->added)
+            return false;
+    }
+
+    Record record;
+    record.id = content.id();
+    record.lastModified = lastModified;
+    record.added = ::time(0);
+    record.segment = 0;
+
+    QImage image = generate(fileName, &record.sourceSize);
+
+    if (image.isNull()) {
+        m_records.remove(fileName);
+
+        return false;
+    }
+
+    const QImage::Format format = image.hasAlphaChannel()
+            ? QImage::Format_ARGB32_Premultiplied
+            : QImage::Format_RGB16;
+
+    for (int i = 0; i < ThumbnailSizeCount; ++i) {
+        QSize size = image.size();
+
+        if (size.width() > ThumbnailSizes[i] || size.height() > ThumbnailSizes[i])
+            size.scale(ThumbnailSizes[i], ThumbnailSizes[i], Qt::KeepAspectRatio);
+        else if (!record.images.isEmpty())
+            continue;
+
+        // Scale from the previous size rather than its converted copy so the
+        // smaller sizes don't lose any more colour depth than the larger.
+        if (size != image.size())
+            image = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+        record.images.prepend(image.convertToFormat(format));
+    }
+
+    m_records.insert(fileName, record);
+
+    if (!m_pending.contains(fileName))
+        m_pending.append(fileName);
+
+    return true;
+}
+
+/*!
+    Writes the thumbnails added since the last commit to a new cache segment.
+    If the cache has grown larger than maximumSize() it is rewritten without
+    the thumbnails of files which no longer exist and of the files used least
+    recently.
+
+    Returns true if the cache was written successfully.
+*/
+bool QThumbnailCacheWriter::commit()
+{
+    if (m_pending.isEmpty())
+        return true;
+
+    if (!writeSegment(m_pending))
+        return false;
+
+    m_pending.clear();
+
+    qint64 size = 0;
+
+    foreach (qint64 segmentSize, m_segments)
+        size += segmentSize;
+
+    if (size > m_maximumSize)
+        return compact();
+
+    // Merge the newest segments into one while together they are at least half
+    // as large as the one before, so segment sizes fall steeply from oldest to
+    // newest and each thumbnail is rewritten only a few times however large the
+    // cache grows.
+    QMap<quint32, qint64>::const_iterator it = m_segments.constEnd();
+
+    quint32 first = 0;
+    qint64 newer = 0;
+    int count = 0;
+
+    while (it != m_segments.constBegin()) {
+        --it;
+
+        if (count > 0 && it.value() > 2 * newer)
+            break;
+
+        first = it.key();
+        newer += it.value();
+        ++count;
+    }
+
+    return count < 2 || merge(first);
+}
+
+/*
+    Rewrites the segments from \a first on as a single segment.
+*/
+bool QThumbnailCacheWriter::merge(quint32 first)
+{
+    QStringList fileNames;
+
+    for (QMap<QString, Record>::const_iterator it = m_records.constBegin(); it != m_records.constEnd(); ++it) {
+        if (it->segment >= first)
+            fileNames.append(it.key());
+    }
+
+    const quint32 last = m_nextSegment - 1;
+
+    if (!writeSegment(fileNames))
+        return false;
+
+    removeSegments(first, last);
+
+    return true;
+}
+
+/*
+    Drops the records of files which no longer exist, evicts the thumbnails
+    of the files used least recently until the cache is three quarters of its
+    maximum size, and rewrites the cache as a single segment.
+*/
+bool QThumbnailCacheWriter::compact()
+{
+    QMultiMap<quint32, QString> byUse;
+
+    qint64 size = 0;
+
+    for (QMap<QString, Record>::iterator it = m_records.begin(); it != m_records.end();) {
+        if (!QFile::exists(it.key())) {
+            it = m_records.erase(it);
+        } else {
+            if (!it->images.isEmpty()) {
+                size += dataSize(*it);
+
+                byUse.insert(qMax<quint32>(m_access->lastAccess(qHash(it.key())), it->added), it.key());
+            }
+            ++it;
+        }
+    }
+
+    // Leave room for new thumbnails so the cache isn't rewritten on every
+    // commit once it is full.
+    const qint64 target = m_maximumSize - m_maximumSize / 4;
+    const uint now = ::time(0);
+
+    for (QMultiMap<quint32, QString>::const_iterator it = byUse.constBegin();
+            size > target && it != byUse.constEnd(); ++it) {
+        Record &record = m_records[it.value()];
+
+        size -= dataSize(record);
+
+        record.images.clear();
+        record.added = now;
+    }
+
+    const quint32 last = m_nextSegment - 1;
+
+    if (!writeSegment(m_records.keys()))
+        return false;
+
+    removeSegments(0, last);
+
+    qLog(DocAPI) << "Compacted thumbnail cache to" << size << "bytes";
+
+    return true;
+}
+
+/*
+    Writes the records of \a fileNames to a new cache segment.
+*/
+bool QThumbnailCacheWriter::writeSegment(const QStringList &fileNames)
+{
+    QList<QPair<uint, QString> > keys;
+
+    int entryCount = 0;
+
+    foreach (const QString &fileName, fileNames) {
+        QMap<QString, Record>::const_iterator it = m_records.constFind(fileName);
+
+        if (it != m_records.constEnd()) {
+            keys.append(qMakePair(uint(qHash(fileName)), fileName));
+
+            entryCount += qMax(it->images.count(), 1);
+        }
+    }
+
+    qSort(keys);
+
+    ThumbnailCacheHeader header;
+    header.magic = ThumbnailCacheMagic;
+    header.version = ThumbnailCacheVersion;
+    header.entryCount = entryCount;
+    header.entryOffset = sizeof(ThumbnailCacheHeader);
+
+    const quint32 dataOffset = header.entryOffset + entryCount * sizeof(ThumbnailCacheEntry);
+
+    QVector<ThumbnailCacheEntry> entries;
+    entries.reserve(entryCount);
+
+    QByteArray data;
+
+    typedef QPair<uint, QString> Key;
+    foreach (const Key &key, keys) {
+        const Record &record = m_records[key.second];
+
+        ThumbnailCacheEntry entry;
+        memset(&entry, 0, sizeof(entry));
+
+        entry.documentId = record.id.second;
+        entry.databaseId = record.id.first;
+        entry.nameHash = key.first;
+        entry.nameOffset = dataOffset + data.size();
+        entry.nameLength = key.second.length();
+        entry.lastModified = record.lastModified;
+        entry.added = record.added;
+        entry.sourceWidth = record.sourceSize.width();
+        entry.sourceHeight = record.sourceSize.height();
+
+        data.append(QByteArray::fromRawData(
+                reinterpret_cast<const char *>(key.second.unicode()), key.second.length() * sizeof(QChar)));
+
+        if (record.images.isEmpty())
+            entries.append(entry);
+
+        foreach (const QImage &image, record.images) {
+            // Scan lines must be 32 bit aligned to construct an image on them.
+            while (data.size() % 4)
+                data.append('\0');
+
+            entry.width = image.width();
+            entry.height = image.height();
+            entry.format = image.format();
+            entry.bytesPerLine = image.bytesPerLine();
+            entry.dataOffset = dataOffset + data.size();
+
+            data.append(QByteArray::fromRawData(reinterpret_cast<const char *>(image.bits()), image.numBytes()));
+
+            entries.append(entry);
+        }
+    }
+
+    const quint32 segment = m_nextSegment;
+    const QString path = QThumbnailCache::cachePath() + segmentName(segment);
+    const QString newPath = path + QLatin1String(".new");
+
+    QFile file(newPath);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Could not write thumbnail cache" << newPath;
+
+        return false;
+    }
+
+    bool written = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header)
+            && file.write(reinterpret_cast<const char *>(entries.constData()), entries.count() * sizeof(ThumbnailCacheEntry))
+                    == qint64(entries.count() * sizeof(ThumbnailCacheEntry))
+            && file.write(data) == data.size();
+
+    const qint64 size = file.size();
+
+    file.close();
+
+    // Publish the segment atomically so processes never map a partial file.
+    if (!written || ::rename(QFile::encodeName(newPath).constData(), QFile::encodeName(path).constData()) != 0) {
+        qWarning() << "Could not write thumbnail cache" << path;
+
+        QFile::remove(newPath);
+
+        return false;
+    }
+
+    foreach (const Key &key, keys)
+        m_records[key.second].segment = segment;
+
+    m_segments.insert(segment, size);
+
+    ++m_nextSegment;
+
+    qLog(DocAPI) << "Wrote thumbnail cache segment" << segment << "with" << keys.count() << "files," << size << "bytes";
+
+    return true;
+}
+
+/*
+    Removes the segments numbered from \a first to \a last.
+*/
+void QThumbnailCacheWriter::removeSegments(quint32 first, quint32 last)
+{
+    QMap<quint32, qint64>::iterator it = m_segments.lowerBound(first);
+
+    while (it != m_segments.end() && it.key() <= last) {
+        QFile::remove(QThumbnailCache::cachePath() + segmentName(it.key()));
+
+        it = m_segments.erase(it);
+    }
+}
+
+/*
+    Returns the number of bytes of pixel data in \a record.
+*/
+qint64 QThumbnailCacheWriter::dataSize(const Record &record)
+{
+    qint64 size = 0;
+
+    foreach (const QImage &image, record.images)
+        size += image.numBytes();
+
+    return size;
+}
+
+/*
+    Loads the thumbnails already in the cache so they are preserved when it is
+    compacted, and determines the maximum size of the cache.
+*/
+void QThumbnailCacheWriter::load()
+{
+    if (m_loaded)
+        return;
+
+    m_loaded = true;
+
+    const QString path = QThumbnailCache::cachePath();
+
+    QDir dir(path);
+    dir.mkpath(path);
+
+    m_access->open(true);
+
+    QSettings config(QLatin1String("Trolltech"), QLatin1String("ContentServer"));
+
+    const qint64 configuredSize = config.value(QLatin1String("Thumbnails/CacheSize"), 0).toLongLong() * 1024;
+
+    struct statvfs storage;
+
+    if (configuredSize > 0) {
+        m_maximumSize = configuredSize;
+    } else if (::statvfs(QFile::encodeName(path).constData(), &storage) == 0) {
+        m_maximumSize = qBound(
+                MinimumCacheSize, qint64(storage.f_blocks) * qint64(storage.f_frsize) / 100, MaximumCacheSize);
+    }
+
+    // Remove segments left half written by an interrupted commit.
+    foreach (const QString &name, dir.entryList(QStringList() << QLatin1String("*.new"), QDir::Files))
+        dir.remove(name);
+
+    foreach (const QString &name, dir.entryList(QStringList() << QLatin1String("*.cache"), QDir::Files, QDir::Name)) {
+        bool ok = false;
+
+        const quint32 segment = name.left(name.length() - 6).toUInt(&ok, 16);
+
+        QFile file(path + name);
+
+        if (!ok || segment == 0 || !file.open(QIODevice::ReadOnly))
+            continue;
+
+        const QByteArray contents = file.readAll();
+        const uchar *data = reinterpret_cast<const uchar *>(contents.constData());
+        const qint64 size = contents.size();
+
+        int count = 0;
+
+        const ThumbnailCacheEntry *entry = segmentEntries(data, size, &count);
+
+        if (!entry) {
+            qWarning() << "Removing invalid thumbnail cache" << file.fileName();
+
+            file.remove();
+
+            continue;
+        }
+
+        m_segments.insert(segment, size);
+        m_nextSegment = qMax(m_nextSegment, segment + 1);
+
+        QString previous;
+
+        for (int i = 0; i < count; ++i, ++entry) {
+            if (entry->nameOffset + qint64(entry->nameLength) * qint64(sizeof(QChar)) > size
+                || entry->dataOffset + qint64(entry->bytesPerLine) * entry->height > size) {
+                continue;
+            }
+
+            const QString fileName(
+                    reinterpret_cast<const QChar *>(data + entry->nameOffset), entry->nameLength);
+
+            Record &record = m_records[fileName];
+
+            // Entries in this segment replace any loaded from older ones.
+            if (fileName != previous)
+                record.images.clear();
+
+            previous = fileName;
+
+            record.id = QContentId(entry->databaseId, entry->documentId);
+            record.lastModified = entry->lastModified;
+            record.added = entry->added;
+            record.segment = segment;
+            record.sourceSize = QSize(entry->sourceWidth, entry->sourceHeight);
+
+            if (entry->width != 0 && entry->height != 0) {
+                record.images.append(QImage(
+                        data + entry->dataOffset,
+                        entry->width,
+                        entry->height,
+                        entry->bytesPerLine,
+                        QImage::Format(entry->format)).copy());
+            }
+        }
+    }
+}
+
+/*
+    Loads an image of \a fileName at least as large as the largest cached size
+    and sets \a sourceSize to the full size of the image.
+
+    The thumbnail embedded in the EXIF header of a JPEG image is used if it is
+    large enough and has the same aspect ratio as the image, avoiding decoding
+    the image itself.
+*/
+QImage QThumbnailCacheWriter::generate(const QString &fileName, QSize *sourceSize)
+{
+    QImageReader reader(fileName);
+
+    if (!reader.canRead())
+        return QImage();
+
+    QSize size = reader.supportsOption(QImageIOHandler::Size) ? reader.size() : QSize();
+
+    const QByteArray format = reader.format().toLower();
+
+    if (size.isValid() && (format == "jpeg" || format == "jpg")) {
+        QExifImageHeader exif;
+
+        if (exif.loadFromJpeg(fileName)) {
+            QImage image = exif.thumbnail();
+
+            const int required = qMin(ThumbnailSizes[0], qMax(size.width(), size.height()));
+
+            // Some cameras letterbox the embedded thumbnail to 4:3, only use
+            // it if its aspect ratio is within 2% of the image's.
+            if (!image.isNull()
+                && qMax(image.width(), image.height()) >= required
+                && qAbs(qint64(image.width()) * size.height() - qint64(image.height()) * size.width()) * 50
+                        <= qint64(image.height()) * size.height()) {
+                *sourceSize = size;
+
+                return image;
+            }
+        }
+    }
+
+    if (size.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize)
+        && (size.width() > ThumbnailSizes[0] || size.height() > ThumbnailSizes[0])) {
+        QSize scaledSize = size;
+        scaledSize.scale(ThumbnailSizes[0], ThumbnailSizes[0], Qt::KeepAspectRatio);
+
+        reader.setQuality( 49 ); // Otherwise Qt smooth scales
+        reader.setScaledSize(scaledSize);
+    }
+
+    QImage image;
+
+    if (!reader.read(&image))
+        return QImage();
+
+    *sourceSize = size.isValid() ? size : image.size();
+
+    return image;
+}
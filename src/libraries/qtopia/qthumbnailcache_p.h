@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef QTHUMBNAILCACHE_P_H
+#define QTHUMBNAILCACHE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Extended API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <qtopiaglobal.h>
+#include <QContent>
+#include <QImage>
+#include <QMap>
+#include <QList>
+
+class QThumbnailAccessTable;
+
+class QTOPIA_EXPORT QThumbnailCache
+{
+public:
+    static QImage thumbnail(
+            const QString &fileName,
+            const QSize &size,
+            Qt::AspectRatioMode mode = Qt::KeepAspectRatio,
+            Qt::TransformationMode transformationMode = Qt::FastTransformation);
+    static QImage thumbnail(
+            const QContent &content,
+            const QSize &size,
+            Qt::AspectRatioMode mode = Qt::KeepAspectRatio,
+            Qt::TransformationMode transformationMode = Qt::FastTransformation);
+
+    static QSize sourceSize(const QString &fileName);
+
+    static QString cachePath();
+};
+
+class QTOPIA_EXPORT QThumbnailCacheWriter
+{
+public:
+    QThumbnailCacheWriter();
+    ~QThumbnailCacheWriter();
+
+    bool add(const QContent &content);
+    bool commit();
+
+    qint64 maximumSize();
+
+private:
+    struct Record
+    {
+        QContentId id;
+        uint lastModified;
+        uint added;
+        quint32 segment;
+        QSize sourceSize;
+        QList<QImage> images;
+    };
+
+    void load();
+    bool merge(quint32 first);
+    bool compact();
+    bool writeSegment(const QStringList &fileNames);
+    void removeSegments(quint32 first, quint32 last);
+    static qint64 dataSize(const Record &record);
+    static QImage generate(const QString &fileName, QSize *sourceSize);
+
+    QMap<QString, Record> m_records;
+    QStringList m_pending;
+    QMap<quint32, qint64> m_segments;
+    quint32 m_nextSegment;
+    qint64 m_maximumSize;
+    QThumbnailAccessTable *m_access;
+    bool m_loaded;
+};
+
+#endif
@@ -28,6 +28,7 @@
 #include <QSqlRecord>
 #include <QtopiaIpcEnvelope>
 #include "qcontent_p.h"
+#include "qsqlcontentstore_p.h"
 #if !defined(QTOPIA_CONTENT_INSTALLER) && !defined(QTOPIA_TEST)
 #include <QDSServiceInfo>
 #include <QDSAction>
@@ -621,6 +622,9 @@ void QtopiaSql::detachDB(const QString& path)
         d()->masterAttachedConns.remove(dbid);
         d()->dbPaths.remove(dbid);
 
+        // Cached statements would prevent the connection from closing.
+        QSqlContentStore::releasePreparedQueries(dbid);
+
         if(d()->dbs.contains(dbid))
             d()->dbs.take(dbid).close();
 
@@ -60,6 +60,7 @@ private slots:
     void tst_Accessors();
     void tst_AddRemoveSynchronous();
     void tst_AddRemoveAsynchronous();
+    void tst_Paged();
 
 private:
     QList<Data> Hyphenated;
@@ -503,3 +504,47 @@ void tst_QContentSet::tst_AddRemoveAsynchronous()
     QEXPECT_FAIL("", "Should fail in asynchronous mode. No way to block on this as yet", Continue);
     QCOMPARE(set.count(), 0);
 }
+
+void tst_QContentSet::tst_Paged()
+{
+    QContentSet set(QContentSet::Paged);
+    QSignalSpy insertspy(&set, SIGNAL(contentInserted()));
+    QSignalSpy removespy(&set, SIGNAL(contentRemoved()));
+
+    QCOMPARE(set.updateMode(), QContentSet::Paged);
+    QCOMPARE(set.count(), 0);
+
+    set.setCriteria(QContentFilter::Synthetic, "none/language/German");
+
+    QContentSet german(QContentFilter::Synthetic, "none/language/German", QStringList() << "name");
+
+    QTRY_VERIFY( insertspy.count() == 1 );
+    QCOMPARE(set.count(), German.count());
+    QCOMPARE(german.count(), German.count());
+
+    // The first page is loaded along with the count.
+    for(int i=0;i<set.count();i++)
+        QCOMPARE(set.contentId(i), german.contentId(i));
+
+    // Explicit content isn't supported.
+    set.add(QContent(tempdir + '/' + Qtopia::dehyphenate(Hyphenated[0].second) + ".txt"));
+    QTest::qWait(100);
+    QCOMPARE(set.count(), German.count());
+
+    insertspy.clear();
+    set.setCriteria(QContentFilter::Synthetic, "none/language/Korean");
+
+    QContentSet korean(QContentFilter::Synthetic, "none/language/Korean", QStringList() << "name");
+
+    QTRY_VERIFY( insertspy.count() == 1 );
+    QCOMPARE(removespy.count(), 1);
+    QCOMPARE(set.count(), Korean.count());
+
+    for(int i=0;i<set.count();i++)
+        QCOMPARE(set.contentId(i), korean.contentId(i));
+
+    removespy.clear();
+    set.clear();
+    QTRY_VERIFY( removespy.count() == 1 );
+    QCOMPARE(set.count(), 0);
+}
@@ -0,0 +1,4 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+TARGET=tst_qthumbnailcache
+SOURCES*=tst_qthumbnailcache.cpp
@@ -0,0 +1,341 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <private/qthumbnailcache_p.h>
+
+#include <QContent>
+#include <QDir>
+#include <QSettings>
+#include <QTest>
+#include <QtopiaApplication>
+#include <shared/qtopiaunittest.h>
+
+#include <sys/stat.h>
+
+//TESTED_CLASS=QThumbnailCache
+//TESTED_FILES=src/libraries/qtopia/qthumbnailcache.cpp
+
+class tst_QThumbnailCache : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+
+    void addAndLookup();
+    void outOfDate();
+    void incrementalCommit();
+    void evictLeastRecentlyUsed();
+    void maximumSize();
+
+private:
+    QContent createImage(const QString &name, const QColor &color);
+    QStringList segments() const;
+    ino_t inode(const QString &segment) const;
+    void setCacheSize(int kilobytes);
+    void clearCache();
+    void waitForReaders();
+
+    QString m_imagePath;
+    QList<QContent> m_images;
+};
+
+QTEST_APP_MAIN( tst_QThumbnailCache, QtopiaApplication )
+
+#include "tst_qthumbnailcache.moc"
+
+void tst_QThumbnailCache::initTestCase()
+{
+    m_imagePath = QDir::tempPath() + QLatin1String("/tst_qthumbnailcache/");
+
+    QVERIFY(QDir().mkpath(m_imagePath));
+}
+
+void tst_QThumbnailCache::init()
+{
+    clearCache();
+    setCacheSize(0);
+}
+
+void tst_QThumbnailCache::cleanupTestCase()
+{
+    foreach (const QContent &image, m_images) {
+        QContent::uninstall(image.id());
+        QFile::remove(image.fileName());
+    }
+
+    QDir().rmdir(m_imagePath);
+
+    clearCache();
+    setCacheSize(0);
+}
+
+/*?
+    Test that thumbnails are served from the cache once committed.
+*/
+void tst_QThumbnailCache::addAndLookup()
+{
+    QContent image = createImage(QLatin1String("lookup"), Qt::red);
+
+    QThumbnailCacheWriter writer;
+
+    QVERIFY(writer.add(image));
+    QVERIFY(QThumbnailCache::thumbnail(image, QSize(64, 64)).isNull());
+
+    QVERIFY(writer.commit());
+    QCOMPARE(segments().count(), 1);
+
+    waitForReaders();
+
+    QImage thumbnail = QThumbnailCache::thumbnail(image, QSize(64, 64));
+
+    QCOMPARE(thumbnail.size(), QSize(64, 64));
+    QCOMPARE(QColor(thumbnail.pixel(32, 32)), QColor(Qt::red));
+    QCOMPARE(QThumbnailCache::thumbnail(image.fileName(), QSize(100, 100)).size(), QSize(100, 100));
+    QCOMPARE(QThumbnailCache::sourceSize(image.fileName()), QSize(256, 256));
+
+    // Already cached.
+    QVERIFY(writer.add(image));
+    QVERIFY(writer.commit());
+    QCOMPARE(segments().count(), 1);
+}
+
+/*?
+    Test that thumbnails of a file modified since they were generated are not
+    served until they are regenerated.
+*/
+void tst_QThumbnailCache::outOfDate()
+{
+    QContent image = createImage(QLatin1String("modified"), Qt::red);
+
+    QThumbnailCacheWriter writer;
+
+    QVERIFY(writer.add(image));
+    QVERIFY(writer.commit());
+
+    waitForReaders();
+
+    QVERIFY(!QThumbnailCache::thumbnail(image, QSize(64, 64)).isNull());
+
+    image = createImage(QLatin1String("modified"), Qt::blue);
+
+    QVERIFY(QThumbnailCache::thumbnail(image, QSize(64, 64)).isNull());
+
+    QVERIFY(writer.add(image));
+    QVERIFY(writer.commit());
+
+    waitForReaders();
+
+    QImage thumbnail = QThumbnailCache::thumbnail(image, QSize(64, 64));
+
+    QCOMPARE(QColor(thumbnail.pixel(32, 32)), QColor(Qt::blue));
+}
+
+/*?
+    Test that a commit writes only the thumbnails added since the last one,
+    and that newer segments are merged without rewriting older, larger ones.
+*/
+void tst_QThumbnailCache::incrementalCommit()
+{
+    setCacheSize(1024);
+
+    QThumbnailCacheWriter writer;
+
+    for (int i = 0; i < 5; ++i)
+        QVERIFY(writer.add(createImage(QString::fromLatin1("first%1").arg(i), Qt::red)));
+    QVERIFY(writer.commit());
+
+    QStringList initial = segments();
+    QCOMPARE(initial.count(), 1);
+
+    const ino_t first = inode(initial.first());
+
+    QContent second = createImage(QLatin1String("second"), Qt::yellow);
+
+    QVERIFY(writer.add(second));
+    QVERIFY(writer.commit());
+
+    QCOMPARE(segments().count(), 2);
+    QCOMPARE(segments().first(), initial.first());
+    QCOMPARE(inode(initial.first()), first);
+
+    QContent third = createImage(QLatin1String("third"), Qt::cyan);
+
+    QVERIFY(writer.add(third));
+    QVERIFY(writer.commit());
+
+    // The two small segments are merged, the first is left alone.
+    QCOMPARE(segments().count(), 2);
+    QCOMPARE(segments().first(), initial.first());
+    QCOMPARE(inode(initial.first()), first);
+
+    waitForReaders();
+
+    QCOMPARE(QColor(QThumbnailCache::thumbnail(second, QSize(32, 32)).pixel(16, 16)), QColor(Qt::yellow));
+    QCOMPARE(QColor(QThumbnailCache::thumbnail(third, QSize(32, 32)).pixel(16, 16)), QColor(Qt::cyan));
+
+    // A new writer picks up where the last left off.
+    QThumbnailCacheWriter reloaded;
+
+    QVERIFY(reloaded.add(second));
+    QVERIFY(reloaded.add(third));
+    QVERIFY(reloaded.commit());
+    QCOMPARE(segments().count(), 2);
+}
+
+/*?
+    Test that the thumbnails of the files looked up least recently are evicted
+    when the cache is full, and only regenerated once they are looked up again.
+*/
+void tst_QThumbnailCache::evictLeastRecentlyUsed()
+{
+    // Each image takes 42KB, room for two but not three.
+    setCacheSize(120);
+
+    QContent used = createImage(QLatin1String("used"), Qt::red);
+    QContent unused = createImage(QLatin1String("unused"), Qt::green);
+    QContent added = createImage(QLatin1String("added"), Qt::blue);
+
+    QThumbnailCacheWriter writer;
+
+    QVERIFY(writer.add(used));
+    QVERIFY(writer.add(unused));
+    QVERIFY(writer.commit());
+
+    waitForReaders();
+
+    QVERIFY(!QThumbnailCache::thumbnail(used, QSize(64, 64)).isNull());
+
+    // Access times have a resolution of a second.
+    waitForReaders();
+
+    QVERIFY(writer.add(added));
+    QVERIFY(writer.commit());
+
+    QCOMPARE(segments().count(), 1);
+
+    QVERIFY(!writer.add(unused));
+
+    QThumbnailCacheWriter reloaded;
+    QVERIFY(!reloaded.add(unused));
+    QVERIFY(reloaded.add(used));
+    QVERIFY(reloaded.add(added));
+
+    waitForReaders();
+
+    QVERIFY(!QThumbnailCache::thumbnail(used, QSize(64, 64)).isNull());
+    QVERIFY(!QThumbnailCache::thumbnail(added, QSize(64, 64)).isNull());
+    QVERIFY(QThumbnailCache::thumbnail(unused, QSize(64, 64)).isNull());
+
+    // Looking up the evicted thumbnail makes it worth generating again.
+    QVERIFY(writer.add(unused));
+}
+
+/*?
+    Test the configured and default maximum cache sizes.
+*/
+void tst_QThumbnailCache::maximumSize()
+{
+    setCacheSize(2048);
+
+    {
+        QThumbnailCacheWriter writer;
+        QCOMPARE(writer.maximumSize(), qint64(2048 * 1024));
+    }
+
+    setCacheSize(0);
+
+    {
+        QThumbnailCacheWriter writer;
+        QVERIFY(writer.maximumSize() >= qint64(8 * 1024 * 1024));
+        QVERIFY(writer.maximumSize() <= qint64(64 * 1024 * 1024));
+    }
+}
+
+/*
+    Writes a 256x256 image filled with \a color and returns its content,
+    which is installed in the database the first time.
+*/
+QContent tst_QThumbnailCache::createImage(const QString &name, const QColor &color)
+{
+    const QString fileName = m_imagePath + name + QLatin1String(".png");
+
+    // Modification times have a resolution of a second.
+    if (QFile::exists(fileName))
+        QTest::qWait(1100);
+
+    QImage image(256, 256, QImage::Format_RGB32);
+    image.fill(color.rgb());
+
+    if (!image.save(fileName, "PNG"))
+        return QContent();
+
+    foreach (const QContent &content, m_images) {
+        if (content.fileName() == fileName)
+            return content;
+    }
+
+    QContent content(fileName);
+
+    m_images.append(content);
+
+    return content;
+}
+
+QStringList tst_QThumbnailCache::segments() const
+{
+    return QDir(QThumbnailCache::cachePath()).entryList(
+            QStringList() << QLatin1String("*.cache"), QDir::Files, QDir::Name);
+}
+
+ino_t tst_QThumbnailCache::inode(const QString &segment) const
+{
+    struct stat status;
+
+    return ::stat(QFile::encodeName(QThumbnailCache::cachePath() + segment).constData(), &status) == 0
+            ? status.st_ino
+            : 0;
+}
+
+void tst_QThumbnailCache::setCacheSize(int kilobytes)
+{
+    QSettings config(QLatin1String("Trolltech"), QLatin1String("ContentServer"));
+
+    if (kilobytes > 0)
+        config.setValue(QLatin1String("Thumbnails/CacheSize"), kilobytes);
+    else
+        config.remove(QLatin1String("Thumbnails/CacheSize"));
+}
+
+void tst_QThumbnailCache::clearCache()
+{
+    QDir dir(QThumbnailCache::cachePath());
+
+    foreach (const QString &name, dir.entryList(QDir::Files))
+        dir.remove(name);
+}
+
+/*
+    Readers only check for new cache segments once a second.
+*/
+void tst_QThumbnailCache::waitForReaders()
+{
+    QTest::qWait(1100);
+}
@@ -47,10 +47,16 @@
 #include <QSvgRenderer>
 #include <QPixmapCache>
 #include <QPicture>
+#include <QCache>
+#include <QSet>
+#include <QTime>
+#include <QtopiaChannel>
 
 #include <limits.h>
 
 #include <QXmlStreamReader>
+#include <private/qcompiledtheme_p.h>
+#include <private/qthemeatlas_p.h>
 
 //===================================================================
 /* declare ThemeListDelegate */
@@ -130,46 +136,37 @@ struct ThemeItemPrivate
     bool isDataExpression;
 };
 
-class ThemeFactory : public QXmlStreamReader
+// Builds the item tree from either QXmlStreamReader or QCompiledThemeReader
+template <class Reader>
+class ThemeBuilder : public Reader
 {
 public:
 
-    ThemeFactory(ThemedView *view)
-      : QXmlStreamReader(), m_root(0), m_view(view) { }
+    ThemeBuilder(ThemedView *view)
+      : Reader(), m_root(0), m_view(view) { }
 
-    bool readThemedView(QIODevice *device)
-    {
-        Q_ASSERT(device && m_view);
+    ThemeItem *root() const { return m_root; }
 
-        m_root = 0;
-        clear();
-        setDevice(device);
+protected:
+    using Reader::atEnd;
+    using Reader::readNext;
+    using Reader::isStartElement;
+    using Reader::isEndElement;
+    using Reader::isCharacters;
+    using Reader::name;
+    using Reader::text;
+    using Reader::attributes;
+    using Reader::readElementText;
+
+    void readDocument()
+    {
         while (!atEnd()) {
             readNext();
             if (isStartElement() && name() == "page")
                 readPage();
         }
-        return !error();
     }
 
-    bool readTemplate(const QString &data, ThemeItem *parent, const QString &uid)
-    {
-        Q_ASSERT(parent && m_view);
-
-        m_root = 0;
-        clear();
-        addData(data);
-        while (!atEnd()) {
-            readNext();
-            if (isStartElement())
-                readTemplateInstance(parent, uid);
-        }
-        return !error();
-    }
-
-    ThemeItem *root() const { return m_root; }
-
-private:
 
     void readTemplateInstance(ThemeItem *parent, const QString &uid)
     {
@@ -400,11 +397,63 @@ private:
         return true;
      }
 
-private:
+protected:
     ThemeItem   *m_root;
     ThemedView  *m_view;
 };
 
+class ThemeFactory : public ThemeBuilder<QXmlStreamReader>
+{
+public:
+
+    ThemeFactory(ThemedView *view)
+      : ThemeBuilder<QXmlStreamReader>(view) { }
+
+    bool readThemedView(QIODevice *device)
+    {
+        Q_ASSERT(device && m_view);
+
+        m_root = 0;
+        clear();
+        setDevice(device);
+        readDocument();
+        return !error();
+    }
+
+    bool readTemplate(const QString &data, ThemeItem *parent, const QString &uid)
+    {
+        Q_ASSERT(parent && m_view);
+
+        m_root = 0;
+        clear();
+        addData(data);
+        while (!atEnd()) {
+            readNext();
+            if (isStartElement())
+                readTemplateInstance(parent, uid);
+        }
+        return !error();
+    }
+};
+
+class CompiledThemeFactory : public ThemeBuilder<QCompiledThemeReader>
+{
+public:
+
+    CompiledThemeFactory(ThemedView *view)
+      : ThemeBuilder<QCompiledThemeReader>(view) { }
+
+    bool readThemedView(const QCompiledTheme *theme)
+    {
+        Q_ASSERT(theme && m_view);
+
+        m_root = 0;
+        setTheme(theme);
+        readDocument();
+        return !error();
+    }
+};
+
 
 /*!
   \class ThemeTemplateInstanceItem
@@ -2983,17 +3032,60 @@ void ThemeLineItem::paint(QPainter *p, const QRect &)
 
 //---------------------------------------------------------------------------
 
+// Atlas keys of recently loaded pixmaps, so that scaled variants can be
+// keyed from the pixmap they were scaled from, and whether the pixmap
+// refers to the shared theme atlas.
+struct ThemeAtlasKey
+{
+    QString key;
+    bool shared;
+};
+typedef QCache<qint64, ThemeAtlasKey> ThemeAtlasKeys;
+Q_GLOBAL_STATIC_WITH_ARGS(ThemeAtlasKeys, themeAtlasKeys, (256))
+
 struct Image
 {
+    Image() : shared(false) {}
+
     QString filename;
     QPixmap pixmap;
+    QString atlasKey;
+    bool shared;
 };
 
+static void setImagePixmap(Image &image, const QPixmap &pixmap)
+{
+    image.pixmap = pixmap;
+    if (ThemeAtlasKey *key = themeAtlasKeys()->object(pixmap.cacheKey())) {
+        image.atlasKey = key->key;
+        image.shared = key->shared;
+    } else {
+        image.atlasKey = QString();
+        image.shared = false;
+    }
+}
+
+struct ThemePixmapItemPrivate;
+typedef QSet<ThemePixmapItemPrivate *> ThemePixmapItemSet;
+Q_GLOBAL_STATIC(ThemePixmapItemSet, themePixmapItems)
+
 struct ThemePixmapItemPrivate
 {
-    ThemePixmapItemPrivate()
-    : hscale(false), vscale(false)
-    {}
+    ThemePixmapItemPrivate(ThemePixmapItem *item)
+    : item(item), hscale(false), vscale(false)
+    {
+        if (ThemePixmapItemSet *items = themePixmapItems())
+            items->insert(this);
+    }
+    ~ThemePixmapItemPrivate()
+    {
+        if (ThemePixmapItemSet *items = themePixmapItems())
+            items->remove(this);
+    }
+
+    void moveToAtlas();
+
+    ThemePixmapItem *item;
     QTagMap<Image> images[3];
     bool hscale;
     bool vscale;
@@ -3022,7 +3114,7 @@ struct ThemePixmapItemPrivate
 ThemePixmapItem::ThemePixmapItem(ThemeItem *parent, ThemedView *view, const ThemeAttributes &atts)
     : ThemeGraphicItem(parent, view, atts)
 {
-    d = new ThemePixmapItemPrivate;
+    d = new ThemePixmapItemPrivate(this);
 
     QString val = atts.value(QLatin1String("scale"));
     if (!val.isEmpty()) {
@@ -3078,12 +3170,12 @@ void ThemePixmapItem::setPixmap( const QString &key, const QPixmap &value, Theme
     int _st = stateToIndex( state );
     QTagMap<Image> &dataset = d->images[_st];
     if ( dataset.contains( key ) ) {
-        dataset[key].pixmap = value;
+        setImagePixmap( dataset[key], value );
         dataset[key].filename = filename;
     }
     else {
         Image image;
-        image.pixmap = value;
+        setImagePixmap( image, value );
         image.filename = filename;
         dataset.insert( key, image );
     }
@@ -3100,12 +3192,12 @@ void ThemePixmapItem::setPixmap( const QLatin1String &key, const QPixmap &value,
     int _st = stateToIndex( state );
     QTagMap<Image> &dataset = d->images[_st];
     if ( dataset.contains( key ) ) {
-        dataset[key].pixmap = value;
+        setImagePixmap( dataset[key], value );
         dataset[key].filename = filename;
     }
     else {
         Image image;
-        image.pixmap = value;
+        setImagePixmap( image, value );
         image.filename = filename;
         dataset.insert( key, image );
     }
@@ -3237,10 +3329,209 @@ QString imageTr( const QString& path, const QString& image, bool i18n )
     return file;
 }
 
+/*
+   The server records every theme image variant its themed views render and,
+   once loading settles, publishes them as the shared theme atlas.  Other
+   processes then find their variants in the atlas instead of loading,
+   colorizing and scaling the images themselves.
+
+   Each publish packs every recorded variant into a new atlas, so variants
+   rendered after startup are batched: an atlas is published at most once
+   per PublishInterval, and not at all while QThemeAtlas::canPublish() says
+   the atlas before the current one is still in use.  Every process moves
+   its pixmaps to the new atlas when it is announced, see ThemeAtlasClient.
+*/
+class ThemeAtlasRecorder : public QObject
+{
+public:
+    static ThemeAtlasRecorder *instance();
+
+    void record(const QString &base, const QString &key, const QPixmap &pm);
+
+protected:
+    void timerEvent(QTimerEvent *);
+
+private:
+    ThemeAtlasRecorder() : tid(0) {}
+
+    enum { SettleInterval = 2000, PublishInterval = 30000 };
+
+    struct Entry
+    {
+        QString base;
+        QImage image;
+        bool touched;
+    };
+
+    QMap<QString, Entry> entries;
+    QString latestBase;
+    QTime lastPublished;
+    int tid;
+};
+
+ThemeAtlasRecorder *ThemeAtlasRecorder::instance()
+{
+    static ThemeAtlasRecorder *recorder = 0;
+    if ( !recorder && qApp->type() == QApplication::GuiServer )
+        recorder = new ThemeAtlasRecorder;
+    return recorder;
+}
+
+void ThemeAtlasRecorder::record(const QString &base, const QString &key, const QPixmap &pm)
+{
+    latestBase = base;
+    QMap<QString, Entry>::iterator it = entries.find(key);
+    if ( it != entries.end() ) {
+        it->touched = true;
+        return;
+    }
+    Entry entry;
+    entry.base = base;
+    entry.image = pm.toImage();
+    entry.touched = true;
+    entries.insert(key, entry);
+
+    if ( tid )
+        killTimer(tid);
+    tid = startTimer(SettleInterval);
+}
+
+void ThemeAtlasRecorder::timerEvent(QTimerEvent *)
+{
+    killTimer(tid);
+    tid = 0;
+
+    int elapsed = lastPublished.isValid() ? lastPublished.elapsed() : int(PublishInterval);
+    if ( elapsed < PublishInterval ) {
+        tid = startTimer(PublishInterval - elapsed);
+        return;
+    }
+    if ( !QThemeAtlas::canPublish() ) {
+        qLog(Resource) << "Theme atlas" << QThemeAtlas::generation() - 1 << "is still in use, not publishing";
+        tid = startTimer(PublishInterval);
+        return;
+    }
+
+    // Images of a previous theme are dropped once no view uses them
+    QMap<QString, QImage> images;
+    QMap<QString, Entry>::iterator it = entries.begin();
+    while ( it != entries.end() ) {
+        if ( !it->touched && it->base != latestBase ) {
+            it = entries.erase(it);
+            continue;
+        }
+        it->touched = false;
+        images.insert(it.key(), it->image);
+        ++it;
+    }
+    if ( !QThemeAtlas::publish(images) )
+        return;
+    lastPublished.start();
+    qLog(Resource) << "Published theme atlas" << QThemeAtlas::generation() << "with" << images.count() << "images";
+
+    // Keep the published images rather than private copies, and copy those
+    // left out so that they do not hold on to the previous atlas
+    for ( it = entries.begin(); it != entries.end(); ++it ) {
+        QPixmap pm;
+        if ( QThemeAtlas::find(it.key(), pm) )
+            it->image = pm.toImage();
+        else
+            it->image = it->image.copy();
+    }
+
+    QtopiaIpcEnvelope e("QPE/ThemeAtlas", "published()");
+}
+
+/*
+   Pixmaps found in the theme atlas keep it in memory after it is replaced,
+   and the server cannot publish another atlas until they are gone.  When an
+   atlas is published, each process moves its theme pixmaps to the new atlas,
+   or to private copies if the new atlas lacks them.
+*/
+class ThemeAtlasClient : public QObject
+{
+    Q_OBJECT
+public:
+    static void listen();
+
+private slots:
+    void received(const QString &msg, const QByteArray &data);
+
+private:
+    ThemeAtlasClient();
+};
+
+void ThemeAtlasClient::listen()
+{
+    static ThemeAtlasClient *client = 0;
+    if ( !client )
+        client = new ThemeAtlasClient;
+}
+
+ThemeAtlasClient::ThemeAtlasClient()
+    : QObject(qApp)
+{
+    QtopiaChannel *channel = new QtopiaChannel("QPE/ThemeAtlas", this);
+    connect(channel, SIGNAL(received(QString,QByteArray)),
+            this, SLOT(received(QString,QByteArray)));
+}
+
+void ThemeAtlasClient::received(const QString &msg, const QByteArray &)
+{
+    if ( msg != QLatin1String("published()") )
+        return;
+    qLog(Resource) << "Moving theme pixmaps to atlas" << QThemeAtlas::generation();
+    if ( ThemePixmapItemSet *items = themePixmapItems() ) {
+        foreach ( ThemePixmapItemPrivate *item, *items )
+            item->moveToAtlas();
+    }
+}
+
+static QString themeAtlasKey(ThemedView *view, const QString &filename, int colorRole, const QColor &colour, int alpha, int width, int height)
+{
+    QString key("QTA_%1%2_%3_%4_%5_%6x%7");
+    key = key.arg(view->base()).arg(filename).arg(colorRole).arg(colour.name()).arg(alpha).arg(width).arg(height);
+    if ( filename.endsWith(".svg") )
+        key += view->palette().color(QPalette::Highlight).name();
+    return key;
+}
+
+static QPixmap themeAtlasLoaded(ThemedView *view, const QString &key, const QPixmap &pm, bool shared = false)
+{
+    if ( key.isEmpty() || pm.isNull() )
+        return pm;
+    ThemeAtlasKey *atlasKey = new ThemeAtlasKey;
+    atlasKey->key = key;
+    atlasKey->shared = shared;
+    themeAtlasKeys()->insert(pm.cacheKey(), atlasKey);
+    if ( shared )
+        ThemeAtlasClient::listen();
+    if ( ThemeAtlasRecorder *recorder = ThemeAtlasRecorder::instance() )
+        recorder->record(view->base(), key, pm);
+    return pm;
+}
+
+void ThemePixmapItemPrivate::moveToAtlas()
+{
+    for ( int i = 0; i < 3; i++ ) {
+        QTagMap<Image>::iterator it;
+        for ( it = images[i].begin(); it != images[i].end(); ++it ) {
+            if ( it->atlasKey.isEmpty() || it->pixmap.isNull() )
+                continue;
+            QPixmap pm;
+            if ( QThemeAtlas::find(it->atlasKey, pm) )
+                setImagePixmap( *it, themeAtlasLoaded(item->view(), it->atlasKey, pm, true) );
+            else if ( it->shared )
+                setImagePixmap( *it, themeAtlasLoaded(item->view(), it->atlasKey, QPixmap::fromImage(it->pixmap.toImage().copy())) );
+        }
+    }
+}
+
 /*!
   Loads the image given by \a filename for the given \a width and \a height.
   If \a colorRole is a valid index to QPalette, or if the color \a col is valid,
   and \a alpha is less than 255, the image is passed through ThemePixmapItem::colorizeImage().
+  Images the server has already rendered are taken from the shared theme atlas.
   Returns the loaded image.
 */
 QPixmap ThemePixmapItem::loadImage(const QString &filename, int colorRole, const QColor &col, int alpha, int width, int height)
@@ -3261,6 +3552,23 @@ QPixmap ThemePixmapItem::loadImage(const QString &filename, int colorRole, const
         imgName.remove(0, 5 /*strlen("i18n/") */ );
     }
 
+    // The background may be the user's own image, so it is not shared
+    QString atlasKey;
+    if (itemName() != QLatin1String("background")) {
+        int w = 0;
+        int h = 0;
+        if (filename.endsWith(".svg") || imgName.startsWith(":icon")) {
+            w = width ? width : geometry().width();
+            h = height ? height : geometry().height();
+        }
+        QColor colour;
+        if (colorRole != QPalette::NColorRoles || alpha != 255)
+            colour = getColor(col, colorRole);
+        atlasKey = themeAtlasKey(view(), filename, colorRole, colour, alpha, w, h);
+        if (QThemeAtlas::find(atlasKey, pm))
+            return themeAtlasLoaded(view(), atlasKey, pm, true);
+    }
+
     if (filename.endsWith(".svg")) {
         int w = width ? width : geometry().width();
         int h = height ? height : geometry().height();
@@ -3272,7 +3580,7 @@ QPixmap ThemePixmapItem::loadImage(const QString &filename, int colorRole, const
         QString key("QTV_%1_%2_%3_%4");
         key = key.arg(filename).arg(w).arg(h).arg(colour.name());
         if (QPixmapCache::find(key, pm))
-            return pm;
+            return themeAtlasLoaded(view(), atlasKey, pm);
         QImage buffer(w, h, QImage::Format_ARGB32_Premultiplied);
         buffer.fill(0);
         QPainter painter(&buffer);
@@ -3329,7 +3637,7 @@ QPixmap ThemePixmapItem::loadImage(const QString &filename, int colorRole, const
             colorizeImage( buffer, colour, alpha, colorRole != QPalette::NColorRoles );
         pm = QPixmap::fromImage(buffer);
         QPixmapCache::insert(key, pm);
-        return pm;
+        return themeAtlasLoaded(view(), atlasKey, pm);
     }
 
     if (colorRole != QPalette::NColorRoles || alpha != 255) {
@@ -3394,7 +3702,7 @@ QPixmap ThemePixmapItem::loadImage(const QString &filename, int colorRole, const
         if( pm.isNull() )
             pm = QPixmap(imgName);
     }
-    return pm;
+    return themeAtlasLoaded(view(), atlasKey, pm);
 }
 
 /*!
@@ -3466,10 +3774,17 @@ void ThemePixmapItem::scaleImage( const QString &key, int width, int height )
         if ( filename.endsWith(".svg") ) {
             QColor colour = color( QLatin1String("color") );
             int alpha = attribute( QLatin1String("alpha") );
-            map[key].pixmap = loadImage( map[key].filename, QPalette::NColorRoles, colour, alpha, width, height );
+            setImagePixmap( map[key], loadImage( map[key].filename, QPalette::NColorRoles, colour, alpha, width, height ) );
 
         } else if (!filename.isEmpty() && !map[key].pixmap.isNull()) {
-            map[key].pixmap = scalePixmap( map[key].pixmap, width, height );
+            QString atlasKey;
+            if (width > 0 && height > 0 && !map[key].atlasKey.isEmpty())
+                atlasKey = map[key].atlasKey + QString("_%1x%2").arg(width).arg(height);
+            QPixmap pm;
+            bool shared = !atlasKey.isEmpty() && QThemeAtlas::find(atlasKey, pm);
+            if (!shared)
+                pm = scalePixmap( map[key].pixmap, width, height );
+            setImagePixmap( map[key], themeAtlasLoaded(view(), atlasKey, pm, shared) );
         }
     }
 }
@@ -5704,6 +6019,8 @@ void ThemedView::setSourceFile(const QString &fileName)
 /*!
   Loads the themed view XML specified by \a fileName.
   If \a fileName is empty (the default) but ThemedView::setSourceFile() has been called, the \a fileName value from that call will be used.
+  If a compiled copy of the file, made by the themecompiler tool when the theme is installed, is present
+  and matches the XML, the items are created from it instead of parsing the XML.
   Returns true if a source was successfully loaded, otherwise returns false.
 */
 bool ThemedView::loadSource(const QString &fileName)
@@ -5723,10 +6040,18 @@ bool ThemedView::loadSource(const QString &fileName)
     }
     QFile file(d->themeSource);
     if (file.exists()){
-        if (file.open(QFile::ReadOnly | QFile::Text))
-            d->factory->readThemedView(&file);
-        file.close();
-        d->root = d->factory->root();
+        // Use the compiled theme if it is up to date, it saves parsing the XML
+        const QCompiledTheme *compiled = QCompiledTheme::load(d->themeSource);
+        if (compiled) {
+            CompiledThemeFactory factory(this);
+            factory.readThemedView(compiled);
+            d->root = factory.root();
+        } else {
+            if (file.open(QFile::ReadOnly | QFile::Text))
+                d->factory->readThemedView(&file);
+            file.close();
+            d->root = d->factory->root();
+        }
         if (d->root && isVisible()) {
             layout();
             update();
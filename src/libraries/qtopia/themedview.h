@@ -51,6 +51,7 @@ class QTOPIA_EXPORT ThemeItem
 {
     friend class ThemeTemplateInstanceItem;
     friend class ThemeFactory;
+    template <class Reader> friend class ThemeBuilder;
     friend struct ThemeItemPrivate;
 public:
     enum State
@@ -249,6 +250,7 @@ class ThemeTemplateInstanceItem;
 class QTOPIA_EXPORT ThemeTemplateItem : public ThemeItem
 {
     friend class ThemeFactory;
+    template <class Reader> friend class ThemeBuilder;
 
 public:
     ThemeTemplateItem(ThemeItem *parent, ThemedView *view, const ThemeAttributes &atts);
@@ -316,6 +318,7 @@ struct ThemeTextItemPrivate;
 class QTOPIA_EXPORT ThemeTextItem : public ThemeGraphicItem
 {
     friend class ThemeFactory;
+    template <class Reader> friend class ThemeBuilder;
 
 public:
     ThemeTextItem(ThemeItem *parent, ThemedView *view, const ThemeAttributes &atts);
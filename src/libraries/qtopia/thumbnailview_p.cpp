@@ -45,6 +45,7 @@
 #include <QContentSet>
 #include <Qtopia>
 #include "drmcontent_p.h"
+#include "qthumbnailcache_p.h"
 
 void ThumbnailCache::insert( const ThumbnailRequest& request, const QPixmap& pixmap )
 {
@@ -136,9 +137,13 @@ void ThumbnailLoader::load( const ThumbnailRequest &request )
 
 QImage ThumbnailLoader::loadThumbnail( const QString &filename, const QSize &size )
 {
-    QImageReader reader( filename );
+    // Use a pre-generated thumbnail if one is cached, the image need not be decoded
+    QImage image = QThumbnailCache::thumbnail( filename, size );
+
+    if( !image.isNull() )
+        return image;
 
-    QImage image;
+    QImageReader reader( filename );
 
     bool scaled = false;
 
@@ -50,6 +50,7 @@
 #include "qpacketprotocol.h"
 #include <QMutex>
 #include <QWaitCondition>
+#include <QTime>
 #include <qtopialog.h>
 
 #define VERSION_TABLE_ENTRIES 8191
@@ -57,6 +58,9 @@
 
 #define MAX_PATH_SIZE 16384
 #define MAX_DATA_SIZE 16384
+/* Attempts made to read the layer without locking before falling back to
+   taking the read lock */
+#define MAX_UNLOCKED_READS 4
 #define INVALID_HANDLE 0xFFFF
 
 #define ALIGN4b(n) ((n) + (((n) % 4)?(4 - ((n) % 4)):0))
@@ -88,6 +92,17 @@ static inline QDataStream& operator>>(QDataStream& stream, unsigned long& v)
     return stream;
 }
 
+/* Orders shared memory accesses on either side of an access to the layer's
+   write sequence counter. */
+static inline void vsmemorybarrier()
+{
+#if defined(Q_CC_GNU) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+    __sync_synchronize();
+#elif defined(Q_CC_GNU)
+    asm volatile("" ::: "memory");
+#endif
+}
+
 static int vsmemcmp(const char * s1, int l1, const char * s2, int l2)
 {
     if(l1 < l2)
@@ -113,6 +128,11 @@ struct VersionTable {
         };
     };
 
+    /* Write sequence counter.  Odd while the server is modifying the
+       layer, and even otherwise.  Clients read the layer without locking
+       and retry if the sequence was odd or changed during the read. */
+    volatile unsigned int sequence;
+
     unsigned int nxtFreeBlk;
     unsigned int nextCreationId;
 
@@ -323,6 +343,18 @@ public:
 
     inline QMallocPool *mallocPool() const { return pool; }
 
+    // Lock-free read protocol
+    inline void beginWrite();
+    inline void endWrite();
+    inline bool beginRead(unsigned int *sequence);
+    inline bool endRead(unsigned int sequence);
+
+    enum ReadResult { ReadInvalid, ReadNoData, ReadOk };
+    ReadResult readData(unsigned short node, unsigned int creationId,
+                        unsigned short *type, QByteArray *data);
+    ReadResult readChildren(unsigned short node, unsigned int creationId,
+                            QSet<QByteArray> *children);
+
     typedef void (*NodeChangeFunction)(unsigned short node, void *ctxt);
     void setNodeChangeFunction(NodeChangeFunction, void *);
 
@@ -373,7 +405,11 @@ private:
 
     inline Node * node(unsigned int);
 
+    inline void * checkedPtr(unsigned int ptr, unsigned int len);
+    inline Node * checkedNode(unsigned int entry);
+
     char * poolMem;
+    unsigned int poolSize;
     QMallocPool * pool;
     bool changed;
     NodeChangeFunction changeFunc;
@@ -385,7 +421,7 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 FixedMemoryTree::FixedMemoryTree(void * mem, unsigned int size,
                                  bool initMemory )
-: poolMem((char *)mem), pool(0), changed(false), changeFunc(0)
+: poolMem((char *)mem), poolSize(size), pool(0), changed(false), changeFunc(0)
 {
     Q_ASSERT(size);
     Q_ASSERT(poolMem);
@@ -1508,6 +1544,144 @@ void FixedMemoryTree::bump(unsigned short node)
         changeFunc(node, changeFuncContext);
 }
 
+/*!
+  Marks the start of a modification to the layer.  Only the server modifies
+  the layer, and it must hold the write lock while doing so.
+ */
+void FixedMemoryTree::beginWrite()
+{
+    ++(versionTable()->sequence);
+    vsmemorybarrier();
+}
+
+/*! Marks the end of a modification started with beginWrite() */
+void FixedMemoryTree::endWrite()
+{
+    vsmemorybarrier();
+    ++(versionTable()->sequence);
+}
+
+/*!
+  Starts an unlocked read of the layer, storing the current write sequence
+  in \a sequence.  Returns false if the server is part way through a
+  modification, in which case the read should not be attempted.
+ */
+bool FixedMemoryTree::beginRead(unsigned int *sequence)
+{
+    *sequence = versionTable()->sequence;
+    vsmemorybarrier();
+    return !(*sequence & 1);
+}
+
+/*!
+  Returns true if no modification has been made to the layer since the call
+  to beginRead() that returned \a sequence, meaning that any values read in
+  between are consistent.
+ */
+bool FixedMemoryTree::endRead(unsigned int sequence)
+{
+    vsmemorybarrier();
+    return versionTable()->sequence == sequence;
+}
+
+/*!
+  Returns \a ptr as an address if the \a len bytes it refers to lie within
+  the layer, or null otherwise.  Used while reading the layer without the
+  lock, where a concurrent modification may leave any pointer dangling.
+ */
+void * FixedMemoryTree::checkedPtr(unsigned int ptr, unsigned int len)
+{
+    if(ptr < sizeof(VersionTable) || ptr >= poolSize || len > poolSize - ptr)
+        return 0;
+    return (void *)(poolMem + ptr);
+}
+
+/*! Returns the node identified by \a entry, or null if it cannot be safely read */
+Node * FixedMemoryTree::checkedNode(unsigned int entry)
+{
+    if(entry >= VERSION_TABLE_ENTRIES)
+        return 0;
+    Node * rv =
+        (Node *)checkedPtr(versionTable()->entries[entry].nodePtr, sizeof(Node));
+    if(rv && !checkedPtr(ptr(rv), sizeof(Node) + ALIGN4b(rv->nameLen)))
+        return 0;
+    return rv;
+}
+
+/*!
+  Copies the default datum of \a node into \a data and \a type without
+  locking the layer, if the node still has the creation id \a creationId.
+  The result is only meaningful if endRead() subsequently succeeds.
+ */
+FixedMemoryTree::ReadResult
+FixedMemoryTree::readData(unsigned short node, unsigned int creationId,
+                          unsigned short *type, QByteArray *data)
+{
+    Node * n = checkedNode(node);
+    if(!n || n->creationId != creationId)
+        return ReadInvalid;
+
+    unsigned int dataCount = n->dataCount;
+    NodeDatum * datum = 0;
+    if(0 == dataCount) {
+        return ReadNoData;
+    } else if(1 == dataCount) {
+        datum = (NodeDatum *)checkedPtr(ptr(n->dataBegin()), sizeof(NodeDatum));
+    } else {
+        unsigned int * valueList = (unsigned int *)
+            checkedPtr(ptr(n->dataBegin()), sizeof(unsigned int));
+        if(valueList)
+            valueList = (unsigned int *)checkedPtr(*valueList, sizeof(unsigned int));
+        if(valueList)
+            datum = (NodeDatum *)checkedPtr(*valueList, sizeof(NodeDatum));
+    }
+
+    if(!datum)
+        return ReadInvalid;
+
+    unsigned int len = datum->len;
+    if(len > MAX_DATA_SIZE || !checkedPtr(ptr(datum->data), len))
+        return ReadInvalid;
+
+    *type = datum->type;
+    *data = QByteArray(datum->data, len);
+    return ReadOk;
+}
+
+/*!
+  Copies the names of the sub nodes of \a node into \a children without
+  locking the layer, if the node still has the creation id \a creationId.
+  The result is only meaningful if endRead() subsequently succeeds.
+ */
+FixedMemoryTree::ReadResult
+FixedMemoryTree::readChildren(unsigned short node, unsigned int creationId,
+                              QSet<QByteArray> *children)
+{
+    Node * n = checkedNode(node);
+    if(!n || n->creationId != creationId)
+        return ReadInvalid;
+
+    unsigned int subNodes = n->subNodes;
+    if(!subNodes)
+        return ReadOk;
+    if(subNodes > VERSION_TABLE_ENTRIES)
+        return ReadInvalid;
+
+    unsigned short * subNodeList = (unsigned short *)
+        checkedPtr(n->subNodePtr, subNodes * sizeof(unsigned short));
+    if(!subNodeList)
+        return ReadInvalid;
+
+    for(unsigned int ii = 0; ii < subNodes; ++ii) {
+        Node * sub = checkedNode(subNodeList[ii]);
+        if(!sub)
+            return ReadInvalid;
+        children->insert(QByteArray(sub->name, sub->nameLen));
+    }
+
+    return ReadOk;
+}
+
 Node * FixedMemoryTree::node(unsigned int entry)
 {
     Q_ASSERT(entry < VERSION_TABLE_ENTRIES);
@@ -1704,7 +1878,13 @@ public:
     QByteArray socket() const;
     void sync();
 
+    void beginTransaction();
+    void commitTransaction();
+    void setRateLimit(const QByteArray &prefix, int msecs);
+
     static QVariant fromDatum(const NodeDatum * data);
+    static QVariant fromData(unsigned short type, const char * data,
+                             unsigned int len);
 
     static ApplicationLayer * instance();
 
@@ -1730,6 +1910,12 @@ private:
     void doClientTransmit();
     void doServerTransmit();
 
+    void lockTree();
+    void unlockTree();
+    bool queueItem(NodeOwner owner,
+                   const QByteArray &path,
+                   const QVariant &val);
+
     struct ReadHandle
     {
         ReadHandle(const QByteArray &_path)
@@ -1800,6 +1986,57 @@ private:
 
     unsigned int changedNodesCount;
     unsigned short changedNodes[VERSION_TABLE_ENTRIES];
+    uchar changedNodesMask[(VERSION_TABLE_ENTRIES + 7) / 8];
+
+    /* Nesting depth of lockTree() calls.  The write lock is only taken and
+       released by the outermost call, so that all the changes in a client
+       packet or transaction become visible together. */
+    unsigned int treeLockDepth;
+
+    /* Set and remove requests for local item owners made while the tree is
+       locked.  Owners may read the tree in response, so they are delivered,
+       in order, once unlockTree() releases it. */
+    struct ItemRequest
+    {
+        bool remove;
+        QByteArray path;
+        QVariant value;
+    };
+    QList<ItemRequest> localRequests;
+
+    /* Nesting depth of beginTransaction() calls.  Clients hold their todo
+       packet until the transaction commits, the server buffers its own
+       changes in transactionOps. */
+    unsigned int transactionDepth;
+    struct TransactionOp
+    {
+        bool remove;
+        NodeOwner owner;
+        QByteArray path;
+        QVariant value;
+    };
+    QList<TransactionOp> transactionOps;
+
+    /* Per path prefix rate limiting of setItem().  Writes arriving within
+       interval msecs of the last flush are held in pending, with later values
+       replacing earlier ones, and are flushed by a timer. */
+    struct RateLimit
+    {
+        RateLimit() : interval(0), timerId(0) {}
+
+        int interval;
+        int timerId;
+        QTime lastFlush;
+        QMap<QPair<QByteArray, unsigned long>, QPair<NodeOwner, QVariant> > pending;
+    };
+    QMap<QByteArray, RateLimit> rateLimits;
+    RateLimit * rateLimit(const QByteArray &path);
+    bool throttleItem(NodeOwner owner,
+                      const QByteArray &path,
+                      const QVariant &val);
+    void discardThrottled(NodeOwner owner, const QByteArray &path);
+    void flushRateLimit(RateLimit &limit);
+    void flushRateLimits();
 
     // Stats memory
     unsigned long *m_statPoolSize;
@@ -1837,11 +2074,12 @@ ApplicationLayer::ApplicationLayer()
 : type(Client), layer(0), lock(0), todoTimer(0),
   nextPackId(1), lastSentId(0), lastRecvId(0), valid(false),
   forceChangeCount(0), clientIndexShmId(0), clientIndex(0),
-  changedNodesCount(0),
+  changedNodesCount(0), treeLockDepth(0), transactionDepth(0),
   m_statPoolSize(0), m_statMaxSystemBytes(0), m_statSystemBytes(0),
   m_statInuseBytes(0), m_statKeepCost(0)
 {
     sserver = new ALServerImpl( this );
+    ::memset(changedNodesMask, 0, sizeof(changedNodesMask));
 }
 
 ApplicationLayer::~ApplicationLayer()
@@ -2209,8 +2447,21 @@ void ALServerImpl::incomingConnection(int socketDescriptor)
     al->connections.insert(protocol);
 }
 
-void ApplicationLayer::timerEvent(QTimerEvent *)
+void ApplicationLayer::timerEvent(QTimerEvent *e)
 {
+    if(e->timerId() != todoTimer) {
+        for(QMap<QByteArray, RateLimit>::Iterator iter = rateLimits.begin();
+                iter != rateLimits.end();
+                ++iter) {
+            if(iter->timerId == e->timerId()) {
+                flushRateLimit(*iter);
+                return;
+            }
+        }
+        killTimer(e->timerId());
+        return;
+    }
+
     if(Client == type)
         doClientTransmit();
     else
@@ -2249,6 +2500,8 @@ void ApplicationLayer::doServerTransmit()
 
     }
 
+    for(unsigned int ii = 0; ii < changedNodesCount; ++ii)
+        changedNodesMask[changedNodes[ii] >> 3] &= ~(1 << (changedNodes[ii] & 0x7));
     changedNodesCount = 0;
     doClientEmit();
 }
@@ -2287,7 +2540,10 @@ void ApplicationLayer::disconnected()
         owner.data2 = 0xFFFFFFFF;
 
         connections.remove(protocol);
-        if(layer->remove("/", owner)) {
+        lockTree();
+        bool changed = layer->remove("/", owner);
+        unlockTree();
+        if(changed) {
             QPacket others;
             others << (quint8)APPLAYER_SYNC << (unsigned int)0;
             for(QSet<QPacketProtocol *>::ConstIterator iter = connections.begin();
@@ -2307,8 +2563,13 @@ static void AppLayerNodeChanged(unsigned short node, void *ctxt)
 
 void ApplicationLayer::nodeChanged(unsigned short node)
 {
-    if(changedNodesCount != VERSION_TABLE_ENTRIES)
-        changedNodes[changedNodesCount++] = node;
+    // Changes are accumulated until the next doServerTransmit(), so each
+    // node is only recorded once however many times it changes in between.
+    uchar bit = 1 << (node & 0x7);
+    if(changedNodesMask[node >> 3] & bit)
+        return;
+    changedNodesMask[node >> 3] |= bit;
+    changedNodes[changedNodesCount++] = node;
 }
 
 void ApplicationLayer::readyRead()
@@ -2362,7 +2623,11 @@ void ApplicationLayer::readyRead()
         bool changed = false;
         bool done = false;
 
-        changedNodesCount = 0;
+        // Apply the packet in one write section so that readers never observe
+        // a partially applied batch.  Set and remove requests are routed to the
+        // item owners in packet order; those for local owners are delivered
+        // when the write section ends.
+        lockTree();
 
         while(!done && !pack.isEmpty()) {
             quint8 op;
@@ -2460,11 +2725,14 @@ void ApplicationLayer::readyRead()
                 default:
                     qWarning("ApplicationLayer: Invalid client request %x "
                              "received.", op);
+                    unlockTree();
                     disconnected();
                     return;
             }
         }
 
+        unlockTree();
+
         // Send change notification
         QPacket causal;
         causal << (quint8)APPLAYER_SYNC << packId;
@@ -2651,6 +2919,33 @@ bool ApplicationLayer::value(HANDLE handle, QVariant *data)
 
     ReadHandle * rhandle = rh(handle);
 
+    if(0xFFFFFFFF == rhandle->currentPath) {
+        // The handle refers to a node - try to read it without locking
+        for(int attempt = 0; attempt < MAX_UNLOCKED_READS; ++attempt) {
+            unsigned int sequence;
+            if(!layer->beginRead(&sequence))
+                continue;
+
+            unsigned short type = 0;
+            QByteArray copy;
+            FixedMemoryTree::ReadResult result =
+                layer->readData(rhandle->currentNode, rhandle->creationId,
+                                &type, &copy);
+            if(!layer->endRead(sequence))
+                continue;
+
+            if(FixedMemoryTree::ReadOk == result) {
+                *data = fromData(type, copy.constData(), copy.size());
+                return true;
+            } else if(FixedMemoryTree::ReadNoData == result) {
+                return false;
+            }
+
+            // The node has been removed - refresh the handle under the lock
+            break;
+        }
+    }
+
     lock->lockForRead(-1);
 
     if(0xFFFFFFFF != rhandle->currentPath)
@@ -2735,6 +3030,31 @@ QSet<QByteArray> ApplicationLayer::children(HANDLE handle)
     ReadHandle * rhandle = rh(handle);
 
     QSet<QByteArray> rv;
+
+    if(0xFFFFFFFF == rhandle->currentPath) {
+        // The handle refers to a node - try to read it without locking
+        for(int attempt = 0; attempt < MAX_UNLOCKED_READS; ++attempt) {
+            unsigned int sequence;
+            if(!layer->beginRead(&sequence))
+                continue;
+
+            FixedMemoryTree::ReadResult result =
+                layer->readChildren(rhandle->currentNode,
+                                    rhandle->creationId, &rv);
+            if(!layer->endRead(sequence)) {
+                rv.clear();
+                continue;
+            }
+
+            if(FixedMemoryTree::ReadOk == result)
+                return rv;
+
+            // The node has been removed - refresh the handle under the lock
+            rv.clear();
+            break;
+        }
+    }
+
     lock->lockForRead(-1);
 
     if(0xFFFFFFFF != rhandle->currentPath)
@@ -2906,7 +3226,7 @@ void ApplicationLayer::clearHandle(ReadHandle *handle)
 
 void ApplicationLayer::triggerTodo()
 {
-    if(todoTimer || !valid)
+    if(todoTimer || !valid || (Client == type && transactionDepth))
         return;
     qLog(ApplicationLayer) << "Trigger todo";
     todoTimer = startTimer(0);
@@ -2989,7 +3309,10 @@ QList<NodeWatch> ApplicationLayer::watchers(const QByteArray &path)
 {
     Q_ASSERT(layer);
 
-    lock->lockForRead(-1);
+    // The tree write lock already excludes writers
+    bool locked = (treeLockDepth != 0);
+    if(!locked)
+        lock->lockForRead(-1);
 
     const char * matched = 0;
     unsigned short node = layer->findClosest(path.constData(), &matched);
@@ -3009,7 +3332,8 @@ QList<NodeWatch> ApplicationLayer::watchers(const QByteArray &path)
         node = n->parent;
     }
 
-    lock->unlock();
+    if(!locked)
+        lock->unlock();
 
     return owners;
 }
@@ -3025,7 +3349,14 @@ bool ApplicationLayer::doRemove(const QByteArray &path)
         if(0 == watch.data1) {
             // Local
             if(!written.contains(watch.data2)) {
-                doClientRemove(path);
+                if(treeLockDepth) {
+                    ItemRequest request;
+                    request.remove = true;
+                    request.path = path;
+                    localRequests.append(request);
+                } else {
+                    doClientRemove(path);
+                }
                 written.insert(watch.data2);
             }
         } else {
@@ -3052,7 +3383,15 @@ bool ApplicationLayer::doWriteItem(const QByteArray &path, const QVariant &val)
         if(0 == watch.data1) {
             // Local
             if(!written.contains(watch.data2)) {
-                doClientWrite(path, val);
+                if(treeLockDepth) {
+                    ItemRequest request;
+                    request.remove = false;
+                    request.path = path;
+                    request.value = val;
+                    localRequests.append(request);
+                } else {
+                    doClientWrite(path, val);
+                }
                 written.insert(watch.data2);
             }
         } else {
@@ -3092,10 +3431,9 @@ bool ApplicationLayer::doSetWatch(NodeWatch watch, const QByteArray &path)
 {
     Q_ASSERT(layer);
 
-    lock->lockForWrite(-1);
+    lockTree();
     bool rv = layer->addWatch(path.constData(), watch);
-    updateStats();
-    lock->unlock();
+    unlockTree();
 
     return rv;
 }
@@ -3124,10 +3462,9 @@ bool ApplicationLayer::doRemWatch(NodeWatch watch, const QByteArray &path)
 {
     Q_ASSERT(layer);
 
-    lock->lockForWrite(-1);
+    lockTree();
     bool rv = layer->remWatch(path.constData(), watch);
-    updateStats();
-    lock->unlock();
+    unlockTree();
 
     return rv;
 }
@@ -3143,6 +3480,18 @@ bool ApplicationLayer::setItem(NodeOwner owner, const QByteArray &path,
     if(path.count() > MAX_PATH_SIZE || path.startsWith("/.ValueSpace") || !valid)
         return false;
     Q_ASSERT(layer);
+
+    if(transactionDepth)
+        discardThrottled(owner, path);
+    else if(throttleItem(owner, path, val))
+        return true;
+
+    return queueItem(owner, path, val);
+}
+
+bool ApplicationLayer::queueItem(NodeOwner owner, const QByteArray &path,
+                                 const QVariant &val)
+{
     bool changed = false;
 
     if(Client == type) {
@@ -3152,6 +3501,14 @@ bool ApplicationLayer::setItem(NodeOwner owner, const QByteArray &path,
         todo << (quint8)APPLAYER_ADD << owner.data2 << path << val;
         triggerTodo();
         return true;
+    } else if(transactionDepth) {
+        TransactionOp op;
+        op.remove = false;
+        op.owner = owner;
+        op.path = path;
+        op.value = val;
+        transactionOps.append(op);
+        return true;
     } else {
         changed = doSetItem(owner, path, val);
         if(changed)
@@ -3165,7 +3522,7 @@ bool ApplicationLayer::doSetItem(NodeOwner owner, const QByteArray &path,
 {
     bool rv = false;
 
-    lock->lockForWrite(-1);
+    lockTree();
 
     switch(val.type()) {
         case QVariant::Bool:
@@ -3242,8 +3599,7 @@ bool ApplicationLayer::doSetItem(NodeOwner owner, const QByteArray &path,
             break;
     }
 
-    updateStats();
-    lock->unlock();
+    unlockTree();
 
     return rv;
 }
@@ -3254,12 +3610,22 @@ bool ApplicationLayer::remItems(NodeOwner owner, const QByteArray &path)
         return false;
     bool rv = false;
 
+    // A held back write must not resurrect the removed items later
+    discardThrottled(owner, path);
+
     if(Client == type) {
         if(todo.isEmpty())
             todo << newPackId();
 
         todo << (quint8)APPLAYER_REM << owner.data2 << path;
         triggerTodo();
+    } else if(transactionDepth) {
+        TransactionOp op;
+        op.remove = true;
+        op.owner = owner;
+        op.path = path;
+        transactionOps.append(op);
+        rv = true;
     } else {
         rv = doRemItems(owner, path);
         if(rv) triggerTodo();
@@ -3283,10 +3649,9 @@ bool ApplicationLayer::doRemItems(NodeOwner owner, const QByteArray &path)
 
     } else {
         Q_ASSERT(layer);
-        lock->lockForWrite(-1);
+        lockTree();
         rv = layer->remove(path.constData(), owner);
-        updateStats();
-        lock->unlock();
+        unlockTree();
     }
 
     return rv;
@@ -3312,6 +3677,14 @@ QByteArray ApplicationLayer::socket() const
 
 void ApplicationLayer::sync()
 {
+    if(transactionDepth) {
+        qWarning("ApplicationLayer: sync() called inside a transaction; "
+                 "call commitTransaction() first.");
+        return;
+    }
+
+    flushRateLimits();
+
     if(Client == type) {
         Q_ASSERT(1 == connections.count());
 
@@ -3337,38 +3710,247 @@ void ApplicationLayer::sync()
     }
 }
 
+/*!
+  Takes the tree write lock, unless it is already held by an enclosing call.
+  */
+void ApplicationLayer::lockTree()
+{
+    Q_ASSERT(Server == type);
+    if(treeLockDepth++)
+        return;
+
+    lock->lockForWrite(-1);
+    layer->beginWrite();
+}
+
+/*!
+  Releases the tree write lock taken by the matching lockTree(), then delivers
+  the set and remove requests for local item owners queued while it was held.
+  */
+void ApplicationLayer::unlockTree()
+{
+    Q_ASSERT(treeLockDepth);
+    if(--treeLockDepth)
+        return;
+
+    // The statistics nodes are part of the tree, so are written before
+    // readers are allowed to validate it
+    updateStats();
+    layer->endWrite();
+    lock->unlock();
+
+    QList<ItemRequest> requests = localRequests;
+    localRequests.clear();
+    for(int ii = 0; ii < requests.count(); ++ii) {
+        const ItemRequest &request = requests.at(ii);
+        if(request.remove)
+            doClientRemove(request.path);
+        else
+            doClientWrite(request.path, request.value);
+    }
+}
+
+void ApplicationLayer::beginTransaction()
+{
+    ++transactionDepth;
+}
+
+void ApplicationLayer::commitTransaction()
+{
+    if(!transactionDepth) {
+        qWarning("ApplicationLayer: commitTransaction() called without "
+                 "beginTransaction().");
+        return;
+    }
+
+    if(--transactionDepth || !valid)
+        return;
+
+    if(Client == type) {
+        // The todo packet is applied by the server as a single batch
+        doClientTransmit();
+    } else if(!transactionOps.isEmpty()) {
+        bool changed = false;
+
+        lockTree();
+        for(int ii = 0; ii < transactionOps.count(); ++ii) {
+            const TransactionOp &op = transactionOps.at(ii);
+            if(op.remove)
+                changed |= doRemItems(op.owner, op.path);
+            else
+                changed |= doSetItem(op.owner, op.path, op.value);
+        }
+        unlockTree();
+
+        transactionOps.clear();
+        if(changed)
+            triggerTodo();
+    }
+}
+
+void ApplicationLayer::setRateLimit(const QByteArray &prefix, int msecs)
+{
+    QByteArray path = prefix;
+    if(!path.startsWith('/'))
+        path.prepend('/');
+    if(path.length() > 1 && path.endsWith('/'))
+        path.truncate(path.length() - 1);
+
+    QMap<QByteArray, RateLimit>::Iterator iter = rateLimits.find(path);
+    if(msecs <= 0) {
+        if(iter != rateLimits.end()) {
+            flushRateLimit(*iter);
+            rateLimits.erase(iter);
+        }
+    } else {
+        rateLimits[path].interval = msecs;
+    }
+}
+
+/*!
+  Returns the rate limit with the longest prefix matching \a path, or 0 if
+  writes to \a path are not limited.
+  */
+ApplicationLayer::RateLimit * ApplicationLayer::rateLimit(const QByteArray &path)
+{
+    RateLimit *rv = 0;
+    int matched = -1;
+
+    for(QMap<QByteArray, RateLimit>::Iterator iter = rateLimits.begin();
+            iter != rateLimits.end();
+            ++iter) {
+        const QByteArray &prefix = iter.key();
+        if(prefix.length() <= matched)
+            continue;
+
+        if(prefix == "/" ||
+           (path.startsWith(prefix) &&
+            (path.length() == prefix.length() || path.at(prefix.length()) == '/'))) {
+            rv = &(*iter);
+            matched = prefix.length();
+        }
+    }
+
+    return rv;
+}
+
+/*!
+  Holds back the write of \a val to \a path if it falls within the rate limit
+  interval of its prefix.  Returns true if the write was held back.
+  */
+bool ApplicationLayer::throttleItem(NodeOwner owner, const QByteArray &path,
+                                    const QVariant &val)
+{
+    RateLimit *limit = rateLimit(path);
+    if(!limit)
+        return false;
+
+    if(!limit->timerId) {
+        int elapsed = limit->lastFlush.isNull()?-1:limit->lastFlush.elapsed();
+        if(elapsed < 0 || elapsed >= limit->interval) {
+            limit->lastFlush.start();
+            return false;
+        }
+        limit->timerId = startTimer(limit->interval - elapsed);
+    }
+
+    limit->pending.insert(qMakePair(path, owner.data2), qMakePair(owner, val));
+    return true;
+}
+
+/*!
+  Drops any held back writes by \a owner to \a path or its sub-paths.
+  */
+void ApplicationLayer::discardThrottled(NodeOwner owner, const QByteArray &path)
+{
+    QByteArray subPath = path.endsWith('/')?path:(path + '/');
+
+    for(QMap<QByteArray, RateLimit>::Iterator limit = rateLimits.begin();
+            limit != rateLimits.end();
+            ++limit) {
+        QMap<QPair<QByteArray, unsigned long>, QPair<NodeOwner, QVariant> >::Iterator iter =
+            limit->pending.begin();
+        while(iter != limit->pending.end()) {
+            if(iter.key().second == owner.data2 &&
+               (iter.key().first == path || iter.key().first.startsWith(subPath)))
+                iter = limit->pending.erase(iter);
+            else
+                ++iter;
+        }
+    }
+}
+
+void ApplicationLayer::flushRateLimit(RateLimit &limit)
+{
+    if(limit.timerId) {
+        killTimer(limit.timerId);
+        limit.timerId = 0;
+    }
+
+    if(limit.pending.isEmpty())
+        return;
+
+    limit.lastFlush.start();
+
+    QMap<QPair<QByteArray, unsigned long>, QPair<NodeOwner, QVariant> > pending =
+        limit.pending;
+    limit.pending.clear();
+
+    // Flush as a single batch
+    beginTransaction();
+    for(QMap<QPair<QByteArray, unsigned long>, QPair<NodeOwner, QVariant> >::ConstIterator iter = pending.begin();
+            iter != pending.end();
+            ++iter)
+        queueItem(iter->first, iter.key().first, iter->second);
+    commitTransaction();
+}
+
+void ApplicationLayer::flushRateLimits()
+{
+    for(QMap<QByteArray, RateLimit>::Iterator iter = rateLimits.begin();
+            iter != rateLimits.end();
+            ++iter)
+        flushRateLimit(*iter);
+}
+
 QVariant ApplicationLayer::fromDatum(const NodeDatum * data)
 {
-    switch(data->type) {
+    return fromData(data->type, data->data, data->len);
+}
+
+QVariant ApplicationLayer::fromData(unsigned short type, const char * data,
+                                    unsigned int len)
+{
+    switch(type) {
         case NodeDatum::Bool:
-            Q_ASSERT(4 == data->len);
-            return QVariant(0 != (*(unsigned int *)data->data));
+            Q_ASSERT(4 == len);
+            return QVariant(0 != (*(unsigned int *)data));
         case NodeDatum::Int:
-            Q_ASSERT(4 == data->len);
-            return QVariant((*(int *)data->data));
+            Q_ASSERT(4 == len);
+            return QVariant((*(int *)data));
         case NodeDatum::UInt:
-            Q_ASSERT(4 == data->len);
-            return QVariant((*(unsigned int *)data->data));
+            Q_ASSERT(4 == len);
+            return QVariant((*(unsigned int *)data));
         case NodeDatum::LongLong:
-            Q_ASSERT(8 == data->len);
-            return QVariant((*(long long*)data->data));
+            Q_ASSERT(8 == len);
+            return QVariant((*(long long*)data));
         case NodeDatum::ULongLong:
-            Q_ASSERT(8 == data->len);
-            return QVariant((*(unsigned long long*)data->data));
+            Q_ASSERT(8 == len);
+            return QVariant((*(unsigned long long*)data));
         case NodeDatum::Double:
-            Q_ASSERT(8 == data->len);
-            return QVariant((*(double*)data->data));
+            Q_ASSERT(8 == len);
+            return QVariant((*(double*)data));
         case NodeDatum::Char:
-            Q_ASSERT(4 == data->len);
-            return QVariant(QChar((unsigned short)(0xFFFF & (*(unsigned int*)data->data))));
+            Q_ASSERT(4 == len);
+            return QVariant(QChar((unsigned short)(0xFFFF & (*(unsigned int*)data))));
         case NodeDatum::String:
-            return QVariant(QString((QChar *)data->data,
-                                     data->len / sizeof(QChar)));
+            return QVariant(QString((QChar *)data,
+                                     len / sizeof(QChar)));
         case NodeDatum::ByteArray:
-            return QVariant(QByteArray(data->data, data->len));
+            return QVariant(QByteArray(data, len));
         case NodeDatum::SerializedType:
             {
-                QByteArray ba(data->data, data->len);
+                QByteArray ba(data, len);
                 QDataStream ds(ba);
                 QVariant rv;
                 ds >> rv;
@@ -3562,6 +4144,12 @@ void ApplicationLayer::doClientWrite(const QByteArray &path,
   generally unnecessary, and should be used sparingly to prevent unnecessary
   load on the system.
 
+  Where several attributes must change together, the changes can be grouped
+  with QValueSpaceObject::beginTransaction() and
+  QValueSpaceObject::commitTransaction().  Applications that update
+  attributes very frequently can limit the rate of writes with
+  QValueSpaceObject::setRateLimit().
+
   \i {Note:} The QValueSpaceObject class is not thread safe and may only be used from
   an application's main thread.
 
@@ -3676,6 +4264,74 @@ void QValueSpaceObject::sync()
     appLayer->sync();
 }
 
+/*!
+  Begins a transaction.
+
+  Attribute changes made by any QValueSpaceObject in the application after this
+  call are held back until the matching commitTransaction().  They are then
+  applied to the Value Space as a single atomic batch, so that other processes
+  never observe only some of them, and observers are notified of the batch
+  once rather than once per attribute.
+
+  Transactions may be nested, in which case changes are applied when the
+  outermost transaction is committed.  sync() must not be called while a
+  transaction is open.
+
+  \code
+  QValueSpaceObject object("/Device/Network/Interfaces/eth0");
+  QValueSpaceObject::beginTransaction();
+  object.setAttribute("BytesSent", sent);
+  object.setAttribute("BytesReceived", received);
+  object.setAttribute("Time", time);
+  QValueSpaceObject::commitTransaction();
+  \endcode
+
+  \sa commitTransaction()
+ */
+void QValueSpaceObject::beginTransaction()
+{
+    VS_CALL_ASSERT;
+    ApplicationLayer *appLayer = applicationLayer();
+    if(!appLayer) return;
+    appLayer->beginTransaction();
+}
+
+/*!
+  Commits the transaction started by beginTransaction().
+
+  \sa beginTransaction()
+ */
+void QValueSpaceObject::commitTransaction()
+{
+    VS_CALL_ASSERT;
+    ApplicationLayer *appLayer = applicationLayer();
+    if(!appLayer) return;
+    appLayer->commitTransaction();
+}
+
+/*!
+  Limits the rate at which this application writes attributes under
+  \a pathPrefix to once every \a msecs milliseconds.
+
+  Attribute values set within \a msecs of the previous write are held back and
+  written together when the interval expires.  If an attribute is set several
+  times in the interval only the last value is written.  This is useful for
+  rapidly changing values, such as signal strengths or transfer counters,
+  whose observers do not need every intermediate value.
+
+  If several prefixes match an attribute the longest one applies.  Attributes
+  set within a transaction are not limited.  Calling sync() writes all held
+  back values immediately.  Passing an \a msecs value of 0 removes the limit
+  for \a pathPrefix.
+ */
+void QValueSpaceObject::setRateLimit(const QByteArray &pathPrefix, int msecs)
+{
+    VS_CALL_ASSERT;
+    ApplicationLayer *appLayer = applicationLayer();
+    if(!appLayer) return;
+    appLayer->setRateLimit(pathPrefix, msecs);
+}
+
 /*!
   \fn void QValueSpaceObject::itemRemove(const QByteArray &attribute)
 
@@ -72,12 +72,15 @@ PRIVATE_HEADERS=\
 
 SEMI_PRIVATE_HEADERS=\
     testslaveinterface_p.h\
-    qcopenvelope_p.h
+    qcopenvelope_p.h\
+    qcompiledtheme_p.h\
+    qthemeatlas_p.h
 
 SOURCES=\
     qactionconfirm.cpp\
     qabstractipcinterfacegroup.cpp\
     qabstractipcinterfacegroupmanager.cpp\
+    qcompiledtheme.cpp\
     qcopenvelope.cpp\
     qdawg.cpp\
     qlog.cpp\
@@ -0,0 +1,467 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qcompiledtheme_p.h"
+#include "qmemoryfile_p.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QDataStream>
+#include <QDateTime>
+
+#include <string.h>
+
+static const char* theme_sig = "QTHM";
+static const quint32 theme_ver = 0x00000200;
+
+// FNV-1a, used to tell whether the compiled copy still matches its source
+static quint32 themeSourceHash(const QByteArray &source)
+{
+    quint32 hash = 2166136261u;
+    const uchar *data = (const uchar *)source.constData();
+    for (int i = 0; i < source.size(); ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Checks every index in the file, so that a corrupt file can't make the reader
+// access memory outside the mapping
+static bool themeIndicesValid(const QCompiledTheme::Header *h, const QCompiledTheme::String *strings,
+                              const QCompiledTheme::Node *nodes, const QCompiledTheme::Attribute *attributes)
+{
+    const quint32 none = QCompiledTheme::None;
+
+    for (quint32 i = 0; i < h->stringCount; ++i) {
+        if (strings[i].offset > h->poolSize || strings[i].length > h->poolSize - strings[i].offset)
+            return false;
+    }
+    for (quint32 i = 0; i < h->attributeCount; ++i) {
+        if (attributes[i].name >= h->stringCount || attributes[i].value >= h->stringCount)
+            return false;
+    }
+
+    // Elements must end after themselves and within their parent
+    QVector<quint32> ends;
+    for (quint32 i = 0; i < h->nodeCount; ++i) {
+        while (!ends.isEmpty() && ends.last() == i)
+            ends.pop_back();
+
+        const QCompiledTheme::Node &n = nodes[i];
+        if ((n.name != none && n.name >= h->stringCount) || (n.text != none && n.text >= h->stringCount))
+            return false;
+        if (n.name == none)
+            continue;
+        if (n.attributes > h->attributeCount || n.attributeCount > h->attributeCount - n.attributes)
+            return false;
+        if (n.end <= i || n.end > h->nodeCount || (!ends.isEmpty() && n.end > ends.last()))
+            return false;
+        ends.append(n.end);
+    }
+    return true;
+}
+
+typedef QHash<QString, QCompiledTheme *> CompiledThemeCache;
+Q_GLOBAL_STATIC(CompiledThemeCache, compiledThemes);
+// Superseded themes stay mapped, as loaded items may still share their strings
+typedef QList<QCompiledTheme *> CompiledThemeList;
+Q_GLOBAL_STATIC(CompiledThemeList, retiredThemes);
+
+/*!
+  \internal
+  \class QCompiledTheme
+    \inpublicgroup QtBaseModule
+
+  \brief The QCompiledTheme class provides access to a theme XML file that has been compiled into a binary format.
+
+  The themecompiler tool stores the elements, attributes and character data of a theme
+  XML file in a memory mappable file next to it. Strings are stored once, in UTF-16,
+  so loading a theme needs neither XML parsing nor text decoding; the strings handed out
+  share the mapped memory. For this reason a compiled theme, once loaded, stays mapped
+  for the life of the process.
+
+  The format is deliberately a token stream rather than a resolved item tree. Attribute
+  values are kept as text and expressions are compiled by the loader, because rects are
+  resolved against the display size, the keypad and touchscreen filters against the
+  device and \c{<tr>} text against the current language, none of which are known when the
+  image is built. Only ThemedView reads compiled themes; QThemedScene items read
+  themselves through QThemeItem::load*(QXmlStreamReader &) and always parse the XML.
+
+  The compiled file records the size, modification time and a hash of the XML it was
+  generated from. load() accepts it without reading the XML when the size and
+  modification time still match, and otherwise compares the hash, so a copy of the XML
+  with a new timestamp still uses the compiled file. load() returns 0 if there is no
+  compiled file or if it does not match the XML, and the caller should then read the XML
+  itself.
+
+  QCompiledThemeReader replays a compiled theme with the subset of the QXmlStreamReader
+  interface that the theme loaders use.
+*/
+
+QCompiledTheme::QCompiledTheme(const QString &fileName)
+    : memoryFile(0), header(0), strings(0), nodes(0), attributes(0)
+{
+    memoryFile = new QMemoryFile(fileName);
+    const char *mem = memoryFile->data();
+    if (!mem || memoryFile->size() < sizeof(Header))
+        return;
+
+    const Header *h = (const Header *)mem;
+    if (0 != strncmp(theme_sig, h->magic, 4) || h->version != theme_ver) {
+        qWarning("Wrong compiled theme format (found %.4s v.%x, require %.4s v.%x). Please regenerate %s.",
+                 h->magic, h->version, theme_sig, theme_ver, fileName.toLatin1().constData());
+        return;
+    }
+    quint64 size = sizeof(Header) + quint64(h->stringCount) * sizeof(String)
+                   + quint64(h->nodeCount) * sizeof(Node) + quint64(h->attributeCount) * sizeof(Attribute)
+                   + quint64(h->poolSize) * sizeof(ushort);
+    if (size != memoryFile->size()) {
+        qWarning("Compiled theme %s is truncated. Please regenerate it.", fileName.toLatin1().constData());
+        return;
+    }
+
+    strings = (const String *)(mem + sizeof(Header));
+    nodes = (const Node *)(strings + h->stringCount);
+    attributes = (const Attribute *)(nodes + h->nodeCount);
+    if (!themeIndicesValid(h, strings, nodes, attributes)) {
+        qWarning("Compiled theme %s is corrupt. Please regenerate it.", fileName.toLatin1().constData());
+        return;
+    }
+    pool = QString::fromRawData((const QChar *)(attributes + h->attributeCount), h->poolSize);
+    header = h;
+}
+
+/*!
+  Destroys the compiled theme and unmaps its file.
+*/
+QCompiledTheme::~QCompiledTheme()
+{
+    delete memoryFile;
+}
+
+/*!
+  Returns the compiled theme for \a xmlFile, or 0 if it has not been compiled or
+  the compiled file is out of date.
+*/
+const QCompiledTheme *QCompiledTheme::load(const QString &xmlFile)
+{
+    QString fileName = compiledFileName(xmlFile);
+    if (!QFile::exists(fileName))
+        return 0;
+
+    CompiledThemeCache *cache = compiledThemes();
+    QCompiledTheme *theme = cache->value(fileName);
+    if (theme && theme->matches(xmlFile))
+        return theme;
+
+    QCompiledTheme *compiled = new QCompiledTheme(fileName);
+    if (!compiled->isValid() || !compiled->matches(xmlFile)) {
+        if (compiled->isValid())
+            qWarning("Compiled theme %s is out of date, reading %s instead.",
+                     fileName.toLatin1().constData(), xmlFile.toLatin1().constData());
+        delete compiled;
+        return 0;
+    }
+    if (theme)
+        retiredThemes()->append(theme);
+    cache->insert(fileName, compiled);
+    return compiled;
+}
+
+/*!
+  Returns the name of the compiled file for \a xmlFile.
+*/
+QString QCompiledTheme::compiledFileName(const QString &xmlFile)
+{
+    QFileInfo fi(xmlFile);
+    return fi.path() + QLatin1Char('/') + fi.completeBaseName() + QLatin1String(".qtb");
+}
+
+bool QCompiledTheme::matches(const QString &xmlFile) const
+{
+    QFileInfo source(xmlFile);
+    if (!isValid() || header->sourceSize != (quint32)source.size())
+        return false;
+
+    // An XML file modified in the second it was compiled could have changed
+    // again without its timestamp showing it, so only trust the timestamp if
+    // the compiled file was written later. themecompiler dates the files it
+    // writes after their source for this.
+    if (header->sourceModified == source.lastModified().toTime_t()
+        && QFileInfo(compiledFileName(xmlFile)).lastModified().toTime_t() > header->sourceModified)
+        return true;
+
+    QFile file(xmlFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return header->sourceHash == themeSourceHash(file.readAll());
+}
+
+/*!
+  Returns string \a index. The string shares the mapped memory.
+*/
+QString QCompiledTheme::string(quint32 index) const
+{
+    if (index == None)
+        return QString();
+    return QString::fromRawData(pool.unicode() + strings[index].offset, strings[index].length);
+}
+
+/*!
+  Returns a reference to string \a index.
+*/
+QStringRef QCompiledTheme::stringRef(quint32 index) const
+{
+    if (index == None)
+        return QStringRef();
+    return QStringRef(&pool, strings[index].offset, strings[index].length);
+}
+
+struct ThemeStringTable
+{
+    quint32 intern(const QString &s)
+    {
+        QHash<QString, quint32>::ConstIterator it = ids.find(s);
+        if (it != ids.end())
+            return *it;
+        QCompiledTheme::String str;
+        str.offset = pool.size();
+        str.length = s.size();
+        pool += s;
+        quint32 id = strings.count();
+        strings.append(str);
+        ids.insert(s, id);
+        return id;
+    }
+
+    QHash<QString, quint32> ids;
+    QVector<QCompiledTheme::String> strings;
+    QString pool;
+};
+
+/*!
+  Compiles the theme XML read from \a xml and writes it to \a out. If \a byteswap is true
+  the result is written for a target with the opposite endianness to the host.
+
+  If \a xml is a QFile its modification time is recorded, so that load() can check the
+  compiled file without reading the XML. The file should be the one that will be
+  installed.
+
+  Returns false if the XML is not well formed or the result could not be written.
+*/
+bool QCompiledTheme::compile(QIODevice *xml, QIODevice *out, bool byteswap)
+{
+    QByteArray source = xml->readAll();
+    quint32 modified = 0;
+    if (QFile *file = qobject_cast<QFile *>(xml))
+        modified = QFileInfo(file->fileName()).lastModified().toTime_t();
+
+    QXmlStreamReader reader(source);
+    ThemeStringTable table;
+    QVector<Node> nodes;
+    QVector<Attribute> attributes;
+    QVector<int> open;
+
+    while (!reader.atEnd()) {
+        switch (reader.readNext()) {
+        case QXmlStreamReader::StartElement: {
+            Node n;
+            n.name = table.intern(reader.name().toString());
+            n.text = None;
+            n.attributes = attributes.count();
+            n.end = None;
+            foreach (QXmlStreamAttribute a, reader.attributes()) {
+                Attribute att;
+                att.name = table.intern(a.qualifiedName().toString());
+                att.value = table.intern(a.value().toString());
+                attributes.append(att);
+            }
+            n.attributeCount = attributes.count() - n.attributes;
+            open.append(nodes.count());
+            nodes.append(n);
+            break;
+        }
+        case QXmlStreamReader::EndElement:
+            nodes[open.last()].end = nodes.count();
+            open.pop_back();
+            break;
+        case QXmlStreamReader::Characters: {
+            Node n;
+            n.name = None;
+            n.text = table.intern(reader.text().toString());
+            n.attributes = 0;
+            n.attributeCount = 0;
+            n.end = nodes.count() + 1;
+            nodes.append(n);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (reader.hasError()) {
+        qWarning("%s at line %d", reader.errorString().toLatin1().constData(), (int)reader.lineNumber());
+        return false;
+    }
+
+    QDataStream ds(out);
+    bool bigEndian = (QSysInfo::ByteOrder == QSysInfo::BigEndian) != byteswap;
+    ds.setByteOrder(bigEndian ? QDataStream::BigEndian : QDataStream::LittleEndian);
+    if (ds.writeRawData(theme_sig, 4) != 4)
+        return false;
+    ds << theme_ver << (quint32)source.size() << modified << themeSourceHash(source)
+       << (quint32)table.strings.count() << (quint32)nodes.count()
+       << (quint32)attributes.count() << (quint32)table.pool.size();
+    for (int i = 0; i < table.strings.count(); ++i)
+        ds << table.strings[i].offset << table.strings[i].length;
+    for (int i = 0; i < nodes.count(); ++i)
+        ds << nodes[i].name << nodes[i].text << nodes[i].attributes << nodes[i].attributeCount << nodes[i].end;
+    for (int i = 0; i < attributes.count(); ++i)
+        ds << attributes[i].name << attributes[i].value;
+    for (int i = 0; i < table.pool.size(); ++i)
+        ds << table.pool.at(i).unicode();
+    return ds.status() == QDataStream::Ok;
+}
+
+/*!
+  \internal
+  \class QCompiledThemeReader
+    \inpublicgroup QtBaseModule
+
+  \brief The QCompiledThemeReader class reads a QCompiledTheme one token at a time, like QXmlStreamReader.
+
+  Only start elements, end elements and character data are reported, as comments and
+  processing instructions are not compiled. Unlike QXmlStreamReader, readElementText()
+  skips over nested elements instead of reporting an error.
+*/
+
+/*!
+  Constructs a reader with no theme; atEnd() is true after the first readNext().
+*/
+QCompiledThemeReader::QCompiledThemeReader()
+    : theme(0), token(QXmlStreamReader::NoToken), current(QCompiledTheme::None), next(0)
+{
+}
+
+/*!
+  Starts reading \a theme from the beginning.
+*/
+void QCompiledThemeReader::setTheme(const QCompiledTheme *theme)
+{
+    this->theme = theme;
+    token = QXmlStreamReader::NoToken;
+    current = QCompiledTheme::None;
+    next = 0;
+    open.clear();
+}
+
+/*!
+  Reads the next token and returns its type.
+*/
+QXmlStreamReader::TokenType QCompiledThemeReader::readNext()
+{
+    if (!theme || token == QXmlStreamReader::EndDocument) {
+        token = QXmlStreamReader::EndDocument;
+        return token;
+    }
+    if (!open.isEmpty() && next == theme->node(open.last()).end) {
+        current = open.last();
+        open.pop_back();
+        token = QXmlStreamReader::EndElement;
+    } else if (next >= theme->nodeCount()) {
+        current = QCompiledTheme::None;
+        token = QXmlStreamReader::EndDocument;
+    } else {
+        current = next++;
+        if (theme->node(current).name == QCompiledTheme::None) {
+            token = QXmlStreamReader::Characters;
+        } else {
+            token = QXmlStreamReader::StartElement;
+            open.append(current);
+        }
+    }
+    return token;
+}
+
+/*!
+  Returns the name of the current start or end element.
+*/
+QStringRef QCompiledThemeReader::name() const
+{
+    if (token != QXmlStreamReader::StartElement && token != QXmlStreamReader::EndElement)
+        return QStringRef();
+    return theme->stringRef(theme->node(current).name);
+}
+
+/*!
+  Returns the current character data.
+*/
+QStringRef QCompiledThemeReader::text() const
+{
+    if (token != QXmlStreamReader::Characters)
+        return QStringRef();
+    return theme->stringRef(theme->node(current).text);
+}
+
+/*!
+  Returns the attributes of the current start element.
+*/
+QXmlStreamAttributes QCompiledThemeReader::attributes() const
+{
+    QXmlStreamAttributes atts;
+    if (token != QXmlStreamReader::StartElement)
+        return atts;
+    const QCompiledTheme::Node &n = theme->node(current);
+    for (quint32 i = 0; i < n.attributeCount; ++i) {
+        const QCompiledTheme::Attribute &a = theme->attribute(n.attributes + i);
+        atts.append(theme->string(a.name), theme->string(a.value));
+    }
+    return atts;
+}
+
+/*!
+  Reads to the end of the current element and returns its character data.
+*/
+QString QCompiledThemeReader::readElementText()
+{
+    if (!isStartElement())
+        return QString();
+    QString result;
+    int depth = 0;
+    forever {
+        switch (readNext()) {
+        case QXmlStreamReader::Characters:
+            if (depth == 0)
+                result += text().toString();
+            break;
+        case QXmlStreamReader::StartElement:
+            ++depth;
+            break;
+        case QXmlStreamReader::EndElement:
+            if (depth-- == 0)
+                return result;
+            break;
+        default:
+            return result;
+        }
+    }
+}
@@ -0,0 +1,133 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+#ifndef QCOMPILEDTHEME_P_H
+#define QCOMPILEDTHEME_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Extended API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <qtopiaglobal.h>
+#include <QString>
+#include <QVector>
+#include <QXmlStreamReader>
+
+class QIODevice;
+class QMemoryFile;
+
+class QTOPIABASE_EXPORT QCompiledTheme
+{
+public:
+    enum { None = 0xffffffff };
+
+    struct Header {
+        char magic[4];
+        quint32 version;
+        quint32 sourceSize;
+        quint32 sourceModified;
+        quint32 sourceHash;
+        quint32 stringCount;
+        quint32 nodeCount;
+        quint32 attributeCount;
+        quint32 poolSize;
+    };
+
+    struct String {
+        quint32 offset;
+        quint32 length;
+    };
+
+    // Elements and character data in document order. Character data has
+    // name None; an element's descendants are the nodes up to its end.
+    struct Node {
+        quint32 name;
+        quint32 text;
+        quint32 attributes;
+        quint32 attributeCount;
+        quint32 end;
+    };
+
+    struct Attribute {
+        quint32 name;
+        quint32 value;
+    };
+
+    ~QCompiledTheme();
+
+    static const QCompiledTheme *load(const QString &xmlFile);
+    static QString compiledFileName(const QString &xmlFile);
+    static bool compile(QIODevice *xml, QIODevice *out, bool byteswap = false);
+
+    uint nodeCount() const { return header->nodeCount; }
+    const Node &node(uint index) const { return nodes[index]; }
+    const Attribute &attribute(uint index) const { return attributes[index]; }
+    QString string(quint32 index) const;
+    QStringRef stringRef(quint32 index) const;
+
+private:
+    explicit QCompiledTheme(const QString &fileName);
+    bool isValid() const { return header != 0; }
+    bool matches(const QString &xmlFile) const;
+
+    QMemoryFile *memoryFile;
+    const Header *header;
+    const String *strings;
+    const Node *nodes;
+    const Attribute *attributes;
+    QString pool;
+};
+
+class QTOPIABASE_EXPORT QCompiledThemeReader
+{
+public:
+    QCompiledThemeReader();
+
+    void setTheme(const QCompiledTheme *theme);
+
+    QXmlStreamReader::TokenType readNext();
+    QXmlStreamReader::TokenType tokenType() const { return token; }
+    bool atEnd() const { return token == QXmlStreamReader::EndDocument; }
+    bool isStartElement() const { return token == QXmlStreamReader::StartElement; }
+    bool isEndElement() const { return token == QXmlStreamReader::EndElement; }
+    bool isCharacters() const { return token == QXmlStreamReader::Characters; }
+
+    QStringRef name() const;
+    QStringRef text() const;
+    QXmlStreamAttributes attributes() const;
+    QString readElementText();
+
+    bool hasError() const { return false; }
+    QXmlStreamReader::Error error() const { return QXmlStreamReader::NoError; }
+
+private:
+    const QCompiledTheme *theme;
+    QXmlStreamReader::TokenType token;
+    uint current;
+    uint next;
+    QVector<uint> open;
+};
+
+#endif
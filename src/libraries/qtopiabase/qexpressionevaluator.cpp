@@ -22,7 +22,10 @@
 #include <QBuffer>
 #include <QByteArray>
 #include <QHash>
+#include <QPair>
 #include <QVector>
+#include <QCoreApplication>
+#include <QThread>
 
 /* System includes */
 #include <ctype.h>
@@ -35,6 +38,7 @@
 #include "qfixedpointnumber_p.h"
 
 #include <qvaluespace.h>
+#include <qtopialog.h>
 
 /*
     The expression framework is basically a simple compiler and software CPU
@@ -71,6 +75,17 @@
     are still valid operands to the * operator, the string value is coerced to
     a double at runtime. Failure to convert at runtime results in a runtime
     semantic error.
+
+    Compiled expressions are shared. ExpressionProgram owns the machine for
+    one expression text and floating point format, and every
+    QExpressionEvaluator in the application thread that sets the same
+    expression uses the same program. Terms are shared in the same way: there
+    is one QValueSpaceItem per valuespace key, however many programs refer to
+    it. A program connects once to each of its terms and is marked dirty when
+    one of them changes; until then evaluate() returns the memoised result of
+    the last execution instead of running the machine again. Subtrees that
+    reference no terms are folded into a single constant by the code
+    generator, so the only work left at run-time depends on the terms.
 */
 
 /*  TODO: The assignment operator, =, has been disabled in ExpressionParser::parseAssignment()
@@ -113,6 +128,7 @@ qexpressionevaluator.cpp
     ExpressionMachineInstruction
     ExpressionCodeGenerator
     ExpressionMachine
+    ExpressionProgram
     QExpressionEvaluatorPrivate
 
     DEFINITIONS
@@ -125,6 +141,7 @@ qexpressionevaluator.cpp
     ExpressionMachineInstruction
     ExpressionCodeGenerator
     ExpressionMachine
+    ExpressionProgram
     QExpressionEvaluatorPrivate
     Expression
    */
@@ -388,6 +405,16 @@ struct ExpressionMachineOperandDataRef
     uint count;
 };
 
+// Term references shared by all programs in the application thread, keyed by valuespace path
+typedef QHash<QString, ExpressionMachineOperandDataRef*> ExpressionTermTable;
+Q_GLOBAL_STATIC(ExpressionTermTable, expressionTerms);
+
+// Sharing is limited to the application thread, which is the only one that may use the valuespace
+static inline bool expressionSharingAllowed()
+{
+    return !QCoreApplication::instance() || QCoreApplication::instance()->thread() == QThread::currentThread();
+}
+
 //========================================
 //= ExpressionMachineOperandData Declaration
 //=======================================
@@ -433,6 +460,7 @@ struct ExpressionMachineOperand
 
     ExpressionMachineOperand& operator=( const ExpressionMachineOperand& other );
     void create( const ExpressionMachineOperand::Type& t );
+    void createTerm( const QString& key );
 
     /* Public Data */
     Type type;
@@ -514,6 +542,7 @@ private:
     void generateDataCode( ExpressionParserNode* data );
     ExpressionMachineInstruction getCompareCode( ExpressionParserNode* node ) const;
     void generateHelper( ExpressionParserNode* node );
+    void foldConstants( int instructionStart, int dataStart );
     ExpressionMachineOperand::Type tokenTypeToMachineType( ExpressionToken::Type t );
     bool isNodeDataType( ExpressionParserNode* node ) const;
 
@@ -541,6 +570,7 @@ public:
     /* Public Methods */
 
     bool execute();
+    bool fold( ExpressionMachineOperand& value );
     QVariant result();
     bool error() const;
 
@@ -554,6 +584,7 @@ private:
     QString instructionToText( ExpressionMachineInstruction i ) const;
 #endif
 
+    bool run();
     QVariant processTerm( const QVariant::Type& t );
     int stackInteger();
     QByteArray stackString();
@@ -573,6 +604,55 @@ private:
 
 //+========================================================================================================================+
 
+//========================================
+//= ExpressionProgram Declaration
+//=======================================
+class ExpressionProgram : public QObject
+{
+    Q_OBJECT
+public:
+    /* ExpressionProgram Ctors */
+    ExpressionProgram( const QByteArray& expression, QExpressionEvaluator::FloatingPointFormat format,
+                       const QVector<ExpressionMachineInstruction>& instructions, const QVector<ExpressionMachineOperand>& data );
+
+    /* ExpressionProgram Dtor */
+    ~ExpressionProgram();
+
+    /* Public Methods */
+    static ExpressionProgram* acquire( const QByteArray& expression, QExpressionEvaluator::FloatingPointFormat format );
+    void release();
+
+    bool evaluate();
+    QVariant result();
+    bool error() const;
+
+signals:
+    void termsChanged();
+
+private slots:
+    void termChanged();
+
+private:
+    /* Private Methods */
+    void reportUsage() const;
+
+    /* Private Data */
+    QByteArray m_expression;
+    QExpressionEvaluator::FloatingPointFormat m_format;
+    ExpressionMachine* m_machine;
+    bool m_dirty;
+    bool m_shared;
+    uint m_users;
+    uint m_executions; // times the machine was run
+    uint m_reused; // times a memoised result was returned instead
+};
+
+// Programs shared by all evaluators in the application thread, keyed by format and expression
+typedef QHash<QPair<int, QByteArray>, ExpressionProgram*> ExpressionProgramCache;
+Q_GLOBAL_STATIC(ExpressionProgramCache, expressionPrograms);
+
+//+========================================================================================================================+
+
 //=======================================
 //= QExpressionEvaluatorPrivate Declaration
 //=======================================
@@ -585,7 +665,7 @@ struct QExpressionEvaluatorPrivate
     /* Public Data */
     QByteArray expressionData;
     QVariant result;
-    ExpressionMachine* machine;
+    ExpressionProgram* program;
     QExpressionEvaluator::FloatingPointFormat floatingPointFormat;
 };
 
@@ -1418,6 +1498,12 @@ void ExpressionMachineOperand::decref() const
                 delete d.ref->s;
             }
             else if ( type == ExpressionMachineOperand::Term ) {
+                ExpressionTermTable* terms = expressionSharingAllowed() ? expressionTerms() : 0;
+                if( terms ) {
+                    QString key = terms->key(d.ref);
+                    if( !key.isNull() )
+                        terms->remove(key);
+                }
                 delete d.ref->t;
             }
             delete d.ref;
@@ -1447,6 +1533,29 @@ void ExpressionMachineOperand::create( const ExpressionMachineOperand::Type& t )
     addref();
 }
 
+/*
+    Makes this operand a term for the valuespace path \a key. In the
+    application thread the term is shared with every other operand for the
+    same path, so each key is backed by a single QValueSpaceItem.
+*/
+void ExpressionMachineOperand::createTerm( const QString& key )
+{
+    decref();
+    type = ExpressionMachineOperand::Term;
+    d.ref = 0;
+    ExpressionTermTable* terms = expressionSharingAllowed() ? expressionTerms() : 0;
+    if( terms )
+        d.ref = terms->value(key);
+    if( !d.ref ) {
+        d.ref = new ExpressionMachineOperandDataRef;
+        d.ref->count = 0;
+        d.ref->t = new QValueSpaceItem(key);
+        if( terms )
+            terms->insert(key, d.ref);
+    }
+    d.ref->count++;
+}
+
 //+========================================================================================================================+
 
 //=======================================
@@ -1532,14 +1641,43 @@ ExpressionMachineOperand::Type ExpressionCodeGenerator::tokenTypeToMachineType(
 
 void ExpressionCodeGenerator::generateHelper( ExpressionParserNode* node )
 {
+    int instructionStart = m_instructions.count();
+    int dataStart = m_data.count();
     if( node->leftChild != 0 )
         generateHelper( node->leftChild );
     if( node->rightChild != 0 )
         generateHelper( node->rightChild );
-    if( isNodeDataType(node) )
+    if( isNodeDataType(node) ) {
         generateDataCode(node);
-    else
+    } else {
         generateOpCode(node);
+        // only fold once every operand has been folded to a single constant
+        int operands = (node->leftChild != 0 ? 1 : 0) + (node->rightChild != 0 ? 1 : 0);
+        if( m_data.count() - dataStart == operands )
+            foldConstants( instructionStart, dataStart );
+    }
+}
+
+/*
+    Replaces the code generated for a subtree, starting at \a instructionStart
+    and \a dataStart, with a single Load of its value if the subtree references
+    no terms. The subtree is run on a machine of its own, so the folded value is
+    exactly what it would have been at run-time. If that fails, eg. a divide by
+    zero, the code is left as it is and the error is reported by evaluate().
+*/
+void ExpressionCodeGenerator::foldConstants( int instructionStart, int dataStart )
+{
+    for( int i = dataStart ; i < m_data.count() ; ++i )
+        if( m_data[i].type == ExpressionMachineOperand::Term )
+            return;
+    ExpressionMachine machine( m_instructions.mid(instructionStart), m_data.mid(dataStart) );
+    ExpressionMachineOperand value;
+    if( !machine.fold(value) )
+        return;
+    m_instructions.resize( instructionStart );
+    m_data.resize( dataStart );
+    m_data.append( value );
+    m_instructions.append( ExpressionMachineInstruction(ExpressionMachineInstruction::Load, value.type) );
 }
 
 void ExpressionCodeGenerator::generateDataCode( ExpressionParserNode* data )
@@ -1550,8 +1688,8 @@ void ExpressionCodeGenerator::generateDataCode( ExpressionParserNode* data )
     ExpressionMachineOperand::Type runtimeType = /* Silence compiler warning */ ExpressionMachineOperand::Bool;
     if( data->token.type == ExpressionToken::Term ) {
         Q_ASSERT( !data->vskey.isNull() );
-        ExpressionMachineOperand operand( ExpressionMachineOperand::Term );
-        *operand.d.ref->t = QValueSpaceItem( data->vskey );
+        ExpressionMachineOperand operand;
+        operand.createTerm( data->vskey );
         switch( data->returnType ) {
             case ExpressionToken::String:
                 runtimeType = ExpressionMachineOperand::String;
@@ -2069,7 +2207,7 @@ ExpressionMachine::~ExpressionMachine()
                    op_result.d.f.precision = fpr.precision; op_result.d.f.value = fpr.value; \
                        m_s.append( op_result ); fpr.value = 0; fpr.precision = 0;
 
-bool ExpressionMachine::execute()
+bool ExpressionMachine::run()
 {
     QFixedPointNumber fpr;
     double dr = 0.0;
@@ -2431,11 +2569,31 @@ bool ExpressionMachine::execute()
         }
         ++m_iptr;
     }
+    return true;
+}
+
+bool ExpressionMachine::execute()
+{
+    if( !run() )
+        return false;
     Q_ASSERT(m_s.count() == 0);
     Q_ASSERT(m_result.isValid());
     return true;
 }
 
+/*
+    Runs code that leaves its value on the stack instead of storing it, as
+    generated for a constant subtree, and returns that value in \a value.
+*/
+bool ExpressionMachine::fold( ExpressionMachineOperand& value )
+{
+    if( !run() || m_errorflag || m_s.count() != 1 )
+        return false;
+    value = m_s.last();
+    m_s.clear();
+    return true;
+}
+
 QVariant ExpressionMachine::result()
 {
     if( m_result.isValid() )
@@ -2791,6 +2949,146 @@ bool ExpressionMachine::stackBool()
 
 //+========================================================================================================================+
 
+//=======================================
+//= ExpressionProgram Definition
+//=======================================
+/* Public Methods */
+/* ExpressionProgram Ctors */
+ExpressionProgram::ExpressionProgram( const QByteArray& expression, QExpressionEvaluator::FloatingPointFormat format,
+                                      const QVector<ExpressionMachineInstruction>& instructions, const QVector<ExpressionMachineOperand>& data )
+    : m_expression(expression)
+    , m_format(format)
+    , m_machine(new ExpressionMachine(instructions, data))
+    , m_dirty(true)
+    , m_shared(false)
+    , m_users(1)
+    , m_executions(0)
+    , m_reused(0)
+{
+    // connect once to each term, however often the expression refers to it
+    QList<QValueSpaceItem*> terms;
+    for( int i = 0 ; i < data.count() ; ++i ) {
+        if( data[i].type == ExpressionMachineOperand::Term && !terms.contains(data[i].d.ref->t) ) {
+            terms.append(data[i].d.ref->t);
+            connect(data[i].d.ref->t, SIGNAL(contentsChanged()), this, SLOT(termChanged()));
+        }
+    }
+}
+
+/* ExpressionProgram Dtor */
+ExpressionProgram::~ExpressionProgram()
+{
+    delete m_machine;
+}
+
+/*
+    Returns the program for \a expression compiled with \a format, with a
+    reference held for the caller. In the application thread an existing
+    program for the same expression is shared. Returns 0 if the expression is
+    syntactically or semantically invalid.
+*/
+ExpressionProgram* ExpressionProgram::acquire( const QByteArray& expression, QExpressionEvaluator::FloatingPointFormat format )
+{
+    ExpressionProgramCache* programs = expressionSharingAllowed() ? expressionPrograms() : 0;
+    QPair<int, QByteArray> key( format, expression );
+    ExpressionProgram* program = programs ? programs->value(key) : 0;
+    if( program != 0 ) {
+        ++program->m_users;
+        return program;
+    }
+
+    /* Create a parser instance */
+    ExpressionParser* pp = new ExpressionParser( expression );
+    ExpressionParserNode* node = pp->parse();
+    if( node == 0 ) {
+        // error: Unable to parse the expression
+        qWarning("error: unable to parse the expression");
+    } else {
+        /* Do semantic checking and code generator on the parse tree */
+        ExpressionCodeGenerator* ss = new ExpressionCodeGenerator( node );
+        ss->setFixedPoint( format == QExpressionEvaluator::FixedPoint );
+        if( ss->generate() ) {
+            /* Checked out OK, should have generated code */
+            program = new ExpressionProgram( expression, format, ss->instructions(), ss->data() );
+            if( programs ) {
+                program->m_shared = true;
+                programs->insert(key, program);
+            }
+#ifdef EXPRESSION_TESTING
+            qWarning("machine data is:\n%s", program->m_machine->dumpInfo().toAscii().data());
+#endif
+        } else {
+            // error: semantic error in the expression
+            qWarning("error: semantic error in the expression");
+        }
+        delete ss;
+    }
+    delete pp; // only thing left in memory is the program
+    return program;
+}
+
+/*
+    Drops the caller's reference, destroying the program when it was the last.
+*/
+void ExpressionProgram::release()
+{
+    Q_ASSERT(m_users > 0);
+    if( --m_users != 0 )
+        return;
+    if( m_shared ) {
+        ExpressionProgramCache* programs = expressionPrograms();
+        if( programs )
+            programs->remove(qMakePair(int(m_format), m_expression));
+    }
+    delete this;
+}
+
+/*
+    Runs the machine if a term has changed since the last successful run,
+    otherwise leaves the memoised result in place.
+*/
+bool ExpressionProgram::evaluate()
+{
+    if( !m_dirty ) {
+        ++m_reused;
+        return true;
+    }
+    if( !m_machine->execute() )
+        return false;
+    m_dirty = false;
+    ++m_executions;
+    // report hot expressions at every power of two, so the log stays short
+    if( m_executions >= 16 && (m_executions & (m_executions - 1)) == 0 )
+        reportUsage();
+    return true;
+}
+
+QVariant ExpressionProgram::result()
+{
+    return m_machine->result();
+}
+
+bool ExpressionProgram::error() const
+{
+    return m_machine->error();
+}
+
+/* Private Methods */
+void ExpressionProgram::termChanged()
+{
+    m_dirty = true;
+    emit termsChanged();
+}
+
+void ExpressionProgram::reportUsage() const
+{
+    qLog(Performance) << "Expression" << m_expression << "executed" << m_executions
+                      << "times, memoised result reused" << m_reused << "times by"
+                      << m_users << "evaluator(s)";
+}
+
+//+========================================================================================================================+
+
 //=======================================
 //= QExpressionEvaluatorPrivate Definition
 //=======================================
@@ -2931,6 +3229,24 @@ bool ExpressionMachine::stackBool()
     If a value in the valuespace changes, expressions which use that value will
     emit the termsChanged() signal.
 
+    \section1 Sharing and Caching
+
+    Evaluators in the application thread that are given the same expression
+    and floating point format share a single compiled copy of it, and every
+    valuespace key is watched by a single QValueSpaceItem however many
+    expressions use it. Parts of an expression that do not depend on the
+    valuespace are calculated once, when the expression is set.
+
+    The result of an expression is kept until one of its valuespace terms
+    changes, so evaluate() only recalculates an expression after termsChanged()
+    has been emitted for it. Calling evaluate() on many evaluators that share an
+    expression therefore costs a single calculation.
+
+    The number of times each expression is recalculated, and the number of times
+    a kept result was reused instead, is reported to the \c Performance log
+    category as the count passes each power of two from 16. Theme authors can
+    use this to find the expressions that are recalculated most often.
+
     \ingroup misc
 */
 
@@ -2969,7 +3285,7 @@ bool ExpressionMachine::stackBool()
 /* Public Methods */
 /* QExpressionEvaluatorPrivate Ctors */
 QExpressionEvaluatorPrivate::QExpressionEvaluatorPrivate()
-    : machine(0), floatingPointFormat(QExpressionEvaluator::Double)
+    : program(0), floatingPointFormat(QExpressionEvaluator::Double)
 {}
 
 //+========================================================================================================================+
@@ -3009,9 +3325,7 @@ QExpressionEvaluator::QExpressionEvaluator( const QByteArray& expr, QObject* par
 */
 QExpressionEvaluator::~QExpressionEvaluator()
 {
-    if( d->machine )
-        delete d->machine;
-
+    clear();
     delete d;
 }
 
@@ -3025,7 +3339,7 @@ QExpressionEvaluator::~QExpressionEvaluator()
 */
 bool QExpressionEvaluator::isValid() const
 {
-    return !d->expressionData.isEmpty() && d->machine != 0 && !d->machine->error();
+    return !d->expressionData.isEmpty() && d->program != 0 && !d->program->error();
 }
 
 /*!
@@ -3041,13 +3355,13 @@ bool QExpressionEvaluator::isValid() const
 */
 bool QExpressionEvaluator::evaluate()
 {
-    Q_ASSERT(d->machine != 0);
-    if( !d->machine->execute() ) {
+    Q_ASSERT(d->program != 0);
+    if( !d->program->evaluate() ) {
         // error: machine runtime error
         qWarning("error: machine runtime error");
         return false;
     }
-    d->result = d->machine->result();
+    d->result = d->program->result();
     return true;
 }
 
@@ -3058,8 +3372,8 @@ bool QExpressionEvaluator::evaluate()
 */
 QVariant QExpressionEvaluator::result()
 {
-    if( d->machine )
-        return d->machine->result();
+    if( d->program )
+        return d->program->result();
     return QVariant();
 }
 
@@ -3070,9 +3384,10 @@ QVariant QExpressionEvaluator::result()
 */
 void QExpressionEvaluator::clear()
 {
-    if( d->machine != 0 ) {
-        delete d->machine;
-        d->machine = 0;
+    if( d->program != 0 ) {
+        disconnect(d->program, 0, this, 0);
+        d->program->release();
+        d->program = 0;
     }
 }
 
@@ -3085,7 +3400,7 @@ void QExpressionEvaluator::clear()
 void QExpressionEvaluator::setFloatingPointFormat( const FloatingPointFormat& fmt ) {
     if( d->floatingPointFormat != fmt ) {
         d->floatingPointFormat = fmt;
-        if( d->machine != 0 )
+        if( d->program != 0 )
             qWarning("QExpressionEvaluator::setFloatingPointFormat - Called with existing expression, no effect until next call to QExpressionEvaluator::setExpression()");
     }
 }
@@ -3115,41 +3430,12 @@ bool QExpressionEvaluator::setExpression( const QByteArray& expr )
         clear();
         if( d->expressionData.isEmpty() )
             return true;
-        /* Parse the expression now */
-
-        /* Create a parser instance */
-        ExpressionParser* pp = new ExpressionParser( expr );
-        ExpressionParserNode* node = pp->parse();
-        if( node == 0 ) {
-            // error: Unable to parse the expression
-            qWarning("error: unable to parse the expression");
+        /* Compile the expression now, or share an existing compilation */
+        d->program = ExpressionProgram::acquire( expr, d->floatingPointFormat );
+        if( d->program != 0 )
+            connect(d->program, SIGNAL(termsChanged()), this, SIGNAL(termsChanged()));
+        else
             ok = false;
-
-        } else {
-            /* Do semantic checking and code generator on the parse tree */
-            ExpressionCodeGenerator* ss = new ExpressionCodeGenerator( node );
-            ss->setFixedPoint( d->floatingPointFormat == QExpressionEvaluator::FixedPoint );
-            if( ss->generate() ) {
-                /* Checked out OK, should have generated code */
-//  dumps generated instructions and data, for debugging
-
-                QVector<ExpressionMachineOperand> data = ss->data();
-                for( int i = 0 ; i < data.count() ; ++i )
-                    if( data[i].type == ExpressionMachineOperand::Term )
-                        connect(data[i].d.ref->t, SIGNAL(contentsChanged()), this, SIGNAL(termsChanged()));
-                d->machine = new ExpressionMachine( ss->instructions(), data);
-
-#ifdef EXPRESSION_TESTING
-                qWarning("machine data is:\n%s", d->machine->dumpInfo().toAscii().data());
-#endif
-            } else {
-                // error: semantic error in the expression
-                qWarning("error: semantic error in the expression");
-                ok = false;
-            }
-            delete ss;
-        }
-        delete pp; // only thing left in memory is machine
     }
     return ok;
 }
@@ -3163,3 +3449,5 @@ QByteArray QExpressionEvaluator::expression() const
 }
 
 //+========================================================================================================================+
+
+#include "qexpressionevaluator.moc"
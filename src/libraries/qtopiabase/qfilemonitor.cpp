@@ -231,6 +231,8 @@ private slots:
     void directoryChanged(const QString &);
 
 private:
+    void processEvent(const inotify_event &);
+
     int m_fd;
 
     struct Directory {
@@ -478,6 +480,9 @@ QFileMonitorPrivate::QFileMonitorPrivate(const QString & f,
 : prov(0), parent(p), refCount(1)
 {
     fileName = QDir::cleanPath(f);
+    // A trailing separator requests monitoring of the directory itself
+    if(f.endsWith(QLatin1Char('/')) && !fileName.endsWith(QLatin1Char('/')))
+        fileName.append(QLatin1Char('/'));
     prov = fileMonitorProvider(s);
     FileMonitorProvider * fmp = prov();
     if(fmp)
@@ -545,6 +550,12 @@ void QFileMonitorPrivate::fileChanged()
 
   \endlist
 
+  If the monitored file name ends with a '/', the directory itself is monitored.
+  With the INotify strategy fileChanged() is then emitted whenever an entry in
+  the directory is created, removed, renamed or modified.  The DNotify and Poll
+  strategies only detect changes to the directory's modification time, that is
+  entries being created, removed or renamed.
+
   To avoid race conditions when using QFileMonitor to trigger re-reading of file
   contents, you should always construct QFileMonitor and \i {only then} read the
   initial file contents.
@@ -1037,12 +1048,21 @@ INotifyFileMonitor::INotifyFileMonitor()
 void INotifyFileMonitor::activated()
 {
     char buffer[INOTIFY_BUFSIZE];
-    inotify_event & event = *((inotify_event *)buffer);
 
-    int readrv = ::read(m_fd, &event, INOTIFY_BUFSIZE);
+    int readrv = ::read(m_fd, buffer, INOTIFY_BUFSIZE);
     Q_ASSERT(readrv >= (int)sizeof(inotify_event));
-    Q_UNUSED(readrv);
 
+    // A single read may return several events
+    int offset = 0;
+    while(offset + (int)sizeof(inotify_event) <= readrv) {
+        const inotify_event & event = *((inotify_event *)(buffer + offset));
+        offset += sizeof(inotify_event) + event.len;
+        processEvent(event);
+    }
+}
+
+void INotifyFileMonitor::processEvent(const inotify_event &event)
+{
     // Locate the directory this wd was for
     QMap<int, Directory>::Iterator diter = m_monitoredPaths.find(event.wd);
     if(diter == m_monitoredPaths.end()) return;
@@ -1072,18 +1092,29 @@ void INotifyFileMonitor::activated()
             monitors[ii]->Release();
 
     } else {
-        // Regular run-of-the-mill change
-        QByteArray file(event.name, event.len);
+        // Regular run-of-the-mill change.  The name is NUL padded.
+        QByteArray file(event.len ? event.name : "");
 
+        QList<Directory::File> changed;
         QMap<QByteArray, Directory::File>::ConstIterator fiter =
             dir.files.find(file);
-        if(fiter == dir.files.end()) return;
+        if(fiter != dir.files.end())
+            changed.append(*fiter);
+
+        // Monitors of the directory itself see changes to any entry
+        if(!file.isEmpty()) {
+            fiter = dir.files.find(QByteArray(""));
+            if(fiter != dir.files.end())
+                changed.append(*fiter);
+        }
 
         // Emit!
-        Directory::File f= *fiter;
-        f.AddRef();
-        doFileChanged(f.monitors);
-        f.Release();
+        for(int ii = 0; ii < changed.count(); ++ii)
+            changed[ii].AddRef();
+        for(int ii = 0; ii < changed.count(); ++ii)
+            doFileChanged(changed.at(ii).monitors);
+        for(int ii = 0; ii < changed.count(); ++ii)
+            changed[ii].Release();
     }
 }
 
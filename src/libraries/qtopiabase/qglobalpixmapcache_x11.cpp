@@ -18,6 +18,7 @@
 ****************************************************************************/
 
 #include "qglobalpixmapcache.h"
+#include "qthemeatlas_p.h"
 
 #ifdef Q_WS_X11
 
@@ -40,4 +41,27 @@ void QGlobalPixmapCache::remove( const QString &key )
     Q_UNUSED(key);
 }
 
+bool QThemeAtlas::find( const QString &key, QPixmap &pixmap )
+{
+    Q_UNUSED(key);
+    Q_UNUSED(pixmap);
+    return false;
+}
+
+bool QThemeAtlas::publish( const QMap<QString, QImage> &images )
+{
+    Q_UNUSED(images);
+    return false;
+}
+
+bool QThemeAtlas::canPublish()
+{
+    return false;
+}
+
+int QThemeAtlas::generation()
+{
+    return 0;
+}
+
 #endif // Q_WS_X11
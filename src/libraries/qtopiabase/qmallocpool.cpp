@@ -36,12 +36,17 @@ static struct malloc_state * qmallocpool_state(QMallocPoolPrivate *);
 #include "dlmalloc.c"
 #include <strings.h>
 
+// Shared pools keep the break pointer alongside the malloc state so every instance allocates from the same region.
+static const unsigned int qmallocpool_shared_state_size =
+    (sizeof(struct malloc_state) + sizeof(unsigned int) + 7) & ~7;
+
 class QMallocPoolPrivate
 {
 public:
     QMallocPoolPrivate(void * _pool, unsigned int _poolLen,
                        QMallocPool::PoolType type, const QString &_name)
-        : name(_name), pool((char *)_pool), poolLength(_poolLen), poolPtr(0)
+        : name(_name), pool((char *)_pool), poolLength(_poolLen), poolPtr(&owned_poolPtr),
+          owned_poolPtr(0)
     {
         Q_ASSERT(pool);
         Q_ASSERT(poolLength > 0);
@@ -50,23 +55,26 @@ public:
             ::bzero(&owned_mstate, sizeof(struct malloc_state));
             mstate = &owned_mstate;
         } else if(QMallocPool::NewShared == type) {
-            Q_ASSERT(poolLength >= sizeof(struct malloc_state));
-            ::bzero(pool, sizeof(struct malloc_state));
+            Q_ASSERT(poolLength >= qmallocpool_shared_state_size);
+            ::bzero(pool, qmallocpool_shared_state_size);
             mstate = (struct malloc_state *)pool;
-            pool += sizeof(struct malloc_state);
-            poolLength -= sizeof(struct malloc_state);
+            poolPtr = (unsigned int *)(pool + sizeof(struct malloc_state));
+            pool += qmallocpool_shared_state_size;
+            poolLength -= qmallocpool_shared_state_size;
         } else if(QMallocPool::Shared == type) {
-            Q_ASSERT(poolLength >= sizeof(struct malloc_state));
+            Q_ASSERT(poolLength >= qmallocpool_shared_state_size);
             mstate = (struct malloc_state *)pool;
-            pool += sizeof(struct malloc_state);
-            poolLength -= sizeof(struct malloc_state);
+            poolPtr = (unsigned int *)(pool + sizeof(struct malloc_state));
+            pool += qmallocpool_shared_state_size;
+            poolLength -= qmallocpool_shared_state_size;
         }
     }
 
     QString name;
     char * pool;
     unsigned int poolLength;
-    unsigned int poolPtr;
+    unsigned int *poolPtr;
+    unsigned int owned_poolPtr;
     struct malloc_state *mstate;
     struct malloc_state owned_mstate;
 };
@@ -84,18 +92,18 @@ static void* qmallocpool_sbrk(intptr_t increment)
 
     if(increment > 0) {
         if((unsigned)increment > d->poolLength ||
-           (d->poolLength - increment) < d->poolPtr)
+           (d->poolLength - increment) < *d->poolPtr)
             // Failure
             return (void *)MORECORE_FAILURE;
 
-        void * rv = (void *)(d->pool + d->poolPtr);
-        d->poolPtr += increment;
+        void * rv = (void *)(d->pool + *d->poolPtr);
+        *d->poolPtr += increment;
         return rv;
 
     } else /* increment <= 0 */ {
-        Q_ASSERT(d->poolPtr >= (unsigned)(-1 * increment));
-        d->poolPtr += increment;
-        return (void *)(d->pool + d->poolPtr);
+        Q_ASSERT(*d->poolPtr >= (unsigned)(-1 * increment));
+        *d->poolPtr += increment;
+        return (void *)(d->pool + *d->poolPtr);
     }
 }
 
@@ -191,7 +199,7 @@ QMallocPool::QMallocPool(void * poolBase, unsigned int poolLength,
 : d(0)
 {
     if((type == NewShared || Shared == type) &&
-            poolLength < sizeof(struct malloc_state))
+            poolLength < qmallocpool_shared_state_size)
         return;
 
     d = new QMallocPoolPrivate(poolBase, poolLength, type, name);
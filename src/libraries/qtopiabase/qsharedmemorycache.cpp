@@ -19,6 +19,7 @@
 
 #include "qsharedmemorycache_p.h"
 #include "qglobalpixmapcache.h"
+#include "qthemeatlas_p.h"
 #include "qtopianamespace.h"
 #include <qtopialog.h>
 #include <QPixmapCache>
@@ -29,6 +30,7 @@
 #include <private/qlock_p.h>
 #include <private/qpixmapdata_p.h>
 #include <QStringList>
+#include <QPainter>
 #include <qglobal.h>
 
 #include <qwindowdefs.h>
@@ -58,6 +60,7 @@
 #include <time.h>
 #include <stdio.h>
 #include <signal.h>
+#include <math.h>
 
 #ifdef THROW_AWAY_UNUSED_PAGES
 # include <sys/mman.h> // madvise
@@ -167,6 +170,15 @@ public:
     int cacheInsertMisses;
     int cacheInsertStrcmps;
 
+    // Theme atlas
+    int atlasGeneration;
+    int atlasEntries;
+    int atlasSkipped;
+    int atlasBytes;
+    int atlasFindHits;
+    int atlasFindMisses;
+    QSMemPtr atlasRetired;                      // The atlas replaced by the current one
+
     QSMemPtr offsets[SHM_ITEMS];                // Hash table
     QSMemPtr freeItems[MAX_SHM_FREE_ITEMS+1];   // List of items marked for deletion
 };
@@ -178,7 +190,7 @@ public:
     ~QSharedMemoryCache() { }
 
     void init() {
-        d->version = 100;
+        d->version = 101;
         d->dataOffset = sizeof(QSharedMemoryCacheData) + 2*sizeof(QSMemNode);
         d->dataSize = QGLOBAL_PIXMAP_CACHE_LIMIT;
         d->offsetsOffset = (int)((char*)&d->offsets[0] - (char*)d);
@@ -194,12 +206,21 @@ public:
         d->cacheInsertHits = 0;
         d->cacheInsertMisses = 0;
         d->cacheInsertStrcmps = 0;
+        d->atlasGeneration = 0;
+        d->atlasEntries = 0;
+        d->atlasSkipped = 0;
+        d->atlasBytes = 0;
+        d->atlasFindHits = 0;
+        d->atlasFindMisses = 0;
+        d->atlasRetired = -1;
         for (int i = 0; i < SHM_ITEMS; i++)
             d->offsets[i] = -1;
         //memset(offsets,-1,SHM_ITEMS*sizeof(QSMemPtr));
     }
 
     QSMCacheItemPtr newItem(const char *key, int size, int type);
+    QSMCacheItemPtr allocItem(const char *key, int size, int type);
+    void insertItem(QSMCacheItemPtr item);
     QSMCacheItemPtr findItem(const char *key, bool ref, int type);
     void freeItem(QSMCacheItem *item) {
 
@@ -230,6 +251,8 @@ public:
 
     bool cleanUp(bool needLock=true);
 
+    QSharedMemoryCacheData *data() const { return d; }
+
 #ifdef DEBUG_SHARED_MEMORY_CACHE
     bool checkCacheConsistency();
 #endif
@@ -288,6 +311,8 @@ bool QSharedMemoryCache::cleanUp_internal()
                     found = true;
                 }
            }
+           if ( (int)d->freeItems[i] == (int)d->atlasRetired )
+               d->atlasRetired = -1;
            item.free();
            memmove(&d->freeItems[i],&d->freeItems[i+1],(d->freeItemCount-i)*sizeof(QSMemPtr));
            d->freeItemCount--;
@@ -797,6 +822,17 @@ bool QSharedMemoryCache::checkCacheConsistency()
 
 
 QSMCacheItemPtr QSharedMemoryCache::newItem(const char *key, int size, int type)
+{
+    QSMCacheItemPtr item = allocItem(key, size, type);
+    if ( (QSMCacheItem*)item )
+        insertItem(item);
+    return item;
+}
+
+
+// Allocates an item without adding it to the hash table, so that it can be
+// filled in before other processes can find it with insertItem()
+QSMCacheItemPtr QSharedMemoryCache::allocItem(const char *key, int size, int type)
 {
     CHECK_CACHE_CONSISTENCY();
 
@@ -826,53 +862,6 @@ QSMCacheItemPtr QSharedMemoryCache::newItem(const char *key, int size, int type)
                 }
                 d->items++;
                 memcpy((char*)item->key, key, strLen+1);
-                QLockHandle lh(qt_getSMManager()->lock(),QLock::Write);
-                int hashIndex, hashInc;
-                hash(key, hashIndex, hashInc);
-                qLog(SharedMemCache) << "hash for"<< key << "is" <<hashIndex;
-                QSMemPtr memPtr2 = d->offsets[hashIndex];
-                qLog(SharedMemCache) << "new: starting item" << hashIndex << "has value"<<(int)memPtr2;
-                int firstReplaceHashIndex = -1;
-                while (memPtr2 && (int)memPtr2 != MAGIC_HASH_DELETED_VAL) {
-#ifdef PROFILE_SHARED_MEMORY_CACHE
-                    if ( firstReplaceHashIndex == -1 )
-                        d->cacheInsertStrcmps++;
-#endif
-                    QSMCacheItemPtr item(memPtr2);
-                    if ( firstReplaceHashIndex == -1 && !qstrcmp(key, item.key()) ) {
-                        // Well actually, can't just remove it because other processess may
-                        // have references to it, they perhaps have active pixmap data connected
-                        // to this shared memory, but it will go away when they release it and
-                        // it's refcount reaches 0. What we can do instead is make sure when
-                        // we look up in the cache we hit this new one first instead of the
-                        // old one, so we insert it earlier, ie swap the positions around in the
-                        // hash table to where we would put it otherwise.
-                        firstReplaceHashIndex = hashIndex;
-
-                        // As we are replacing the old pixmap, deference it as there should
-                        // only be one reference for both pixmaps after an
-                        // QGlobalPixmapCache::insert(), as QGlobalPixmapCache::remove()
-                        // must remove it from the cache.
-                        item.deref();
-                    }
-
-                    hashIndex = (hashIndex + hashInc) % SHM_ITEMS;
-                    memPtr2 = d->offsets[hashIndex];
-                    qLog(SharedMemCache) << "new: next item" << hashIndex << "has value" << (int)memPtr2;
-                }
-                qLog(SharedMemCache) << "new: using item" << hashIndex << "with value" << (int)memPtr2;
-                if ( firstReplaceHashIndex != -1 ) {
-                    d->offsets[hashIndex] = d->offsets[firstReplaceHashIndex];
-                    d->offsets[firstReplaceHashIndex] = memPtr;
-                } else {
-                    d->offsets[hashIndex] = memPtr;
-                }
-
-                CHECK_CACHE_CONSISTENCY();
-#ifdef PROFILE_SHARED_MEMORY_CACHE
-                d->cacheInsertHits++;
-#endif
-                qLog(SharedMemCache) << "allocated" << key << "to index" <<hashIndex;
                 return QSMCacheItemPtr(item);
             }
         }
@@ -888,6 +877,62 @@ QSMCacheItemPtr QSharedMemoryCache::newItem(const char *key, int size, int type)
 }
 
 
+// Adds an item from allocItem() to the hash table, replacing any item with the same key
+void QSharedMemoryCache::insertItem(QSMCacheItemPtr newItem)
+{
+    QSMemPtr memPtr((char*)(QSMCacheItem*)newItem);
+    const char *key = newItem.key();
+
+    QLockHandle lh(qt_getSMManager()->lock(),QLock::Write);
+    int hashIndex, hashInc;
+    hash(key, hashIndex, hashInc);
+    qLog(SharedMemCache) << "hash for"<< key << "is" <<hashIndex;
+    QSMemPtr memPtr2 = d->offsets[hashIndex];
+    qLog(SharedMemCache) << "new: starting item" << hashIndex << "has value"<<(int)memPtr2;
+    int firstReplaceHashIndex = -1;
+    while (memPtr2 && (int)memPtr2 != MAGIC_HASH_DELETED_VAL) {
+#ifdef PROFILE_SHARED_MEMORY_CACHE
+        if ( firstReplaceHashIndex == -1 )
+            d->cacheInsertStrcmps++;
+#endif
+        QSMCacheItemPtr item(memPtr2);
+        if ( firstReplaceHashIndex == -1 && !qstrcmp(key, item.key()) ) {
+            // Well actually, can't just remove it because other processess may
+            // have references to it, they perhaps have active pixmap data connected
+            // to this shared memory, but it will go away when they release it and
+            // it's refcount reaches 0. What we can do instead is make sure when
+            // we look up in the cache we hit this new one first instead of the
+            // old one, so we insert it earlier, ie swap the positions around in the
+            // hash table to where we would put it otherwise.
+            firstReplaceHashIndex = hashIndex;
+
+            // As we are replacing the old pixmap, deference it as there should
+            // only be one reference for both pixmaps after an
+            // QGlobalPixmapCache::insert(), as QGlobalPixmapCache::remove()
+            // must remove it from the cache.
+            item.deref();
+        }
+
+        hashIndex = (hashIndex + hashInc) % SHM_ITEMS;
+        memPtr2 = d->offsets[hashIndex];
+        qLog(SharedMemCache) << "new: next item" << hashIndex << "has value" << (int)memPtr2;
+    }
+    qLog(SharedMemCache) << "new: using item" << hashIndex << "with value" << (int)memPtr2;
+    if ( firstReplaceHashIndex != -1 ) {
+        d->offsets[hashIndex] = d->offsets[firstReplaceHashIndex];
+        d->offsets[firstReplaceHashIndex] = memPtr;
+    } else {
+        d->offsets[hashIndex] = memPtr;
+    }
+
+    CHECK_CACHE_CONSISTENCY();
+#ifdef PROFILE_SHARED_MEMORY_CACHE
+    d->cacheInsertHits++;
+#endif
+    qLog(SharedMemCache) << "allocated" << key << "to index" <<hashIndex;
+}
+
+
 // Optimization: "type" is currently ignored, but could be used to find the hash table to look in
 QSMCacheItemPtr QSharedMemoryCache::findItem(const char *keyStr, bool ref, int /*type*/)
 {
@@ -1075,6 +1120,253 @@ void QSharedMemoryManager::removePixmap(const QString &k)
     }
 }
 
+// ============================================================================
+//
+// Theme atlas
+//
+// ============================================================================
+
+#define THEME_ATLAS_KEY         "_$QTOPIA_THEME_ATLAS"
+
+// Pixmaps found in an atlas keep it in memory after it is replaced, so a
+// new atlas is not published while the one before the current one is still
+// referenced (see canPublishAtlas()).  At most THEME_ATLAS_GENERATIONS
+// atlases are then in use, and together they take at most half of the
+// shared memory, leaving the rest to QGlobalPixmapCache.  No single image
+// may take more than a quarter of an atlas.
+#define THEME_ATLAS_GENERATIONS 2
+#define THEME_ATLAS_LIMIT       (QGLOBAL_PIXMAP_CACHE_LIMIT / 2 / THEME_ATLAS_GENERATIONS)
+#define THEME_ATLAS_MAX_IMAGE   (THEME_ATLAS_LIMIT / 4)
+#define THEME_ATLAS_MAX_WIDTH   1024
+
+/*
+  The theme atlas is a single cache item.  The header is followed by the
+  index, sorted by key hash, then the nul terminated UTF-8 keys and finally
+  the ARGB32 premultiplied pixels.  Offsets are relative to the header.
+*/
+class ThemeAtlasShmItem {
+public:
+    int generation;
+    int entries;
+    int width;
+    int height;
+    int bytesPerLine;
+    int keysOffset;
+    int pixelsOffset;
+};
+
+class ThemeAtlasEntry {
+public:
+    uint    hash;
+    int     key;    // offset into the keys
+    ushort  x;
+    ushort  y;
+    ushort  w;
+    ushort  h;
+};
+
+struct ThemeAtlasPlacement
+{
+    QString key;
+    QImage image;
+    QRect rect;
+};
+
+static bool themeAtlasTallerThan(const ThemeAtlasPlacement &a, const ThemeAtlasPlacement &b)
+{
+    return a.image.height() > b.image.height();
+}
+
+static bool themeAtlasHashLessThan(const ThemeAtlasEntry &a, const ThemeAtlasEntry &b)
+{
+    return a.hash < b.hash;
+}
+
+bool QSharedMemoryManager::findAtlasPixmap(const QString &k, QPixmap &pm) const
+{
+    QSharedMemoryCacheData *stats = cache->data();
+
+    QSMCacheItemPtr cacheItem = cache->findItem(THEME_ATLAS_KEY, true, QSMCacheItem::ThemeAtlas);
+    ThemeAtlasShmItem *atlas = (ThemeAtlasShmItem*)(char*)cacheItem;
+    if ( atlas ) {
+        const ThemeAtlasEntry *index = (const ThemeAtlasEntry*)((char*)atlas + sizeof(ThemeAtlasShmItem));
+        const ThemeAtlasEntry *end = index + atlas->entries;
+        ThemeAtlasEntry probe;
+        probe.hash = qHash(k);
+        QByteArray key = k.toUtf8();
+        const ThemeAtlasEntry *entry = qLowerBound(index, end, probe, themeAtlasHashLessThan);
+        for ( ; entry != end && entry->hash == probe.hash; ++entry ) {
+            if ( qstrcmp(key.constData(), (char*)atlas + atlas->keysOffset + entry->key) )
+                continue;
+            uchar *bits = (uchar*)atlas + atlas->pixelsOffset
+                          + entry->y * atlas->bytesPerLine + entry->x * sizeof(QRgb);
+            QImage newimage(bits, entry->w, entry->h, atlas->bytesPerLine,
+                            QImage::Format_ARGB32_Premultiplied);
+            // the reference taken by findItem() is released with the image
+            localSerialMap.insert(newimage.serialNumber(), (char*)atlas);
+            pm.data_ptr()->fromImage(newimage, 0);
+            stats->atlasFindHits++;
+            qLog(SharedMemCache) << "Found" << k << "in theme atlas" << atlas->generation;
+            return true;
+        }
+        cacheItem.deref();
+    }
+    stats->atlasFindMisses++;
+    return false;
+}
+
+bool QSharedMemoryManager::canPublishAtlas() const
+{
+    QSMCacheItemPtr retired(cache->data()->atlasRetired);
+    return (QSMCacheItem*)retired == 0 || retired.count() == 0;
+}
+
+bool QSharedMemoryManager::insertAtlas(const QMap<QString, QImage> &images)
+{
+    QSharedMemoryCacheData *stats = cache->data();
+
+    if ( !canPublishAtlas() ) {
+        qLog(SharedMemCache) << "Theme atlas" << stats->atlasGeneration - 1 << "is still in use";
+        return false;
+    }
+
+    QList<ThemeAtlasPlacement> placements;
+    int skipped = 0;
+    int widest = 0;
+    int area = 0;
+    QMap<QString, QImage>::const_iterator it;
+    for ( it = images.constBegin(); it != images.constEnd(); ++it ) {
+        const QImage &img = it.value();
+        if ( img.isNull() || img.width() > THEME_ATLAS_MAX_WIDTH
+             || img.width() * img.height() * int(sizeof(QRgb)) > THEME_ATLAS_MAX_IMAGE ) {
+            skipped++;
+            continue;
+        }
+        ThemeAtlasPlacement placement;
+        placement.key = it.key();
+        placement.image = img;
+        placements.append(placement);
+        widest = qMax(widest, img.width());
+        area += img.width() * img.height();
+    }
+
+    // Shelf packing, tallest first.  Images that would take the atlas over
+    // its limit are left out and are rendered by each process as before.
+    int width = qMax(widest, qMin(THEME_ATLAS_MAX_WIDTH, (int(::sqrt(double(area))) + 31) & ~31));
+    int maxHeight = width ? THEME_ATLAS_LIMIT / (width * int(sizeof(QRgb))) : 0;
+    qStableSort(placements.begin(), placements.end(), themeAtlasTallerThan);
+    int x = 0;
+    int y = 0;
+    int shelf = 0;
+    int height = 0;
+    QList<ThemeAtlasPlacement>::iterator pit = placements.begin();
+    while ( pit != placements.end() ) {
+        QSize size = pit->image.size();
+        if ( x + size.width() > width ) {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        if ( y + size.height() > maxHeight ) {
+            skipped++;
+            pit = placements.erase(pit);
+            continue;
+        }
+        pit->rect = QRect(QPoint(x, y), size);
+        x += size.width();
+        shelf = qMax(shelf, size.height());
+        height = qMax(height, y + size.height());
+        ++pit;
+    }
+
+    QVector<ThemeAtlasEntry> index(placements.count());
+    QByteArray keys;
+    for ( int i = 0; i < placements.count(); i++ ) {
+        const ThemeAtlasPlacement &placement = placements.at(i);
+        ThemeAtlasEntry &entry = index[i];
+        entry.hash = qHash(placement.key);
+        entry.key = keys.size();
+        entry.x = placement.rect.x();
+        entry.y = placement.rect.y();
+        entry.w = placement.rect.width();
+        entry.h = placement.rect.height();
+        keys += placement.key.toUtf8();
+        keys += '\0';
+    }
+    qSort(index.begin(), index.end(), themeAtlasHashLessThan);
+
+    int bytesPerLine = width * sizeof(QRgb);
+    int keysOffset = sizeof(ThemeAtlasShmItem) + index.count() * sizeof(ThemeAtlasEntry);
+    int pixelsOffset = (keysOffset + keys.size() + 3) & ~3;
+    int size = pixelsOffset + bytesPerLine * height;
+
+    // The atlas is filled in before it is added to the cache, so other
+    // processes never find it with a partial header, index or keys
+    QSMCacheItemPtr cacheItem = cache->allocItem(THEME_ATLAS_KEY, size, QSMCacheItem::ThemeAtlas);
+    if ( (QSMCacheItem*)cacheItem == 0 ) {
+        while ( cache->cleanUp() );
+        cacheItem = cache->allocItem(THEME_ATLAS_KEY, size, QSMCacheItem::ThemeAtlas);
+    }
+    ThemeAtlasShmItem *atlas = (ThemeAtlasShmItem*)(char*)cacheItem;
+    if ( !atlas ) {
+        qLog(SharedMemCache) << "No room for a" << size << "byte theme atlas";
+        return false;
+    }
+    cacheItem.setCount(1);  // released when the next atlas replaces this one
+
+    atlas->generation = stats->atlasGeneration + 1;
+    atlas->entries = index.count();
+    atlas->width = width;
+    atlas->height = height;
+    atlas->bytesPerLine = bytesPerLine;
+    atlas->keysOffset = keysOffset;
+    atlas->pixelsOffset = pixelsOffset;
+    memcpy((char*)atlas + sizeof(ThemeAtlasShmItem), index.constData(),
+           index.count() * sizeof(ThemeAtlasEntry));
+    memcpy((char*)atlas + keysOffset, keys.constData(), keys.size());
+
+    if ( height ) {
+        QImage pixels((uchar*)atlas + pixelsOffset, width, height, bytesPerLine,
+                      QImage::Format_ARGB32_Premultiplied);
+        pixels.fill(0);
+        QPainter painter(&pixels);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        foreach ( const ThemeAtlasPlacement &placement, placements )
+            painter.drawImage(placement.rect.topLeft(), placement.image);
+    }
+
+    QSMCacheItemPtr current = cache->findItem(THEME_ATLAS_KEY, false, QSMCacheItem::ThemeAtlas);
+    cache->insertItem(cacheItem);
+    stats->atlasRetired = QSMemPtr((char*)(QSMCacheItem*)current);
+    stats->atlasGeneration = atlas->generation;
+    stats->atlasEntries = index.count();
+    stats->atlasSkipped = skipped;
+    stats->atlasBytes = size;
+    dumpStatistics();
+    return true;
+}
+
+int QSharedMemoryManager::atlasGeneration() const
+{
+    return cache->data()->atlasGeneration;
+}
+
+void QSharedMemoryManager::dumpStatistics() const
+{
+    const QSharedMemoryCacheData *d = cache->data();
+    qLog(SharedMemCache) << "items" << d->items << "of" << d->maxItems
+                         << "pending free" << d->freeItemCount;
+#ifdef PROFILE_SHARED_MEMORY_CACHE
+    qLog(SharedMemCache) << "find hits" << d->cacheFindHits << "misses" << d->cacheFindMisses
+                         << "strcmps" << d->cacheFindStrcmps;
+    qLog(SharedMemCache) << "insert hits" << d->cacheInsertHits << "misses" << d->cacheInsertMisses
+                         << "strcmps" << d->cacheInsertStrcmps;
+#endif
+    qLog(SharedMemCache) << "theme atlas" << d->atlasGeneration << "entries" << d->atlasEntries
+                         << "skipped" << d->atlasSkipped << "bytes" << d->atlasBytes
+                         << "hits" << d->atlasFindHits << "misses" << d->atlasFindMisses;
+}
+
 // ============================================================================
 //
 // QGlobalPixmapCache
@@ -1212,4 +1504,68 @@ void QGlobalPixmapCache::remove( const QString &key )
     qt_getSMManager()->removePixmap( key );
 }
 
+// ============================================================================
+//
+// QThemeAtlas
+//
+// ============================================================================
+
+/*!
+    \class QThemeAtlas
+    \internal
+
+    \brief The QThemeAtlas class shares pre-rendered theme images between processes.
+
+    The server packs the colorized and scaled theme images it renders into
+    a single atlas in the shared memory cache with publish().  Any process
+    can then find() an image by key and get a pixmap that refers directly
+    to the atlas, without loading or colorizing the image itself.
+
+    Publishing a new atlas replaces the previous one.  Pixmaps found in the
+    previous atlas remain valid until they are destroyed, and keep it in
+    memory until then.  A further atlas cannot be published until they are
+    released; see canPublish().
+
+    Hits, misses and the size of the atlas are recorded with the shared
+    memory cache statistics and logged to the SharedMemCache category.
+*/
+
+/*!
+    Looks for the image associated with \a key in the theme atlas.  If it
+    is found, \a pixmap is set to refer to it and true is returned;
+    otherwise \a pixmap is left alone and false is returned.
+*/
+bool QThemeAtlas::find(const QString &key, QPixmap &pixmap)
+{
+    return qt_getSMManager()->findAtlasPixmap(key, pixmap);
+}
+
+/*!
+    Packs \a images, keyed by name, into a new theme atlas that replaces the
+    current one.  Images that do not fit are left out.  Returns false if the
+    atlas could not be allocated, or if canPublish() is false.
+*/
+bool QThemeAtlas::publish(const QMap<QString, QImage> &images)
+{
+    return qt_getSMManager()->insertAtlas(images);
+}
+
+/*!
+    Returns true if a new atlas can be published, or false while pixmaps
+    found in the atlas that the current one replaced are still in use.
+*/
+bool QThemeAtlas::canPublish()
+{
+    return qt_getSMManager()->canPublishAtlas();
+}
+
+/*!
+    Returns the number of atlases that have been published since the
+    server started.
+*/
+int QThemeAtlas::generation()
+{
+    return qt_getSMManager()->atlasGeneration();
+}
+
 #endif // QT_NO_QWS_SHARED_MEMORY_CACHE
@@ -33,6 +33,8 @@
 
 #include <QString>
 #include <QHash>
+#include <QMap>
+#include <QImage>
 
 //#define DEBUG_SHARED_MEMORY_CACHE
 
@@ -93,7 +95,8 @@ public:
         Global = 0,
         Pixmap = 1,
         GlyphRowIndex = 2,
-        GlyphRow = 3
+        GlyphRow = 3,
+        ThemeAtlas = 4
     };
     /*
         Would be nice to have virtual destructors for when
@@ -157,6 +160,16 @@ public:
     // removes a pixmap from the shared memory cache
     void removePixmap(const QString &key);
 
+    // finds a theme image in the shared theme atlas
+    bool findAtlasPixmap(const QString &key, QPixmap &pm) const;
+    // packs images into a new shared theme atlas, replacing the current one
+    bool insertAtlas(const QMap<QString, QImage> &images);
+    bool canPublishAtlas() const;
+    int atlasGeneration() const;
+
+    // logs the cache and theme atlas statistics
+    void dumpStatistics() const;
+
     // creates a new item in the cache
     static QSMCacheItemPtr newItem(const char *key, int size, int type = QSMCacheItem::Global);
     // finds an item from the cache
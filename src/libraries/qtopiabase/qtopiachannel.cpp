@@ -234,13 +234,11 @@ bool QtopiaChannel::send(const QString &channel, const QString &msg,
     // Compose the individual fragments and send them.
     QString uuid = QUuid::createUuid().toString();
     for ( int posn = 0; posn < data.size(); posn += MAX_FRAGMENT_SIZE ) {
-        QByteArray fragment;
-        if ( ( posn + MAX_FRAGMENT_SIZE ) <= data.size() ) {
-            fragment = data.mid( posn, MAX_FRAGMENT_SIZE );
-        } else {
-            fragment = data.mid( posn );
-        }
+        // Refer to the fragment in place, it is copied once when serialized.
+        QByteArray fragment = QByteArray::fromRawData
+            ( data.constData() + posn, qMin( MAX_FRAGMENT_SIZE, data.size() - posn ) );
         QByteArray newData;
+        newData.reserve( fragment.size() + 128 );
         {
             QDataStream stream
                 ( &newData, QIODevice::WriteOnly | QIODevice::Append );
@@ -304,7 +302,8 @@ void QtopiaChannel_Private::receive(const QString& msg, const QByteArray &data)
         // First fragment in a new message.
         frag = new Fragment();
         frag->uuid = uuid;
-        frag->data = fragData;
+        frag->data.reserve( size );
+        frag->data += fragData;
         frag->next = m_fragments;
         m_fragments = frag;
         prev = 0;
@@ -178,7 +178,8 @@ void QtopiaIpcAdaptorChannel::receive( const QString& msg, const QByteArray &dat
         // First fragment in a new message.
         frag = new Fragment();
         frag->uuid = uuid;
-        frag->data = fragData;
+        frag->data.reserve( size );
+        frag->data += fragData;
         frag->next = m_fragments;
         m_fragments = frag;
         prev = 0;
@@ -179,6 +179,9 @@ public:
 
     QString objectPath() const;
     static void sync();
+    static void beginTransaction();
+    static void commitTransaction();
+    static void setRateLimit(const QByteArray &pathPrefix, int msecs);
 
 signals:
     void itemRemove(const QByteArray &attribute);
@@ -318,6 +318,46 @@ private slots:
 	QCOMPARE(ess.count(), 0);
     }
 
+    /* Evaluators with the same expression share it, and keep its result until a term changes */
+    void SharedValuespace() {
+	QValueSpace::initValuespaceManager();
+	QValueSpaceObject object("");
+	object.setAttribute("/Test/Expression/Shared", QVariant(3));
+	object.sync();
+	QExpressionEvaluator first("@/Test/Expression/Shared * (2 + 5) + @/Test/Expression/Shared");
+	QExpressionEvaluator second("@/Test/Expression/Shared * (2 + 5) + @/Test/Expression/Shared");
+	QSignalSpy fss(&first, SIGNAL(termsChanged()));
+	QSignalSpy sss(&second, SIGNAL(termsChanged()));
+	QVERIFY(first.isValid());
+	QVERIFY(second.isValid());
+	QVERIFY(first.evaluate());
+	QCOMPARE(first.result().toInt(), 24);
+	QVERIFY(second.evaluate());
+	QCOMPARE(second.result().toInt(), 24);
+	object.setAttribute("/Test/Expression/Shared", QVariant(5));
+	object.sync();
+	QCOMPARE(fss.count(), 1);
+	QCOMPARE(sss.count(), 1);
+	QVERIFY(second.evaluate());
+	QCOMPARE(second.result().toInt(), 40);
+	QVERIFY(first.evaluate());
+	QCOMPARE(first.result().toInt(), 40);
+	second.clear();
+	object.setAttribute("/Test/Expression/Shared", QVariant(1));
+	object.sync();
+	QCOMPARE(fss.count(), 2);
+	QCOMPARE(sss.count(), 1);
+	QVERIFY(first.evaluate());
+	QCOMPARE(first.result().toInt(), 8);
+    }
+
+    /* Folding constants at compile time must not turn run-time errors into compile errors */
+    void ConstantDivideByZero() {
+	QExpressionEvaluator expr("1 + 10.5 / 0.0");
+	QVERIFY(expr.isValid());
+	QVERIFY(!expr.evaluate());
+    }
+
 private:
     void expectResult(const QByteArray& data, const QVariant& expectedresult, const QVariant::Type& expectedresulttype, bool useFixedPoint = false ) {
 	QExpressionEvaluator _testexpr;
@@ -0,0 +1,5 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+get_sourcepath(qtopiabase)
+TARGET=tst_qcompiledtheme
+SOURCES=tst_qcompiledtheme.cpp
@@ -0,0 +1,259 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QTest>
+#include <QXmlStreamReader>
+#include <shared/qtopiaunittest.h>
+#include "qcompiledtheme_p.h"
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <utime.h>
+#include <time.h>
+
+//TESTED_CLASS=QCompiledTheme
+//TESTED_FILES=src/libraries/qtopiabase/qcompiledtheme_p.h
+
+static const char themeXml[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!-- comments are not compiled -->\n"
+    "<page name=\"home\" base=\"themes/finxi\">\n"
+    "    <image name=\"background\" rect=\"0,0,0x0\" src=\"background\"/>\n"
+    "    <text name=\"time\" rect=\"0,0,0x20\" align=\"hcenter\">expr:@/UI/DisplayTime/Time</text>\n"
+    "    <rect rect=\"0,20,0x0\" keypad=\"no\"><text>skipped &amp; nested</text></rect>\n"
+    "    <text name=\"date\" rect=\"0,40,0x20\" align=\"hcenter\"><![CDATA[a < b]]></text>\n"
+    "</page>\n";
+
+/*
+    The tst_QCompiledTheme class provides unit tests for the QCompiledTheme class.
+    Note that QCompiledTheme is not a part of the public Qt Extended API.
+*/
+class tst_QCompiledTheme : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void replay();
+    void readElementText();
+    void stale();
+    void touched();
+    void corrupt();
+
+private:
+    void writeXml(const QByteArray &data);
+    bool compile();
+
+    QString xmlFile;
+};
+
+QTEST_MAIN(tst_QCompiledTheme)
+#include "tst_qcompiledtheme.moc"
+
+void tst_QCompiledTheme::initTestCase()
+{
+    QDir().mkpath(QDir::homePath() + "/autotestTmpData");
+    xmlFile = QDir::homePath() + "/autotestTmpData/tst_qcompiledtheme.xml";
+}
+
+void tst_QCompiledTheme::cleanupTestCase()
+{
+    QFile::remove(xmlFile);
+    QFile::remove(QCompiledTheme::compiledFileName(xmlFile));
+}
+
+void tst_QCompiledTheme::writeXml(const QByteArray &data)
+{
+    QFile file(xmlFile);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(data), (qint64)data.size());
+}
+
+bool tst_QCompiledTheme::compile()
+{
+    QFile xml(xmlFile);
+    QFile out(QCompiledTheme::compiledFileName(xmlFile));
+    out.remove();
+    return xml.open(QIODevice::ReadOnly) && out.open(QIODevice::WriteOnly)
+           && QCompiledTheme::compile(&xml, &out);
+}
+
+/*?
+    Test that reading a compiled theme gives the elements, attributes and
+    character data that QXmlStreamReader gives for the XML.
+*/
+void tst_QCompiledTheme::replay()
+{
+    writeXml(themeXml);
+    QVERIFY(compile());
+    const QCompiledTheme *theme = QCompiledTheme::load(xmlFile);
+    QVERIFY(theme != 0);
+    QVERIFY(QCompiledTheme::load(xmlFile) == theme);
+
+    QByteArray source(themeXml);
+    QXmlStreamReader xml(source);
+    QCompiledThemeReader compiled;
+    compiled.setTheme(theme);
+    while (!xml.atEnd()) {
+        xml.readNext();
+        if (!xml.isStartElement() && !xml.isEndElement() && !xml.isCharacters())
+            continue;
+        compiled.readNext();
+        QCOMPARE(compiled.tokenType(), xml.tokenType());
+        QCOMPARE(compiled.name().toString(), xml.name().toString());
+        QCOMPARE(compiled.text().toString(), xml.text().toString());
+        QXmlStreamAttributes expected = xml.attributes();
+        QXmlStreamAttributes actual = compiled.attributes();
+        QCOMPARE(actual.count(), expected.count());
+        for (int i = 0; i < expected.count(); ++i) {
+            QCOMPARE(actual[i].qualifiedName().toString(), expected[i].qualifiedName().toString());
+            QCOMPARE(actual[i].value().toString(), expected[i].value().toString());
+        }
+    }
+    QVERIFY(!xml.hasError());
+    compiled.readNext();
+    QVERIFY(compiled.atEnd());
+}
+
+/*?
+    Test that readElementText() returns the text of an element and skips
+    nested elements, leaving the reader after the element.
+*/
+void tst_QCompiledTheme::readElementText()
+{
+    writeXml(themeXml);
+    QVERIFY(compile());
+    const QCompiledTheme *theme = QCompiledTheme::load(xmlFile);
+    QVERIFY(theme != 0);
+
+    QCompiledThemeReader reader;
+    reader.setTheme(theme);
+    QStringList texts;
+    while (!reader.atEnd()) {
+        reader.readNext();
+        if (reader.isStartElement() && reader.name() != "page")
+            texts << reader.attributes().value("name").toString() + '=' + reader.readElementText();
+    }
+    QCOMPARE(texts, QStringList() << "background=" << "time=expr:@/UI/DisplayTime/Time" << "=" << "date=a < b");
+}
+
+/*?
+    Test that a compiled theme that no longer matches its XML is not used.
+*/
+void tst_QCompiledTheme::stale()
+{
+    writeXml(themeXml);
+    QVERIFY(compile());
+    QVERIFY(QCompiledTheme::load(xmlFile) != 0);
+
+    QByteArray changed(themeXml);
+    changed.replace("hcenter", "right  ");
+    writeXml(changed);
+    QVERIFY(QCompiledTheme::load(xmlFile) == 0);
+
+    QVERIFY(compile());
+    const QCompiledTheme *theme = QCompiledTheme::load(xmlFile);
+    QVERIFY(theme != 0);
+    QCompiledThemeReader reader;
+    reader.setTheme(theme);
+    while (!reader.atEnd() && !(reader.isStartElement() && reader.name() == "text"))
+        reader.readNext();
+    QCOMPARE(reader.attributes().value("align").toString(), QString("right  "));
+
+    QFile::remove(QCompiledTheme::compiledFileName(xmlFile));
+    QVERIFY(QCompiledTheme::load(xmlFile) == 0);
+}
+
+/*?
+    Test that a compiled theme is still used when its XML has a new
+    modification time but the same content, as when it is copied.
+*/
+void tst_QCompiledTheme::touched()
+{
+    writeXml(themeXml);
+    QVERIFY(compile());
+    const QCompiledTheme *theme = QCompiledTheme::load(xmlFile);
+    QVERIFY(theme != 0);
+
+    struct utimbuf times;
+    times.actime = times.modtime = time(0) + 60;
+    QCOMPARE(utime(QFile::encodeName(xmlFile).constData(), &times), 0);
+    QVERIFY(QCompiledTheme::load(xmlFile) == theme);
+
+    QByteArray changed(themeXml);
+    changed.replace("hcenter", "right  ");
+    writeXml(changed);
+    QCOMPARE(utime(QFile::encodeName(xmlFile).constData(), &times), 0);
+    QVERIFY(QCompiledTheme::load(xmlFile) == 0);
+}
+
+/*?
+    Test that a compiled theme whose strings, nodes or attributes refer
+    outside the file is not used.
+*/
+void tst_QCompiledTheme::corrupt()
+{
+    // Differs from the XML of the cached theme, so every load maps the file again
+    QByteArray changed(themeXml);
+    changed.replace("finxi", "smart");
+    writeXml(changed);
+    QVERIFY(compile());
+
+    QString compiledFile = QCompiledTheme::compiledFileName(xmlFile);
+    QFile file(compiledFile);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray valid = file.readAll();
+    file.close();
+
+    const QCompiledTheme::Header *h = (const QCompiledTheme::Header *)valid.constData();
+    int nodes = sizeof(QCompiledTheme::Header) + h->stringCount * sizeof(QCompiledTheme::String);
+    int attributes = nodes + h->nodeCount * sizeof(QCompiledTheme::Node);
+    int image = nodes + 2 * sizeof(QCompiledTheme::Node);
+    QCOMPARE(h->nodeCount > 2, true);
+    QCOMPARE(((const QCompiledTheme::Node *)(valid.constData() + image))->name == QCompiledTheme::None, false);
+
+    QList<QPair<int, quint32> > patches;
+    patches << qMakePair(int(sizeof(QCompiledTheme::Header) + offsetof(QCompiledTheme::String, offset)), h->poolSize + 1)
+            << qMakePair(int(sizeof(QCompiledTheme::Header) + offsetof(QCompiledTheme::String, length)), h->poolSize + 1)
+            << qMakePair(int(nodes + offsetof(QCompiledTheme::Node, name)), h->stringCount)
+            << qMakePair(int(nodes + offsetof(QCompiledTheme::Node, attributeCount)), h->attributeCount + 1)
+            << qMakePair(int(nodes + offsetof(QCompiledTheme::Node, end)), h->nodeCount + 1)
+            << qMakePair(int(image + offsetof(QCompiledTheme::Node, end)), quint32(2))
+            << qMakePair(int(attributes + offsetof(QCompiledTheme::Attribute, value)), h->stringCount);
+
+    for (int i = 0; i < patches.count(); ++i) {
+        QByteArray data = valid;
+        memcpy(data.data() + patches[i].first, &patches[i].second, sizeof(quint32));
+        QFile::remove(compiledFile);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(data), (qint64)data.size());
+        file.close();
+        QVERIFY(QCompiledTheme::load(xmlFile) == 0);
+    }
+
+    QFile::remove(compiledFile);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(valid), (qint64)valid.size());
+    file.close();
+    QVERIFY(QCompiledTheme::load(xmlFile) != 0);
+}
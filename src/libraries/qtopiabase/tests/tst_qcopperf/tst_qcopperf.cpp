@@ -33,6 +33,7 @@
 //TESTED_FILES=
 
 static int DefaultNumberOfRuns = 10000;
+static int LargePayloadNumberOfRuns = 100;
 
 QCopTestObject::QCopTestObject( QObject *parent )
     : QObject( parent )
@@ -150,6 +151,81 @@ void QCopRoundTripAdaptor::receiveMini()
     }
 }
 
+QCopRoundTripLarge::QCopRoundTripLarge( bool adaptor, int payloadSize, QObject *parent )
+    : QCopTestObject( parent ), _failures( 0 )
+{
+    this->adaptor = adaptor;
+    setNumberOfRuns( LargePayloadNumberOfRuns );
+
+    payload.resize( payloadSize );
+    for ( int i = 0; i < payloadSize; ++i )
+        payload[i] = (char)( i * 7 );
+
+    if ( adaptor ) {
+        QtopiaIpcAdaptor *adap =
+                new QtopiaIpcAdaptor( "QPE/Communications/TestInterface3/Request/modem", this );
+        QtopiaIpcAdaptor::connect
+            ( this, SIGNAL(send(QByteArray)),
+              adap, MESSAGE(requestLarge(QByteArray)) );
+        QtopiaIpcAdaptor::connect
+            ( adap, MESSAGE(requestLarge(QByteArray)),
+              this, SLOT(receive(QByteArray)));
+    } else {
+        QtopiaChannel *channel = new QtopiaChannel
+            ( "QPE/Communications/TestInterface3/Response/modem", this );
+        connect( channel, SIGNAL(received(QString,QByteArray)),
+                 this, SLOT(received(QString,QByteArray)) );
+    }
+}
+
+QCopRoundTripLarge::~QCopRoundTripLarge()
+{
+}
+
+void QCopRoundTripLarge::start()
+{
+    elapse.start();
+    count = numMsgs = numberOfRuns();
+    _failures = 0;
+    sendNext();
+}
+
+void QCopRoundTripLarge::received( const QString& message, const QByteArray& data )
+{
+    if ( message != "requestLarge(QByteArray)" )
+        ++_failures;
+    receive( data );
+}
+
+void QCopRoundTripLarge::receive( const QByteArray& data )
+{
+    if ( data != payload )
+        ++_failures;
+    --count;
+    if ( count > 0 ) {
+        sendNext();
+    } else {
+        int elapsed = elapse.elapsed();
+        qDebug( "%s round-tripped %d %d byte messages in %f seconds (%f MB/s)",
+                adaptor ? "QtopiaIpcAdaptor" : "QtopiaChannel",
+                numMsgs, payload.size(), ((double)elapsed) / 1000.0,
+                elapsed ? ((double)numMsgs * payload.size()) / 1024.0 / 1024.0 /
+                          (((double)elapsed) / 1000.0) : 0.0 );
+        emit done();
+    }
+}
+
+void QCopRoundTripLarge::sendNext()
+{
+    if ( adaptor ) {
+        emit send( payload );
+    } else {
+        QtopiaChannel::send
+            ( "QPE/Communications/TestInterface3/Response/modem",
+              "requestLarge(QByteArray)", payload );
+    }
+}
+
 QCopRoundTripInterfaceClient::QCopRoundTripInterfaceClient
         ( QObject *parent, QAbstractIpcInterface::Mode mode )
     : QAbstractIpcInterface( "/Testing", "QCopRoundTripInterfaceClient",
@@ -271,6 +347,41 @@ void tst_QCopPerf::interface()
     runQCopTest( testObject );
 }
 
+void tst_QCopPerf::largePayloadData()
+{
+    QTest::addColumn<int>("payloadSize");
+
+    QTest::newRow("16K") << 16 * 1024;
+    QTest::newRow("256K") << 256 * 1024;
+    QTest::newRow("1M") << 1024 * 1024;
+}
+
+void tst_QCopPerf::channelLarge_data()
+{
+    largePayloadData();
+}
+
+void tst_QCopPerf::channelLarge()
+{
+    QFETCH( int, payloadSize );
+    QCopRoundTripLarge *testObject = new QCopRoundTripLarge( false, payloadSize, this );
+    runQCopTest( testObject );
+    QCOMPARE( testObject->failures(), 0 );
+}
+
+void tst_QCopPerf::adaptorLarge_data()
+{
+    largePayloadData();
+}
+
+void tst_QCopPerf::adaptorLarge()
+{
+    QFETCH( int, payloadSize );
+    QCopRoundTripLarge *testObject = new QCopRoundTripLarge( true, payloadSize, this );
+    runQCopTest( testObject );
+    QCOMPARE( testObject->failures(), 0 );
+}
+
 void tst_QCopPerf::runQCopTest( QCopTestObject *testObject )
 {
     QSignalSpy spy(testObject,SIGNAL(done()));
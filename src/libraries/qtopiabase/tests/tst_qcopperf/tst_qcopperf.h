@@ -84,6 +84,34 @@ private:
     bool mini;
 };
 
+class QCopRoundTripLarge : public QCopTestObject
+{
+    Q_OBJECT
+public:
+    QCopRoundTripLarge( bool adaptor, int payloadSize, QObject *parent = 0 );
+    ~QCopRoundTripLarge();
+
+    int failures() const { return _failures; }
+
+public slots:
+    void start();
+    void received( const QString& message, const QByteArray& data );
+    void receive( const QByteArray& data );
+
+signals:
+    void send( const QByteArray& data );
+
+private:
+    void sendNext();
+
+    QTime elapse;
+    int count;
+    int numMsgs;
+    int _failures;
+    bool adaptor;
+    QByteArray payload;
+};
+
 class QCopRoundTripInterfaceClient : public QAbstractIpcInterface
 {
     Q_OBJECT
@@ -148,9 +176,14 @@ private slots:
     void adaptor();
     void adaptorMini();
     void interface();
+    void channelLarge_data();
+    void channelLarge();
+    void adaptorLarge_data();
+    void adaptorLarge();
 
 private:
     void runQCopTest( QCopTestObject *testObject );
+    void largePayloadData();
 };
 
 #endif
@@ -24,11 +24,12 @@
 #include <qtopianamespace.h>
 #include <QtopiaApplication>
 #include <QString>
+#include <private/qthemeatlas_p.h>
 
 #include <shared/qtopiaunittest.h>
 
 //TESTED_CLASS=QGlobalPixmapCache
-//TESTED_FILES=src/libraries/qtopiabase/qglobalpixmapcache.h
+//TESTED_FILES=src/libraries/qtopiabase/qglobalpixmapcache.h,src/libraries/qtopiabase/qthemeatlas_p.h
 
 /*
     The tst_QGlobalPixmapCache class provides unit tests for the QGlobalPixmapCache class.
@@ -49,6 +50,8 @@ private slots:
     void insert_remove();
     void insert_remove_data();
 
+    void themeAtlas();
+
 /* These tests are disabled until the bug related to insert_remove_bug is
    fixed - until then, these cause the test to hang. */
 private:
@@ -390,3 +393,65 @@ void tst_QGlobalPixmapCache::notFillCache()
     QVERIFY( didNotFill );
 }
 
+/*?
+    Test function for the shared theme atlas.
+    This function:
+        * Publishes an atlas of differently sized solid images.
+        * Checks that each image can be found by its key, has the
+          right size and the right pixels.
+        * Checks that an unknown key is not found.
+        * Publishes a new atlas and checks that pixmaps found in the
+          previous one are still valid while the new one replaces it.
+        * Checks that no further atlas is published until the pixmaps
+          found in the replaced atlas are released.
+*/
+void tst_QGlobalPixmapCache::themeAtlas()
+{
+    QMap<QString, QImage> images;
+    QList<QColor> colors;
+    colors << Qt::red << Qt::green << Qt::blue << Qt::yellow;
+    for ( int i = 0; i < colors.count(); ++i ) {
+        QImage img(10 + i * 7, 30 - i * 5, QImage::Format_ARGB32_Premultiplied);
+        img.fill(colors.at(i).rgba());
+        images.insert("atlas_" + QString::number(i), img);
+    }
+    int generation = QThemeAtlas::generation();
+    QVERIFY( QThemeAtlas::publish(images) );
+    QCOMPARE( QThemeAtlas::generation(), generation + 1 );
+
+    QPixmap first;
+    for ( int i = 0; i < colors.count(); ++i ) {
+        QString key = "atlas_" + QString::number(i);
+        QPixmap pm;
+        QVERIFY( QThemeAtlas::find(key, pm) );
+        QCOMPARE( pm.size(), images[key].size() );
+        QImage found = pm.toImage();
+        QCOMPARE( found.pixel(0, 0), colors.at(i).rgba() );
+        QCOMPARE( found.pixel(found.width() - 1, found.height() - 1), colors.at(i).rgba() );
+        if ( i == 0 )
+            first = pm;
+    }
+
+    QPixmap missing;
+    QVERIFY( !QThemeAtlas::find("atlas_missing", missing) );
+    QVERIFY( missing.isNull() );
+
+    QMap<QString, QImage> replacement;
+    replacement.insert("atlas_0", images["atlas_1"]);
+    QVERIFY( QThemeAtlas::publish(replacement) );
+    QCOMPARE( first.toImage().pixel(0, 0), colors.at(0).rgba() );
+    QPixmap pm;
+    QVERIFY( QThemeAtlas::find("atlas_0", pm) );
+    QCOMPARE( pm.size(), images["atlas_1"].size() );
+    QVERIFY( !QThemeAtlas::find("atlas_2", pm) );
+
+    QVERIFY( !QThemeAtlas::canPublish() );
+    generation = QThemeAtlas::generation();
+    QVERIFY( !QThemeAtlas::publish(QMap<QString, QImage>()) );
+    QCOMPARE( QThemeAtlas::generation(), generation );
+
+    first = QPixmap();
+    QVERIFY( QThemeAtlas::canPublish() );
+    QVERIFY( QThemeAtlas::publish(QMap<QString, QImage>()) );
+    QCOMPARE( QThemeAtlas::generation(), generation + 1 );
+}
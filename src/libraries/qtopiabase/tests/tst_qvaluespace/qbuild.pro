@@ -0,0 +1,4 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+TARGET=tst_qvaluespace
+SOURCES=tst_qvaluespace.cpp
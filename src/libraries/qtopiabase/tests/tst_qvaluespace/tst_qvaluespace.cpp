@@ -0,0 +1,211 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QObject>
+#include <QTest>
+#include <QtTest/qsignalspy.h>
+#include <QApplication>
+#include <qvaluespace.h>
+
+//TESTED_CLASS=QValueSpaceObject
+//TESTED_FILES=src/libraries/qtopiabase/qvaluespace.h
+
+/*
+    The tst_QValueSpace class provides unit tests for Value Space write
+    transactions and rate limits, as seen by the Value Space server.
+*/
+class tst_QValueSpace : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanup();
+
+    void transaction();
+    void transactionOrder();
+    void nestedTransaction();
+    void rateLimit();
+    void rateLimitSync();
+    void rateLimitRemove();
+    void rateLimitPrefix();
+};
+
+QTEST_MAIN(tst_QValueSpace)
+#include "tst_qvaluespace.moc"
+
+void tst_QValueSpace::initTestCase()
+{
+    QValueSpace::initValuespaceManager();
+}
+
+void tst_QValueSpace::cleanup()
+{
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace", 0);
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace/Fast", 0);
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace/Limited", 0);
+}
+
+/*?
+    Changes made in a transaction only become visible, and are only notified,
+    once the transaction is committed.
+*/
+void tst_QValueSpace::transaction()
+{
+    QValueSpaceObject object("/Test/ValueSpace");
+    QValueSpaceItem item("/Test/ValueSpace");
+    QSignalSpy spy(&item, SIGNAL(contentsChanged()));
+
+    QValueSpaceObject::beginTransaction();
+    object.setAttribute("First", 1);
+    object.setAttribute("Second", 2);
+    QVERIFY(!item.value("First").isValid());
+    QVERIFY(!item.value("Second").isValid());
+
+    QValueSpaceObject::commitTransaction();
+    QCOMPARE(item.value("First").toInt(), 1);
+    QCOMPARE(item.value("Second").toInt(), 2);
+
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 1);
+}
+
+/*?
+    The changes in a transaction are applied in the order they were made.
+*/
+void tst_QValueSpace::transactionOrder()
+{
+    QValueSpaceObject object("/Test/ValueSpace");
+    QValueSpaceItem item("/Test/ValueSpace");
+
+    QValueSpaceObject::beginTransaction();
+    object.setAttribute("Kept", 1);
+    object.removeAttribute("Kept");
+    object.setAttribute("Kept", 2);
+    object.setAttribute("Removed", 1);
+    object.removeAttribute("Removed");
+    QValueSpaceObject::commitTransaction();
+
+    QCOMPARE(item.value("Kept").toInt(), 2);
+    QVERIFY(!item.value("Removed").isValid());
+}
+
+/*?
+    Only the outermost commit applies a nested transaction.
+*/
+void tst_QValueSpace::nestedTransaction()
+{
+    QValueSpaceObject object("/Test/ValueSpace");
+    QValueSpaceItem item("/Test/ValueSpace");
+
+    QValueSpaceObject::beginTransaction();
+    object.setAttribute("Outer", 1);
+    QValueSpaceObject::beginTransaction();
+    object.setAttribute("Inner", 2);
+    QValueSpaceObject::commitTransaction();
+    QVERIFY(!item.value("Outer").isValid());
+    QVERIFY(!item.value("Inner").isValid());
+
+    QValueSpaceObject::commitTransaction();
+    QCOMPARE(item.value("Outer").toInt(), 1);
+    QCOMPARE(item.value("Inner").toInt(), 2);
+}
+
+/*?
+    Writes under a rate limited prefix within the limit interval are held
+    back, the last value winning, and flushed once the interval expires.
+    Writes elsewhere are unaffected.
+*/
+void tst_QValueSpace::rateLimit()
+{
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace/Limited", 200);
+
+    QValueSpaceObject object("/Test/ValueSpace");
+    QValueSpaceItem item("/Test/ValueSpace");
+
+    object.setAttribute("Limited/Value", 1);
+    QCOMPARE(item.value("Limited/Value").toInt(), 1);
+
+    object.setAttribute("Limited/Value", 2);
+    object.setAttribute("Limited/Value", 3);
+    object.setAttribute("Unlimited/Value", 4);
+    QCOMPARE(item.value("Limited/Value").toInt(), 1);
+    QCOMPARE(item.value("Unlimited/Value").toInt(), 4);
+
+    QTest::qWait(400);
+    QCOMPARE(item.value("Limited/Value").toInt(), 3);
+}
+
+/*?
+    sync() flushes held back writes immediately.
+*/
+void tst_QValueSpace::rateLimitSync()
+{
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace", 10000);
+
+    QValueSpaceObject object("/Test/ValueSpace");
+    QValueSpaceItem item("/Test/ValueSpace");
+
+    object.setAttribute("Value", 1);
+    object.setAttribute("Value", 2);
+    QCOMPARE(item.value("Value").toInt(), 1);
+
+    QValueSpaceObject::sync();
+    QCOMPARE(item.value("Value").toInt(), 2);
+}
+
+/*?
+    Removing an attribute discards held back writes to it, so they do not
+    reappear when the rate limit is flushed.
+*/
+void tst_QValueSpace::rateLimitRemove()
+{
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace", 200);
+
+    QValueSpaceObject object("/Test/ValueSpace");
+    QValueSpaceItem item("/Test/ValueSpace");
+
+    object.setAttribute("Value", 1);
+    object.setAttribute("Value", 2);
+    object.removeAttribute("Value");
+    QVERIFY(!item.value("Value").isValid());
+
+    QTest::qWait(400);
+    QVERIFY(!item.value("Value").isValid());
+}
+
+/*?
+    The rate limit of the longest matching prefix applies.
+*/
+void tst_QValueSpace::rateLimitPrefix()
+{
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace", 10000);
+    QValueSpaceObject::setRateLimit("/Test/ValueSpace/Fast", 1);
+
+    QValueSpaceObject object("/Test/ValueSpace");
+    QValueSpaceItem item("/Test/ValueSpace");
+
+    object.setAttribute("Slow", 1);
+    object.setAttribute("Fast", 1);
+    object.setAttribute("Slow", 2);
+    QTest::qWait(50);
+    object.setAttribute("Fast", 2);
+
+    QCOMPARE(item.value("Slow").toInt(), 1);
+    QCOMPARE(item.value("Fast").toInt(), 2);
+}
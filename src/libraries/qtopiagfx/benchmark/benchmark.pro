@@ -11,9 +11,12 @@ VPATH += ../
 SOURCES += routines.cpp gfx.cpp def_blur.cpp def_color.cpp def_blend.cpp \
            def_memory.cpp gfxpainter.cpp gfxparticles.cpp gfximage.cpp \
            def_transform.cpp \
-           gfxtimeline.cpp
+           gfxtimeline.cpp \
+           sse2_blend.cpp sse2_blur.cpp sse2_color.cpp \
+           neon_blend.cpp neon_blur.cpp neon_color.cpp
 HEADERS += routines.h gfx.h def_blur.h def_color.h def_blend.h gfxpainter.h \
-           def_memory.h gfxparticles.h gfximage.h def_transform.h gfxtimeline.h
+           def_memory.h gfxparticles.h gfximage.h def_transform.h gfxtimeline.h \
+           sse2_routines.h neon_routines.h
 
 # Input
 SOURCES += main.cpp
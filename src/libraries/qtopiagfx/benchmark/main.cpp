@@ -27,6 +27,10 @@
 #include <QDebug>
 #include <gfxpainter.h>
 #include <gfx.h>
+#include <def_blend.h>
+#include <def_blur.h>
+#include <def_color.h>
+#include <QVector>
 
 #define BENCHMARK_TIME 3000
 
@@ -35,6 +39,67 @@ QString benchmark;
 bool includeSmall = false;
 QImage::Format srcFormat = QImage::Format_RGB16;
 
+// A 240x320 frame worth of pixels for the kernel benchmarks
+#define KERNEL_WIDTH 240
+#define KERNEL_HEIGHT 320
+QVector<ushort> kernelDest16;
+QVector<ushort> kernelSrc16;
+QVector<uchar> kernelAlpha;
+QVector<uint> kernelSrc32;
+QVector<uint> kernelOut32;
+
+typedef void (*BlendArgb32pRgb16)(ushort *, uint *, uchar, int, ushort *);
+typedef void (*BlendRgba16Rgb16)(ushort *, ushort *, uchar *, uchar, int, ushort *);
+typedef void (*Blur32)(uint *, int, int, int, int);
+typedef void (*Blur16)(ushort *, int, int, int, int);
+typedef void (*ColorRgb16Rgb32)(ushort *, int, uint *);
+typedef void (*ColorRgb32Rgb16)(uint *, int, ushort *);
+
+static void blendArgb32pRgb16Frame(BlendArgb32pRgb16 f)
+{
+    for(int row = 0; row < KERNEL_HEIGHT; ++row) {
+        ushort *dest = kernelDest16.data() + row * KERNEL_WIDTH;
+        f(dest, kernelSrc32.data() + row * KERNEL_WIDTH, 0xFF, KERNEL_WIDTH, dest);
+    }
+}
+
+static void blendArgb32pRgb16OpacityFrame(BlendArgb32pRgb16 f)
+{
+    for(int row = 0; row < KERNEL_HEIGHT; ++row) {
+        ushort *dest = kernelDest16.data() + row * KERNEL_WIDTH;
+        f(dest, kernelSrc32.data() + row * KERNEL_WIDTH, 0x77, KERNEL_WIDTH, dest);
+    }
+}
+
+static void blendRgba16Rgb16Frame(BlendRgba16Rgb16 f)
+{
+    for(int row = 0; row < KERNEL_HEIGHT; ++row) {
+        ushort *dest = kernelDest16.data() + row * KERNEL_WIDTH;
+        f(dest, kernelSrc16.data() + row * KERNEL_WIDTH,
+          kernelAlpha.data() + row * KERNEL_WIDTH, 0xFF, KERNEL_WIDTH, dest);
+    }
+}
+
+static void blur32Frame(Blur32 f)
+{
+    f(kernelSrc32.data(), KERNEL_WIDTH, KERNEL_HEIGHT, KERNEL_WIDTH, 20000);
+}
+
+static void blur16Frame(Blur16 f)
+{
+    f(kernelDest16.data(), KERNEL_WIDTH, KERNEL_HEIGHT, KERNEL_WIDTH, 40000);
+}
+
+static void colorRgb16Rgb32Frame(ColorRgb16Rgb32 f)
+{
+    f(kernelDest16.data(), KERNEL_WIDTH * KERNEL_HEIGHT, kernelOut32.data());
+}
+
+static void colorRgb32Rgb16Frame(ColorRgb32Rgb16 f)
+{
+    f(kernelSrc32.data(), KERNEL_WIDTH * KERNEL_HEIGHT, kernelDest16.data());
+}
+
 class GfxBenchmarks : public QObject
 {
 Q_OBJECT
@@ -52,6 +117,7 @@ public slots:
         if(benchmark.isEmpty() || "transformedBlit" == benchmark) rotateBenchmark();
         if(benchmark.isEmpty() || "fill" == benchmark) fillBenchmark();
         if(benchmark.isEmpty() || "transformedFill" == benchmark) fillTransformedBenchmark();
+        if(benchmark.isEmpty() || "kernels" == benchmark) kernelBenchmark();
     }
 
 private:
@@ -232,6 +298,69 @@ private:
         }
     }
 
+    // Compare each routine selected by Gfx::init() against its def_* reference
+    void kernelBenchmark()
+    {
+        int count = KERNEL_WIDTH * KERNEL_HEIGHT;
+        kernelDest16.resize(count);
+        kernelSrc16.resize(count);
+        kernelAlpha.resize(count);
+        kernelSrc32.resize(count);
+        kernelOut32.resize(count);
+        for(int ii = 0; ii < count; ++ii) {
+            kernelDest16[ii] = qrand();
+            kernelSrc16[ii] = qrand();
+            kernelAlpha[ii] = qrand();
+            uint alpha = qrand() & 0xFF;
+            kernelSrc32[ii] = alpha << 24 | qRgb(alpha, alpha / 2, alpha / 3);
+        }
+
+        kernel("blend_argb32p_rgb16", &def_blend_argb32p_rgb16,
+               q_blendroutines.blend_argb32p_rgb16, &blendArgb32pRgb16Frame);
+        kernel("blend_argb32p_rgb16, 0x77 opacity", &def_blend_argb32p_rgb16,
+               q_blendroutines.blend_argb32p_rgb16, &blendArgb32pRgb16OpacityFrame);
+        kernel("blend_rgba16_rgb16", &def_blend_rgba16_rgb16,
+               q_blendroutines.blend_rgba16_rgb16, &blendRgba16Rgb16Frame);
+        kernel("blur32", &def_blur32, q_blurroutines.blur32, &blur32Frame);
+        kernel("blur16", &def_blur16, q_blurroutines.blur16, &blur16Frame);
+        kernel("color_rgb16_rgb32", &def_color_rgb16_rgb32,
+               q_colorroutines.color_rgb16_rgb32, &colorRgb16Rgb32Frame);
+        kernel("color_rgb32_rgb16", &def_color_rgb32_rgb16,
+               q_colorroutines.color_rgb32_rgb16, &colorRgb32Rgb16Frame);
+    }
+
+    template<typename F>
+    void kernel(const QString &name, F reference, F current, void (*frame)(F))
+    {
+        qreal before = kernelFps(name + " (def)", reference, frame);
+        if(current == reference) {
+            qWarning().nospace() << name << ": no accelerated routine";
+            return;
+        }
+        qreal after = kernelFps(name, current, frame);
+        qWarning().nospace() << name << ": " << after / before << "x";
+    }
+
+    template<typename F>
+    qreal kernelFps(const QString &name, F f, void (*frame)(F))
+    {
+        QTime t;
+        t.start();
+        unsigned int frames = 0;
+        while(true) {
+            ++frames;
+            frame(f);
+
+            if(t.elapsed() >= BENCHMARK_TIME) {
+               int e = t.elapsed();
+               qreal fps = 1000. * (qreal)frames / (qreal)e;
+
+               qWarning().nospace() << name << ": " << fps << " fps, " << (qreal)e / (qreal)frames << " ms/frame";
+               return fps;
+            }
+        }
+    }
+
     void memcpyBenchmark()
     {
         int sizes[] = { 2, 10, 150, 320, 10000, 100000, 1000000 };
@@ -313,6 +442,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->fillRect(QRect(0, 0, size, size), c);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -331,6 +461,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->drawImage(0.3f, 0, img);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -350,6 +481,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->drawImage(1, 0, img);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -368,6 +500,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->fillRectTransformed(m, size, c, false);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -386,6 +519,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->fillRectTransformed(m, size, c, true);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -404,6 +538,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->drawImageTransformed(m, img, false);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -423,6 +558,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->drawImageTransformed(m, img, true);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -441,6 +577,7 @@ private:
         while(true) {
             ++frames;
             gfxPainter->drawImage(0, 0, img);
+            gfxPainter->sync();
 
             if(t.elapsed() >= BENCHMARK_TIME) {
                int e = t.elapsed(); 
@@ -455,13 +592,14 @@ private:
 
 void help(char *name)
 {
-    qWarning() << name << ": [-32] [-16] [-src32] [-src16] [-src32p] [-small] [test]";
+    qWarning() << name << ": [-32] [-16] [-src32] [-src16] [-src32p] [-small] [-vga] [-threads <count>] [test]";
     qWarning() << "     blit";
     qWarning() << "     blur";
     qWarning() << "     memcpy";
     qWarning() << "     transformedBlit";
     qWarning() << "     fill";
     qWarning() << "     transformedFill";
+    qWarning() << "     kernels";
     exit(-1);
 }
 
@@ -472,6 +610,8 @@ int main(int argc, char ** argv)
     Gfx::init();
 
     bool depth32 = false;
+    bool vga = false;
+    int threads = 1;
     for(int ii = 1; ii < argc; ++ii) {
         if(0 == ::strcmp(argv[ii], "-help")) 
             help(argv[0]);
@@ -487,12 +627,18 @@ int main(int argc, char ** argv)
             srcFormat = QImage::Format_ARGB32_Premultiplied;
         else if(0 == ::strcmp(argv[ii], "-small")) 
             includeSmall = true;
+        else if(0 == ::strcmp(argv[ii], "-vga"))
+            vga = true;
+        else if(0 == ::strcmp(argv[ii], "-threads") && ii + 1 < argc)
+            threads = ::atoi(argv[++ii]);
         else
             benchmark = argv[ii];
     }
 
-    QImage img(240, 320, depth32?QImage::Format_RGB32:QImage::Format_RGB16);
+    QImage img(vga?480:240, vga?640:320, depth32?QImage::Format_RGB32:QImage::Format_RGB16);
     gfxPainter = new GfxPainter(img);;
+    gfxPainter->setThreadCount(threads);
+    qWarning() << "Drawing" << img.width() << "x" << img.height() << "with" << gfxPainter->threadCount() << "threads";
 
     GfxBenchmarks benchmarks;
     benchmarks.runBenchmarks();
@@ -32,6 +32,16 @@
 #define PLD(src)
 #endif
 
+// Restricts r to the lines a caller asked for.  Each output line is computed
+// independently, so drawing a band gives the same pixels as drawing it all.
+static inline void clipLines(QRect &r, int firstLine, int lastLine)
+{
+    if(r.top() < firstLine)
+        r.setTop(firstLine);
+    if(r.bottom() > lastLine)
+        r.setBottom(lastLine);
+}
+
 static inline unsigned int byte_mul(unsigned int pixel, unsigned int alpha)
 {
     return ((((pixel & 0xFF00FF) * alpha) >> 8) & 0xFF00FF) |
@@ -368,7 +378,8 @@ TRANSFORM_BIFUNC_OP_IMPL(transform_argb32p_32_bi_op, uint, uint, ,argb32p_rgb32_
 TRANSFORM_BIFUNC_OP_IMPL(transform_argb32p_16_bi_op, uint, ushort, ,argb32p_rgb16_opacity_inplace);
 
 #define TRANSFORM_IMPL_OP(name, func, in_type, out_type) \
-static void name(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op) \
+static void name(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op, \
+                 int firstLine, int lastLine) \
 { \
     QMatrix inv = m.inverted(); \
  \
@@ -408,6 +419,7 @@ static void name(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op)
     QRect outRect(QPoint(topLeft_x, topLeft_y),  \
             QPoint(botRight_x, botRight_y)); \
     outRect &= out.rect(); \
+    clipLines(outRect, firstLine, lastLine); \
  \
     for(int yy_base = outRect.top(); yy_base <= outRect.bottom(); yy_base += 64) { \
         for(int xx_base = outRect.left(); xx_base <= outRect.right(); xx_base += 32) { \
@@ -436,7 +448,8 @@ static void name(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op)
 }
 
 #define TRANSFORM_IMPL(name, func, in_type, out_type) \
-void name(GfxImageRef &out, const QImage &in, const QMatrix &m) \
+void name(GfxImageRef &out, const QImage &in, const QMatrix &m, \
+          int firstLine, int lastLine) \
 { \
     QMatrix inv = m.inverted(); \
  \
@@ -476,6 +489,7 @@ void name(GfxImageRef &out, const QImage &in, const QMatrix &m) \
     QRect outRect(QPoint(topLeft_x, topLeft_y),  \
             QPoint(botRight_x, botRight_y)); \
     outRect &= out.rect(); \
+    clipLines(outRect, firstLine, lastLine); \
  \
     for(int yy_base = outRect.top(); yy_base <= outRect.bottom(); yy_base += 64) { \
         for(int xx_base = outRect.left(); xx_base <= outRect.right(); xx_base += 32) { \
@@ -528,8 +542,8 @@ TRANSFORM_IMPL_OP(def_transform_16_32_bi_op, transform_16_32_bi_op, ushort, uint
 TRANSFORM_IMPL_OP(def_transform_argb32p_16_bi_op, transform_argb32p_16_bi_op, uint, ushort);
 TRANSFORM_IMPL_OP(def_transform_argb32p_32_bi_op, transform_argb32p_32_bi_op, uint, uint);
 
-typedef void (*TransformFunc)(GfxImageRef &out, const QImage &in, const QMatrix &m);
-typedef void (*TransformFuncOpacity)(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar);
+typedef void (*TransformFunc)(GfxImageRef &out, const QImage &in, const QMatrix &m, int, int);
+typedef void (*TransformFuncOpacity)(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar, int, int);
 
 enum ImageType { RGB16 = 0, RGB32 = 1, ARGB32p = 2, None = 3 };
 static const TransformFunc transformFuncs[RGB32 + 1][ARGB32p + 1] = {
@@ -591,7 +605,8 @@ static bool isScale(const QMatrix &m)
 }
 
 #define TRANSFORM_SCALE_IMPL(name, out_type, in_type, blend) \
-void name(GfxImageRef &out, const GfxImageRef &in, const QMatrix &m) \
+void name(GfxImageRef &out, const GfxImageRef &in, const QMatrix &m, \
+          int firstLine, int lastLine) \
 { \
     QRect inrect(0, 0, in.width(), in.height()); \
     inrect = m.mapRect(inrect); \
@@ -616,8 +631,10 @@ void name(GfxImageRef &out, const GfxImageRef &in, const QMatrix &m) \
 \
     inrect &= QRect(0, 0, out.width(), out.height()); \
 \
-    int iny = in_start_y; \
-    for(int yy = 0; yy < inrect.height(); ++yy) { \
+    int yy_start = qMax(0, firstLine - inrect.top()); \
+    int yy_end = qMin(inrect.bottom(), lastLine) - inrect.top() + 1; \
+    int iny = in_start_y + yy_start * heightratio; \
+    for(int yy = yy_start; yy < yy_end; ++yy) { \
         out_type *outbits = ((out_type *)out.bits()) + (yy + inrect.top()) * (out.bytesPerLine() / sizeof(out_type)) + inrect.x(); \
         in_type *inbits = ((in_type *)in.bits()) + (iny >> 16) * (in.bytesPerLine() / sizeof(in_type)); \
         int inx = in_start_x; \
@@ -639,7 +656,8 @@ void name(GfxImageRef &out, const GfxImageRef &in, const QMatrix &m) \
 } \
 
 #define TRANSFORM_SCALE_OP_IMPL(name, out_type, in_type, blend) \
-void name(GfxImageRef &out, const GfxImageRef &in, const QMatrix &m, uchar op) \
+void name(GfxImageRef &out, const GfxImageRef &in, const QMatrix &m, uchar op, \
+          int firstLine, int lastLine) \
 { \
     QRect inrect(0, 0, in.width(), in.height()); \
     inrect = m.mapRect(inrect); \
@@ -664,8 +682,10 @@ void name(GfxImageRef &out, const GfxImageRef &in, const QMatrix &m, uchar op) \
 \
     inrect &= QRect(0, 0, out.width(), out.height()); \
 \
-    int iny = in_start_y; \
-    for(int yy = 0; yy < inrect.height(); ++yy) { \
+    int yy_start = qMax(0, firstLine - inrect.top()); \
+    int yy_end = qMin(inrect.bottom(), lastLine) - inrect.top() + 1; \
+    int iny = in_start_y + yy_start * heightratio; \
+    for(int yy = yy_start; yy < yy_end; ++yy) { \
         out_type *outbits = ((out_type *)out.bits()) + (yy + inrect.top()) * (out.bytesPerLine() / sizeof(out_type)) + inrect.x(); \
         in_type *inbits = ((in_type *)in.bits()) + (iny >> 16) * (in.bytesPerLine() / sizeof(in_type)); \
         int inx = in_start_x; \
@@ -718,7 +738,7 @@ TRANSFORM_SCALE_OP_IMPL(def_transform_scale_rgb32_rgb16_op, ushort, uint, rgb32_
 TRANSFORM_SCALE_OP_IMPL(def_transform_scale_argb32p_rgb16_op, ushort, uint, argb32p_rgb16_opacity_inplace);
 TRANSFORM_SCALE_OP_IMPL(def_transform_scale_argb32p_rgb32_op, uint, uint, argb32p_rgb32_opacity_inplace);
 
-typedef void (*ScaleFunc)(GfxImageRef &, const GfxImageRef &, const QMatrix &);
+typedef void (*ScaleFunc)(GfxImageRef &, const GfxImageRef &, const QMatrix &, int, int);
 ScaleFunc scaleFuncs[RGB32 + 1][ARGB32p + 1] = {
     {
         def_transform_scale_rgb16_rgb16,
@@ -732,7 +752,7 @@ ScaleFunc scaleFuncs[RGB32 + 1][ARGB32p + 1] = {
     }
 };
 
-typedef void (*ScaleOpFunc)(GfxImageRef &, const GfxImageRef &, const QMatrix &, uchar);
+typedef void (*ScaleOpFunc)(GfxImageRef &, const GfxImageRef &, const QMatrix &, uchar, int, int);
 ScaleOpFunc scaleOpFuncs[RGB32 + 1][ARGB32p + 1] = {
     {
         def_transform_scale_rgb16_rgb16_op,
@@ -746,7 +766,8 @@ ScaleOpFunc scaleOpFuncs[RGB32 + 1][ARGB32p + 1] = {
     }
 };
 
-void def_transform(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op)
+void def_transform(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op,
+                   int firstLine, int lastLine)
 {
     ImageType outType = None;
     ImageType inType = None;
@@ -782,18 +803,19 @@ void def_transform(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar o
 
     if(isScale(m)) {
         if(op == 0xFF)
-            scaleFuncs[outType][inType](out, in, m);
+            scaleFuncs[outType][inType](out, in, m, firstLine, lastLine);
         else
-            scaleOpFuncs[outType][inType](out, in, m, op);
+            scaleOpFuncs[outType][inType](out, in, m, op, firstLine, lastLine);
     } else {
         if(op == 0xFF)
-            transformFuncs[outType][inType](out, in, m);
+            transformFuncs[outType][inType](out, in, m, firstLine, lastLine);
         else
-            transformOpFuncs[outType][inType](out, in, m, op);
+            transformOpFuncs[outType][inType](out, in, m, op, firstLine, lastLine);
     }
 }
 
-void def_transform_bilinear(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op)
+void def_transform_bilinear(GfxImageRef &out, const QImage &in, const QMatrix &m, uchar op,
+                            int firstLine, int lastLine)
 {
     ImageType outType = None;
     ImageType inType = None;
@@ -828,14 +850,14 @@ void def_transform_bilinear(GfxImageRef &out, const QImage &in, const QMatrix &m
     }
 
     if(op == 0xFF)
-        transformFuncsBi[outType][inType](out, in, m);
+        transformFuncsBi[outType][inType](out, in, m, firstLine, lastLine);
     else
-        transformOpFuncsBi[outType][inType](out, in, m, op);
+        transformOpFuncsBi[outType][inType](out, in, m, op, firstLine, lastLine);
 }
 
 #define TRANSFORM_FILL_IMPL(name, out_type, out_bit_size, inToOut, blendWithOut) \
 static void name(GfxImageRef &out, const QMatrix &m, const QSize &s, \
-                 unsigned int color) \
+                 unsigned int color, int firstLine, int lastLine) \
 { \
     QMatrix inv = m.inverted(); \
  \
@@ -850,6 +872,7 @@ static void name(GfxImageRef &out, const QMatrix &m, const QSize &s, \
     QRect r(QPoint(0, 0), s);\
     r = m.mapRect(r);\
     r &= out.rect(); \
+    clipLines(r, firstLine, lastLine); \
 \
     xxo_min -= r.top() * xxo_adj;\
     xxo_max -= r.top() * xxo_adj;\
@@ -952,7 +975,7 @@ static inline void name(uchar *_outpixel, int height, int width, \
 
 #define TRANSFORM_FILL_BI_IMPL(name, out_type, bifunc, inToOut, out_bit_size, blendWithOut) \
 static void name(GfxImageRef &out, const QMatrix &m, const QSize &s, \
-                 unsigned int color) \
+                 unsigned int color, int firstLine, int lastLine) \
 { \
     QMatrix inv = m.inverted(); \
  \
@@ -976,6 +999,7 @@ static void name(GfxImageRef &out, const QMatrix &m, const QSize &s, \
     QRect r(QPoint(0, 0), s);\
     r = m.mapRect(r);\
     r &= out.rect(); \
+    clipLines(r, firstLine, lastLine); \
 \
     xxo_min -= r.top() * xxo_adj;\
     xxo_max -= r.top() * xxo_adj;\
@@ -1040,7 +1064,7 @@ static void name(GfxImageRef &out, const QMatrix &m, const QSize &s, \
 TRANSFORM_FILL_IMPL(def_transform_fill_16, ushort, 16, qConvertRgb32To16, q_blendroutines.blend_color_rgb16);
 TRANSFORM_FILL_IMPL(def_transform_fill_32, uint, 32, , q_blendroutines.blend_color_rgb32);
 
-typedef void (*TransformFillFunc)(GfxImageRef &out, const QMatrix &m, const QSize &s, unsigned int color);
+typedef void (*TransformFillFunc)(GfxImageRef &out, const QMatrix &m, const QSize &s, unsigned int color, int, int);
 
 static const TransformFillFunc transformFillFuncs[RGB32 + 1] = {
     def_transform_fill_16,
@@ -1048,7 +1072,8 @@ static const TransformFillFunc transformFillFuncs[RGB32 + 1] = {
 };
 
 void def_transform_fill(GfxImageRef &out, const QMatrix &m,
-                        const QSize &s, unsigned int color, unsigned char op)
+                        const QSize &s, unsigned int color, unsigned char op,
+                        int firstLine, int lastLine)
 {
     ImageType outType = None;
     switch(out.format()) {
@@ -1068,7 +1093,7 @@ void def_transform_fill(GfxImageRef &out, const QMatrix &m,
     }
 
     color = premul(color, op);
-    transformFillFuncs[outType](out, m, s, color);
+    transformFillFuncs[outType](out, m, s, color, firstLine, lastLine);
 }
 
 TRANSFORM_BIFUNC_FILL_IMPL(transform_color_16_bi, ushort, argb32p_rgb16_inplace);
@@ -1082,7 +1107,8 @@ static const TransformFillFunc transformFillBiFuncs[RGB32 + 1] = {
 };
 
 void def_transform_fill_bilinear(GfxImageRef &out, const QMatrix &m,
-                                 const QSize &s, unsigned int color, unsigned char op)
+                                 const QSize &s, unsigned int color, unsigned char op,
+                                 int firstLine, int lastLine)
 {
     ImageType outType = None;
     switch(out.format()) {
@@ -1102,6 +1128,6 @@ void def_transform_fill_bilinear(GfxImageRef &out, const QMatrix &m,
     }
 
     color = premul(color, op);
-    transformFillBiFuncs[outType](out, m, s, color);
+    transformFillBiFuncs[outType](out, m, s, color, firstLine, lastLine);
 }
 
@@ -20,14 +20,22 @@
 #ifndef DEF_TRANSFORM_H
 #define DEF_TRANSFORM_H
 
+#include <limits.h>
+
 class QImage;
 class QMatrix;
 class QSize;
 class GfxImageRef;
-void def_transform(GfxImageRef &out, const QImage &in, const QMatrix &m, unsigned char op);
-void def_transform_bilinear(GfxImageRef &out, const QImage &in, const QMatrix &m, unsigned char op);
 
-void def_transform_fill(GfxImageRef &out, const QMatrix &m, const QSize &, unsigned int color, unsigned char op);
-void def_transform_fill_bilinear(GfxImageRef &out, const QMatrix &m, const QSize &, unsigned int color, unsigned char op);
+// firstLine and lastLine limit drawing to a band of lines in out
+void def_transform(GfxImageRef &out, const QImage &in, const QMatrix &m, unsigned char op,
+                   int firstLine = 0, int lastLine = INT_MAX);
+void def_transform_bilinear(GfxImageRef &out, const QImage &in, const QMatrix &m, unsigned char op,
+                            int firstLine = 0, int lastLine = INT_MAX);
+
+void def_transform_fill(GfxImageRef &out, const QMatrix &m, const QSize &, unsigned int color, unsigned char op,
+                        int firstLine = 0, int lastLine = INT_MAX);
+void def_transform_fill_bilinear(GfxImageRef &out, const QMatrix &m, const QSize &, unsigned int color, unsigned char op,
+                                 int firstLine = 0, int lastLine = INT_MAX);
 
 #endif
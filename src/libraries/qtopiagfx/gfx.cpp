@@ -27,6 +27,7 @@
 
 bool gfx_use_qt = false;
 bool gfx_report_hazards = false;
+int gfx_threads = 1;
 
 static const char *QImage_formatToString(QImage::Format f)
 {
@@ -63,6 +64,11 @@ void Gfx::init(const char *_arch)
         gfx_use_qt = true;
     if(!QString(getenv("GFX_REPORT_HAZARDS")).isEmpty())
         gfx_report_hazards = true;
+    if(QString(getenv("GFX_NO_SIMD")).isEmpty())
+        q_initroutines();
+    QString threads(getenv("GFX_THREADS"));
+    if(!threads.isEmpty())
+        gfx_threads = threads.toInt();
 
     QByteArray arch;
     if(_arch) {
@@ -29,6 +29,9 @@
 #include <QImage>
 #include <QMutex>
 #include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QCoreApplication>
 #include <QEvent>
 #if defined(Q_WS_QWS)
@@ -56,6 +59,7 @@ bool qt_region_is_rect(const QRegion &r)
 
 extern bool gfx_use_qt;
 extern bool gfx_report_hazards;
+extern int gfx_threads;
 
 class MainThreadProxy : public QObject
 {
@@ -133,6 +137,70 @@ void GfxDirectPainter::regionChanged(const QRegion &newRegion)
 
 #endif // Q_WS_QWS
 
+// A drawing operation recorded by a threaded GfxPainter, together with the
+// painter state it was recorded with
+class GfxPainterOperation
+{
+public:
+    enum Type { Clear, Image, Fill, ImageTransformed, FillTransformed };
+
+    GfxPainterOperation(Type t)
+        : type(t), flipped(false), smooth(false), value(0), opacity(0xFF),
+          realOpacity(1.0f), lineOpacityTop(0) {}
+
+    Type type;
+    QPoint point;
+    GfxImageRef ref;
+    QImage image;
+    QMatrix matrix;
+    QRect rect;
+    QSize size;
+    QColor color;
+    bool flipped;
+    bool smooth;
+    ushort value;
+
+    uchar opacity;
+    qreal realOpacity;
+    QRect userClipRect;
+    // Results of the horizontal opacity function, which is only ever called
+    // from the recording thread
+    QVector<uchar> lineOpacity;
+    int lineOpacityTop;
+};
+
+static uchar recordedLineOpacity(int line, void *data)
+{
+    GfxPainterOperation *op = static_cast<GfxPainterOperation *>(data);
+    return op->lineOpacity.at(line - op->lineOpacityTop);
+}
+
+// Replays every recorded operation, clipped to one band of lines
+class GfxPainterBand : public QRunnable
+{
+public:
+    GfxPainterBand(const GfxPainter &p, const QRect &band, QSemaphore *done)
+        : painter(p, band), operations(p.operations), done(done) {}
+
+    virtual void run()
+    {
+        for(int ii = 0; ii < operations.count(); ++ii)
+            painter.replay(*operations.at(ii));
+        if(done)
+            done->release();
+    }
+
+private:
+    GfxPainter painter;
+    QList<GfxPainterOperation *> operations;
+    QSemaphore *done;
+};
+
+Q_GLOBAL_STATIC(QThreadPool, gfxThreadPool);
+
+// Bands smaller than this aren't worth handing to another thread
+#define GFX_MIN_BAND_LINES 16
+
 /*!
   \class GfxPainter
     \inpublicgroup QtBaseModule
@@ -271,9 +339,10 @@ static const SimpleBlendFunc simpleBlendFuncs[RGB32 + 1][ARGB32p + 1] = {
 GfxPainter::GfxPainter()
 : fBuffer(0), buffer(0), _opacity(0xFF), realOpacity(1.0f),
   mainThreadProxy(0), dp(0),  p(0), pImg(0), useQt(false), depth(Depth_16),
-  opacityFunc(0), opacityFuncData(0)
+  opacityFunc(0), opacityFuncData(0), threads(1)
 {
     Gfx::init();
+    setThreadCount(gfx_threads);
     useQt = gfx_use_qt;
     mainThreadProxy = new MainThreadProxy(this);
 #if defined(Q_WS_QWS)
@@ -284,9 +353,10 @@ GfxPainter::GfxPainter()
 GfxPainter::GfxPainter(QImage &img, const QRegion &reg)
 : fBuffer(0), buffer(0), _opacity(0xFF), realOpacity(1.0f),
   mainThreadProxy(0), dp(0),  p(0), pImg(0), useQt(false), depth(Depth_16),
-  opacityFunc(0), opacityFuncData(0)
+  opacityFunc(0), opacityFuncData(0), threads(1)
 {
     Gfx::init();
+    setThreadCount(gfx_threads);
     QImage::Format format = img.format();
 
     if(!gfx_use_qt && (format == QImage::Format_RGB16 || format == QImage::Format_RGB32)) {
@@ -326,9 +396,10 @@ GfxPainter::GfxPainter(QImage &img, const QRegion &reg)
 GfxPainter::GfxPainter(QWidget *wid, QPaintEvent *e)
 : fBuffer(0), buffer(0), _opacity(0xFF), realOpacity(1.0f),
   mainThreadProxy(0), dp(0),  p(0), pImg(0), useQt(false), depth(Depth_16),
-  opacityFunc(0), opacityFuncData(0)
+  opacityFunc(0), opacityFuncData(0), threads(1)
 {
     Gfx::init();
+    setThreadCount(gfx_threads);
 #ifdef Q_WS_QWS
     if(!gfx_use_qt) {
         // XXX all this relies on the memory or shared memory window surface
@@ -378,8 +449,21 @@ GfxPainter::GfxPainter(QWidget *wid, QPaintEvent *e)
         p = new QPainter(wid);
 }
 
+// Shares the target of \a other, but only draws the lines within \a band
+GfxPainter::GfxPainter(const GfxPainter &other, const QRect &band)
+: fRect(other.fRect), fBuffer(0), linestep(other.linestep),
+  width(other.width), height(other.height), step(other.step),
+  buffer(other.buffer), _opacity(0xFF), realOpacity(1.0f),
+  mainThreadProxy(0), dp(0), clipRegion(other.clipRegion),
+  clipRects(other.clipRects), p(0), pImg(0), useQt(false),
+  depth(other.depth), opacityFunc(0), opacityFuncData(0), threads(1),
+  bandRect(band)
+{
+}
+
 GfxPainter::~GfxPainter()
 {
+    sync();
     delete mainThreadProxy; mainThreadProxy = 0;
     if(p)
         delete p;
@@ -392,6 +476,7 @@ void GfxPainter::setRect(const QRect &rect)
     if(fRect == rect)
         return;
 
+    sync();
     fRect = rect;
 
     width = rect.width();
@@ -442,8 +527,22 @@ void GfxPainter::clear()
 
 void GfxPainter::clear(ushort val)
 {
-    ushort *dest = (ushort *)buffer;
-    for(int ii = 0; ii < height; ++ii) {
+    if(deferred()) {
+        GfxPainterOperation *op = new GfxPainterOperation(GfxPainterOperation::Clear);
+        op->value = val;
+        record(op, QRect(0, 0, width, height));
+        return;
+    }
+
+    int first = 0;
+    int last = height - 1;
+    if(!bandRect.isNull()) {
+        first = qMax(first, bandRect.top());
+        last = qMin(last, bandRect.bottom());
+    }
+
+    ushort *dest = (ushort *)buffer + first * step;
+    for(int ii = first; ii <= last; ++ii) {
         q_memoryroutines.memset_16(dest, val, width);
         dest += step;
     }
@@ -516,6 +615,7 @@ void GfxPainter::flipUnclipped(const QRect &rect)
 
 void GfxPainter::flip(const QRect &r)
 {
+    sync();
     if(clipRegion == QRegion(fRect)) {
         QRect fr = fRect.intersected(r);
         if(!fr.isEmpty()) flipUnclipped(fr);
@@ -534,6 +634,114 @@ void GfxPainter::flip()
     flip(QRect(0, 0, width, height));
 }
 
+/*!
+  Sets the number of threads used to draw to \a count.  Values less than one
+  use one thread per processor.  The default is taken from the GFX_THREADS
+  environment variable, or is one if that isn't set.
+
+  With more than one thread, blits, fills and transformed draws are recorded
+  rather than drawn, and are only drawn when sync() is called.  The target is
+  then split into bands of lines which are drawn in parallel, giving exactly
+  the same pixels as drawing on one thread.  Images passed as a GfxImageRef
+  must stay valid until then; QImages are kept by the painter.
+ */
+void GfxPainter::setThreadCount(int count)
+{
+    sync();
+    if(count < 1)
+        count = QThread::idealThreadCount();
+    threads = qMax(1, count);
+    if(gfxThreadPool()->maxThreadCount() < threads - 1)
+        gfxThreadPool()->setMaxThreadCount(threads - 1);
+}
+
+int GfxPainter::threadCount() const
+{
+    return threads;
+}
+
+/*!
+  Draws all the operations recorded since the last sync(), and returns once
+  they are complete.  This is called by flip() and when the painter is
+  destroyed, so it only needs to be called directly when drawing to an image.
+ */
+void GfxPainter::sync()
+{
+    if(operations.isEmpty())
+        return;
+
+    // Split the lines that were drawn to evenly, and give the lines above and
+    // below them to the first and last bands
+    QRect lines = dirtyLines;
+    int bands = qBound(1, lines.height() / GFX_MIN_BAND_LINES, threads);
+
+    QSemaphore done;
+    int top = 0;
+    for(int ii = 0; ii < bands - 1; ++ii) {
+        int bottom = lines.top() + lines.height() * (ii + 1) / bands - 1;
+        gfxThreadPool()->start(new GfxPainterBand(*this, QRect(0, top, width, bottom - top + 1), &done));
+        top = bottom + 1;
+    }
+    GfxPainterBand last(*this, QRect(0, top, width, height - top), 0);
+    last.run();
+    done.acquire(bands - 1);
+
+    qDeleteAll(operations);
+    operations.clear();
+    images.clear();
+    dirtyLines = QRect();
+}
+
+void GfxPainter::record(GfxPainterOperation *op, const QRect &lines)
+{
+    op->opacity = _opacity;
+    op->realOpacity = realOpacity;
+    op->userClipRect = _userClipRect;
+
+    QRect r = lines & QRect(0, 0, width, height);
+    if(opacityFunc && op->type == GfxPainterOperation::Image && !r.isEmpty()) {
+        op->lineOpacityTop = r.top();
+        op->lineOpacity.resize(r.height());
+        for(int ii = 0; ii < r.height(); ++ii)
+            op->lineOpacity[ii] = opacityFunc(r.top() + ii, opacityFuncData);
+    }
+
+    dirtyLines |= r;
+    operations.append(op);
+}
+
+void GfxPainter::replay(const GfxPainterOperation &op)
+{
+    _opacity = op.opacity;
+    realOpacity = op.realOpacity;
+    _userClipRect = op.userClipRect;
+    if(op.lineOpacity.isEmpty()) {
+        opacityFunc = 0;
+        opacityFuncData = 0;
+    } else {
+        opacityFunc = recordedLineOpacity;
+        opacityFuncData = const_cast<GfxPainterOperation *>(&op);
+    }
+
+    switch(op.type) {
+        case GfxPainterOperation::Clear:
+            clear(op.value);
+            break;
+        case GfxPainterOperation::Image:
+            drawImage(op.point.x(), op.point.y(), op.ref, op.flipped);
+            break;
+        case GfxPainterOperation::Fill:
+            fillRect(op.rect, op.color);
+            break;
+        case GfxPainterOperation::ImageTransformed:
+            drawImageTransformed(op.matrix, op.image, op.smooth);
+            break;
+        case GfxPainterOperation::FillTransformed:
+            fillRectTransformed(op.matrix, op.size, op.color, op.smooth);
+            break;
+    }
+}
+
 QImage GfxPainter::string(const QString &str, const QColor &c, const QFont &f)
 {
     QFontMetrics fm(f);
@@ -575,6 +783,9 @@ void GfxPainter::drawImage(qreal x, int y, const QImage &img)
         return;
     }
 
+    // Sub-pixel blits aren't recorded
+    sync();
+
     qreal pos_x = x + 1000.;
     int int_x = int(pos_x);
     qreal float_x = pos_x - int_x;
@@ -708,6 +919,8 @@ void GfxPainter::drawImageFlipped(const QPoint &p, const GfxImageRef &img)
 
 void GfxPainter::drawImageFlipped(int x, int y, const QImage &img)
 {
+    if(deferred())
+        images.append(img);
     drawImage(x, y, GfxImageRef(img), true);
 }
 
@@ -725,6 +938,8 @@ void GfxPainter::setHorizontalOpacityFunction(HorizontalOpacityFunction func,
 
 void GfxPainter::drawImage(int x, int y, const QImage &img)
 {
+    if(deferred())
+        images.append(img);
     drawImage(x, y, img, false);
 }
 
@@ -748,6 +963,22 @@ void GfxPainter::drawImage(int x, int y, const GfxImageRef &img, bool flipped)
     if(_opacity == 0)
         return;
 
+    if(deferred()) {
+        GfxPainterOperation *op = new GfxPainterOperation(GfxPainterOperation::Image);
+        op->point = QPoint(x, y);
+        if(img.bits() >= buffer && img.bits() < buffer + height * step * depth) {
+            // Drawing part of the target onto itself, as a reflection does.
+            // Other bands may draw over those pixels before this is replayed,
+            // so keep a copy of them as they are now.
+            op->image = img.toImage().copy();
+            op->ref = GfxImageRef(op->image);
+        } else {
+            op->ref = img;
+        }
+        op->flipped = flipped;
+        record(op, QRect(op->point, img.size()));
+        return;
+    }
 
     int src_depth = (img.format() == QImage::Format_RGB16)?(2):(4);
     SimpleBlendFunc sbf = 0;
@@ -771,6 +1002,8 @@ void GfxPainter::drawImage(int x, int y, const GfxImageRef &img, bool flipped)
     QRect origImgRect(QPoint(x, y), img.size());
     if(!_userClipRect.isNull())
         origImgRect = origImgRect & _userClipRect;
+    if(!bandRect.isNull())
+        origImgRect &= bandRect;
     if(origImgRect.isEmpty())
         return;
 
@@ -788,8 +1021,9 @@ void GfxPainter::drawImage(int x, int y, const GfxImageRef &img, bool flipped)
         uchar *destBits = buffer;
         destBits += imgRect.y() * step * depth + imgRect.x() * depth;
 
+        // Clipped lines come from the other end of a flipped image
         if(flipped) {
-            srcBits += (height - 1) * srcStep;
+            srcBits += (img.height() - 1 - 2 * baseRect.y()) * srcStep;
             srcStep *= -1;
         }
 
@@ -826,7 +1060,7 @@ void GfxPainter::drawImage(int x, int y, const GfxImageRef &img, bool flipped)
             destBits += imgRect.y() * step * depth + imgRect.x() * depth;
 
             if(flipped) {
-                srcBits += (height - 1) * srcStep;
+                srcBits += (img.height() - 1 - 2 * baseRect.y()) * srcStep;
                 srcStep *= -1;
             }
             if(opacityFunc) {
@@ -918,10 +1152,13 @@ void GfxPainter::fillOpaque(const QRect &r, const QRgb &rgb)
 
 void GfxPainter::drawImage(const QRect &target, const QImage &img)
 {
-    if(useQt)
+    if(useQt) {
         painter()->drawImage(target, img);
-    else
+    } else {
+        if(deferred())
+            images.append(img);
         drawImage(target, GfxImageRef(img));
+    }
 }
 
 void GfxPainter::drawImage(const QRect &target, const GfxImageRef &img)
@@ -959,6 +1196,8 @@ void GfxPainter::drawImage(const QRect &target, const QImage &img,
     if(0 && useQt) {
         painter()->drawImage(target, img, source);
     } else {
+        if(deferred())
+            images.append(img);
         drawImage(target, GfxImageRef(img), source);
     }
 }
@@ -974,9 +1213,19 @@ void GfxPainter::fillRect(const QRect &_r, const QColor &c)
     if(!_opacity)
         return;
 
+    if(deferred()) {
+        GfxPainterOperation *op = new GfxPainterOperation(GfxPainterOperation::Fill);
+        op->rect = _r;
+        op->color = c;
+        record(op, _r);
+        return;
+    }
+
     QRect r = _r;
     if(!_userClipRect.isEmpty())
         r &= _userClipRect;
+    if(!bandRect.isNull())
+        r &= bandRect;
 
     QRgb rgba = c.rgba();
     if(_opacity != 0xFF)
@@ -1058,7 +1307,17 @@ void GfxPainter::drawImage(const QPoint &p, const QImage &i)
     drawImage(p.x(), p.y(), i);
 }
 
-GfxImageRef GfxPainter::imgRef(const QRect &r) const
+/*!
+  Returns a reference to the pixels of \a r in the target.  Any recorded
+  operations are drawn first, so that the pixels are up to date.
+ */
+GfxImageRef GfxPainter::imgRef(const QRect &r)
+{
+    sync();
+    return bufferRef(r);
+}
+
+GfxImageRef GfxPainter::bufferRef(const QRect &r) const
 {
     QRect imgRect = r & QRect(0, 0, width, height);
     if(imgRect.isEmpty())
@@ -1076,8 +1335,14 @@ GfxImageRef GfxPainter::imgRef(const QRect &r) const
 
 }
 
-QImage GfxPainter::img(const QRect &r) const
+/*!
+  Returns an image sharing the pixels of \a r in the target.  Any recorded
+  operations are drawn first, so that the pixels are up to date.
+ */
+QImage GfxPainter::img(const QRect &r)
 {
+    sync();
+
     QRect imgRect = r & QRect(0, 0, width, height);
     if(imgRect.isEmpty())
         return QImage();
@@ -1094,6 +1359,22 @@ QImage GfxPainter::img(const QRect &r) const
 
 }
 
+// Finds the lines of \a r, relative to its top, that lie within \a band.
+// Returns false if there are none.
+static bool bandLines(const QRect &band, const QRect &r, int *firstLine, int *lastLine)
+{
+    if(r.isEmpty())
+        return false;
+
+    *firstLine = 0;
+    *lastLine = r.height() - 1;
+    if(!band.isNull()) {
+        *firstLine = qMax(*firstLine, band.top() - r.top());
+        *lastLine = qMin(*lastLine, band.bottom() - r.top());
+    }
+    return *firstLine <= *lastLine;
+}
+
 void GfxPainter::fillRectTransformed(const QMatrix &m, const QSize &s, const QColor &c, bool smooth)
 {
     if(useQt) {
@@ -1109,10 +1390,21 @@ void GfxPainter::fillRectTransformed(const QMatrix &m, const QSize &s, const QCo
             painter()->setRenderHint(QPainter::Antialiasing, false);
         }
     } else {
+        if(deferred()) {
+            GfxPainterOperation *op = new GfxPainterOperation(GfxPainterOperation::FillTransformed);
+            op->matrix = m;
+            op->size = s;
+            op->color = c;
+            op->smooth = smooth;
+            record(op, m.mapRect(QRect(QPoint(0, 0), s)).adjusted(-1, -1, 1, 1));
+            return;
+        }
+
         QRect cr = clipRegion.boundingRect();
         if(!_userClipRect.isEmpty())
             cr &= _userClipRect;
-        if(cr.isEmpty())
+        int firstLine, lastLine;
+        if(!bandLines(bandRect, cr, &firstLine, &lastLine))
             return;
         QMatrix m2;
         m2.translate(-cr.x(), -cr.y());
@@ -1126,11 +1418,11 @@ void GfxPainter::fillRectTransformed(const QMatrix &m, const QSize &s, const QCo
                     ((((color & 0xFF00) * alpha) >> 8) & 0xFF00);
 
         }
-        GfxImageRef img = imgRef(cr);
+        GfxImageRef img = bufferRef(cr);
         if(smooth)
-            def_transform_fill_bilinear(img, m2, s, color, _opacity);
+            def_transform_fill_bilinear(img, m2, s, color, _opacity, firstLine, lastLine);
         else
-            def_transform_fill(img, m2, s, color, _opacity);
+            def_transform_fill(img, m2, s, color, _opacity, firstLine, lastLine);
     }
 }
 
@@ -1149,20 +1441,30 @@ void GfxPainter::drawImageTransformed(const QMatrix &m, const QImage &img, bool
             painter()->setRenderHint(QPainter::Antialiasing, false);
         }
     } else {
+        if(deferred()) {
+            GfxPainterOperation *op = new GfxPainterOperation(GfxPainterOperation::ImageTransformed);
+            op->matrix = m;
+            op->image = img;
+            op->smooth = smooth;
+            record(op, m.mapRect(img.rect()).adjusted(-1, -1, 1, 1));
+            return;
+        }
+
         QRect cr = clipRegion.boundingRect();
         if(!_userClipRect.isEmpty())
             cr &= _userClipRect;
-        if(cr.isEmpty())
+        int firstLine, lastLine;
+        if(!bandLines(bandRect, cr, &firstLine, &lastLine))
             return;
         QMatrix m2;
         m2.translate(-cr.x(), -cr.y());
         m2 = m * m2;
 
-        GfxImageRef out = imgRef(cr);
+        GfxImageRef out = bufferRef(cr);
         if(smooth)
-            def_transform_bilinear(out, img, m2, _opacity);
+            def_transform_bilinear(out, img, m2, _opacity, firstLine, lastLine);
         else
-            def_transform(out, img, m2, _opacity);
+            def_transform(out, img, m2, _opacity, firstLine, lastLine);
     }
 }
 
@@ -23,6 +23,7 @@
 #include <qglobal.h>
 #include <QRect>
 #include <QPainter>
+#include <QList>
 #include "gfx.h"
 
 class QImage;
@@ -30,6 +31,8 @@ class GfxImageRef;
 class MainThreadProxy;
 class QPaintEvent;
 class GfxDirectPainter;
+class GfxPainterOperation;
+class GfxPainterBand;
 class QTOPIAGFX_EXPORT GfxPainter
 {
 public:
@@ -79,16 +82,22 @@ public:
     void flip();
     void flip(const QRect &);
 
+    void setThreadCount(int);
+    int threadCount() const;
+    void sync();
+
     static QImage string(const QString &, const QColor & = Qt::black, const QFont & = QFont());
 
     uchar *frameBuffer() const { return fBuffer; }
     uchar *backBuffer() const { return buffer; }
-    QImage *img() { return pImg; }
+    QImage *img() { sync(); return pImg; }
     QPainter *painter() { return p; }
-    QImage img(const QRect &) const;
-    GfxImageRef imgRef(const QRect &) const;
+    QImage img(const QRect &);
+    GfxImageRef imgRef(const QRect &);
 
 private:
+    GfxImageRef bufferRef(const QRect &) const;
+    GfxPainter(const GfxPainter &, const QRect &band);
     void drawImage(int x, int y, const GfxImageRef &, bool);
     void fillOpaque(const QRect &, const QRgb &c);
     void flipUnclipped(const QRect &);
@@ -123,6 +132,16 @@ private:
 
     HorizontalOpacityFunction opacityFunc;
     void *opacityFuncData;
+
+    friend class GfxPainterBand;
+    bool deferred() const { return threads > 1 && !useQt && buffer; }
+    void record(GfxPainterOperation *, const QRect &);
+    void replay(const GfxPainterOperation &);
+    int threads;
+    QList<GfxPainterOperation *> operations;
+    QList<QImage> images;
+    QRect dirtyLines;
+    QRect bandRect;
 };
 
 #endif
@@ -0,0 +1,166 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "neon_routines.h"
+
+#ifdef GFX_HAVE_NEON
+
+#if !defined(__ARM_NEON__) && !defined(__ARM_NEON)
+#error "neon_blend.cpp must be compiled with -mfpu=neon"
+#endif
+
+#include "def_blend.h"
+#include <arm_neon.h>
+
+// These produce exactly the same output as the def_blend.cpp routines; eight
+// pixels are blended per iteration and any remainder is handed to those.
+
+// rgb16 pixels held in 32-bit lanes to rgb32, as qConvertRgb16To32() does
+static inline uint32x4_t rgb16_rgb32(uint32x4_t c)
+{
+    return vorrq_u32(vorrq_u32(vshlq_n_u32(vandq_u32(c, vdupq_n_u32(0xF800)), 8),
+                               vshlq_n_u32(vandq_u32(c, vdupq_n_u32(0x07E0)), 5)),
+                     vorrq_u32(vshlq_n_u32(vandq_u32(c, vdupq_n_u32(0x001F)), 3),
+                               vdupq_n_u32(0xFF070307)));
+}
+
+// rgb32 to rgb16 pixels held in 32-bit lanes, as qConvertRgb32To16() does
+static inline uint32x4_t rgb32_rgb16(uint32x4_t c)
+{
+    return vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(c, 3), vdupq_n_u32(0x001F)),
+                               vandq_u32(vshrq_n_u32(c, 5), vdupq_n_u32(0x07E0))),
+                     vandq_u32(vshrq_n_u32(c, 8), vdupq_n_u32(0xF800)));
+}
+
+// premul() with alpha + 1 in each 16-bit lane of a
+static inline uint32x4_t premul(uint32x4_t val, uint16x8_t a)
+{
+    uint16x8_t rb = vshrq_n_u16(vmulq_u16(vreinterpretq_u16_u32(vandq_u32(val, vdupq_n_u32(0x00FF00FF))), a), 8);
+    uint16x8_t ag = vandq_u16(vmulq_u16(vshrq_n_u16(vreinterpretq_u16_u32(val), 8), a), vdupq_n_u16(0xFF00));
+    return vreinterpretq_u32_u16(vorrq_u16(rb, ag));
+}
+
+// argb32p_rgb16() on four rgb16 pixels held in 32-bit lanes
+static inline uint32x4_t argb32p_rgb16(uint32x4_t dest, uint32x4_t src)
+{
+    uint32x4_t d = rgb16_rgb32(dest);
+    uint32x4_t alpha = vshrq_n_u32(src, 24);
+    uint32x4_t inv_alpha = vsubq_u32(vdupq_n_u32(0xFF), alpha);
+    uint16x8_t ia = vreinterpretq_u16_u32(vorrq_u32(inv_alpha, vshlq_n_u32(inv_alpha, 16)));
+
+    // premul_nozero(d, inv_alpha) & 0xFFFFFF, which is d when alpha is 0xFF
+    uint16x8_t rb = vshrq_n_u16(vmulq_u16(vreinterpretq_u16_u32(vandq_u32(d, vdupq_n_u32(0x00FF00FF))), ia), 8);
+    uint32x4_t g = vandq_u32(vreinterpretq_u32_u16(vmulq_u16(vshrq_n_u16(vreinterpretq_u16_u32(d), 8), ia)),
+                             vdupq_n_u32(0xFF00));
+
+    uint32x4_t result = rgb32_rgb16(vaddq_u32(vorrq_u32(vreinterpretq_u32_u16(rb), g), src));
+
+    return vbslq_u32(vceqq_u32(alpha, vdupq_n_u32(0)), dest, result);
+}
+
+void neon_blend_argb32p_rgb16(unsigned short *dest,
+                              unsigned int *src,
+                              unsigned char opacity,
+                              int width,
+                              unsigned short *output)
+{
+    // def_blend_argb32p_rgb16() premultiplies by opacity + 1, which leaves
+    // the source untouched for an opacity of 0xFE as well as 0xFF
+    const bool applyOpacity = opacity < 0xFE;
+    const uint16x8_t a = vdupq_n_u16(opacity + 1);
+
+    while(width >= 8) {
+        uint32x4_t s0 = vld1q_u32(src);
+        uint32x4_t s1 = vld1q_u32(src + 4);
+        if(applyOpacity) {
+            s0 = premul(s0, a);
+            s1 = premul(s1, a);
+        }
+
+        uint32x4_t alpha = vshrq_n_u32(vorrq_u32(s0, s1), 24);
+        uint32x2_t any = vorr_u32(vget_low_u32(alpha), vget_high_u32(alpha));
+        if((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) == 0) {
+            if(dest != output)
+                vst1q_u16(output, vld1q_u16(dest));
+        } else {
+            uint16x8_t d = vld1q_u16(dest);
+            uint32x4_t lo = argb32p_rgb16(vmovl_u16(vget_low_u16(d)), s0);
+            uint32x4_t hi = argb32p_rgb16(vmovl_u16(vget_high_u16(d)), s1);
+            vst1q_u16(output, vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+        }
+
+        dest += 8;
+        src += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_blend_argb32p_rgb16(dest, src, opacity, width, output);
+}
+
+void neon_blend_rgba16_rgb16(unsigned short *dest,
+                             unsigned short *src,
+                             unsigned char *alpha,
+                             unsigned char opacity,
+                             int width,
+                             unsigned short *output)
+{
+    const uint16x8_t o = vdupq_n_u16(opacity + 1);
+    const uint16x8_t sixtyFour = vdupq_n_u16(0x40);
+    const uint16x8_t redBlueMask = vdupq_n_u16(0x1F);
+    const uint16x8_t greenMask = vdupq_n_u16(0x3F);
+
+    while(width >= 8) {
+        uint16x8_t a = vmovl_u8(vld1_u8(alpha));
+        if(opacity != 0xFF)
+            a = vshrq_n_u16(vmulq_u16(a, o), 8);
+
+        uint16x8_t d = vld1q_u16(dest);
+        uint16x8_t s = vld1q_u16(src);
+
+        // rgba16_rgb16() blends each channel with a 6-bit alpha, and none of
+        // the channel sums can carry into its neighbour
+        uint16x8_t a6 = vaddq_u16(vshrq_n_u16(a, 2), vdupq_n_u16(1));
+        uint16x8_t inv_a6 = vsubq_u16(sixtyFour, a6);
+
+        uint16x8_t r = vmlaq_u16(vmulq_u16(vshrq_n_u16(d, 11), inv_a6), vshrq_n_u16(s, 11), a6);
+        uint16x8_t g = vmlaq_u16(vmulq_u16(vandq_u16(vshrq_n_u16(d, 5), greenMask), inv_a6),
+                                 vandq_u16(vshrq_n_u16(s, 5), greenMask), a6);
+        uint16x8_t b = vmlaq_u16(vmulq_u16(vandq_u16(d, redBlueMask), inv_a6),
+                                 vandq_u16(s, redBlueMask), a6);
+
+        uint16x8_t result = vorrq_u16(vorrq_u16(vshlq_n_u16(vshrq_n_u16(r, 6), 11),
+                                                vshlq_n_u16(vshrq_n_u16(g, 6), 5)),
+                                      vshrq_n_u16(b, 6));
+
+        vst1q_u16(output, vbslq_u16(vceqq_u16(a, vdupq_n_u16(0)), d, result));
+
+        dest += 8;
+        src += 8;
+        alpha += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_blend_rgba16_rgb16(dest, src, alpha, opacity, width, output);
+}
+
+#endif
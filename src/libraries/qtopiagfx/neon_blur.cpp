@@ -0,0 +1,186 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "neon_routines.h"
+
+#ifdef GFX_HAVE_NEON
+
+#if !defined(__ARM_NEON__) && !defined(__ARM_NEON)
+#error "neon_blur.cpp must be compiled with -mfpu=neon"
+#endif
+
+#include <qglobal.h>
+#include <arm_neon.h>
+
+// The blur is a recursive filter run forwards and backwards along each row and
+// then each column, so the pixels of a line depend on one another.  Several
+// lines are filtered at once instead, which gives exactly the same result as
+// def_blur.cpp.
+
+// blurinner(): z += (alpha * ((c << 8) - z)) >> 15
+static inline int32x4_t blurstep(int32x4_t z, uint32x4_t c, int32x4_t alpha)
+{
+    int32x4_t delta = vsubq_s32(vreinterpretq_s32_u32(vshlq_n_u32(c, 8)), z);
+    return vaddq_s32(z, vshrq_n_s32(vmulq_s32(delta, alpha), 15));
+}
+
+static inline uint32x4_t unpack32(unsigned int pixel)
+{
+    uint16x8_t c = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(pixel)));
+    return vmovl_u16(vget_low_u16(c));
+}
+
+static inline unsigned int pack32(int32x4_t z)
+{
+    uint16x4_t c = vmovn_u32(vshrq_n_u32(vreinterpretq_u32_s32(z), 8));
+    return vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(c, c))), 0);
+}
+
+// Blurs N lines of 32-bit pixels with the four channels of a pixel in the
+// lanes of one vector; the lines are independent so interleaving them hides
+// the latency of the multiply.  Line n starts at data + n * lineStep and its
+// pixels are pixelStep apart.
+template<int N>
+static void blurlines32(unsigned int *data, int lineStep, int length, int pixelStep, int32x4_t alpha)
+{
+    int32x4_t z[N];
+    for(int n = 0; n < N; ++n)
+        z[n] = vreinterpretq_s32_u32(vshlq_n_u32(unpack32(data[n * lineStep]), 8));
+
+    for(int index = 1; index < length; ++index) {
+        for(int n = 0; n < N; ++n) {
+            unsigned int *p = data + n * lineStep + index * pixelStep;
+            z[n] = blurstep(z[n], unpack32(*p), alpha);
+            *p = pack32(z[n]);
+        }
+    }
+
+    for(int index = length - 2; index >= 0; --index) {
+        for(int n = 0; n < N; ++n) {
+            unsigned int *p = data + n * lineStep + index * pixelStep;
+            z[n] = blurstep(z[n], unpack32(*p), alpha);
+            *p = pack32(z[n]);
+        }
+    }
+}
+
+void neon_blur32(unsigned int *data, int width, int height, int step_width, int alpha)
+{
+    if(width < 1 || height < 1)
+        return;
+
+    int32x4_t a = vdupq_n_s32(alpha);
+
+    int row = 0;
+    for(; row + 4 <= height; row += 4)
+        blurlines32<4>(data + row * step_width, step_width, width, 1, a);
+    for(; row < height; ++row)
+        blurlines32<1>(data + row * step_width, step_width, width, 1, a);
+
+    int col = 0;
+    for(; col + 4 <= width; col += 4)
+        blurlines32<4>(data + col, 1, height, step_width, a);
+    for(; col < width; ++col)
+        blurlines32<1>(data + col, 1, height, step_width, a);
+}
+
+// The 16-bit blur only has three channels, so instead four lines are filtered
+// at once with one line per 32-bit lane.
+struct BlurLines16
+{
+    // Line n of the count being blurred starts at data + n * lineStep, and
+    // the pixels in a line are pixelStep apart.  Lanes past count repeat the
+    // first line but are never written back.
+    BlurLines16(unsigned short *data, int count, int lineStep, int pixelStep)
+        : count(count), pixelStep(pixelStep)
+    {
+        for(int n = 0; n < 4; ++n)
+            lines[n] = data + (n < count ? n : 0) * lineStep;
+    }
+
+    inline uint32x4_t load(int index) const
+    {
+        int offset = index * pixelStep;
+        unsigned int values[4] = { lines[0][offset], lines[1][offset],
+                                   lines[2][offset], lines[3][offset] };
+        return vld1q_u32(values);
+    }
+
+    inline void store(int index, uint32x4_t pixels) const
+    {
+        int offset = index * pixelStep;
+        unsigned int values[4];
+        vst1q_u32(values, pixels);
+        for(int n = 0; n < count; ++n)
+            lines[n][offset] = values[n];
+    }
+
+    unsigned short *lines[4];
+    int count;
+    int pixelStep;
+};
+
+static inline void rgb16_channels(uint32x4_t pixels, uint32x4_t *r, uint32x4_t *g, uint32x4_t *b)
+{
+    *r = vorrq_u32(vshrq_n_u32(pixels, 8), vdupq_n_u32(0x07));
+    *g = vorrq_u32(vshrq_n_u32(vandq_u32(pixels, vdupq_n_u32(0x07E0)), 3), vdupq_n_u32(0x03));
+    *b = vorrq_u32(vshlq_n_u32(vandq_u32(pixels, vdupq_n_u32(0x001F)), 3), vdupq_n_u32(0x07));
+}
+
+static void blurlines16(const BlurLines16 &l, int length, int32x4_t alpha)
+{
+    uint32x4_t r, g, b;
+    rgb16_channels(l.load(0), &r, &g, &b);
+    int32x4_t zr = vreinterpretq_s32_u32(vshlq_n_u32(r, 8));
+    int32x4_t zg = vreinterpretq_s32_u32(vshlq_n_u32(g, 8));
+    int32x4_t zb = vreinterpretq_s32_u32(vshlq_n_u32(b, 8));
+
+    for(int pass = 0; pass < 2; ++pass) {
+        int index = pass ? length - 2 : 1;
+        int end = pass ? -1 : length;
+        int step = pass ? -1 : 1;
+        for(; index != end; index += step) {
+            rgb16_channels(l.load(index), &r, &g, &b);
+            zr = blurstep(zr, r, alpha);
+            zg = blurstep(zg, g, alpha);
+            zb = blurstep(zb, b, alpha);
+
+            uint32x4_t result = vorrq_u32(vandq_u32(vreinterpretq_u32_s32(zr), vdupq_n_u32(0xF800)),
+                                          vandq_u32(vshrq_n_u32(vreinterpretq_u32_s32(zg), 5), vdupq_n_u32(0x07E0)));
+            result = vorrq_u32(result, vshrq_n_u32(vreinterpretq_u32_s32(zb), 11));
+            l.store(index, result);
+        }
+    }
+}
+
+void neon_blur16(unsigned short *data, int width, int height, int step_width, int alpha)
+{
+    if(width < 1 || height < 1)
+        return;
+
+    int32x4_t a = vdupq_n_s32(alpha >> 1);
+
+    for(int row = 0; row < height; row += 4)
+        blurlines16(BlurLines16(data + row * step_width, qMin(4, height - row), step_width, 1), width, a);
+
+    for(int col = 0; col < width; col += 4)
+        blurlines16(BlurLines16(data + col, qMin(4, width - col), 1, step_width), height, a);
+}
+
+#endif
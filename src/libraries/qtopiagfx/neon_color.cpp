@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "neon_routines.h"
+
+#ifdef GFX_HAVE_NEON
+
+#if !defined(__ARM_NEON__) && !defined(__ARM_NEON)
+#error "neon_color.cpp must be compiled with -mfpu=neon"
+#endif
+
+#include "def_color.h"
+#include <arm_neon.h>
+
+void neon_color_rgb16_rgb32(unsigned short *src, int width, unsigned int *output)
+{
+    const uint32x4_t red = vdupq_n_u32(0xF800);
+    const uint32x4_t green = vdupq_n_u32(0x07E0);
+    const uint32x4_t blue = vdupq_n_u32(0x001F);
+    const uint32x4_t fill = vdupq_n_u32(0xFF070307);
+
+    while(width >= 8) {
+        uint16x8_t s = vld1q_u16(src);
+        uint32x4_t c[2] = { vmovl_u16(vget_low_u16(s)), vmovl_u16(vget_high_u16(s)) };
+        for(int ii = 0; ii < 2; ++ii) {
+            uint32x4_t out = vorrq_u32(vorrq_u32(vshlq_n_u32(vandq_u32(c[ii], red), 8),
+                                                 vshlq_n_u32(vandq_u32(c[ii], green), 5)),
+                                       vorrq_u32(vshlq_n_u32(vandq_u32(c[ii], blue), 3), fill));
+            vst1q_u32(output + ii * 4, out);
+        }
+
+        src += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_color_rgb16_rgb32(src, width, output);
+}
+
+void neon_color_rgb32_rgb16(unsigned int *src, int width, unsigned short *output)
+{
+    const uint32x4_t red = vdupq_n_u32(0xF80000);
+    const uint32x4_t green = vdupq_n_u32(0xFC00);
+    const uint32x4_t blue = vdupq_n_u32(0xF8);
+
+    while(width >= 8) {
+        uint16x4_t c[2];
+        for(int ii = 0; ii < 2; ++ii) {
+            uint32x4_t s = vld1q_u32(src + ii * 4);
+            c[ii] = vmovn_u32(vorrq_u32(vorrq_u32(vshrq_n_u32(vandq_u32(s, red), 8),
+                                                  vshrq_n_u32(vandq_u32(s, green), 5)),
+                                        vshrq_n_u32(vandq_u32(s, blue), 3)));
+        }
+        vst1q_u16(output, vcombine_u16(c[0], c[1]));
+
+        src += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_color_rgb32_rgb16(src, width, output);
+}
+
+#endif
@@ -28,6 +28,8 @@ HEADERS=\
     gfximage.h\
     def_transform.h\
     def_blendhelper.h\
+    sse2_routines.h\
+    neon_routines.h\
     gfxtimeline.h\
     gfxmipimage.h\
     gfxeasing.h
@@ -47,3 +49,26 @@ SOURCES=\
     gfxmipimage.cpp\
     gfxeasing.cpp
 
+# The SIMD kernels alone are built for the extended instruction set;
+# q_initroutines() only uses them if the CPU supports it at runtime.
+SSE2 [
+    TYPE=CPP_SOURCES
+    CXXFLAGS=-msse2
+]
+
+NEON [
+    TYPE=CPP_SOURCES
+    CXXFLAGS=-mfpu=neon
+]
+
+equals(arch,i386)|equals(arch,x86_64) {
+    DEFINES+=GFX_HAVE_SSE2
+    SSE2.SOURCES=sse2_blend.cpp sse2_blur.cpp sse2_color.cpp
+}
+
+# configure only enables NEON for ARMv7-A targets with a NEON-capable float ABI
+enable_neon {
+    DEFINES+=GFX_HAVE_NEON
+    NEON.SOURCES=neon_blend.cpp neon_blur.cpp neon_color.cpp
+}
+
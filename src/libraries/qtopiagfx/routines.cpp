@@ -22,6 +22,13 @@
 #include "def_color.h"
 #include "def_blend.h"
 #include "def_memory.h"
+#include "sse2_routines.h"
+#include "neon_routines.h"
+
+#if defined(GFX_HAVE_NEON) && defined(__arm__) && defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 struct BlurRoutines q_blurroutines =
 {
@@ -67,3 +74,76 @@ struct ScaleRoutines q_scaleroutines =
     0,
     0
 };
+
+unsigned int q_cpufeatures(void)
+{
+    static unsigned int features = 0xFFFFFFFF;
+    if(features != 0xFFFFFFFF)
+        return features;
+
+    features = 0;
+#if defined(GFX_HAVE_SSE2)
+#  if defined(__x86_64__)
+    features |= CpuSSE2;
+#  elif defined(__i386__)
+    unsigned int eax = 1;
+    unsigned int edx = 0;
+    // ebx may hold the PIC register, so preserve it around cpuid
+    asm("pushl %%ebx\n\t"
+        "cpuid\n\t"
+        "popl %%ebx"
+        : "+a"(eax), "=d"(edx)
+        :
+        : "ecx");
+    if(edx & (1 << 26))
+        features |= CpuSSE2;
+#  endif
+#elif defined(GFX_HAVE_NEON)
+#  if defined(__aarch64__)
+    features |= CpuNEON;
+#  elif defined(__linux__)
+    // NEON is optional on ARMv7, so ask the kernel through the aux vector
+    int fd = ::open("/proc/self/auxv", O_RDONLY);
+    if(fd != -1) {
+        unsigned long entry[2];
+        while(::read(fd, entry, sizeof(entry)) == sizeof(entry) && entry[0] != 0) {
+            if(entry[0] == 16 /* AT_HWCAP */) {
+                if(entry[1] & (1 << 12) /* HWCAP_NEON */)
+                    features |= CpuNEON;
+                break;
+            }
+        }
+        ::close(fd);
+    }
+#  endif
+#endif
+    return features;
+}
+
+void q_initroutines(void)
+{
+    unsigned int features = q_cpufeatures();
+    (void)features;
+
+#ifdef GFX_HAVE_SSE2
+    if(features & CpuSSE2) {
+        q_blurroutines.blur32 = &sse2_blur32;
+        q_blurroutines.blur16 = &sse2_blur16;
+        q_blendroutines.blend_rgba16_rgb16 = &sse2_blend_rgba16_rgb16;
+        q_blendroutines.blend_argb32p_rgb16 = &sse2_blend_argb32p_rgb16;
+        q_colorroutines.color_rgb16_rgb32 = &sse2_color_rgb16_rgb32;
+        q_colorroutines.color_rgb32_rgb16 = &sse2_color_rgb32_rgb16;
+    }
+#endif
+
+#ifdef GFX_HAVE_NEON
+    if(features & CpuNEON) {
+        q_blurroutines.blur32 = &neon_blur32;
+        q_blurroutines.blur16 = &neon_blur16;
+        q_blendroutines.blend_rgba16_rgb16 = &neon_blend_rgba16_rgb16;
+        q_blendroutines.blend_argb32p_rgb16 = &neon_blend_argb32p_rgb16;
+        q_colorroutines.color_rgb16_rgb32 = &neon_color_rgb16_rgb32;
+        q_colorroutines.color_rgb32_rgb16 = &neon_color_rgb32_rgb16;
+    }
+#endif
+}
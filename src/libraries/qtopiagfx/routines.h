@@ -145,6 +145,19 @@ extern "C" {
 
     extern struct ScaleRoutines q_scaleroutines;
 
+    enum CpuFeatures
+    {
+        CpuSSE2 = 0x01,
+        CpuNEON = 0x02
+    };
+
+    // Features of the running CPU that the built-in kernels can use
+    unsigned int q_cpufeatures(void);
+
+    // Replace the def_* routines with the fastest built-in kernels that
+    // q_cpufeatures() allows.  Plugins loaded afterwards may override these.
+    void q_initroutines(void);
+
     struct PluginRoutines
     {
         struct BlurRoutines *blur;
@@ -0,0 +1,180 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "sse2_routines.h"
+
+#ifdef GFX_HAVE_SSE2
+
+#if !defined(__SSE2__)
+#error "sse2_blend.cpp must be compiled with -msse2"
+#endif
+
+#include "def_blend.h"
+#include <emmintrin.h>
+
+// These produce exactly the same output as the def_blend.cpp routines; eight
+// pixels are blended per iteration and any remainder is handed to those.
+
+// rgb16 pixels held in 32-bit lanes to rgb32, as qConvertRgb16To32() does
+static inline __m128i rgb16_rgb32(__m128i c)
+{
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0xF800)), 8),
+                                     _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x07E0)), 5)),
+                        _mm_or_si128(_mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x001F)), 3),
+                                     _mm_set1_epi32(0xFF070307)));
+}
+
+// rgb32 to rgb16 pixels held in 32-bit lanes, as qConvertRgb32To16() does
+static inline __m128i rgb32_rgb16(__m128i c)
+{
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x001F)),
+                                     _mm_and_si128(_mm_srli_epi32(c, 5), _mm_set1_epi32(0x07E0))),
+                        _mm_and_si128(_mm_srli_epi32(c, 8), _mm_set1_epi32(0xF800)));
+}
+
+// packs two vectors of 16-bit values held in 32-bit lanes, without saturating
+static inline __m128i pack_rgb16(__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    return _mm_packs_epi32(lo, hi);
+}
+
+// premul() with alpha + 1 in each 16-bit lane of a
+static inline __m128i premul(__m128i val, __m128i a)
+{
+    __m128i rb = _mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(val, _mm_set1_epi32(0x00FF00FF)), a), 8);
+    __m128i ag = _mm_and_si128(_mm_mullo_epi16(_mm_srli_epi16(val, 8), a), _mm_set1_epi16((short)0xFF00));
+    return _mm_or_si128(rb, ag);
+}
+
+// argb32p_rgb16() on four rgb16 pixels held in 32-bit lanes
+static inline __m128i argb32p_rgb16(__m128i dest, __m128i src)
+{
+    __m128i d = rgb16_rgb32(dest);
+    __m128i alpha = _mm_srli_epi32(src, 24);
+    __m128i inv_alpha = _mm_sub_epi32(_mm_set1_epi32(0xFF), alpha);
+    inv_alpha = _mm_or_si128(inv_alpha, _mm_slli_epi32(inv_alpha, 16));
+
+    // premul_nozero(d, inv_alpha) & 0xFFFFFF, which is d when alpha is 0xFF
+    __m128i rb = _mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(d, _mm_set1_epi32(0x00FF00FF)), inv_alpha), 8);
+    __m128i g = _mm_and_si128(_mm_mullo_epi16(_mm_srli_epi16(d, 8), inv_alpha), _mm_set1_epi32(0xFF00));
+
+    __m128i result = rgb32_rgb16(_mm_add_epi32(_mm_or_si128(rb, g), src));
+
+    __m128i transparent = _mm_cmpeq_epi32(alpha, _mm_setzero_si128());
+    return _mm_or_si128(_mm_and_si128(transparent, dest), _mm_andnot_si128(transparent, result));
+}
+
+void sse2_blend_argb32p_rgb16(unsigned short *dest,
+                              unsigned int *src,
+                              unsigned char opacity,
+                              int width,
+                              unsigned short *output)
+{
+    // def_blend_argb32p_rgb16() premultiplies by opacity + 1, which leaves
+    // the source untouched for an opacity of 0xFE as well as 0xFF
+    const bool applyOpacity = opacity < 0xFE;
+    const __m128i a = _mm_set1_epi16(opacity + 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+
+    while(width >= 8) {
+        __m128i s0 = _mm_loadu_si128((const __m128i *)src);
+        __m128i s1 = _mm_loadu_si128((const __m128i *)(src + 4));
+        if(applyOpacity) {
+            s0 = premul(s0, a);
+            s1 = premul(s1, a);
+        }
+
+        __m128i alpha = _mm_or_si128(_mm_and_si128(s0, alphaMask), _mm_and_si128(s1, alphaMask));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xFFFF) {
+            if(dest != output)
+                _mm_storeu_si128((__m128i *)output, _mm_loadu_si128((const __m128i *)dest));
+        } else {
+            __m128i d = _mm_loadu_si128((const __m128i *)dest);
+            __m128i lo = argb32p_rgb16(_mm_unpacklo_epi16(d, zero), s0);
+            __m128i hi = argb32p_rgb16(_mm_unpackhi_epi16(d, zero), s1);
+            _mm_storeu_si128((__m128i *)output, pack_rgb16(lo, hi));
+        }
+
+        dest += 8;
+        src += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_blend_argb32p_rgb16(dest, src, opacity, width, output);
+}
+
+void sse2_blend_rgba16_rgb16(unsigned short *dest,
+                             unsigned short *src,
+                             unsigned char *alpha,
+                             unsigned char opacity,
+                             int width,
+                             unsigned short *output)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i o = _mm_set1_epi16(opacity + 1);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i sixtyFour = _mm_set1_epi16(0x40);
+    const __m128i redBlueMask = _mm_set1_epi16(0x1F);
+    const __m128i greenMask = _mm_set1_epi16(0x3F);
+
+    while(width >= 8) {
+        __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)alpha), zero);
+        if(opacity != 0xFF)
+            a = _mm_srli_epi16(_mm_mullo_epi16(a, o), 8);
+
+        __m128i d = _mm_loadu_si128((const __m128i *)dest);
+        __m128i s = _mm_loadu_si128((const __m128i *)src);
+
+        // rgba16_rgb16() blends each channel with a 6-bit alpha, and none of
+        // the channel sums can carry into its neighbour
+        __m128i a6 = _mm_add_epi16(_mm_srli_epi16(a, 2), one);
+        __m128i inv_a6 = _mm_sub_epi16(sixtyFour, a6);
+
+        __m128i r = _mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(d, 11), inv_a6),
+                                  _mm_mullo_epi16(_mm_srli_epi16(s, 11), a6));
+        __m128i g = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(d, 5), greenMask), inv_a6),
+                                  _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(s, 5), greenMask), a6));
+        __m128i b = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(d, redBlueMask), inv_a6),
+                                  _mm_mullo_epi16(_mm_and_si128(s, redBlueMask), a6));
+
+        __m128i result = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r, 6), 11),
+                                                   _mm_slli_epi16(_mm_srli_epi16(g, 6), 5)),
+                                      _mm_srli_epi16(b, 6));
+
+        __m128i transparent = _mm_cmpeq_epi16(a, zero);
+        result = _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, result));
+        _mm_storeu_si128((__m128i *)output, result);
+
+        dest += 8;
+        src += 8;
+        alpha += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_blend_rgba16_rgb16(dest, src, alpha, opacity, width, output);
+}
+
+#endif
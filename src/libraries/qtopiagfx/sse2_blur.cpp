@@ -0,0 +1,195 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "sse2_routines.h"
+
+#ifdef GFX_HAVE_SSE2
+
+#if !defined(__SSE2__)
+#error "sse2_blur.cpp must be compiled with -msse2"
+#endif
+
+#include <qglobal.h>
+#include <emmintrin.h>
+
+// The blur is a recursive filter run forwards and backwards along each row and
+// then each column, so the pixels of a line depend on one another.  Several
+// lines are filtered at once instead, which gives exactly the same result as
+// def_blur.cpp.
+
+// low 32 bits of each product; the filter's products always fit in 32 bits
+static inline __m128i mullo_epi32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// blurinner(): z += (alpha * ((c << 8) - z)) >> 15
+static inline __m128i blurstep(__m128i z, __m128i c, __m128i alpha)
+{
+    __m128i delta = _mm_sub_epi32(_mm_slli_epi32(c, 8), z);
+    return _mm_add_epi32(z, _mm_srai_epi32(mullo_epi32(delta, alpha), 15));
+}
+
+static inline __m128i unpack32(unsigned int pixel)
+{
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero);
+}
+
+static inline unsigned int pack32(__m128i z)
+{
+    __m128i c = _mm_srli_epi32(z, 8);
+    c = _mm_packs_epi32(c, c);
+    return _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+}
+
+// Blurs N lines of 32-bit pixels with the four channels of a pixel in the
+// lanes of one vector; the lines are independent so interleaving them hides
+// the latency of the multiply.  Line n starts at data + n * lineStep and its
+// pixels are pixelStep apart.
+template<int N>
+static void blurlines32(unsigned int *data, int lineStep, int length, int pixelStep, __m128i alpha)
+{
+    __m128i z[N];
+    for(int n = 0; n < N; ++n)
+        z[n] = _mm_slli_epi32(unpack32(data[n * lineStep]), 8);
+
+    for(int index = 1; index < length; ++index) {
+        for(int n = 0; n < N; ++n) {
+            unsigned int *p = data + n * lineStep + index * pixelStep;
+            z[n] = blurstep(z[n], unpack32(*p), alpha);
+            *p = pack32(z[n]);
+        }
+    }
+
+    for(int index = length - 2; index >= 0; --index) {
+        for(int n = 0; n < N; ++n) {
+            unsigned int *p = data + n * lineStep + index * pixelStep;
+            z[n] = blurstep(z[n], unpack32(*p), alpha);
+            *p = pack32(z[n]);
+        }
+    }
+}
+
+void sse2_blur32(unsigned int *data, int width, int height, int step_width, int alpha)
+{
+    if(width < 1 || height < 1)
+        return;
+
+    __m128i a = _mm_set1_epi32(alpha);
+
+    int row = 0;
+    for(; row + 4 <= height; row += 4)
+        blurlines32<4>(data + row * step_width, step_width, width, 1, a);
+    for(; row < height; ++row)
+        blurlines32<1>(data + row * step_width, step_width, width, 1, a);
+
+    int col = 0;
+    for(; col + 4 <= width; col += 4)
+        blurlines32<4>(data + col, 1, height, step_width, a);
+    for(; col < width; ++col)
+        blurlines32<1>(data + col, 1, height, step_width, a);
+}
+
+// The 16-bit blur only has three channels, so instead four lines are filtered
+// at once with one line per 32-bit lane.
+struct BlurLines16
+{
+    // Line n of the count being blurred starts at data + n * lineStep, and
+    // the pixels in a line are pixelStep apart.  Lanes past count repeat the
+    // first line but are never written back.
+    BlurLines16(unsigned short *data, int count, int lineStep, int pixelStep)
+        : count(count), pixelStep(pixelStep)
+    {
+        for(int n = 0; n < 4; ++n)
+            lines[n] = data + (n < count ? n : 0) * lineStep;
+    }
+
+    inline __m128i load(int index) const
+    {
+        int offset = index * pixelStep;
+        return _mm_set_epi32(lines[3][offset], lines[2][offset],
+                             lines[1][offset], lines[0][offset]);
+    }
+
+    inline void store(int index, __m128i pixels) const
+    {
+        int offset = index * pixelStep;
+        unsigned int values[4];
+        _mm_storeu_si128((__m128i *)values, pixels);
+        for(int n = 0; n < count; ++n)
+            lines[n][offset] = values[n];
+    }
+
+    unsigned short *lines[4];
+    int count;
+    int pixelStep;
+};
+
+static inline void rgb16_channels(__m128i pixels, __m128i *r, __m128i *g, __m128i *b)
+{
+    *r = _mm_or_si128(_mm_srli_epi32(pixels, 8), _mm_set1_epi32(0x07));
+    *g = _mm_or_si128(_mm_srli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0x07E0)), 3), _mm_set1_epi32(0x03));
+    *b = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0x001F)), 3), _mm_set1_epi32(0x07));
+}
+
+static void blurlines16(const BlurLines16 &l, int length, __m128i alpha)
+{
+    __m128i r, g, b;
+    rgb16_channels(l.load(0), &r, &g, &b);
+    __m128i zr = _mm_slli_epi32(r, 8);
+    __m128i zg = _mm_slli_epi32(g, 8);
+    __m128i zb = _mm_slli_epi32(b, 8);
+
+    for(int pass = 0; pass < 2; ++pass) {
+        int index = pass ? length - 2 : 1;
+        int end = pass ? -1 : length;
+        int step = pass ? -1 : 1;
+        for(; index != end; index += step) {
+            rgb16_channels(l.load(index), &r, &g, &b);
+            zr = blurstep(zr, r, alpha);
+            zg = blurstep(zg, g, alpha);
+            zb = blurstep(zb, b, alpha);
+
+            __m128i result = _mm_or_si128(_mm_and_si128(zr, _mm_set1_epi32(0xF800)),
+                                          _mm_and_si128(_mm_srli_epi32(zg, 5), _mm_set1_epi32(0x07E0)));
+            result = _mm_or_si128(result, _mm_srli_epi32(zb, 11));
+            l.store(index, result);
+        }
+    }
+}
+
+void sse2_blur16(unsigned short *data, int width, int height, int step_width, int alpha)
+{
+    if(width < 1 || height < 1)
+        return;
+
+    __m128i a = _mm_set1_epi32(alpha >> 1);
+
+    for(int row = 0; row < height; row += 4)
+        blurlines16(BlurLines16(data + row * step_width, qMin(4, height - row), step_width, 1), width, a);
+
+    for(int col = 0; col < width; col += 4)
+        blurlines16(BlurLines16(data + col, qMin(4, width - col), 1, step_width), height, a);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "sse2_routines.h"
+
+#ifdef GFX_HAVE_SSE2
+
+#if !defined(__SSE2__)
+#error "sse2_color.cpp must be compiled with -msse2"
+#endif
+
+#include "def_color.h"
+#include <emmintrin.h>
+
+void sse2_color_rgb16_rgb32(unsigned short *src, int width, unsigned int *output)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i red = _mm_set1_epi32(0xF800);
+    const __m128i green = _mm_set1_epi32(0x07E0);
+    const __m128i blue = _mm_set1_epi32(0x001F);
+    const __m128i fill = _mm_set1_epi32(0xFF070307);
+
+    while(width >= 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)src);
+        __m128i c[2] = { _mm_unpacklo_epi16(s, zero), _mm_unpackhi_epi16(s, zero) };
+        for(int ii = 0; ii < 2; ++ii) {
+            __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(c[ii], red), 8),
+                                                    _mm_slli_epi32(_mm_and_si128(c[ii], green), 5)),
+                                       _mm_or_si128(_mm_slli_epi32(_mm_and_si128(c[ii], blue), 3), fill));
+            _mm_storeu_si128((__m128i *)(output + ii * 4), out);
+        }
+
+        src += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_color_rgb16_rgb32(src, width, output);
+}
+
+void sse2_color_rgb32_rgb16(unsigned int *src, int width, unsigned short *output)
+{
+    const __m128i red = _mm_set1_epi32(0xF80000);
+    const __m128i green = _mm_set1_epi32(0xFC00);
+    const __m128i blue = _mm_set1_epi32(0xF8);
+
+    while(width >= 8) {
+        __m128i c[2];
+        for(int ii = 0; ii < 2; ++ii) {
+            __m128i s = _mm_loadu_si128((const __m128i *)(src + ii * 4));
+            c[ii] = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(_mm_and_si128(s, red), 8),
+                                              _mm_srli_epi32(_mm_and_si128(s, green), 5)),
+                                 _mm_srli_epi32(_mm_and_si128(s, blue), 3));
+            // sign extend so that packing does not saturate
+            c[ii] = _mm_srai_epi32(_mm_slli_epi32(c[ii], 16), 16);
+        }
+        _mm_storeu_si128((__m128i *)output, _mm_packs_epi32(c[0], c[1]));
+
+        src += 8;
+        output += 8;
+        width -= 8;
+    }
+
+    if(width)
+        def_color_rgb32_rgb16(src, width, output);
+}
+
+#endif
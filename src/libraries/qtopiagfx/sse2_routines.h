@@ -0,0 +1,52 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef SSE2_ROUTINES_H
+#define SSE2_ROUTINES_H
+
+// The build defines GFX_HAVE_SSE2 on x86, where only sse2_*.cpp are compiled with
+// -msse2; q_initroutines() checks that the CPU has SSE2 before using them.
+#if !defined(GFX_HAVE_SSE2) && defined(__SSE2__)
+#define GFX_HAVE_SSE2
+#endif
+
+#ifdef GFX_HAVE_SSE2
+
+void sse2_blend_rgba16_rgb16(unsigned short *dest,
+                             unsigned short *src,
+                             unsigned char *alpha,
+                             unsigned char opacity,
+                             int width,
+                             unsigned short *output);
+
+void sse2_blend_argb32p_rgb16(unsigned short *dest,
+                              unsigned int *src,
+                              unsigned char opacity,
+                              int width,
+                              unsigned short *output);
+
+void sse2_blur32(unsigned int *data, int width, int height, int step_width, int alpha);
+void sse2_blur16(unsigned short *data, int width, int height, int step_width, int alpha);
+
+void sse2_color_rgb16_rgb32(unsigned short *src, int width, unsigned int *output);
+void sse2_color_rgb32_rgb16(unsigned int *src, int width, unsigned short *output);
+
+#endif
+
+#endif
@@ -0,0 +1,8 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+TARGET=tst_gfxpainter
+
+QTOPIA*=gfx
+
+SOURCES=\
+    tst_gfxpainter.cpp
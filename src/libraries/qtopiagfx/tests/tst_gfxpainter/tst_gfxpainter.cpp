@@ -0,0 +1,253 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QObject>
+#include <QTest>
+#include <QApplication>
+#include <QImage>
+#include <QMatrix>
+#include <shared/qtopiaunittest.h>
+
+#include <gfx.h>
+#include <gfxpainter.h>
+#include <gfximage.h>
+
+//TESTED_CLASS=GfxPainter
+//TESTED_FILES=src/libraries/qtopiagfx/gfxpainter.cpp
+
+/*
+    The unit test for GfxPainter's threaded drawing, which must produce exactly
+    the same image as drawing on one thread.
+*/
+class tst_GfxPainter : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void threaded_data();
+    void threaded();
+    void sync();
+    void reflection_data();
+    void reflection();
+
+private:
+    static QImage source(QImage::Format, int width, int height);
+    static void draw(GfxPainter &, const QImage &, const QImage &);
+    static void reflect(GfxPainter &, const QImage &);
+    static uchar fade(int line, void *);
+};
+
+QTEST_APP_MAIN(tst_GfxPainter, QApplication)
+#include "tst_gfxpainter.moc"
+
+void tst_GfxPainter::initTestCase()
+{
+    qsrand(1);
+}
+
+QImage tst_GfxPainter::source(QImage::Format format, int width, int height)
+{
+    QImage img(width, height, QImage::Format_ARGB32_Premultiplied);
+    for(int yy = 0; yy < height; ++yy) {
+        for(int xx = 0; xx < width; ++xx) {
+            int alpha = (xx * 7 + yy * 3) & 0xFF;
+            img.setPixel(xx, yy, qRgba(alpha * (qrand() & 0xFF) / 255, alpha / 2,
+                                       alpha * xx / width, alpha));
+        }
+    }
+    return img.convertToFormat(format);
+}
+
+uchar tst_GfxPainter::fade(int line, void *)
+{
+    return (line * 5) & 0xFF;
+}
+
+// Covers every operation that is recorded when drawing with threads
+void tst_GfxPainter::draw(GfxPainter &p, const QImage &img, const QImage &opaque)
+{
+    p.clear(0x1234);
+    p.fillRect(QRect(5, 10, 80, 150), QColor(10, 200, 30));
+    p.fillRect(QRect(-10, 40, 60, 200), QColor(200, 10, 30, 0x77));
+
+    p.drawImage(3, -7, img);
+    p.drawImageFlipped(20, 60, img);
+    p.drawImage(QPoint(-11, 130), opaque);
+    p.drawImage(QRect(0, 30, 90, 150), opaque);
+
+    p.setOpacity(0.6);
+    p.drawImage(30, 100, img);
+    p.setHorizontalOpacityFunction(fade, 0);
+    p.drawImage(8, 15, opaque);
+    p.setHorizontalOpacityFunction(0, 0);
+    p.setOpacity(1.0);
+
+    p.setUserClipRect(QRect(10, 25, 70, 120));
+    QMatrix m;
+    m.translate(40, 90);
+    m.rotate(33);
+    m.translate(-30, -40);
+    p.drawImageTransformed(m, img, false);
+    p.drawImageTransformed(m.scale(0.7, 1.3), opaque, true);
+    p.setUserClipRect(QRect());
+
+    p.fillRectTransformed(m, QSize(40, 70), QColor(0, 0, 255, 0x90), false);
+    p.fillRectTransformed(m.rotate(-70), QSize(50, 30), QColor(255, 255, 0), true);
+    p.setOpacity(0.3);
+    p.fillRectTransformed(m.rotate(20), QSize(30, 30), QColor(0, 255, 255), false);
+    p.setOpacity(1.0);
+
+    QMatrix scale;
+    scale.translate(12, 40);
+    scale.scale(1.5, 1.5);
+    p.drawImageTransformed(scale, opaque, false);
+}
+
+void tst_GfxPainter::threaded_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<int>("threads");
+
+    QTest::newRow("rgb16, 2 threads") << int(QImage::Format_RGB16) << 2;
+    QTest::newRow("rgb16, 3 threads") << int(QImage::Format_RGB16) << 3;
+    QTest::newRow("rgb16, 7 threads") << int(QImage::Format_RGB16) << 7;
+    QTest::newRow("rgb32, 2 threads") << int(QImage::Format_RGB32) << 2;
+    QTest::newRow("rgb32, 5 threads") << int(QImage::Format_RGB32) << 5;
+}
+
+/*?
+    Drawing with several threads must give the same pixels as drawing with one,
+    however the target is split into bands.
+*/
+void tst_GfxPainter::threaded()
+{
+    QFETCH(int, format);
+    QFETCH(int, threads);
+
+    QImage img = source(QImage::Format_ARGB32_Premultiplied, 57, 83);
+    QImage opaque = source(QImage::Format(format), 61, 45);
+
+    QImage expected(96, 200, QImage::Format(format));
+    {
+        GfxPainter p(expected);
+        QCOMPARE(p.threadCount(), 1);
+        draw(p, img, opaque);
+    }
+
+    QImage actual(96, 200, QImage::Format(format));
+    {
+        GfxPainter p(actual);
+        p.setThreadCount(threads);
+        QCOMPARE(p.threadCount(), threads);
+        draw(p, img, opaque);
+        p.sync();
+    }
+
+    for(int yy = 0; yy < expected.height(); ++yy) {
+        if(memcmp(expected.scanLine(yy), actual.scanLine(yy), expected.bytesPerLine()))
+            QFAIL(qPrintable(QString("line %1 differs").arg(yy)));
+    }
+}
+
+/*?
+    Recorded operations aren't drawn until sync(), and images passed to them
+    are kept by the painter until then.
+*/
+void tst_GfxPainter::sync()
+{
+    QImage target(64, 64, QImage::Format_RGB16);
+    target.fill(0);
+
+    GfxPainter p(target);
+    p.setThreadCount(4);
+    p.fillRect(QRect(0, 0, 64, 64), QColor(255, 255, 255));
+    {
+        QImage img(8, 8, QImage::Format_RGB32);
+        img.fill(0xFF0000FF);
+        p.drawImage(4, 4, img);
+    }
+    QCOMPARE(target.pixel(0, 0), qRgb(0, 0, 0));
+
+    p.sync();
+    QCOMPARE(target.pixel(0, 0), qRgb(255, 255, 255));
+    QCOMPARE(target.pixel(5, 5), qRgb(0, 0, 255));
+}
+
+// Draws an image and its reflection below it, as GfxCanvasReflection does
+void tst_GfxPainter::reflect(GfxPainter &p, const QImage &img)
+{
+    QRect item(10, 5, img.width(), img.height());
+    QRect reflection = item.translated(0, img.height());
+
+    p.clear(0x4321);
+    p.drawImage(item.topLeft(), img);
+    p.fillRect(QRect(0, 20, 40, 30), QColor(200, 10, 30, 0x77));
+
+    p.setHorizontalOpacityFunction(fade, 0);
+    p.drawImageFlipped(reflection.topLeft(), p.imgRef(item));
+    p.setHorizontalOpacityFunction(0, 0);
+
+    QImage blurred = p.img(reflection);
+    Gfx::blur(blurred, 3);
+
+    // Draw over the reflected pixels once their reflection has been recorded
+    p.fillRect(item.adjusted(5, 5, -5, -5), QColor(10, 200, 30));
+}
+
+void tst_GfxPainter::reflection_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<int>("threads");
+
+    QTest::newRow("rgb16, 2 threads") << int(QImage::Format_RGB16) << 2;
+    QTest::newRow("rgb16, 4 threads") << int(QImage::Format_RGB16) << 4;
+    QTest::newRow("rgb32, 3 threads") << int(QImage::Format_RGB32) << 3;
+}
+
+/*?
+    Reading back the target with imgRef() or img() must give the pixels drawn
+    so far, and drawing part of the target onto itself must give the same
+    result as drawing with one thread.
+*/
+void tst_GfxPainter::reflection()
+{
+    QFETCH(int, format);
+    QFETCH(int, threads);
+
+    QImage img = source(QImage::Format_ARGB32_Premultiplied, 57, 83);
+
+    QImage expected(96, 200, QImage::Format(format));
+    {
+        GfxPainter p(expected);
+        reflect(p, img);
+    }
+
+    QImage actual(96, 200, QImage::Format(format));
+    {
+        GfxPainter p(actual);
+        p.setThreadCount(threads);
+        reflect(p, img);
+        p.sync();
+    }
+
+    for(int yy = 0; yy < expected.height(); ++yy) {
+        if(memcmp(expected.scanLine(yy), actual.scanLine(yy), expected.bytesPerLine()))
+            QFAIL(qPrintable(QString("line %1 differs").arg(yy)));
+    }
+}
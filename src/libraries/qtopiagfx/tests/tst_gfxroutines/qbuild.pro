@@ -0,0 +1,36 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+TARGET=tst_gfxroutines
+
+SOURCEPATH+=/src/libraries/qtopiagfx
+
+SOURCES=\
+    tst_gfxroutines.cpp\
+    routines.cpp\
+    def_blend.cpp\
+    def_blur.cpp\
+    def_color.cpp\
+    def_memory.cpp
+
+# Built as the library builds them
+SSE2 [
+    TYPE=CPP_SOURCES
+    SOURCEPATH=/src/libraries/qtopiagfx
+    CXXFLAGS=-msse2
+]
+
+NEON [
+    TYPE=CPP_SOURCES
+    SOURCEPATH=/src/libraries/qtopiagfx
+    CXXFLAGS=-mfpu=neon
+]
+
+equals(arch,i386)|equals(arch,x86_64) {
+    DEFINES+=GFX_HAVE_SSE2
+    SSE2.SOURCES=sse2_blend.cpp sse2_blur.cpp sse2_color.cpp
+}
+
+enable_neon {
+    DEFINES+=GFX_HAVE_NEON
+    NEON.SOURCES=neon_blend.cpp neon_blur.cpp neon_color.cpp
+}
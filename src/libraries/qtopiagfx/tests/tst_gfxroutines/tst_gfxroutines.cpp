@@ -0,0 +1,305 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QObject>
+#include <QTest>
+#include <QApplication>
+#include <QVector>
+#include <shared/qtopiaunittest.h>
+
+#include "routines.h"
+#include "def_blend.h"
+#include "def_blur.h"
+#include "def_color.h"
+#include "sse2_routines.h"
+#include "neon_routines.h"
+
+//TESTED_CLASS=
+//TESTED_FILES=src/libraries/qtopiagfx/routines.cpp
+
+/*
+    The SIMD kernels selected by q_initroutines() must produce exactly the same
+    output as the def_* reference routines they replace.
+*/
+struct Kernels
+{
+    const char *name;
+    unsigned int feature;
+    void (*blend_rgba16_rgb16)(unsigned short *, unsigned short *, unsigned char *,
+                               unsigned char, int, unsigned short *);
+    void (*blend_argb32p_rgb16)(unsigned short *, unsigned int *, unsigned char,
+                                int, unsigned short *);
+    void (*blur32)(unsigned int *, int, int, int, int);
+    void (*blur16)(unsigned short *, int, int, int, int);
+    void (*color_rgb16_rgb32)(unsigned short *, int, unsigned int *);
+    void (*color_rgb32_rgb16)(unsigned int *, int, unsigned short *);
+};
+
+static const Kernels kernels[] = {
+#ifdef GFX_HAVE_SSE2
+    { "sse2", CpuSSE2, sse2_blend_rgba16_rgb16, sse2_blend_argb32p_rgb16,
+      sse2_blur32, sse2_blur16, sse2_color_rgb16_rgb32, sse2_color_rgb32_rgb16 },
+#endif
+#ifdef GFX_HAVE_NEON
+    { "neon", CpuNEON, neon_blend_rgba16_rgb16, neon_blend_argb32p_rgb16,
+      neon_blur32, neon_blur16, neon_color_rgb16_rgb32, neon_color_rgb32_rgb16 },
+#endif
+    { 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+
+static const unsigned char opacities[] = { 0x00, 0x01, 0x64, 0x7F, 0x80, 0xFD, 0xFE, 0xFF };
+
+class tst_GfxRoutines : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void blend_argb32p_rgb16_data();
+    void blend_argb32p_rgb16();
+    void blend_rgba16_rgb16_data();
+    void blend_rgba16_rgb16();
+    void blur_data();
+    void blur();
+    void color_data();
+    void color();
+    void dispatch();
+
+private:
+    void kernelData();
+    static unsigned int random();
+    static unsigned char randomAlpha();
+};
+
+QTEST_APP_MAIN(tst_GfxRoutines, QApplication)
+#include "tst_gfxroutines.moc"
+
+unsigned int tst_GfxRoutines::random()
+{
+    return (unsigned int)qrand() ^ ((unsigned int)qrand() << 15) ^ ((unsigned int)qrand() << 30);
+}
+
+// favour the fully transparent and opaque values the kernels special case
+unsigned char tst_GfxRoutines::randomAlpha()
+{
+    switch(random() % 4) {
+        case 0: return 0x00;
+        case 1: return 0xFF;
+        default: return random() & 0xFF;
+    }
+}
+
+void tst_GfxRoutines::initTestCase()
+{
+    qsrand(1);
+}
+
+void tst_GfxRoutines::kernelData()
+{
+    QTest::addColumn<int>("kernel");
+
+    for(int ii = 0; kernels[ii].name; ++ii) {
+        if(q_cpufeatures() & kernels[ii].feature)
+            QTest::newRow(kernels[ii].name) << ii;
+    }
+}
+
+void tst_GfxRoutines::blend_argb32p_rgb16_data()
+{
+    kernelData();
+}
+
+void tst_GfxRoutines::blend_argb32p_rgb16()
+{
+    QFETCH(int, kernel);
+    const Kernels &k = kernels[kernel];
+
+    // widths from 1, as the reference runs a full Duff's device block for 0
+    for(int width = 1; width < 70; ++width) {
+        for(uint o = 0; o < sizeof(opacities); ++o) {
+            for(int offset = 0; offset < 2; ++offset) {
+                QVector<unsigned short> dest(width + 2);
+                QVector<unsigned int> src(width + 2);
+                for(int ii = 0; ii < dest.count(); ++ii) {
+                    dest[ii] = random();
+                    unsigned int alpha = randomAlpha();
+                    unsigned int r = (random() & 0xFF) * alpha / 0xFF;
+                    unsigned int g = (random() & 0xFF) * alpha / 0xFF;
+                    unsigned int b = (random() & 0xFF) * alpha / 0xFF;
+                    src[ii] = alpha << 24 | r << 16 | g << 8 | b;
+                }
+
+                QVector<unsigned short> expected(width + 2);
+                QVector<unsigned short> actual(width + 2);
+                def_blend_argb32p_rgb16(dest.data() + offset, src.data() + offset,
+                                        opacities[o], width, expected.data() + offset);
+                k.blend_argb32p_rgb16(dest.data() + offset, src.data() + offset,
+                                      opacities[o], width, actual.data() + offset);
+                QCOMPARE(actual, expected);
+
+                QVector<unsigned short> inplace = dest;
+                k.blend_argb32p_rgb16(inplace.data() + offset, src.data() + offset,
+                                      opacities[o], width, inplace.data() + offset);
+                QCOMPARE(inplace.mid(offset, width), expected.mid(offset, width));
+            }
+        }
+    }
+}
+
+void tst_GfxRoutines::blend_rgba16_rgb16_data()
+{
+    kernelData();
+}
+
+void tst_GfxRoutines::blend_rgba16_rgb16()
+{
+    QFETCH(int, kernel);
+    const Kernels &k = kernels[kernel];
+
+    for(int width = 0; width < 70; ++width) {
+        for(uint o = 0; o < sizeof(opacities); ++o) {
+            for(int offset = 0; offset < 2; ++offset) {
+                QVector<unsigned short> dest(width + 2);
+                QVector<unsigned short> src(width + 2);
+                QVector<unsigned char> alpha(width + 2);
+                for(int ii = 0; ii < dest.count(); ++ii) {
+                    dest[ii] = random();
+                    src[ii] = random();
+                    alpha[ii] = randomAlpha();
+                }
+
+                QVector<unsigned short> expected(width + 2);
+                QVector<unsigned short> actual(width + 2);
+                def_blend_rgba16_rgb16(dest.data() + offset, src.data() + offset, alpha.data() + offset,
+                                       opacities[o], width, expected.data() + offset);
+                k.blend_rgba16_rgb16(dest.data() + offset, src.data() + offset, alpha.data() + offset,
+                                     opacities[o], width, actual.data() + offset);
+                QCOMPARE(actual, expected);
+
+                QVector<unsigned short> inplace = dest;
+                k.blend_rgba16_rgb16(inplace.data() + offset, src.data() + offset, alpha.data() + offset,
+                                     opacities[o], width, inplace.data() + offset);
+                QCOMPARE(inplace.mid(offset, width), expected.mid(offset, width));
+            }
+        }
+    }
+}
+
+void tst_GfxRoutines::blur_data()
+{
+    kernelData();
+}
+
+void tst_GfxRoutines::blur()
+{
+    QFETCH(int, kernel);
+    const Kernels &k = kernels[kernel];
+
+    // alpha as Gfx::blur() computes it, up to just under 1 << 15
+    const int alphas[] = { 1, 1000, 16000, 32767 };
+
+    for(int width = 1; width < 24; ++width) {
+        for(int height = 1; height < 24; height += 3) {
+            for(uint a = 0; a < sizeof(alphas) / sizeof(alphas[0]); ++a) {
+                int step = width + (height & 3);
+
+                QVector<unsigned int> expected32(step * height);
+                for(int ii = 0; ii < expected32.count(); ++ii)
+                    expected32[ii] = random();
+                QVector<unsigned int> actual32 = expected32;
+                def_blur32(expected32.data(), width, height, step, alphas[a]);
+                k.blur32(actual32.data(), width, height, step, alphas[a]);
+                QCOMPARE(actual32, expected32);
+
+                QVector<unsigned short> expected16(step * height);
+                for(int ii = 0; ii < expected16.count(); ++ii)
+                    expected16[ii] = random();
+                QVector<unsigned short> actual16 = expected16;
+                def_blur16(expected16.data(), width, height, step, alphas[a] << 1);
+                k.blur16(actual16.data(), width, height, step, alphas[a] << 1);
+                QCOMPARE(actual16, expected16);
+            }
+        }
+    }
+}
+
+void tst_GfxRoutines::color_data()
+{
+    kernelData();
+}
+
+void tst_GfxRoutines::color()
+{
+    QFETCH(int, kernel);
+    const Kernels &k = kernels[kernel];
+
+    for(int width = 0; width < 70; ++width) {
+        for(int offset = 0; offset < 2; ++offset) {
+            QVector<unsigned short> src16(width + 2);
+            QVector<unsigned int> src32(width + 2);
+            for(int ii = 0; ii < src16.count(); ++ii) {
+                src16[ii] = random();
+                src32[ii] = random();
+            }
+
+            QVector<unsigned int> expected32(width + 2);
+            QVector<unsigned int> actual32(width + 2);
+            def_color_rgb16_rgb32(src16.data() + offset, width, expected32.data() + offset);
+            k.color_rgb16_rgb32(src16.data() + offset, width, actual32.data() + offset);
+            QCOMPARE(actual32, expected32);
+
+            QVector<unsigned short> expected16(width + 2);
+            QVector<unsigned short> actual16(width + 2);
+            def_color_rgb32_rgb16(src32.data() + offset, width, expected16.data() + offset);
+            k.color_rgb32_rgb16(src32.data() + offset, width, actual16.data() + offset);
+            QCOMPARE(actual16, expected16);
+        }
+    }
+}
+
+/*
+    q_initroutines() must install the kernels for the features the CPU has,
+    and leave the references in place otherwise.
+*/
+void tst_GfxRoutines::dispatch()
+{
+    q_initroutines();
+
+    const Kernels *selected = 0;
+    for(int ii = 0; kernels[ii].name; ++ii) {
+        if(q_cpufeatures() & kernels[ii].feature)
+            selected = &kernels[ii];
+    }
+
+    if(selected) {
+        QVERIFY(q_blendroutines.blend_argb32p_rgb16 == selected->blend_argb32p_rgb16);
+        QVERIFY(q_blendroutines.blend_rgba16_rgb16 == selected->blend_rgba16_rgb16);
+        QVERIFY(q_blurroutines.blur32 == selected->blur32);
+        QVERIFY(q_blurroutines.blur16 == selected->blur16);
+        QVERIFY(q_colorroutines.color_rgb16_rgb32 == selected->color_rgb16_rgb32);
+        QVERIFY(q_colorroutines.color_rgb32_rgb16 == selected->color_rgb32_rgb16);
+    } else {
+        QVERIFY(q_blendroutines.blend_argb32p_rgb16 == &def_blend_argb32p_rgb16);
+        QVERIFY(q_blurroutines.blur32 == &def_blur32);
+        QVERIFY(q_colorroutines.color_rgb16_rgb32 == &def_color_rgb16_rgb32);
+    }
+
+    // untouched entries keep their reference implementation
+    QVERIFY(q_blendroutines.blend_argb32p_rgb32 == &def_blend_argb32p_rgb32);
+    QVERIFY(q_colorroutines.color_argb32_argb32p == &def_color_argb32_argb32p);
+}
@@ -36,7 +36,7 @@
 // is disabled, since it automatically instantiates some code using typeid().
 
 // Provide the small parts of functional we use - binding only to member functions,
-// with up to 4 function parameters, and with crefs only to value types.
+// with up to 5 function parameters, and with crefs only to value types.
 
 namespace nonstd {
 namespace tr1 {
@@ -153,6 +153,26 @@ struct FunctionWrapper5e1
     R operator()(E1 e1) { return (m_a1->*m_f)(m_a2, m_a3, m_a4, m_a5, e1); }
 };
 
+template<typename R, typename F, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+struct FunctionWrapper6
+{
+    F m_f; A1 m_a1; A2 m_a2; A3 m_a3; A4 m_a4; A5 m_a5; A6 m_a6;
+
+    FunctionWrapper6(F f, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6) : m_f(f), m_a1(a1), m_a2(a2), m_a3(a3), m_a4(a4), m_a5(a5), m_a6(a6) {}
+
+    R operator()() { return (m_a1->*m_f)(m_a2, m_a3, m_a4, m_a5, m_a6); }
+};
+
+template<typename R, typename F, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6, typename E1>
+struct FunctionWrapper6e1
+{
+    F m_f; A1 m_a1; A2 m_a2; A3 m_a3; A4 m_a4; A5 m_a5; A6 m_a6;
+
+    FunctionWrapper6e1(F f, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6) : m_f(f), m_a1(a1), m_a2(a2), m_a3(a3), m_a4(a4), m_a5(a5), m_a6(a6) {}
+
+    R operator()(E1 e1) { return (m_a1->*m_f)(m_a2, m_a3, m_a4, m_a5, m_a6, e1); }
+};
+
 } // namespace impl
 
 template<typename T>
@@ -281,6 +301,30 @@ impl::FunctionWrapper5e1<R, R (T::*)(B1, B2, B3, B4, E1) const, A1, A2, A3, A4,
     return impl::FunctionWrapper5e1<R, R (T::*)(B1, B2, B3, B4, E1) const, A1, A2, A3, A4, A5, E1>(f, a1, a2, a3, a4, a5);
 }
 
+template<typename R, typename T, typename B1, typename B2, typename B3, typename B4, typename B5, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+impl::FunctionWrapper6<R, R (T::*)(B1, B2, B3, B4, B5), A1, A2, A3, A4, A5, A6> bind(R (T::*f)(B1, B2, B3, B4, B5), A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6)
+{
+    return impl::FunctionWrapper6<R, R (T::*)(B1, B2, B3, B4, B5), A1, A2, A3, A4, A5, A6>(f, a1, a2, a3, a4, a5, a6);
+}
+
+template<typename R, typename T, typename B1, typename B2, typename B3, typename B4, typename B5, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+impl::FunctionWrapper6<R, R (T::*)(B1, B2, B3, B4, B5) const, A1, A2, A3, A4, A5, A6> bind(R (T::*f)(B1, B2, B3, B4, B5) const, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6)
+{
+    return impl::FunctionWrapper6<R, R (T::*)(B1, B2, B3, B4, B5) const, A1, A2, A3, A4, A5, A6>(f, a1, a2, a3, a4, a5, a6);
+}
+
+template<typename R, typename T, typename B1, typename B2, typename B3, typename B4, typename B5, typename E1, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+impl::FunctionWrapper6e1<R, R (T::*)(B1, B2, B3, B4, B5, E1), A1, A2, A3, A4, A5, A6, E1> bind(R (T::*f)(B1, B2, B3, B4, B5, E1), A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6)
+{
+    return impl::FunctionWrapper6e1<R, R (T::*)(B1, B2, B3, B4, B5, E1), A1, A2, A3, A4, A5, A6, E1>(f, a1, a2, a3, a4, a5, a6);
+}
+
+template<typename R, typename T, typename B1, typename B2, typename B3, typename B4, typename B5, typename E1, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+impl::FunctionWrapper6e1<R, R (T::*)(B1, B2, B3, B4, B5, E1) const, A1, A2, A3, A4, A5, A6, E1> bind(R (T::*f)(B1, B2, B3, B4, B5, E1) const, A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6)
+{
+    return impl::FunctionWrapper6e1<R, R (T::*)(B1, B2, B3, B4, B5, E1) const, A1, A2, A3, A4, A5, A6, E1>(f, a1, a2, a3, a4, a5, a6);
+}
+
 }  // namespace tr1
 }  // namespace nonstd
 
@@ -70,7 +70,8 @@ PRIVATE_HEADERS=\
     qmailaccountkey_p.h\
     qmailaccountsortkey_p.h\
     qmailkeyargument_p.h\
-    semaphore_p.h
+    semaphore_p.h\
+    sharedmetadatacache_p.h
 
 SEMI_PRIVATE_HEADERS=\
     accountconfiguration_p.h\
@@ -111,6 +112,7 @@ SOURCES=\
     qmailmessageremovalrecord.cpp\
     detailspage.cpp\
     semaphore.cpp\
+    sharedmetadatacache.cpp\
     addressselectorwidget.cpp\
     qmailserviceaction.cpp\
     qmailnewmessagehandler.cpp\
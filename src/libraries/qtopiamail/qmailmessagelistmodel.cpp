@@ -18,13 +18,17 @@
 ****************************************************************************/
 
 #include "qmailmessagelistmodel.h"
+#include "qmailmessagesortkey_p.h"
 #include "qmailstore.h"
 #include <QIcon>
 #include <QTimeString>
 #include <QDebug>
 #include <QCache>
+#include <QHash>
+#include <QSet>
 #include <QContactModel>
 #include <QtAlgorithms>
+#include <string.h>
 
 #include <QCollectivePresenceInfo>
 
@@ -33,147 +37,420 @@
 #endif
 
 static const int nameCacheSize = 50;
-static const int fullRefreshCutoff = 10;
+static const int pageSize = 100;
+
+// Rank the storage classes of a database value in the order SQLite sorts them
+static int sqlTypeRank(const QVariant& value)
+{
+    if (value.isNull())
+        return 0;
+
+    switch (value.type()) {
+    case QVariant::Bool:
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+    case QVariant::Double:
+        return 1;
+
+    case QVariant::ByteArray:
+        return 3;
+
+    default:
+        break;
+    }
+
+    return 2;
+}
+
+// Compare two values retrieved from the database, consistently with an SQL ORDER BY clause
+static int compareSqlValues(const QVariant& lhs, const QVariant& rhs)
+{
+    int lhsRank = sqlTypeRank(lhs);
+    int rhsRank = sqlTypeRank(rhs);
+    if (lhsRank != rhsRank)
+        return (lhsRank - rhsRank);
+
+    if (lhsRank == 1) {
+        if ((lhs.type() == QVariant::Double) || (rhs.type() == QVariant::Double)) {
+            double l(lhs.toDouble()), r(rhs.toDouble());
+            return (l < r ? -1 : (r < l ? 1 : 0));
+        }
+
+        qlonglong l(lhs.toLongLong()), r(rhs.toLongLong());
+        return (l < r ? -1 : (r < l ? 1 : 0));
+    } else if (lhsRank == 2) {
+        return QString::compare(lhs.toString(), rhs.toString());
+    } else if (lhsRank == 3) {
+        QByteArray l(lhs.toByteArray()), r(rhs.toByteArray());
+        int result = ::memcmp(l.constData(), r.constData(), qMin(l.size(), r.size()));
+        return (result != 0 ? result : l.size() - r.size());
+    }
+
+    return 0;
+}
 
 class QMailMessageListModelPrivate
 {
 public:
-    class Item : private QPair<QMailMessageId, bool>
+    class Item
     {
     public:
-        explicit Item(const QMailMessageId& id, bool f = false) : QPair<QMailMessageId, bool>(id, f) {}
+        explicit Item(const QMailMessageId& id = QMailMessageId(), const QVariantList& values = QVariantList(), bool f = false) 
+            : mId(id), mValues(values), mChecked(f) {}
+
+        QMailMessageId id() const { return mId; }
 
-        QMailMessageId id() const { return first; }
+        // The values of the sort key columns, as stored in the database
+        const QVariantList& sortValues() const { return mValues; }
+        void setSortValues(const QVariantList& values) { mValues = values; }
 
-        bool isChecked() const { return second; }
-        void setChecked(bool f) { second = f; }
+        bool isChecked() const { return mChecked; }
+        void setChecked(bool f) { mChecked = f; }
 
-        // Two instances of the same QMailMessageId are the same Item, regardless of the checked state
-        bool operator== (const Item& other) { return (first == other.first); }
+    private:
+        QMailMessageId mId;
+        QVariantList mValues;
+        bool mChecked;
     };
 
+    typedef QPair<QMailMessageId, QVariantList> SortedId;
+
     QMailMessageListModelPrivate(const QMailMessageKey& key,
                                  const QMailMessageSortKey& sortKey,
                                  bool sychronizeEnabled);
     ~QMailMessageListModelPrivate();
 
-    const QList<Item>& items() const;
+    void initialize() const;
+
+    void setSortKey(const QMailMessageSortKey& key);
+
+    int rowCount() const;
+    bool isComplete() const;
+
+    Item* item(int row) const;
 
     int indexOf(const QMailMessageId& id) const;
+    QList<int> indexesOf(const QMailMessageIdList& ids) const;
+    int indexOf(const QMailMessageId& id, const QVariantList& values) const;
+
+    QList<SortedId> query(const QMailMessageKey& filter) const;
+
+    bool lessThan(const QVariantList& lhs, const QVariantList& rhs) const;
+    int insertPosition(const QVariantList& values) const;
+    bool inPosition(int index, const QVariantList& values, const QSet<QMailMessageId>& updatedIds) const;
 
-    template<typename Comparator>
-    QList<Item>::iterator lowerBound(const QMailMessageId& id, Comparator& cmp) const;
+    void removeItems(QMailMessageListModel* model, const QList<int>& indexes);
+    void insertItems(QMailMessageListModel* model, const QList<Item>& items);
+    void updateItems(QMailMessageListModel* model, const QSet<QMailMessageId>& ids);
+    void synchronizeCount(QMailMessageListModel* model);
 
     QString messageAddressText(const QMailMessageMetaData& m, bool incoming);
 
     void invalidateCache();
 
+private:
+    bool fetch(int count) const;
+
 public:
     QMailMessageKey key;
     QMailMessageSortKey sortKey;
+    QMailMessageSortKey pageSortKey;
+    QList<Qt::SortOrder> sortOrders;
     bool ignoreUpdates;
     mutable QList<Item> itemList;
+    mutable int totalCount;
     mutable bool init;
     mutable bool needSynchronize;
     QCache<QString,QString> nameCache;
     QContactModel contactModel;
 };
 
-class LessThanFunctor
+QMailMessageListModelPrivate::QMailMessageListModelPrivate(const QMailMessageKey& key,
+                                                           const QMailMessageSortKey& sortKey,
+                                                           bool ignoreUpdates)
+:
+    key(key),
+    ignoreUpdates(ignoreUpdates),
+    totalCount(0),
+    init(false),
+    needSynchronize(true),
+    nameCache(nameCacheSize)
 {
-public:
-    typedef QMailMessageListModelPrivate::Item Item;
+    setSortKey(sortKey);
+}
 
-    LessThanFunctor(const QMailMessageSortKey& sortKey);
-    ~LessThanFunctor();
+QMailMessageListModelPrivate::~QMailMessageListModelPrivate()
+{
+}
 
-    bool operator()(const QMailMessageId& lhs, const QMailMessageId& rhs);
+void QMailMessageListModelPrivate::setSortKey(const QMailMessageSortKey& key)
+{
+    sortKey = key;
 
-    bool operator()(const Item& lhs, const Item& rhs) { return operator()(lhs.id(), rhs.id()); }
-    bool operator()(const Item& lhs, const QMailMessageId& rhs) { return operator()(lhs.id(), rhs); }
-    bool operator()(const QMailMessageId& lhs, const Item& rhs) { return operator()(lhs, rhs.id()); }
+    // Break ties with the message identifier, so that the order is total and stable between pages
+    pageSortKey = sortKey & QMailMessageSortKey(QMailMessageSortKey::Id);
 
-    bool invalidatedList() const;
+    sortOrders.clear();
+    foreach (const QMailMessageSortKeyPrivate::Argument& arg, pageSortKey.d->arguments)
+        sortOrders.append(arg.second);
+}
 
-private:
-    QMailMessageSortKey mSortKey;
-    bool mInvalidatedList;
-};
+void QMailMessageListModelPrivate::initialize() const
+{
+    if(!init)
+    {
+        // Only the first page of identifiers is loaded; the remainder is loaded on demand
+        itemList.clear();
+        totalCount = QMailStore::instance()->countMessages(key);
 
-LessThanFunctor::LessThanFunctor(const QMailMessageSortKey& sortKey)
-:
-    mSortKey(sortKey),
-    mInvalidatedList(false)
+        init = true;
+        needSynchronize = false;
+
+        fetch(pageSize);
+    }
+}
+
+bool QMailMessageListModelPrivate::fetch(int count) const
 {
+    // Extend the loaded items to include at least the first 'count' rows
+    bool extended = false;
+
+    while (itemList.count() < qMin(count, totalCount)) {
+        // Overlap the last loaded item, and only accept items that sort after it, so that 
+        // the page aligns with the loaded items even if the store has been modified since
+        int offset = qMax(itemList.count() - 1, 0);
+        int limit = qMax(count - itemList.count(), pageSize) + (itemList.count() - offset);
+
+        QList<SortedId> page(QMailStore::instance()->queryMessageSortValues(key, pageSortKey, limit, offset));
+
+        int loaded = itemList.count();
+        foreach (const SortedId& sorted, page) {
+            if (itemList.count() == totalCount)
+                break;
+
+            if (itemList.isEmpty() || lessThan(itemList.last().sortValues(), sorted.second))
+                itemList.append(Item(sorted.first, sorted.second));
+        }
+
+        if ((itemList.count() == loaded) || (page.count() < limit)) {
+            // The store has fewer messages than expected; the count will be corrected 
+            // when the removal notification is processed
+            extended |= (itemList.count() != loaded);
+            break;
+        }
+
+        extended = true;
+    }
+
+    return extended;
 }
 
-LessThanFunctor::~LessThanFunctor(){}
+int QMailMessageListModelPrivate::rowCount() const
+{
+    initialize();
+    return totalCount;
+}
 
-bool LessThanFunctor::operator()(const QMailMessageId& lhs, const QMailMessageId& rhs)
+bool QMailMessageListModelPrivate::isComplete() const
 {
-    QMailMessageKey firstKey(QMailMessageKey::Id,lhs);
-    QMailMessageKey secondKey(QMailMessageKey::Id,rhs);
+    return (itemList.count() == totalCount);
+}
 
-    // TODO: we have to do this in a more efficient manner:
-    QMailMessageIdList results = QMailStore::instance()->queryMessages(firstKey | secondKey, mSortKey);
-    if(results.count() != 2)
-    {
-        mInvalidatedList = true;
-        return false;
+QMailMessageListModelPrivate::Item* QMailMessageListModelPrivate::item(int row) const
+{
+    initialize();
+
+    if (row >= itemList.count()) {
+        // Load the page containing this row
+        fetch(((row / pageSize) + 1) * pageSize);
+        if (row >= itemList.count())
+            return 0;
     }
-    return results.first() == lhs;
+
+    return &itemList[row];
 }
 
-bool LessThanFunctor::invalidatedList() const
+int QMailMessageListModelPrivate::indexOf(const QMailMessageId& id) const
 {
-    return mInvalidatedList;
+    for (int i = 0; i < itemList.count(); ++i)
+        if (itemList.at(i).id() == id)
+            return i;
+
+    return -1;
 }
 
-QMailMessageListModelPrivate::QMailMessageListModelPrivate(const QMailMessageKey& key,
-                                                           const QMailMessageSortKey& sortKey,
-                                                           bool ignoreUpdates)
-:
-    key(key),
-    sortKey(sortKey),
-    ignoreUpdates(ignoreUpdates),
-    init(false),
-    needSynchronize(true),
-    nameCache(nameCacheSize)
+QList<int> QMailMessageListModelPrivate::indexesOf(const QMailMessageIdList& ids) const
 {
+    // Find the indexes of all the loaded items in a single pass
+    QSet<QMailMessageId> idSet(ids.toSet());
+
+    QList<int> indexes;
+    for (int i = 0; (i < itemList.count()) && (indexes.count() < idSet.count()); ++i)
+        if (idSet.contains(itemList.at(i).id()))
+            indexes.append(i);
+
+    return indexes;
 }
 
-QMailMessageListModelPrivate::~QMailMessageListModelPrivate()
+int QMailMessageListModelPrivate::indexOf(const QMailMessageId& id, const QVariantList& values) const
 {
+    // Load items until we reach the position where this message would be sorted
+    while (!isComplete() && (itemList.isEmpty() || lessThan(itemList.last().sortValues(), values))) {
+        if (!fetch(itemList.count() + pageSize))
+            break;
+    }
+
+    int index = insertPosition(values) - 1;
+    if ((index >= 0) && (itemList.at(index).id() == id))
+        return index;
+
+    return indexOf(id);
 }
 
-const QList<QMailMessageListModelPrivate::Item>& QMailMessageListModelPrivate::items() const
+QList<QMailMessageListModelPrivate::SortedId> QMailMessageListModelPrivate::query(const QMailMessageKey& filter) const
 {
-    if(!init)
-    {
-        itemList.clear();
-        QMailMessageIdList ids = QMailStore::instance()->queryMessages(key,sortKey);
-        foreach (const QMailMessageId& id, ids)
-            itemList.append(QMailMessageListModelPrivate::Item(id, false));
+    return QMailStore::instance()->queryMessageSortValues(key & filter, pageSortKey);
+}
 
-        init = true;
-        needSynchronize = false;
+bool QMailMessageListModelPrivate::lessThan(const QVariantList& lhs, const QVariantList& rhs) const
+{
+    for (int i = 0; i < sortOrders.count(); ++i) {
+        int result = compareSqlValues(lhs.value(i), rhs.value(i));
+        if (result != 0)
+            return (sortOrders.at(i) == Qt::AscendingOrder ? (result < 0) : (result > 0));
     }
 
-    return itemList;
+    return false;
 }
 
-int QMailMessageListModelPrivate::indexOf(const QMailMessageId& id) const
+int QMailMessageListModelPrivate::insertPosition(const QVariantList& values) const
+{
+    // Binary search for the first loaded item that sorts after these values
+    int begin = 0;
+    int n = itemList.count();
+
+    while (n > 0) {
+        int half = n / 2;
+        int middle = begin + half;
+        if (lessThan(values, itemList.at(middle).sortValues())) {
+            n = half;
+        } else {
+            begin = middle + 1;
+            n -= (half + 1);
+        }
+    }
+
+    return begin;
+}
+
+bool QMailMessageListModelPrivate::inPosition(int index, const QVariantList& values, const QSet<QMailMessageId>& updatedIds) const
+{
+    if (values == itemList.at(index).sortValues())
+        return true;
+
+    // The last loaded item could have moved into the part of the list that is not loaded
+    if ((index == itemList.count() - 1) && !isComplete())
+        return false;
+
+    // The item remains in position if it still sorts between its neighbours, provided 
+    // that the neighbours have not also changed
+    if (index > 0) {
+        const Item& previous(itemList.at(index - 1));
+        if (updatedIds.contains(previous.id()) || lessThan(values, previous.sortValues()))
+            return false;
+    }
+    if (index < itemList.count() - 1) {
+        const Item& next(itemList.at(index + 1));
+        if (updatedIds.contains(next.id()) || lessThan(next.sortValues(), values))
+            return false;
+    }
+
+    return true;
+}
+
+void QMailMessageListModelPrivate::removeItems(QMailMessageListModel* model, const QList<int>& indexes)
 {
-    Item item(id, false);
+    // Remove contiguous runs of ascending indexes as ranges, from the end of the list
+    int i = indexes.count() - 1;
+    while (i >= 0) {
+        int last = indexes.at(i);
+        int first = last;
+        while ((i > 0) && (indexes.at(i - 1) == first - 1)) {
+            --i;
+            --first;
+        }
+        --i;
 
-    // Will return the matching item regardless of boolean state due to Item::operator==
-    return itemList.indexOf(item);
+        model->beginRemoveRows(QModelIndex(), first, last);
+        itemList.erase(itemList.begin() + first, itemList.begin() + last + 1);
+        totalCount -= (last - first + 1);
+        model->endRemoveRows();
+    }
 }
 
-template<typename Comparator>
-QList<QMailMessageListModelPrivate::Item>::iterator QMailMessageListModelPrivate::lowerBound(const QMailMessageId& id, Comparator& cmp) const
+void QMailMessageListModelPrivate::insertItems(QMailMessageListModel* model, const QList<Item>& items)
 {
-    return qLowerBound(itemList.begin(), itemList.end(), id, cmp);
+    // The items must be sorted; consecutive items that share an insertion point are inserted as a range
+    bool complete = isComplete();
+
+    int i = 0;
+    while (i < items.count()) {
+        int position = insertPosition(items.at(i).sortValues());
+        if ((position == itemList.count()) && !complete) {
+            // These items belong in the part of the list that is not loaded
+            break;
+        }
+
+        int end = i + 1;
+        if (position == itemList.count()) {
+            end = items.count();
+        } else {
+            const QVariantList& following(itemList.at(position).sortValues());
+            while ((end < items.count()) && lessThan(items.at(end).sortValues(), following))
+                ++end;
+        }
+
+        model->beginInsertRows(QModelIndex(), position, position + (end - i) - 1);
+        for (int j = i; j < end; ++j)
+            itemList.insert(position + (j - i), items.at(j));
+        totalCount += (end - i);
+        model->endInsertRows();
+
+        i = end;
+    }
+}
+
+void QMailMessageListModelPrivate::updateItems(QMailMessageListModel* model, const QSet<QMailMessageId>& ids)
+{
+    // Report contiguous runs of changed items as ranges
+    int first = -1;
+    for (int i = 0; i <= itemList.count(); ++i) {
+        bool changed = (i < itemList.count()) && ids.contains(itemList.at(i).id());
+        if (changed && (first == -1)) {
+            first = i;
+        } else if (!changed && (first != -1)) {
+            emit model->dataChanged(model->createIndex(first, 0), model->createIndex(i - 1, 0));
+            first = -1;
+        }
+    }
+}
+
+void QMailMessageListModelPrivate::synchronizeCount(QMailMessageListModel* model)
+{
+    // Resize the part of the list that is not loaded to match the store
+    int count = qMax(QMailStore::instance()->countMessages(key), itemList.count());
+
+    if (count > totalCount) {
+        model->beginInsertRows(QModelIndex(), totalCount, count - 1);
+        totalCount = count;
+        model->endInsertRows();
+    } else if (count < totalCount) {
+        model->beginRemoveRows(QModelIndex(), count, totalCount - 1);
+        totalCount = count;
+        model->endRemoveRows();
+    }
 }
 
 QString QMailMessageListModelPrivate::messageAddressText(const QMailMessageMetaData& m, bool incoming) 
@@ -234,8 +511,14 @@ void QMailMessageListModelPrivate::invalidateCache()
   The QMailMessageListModel is a descendant of QAbstractListModel, so it is suitable for use with
   the Qt View classes such as QListView to visually represent lists of messages. 
  
+  The model does not load the entire list of messages when it is first accessed; message 
+  identifiers are retrieved from the store in sorted pages, as the rows they occupy are 
+  requested.
+
   The model listens for changes reported by the QMailStore, and automatically synchronizes
-  its content with that of the store.  This behaviour can be optionally or temporarily disabled 
+  its content with that of the store.  The sorted position of an added or modified message
+  is located within the loaded rows without requerying the store, and adjacent changes are
+  reported as ranges of inserted or removed rows.  This behaviour can be optionally or temporarily disabled 
   by calling the setIgnoreMailStoreUpdates() function.
 
   Messages can be extracted from the view with the idFromIndex() function and the resultant id can be 
@@ -326,7 +609,7 @@ QMailMessageListModel::~QMailMessageListModel()
 int QMailMessageListModel::rowCount(const QModelIndex& index) const
 {
     Q_UNUSED(index);
-    return d->items().count();
+    return d->rowCount();
 }
 
 /*!
@@ -334,7 +617,7 @@ int QMailMessageListModel::rowCount(const QModelIndex& index) const
 */
 bool QMailMessageListModel::isEmpty() const
 {
-    return d->items().isEmpty();
+    return (d->rowCount() == 0);
 }
 
 /*!
@@ -391,7 +674,7 @@ QVariant QMailMessageListModel::data(const QModelIndex& index, int role) const
         break;
 
     case Qt::CheckStateRole:
-        return (d->itemList[index.row()].isChecked() ? Qt::Checked : Qt::Unchecked);
+        return (d->item(index.row())->isChecked() ? Qt::Checked : Qt::Unchecked);
         break;
 
     default:
@@ -576,8 +859,9 @@ bool QMailMessageListModel::setData(const QModelIndex& index, const QVariant& va
             // No support for partial checking in this model
             if (state != Qt::PartiallyChecked) {
                 int row = index.row();
-                if (row < rowCount()) {
-                    d->itemList[row].setChecked(state == Qt::Checked);
+                QMailMessageListModelPrivate::Item* item = (row < rowCount() ? d->item(row) : 0);
+                if (item) {
+                    item->setChecked(state == Qt::Checked);
                     emit dataChanged(index, index);
                     return true;
                 }
@@ -626,7 +910,7 @@ QMailMessageSortKey QMailMessageListModel::sortKey() const
 
 void QMailMessageListModel::setSortKey(const QMailMessageSortKey& sortKey) 
 {
-    d->sortKey = sortKey;
+    d->setSortKey(sortKey);
     fullRefresh(true);
 }
 
@@ -638,51 +922,26 @@ void QMailMessageListModel::messagesAdded(const QMailMessageIdList& ids)
     if(d->ignoreUpdates)
         return;
 
-    //TODO change this code to use our own searching and insertion routines
-    //for more control
-    //use id sorted indexes
-    
     if(!d->init)
         return;
-    
-    QMailMessageKey passKey = d->key & QMailMessageKey(ids);
-    QMailMessageIdList results = QMailStore::instance()->queryMessages(passKey);
 
-    if(results.isEmpty())
-        return;
+    bool complete = d->isComplete();
 
-    if(results.count() > fullRefreshCutoff)
-        fullRefresh(false);
+    // Items may already have been loaded, if the page was fetched after the messages were added
+    QSet<QMailMessageId> existingIds;
+    foreach (int index, d->indexesOf(ids))
+        existingIds.insert(d->itemList.at(index).id());
 
-    if(!d->sortKey.isEmpty())
-    { 
-        foreach(const QMailMessageId &id,results)
-        {
-            LessThanFunctor lessThan(d->sortKey);
+    QList<QMailMessageListModelPrivate::Item> insertions;
+    foreach (const QMailMessageListModelPrivate::SortedId& sorted, d->query(QMailMessageKey(ids))) 
+        if (!existingIds.contains(sorted.first))
+            insertions.append(QMailMessageListModelPrivate::Item(sorted.first, sorted.second));
 
-            //if sorting the list fails, then resort to a complete refresh
-            if(lessThan.invalidatedList())
-                fullRefresh(false);
-            else
-            {
-                QList<QMailMessageListModelPrivate::Item>::iterator itr = d->lowerBound(id, lessThan);
-                int newIndex = (itr - d->itemList.begin());
+    d->insertItems(this, insertions);
 
-                beginInsertRows(QModelIndex(),newIndex,newIndex);
-                d->itemList.insert(newIndex, QMailMessageListModelPrivate::Item(id));
-                endInsertRows();
-            }
-        }
-    }
-    else
-    {
-        int index = d->itemList.count();
+    if (!complete)
+        d->synchronizeCount(this);
 
-        beginInsertRows(QModelIndex(),index,(index + results.count() - 1));
-        foreach(const QMailMessageId &id,results)
-            d->itemList.append(QMailMessageListModelPrivate::Item(id));
-        endInsertRows();
-    }
     d->needSynchronize = false;
 }
 
@@ -694,91 +953,59 @@ void QMailMessageListModel::messagesUpdated(const QMailMessageIdList& ids)
     if(d->ignoreUpdates)
         return;
 
-    //TODO change this code to use our own searching and insertion routines
-    //for more control
-    //use id sorted indexes
-
     if(!d->init)
         return;
 
-    QMailMessageKey idKey(ids);
-
-    QMailMessageIdList validIds = QMailStore::instance()->queryMessages(idKey & d->key);
-    if(validIds.count() > fullRefreshCutoff)
-    {
-        fullRefresh(false);
-        return;
+    bool complete = d->isComplete();
+
+    QList<QMailMessageListModelPrivate::SortedId> matches(d->query(QMailMessageKey(ids)));
+
+    QHash<QMailMessageId, QVariantList> matchValues;
+    foreach (const QMailMessageListModelPrivate::SortedId& sorted, matches)
+        matchValues.insert(sorted.first, sorted.second);
+
+    QSet<QMailMessageId> updatedIds(ids.toSet());
+    QSet<QMailMessageId> existingIds;
+    QSet<QMailMessageId> changedIds;
+    QHash<QMailMessageId, bool> movedIds;
+    QList<int> removals;
+
+    foreach (int index, d->indexesOf(ids)) {
+        QMailMessageListModelPrivate::Item& item(d->itemList[index]);
+        existingIds.insert(item.id());
+
+        QHash<QMailMessageId, QVariantList>::const_iterator it = matchValues.constFind(item.id());
+        if (it == matchValues.constEnd()) {
+            // This message no longer matches our key
+            removals.append(index);
+        } else if (d->inPosition(index, it.value(), updatedIds)) {
+            item.setSortValues(it.value());
+            changedIds.insert(item.id());
+        } else {
+            // Remove this item, and reinsert it at its new position
+            removals.append(index);
+            movedIds.insert(item.id(), item.isChecked());
+        }
     }
 
-    //if the key is empty the id's will be returned valid and invalid
-    if(!d->key.isEmpty())
-    {
-        QMailMessageIdList invalidIds = QMailStore::instance()->queryMessages(idKey & ~d->key);
+    d->removeItems(this, removals);
 
-        foreach(const QMailMessageId &id,invalidIds)
-        {
-            //get the index
-            int index = d->indexOf(id);
-            if(index == -1) 
-                continue;
-
-            beginRemoveRows(QModelIndex(),index,index);
-            d->itemList.removeAt(index);
-            endRemoveRows();
+    QList<QMailMessageListModelPrivate::Item> insertions;
+    foreach (const QMailMessageListModelPrivate::SortedId& sorted, matches) {
+        if (!existingIds.contains(sorted.first)) {
+            insertions.append(QMailMessageListModelPrivate::Item(sorted.first, sorted.second));
+        } else if (movedIds.contains(sorted.first)) {
+            insertions.append(QMailMessageListModelPrivate::Item(sorted.first, sorted.second, movedIds.value(sorted.first)));
         }
     }
 
-    LessThanFunctor lessThan(d->sortKey);
-
-    foreach(const QMailMessageId &id, validIds)
-    {
-        int index = d->indexOf(id);
-        if(index == -1) //insert
-        {
-            if(lessThan.invalidatedList())
-                fullRefresh(false);
-            else
-            {
-                QList<QMailMessageListModelPrivate::Item>::iterator itr = d->lowerBound(id, lessThan);
-                int newIndex = (itr - d->itemList.begin());
-
-                beginInsertRows(QModelIndex(),newIndex,newIndex);
-                d->itemList.insert(itr, QMailMessageListModelPrivate::Item(id));
-                endInsertRows();
-            }
+    d->insertItems(this, insertions);
 
-        }
-        else //update
-        {
-            if(lessThan.invalidatedList())
-                fullRefresh(false);
-            else
-            {
-                QList<QMailMessageListModelPrivate::Item>::iterator itr = d->lowerBound(id, lessThan);
-                int newIndex = (itr - d->itemList.begin());
-
-                if((newIndex == index) || (newIndex == index + 1))
-                {
-                    // This item would be inserted either immediately before or after itself
-                    QModelIndex modelIndex = createIndex(index,0);
-                    emit dataChanged(modelIndex,modelIndex);
-                }
-                else
-                {
-                    beginRemoveRows(QModelIndex(),index,index);
-                    d->itemList.removeAt(index);
-                    endRemoveRows();
+    if (!complete)
+        d->synchronizeCount(this);
 
-                    if (newIndex > index)
-                        --newIndex;
+    d->updateItems(this, changedIds);
 
-                    beginInsertRows(QModelIndex(),newIndex,newIndex);
-                    d->itemList.insert(newIndex, QMailMessageListModelPrivate::Item(id));
-                    endInsertRows();
-                }
-            }
-        }
-    }
     d->needSynchronize = false;
 }
 
@@ -793,23 +1020,14 @@ void QMailMessageListModel::messagesRemoved(const QMailMessageIdList& ids)
     if(!d->init)
         return;
 
-    QList<int> indexes;
-
-    foreach (const QMailMessageId &id, ids) {
-        int index = d->indexOf(id);
-        if (index != -1 && !indexes.contains(index))
-            indexes.append(index);
-    }
+    bool complete = d->isComplete();
 
-    if (!indexes.isEmpty()) {
-        qSort(indexes.begin(), indexes.end(), qGreater<int>());
+    QList<int> indexes(d->indexesOf(ids));
+    d->removeItems(this, indexes);
 
-        foreach (int index, indexes) {
-            beginRemoveRows(QModelIndex(), index, index);
-            d->itemList.removeAt(index);
-            endRemoveRows();
-        }
-    }
+    // Some of the removed messages may have been in the part of the list that is not loaded
+    if (!complete && (indexes.count() < ids.count()))
+        d->synchronizeCount(this);
 
     d->needSynchronize = false;
 }
@@ -830,7 +1048,8 @@ QMailMessageId QMailMessageListModel::idFromIndex(const QModelIndex& index) cons
         return QMailMessageId();
     }
 
-    return d->items()[row].id();
+    QMailMessageListModelPrivate::Item* item = d->item(row);
+    return (item ? item->id() : QMailMessageId());
 }
 
 /*!
@@ -841,8 +1060,17 @@ QMailMessageId QMailMessageListModel::idFromIndex(const QModelIndex& index) cons
 QModelIndex QMailMessageListModel::indexFromId(const QMailMessageId& id) const
 {
     if (id.isValid()) {
-        //if the id does not exist return null
+        d->initialize();
+
         int index = d->indexOf(id);
+        if ((index == -1) && !d->isComplete()) {
+            // The message may be in the part of the list that has not been loaded yet
+            QList<QMailMessageListModelPrivate::SortedId> match(d->query(QMailMessageKey(QMailMessageKey::Id, id)));
+            if (!match.isEmpty())
+                index = d->indexOf(id, match.first().second);
+        }
+
+        //if the id does not exist return null
         if(index != -1)
             return createIndex(index,0);
     }
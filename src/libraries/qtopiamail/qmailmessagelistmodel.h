@@ -81,6 +81,8 @@ private:
     void fullRefresh(bool modelChanged);
 
 private:
+    friend class QMailMessageListModelPrivate;
+
     QMailMessageListModelPrivate* d;
 };
 
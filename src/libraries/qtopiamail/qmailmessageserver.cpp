@@ -489,7 +489,10 @@ void QMailMessageServer::deleteMessages(const QMailMessageIdList& mailList)
 /*!
     Requests that the MessageServer search for messages that meet the criteria encoded
     in \a filter.  If \a bodyText is non-empty, messages must also contain the specified
-    text in their content to be considered matching.  If the content of a message is not
+    text in their content to be considered matching: each word of \a bodyText must begin
+    a word of the content, and text of more than one word must also appear in the content
+    as written.  A word matches only from its start, so \c {own} does not match
+    \c {brown}.  If the content of a message is not
     stored locally, the MessageServer may connect to the originating server to request
     a content search, if necessary.
 
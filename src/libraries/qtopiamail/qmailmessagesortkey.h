@@ -66,6 +66,7 @@ public:
 private:
     friend class QMailStore;
     friend class QMailStorePrivate;
+    friend class QMailMessageListModelPrivate;
 
     QSharedDataPointer<QMailMessageSortKeyPrivate> d;
 };
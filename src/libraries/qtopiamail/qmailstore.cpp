@@ -427,10 +427,114 @@ const QMailMessageIdList QMailStore::queryMessages(const QMailMessageKey& key,
                                                    const QMailMessageSortKey& sortKey) const
 {
     QMailMessageIdList ids;
-    repeatedly<ReadAccess>(bind(&QMailStore::attemptQueryMessages, this, cref(key), cref(sortKey), &ids), "queryMessages");
+    repeatedly<ReadAccess>(bind(&QMailStore::attemptQueryMessages, this, cref(key), cref(sortKey), -1, 0, &ids), "queryMessages");
     return ids;
 }
 
+/*!
+    \overload
+
+    Returns at most \a limit of the \l{QMailMessageId}s of messages in the message store
+    matching \a key, sorted by the parameters set by \a sortKey, skipping the first 
+    \a offset identifiers of the sorted sequence.  If \a limit is negative, all the 
+    identifiers following \a offset are returned.
+
+    This allows a large result set to be retrieved in pages.  The sequence of identifiers 
+    is only stable between calls if \a sortKey specifies a total ordering; appending 
+    a QMailMessageSortKey::Id term to \a sortKey guarantees this.
+*/
+const QMailMessageIdList QMailStore::queryMessages(const QMailMessageKey& key, 
+                                                   const QMailMessageSortKey& sortKey,
+                                                   int limit, int offset) const
+{
+    QMailMessageIdList ids;
+    repeatedly<ReadAccess>(bind(&QMailStore::attemptQueryMessages, this, cref(key), cref(sortKey), limit, offset, &ids), "queryMessages");
+    return ids;
+}
+
+/*!
+    Returns the \l{QMailMessageId}s of messages in the message store whose text content 
+    contains a word beginning with each of the words in \a text.  If \a key is not empty 
+    only messages matching the parameters set by \a key will be returned.
+
+    The lookup is performed against an index of the words in the text parts of each 
+    message body, and does not require the message bodies to be loaded.  Words shorter 
+    than two characters are not indexed, and are ignored in \a text; if \a text contains 
+    no indexable words, the result is identical to that of queryMessages().
+
+    Until isBodyIndexComplete() returns true, messages whose bodies have not been indexed 
+    yet are returned whether or not they contain \a text, and must be checked by the caller.
+
+    \sa queryMessages(), updateBodyIndex()
+*/
+const QMailMessageIdList QMailStore::queryMessageBodies(const QMailMessageKey& key, const QString& text) const
+{
+    QMailMessageIdList ids;
+    repeatedly<ReadAccess>(bind(&QMailStore::attemptQueryMessageBodies, this, cref(key), cref(text), &ids), "queryMessageBodies");
+    return ids;
+}
+
+/*!
+    Returns \c true if the bodies of all messages in the store are in the message body 
+    index, or \c false if messages added before the index was created remain to be indexed.
+
+    \sa updateBodyIndex()
+*/
+bool QMailStore::isBodyIndexComplete() const
+{
+    return (d->unindexedBodyLimit() == 0);
+}
+
+/*!
+    Returns \c true if \a text is a single word that the message body index records in 
+    full, so that the result of queryMessageBodies() for \a text needs no further checking 
+    once isBodyIndexComplete() returns true.  Returns \c false for phrases, and for words 
+    too short to be indexed or long enough to be truncated in the index.
+
+    \sa queryMessageBodies()
+*/
+bool QMailStore::isBodyIndexWord(const QString& text)
+{
+    return QMailStorePrivate::isBodyTextToken(text);
+}
+
+/*!
+    Adds the bodies of up to \a count messages that were stored before the message body 
+    index was created to the index.  Calling this repeatedly until isBodyIndexComplete() 
+    returns true populates the index without locking other clients out of the store for 
+    long.
+    Returns \c true if the operation completed successfully, \c false otherwise. 
+
+    \sa isBodyIndexComplete(), rebuildBodyIndex()
+*/
+bool QMailStore::updateBodyIndex(int count)
+{
+    return repeatedly<WriteAccess>(bind(&QMailStore::attemptUpdateBodyIndex, this, count), "updateBodyIndex");
+}
+
+/*!
+    Discards the existing message body index and rebuilds it from the message bodies 
+    in the store.
+    Returns \c true if the operation completed successfully, \c false otherwise. 
+
+    \sa updateBodyIndex(), queryMessageBodies()
+*/
+bool QMailStore::rebuildBodyIndex()
+{
+    // Index the messages in batches, so that other clients are not locked out for the duration
+    static const int BatchSize = 50;
+
+    if (!repeatedly<WriteAccess>(bind(&QMailStore::attemptClearBodyIndex, this), "clearBodyIndex"))
+        return false;
+
+    while (!isBodyIndexComplete()) {
+        if (!updateBodyIndex(BatchSize))
+            return false;
+    }
+
+    return true;
+}
+
 /*!
    Returns the QMailAcount defined by a QMailAccountId \a id from
    the store.
@@ -497,13 +601,12 @@ QMailMessage QMailStore::message(const QString& uid, const QMailAccountId& accou
 */
 QMailMessageMetaData QMailStore::messageMetaData(const QMailMessageId& id) const
 {
-    if (d->headerCache.contains(id))
-        return d->headerCache.lookup(id);
+    QMailMessageMetaData metaData(d->headerCache.lookup(id));
+    if (metaData.id().isValid())
+        return metaData;
 
     //if not in the cache, then preload the cache with the id and its most likely requested siblings
-    preloadHeaderCache(id);
-
-    return d->headerCache.lookup(id);
+    return preloadHeaderCache(id);
 }
 
 /*!
@@ -514,12 +617,13 @@ QMailMessageMetaData QMailStore::messageMetaData(const QString& uid, const QMail
     QMailMessageKey uidKey(QMailMessageKey::ServerUid,uid);
     QMailMessageKey accountKey(QMailMessageKey::ParentAccountId,accountId);
 
+    quint32 generation = d->headerCache.generation();
     QMailMessageMetaDataList results = messagesMetaData(uidKey & accountKey, QMailStorePrivate::allMessageProperties());
     if(!results.isEmpty()) {
         if (results.count() > 1)
             qLog(Messaging) << "Warning, messageMetaData by uid returned more than 1 result";
         
-        d->headerCache.insert(results.first());
+        d->headerCache.insert(results.first(), generation);
         return results.first();
     }
 
@@ -1089,6 +1193,11 @@ QMailStore::AttemptResult QMailStore::attemptAddMessage(QMailMessageMetaData *me
         insertId = QMailMessageId(d->extractValue<quint64>(query.lastInsertId()));
     }
 
+    if (!mailfile.isEmpty()) {
+        if (!d->indexMessageBody(insertId, d->pendingBodyTokens.value(mailfile)))
+            return DatabaseFailure;
+    }
+
     QMailMessageIdList ids;
     QMailFolderIdList folderIds;
     QMailAccountIdList accountIds;
@@ -1107,6 +1216,7 @@ QMailStore::AttemptResult QMailStore::attemptAddMessage(QMailMessageMetaData *me
 
     if (t.commit()) {
         metaData->setId(insertId);
+        d->pendingBodyTokens.remove(mailfile);
 
         //synchronize
         d->notifyMessagesChange(QMailStorePrivate::Added,ids);
@@ -1463,21 +1573,29 @@ QMailStore::AttemptResult QMailStore::attemptUpdateMessage(QMailMessageMetaData
             qLog(Messaging) << "Could not update mail body " << mailfile;
             return Failure;
         }
+
+        if (!d->indexMessageBody(metaData->id(), d->pendingBodyTokens.value(mailfile)))
+            return DatabaseFailure;
     }
 
     if (t.commit()) {
         // The message is now up-to-date with data store
         metaData->committed();
+        if (updateContent)
+            d->pendingBodyTokens.remove(mailfile);
 
         //update the header cache
-        if(d->headerCache.contains(metaData->id())) {
+        QMailMessageMetaData cachedMetaData(d->headerCache.lookup(metaData->id()));
+        if (cachedMetaData.id().isValid()) {
             if (updateMailfile)
                 messageValues.takeLast();
 
-            QMailMessageMetaData cachedMetaData = d->headerCache.lookup(metaData->id());
             d->updateMessageValues(updateProperties, messageValues, cachedMetaData);
             cachedMetaData.committed();
             d->headerCache.insert(cachedMetaData);
+        } else {
+            // Discard any copy loaded concurrently by another process
+            d->headerCache.remove(metaData->id());
         }
 
         //synchronize
@@ -1616,11 +1734,13 @@ QMailStore::AttemptResult QMailStore::attemptUpdateMessagesMetaData(const QMailM
         if (!modifiedMessageIds.isEmpty()) {
             //update the header cache
             foreach(const QMailMessageId& id,modifiedMessageIds) {
-                if (d->headerCache.contains(id)) {
-                    QMailMessageMetaData cachedMetaData = d->headerCache.lookup(id);
+                QMailMessageMetaData cachedMetaData(d->headerCache.lookup(id));
+                if (cachedMetaData.id().isValid()) {
                     d->updateMessageValues(properties, messageValues, cachedMetaData);
                     cachedMetaData.committed();
                     d->headerCache.insert(cachedMetaData);
+                } else {
+                    d->headerCache.remove(id);
                 }
             }
 
@@ -1675,13 +1795,15 @@ QMailStore::AttemptResult QMailStore::attemptUpdateMessagesStatus(const QMailMes
         if (!modifiedMessageIds.isEmpty()) {
             //update the header cache
             foreach (const QMailMessageId& id, modifiedMessageIds) {
-                if (d->headerCache.contains(id)) {
-                    QMailMessageMetaData cachedMetaData = d->headerCache.lookup(id);
+                QMailMessageMetaData cachedMetaData(d->headerCache.lookup(id));
+                if (cachedMetaData.id().isValid()) {
                     quint64 newStatus = cachedMetaData.status();
                     newStatus = set ? (newStatus | status) : (newStatus & ~status);
                     cachedMetaData.setStatus(newStatus);
                     cachedMetaData.committed();
                     d->headerCache.insert(cachedMetaData);
+                } else {
+                    d->headerCache.remove(id);
                 }
             }
 
@@ -1862,6 +1984,8 @@ QMailStore::AttemptResult QMailStore::attemptQueryFolders(const QMailFolderKey &
 /*! \internal */
 QMailStore::AttemptResult QMailStore::attemptQueryMessages(const QMailMessageKey &key, 
                                                            const QMailMessageSortKey &sortKey,
+                                                           int limit,
+                                                           int offset,
                                                            QMailMessageIdList *ids, 
                                                            MailStoreReadLock&) const
 {
@@ -1872,6 +1996,8 @@ QMailStore::AttemptResult QMailStore::attemptQueryMessages(const QMailMessageKey
         sql += " WHERE " + d->buildWhereClause(key);
     if (!sortKey.isEmpty())
         sql += " " + d->buildOrderClause(sortKey);
+    if ((limit >= 0) || (offset > 0))
+        sql += QString(" LIMIT %1 OFFSET %2").arg(limit).arg(offset);
 
     QSqlQuery query = d->prepare(sql);
     if (query.lastError().type() != QSqlError::NoError)
@@ -1893,6 +2019,185 @@ QMailStore::AttemptResult QMailStore::attemptQueryMessages(const QMailMessageKey
     return DatabaseFailure;
 }
 
+/*! \internal */
+QMailStore::AttemptResult QMailStore::attemptQueryMessageSortValues(const QMailMessageKey &key, 
+                                                                    const QMailMessageSortKey &sortKey,
+                                                                    int limit,
+                                                                    int offset,
+                                                                    QList<QPair<QMailMessageId, QVariantList> > *result, 
+                                                                    MailStoreReadLock&) const
+{
+    d->checkComparitors(key);
+
+    QString sql = "SELECT id";
+    if (!sortKey.isEmpty())
+        sql += "," + d->buildSortColumns(sortKey);
+    sql += " FROM mailmessages";
+    if (!key.isEmpty())
+        sql += " WHERE " + d->buildWhereClause(key);
+    if (!sortKey.isEmpty())
+        sql += " " + d->buildOrderClause(sortKey);
+    if ((limit >= 0) || (offset > 0))
+        sql += QString(" LIMIT %1 OFFSET %2").arg(limit).arg(offset);
+
+    QSqlQuery query = d->prepare(sql);
+    if (query.lastError().type() != QSqlError::NoError)
+        return DatabaseFailure;
+
+    if (!key.isEmpty())
+        d->bindWhereData(key,query);
+
+    if (d->execute(query)) {
+        result->clear();
+
+        QMailMessageIdList ids;
+        int columns = query.record().count();
+        while (query.next()) {
+            QVariantList values;
+            for (int i = 1; i < columns; ++i)
+                values.append(query.value(i));
+
+            ids.append(QMailMessageId(d->extractValue<quint64>(query.value(0))));
+            result->append(qMakePair(ids.last(), values));
+        }
+
+        //store the results of this call for cache preloading
+        d->lastQueryMessageResult = ids;
+
+        return Success;
+    }
+
+    return DatabaseFailure;
+}
+
+/*! \internal */
+QMailStore::AttemptResult QMailStore::attemptQueryMessageBodies(const QMailMessageKey &key, 
+                                                                const QString &text,
+                                                                QMailMessageIdList *ids, 
+                                                                MailStoreReadLock&) const
+{
+    d->checkComparitors(key);
+
+    // Each search word must prefix a token indexed for the message
+    QVariantList tokenValues;
+    QStringList tokenClauses;
+    foreach (const QString& token, QMailStorePrivate::bodyTextTokens(text).toSet()) {
+        tokenValues << token << QString(token + QChar(0xffff));
+        tokenClauses.append("SELECT messageid FROM mailbodytokens WHERE token BETWEEN ? AND ?");
+    }
+
+    // Messages that have not been indexed yet are candidates regardless of their content
+    quint64 unindexed = d->unindexedBodyLimit();
+
+    QStringList clauses;
+    if (!tokenClauses.isEmpty()) {
+        if (unindexed)
+            clauses.append("(id <= ? OR id IN (" + tokenClauses.join(" INTERSECT ") + "))");
+        else
+            clauses.append("id IN (" + tokenClauses.join(" INTERSECT ") + ")");
+    }
+    if (!key.isEmpty())
+        clauses.append("(" + d->buildWhereClause(key) + ")");
+
+    QString sql = "SELECT id FROM mailmessages";
+    if (!clauses.isEmpty())
+        sql += " WHERE " + clauses.join(" AND ");
+
+    QSqlQuery query = d->prepare(sql);
+    if (query.lastError().type() != QSqlError::NoError)
+        return DatabaseFailure;
+
+    if (!tokenClauses.isEmpty() && unindexed)
+        query.addBindValue(unindexed);
+    foreach (const QVariant& value, tokenValues)
+        query.addBindValue(value);
+
+    if (!key.isEmpty())
+        d->bindWhereData(key,query);
+
+    if (d->execute(query)) {
+        while (query.next())
+            ids->append(QMailMessageId(d->extractValue<quint64>(query.value(0))));
+
+        return Success;
+    }
+
+    return DatabaseFailure;
+}
+
+/*! \internal */
+QMailStore::AttemptResult QMailStore::attemptClearBodyIndex(MailStoreTransaction& t)
+{
+    {
+        QSqlQuery query(d->simpleQuery("DELETE FROM mailbodytokens", 
+                                       "clearBodyIndex delete query"));
+        if (query.lastError().type() != QSqlError::NoError)
+            return DatabaseFailure;
+    }
+
+    {
+        QSqlQuery query(d->simpleQuery("SELECT COALESCE(MAX(id), 0) FROM mailmessages", 
+                                       "clearBodyIndex max id query"));
+        if (query.lastError().type() != QSqlError::NoError || !query.first())
+            return DatabaseFailure;
+
+        if (!d->setUnindexedBodyLimit(d->extractValue<quint64>(query.value(0))))
+            return DatabaseFailure;
+    }
+
+    if (!t.commit()) {
+        qLog(Messaging) << "Could not commit body index removal to database";
+        return DatabaseFailure;
+    }
+
+    return Success;
+}
+
+/*! \internal */
+QMailStore::AttemptResult QMailStore::attemptUpdateBodyIndex(int count, MailStoreTransaction& t)
+{
+    quint64 unindexed = d->unindexedBodyLimit();
+    if (unindexed == 0)
+        return Success;
+
+    // Index the newest unindexed messages, and move the limit below them
+    QList<QPair<QMailMessageId, QString> > mailfiles;
+    int found = 0;
+    quint64 oldest = unindexed;
+
+    {
+        QSqlQuery query(d->simpleQuery("SELECT id,mailfile FROM mailmessages WHERE id<=? ORDER BY id DESC LIMIT ?",
+                                       QVariantList() << unindexed << count,
+                                       "updateBodyIndex mailfile query"));
+        if (query.lastError().type() != QSqlError::NoError)
+            return DatabaseFailure;
+
+        while (query.next()) {
+            ++found;
+            oldest = d->extractValue<quint64>(query.value(0));
+            QString mailfile(d->extractValue<QString>(query.value(1)));
+            if (!mailfile.isEmpty())
+                mailfiles.append(qMakePair(QMailMessageId(oldest), mailfile));
+        }
+    }
+
+    QList<QPair<QMailMessageId, QString> >::const_iterator it = mailfiles.begin(), end = mailfiles.end();
+    for ( ; it != end; ++it) {
+        if (!d->indexMessageBody((*it).first, (*it).second))
+            return DatabaseFailure;
+    }
+
+    if (!d->setUnindexedBodyLimit(found < count ? 0 : oldest - 1))
+        return DatabaseFailure;
+
+    if (!t.commit()) {
+        qLog(Messaging) << "Could not commit body index changes to database";
+        return DatabaseFailure;
+    }
+
+    return Success;
+}
+
 /*! \internal */
 QMailStore::AttemptResult QMailStore::attemptFolder(const QMailFolderId &id, QMailFolder *result, MailStoreReadLock&) const
 {
@@ -2170,12 +2475,14 @@ QMailStore::AttemptResult QMailStore::attemptRestoreToPreviousFolder(const QMail
         if (!modifiedMessageIds.isEmpty()) {
             //update the header cache
             foreach (const QMailMessageId &id, modifiedMessageIds) {
-                if (d->headerCache.contains(id)) {
-                    QMailMessageMetaData cachedMetaData = d->headerCache.lookup(id);
+                QMailMessageMetaData cachedMetaData(d->headerCache.lookup(id));
+                if (cachedMetaData.id().isValid()) {
                     cachedMetaData.setParentFolderId(cachedMetaData.previousParentFolderId());
                     cachedMetaData.setPreviousParentFolderId(QMailFolderId());
                     cachedMetaData.committed();
                     d->headerCache.insert(cachedMetaData);
+                } else {
+                    d->headerCache.remove(id);
                 }
             }
 
@@ -2197,7 +2504,7 @@ QMailStore::AttemptResult QMailStore::attemptRestoreToPreviousFolder(const QMail
     return DatabaseFailure;
 }
 
-void QMailStore::preloadHeaderCache(const QMailMessageId& id) const
+QMailMessageMetaData QMailStore::preloadHeaderCache(const QMailMessageId& id) const
 {
     QMailMessageIdList idBatch;
     idBatch.append(id);
@@ -2255,13 +2562,36 @@ void QMailStore::preloadHeaderCache(const QMailMessageId& id) const
 
     QMailMessageMetaData result;
     QMailMessageKey key(idBatch);
+    quint32 generation = d->headerCache.generation();
     foreach (const QMailMessageMetaData& metaData, messagesMetaData(key, QMailStorePrivate::allMessageProperties())) {
         if (metaData.id().isValid()) {
-            d->headerCache.insert(metaData);
+            d->headerCache.insert(metaData, generation);
             if (metaData.id() == id)
                 result = metaData;
         }
     }
+
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns the identifiers of the messages matching \a key, sorted by \a sortKey, each 
+    paired with the raw database values of the columns named by \a sortKey.  The \a limit 
+    and \a offset parameters select a page of the sorted sequence, as for queryMessages().
+
+    The values are intended to allow a client to locate the sorted position of a message 
+    without further queries; values are compared in the manner of SQLite: nulls first, 
+    then numeric values, then text.
+*/
+QList<QPair<QMailMessageId, QVariantList> > QMailStore::queryMessageSortValues(const QMailMessageKey& key,
+                                                                              const QMailMessageSortKey& sortKey,
+                                                                              int limit, int offset) const
+{
+    QList<QPair<QMailMessageId, QVariantList> > result;
+    repeatedly<ReadAccess>(bind(&QMailStore::attemptQueryMessageSortValues, this, cref(key), cref(sortKey), limit, offset, &result), "queryMessageSortValues");
+    return result;
 }
 
 /*! \internal */
@@ -109,6 +109,15 @@ public:
                                          const QMailFolderSortKey& sortKey = QMailFolderSortKey()) const;
     const QMailMessageIdList queryMessages(const QMailMessageKey& key = QMailMessageKey(),
                                            const QMailMessageSortKey& sortKey = QMailMessageSortKey()) const;
+    const QMailMessageIdList queryMessages(const QMailMessageKey& key,
+                                           const QMailMessageSortKey& sortKey,
+                                           int limit, int offset = 0) const;
+    const QMailMessageIdList queryMessageBodies(const QMailMessageKey& key, const QString& text) const;
+
+    bool isBodyIndexComplete() const;
+    bool updateBodyIndex(int count);
+    bool rebuildBodyIndex();
+    static bool isBodyIndexWord(const QString& text);
 
     QMailAccount account(const QMailAccountId& id) const;
 
@@ -211,7 +220,12 @@ private:
 
     AttemptResult attemptQueryAccounts(const QMailAccountKey &key, const QMailAccountSortKey &sortKey, QMailAccountIdList *ids, MailStoreReadLock&) const;
     AttemptResult attemptQueryFolders(const QMailFolderKey &key, const QMailFolderSortKey &sortKey, QMailFolderIdList *ids, MailStoreReadLock&) const;
-    AttemptResult attemptQueryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, QMailMessageIdList *ids, MailStoreReadLock&) const;
+    AttemptResult attemptQueryMessages(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, int limit, int offset, QMailMessageIdList *ids, MailStoreReadLock&) const;
+    AttemptResult attemptQueryMessageSortValues(const QMailMessageKey &key, const QMailMessageSortKey &sortKey, int limit, int offset, QList<QPair<QMailMessageId, QVariantList> > *result, MailStoreReadLock&) const;
+    AttemptResult attemptQueryMessageBodies(const QMailMessageKey &key, const QString &text, QMailMessageIdList *ids, MailStoreReadLock&) const;
+
+    AttemptResult attemptClearBodyIndex(MailStoreTransaction& t);
+    AttemptResult attemptUpdateBodyIndex(int count, MailStoreTransaction& t);
 
     AttemptResult attemptAccount(const QMailAccountId &id, QMailAccount *result, MailStoreReadLock&) const;
     AttemptResult attemptFolder(const QMailFolderId &id, QMailFolder *result, MailStoreReadLock&) const;
@@ -241,12 +255,17 @@ private:
     AttemptResult attemptStatusBit(const QString &name, const QString &context, int *result, MailStoreReadLock&) const;
     AttemptResult attemptRegisterStatusBit(const QString &name, const QString &context, int maximum, MailStoreTransaction& t);
 
-    void preloadHeaderCache(const QMailMessageId& id) const;
+    QMailMessageMetaData preloadHeaderCache(const QMailMessageId& id) const;
+
+    QList<QPair<QMailMessageId, QVariantList> > queryMessageSortValues(const QMailMessageKey& key,
+                                                                      const QMailMessageSortKey& sortKey,
+                                                                      int limit = -1, int offset = 0) const;
 
     quint64 queryStatusMap(const QString &name, const QString &context, QMap<QString, quint64> &map) const;
 
 private:
     friend class QMailStorePrivate;
+    friend class QMailMessageListModelPrivate;
 
     QMailStorePrivate* d;
 };
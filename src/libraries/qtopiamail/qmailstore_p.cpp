@@ -1338,6 +1338,14 @@ QMailStorePrivate::QMailStorePrivate(QMailStore* parent)
     mutex = new ProcessMutex(databaseIdentifier(1));
     readLock = new ProcessReadLock(databaseIdentifier(2));
 
+    // Share message meta data with the other mail store users
+    QSettings settings("Trolltech", "qtopiamail");
+    int sharedCacheSize = settings.value("MetaDataCache/Size", sharedHeaderCacheSize).toInt();
+    if (sharedCacheSize > 0) {
+        if (!headerCache.attach(databaseIdentifier(3), databaseIdentifier(4), sharedCacheSize * 1024))
+            qLog(Messaging) << "Unable to attach shared message cache, using private cache";
+    }
+
     MutexGuard guard(databaseMutex());
     if (guard.lock(1000)) {
         if (settingsMutex == 0) {
@@ -1768,6 +1776,15 @@ QString QMailStorePrivate::buildOrderClause(const QMailMessageSortKey& key) cons
     return ::buildOrderClause(key.d->arguments);
 }
 
+QString QMailStorePrivate::buildSortColumns(const QMailMessageSortKey& key) const
+{
+    QStringList columns;
+    foreach (const QMailMessageSortKeyPrivate::Argument& arg, key.d->arguments)
+        columns.append(fieldName(arg.first));
+
+    return columns.join(",");
+}
+
 QString QMailStorePrivate::buildWhereClause(const QMailAccountKey& key) const
 {
     return ::buildWhereClause<QMailAccountKeyPrivate>(key, key.d->combiner, key.d->arguments, key.d->subKeys, key.d->negated, *this);
@@ -2216,13 +2233,17 @@ void QMailStorePrivate::initStore()
             return;
         }
 
+        // Messages already in the store are not indexed when the body index is created
+        bool bodyIndexExists = database.tables().contains("mailbodytokens", Qt::CaseInsensitive);
+
         if (!ensureVersionInfo() ||
             !setupTables(QList<TableInfo>() << tableInfo("mailaccounts", 100)
                                             << tableInfo("mailfolders", 101)
                                             << tableInfo("mailfolderlinks", 100)
                                             << tableInfo("mailmessages", 100)
                                             << tableInfo("mailstatusflags", 100)
-                                            << tableInfo("deletedmessages", 100)) ||
+                                            << tableInfo("deletedmessages", 100)
+                                            << tableInfo("mailbodytokens", 100)) ||
             !setupFolders(QList<FolderInfo>() << folderInfo(QMailFolder::InboxFolder, tr("Inbox"))
                                                 << folderInfo(QMailFolder::OutboxFolder, tr("Outbox"))
                                                 << folderInfo(QMailFolder::DraftsFolder, tr("Drafts"))
@@ -2230,6 +2251,16 @@ void QMailStorePrivate::initStore()
                                                 << folderInfo(QMailFolder::TrashFolder, tr("Trash")))) {
             return;
         }
+
+        if (!bodyIndexExists) {
+            QSqlQuery query(simpleQuery("SELECT COALESCE(MAX(id), 0) FROM mailmessages",
+                                        "initStore max id query"));
+            if (query.lastError().type() != QSqlError::NoError || !query.first())
+                return;
+
+            if (!setUnindexedBodyLimit(extractValue<quint64>(query.value(0))))
+                return;
+        }
     }
 
     {
@@ -2332,6 +2363,30 @@ bool QMailStorePrivate::setTableVersion(const QString &name, qint64 version)
     return true;
 }
 
+/*
+    Returns the identifier of the newest message whose body may not yet be
+    in the body index, or zero if every message body is indexed.
+*/
+quint64 QMailStorePrivate::unindexedBodyLimit() const
+{
+    return static_cast<quint64>(tableVersion("mailbodytokens_unindexed"));
+}
+
+bool QMailStorePrivate::setUnindexedBodyLimit(quint64 id)
+{
+    QString sql("DELETE FROM versioninfo WHERE tableName=?");
+
+    QSqlQuery query(database);
+    query.prepare(sql);
+    query.addBindValue(QString("mailbodytokens_unindexed"));
+    if (!query.exec()) {
+        qLog(Messaging) << "Failed to delete versioninfo - query:" << sql << "- error:" << query.lastError().text();
+        return false;
+    }
+
+    return (id == 0) || setTableVersion("mailbodytokens_unindexed", static_cast<qint64>(id));
+}
+
 bool QMailStorePrivate::createTable(const QString &name)
 {
     bool result = true;
@@ -2901,8 +2956,9 @@ bool QMailStorePrivate::emitIpcNotification()
 
         void (QMailStore::*sig)(const QMailMessageIdList&) = mit.value();
         if ((sig == &QMailStore::messagesUpdated) || (sig == &QMailStore::messagesRemoved)) {
+            // The sender has already updated the shared cache
             foreach (const QMailMessageId &id, ids)
-                headerCache.remove(id);
+                headerCache.removeLocal(id);
         }
 
         asyncEmission = true;
@@ -3012,6 +3068,8 @@ bool QMailStorePrivate::saveMessageBody(const QMailMessage& m, const QString& fi
         return false;
     }
 
+    // The tokens are written to the index when the file is associated with a message
+    pendingBodyTokens.insert(fileName, messageBodyTokens(m));
     return true;
 }
 
@@ -3026,6 +3084,9 @@ bool QMailStorePrivate::removeMessageBody(const QString& fileName)
         return false;
     } 
 
+    // Any index entries for this file are removed along with its message record
+    pendingBodyTokens.remove(fileName);
+
     bool result = false;
     if (QFile::exists(filePath))
         result = QFile::remove(filePath);
@@ -3053,6 +3114,8 @@ bool QMailStorePrivate::updateMessageBody(const QString& fileName, QMailMessage*
         }
     }
 
+    pendingBodyTokens.insert(fileName, messageBodyTokens(*data));
+
     QString detachedFile = data->headerField("X-qtopia-internal-filename").content();
     if (!detachedFile.isEmpty()) {
         data->removeHeaderField("X-qtopia-internal-filename");
@@ -3138,6 +3201,106 @@ bool QMailStorePrivate::loadMessageBody(const QString& fileName, QMailMessage* o
     return true;
 }
 
+QStringList QMailStorePrivate::bodyTextTokens(const QString& text)
+{
+    // Tokens are stored lowercased, and truncated so that long words do not bloat
+    // the index; matching is performed on token prefixes, so truncation is harmless
+    QStringList tokens;
+
+    const QChar *it = text.constData();
+    const QChar *end = it + text.length();
+    while (it != end) {
+        while ((it != end) && !it->isLetterOrNumber())
+            ++it;
+
+        const QChar *begin = it;
+        while ((it != end) && it->isLetterOrNumber())
+            ++it;
+
+        int length = (it - begin);
+        if (length >= MinimumTokenLength)
+            tokens.append(QString(begin, qMin<int>(length, MaximumTokenLength)).toLower());
+    }
+
+    return tokens;
+}
+
+bool QMailStorePrivate::isBodyTextToken(const QString& text)
+{
+    // A word longer than the maximum is truncated when indexed, so the index can
+    // only tell that it may occur; the message content must confirm it
+    if ((text.length() < MinimumTokenLength) || (text.length() > MaximumTokenLength))
+        return false;
+
+    foreach (const QChar &c, text)
+        if (!c.isLetterOrNumber())
+            return false;
+
+    return true;
+}
+
+static void addBodyTokens(const QMailMessagePartContainer& container, QSet<QString>& tokens)
+{
+    // Index only messages or message parts that are of type 'text/*'; parts may
+    // be nested, as in multipart/alternative within multipart/mixed
+    if (container.hasBody()) {
+        if (container.contentType().type().toLower() == "text")
+            tokens += QMailStorePrivate::bodyTextTokens(container.body().data()).toSet();
+    } else if (container.multipartType() != QMailMessage::MultipartNone) {
+        for (uint i = 0; i < container.partCount(); ++i)
+            addBodyTokens(container.partAt(i), tokens);
+    }
+}
+
+QSet<QString> QMailStorePrivate::messageBodyTokens(const QMailMessage& message)
+{
+    QSet<QString> tokens;
+    addBodyTokens(message, tokens);
+    return tokens;
+}
+
+bool QMailStorePrivate::indexMessageBody(const QMailMessageId& id, const QSet<QString>& tokens)
+{
+    {
+        // Remove any tokens indexed for a previous version of the body
+        QSqlQuery query(simpleQuery("DELETE FROM mailbodytokens WHERE messageid=?",
+                                    QVariantList() << id.toULongLong(),
+                                    "indexMessageBody delete query"));
+        if (query.lastError().type() != QSqlError::NoError)
+            return false;
+    }
+
+    if (!tokens.isEmpty()) {
+        QVariantList tokenValues;
+        QVariantList idValues;
+        foreach (const QString& token, tokens) {
+            tokenValues.append(token);
+            idValues.append(id.toULongLong());
+        }
+
+        QSqlQuery query(simpleQuery("INSERT INTO mailbodytokens (token,messageid) VALUES (?,?)",
+                                    QVariantList() << QVariant(tokenValues)
+                                                   << QVariant(idValues),
+                                    "indexMessageBody insert query",
+                                    true));
+        if (query.lastError().type() != QSqlError::NoError)
+            return false;
+    }
+
+    return true;
+}
+
+bool QMailStorePrivate::indexMessageBody(const QMailMessageId& id, const QString& fileName)
+{
+    QMailMessage message;
+    if (!loadMessageBody(fileName, &message)) {
+        qLog(Messaging) << "Could not load message body for indexing" << fileName;
+        return indexMessageBody(id, QSet<QString>());
+    }
+
+    return indexMessageBody(id, messageBodyTokens(message));
+}
+
 template<typename AccountType>
 bool QMailStorePrivate::saveAccountSettings(const AccountType& account) 
 {
@@ -3374,6 +3537,16 @@ bool QMailStorePrivate::deleteMessages(const QMailMessageKey& key,
             return false;
     }
 
+    {
+        // Remove the index entries for the message bodies being expired
+        QString sql("DELETE FROM mailbodytokens WHERE messageid IN (SELECT id FROM mailmessages WHERE %1)");
+        QSqlQuery deleteTokensQuery(simpleQuery(sql.arg(buildWhereClause(key)),
+                                                whereClauseValues(key),
+                                                "deleteMessages delete mailbodytokens query"));
+        if (deleteTokensQuery.lastError().type() != QSqlError::NoError)
+            return false;
+    }
+
     {
         // Perform the message deletion
         QSqlQuery deleteMessagesQuery(simpleQuery("DELETE FROM mailmessages WHERE",
@@ -35,6 +35,7 @@
 #include <QSqlQuery>
 #include <QString>
 #include <QCache>
+#include <QSet>
 #include <QTimer>
 #include <QtopiaIpcEnvelope>
 #include "qmailfolder.h"
@@ -42,6 +43,7 @@
 #include "qmailmessagekey.h"
 #include "qmailmessagesortkey.h"
 #include "qmailstore.h"
+#include "sharedmetadatacache_p.h"
 
 #include "qtopialog.h"
 
@@ -119,6 +121,7 @@ class QMailStorePrivate : public QObject
 
 public:
     static const int headerCacheSize = 100;
+    static const int sharedHeaderCacheSize = 512; // KB
     static const int folderCacheSize = 10;
     static const int accountCacheSize = 10;
     static const int lookAhead = 5;
@@ -190,6 +193,8 @@ public:
     QString buildOrderClause(const QMailFolderSortKey& key) const;
     QString buildOrderClause(const QMailMessageSortKey& key) const;
 
+    QString buildSortColumns(const QMailMessageSortKey& key) const;
+
     bool containsProperty(const QMailMessageKey::Property& p,
                           const QMailMessageKey& key) const;
     bool containsProperty(const QMailMessageSortKey::Property& p,
@@ -232,6 +237,18 @@ public:
     bool updateMessageBody(const QString& fileName, QMailMessage* data);
     bool loadMessageBody(const QString& fileName, QMailMessage* out) const;
 
+    enum { MinimumTokenLength = 2, MaximumTokenLength = 32 };
+
+    static QStringList bodyTextTokens(const QString& text);
+    static bool isBodyTextToken(const QString& text);
+    static QSet<QString> messageBodyTokens(const QMailMessage& message);
+
+    bool indexMessageBody(const QMailMessageId& id, const QSet<QString>& tokens);
+    bool indexMessageBody(const QMailMessageId& id, const QString& fileName);
+
+    quint64 unindexedBodyLimit() const;
+    bool setUnindexedBodyLimit(quint64 id);
+
     template<typename AccountType>
     static bool saveAccountSettings(const AccountType& account);
 
@@ -316,7 +333,6 @@ private:
     bool ensureVersionInfo();
     qint64 tableVersion(const QString &name) const;
     bool setTableVersion(const QString &name, qint64 version);
-
     bool createTable(const QString &name);
 
     typedef QPair<QString, qint64> TableInfo;
@@ -363,7 +379,7 @@ public:
     mutable QSqlDatabase database;
     
     mutable QMailMessageIdList lastQueryMessageResult;
-    mutable MailStoreCache<QMailMessageMetaData, QMailMessageId> headerCache;
+    mutable SharedMetaDataCache headerCache;
     mutable MailStoreCache<QMailFolder, QMailFolderId> folderCache;
     mutable MailStoreCache<QMailAccount, QMailAccountId> accountCache;
     mutable QList<const QMailMessageKey*> requiredTableKeys;
@@ -397,6 +413,10 @@ public:
 
     QTimer queueTimer;
     QList <QPair<QString, QByteArray> > messageQueue;
+
+    // Body tokens extracted by saveMessageBody/updateMessageBody, awaiting the
+    // transaction that associates the body file with a message
+    QMap<QString, QSet<QString> > pendingBodyTokens;
 };
 
 template <typename ValueType>
@@ -0,0 +1,7 @@
+CREATE TABLE mailbodytokens (
+    token VARCHAR NOT NULL,
+    messageid INTEGER NOT NULL,
+    PRIMARY KEY(token, messageid),
+    FOREIGN KEY (messageid) REFERENCES mailmessages(id));
+
+CREATE INDEX messageid_idx ON mailbodytokens("messageid");
@@ -0,0 +1,497 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+#include "sharedmetadatacache_p.h"
+#include "semaphore_p.h"
+
+#include <qmallocpool.h>
+#include <qtopialog.h>
+#include <QDataStream>
+#include <QHash>
+
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+namespace {
+
+enum {
+    CacheMagic = 0x514d4443, // 'QMDC'
+    CacheVersion = 1,
+    BucketCount = 509,
+    LockTimeout = 1000
+};
+
+}
+
+struct SharedMetaDataCacheHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint64 base;           // The address the creator mapped the segment at
+    quint32 size;
+    quint32 busy;           // Set while the cache is locked, if found set the holder died
+    quint32 generation;     // Incremented whenever an entry is updated or removed
+    quint32 count;
+    quint32 mostRecent;
+    quint32 leastRecent;
+    quint32 buckets[BucketCount];
+};
+
+struct SharedMetaDataCacheEntry
+{
+    quint64 id;
+    quint32 next;
+    quint32 moreRecent;
+    quint32 lessRecent;
+    quint32 removed;        // Set by processes which can't release the entry themselves
+    quint32 length;
+    quint32 reserved;
+    // Followed by 'length' bytes of serialized meta data
+};
+
+static const unsigned int poolOffset = (sizeof(SharedMetaDataCacheHeader) + 15) & ~15;
+
+
+SharedMetaDataCache::SharedMetaDataCache(unsigned int localSize)
+    : mLocal(localSize),
+      mMutex(0),
+      mPool(0),
+      mShmId(-1),
+      mSegment(0),
+      mHeader(0),
+      mWritable(false)
+{
+}
+
+SharedMetaDataCache::~SharedMetaDataCache()
+{
+    delete mPool;
+
+    if (mSegment) {
+        // Detach under the lock so that no process attaches between the last
+        // detach and the removal of the segment
+        bool locked = mMutex->lock(LockTimeout);
+
+        ::shmdt(mSegment);
+
+        struct shmid_ds info;
+        if (locked && (::shmctl(mShmId, IPC_STAT, &info) == 0) && (info.shm_nattch == 0))
+            ::shmctl(mShmId, IPC_RMID, 0);
+
+        if (locked)
+            mMutex->unlock();
+    }
+
+    delete mMutex;
+}
+
+/*
+    Attaches to the shared cache segment identified by \a segmentId, creating it with
+    \a size bytes if it doesn't exist yet.  Access to the segment is serialized by the
+    process mutex identified by \a mutexId.
+
+    Returns false if the cache will only be local to this process.
+*/
+bool SharedMetaDataCache::attach(int mutexId, int segmentId, unsigned int size)
+{
+    if (mSegment)
+        return true;
+
+    if (size < poolOffset + 4096)
+        return false;
+
+    mMutex = new ProcessMutex(mutexId);
+
+    // Creation is performed under the lock so no-one sees a partially initialized segment
+    if (!mMutex->lock(LockTimeout)) {
+        qLog(Messaging) << "SharedMetaDataCache: Unable to lock cache mutex";
+        return false;
+    }
+
+    bool created = false;
+
+    int shmId = ::shmget(segmentId, 0, 0);
+    if (shmId == -1 && errno == ENOENT) {
+        shmId = ::shmget(segmentId, size, IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
+        created = (shmId != -1);
+    }
+
+    void *address = (shmId != -1) ? ::shmat(shmId, 0, 0) : (void *)-1;
+    if (address == (void *)-1) {
+        qLog(Messaging) << "SharedMetaDataCache: Unable to attach cache segment:" << ::strerror(errno);
+        mMutex->unlock();
+        return false;
+    }
+
+    SharedMetaDataCacheHeader *header = reinterpret_cast<SharedMetaDataCacheHeader *>(address);
+
+    if (created) {
+        ::memset(header, 0, sizeof(SharedMetaDataCacheHeader));
+        header->magic = CacheMagic;
+        header->version = CacheVersion;
+        header->base = reinterpret_cast<quintptr>(address);
+        header->size = size;
+    } else if (header->magic != CacheMagic || header->version != CacheVersion) {
+        qLog(Messaging) << "SharedMetaDataCache: Incompatible cache segment";
+        ::shmdt(address);
+        mMutex->unlock();
+        return false;
+    } else if (header->base != reinterpret_cast<quintptr>(address)) {
+        // Try to map the segment where the pool bookkeeping expects it to be
+        void *fixed = ::shmat(shmId, reinterpret_cast<void *>(header->base), 0);
+        if (fixed != (void *)-1) {
+            ::shmdt(address);
+            address = fixed;
+            header = reinterpret_cast<SharedMetaDataCacheHeader *>(address);
+        }
+    }
+
+    mShmId = shmId;
+    mSegment = reinterpret_cast<char *>(address);
+    mHeader = header;
+    mWritable = (mHeader->base == reinterpret_cast<quintptr>(address));
+
+    if (mWritable) {
+        mPool = new QMallocPool(mSegment + poolOffset, mHeader->size - poolOffset,
+                                created ? QMallocPool::NewShared : QMallocPool::Shared,
+                                QLatin1String("SharedMetaDataCache"));
+    } else {
+        qLog(Messaging) << "SharedMetaDataCache: Unable to map cache segment at" << (void *)mHeader->base << "- new entries will not be shared";
+    }
+
+    mMutex->unlock();
+
+    return true;
+}
+
+bool SharedMetaDataCache::isShared() const
+{
+    return (mHeader != 0);
+}
+
+QMailMessageMetaData SharedMetaDataCache::lookup(const QMailMessageId& id) const
+{
+    if (!id.isValid())
+        return QMailMessageMetaData();
+
+    if (mHeader && lock()) {
+        if (SharedMetaDataCacheEntry *cached = find(id.toULongLong())) {
+            touch(cached);
+
+            // Copy the data out, it may be released as soon as we unlock
+            QByteArray data(reinterpret_cast<const char *>(cached + 1), cached->length);
+            unlock();
+
+            QMailMessageMetaData metaData;
+            QDataStream ds(data);
+            ds >> metaData;
+            return metaData;
+        }
+
+        unlock();
+    }
+
+    if (QMailMessageMetaData *cached = mLocal.object(id.toULongLong()))
+        return *cached;
+
+    return QMailMessageMetaData();
+}
+
+bool SharedMetaDataCache::contains(const QMailMessageId& id) const
+{
+    if (!id.isValid())
+        return false;
+
+    if (mHeader && lock()) {
+        bool found = (find(id.toULongLong()) != 0);
+        unlock();
+
+        if (found)
+            return true;
+    }
+
+    return mLocal.contains(id.toULongLong());
+}
+
+/*
+    Inserts \a item into the cache, replacing any existing entry.  This should be used to
+    record changes made to the store, any entries loaded concurrently by other processes
+    will be discarded.
+*/
+void SharedMetaDataCache::insert(const QMailMessageMetaData& item)
+{
+    store(item, 0);
+}
+
+/*
+    Inserts \a item into the cache if no entry has been updated or removed since the
+    cache was at \a generation.  This should be used to cache data loaded from the store,
+    where the \a generation is taken before the data is loaded, so that data made stale
+    by a concurrent change is not cached.
+*/
+void SharedMetaDataCache::insert(const QMailMessageMetaData& item, quint32 generation)
+{
+    store(item, &generation);
+}
+
+void SharedMetaDataCache::remove(const QMailMessageId& id)
+{
+    quint64 key(id.toULongLong());
+
+    mLocal.remove(key);
+
+    if (mHeader) {
+        if (lock()) {
+            if (SharedMetaDataCacheEntry *cached = find(key)) {
+                if (mWritable)
+                    release(cached);
+                else
+                    cached->removed = 1;
+            }
+
+            ++mHeader->generation;
+            unlock();
+        } else {
+            qLog(Messaging) << "SharedMetaDataCache: Unable to remove" << key;
+        }
+    }
+}
+
+/*
+    Removes any entry for \a id from the private cache of this process only.  This should
+    be used when another process reports a change to the store, as that process has
+    already updated or removed the shared entry.
+*/
+void SharedMetaDataCache::removeLocal(const QMailMessageId& id)
+{
+    mLocal.remove(id.toULongLong());
+}
+
+quint32 SharedMetaDataCache::generation() const
+{
+    return (mHeader ? mHeader->generation : 0);
+}
+
+bool SharedMetaDataCache::lock() const
+{
+    if (!mMutex->lock(LockTimeout))
+        return false;
+
+    if (mHeader->busy) {
+        // A process died while modifying the cache; the content can no longer be trusted
+        if (!mWritable) {
+            mMutex->unlock();
+            return false;
+        }
+
+        reset();
+    }
+
+    mHeader->busy = 1;
+    return true;
+}
+
+void SharedMetaDataCache::unlock() const
+{
+    mHeader->busy = 0;
+    mMutex->unlock();
+}
+
+void SharedMetaDataCache::store(const QMailMessageMetaData& item, const quint32 *generation)
+{
+    if (!item.id().isValid())
+        return;
+
+    quint64 key(item.id().toULongLong());
+
+    QByteArray data;
+    {
+        QDataStream ds(&data, QIODevice::WriteOnly);
+        ds << item;
+    }
+
+    if (!mHeader) {
+        mLocal.insert(key, new QMailMessageMetaData(item));
+        return;
+    }
+
+    if (!lock())
+        return;
+
+    if (generation && (*generation != mHeader->generation)) {
+        // The store has changed since the item was loaded
+        unlock();
+        return;
+    }
+
+    if (SharedMetaDataCacheEntry *cached = find(key)) {
+        if (mWritable)
+            release(cached);
+        else
+            cached->removed = 1;
+    }
+
+    if (!generation)
+        ++mHeader->generation;
+
+    if (!mWritable) {
+        unlock();
+
+        mLocal.insert(key, new QMailMessageMetaData(item));
+        return;
+    }
+
+    const unsigned int length = sizeof(SharedMetaDataCacheEntry) + data.length();
+
+    void *memory = 0;
+    while ((memory = mPool->malloc(length)) == 0) {
+        // Evict the least recently used entries until there is room
+        SharedMetaDataCacheEntry *last = entry(mHeader->leastRecent);
+        if (!last)
+            break;
+
+        release(last);
+    }
+
+    if (memory) {
+        SharedMetaDataCacheEntry *cached = reinterpret_cast<SharedMetaDataCacheEntry *>(memory);
+        ::memset(cached, 0, sizeof(SharedMetaDataCacheEntry));
+        cached->id = key;
+        cached->length = data.length();
+        ::memcpy(cached + 1, data.constData(), data.length());
+
+        quint32 *head = bucket(key);
+        cached->next = *head;
+        *head = offset(cached);
+
+        touch(cached);
+        ++mHeader->count;
+    }
+
+    unlock();
+}
+
+SharedMetaDataCacheEntry *SharedMetaDataCache::entry(quint32 offset) const
+{
+    return (offset ? reinterpret_cast<SharedMetaDataCacheEntry *>(mSegment + offset) : 0);
+}
+
+quint32 SharedMetaDataCache::offset(const SharedMetaDataCacheEntry *entry) const
+{
+    return (entry ? reinterpret_cast<const char *>(entry) - mSegment : 0);
+}
+
+quint32 *SharedMetaDataCache::bucket(quint64 id) const
+{
+    return &mHeader->buckets[qHash(id) % BucketCount];
+}
+
+SharedMetaDataCacheEntry *SharedMetaDataCache::find(quint64 id) const
+{
+    for (quint32 *link = bucket(id); *link; ) {
+        SharedMetaDataCacheEntry *cached = entry(*link);
+
+        if (cached->removed) {
+            if (mWritable) {
+                // Release entries removed by processes that couldn't release them
+                *link = cached->next;
+                unlinkRecent(cached);
+                mPool->free(cached);
+                --mHeader->count;
+                continue;
+            }
+        } else if (cached->id == id) {
+            return cached;
+        }
+
+        link = &cached->next;
+    }
+
+    return 0;
+}
+
+void SharedMetaDataCache::touch(SharedMetaDataCacheEntry *cached) const
+{
+    quint32 position = offset(cached);
+    if (mHeader->mostRecent == position)
+        return;
+
+    if (cached->moreRecent || cached->lessRecent || mHeader->leastRecent == position)
+        unlinkRecent(cached);
+
+    cached->moreRecent = 0;
+    cached->lessRecent = mHeader->mostRecent;
+
+    if (mHeader->mostRecent)
+        entry(mHeader->mostRecent)->moreRecent = position;
+    else
+        mHeader->leastRecent = position;
+
+    mHeader->mostRecent = position;
+}
+
+void SharedMetaDataCache::unlinkRecent(SharedMetaDataCacheEntry *cached) const
+{
+    if (cached->moreRecent)
+        entry(cached->moreRecent)->lessRecent = cached->lessRecent;
+    else
+        mHeader->mostRecent = cached->lessRecent;
+
+    if (cached->lessRecent)
+        entry(cached->lessRecent)->moreRecent = cached->moreRecent;
+    else
+        mHeader->leastRecent = cached->moreRecent;
+
+    cached->moreRecent = 0;
+    cached->lessRecent = 0;
+}
+
+void SharedMetaDataCache::release(SharedMetaDataCacheEntry *cached) const
+{
+    quint32 position = offset(cached);
+
+    for (quint32 *link = bucket(cached->id); *link; link = &entry(*link)->next) {
+        if (*link == position) {
+            *link = cached->next;
+            break;
+        }
+    }
+
+    unlinkRecent(cached);
+    mPool->free(cached);
+    --mHeader->count;
+}
+
+void SharedMetaDataCache::reset() const
+{
+    qLog(Messaging) << "SharedMetaDataCache: Resetting cache abandoned by a failed process";
+
+    ::memset(mHeader->buckets, 0, sizeof(mHeader->buckets));
+    mHeader->count = 0;
+    mHeader->mostRecent = 0;
+    mHeader->leastRecent = 0;
+    ++mHeader->generation;
+
+    delete mPool;
+    mPool = new QMallocPool(mSegment + poolOffset, mHeader->size - poolOffset,
+                            QMallocPool::NewShared, QLatin1String("SharedMetaDataCache"));
+}
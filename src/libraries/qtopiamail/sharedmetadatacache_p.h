@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+#ifndef SHAREDMETADATACACHE_P_H
+#define SHAREDMETADATACACHE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Extended API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qmailmessage.h"
+#include <QCache>
+
+class ProcessMutex;
+class QMallocPool;
+struct SharedMetaDataCacheHeader;
+struct SharedMetaDataCacheEntry;
+
+// A cache of message meta data shared between all users of the qtopiamail library.
+// The cache is held in a SysV shared memory segment managed by a shared QMallocPool,
+// entries are referenced by their offset into the segment and evicted in least
+// recently used order when the segment is full.  As the pool bookkeeping contains
+// absolute pointers, only processes able to map the segment at the address of its
+// creator may add entries; other processes read from the segment and keep their
+// own entries in a private cache.  The segment is removed when the last process
+// using it detaches.
+class SharedMetaDataCache
+{
+public:
+    SharedMetaDataCache(unsigned int localSize);
+    ~SharedMetaDataCache();
+
+    bool attach(int mutexId, int segmentId, unsigned int size);
+    bool isShared() const;
+
+    QMailMessageMetaData lookup(const QMailMessageId& id) const;
+    bool contains(const QMailMessageId& id) const;
+    void insert(const QMailMessageMetaData& item);
+    void insert(const QMailMessageMetaData& item, quint32 generation);
+    void remove(const QMailMessageId& id);
+    void removeLocal(const QMailMessageId& id);
+
+    quint32 generation() const;
+
+private:
+    Q_DISABLE_COPY(SharedMetaDataCache)
+
+    bool lock() const;
+    void unlock() const;
+
+    void store(const QMailMessageMetaData& item, const quint32 *generation);
+
+    SharedMetaDataCacheEntry *entry(quint32 offset) const;
+    quint32 offset(const SharedMetaDataCacheEntry *entry) const;
+    quint32 *bucket(quint64 id) const;
+
+    SharedMetaDataCacheEntry *find(quint64 id) const;
+    void touch(SharedMetaDataCacheEntry *entry) const;
+    void unlinkRecent(SharedMetaDataCacheEntry *entry) const;
+    void release(SharedMetaDataCacheEntry *entry) const;
+    void reset() const;
+
+    mutable QCache<quint64, QMailMessageMetaData> mLocal;
+    ProcessMutex *mMutex;
+    mutable QMallocPool *mPool;
+    int mShmId;
+    char *mSegment;
+    SharedMetaDataCacheHeader *mHeader;
+    bool mWritable;
+};
+
+#endif
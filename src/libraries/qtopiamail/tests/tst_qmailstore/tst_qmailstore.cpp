@@ -28,6 +28,7 @@
 #undef private
 #include <QMailStore>
 #include <QMailFolder>
+#include <QMailMessage>
 
 
 //TESTED_CLASS=QMailStore
@@ -58,6 +59,7 @@ private slots:
     void removeMessage();
     void queryFolders();
     void queryMessages();
+    void queryMessageBodies();
     void countFolders();
     void countMessages();
     void folder();
@@ -94,6 +96,7 @@ void tst_QMailStore::cleanup()
     QSqlQuery sql(db);
     sql.exec("DELETE * FROM mailfolders");
     sql.exec("DELETE * FROM mailmessages");
+    sql.exec("DELETE * FROM mailbodytokens");
 
     //delete all mail files
 
@@ -251,7 +254,88 @@ void tst_QMailStore::queryFolders()
 
 void tst_QMailStore::queryMessages()
 {
+    QMailFolderId inboxId(QMailFolder::InboxFolder);
+    QMailMessageKey inboxKey(QMailMessageKey::ParentFolderId, inboxId);
+    QMailMessageSortKey subjectKey(QMailMessageSortKey::Subject, Qt::DescendingOrder);
+
+    QMailMessageIdList ids;
+    foreach (const QString& subject, QStringList() << "b" << "d" << "a" << "e" << "c") {
+        QMailMessage message;
+        message.setParentFolderId(inboxId);
+        message.setSubject(subject);
+        QVERIFY(QMailStore::instance()->addMessage(&message));
+        ids.append(message.id());
+    }
+
+    QMailMessageIdList sorted(QMailStore::instance()->queryMessages(inboxKey, subjectKey));
+    QCOMPARE(sorted, QMailMessageIdList() << ids[3] << ids[1] << ids[4] << ids[0] << ids[2]);
+
+    //pages of the sorted sequence can be retrieved separately
+
+    QCOMPARE(QMailStore::instance()->queryMessages(inboxKey, subjectKey, 2), sorted.mid(0, 2));
+    QCOMPARE(QMailStore::instance()->queryMessages(inboxKey, subjectKey, 2, 2), sorted.mid(2, 2));
+    QCOMPARE(QMailStore::instance()->queryMessages(inboxKey, subjectKey, 2, 4), sorted.mid(4));
+    QCOMPARE(QMailStore::instance()->queryMessages(inboxKey, subjectKey, -1, 1), sorted.mid(1));
+    QCOMPARE(QMailStore::instance()->queryMessages(inboxKey, subjectKey, 2, 5), QMailMessageIdList());
+}
+
+void tst_QMailStore::queryMessageBodies()
+{
+    QMailFolderId inboxId(QMailFolder::InboxFolder);
+    QMailMessageKey inboxKey(QMailMessageKey::ParentFolderId, inboxId);
+
+    QMailMessage message1;
+    message1.setParentFolderId(inboxId);
+    message1.setBody(QMailMessageBody::fromData(QString("The quick brown fox"), QMailMessageContentType("text/plain"), QMailMessageBody::Base64));
+    QVERIFY(QMailStore::instance()->addMessage(&message1));
+
+    QMailMessage message2;
+    message2.setParentFolderId(inboxId);
+    message2.setBody(QMailMessageBody::fromData(QString("Jumped over the lazy dog"), QMailMessageContentType("text/plain"), QMailMessageBody::Base64));
+    QVERIFY(QMailStore::instance()->addMessage(&message2));
+
+    //whole words and word prefixes are matched, without regard to case
+
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(inboxKey, "fox"), QMailMessageIdList() << message1.id());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(inboxKey, "LAZ"), QMailMessageIdList() << message2.id());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(inboxKey, "the").count(), 2);
+
+    //every word must be matched
+
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(inboxKey, "quick dog"), QMailMessageIdList());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(inboxKey, "brown quick"), QMailMessageIdList() << message1.id());
+
+    //updated content is reindexed
+
+    message1.setBody(QMailMessageBody::fromData(QString("A slow grey wolf"), QMailMessageContentType("text/plain"), QMailMessageBody::Base64));
+    QVERIFY(QMailStore::instance()->updateMessage(&message1));
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(inboxKey, "fox"), QMailMessageIdList());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(inboxKey, "wolf"), QMailMessageIdList() << message1.id());
+
+    //removed messages are pruned from the index, and rebuilding restores the remainder
+
+    QVERIFY(QMailStore::instance()->removeMessage(message2.id()));
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(QMailMessageKey(), "lazy"), QMailMessageIdList());
+
+    QVERIFY(QMailStore::instance()->rebuildBodyIndex());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(QMailMessageKey(), "grey"), QMailMessageIdList() << message1.id());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(QMailMessageKey(), "dog"), QMailMessageIdList());
+    QVERIFY(QMailStore::instance()->isBodyIndexComplete());
+
+    //messages stored before the index existed are returned until they are indexed
+
+    QSqlDatabase db = QtopiaSql::instance()->applicationSpecificDatabase("qtopiamail");
+    QSqlQuery sql(db);
+    QVERIFY(sql.exec("DELETE FROM mailbodytokens"));
+    QVERIFY(sql.exec(QString("INSERT INTO versioninfo (tableName,versionNum,lastUpdated) VALUES ('mailbodytokens_unindexed',%1,'')").arg(message1.id().toULongLong())));
+
+    QVERIFY(!QMailStore::instance()->isBodyIndexComplete());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(QMailMessageKey(), "dog"), QMailMessageIdList() << message1.id());
 
+    QVERIFY(QMailStore::instance()->updateBodyIndex(10));
+    QVERIFY(QMailStore::instance()->isBodyIndexComplete());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(QMailMessageKey(), "dog"), QMailMessageIdList());
+    QCOMPARE(QMailStore::instance()->queryMessageBodies(QMailMessageKey(), "grey"), QMailMessageIdList() << message1.id());
 }
 
 void tst_QMailStore::countFolders()
@@ -55,7 +55,8 @@ PRIVATE_HEADERS=\
     qtasksqlio_p.h\
     qcontactsqlio_p.h\
     qdependentcontexts_p.h\
-    qpimdependencylist_p.h
+    qpimdependencylist_p.h\
+    qphonenumberindex_p.h
 
 SOURCES=\
     qannotator.cpp\
@@ -80,6 +81,7 @@ SOURCES=\
     qpimsourcemodel.cpp\
     qpimsourcedialog.cpp\
     qphonenumber.cpp\
+    qphonenumberindex.cpp\
     qpimdelegate.cpp\
     qdependentcontexts.cpp\
     qfielddefinition.cpp\
@@ -26,6 +26,7 @@
 #include <qtopiaipcenvelope.h>
 #include "qcontactsqlio_p.h"
 #include "qannotator_p.h"
+#include "qphonenumberindex_p.h"
 #ifdef Q_OS_WIN32
 #include <process.h>
 #else
@@ -243,7 +244,7 @@ ContactSqlIO::ContactSqlIO(QObject *parent, const QString &)
             phoneQuery("SELECT phone_type, phone_number from contactphonenumbers where recid=:id"),
             insertEmailsQuery("INSERT INTO emailaddresses (recid, addr) VALUES (:i, :a)"),
             insertAddressesQuery("INSERT INTO contactaddresses (recid, addresstype, street, city, state, zip, country) VALUES (:i, :t, :s, :c, :st, :z, :co)"),
-            insertPhoneQuery("INSERT INTO contactphonenumbers (recid, phone_type, phone_number) VALUES (:i, :t, :ph)"),
+            insertPhoneQuery("INSERT INTO contactphonenumbers (recid, phone_type, phone_number, reversed_local_number) VALUES (:i, :t, :ph, :k)"),
             insertPresenceQuery("INSERT INTO contactpresence (recid, uri, status, statusstring, message, displayname, updatetime,capabilities) "
                     "SELECT :i,uri,status,statusstring,message,displayname,updatetime,capabilities FROM contactpresence WHERE uri=:u AND recid=0"),
             removeEmailsQuery("DELETE from emailaddresses WHERE recid = :i"),
@@ -431,7 +432,6 @@ void ContactSqlIO::invalidateCache()
 {
     QPimSqlIO::invalidateCache();
     contactByRowValid = false;
-    mLocalNumberCache.clear();
 }
 
 // if filtering/sorting/contacts doesn't change.
@@ -887,6 +887,15 @@ bool ContactSqlIO::updateExtraTables(uint uid, const QPimRecord &r)
     return insertExtraTables(uid, r);
 }
 
+bool ContactSqlIO::rollback()
+{
+    // The phone number index was updated as the rows were written; have it
+    // reload the affected buckets from the restored table.
+    bool result = QPimSqlIO::rollback();
+    QPhoneNumberIndex::instance()->invalidate();
+    return result;
+}
+
 bool ContactSqlIO::removeExtraTables(uint uid)
 {
     removeEmailsQuery.prepare();
@@ -907,6 +916,7 @@ bool ContactSqlIO::removeExtraTables(uint uid)
     if (!removePhoneQuery.exec())
         return false;
     removePhoneQuery.reset();
+    QPhoneNumberIndex::instance()->remove(QUniqueId::fromUInt(uid));
 
     removePresenceQuery.bindValue(":i", uid);
     if (!removePresenceQuery.exec())
@@ -964,8 +974,10 @@ bool ContactSqlIO::insertExtraTables(uint uid, const QPimRecord &r)
         insertPhoneQuery.bindValue(":i", uid);
         insertPhoneQuery.bindValue(":t", phi.key());
         insertPhoneQuery.bindValue(":ph", phi.value());
+        insertPhoneQuery.bindValue(":k", QPhoneNumberIndex::indexKey(phi.value()));
         if (!insertPhoneQuery.exec())
             return false;
+        QPhoneNumberIndex::instance()->insert(QUniqueId::fromUInt(uid), phi.value());
     }
     insertPhoneQuery.reset();
 
@@ -1274,58 +1286,27 @@ QList<QUniqueId> ContactSqlIO::matchChatAddress(const QString &address, const QS
 
 QUniqueId ContactSqlIO::matchPhoneNumber(const QString &phnumber, int &bestMatch) const
 {
-    QString local = QPhoneNumber::localNumber(phnumber);
-    if (local.isEmpty())
+    QString key = QPhoneNumberIndex::indexKey(phnumber);
+    if (key.isEmpty())
         return QUniqueId();
 
-    /* For URL matching, strip off the protocol */
-    int colonIdx = local.indexOf(':');
-    if (colonIdx > 0 && colonIdx < local.length() - 1)
-        local = local.mid(colonIdx + 1);
-
-    /* Unfortunately we don't store the "localNumber" version of the entered number, so spaces, dashes etc
-       cause an SQL LIKE clause to miss the number.. instead, maintain a cache of localNumber entries
-       derived from the stored numbers. */
-    if (mLocalNumberCache.isEmpty()) {
-        QPreparedSqlQuery q(database());
-        // Ensure numbers are added in a deterministic order
-        q.prepare("SELECT recid, phone_number FROM contactphonenumbers ORDER BY recid");
-        q.exec();
-
-        while (q.next()) {
-            QUniqueId numberId = QUniqueId::fromUInt(q.value(0).toUInt());
-            QString phoneNumber = q.value(1).toString();
-            QString localNumber = QPhoneNumber::localNumber(phoneNumber);
-
-            if (!localNumber.isEmpty()) {
-                colonIdx = localNumber.indexOf(':');
-                if (colonIdx > 0 && colonIdx < localNumber.length() - 1)
-                    localNumber = localNumber.mid(colonIdx + 1);
-                // Index only by last 5 digits - resolve the rest by inspecting each.
-                mLocalNumberCache.insert(localNumber.right(5), qMakePair(numberId, phoneNumber));
-            }
-        }
-    }
-
     bestMatch = 0;
     QUniqueId bestContact;
-    local = local.right(5);
 
-    LocalNumberCache::const_iterator it = mLocalNumberCache.find(local), end = mLocalNumberCache.end();
-    if (it != end) {
-        // We have at least one exact match on the local number - see if there is a better one
-        for ( ; (bestMatch != 100) && (it != end) && (it.key() == local); ++it) {
-            const QPair<QUniqueId, QString>& matched(it.value());
+    /* The index holds the numbers ending with the same digits as the local number,
+       resolve the rest by inspecting each. */
+    QList<QPhoneNumberIndex::Candidate> candidates = QPhoneNumberIndex::instance()->candidates(key);
+    for (int i = 0; (bestMatch != 100) && (i < candidates.count()); ++i) {
+        const QPhoneNumberIndex::Candidate &matched(candidates.at(i));
 
-            // The cache has everything in it, we may have filtered something out
-            if (!contains(matched.first))
-                continue;
+        // The index has everything in it, we may have filtered something out
+        if (!contains(matched.id))
+            continue;
 
-            int match = QPhoneNumber::matchNumbers(phnumber, matched.second);
-            if (match > bestMatch) {
-                bestMatch = match;
-                bestContact = matched.first;
-            }
+        int match = QPhoneNumber::matchNumbers(phnumber, matched.number);
+        if (match > bestMatch) {
+            bestMatch = match;
+            bestContact = matched.id;
         }
     }
 
@@ -177,6 +177,7 @@ protected:
     bool updateExtraTables(uint, const QPimRecord &);
     bool insertExtraTables(uint, const QPimRecord &);
     bool removeExtraTables(uint);
+    bool rollback();
 
 private slots:
     void updateSqlLabel();
@@ -201,9 +202,6 @@ private:
 
     bool tmptable;
 
-    typedef QMultiHash<QString, QPair<QUniqueId, QString> > LocalNumberCache;
-    mutable LocalNumberCache mLocalNumberCache;
-
     static QMap<QContactModel::Field, QString> mFields;
     static QMap<QContactModel::Field, bool> mUpdateable;
 
@@ -0,0 +1,355 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qphonenumberindex_p.h"
+#include "qpimsqlio_p.h"
+#include "qpreparedquery_p.h"
+#include "qphonenumber.h"
+
+#include <qtopialog.h>
+
+#include <QValueSpaceItem>
+#include <QSqlDatabase>
+
+/*!
+  \class QPhoneNumberIndex
+  \internal
+
+  A process wide index of the contact phone numbers used for caller id.
+
+  Each stored number also has its local number stored reversed in the
+  reversed_local_number column of contactphonenumbers, so all numbers
+  ending in the same digits form a range of an SQL index.  In memory the
+  reversed keys form a trie.  Numbers are grouped into buckets by their
+  last five characters and a bucket is read from the database the first
+  time it is needed, and again after the contacts were changed by another
+  model, rather than rereading every number.
+*/
+
+/*!
+  \internal
+  Returns the index shared by the contact models of this process.
+*/
+QPhoneNumberIndex *QPhoneNumberIndex::instance()
+{
+    static QPhoneNumberIndex *index = 0;
+    if (!index)
+        index = new QPhoneNumberIndex;
+    return index;
+}
+
+QPhoneNumberIndex::QPhoneNumberIndex()
+    : mFreeEntries(-1), mGeneration(1), mStoredKeysUpdated(false)
+{
+    Node root = { 0, -1, -1, -1, 0 };
+    mNodes.append(root);
+
+    mContactsChanged = new QValueSpaceItem("PIM/Contacts", this);
+    connect(mContactsChanged, SIGNAL(contentsChanged()), this, SLOT(invalidate()));
+}
+
+/*!
+  \internal
+  Returns the key \a number is indexed by, the local part of the number
+  reversed.  For URLs the protocol is not part of the key.
+*/
+QString QPhoneNumberIndex::indexKey(const QString &number)
+{
+    QString local = QPhoneNumber::localNumber(number);
+
+    int colonIdx = local.indexOf(':');
+    if (colonIdx > 0 && colonIdx < local.length() - 1)
+        local = local.mid(colonIdx + 1);
+
+    QString key;
+    key.reserve(local.length());
+    for (int i = local.length() - 1; i >= 0; --i)
+        key.append(local[i]);
+
+    return key;
+}
+
+/*!
+  \internal
+  Returns the numbers ending with the same five characters as the
+  number indexed by \a key, those sharing the longest ending first.  A
+  key shorter than five characters only matches numbers with the same key.
+*/
+QList<QPhoneNumberIndex::Candidate> QPhoneNumberIndex::candidates(const QString &key)
+{
+    QList<Candidate> result;
+    if (key.isEmpty())
+        return result;
+
+    updateStoredKeys();
+
+    const bool exact = key.length() < BucketLength;
+    const int bucket = node(key, qMin(int(BucketLength), key.length()), true);
+
+    if (mNodes[bucket].generation != mGeneration) {
+        loadBucket(bucket, key.left(BucketLength), exact);
+        mNodes[bucket].generation = mGeneration;
+    }
+
+    if (exact) {
+        for (int e = mNodes[bucket].entries; e != -1; e = mEntries[e].next) {
+            Candidate c;
+            c.id = QUniqueId::fromUInt(mEntries[e].recid);
+            c.number = mEntries[e].number;
+            result.append(c);
+        }
+        return result;
+    }
+
+    // follow the key as deep as the stored numbers go
+    QList<int> path;
+    path.append(bucket);
+    for (int length = BucketLength + 1; length <= key.length(); ++length) {
+        int n = node(key, length, false);
+        if (n == -1)
+            break;
+        path.append(n);
+    }
+
+    int skip = -1;
+    for (int i = path.count() - 1; i >= 0; --i) {
+        collect(path[i], skip, result);
+        skip = path[i];
+    }
+
+    return result;
+}
+
+/*!
+  \internal
+  Adds \a number stored for the contact \a id.  Called when the contact
+  is saved so other models in this process see the number at once.
+*/
+void QPhoneNumberIndex::insert(const QUniqueId &id, const QString &number)
+{
+    QString key = indexKey(number);
+    if (!key.isEmpty())
+        addEntry(node(key, key.length(), true), id.toUInt(), number);
+}
+
+/*!
+  \internal
+  Removes the numbers of the contact \a id.
+*/
+void QPhoneNumberIndex::remove(const QUniqueId &id)
+{
+    const uint recid = id.toUInt();
+
+    QList<int> entries = mRecordEntries.values(recid);
+    foreach (int entry, entries)
+        removeEntry(entry);
+}
+
+/*!
+  \internal
+  Marks every bucket as out of date, called when the contacts were changed.
+*/
+void QPhoneNumberIndex::invalidate()
+{
+    ++mGeneration;
+}
+
+/*
+  Returns the node reached by following the first \a length characters of
+  \a key, creating missing nodes if \a create is true, otherwise -1.
+*/
+int QPhoneNumberIndex::node(const QString &key, int length, bool create)
+{
+    int n = 0;
+    for (int i = 0; i < length; ++i) {
+        const ushort c = key[i].unicode();
+
+        int child = mNodes[n].child;
+        while (child != -1 && mNodes[child].key != c)
+            child = mNodes[child].sibling;
+
+        if (child == -1) {
+            if (!create)
+                return -1;
+
+            Node added = { c, -1, mNodes[n].child, -1, 0 };
+            child = mNodes.count();
+            mNodes.append(added);
+            mNodes[n].child = child;
+        }
+
+        n = child;
+    }
+    return n;
+}
+
+void QPhoneNumberIndex::addEntry(int node, uint recid, const QString &number)
+{
+    int entry = mFreeEntries;
+    if (entry == -1) {
+        entry = mEntries.count();
+        mEntries.resize(entry + 1);
+    } else {
+        mFreeEntries = mEntries[entry].next;
+    }
+
+    // most recently added first, as numbers are read in record order
+    Entry &e = mEntries[entry];
+    e.recid = recid;
+    e.number = number;
+    e.node = node;
+    e.next = mNodes[node].entries;
+    mNodes[node].entries = entry;
+
+    mRecordEntries.insert(recid, entry);
+}
+
+void QPhoneNumberIndex::removeEntry(int entry)
+{
+    Entry &e = mEntries[entry];
+
+    int *link = &mNodes[e.node].entries;
+    while (*link != entry)
+        link = &mEntries[*link].next;
+    *link = e.next;
+
+    mRecordEntries.remove(e.recid, entry);
+
+    e.number = QString();
+    e.next = mFreeEntries;
+    mFreeEntries = entry;
+}
+
+/*
+  Removes the entries of \a node, and of all nodes below it if \a subtree
+  is true.
+*/
+void QPhoneNumberIndex::clearEntries(int node, bool subtree)
+{
+    while (mNodes[node].entries != -1)
+        removeEntry(mNodes[node].entries);
+
+    if (subtree) {
+        for (int child = mNodes[node].child; child != -1; child = mNodes[child].sibling)
+            clearEntries(child, true);
+    }
+}
+
+/*
+  Appends the entries of \a node and the nodes below it, except those
+  below \a skip.
+*/
+void QPhoneNumberIndex::collect(int node, int skip, QList<Candidate> &candidates) const
+{
+    for (int e = mNodes[node].entries; e != -1; e = mEntries[e].next) {
+        Candidate c;
+        c.id = QUniqueId::fromUInt(mEntries[e].recid);
+        c.number = mEntries[e].number;
+        candidates.append(c);
+    }
+
+    for (int child = mNodes[node].child; child != -1; child = mNodes[child].sibling) {
+        if (child != skip)
+            collect(child, -1, candidates);
+    }
+}
+
+/*
+  Rereads the numbers of the bucket \a node from the database.  An \a exact
+  bucket holds only numbers whose key is \a bucket, otherwise all the
+  numbers whose key starts with \a bucket.
+*/
+void QPhoneNumberIndex::loadBucket(int node, const QString &bucket, bool exact)
+{
+    clearEntries(node, !exact);
+
+    QPreparedSqlQuery q(QPimSqlIO::database());
+    if (exact) {
+        q.prepare("SELECT recid, phone_number FROM contactphonenumbers "
+                  "WHERE reversed_local_number = :k ORDER BY recid");
+        q.bindValue(":k", bucket);
+    } else {
+        // all keys starting with the bucket characters
+        QString end = bucket;
+        end[end.length() - 1] = QChar(end[end.length() - 1].unicode() + 1);
+
+        q.prepare("SELECT recid, phone_number, reversed_local_number FROM contactphonenumbers "
+                  "WHERE reversed_local_number >= :b AND reversed_local_number < :e ORDER BY recid");
+        q.bindValue(":b", bucket);
+        q.bindValue(":e", end);
+    }
+    q.exec();
+
+    while (q.next()) {
+        const uint recid = q.value(0).toUInt();
+        const QString number = q.value(1).toString();
+
+        if (exact) {
+            addEntry(node, recid, number);
+        } else {
+            const QString key = q.value(2).toString();
+            addEntry(this->node(key, key.length(), true), recid, number);
+        }
+    }
+
+    qLog(Sql) << "QPhoneNumberIndex::loadBucket()" << bucket << exact;
+}
+
+/*
+  Fills in the index key of numbers stored without one, such as those
+  copied by a database migration.
+*/
+void QPhoneNumberIndex::updateStoredKeys()
+{
+    if (mStoredKeysUpdated)
+        return;
+    mStoredKeysUpdated = true;
+
+    QSqlDatabase db = QPimSqlIO::database();
+
+    QPreparedSqlQuery select(db);
+    select.prepare("SELECT DISTINCT phone_number FROM contactphonenumbers WHERE reversed_local_number IS NULL");
+    select.exec();
+
+    QStringList numbers;
+    while (select.next())
+        numbers.append(select.value(0).toString());
+    select.reset();
+
+    if (numbers.isEmpty())
+        return;
+
+    // may already be part of a transaction, when synchronizing
+    bool transaction = db.transaction();
+
+    QPreparedSqlQuery update(db);
+    update.prepare("UPDATE contactphonenumbers SET reversed_local_number = :k "
+                   "WHERE phone_number = :ph AND reversed_local_number IS NULL");
+    foreach (const QString &number, numbers) {
+        update.bindValue(":k", indexKey(number));
+        update.bindValue(":ph", number);
+        update.exec();
+    }
+    update.reset();
+
+    if (transaction)
+        db.commit();
+
+    qLog(Sql) << "QPhoneNumberIndex::updateStoredKeys() indexed" << numbers.count() << "numbers";
+}
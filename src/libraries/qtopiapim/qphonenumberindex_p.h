@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef QPHONENUMBERINDEX_P_H
+#define QPHONENUMBERINDEX_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Extended API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <qobject.h>
+#include <qstring.h>
+#include <qvector.h>
+#include <qlist.h>
+#include <qhash.h>
+
+#include "quniqueid.h"
+
+class QValueSpaceItem;
+
+class QTOPIA_AUTOTEST_EXPORT QPhoneNumberIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Candidate {
+        QUniqueId id;
+        QString number;
+    };
+
+    static QPhoneNumberIndex *instance();
+
+    static QString indexKey(const QString &number);
+
+    QList<Candidate> candidates(const QString &key);
+
+    void insert(const QUniqueId &id, const QString &number);
+    void remove(const QUniqueId &id);
+
+public slots:
+    void invalidate();
+
+private:
+    QPhoneNumberIndex();
+
+    // Numbers are bucketed by their last BucketLength characters
+    enum { BucketLength = 5 };
+
+    struct Node {
+        ushort key;
+        int child;
+        int sibling;
+        int entries;
+        uint generation;
+    };
+
+    struct Entry {
+        uint recid;
+        QString number;
+        int node;
+        int next;
+    };
+
+    int node(const QString &key, int length, bool create);
+    void addEntry(int node, uint recid, const QString &number);
+    void removeEntry(int entry);
+    void clearEntries(int node, bool subtree);
+    void collect(int node, int skip, QList<Candidate> &candidates) const;
+    void loadBucket(int node, const QString &bucket, bool exact);
+    void updateStoredKeys();
+
+    QVector<Node> mNodes;
+    QVector<Entry> mEntries;
+    int mFreeEntries;
+    QMultiHash<uint, int> mRecordEntries;
+    uint mGeneration;
+    bool mStoredKeysUpdated;
+    QValueSpaceItem *mContactsChanged;
+};
+
+#endif
@@ -164,7 +164,7 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
         bindFields(r, q);
 
         if (!q.exec()) {
-            if (mSyncTime.isNull()) database().rollback();
+            if (mSyncTime.isNull()) rollback();
             return false;
         }
 
@@ -175,7 +175,7 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
         q.bindValue(":i", uid.toUInt());
         if(!q.exec())
         {
-            if (mSyncTime.isNull()) database().rollback();
+            if (mSyncTime.isNull()) rollback();
             return false;
         }
 
@@ -183,7 +183,7 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
             q.prepare(deleteCustomText);
             q.bindValue(":i", uid.toUInt());
             if (!q.exec()) {
-                if (mSyncTime.isNull()) database().rollback();
+                if (mSyncTime.isNull()) rollback();
                 return false;
             }
         }
@@ -196,7 +196,7 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
                 q.bindValue(":n", it.key());
                 q.bindValue(":v", it.value());
                 if (!q.exec()) {
-                    if (mSyncTime.isNull()) database().rollback();
+                    if (mSyncTime.isNull()) rollback();
                     return false;
                 }
             }
@@ -210,7 +210,7 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
             q.prepare(deleteCategoriesText);
             q.bindValue(":i", uid.toUInt());
             if (!q.exec()) {
-                if (mSyncTime.isNull()) database().rollback();
+                if (mSyncTime.isNull()) rollback();
                 return false;
             }
         }
@@ -220,7 +220,7 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
             foreach(QString v, cats) {
                 q.bindValue(":v", v);
                 if (!q.exec()) {
-                    if (mSyncTime.isNull()) database().rollback();
+                    if (mSyncTime.isNull()) rollback();
                     return false;
                 }
             }
@@ -228,7 +228,7 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
 
         if (!updateExtraTables(uid.toUInt(), r)) {
             qWarning("failed to update extra tables: %s", (const char *)database().lastError().text().toLocal8Bit());
-            if (mSyncTime.isNull()) database().rollback();
+            if (mSyncTime.isNull()) rollback();
             return false;
         }
 
@@ -237,13 +237,13 @@ bool QPimSqlIO::updateRecord(const QPimRecord& r)
         q.bindValue(":ls", syncTime);
         q.bindValue(":id", uid.toUInt());
         if (!q.exec()) {
-            if (mSyncTime.isNull()) database().rollback();
+            if (mSyncTime.isNull()) rollback();
             return false;
         }
     }
     if (mSyncTime.isNull() && !database().commit()) {
         qWarning("Could not commit update of record: %s", (const char *)database().lastError().text().toLocal8Bit());
-        database().rollback();
+        rollback();
         return false;
     }
 
@@ -285,7 +285,7 @@ bool QPimSqlIO::removeRecord(const QUniqueId & id)
     if (mSyncTime.isNull()) database().transaction();
 
     if (!removeExtraTables(id.toUInt())) {
-        if (mSyncTime.isNull()) database().rollback();
+        if (mSyncTime.isNull()) rollback();
         qWarning ("Failed to remove extra tables for %s", id.toString().toLatin1().constData());
         return false;
     }
@@ -295,14 +295,14 @@ bool QPimSqlIO::removeRecord(const QUniqueId & id)
     q.bindValue(":i", id.toUInt());
     if (!q.exec()) {
         qWarning("failed clean up custom fields: %s", (const char *)q.lastError().text().toLocal8Bit());
-        if (mSyncTime.isNull()) database().rollback();
+        if (mSyncTime.isNull()) rollback();
         return false;
     }
 
     q.prepare(deleteRecordText);
     q.bindValue(":i", id.toUInt());
     if( !q.exec()) {
-        if (mSyncTime.isNull()) database().rollback();
+        if (mSyncTime.isNull()) rollback();
         return false;
     }
 
@@ -311,13 +311,13 @@ bool QPimSqlIO::removeRecord(const QUniqueId & id)
     q.bindValue(":ls", syncTime);
     q.bindValue(":id", id.toUInt());
     if (!q.exec()) {
-        if (mSyncTime.isNull()) database().rollback();
+        if (mSyncTime.isNull()) rollback();
         return false;
     }
 
     if (mSyncTime.isNull() && !database().commit()) {
         qWarning("Could not commit removal of record: %s", (const char *)database().lastError().text().toLocal8Bit());
-        database().rollback();
+        rollback();
         return false;
     }
 
@@ -381,7 +381,7 @@ bool QPimSqlIO::removeRecords(const QList<QUniqueId> &ids)
     foreach(QUniqueId id, ids) {
         if (!removeRecord(id)) {
             if (doTransaction) {
-                database().rollback();
+                rollback();
                 mSyncTime = QDateTime();
             }
             return false;
@@ -390,7 +390,7 @@ bool QPimSqlIO::removeRecords(const QList<QUniqueId> &ids)
     if (doTransaction) {
         mSyncTime = QDateTime();
         if (!database().commit()) {
-            database().rollback();
+            rollback();
             return false;
         }
     }
@@ -430,7 +430,7 @@ QUniqueId QPimSqlIO::addRecord(const QPimRecord &record, int context, bool creat
     bindFields(record, addRecordQuery);
 
     if (!addRecordQuery.exec()) {
-        if (mSyncTime.isNull()) database().rollback();
+        if (mSyncTime.isNull()) rollback();
         return QUniqueId();
     }
 
@@ -447,7 +447,7 @@ QUniqueId QPimSqlIO::addRecord(const QPimRecord &record, int context, bool creat
             q.bindValue(":n", it.key());
             q.bindValue(":v", it.value());
             if (!q.exec()) {
-                if (mSyncTime.isNull()) database().rollback();
+                if (mSyncTime.isNull()) rollback();
                 return QUniqueId();
             }
         }
@@ -461,7 +461,7 @@ QUniqueId QPimSqlIO::addRecord(const QPimRecord &record, int context, bool creat
         foreach(QString v, cats) {
             q.bindValue(":v", v);
             if (!q.exec()) {
-                if (mSyncTime.isNull()) database().rollback();
+                if (mSyncTime.isNull()) rollback();
                 return QUniqueId();
             }
         }
@@ -469,7 +469,7 @@ QUniqueId QPimSqlIO::addRecord(const QPimRecord &record, int context, bool creat
 
     if (!insertExtraTables(u.toUInt(), record))
     {
-        if (mSyncTime.isNull()) database().rollback();
+        if (mSyncTime.isNull()) rollback();
         return QUniqueId();
     }
 
@@ -483,7 +483,7 @@ QUniqueId QPimSqlIO::addRecord(const QPimRecord &record, int context, bool creat
         changeLogUpdate.bindValue(":ls", syncTime);
         changeLogUpdate.bindValue(":id", u.toUInt());
         if (!changeLogUpdate.exec()) {
-            if (mSyncTime.isNull()) database().rollback();
+            if (mSyncTime.isNull()) rollback();
             changeLogUpdate.reset();
             return QUniqueId();
         }
@@ -497,7 +497,7 @@ QUniqueId QPimSqlIO::addRecord(const QPimRecord &record, int context, bool creat
         changeLogInsert.bindValue(":ct", syncTime);
         changeLogInsert.bindValue(":mt", syncTime);
         if (!changeLogInsert.exec()) {
-            if (mSyncTime.isNull()) database().rollback();
+            if (mSyncTime.isNull()) rollback();
             changeLogInsert.reset();
             return QUniqueId();
         }
@@ -506,7 +506,7 @@ QUniqueId QPimSqlIO::addRecord(const QPimRecord &record, int context, bool creat
 
     if (mSyncTime.isNull() && !database().commit()) {
         qWarning("failed to commit: %s", (const char *)database().lastError().text().toLocal8Bit());
-        database().rollback();
+        rollback();
         return QUniqueId();
     }
 
@@ -874,6 +874,17 @@ bool QPimSqlIO::abortTransaction()
     Q_ASSERT(mTransactionStack >= 0);
 
     mSyncTime = QDateTime();
+    return rollback();
+}
+
+/*!
+  \internal
+  Rolls back the current database transaction.  Subclasses that mirror
+  their extra tables in memory reimplement this to discard any state
+  recorded for the aborted changes.
+*/
+bool QPimSqlIO::rollback()
+{
     return database().rollback();
 }
 
@@ -154,6 +154,7 @@ protected:
     virtual bool updateExtraTables(uint, const QPimRecord &);
     virtual bool insertExtraTables(uint, const QPimRecord &);
     virtual bool removeExtraTables(uint);
+    virtual bool rollback();
 
     virtual void bindFields(const QPimRecord &r, QPreparedSqlQuery &) const = 0;
 
@@ -89,9 +89,9 @@ QContactSimSyncer::QContactSimSyncer(const QString &type, QObject *parent)
     SIMLabelLimit(20), SIMNumberLimit(60),
     SIMListStart(1), SIMListEnd(200), 
     addNameQuery("INSERT INTO contacts (recid, firstname, context) VALUES (:i, :fn, :c)"),
-    addNumberQuery("INSERT INTO contactphonenumbers (recid, phone_type, phone_number) VALUES (:i, 1, :pn)"),
+    addNumberQuery("INSERT INTO contactphonenumbers (recid, phone_type, phone_number, reversed_local_number) VALUES (:i, 1, :pn, :k)"),
     updateNameQuery("UPDATE contacts SET firstname = :fn WHERE recid = :i"),
-    updateNumberQuery("UPDATE contactphonenumbers SET phone_number = :pn WHERE recid = :i AND phone_type = 1"),
+    updateNumberQuery("UPDATE contactphonenumbers SET phone_number = :pn, reversed_local_number = :k WHERE recid = :i AND phone_type = 1"),
     removeNameQuery("DELETE FROM contacts WHERE recid = :i"),
     removeNumberQuery("DELETE FROM contactphonenumbers WHERE recid = :i"),
     selectNameQuery("SELECT firstname FROM contacts WHERE recid = :i"),
@@ -111,6 +111,8 @@ private:
     QString mActiveCard;
     QDateTime mInsertTime;
 
+    // :k in the number queries is QPhoneNumberIndex::indexKey() of :pn;
+    // callers must also insert()/remove() the number in the index.
     mutable QPreparedSqlQuery addNameQuery;
     mutable QPreparedSqlQuery addNumberQuery;
     mutable QPreparedSqlQuery updateNameQuery;
@@ -2,6 +2,7 @@ CREATE TABLE contactphonenumbers (
     phone_number VARCHAR(100) NOT NULL,
     recid INTEGER,
     phone_type INTEGER,
+    reversed_local_number VARCHAR(100),
     FOREIGN KEY(recid) REFERENCES contacts(recid)
 );
 
@@ -9,3 +10,4 @@ CREATE INDEX contactphonenumbersbytype ON contactphonenumbers (phone_type, phone
 CREATE INDEX contactphonenumbersindex ON contactphonenumbers (recid);
 CREATE INDEX contactphonenumbersnumbers ON contactphonenumbers (phone_number, recid);
 CREATE INDEX contactphnenumberscontacts ON contactphonenumbers (recid, phone_number);
+CREATE INDEX contactphonenumbersreversed ON contactphonenumbers (reversed_local_number);
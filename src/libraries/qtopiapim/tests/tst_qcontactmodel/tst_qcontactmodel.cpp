@@ -81,6 +81,7 @@ private slots:
     void matchChat();
     void match();
     void matchPhoneNumber();
+    void matchPhoneNumberChanges();
     void sort();
     void label();
     void presence();
@@ -812,6 +813,60 @@ void tst_QContactModel::matchPhoneNumber()
 }
 
 
+/*?
+    Test that phone number matching follows changes to the contacts made
+    through the same model and through other models.
+*/
+void tst_QContactModel::matchPhoneNumberChanges()
+{
+    QContactModel source;
+    QContactModel destination;
+
+    QContact x;
+    x.setFirstName("Xavier");
+    x.setHomePhone("0298765432");
+
+    QContact y;
+    y.setFirstName("Yvonne");
+    y.setHomeMobile("0398765432");
+
+    x.setUid(source.addContact(x));
+    y.setUid(source.addContact(y));
+
+    QContact none;
+
+    // numbers sharing the same ending
+    QCOMPARE(source.matchPhoneNumber("0298765432"), x);
+    QCOMPARE(source.matchPhoneNumber("0398765432"), y);
+
+    qApp->processEvents();
+    qApp->processEvents();
+
+    QCOMPARE(destination.matchPhoneNumber("0298765432"), x);
+    QCOMPARE(destination.matchPhoneNumber("0398765432"), y);
+
+    // changing a number
+    x.setHomePhone("0211112222");
+    QVERIFY(source.updateContact(x));
+    QCOMPARE(source.matchPhoneNumber("0211112222"), x);
+    QVERIFY(!(source.matchPhoneNumber("0298765432") == x));
+
+    qApp->processEvents();
+    qApp->processEvents();
+
+    QCOMPARE(destination.matchPhoneNumber("0211112222"), x);
+    QCOMPARE(destination.matchPhoneNumber("0398765432"), y);
+
+    // removing a contact
+    QVERIFY(source.removeContact(y));
+    QCOMPARE(source.matchPhoneNumber("0398765432"), none);
+
+    qApp->processEvents();
+    qApp->processEvents();
+
+    QCOMPARE(destination.matchPhoneNumber("0398765432"), none);
+}
+
 void tst_QContactModel::match()
 {
     QContactModel model;
@@ -20,10 +20,12 @@ HEADERS=\
     qpackageregistry.h
 
 PRIVATE_HEADERS=\
-    keyfiler_p.h
+    keyfiler_p.h\
+    qsxepolicytable_p.h
 
 SOURCES=\
     qsxepolicy.cpp\
+    qsxepolicytable.cpp\
     keyfiler.cpp\
     qpackageregistry.cpp
 
@@ -20,6 +20,7 @@
 #include "qpackageregistry.h"
 #include "keyfiler_p.h"
 #include "qsxepolicy.h"
+#include "qsxepolicytable_p.h"
 
 #include <qtopianamespace.h>
 #ifndef SXE_INSTALLER
@@ -49,6 +50,7 @@ const QString QPackageRegistry::installsFileName = "installs";
 const QString QPackageRegistry::manifestFileName = "manifest";
 const QString QPackageRegistry::policyFileName = "sxe.policy";
 const QString QPackageRegistry::profilesFileName = "sxe.profiles";
+const QString QPackageRegistry::policyTableFileName = "sxe.policytable";
 const QString QPackageRegistry::binInstallPath = "/bin/";
 const QString QPackageRegistry::qlLibInstallPath = "/plugins/application/";
 const QString QPackageRegistry::packageDirectory = "packages";
@@ -1262,6 +1264,76 @@ void QPackageRegistry::outputPolicyFile()
         ++pit;
     }
     pf.close();
+
+    outputPolicyTable();
+}
+
+/*!
+  \internal
+  Have this process and every running policy manager remap the policy table
+  of the given \a generation, or fall back to the text files if it has been
+  removed.
+*/
+void QPackageRegistry::announcePolicyTable( quint32 generation )
+{
+#ifndef SXE_INSTALLER
+    SXEPolicyManager::getInstance()->reloadPolicyTable();
+#ifdef Q_WS_QWS
+    QtopiaIpcEnvelope e( "QPE/SXE", "policyChanged(int)" );
+    e << (int)generation;
+#endif
+#else
+    Q_UNUSED( generation );
+#endif
+}
+
+/*!
+  \internal
+  Compile the policy just written together with the sxe.profiles file into
+  the binary policy table which SXEPolicyManager maps, then announce the new
+  generation of the table so running policy managers reload it.  If the table
+  cannot be compiled it is removed, and the announcement makes the policy
+  managers drop any table they still have mapped.
+*/
+void QPackageRegistry::outputPolicyTable()
+{
+    QString tableFn = sxeConfPath() + "/" + policyTableFileName;
+    quint32 generation = SXEPolicyTable::readGeneration( tableFn ) + 1;
+
+    QMultiHash<QString,QString> requests;
+    QMap<QString,QString> wildcards;
+    if ( !SXEPolicyTable::readProfiles( getQtopiaDir() + "etc/" + profilesFileName, &requests, &wildcards ))
+    {
+        // without the profiles the table would deny everything; leave the
+        // policy managers to fall back to the text files instead
+        QFile::remove( tableFn );
+        announcePolicyTable( generation );
+        return;
+    }
+
+    QMap<unsigned char,QStringList> policies;
+    QHash<QString,unsigned char>::iterator pit = profileDict.begin();
+    for ( ; pit != profileDict.end(); ++pit )
+    {
+        QStringList profs;
+        foreach ( QString p, pit.key().split( "," ))
+        {
+            int idx = p.indexOf( QLatin1Char('{') );
+            if ( idx >= 0 )
+                p.truncate( idx );
+            if ( !p.isEmpty() )
+                profs << p;
+        }
+        if ( profs.isEmpty() )
+            profs << QLatin1String("none");
+        policies[pit.value()] = profs;
+    }
+
+    qLog(SXE) << "Writing SXE policy table" << tableFn << "generation" << generation;
+    if ( !SXEPolicyTable::compile( tableFn, policies, requests, wildcards, generation ))
+        QFile::remove( tableFn );
+
+    announcePolicyTable( generation );
 }
 
 
@@ -64,6 +64,7 @@ public:
     static const QString manifestFileName;
     static const QString policyFileName;
     static const QString profilesFileName;
+    static const QString policyTableFileName;
     static const QString binInstallPath;
     static const QString qlLibInstallPath;
     static const QString procLidsKeysPath;
@@ -90,6 +91,8 @@ public slots:
 
 private:
     void outputPolicyFile();
+    void outputPolicyTable();
+    void announcePolicyTable( quint32 generation );
     void initialiseInstallDicts();
     bool openSystemFiles();
     void closeSystemFiles();
@@ -25,6 +25,7 @@
 #include <ctype.h>
 #include <unistd.h>
 
+#include <QDataStream>
 #include <QDateTime>
 #include <QFileInfo>
 #include <QTextStream>
@@ -35,6 +36,12 @@
 
 #include <qsxepolicy.h>
 #include <qpackageregistry.h>
+#include "qsxepolicytable_p.h"
+
+#ifndef SXE_INSTALLER
+#include <QCoreApplication>
+#include <qtopiachannel.h>
+#endif
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -114,6 +121,12 @@ static time_t fileModified(const QString &filename)
   A request will generally be only included in one profile, but there is nothing
   to prevent it being present in more than one.
 
+  Where the package installer has compiled the policy and profiles into a
+  binary policy table that table is mapped into memory, and both findPolicy()
+  and findRequest() are answered from it without touching the text files.
+  The table is only reloaded when the installer announces a new generation
+  of it on the \c QPE/SXE channel.
+
   \sa QPackageRegistry
 */
 
@@ -123,9 +136,19 @@ static time_t fileModified(const QString &filename)
 */
 SXEPolicyManager::SXEPolicyManager()
     : policyCache()
+    , policyTable( new SXEPolicyTable )
     , checkDate( true )
 {
-    readProfiles();
+    if ( !loadPolicyTable() )
+        readProfiles();
+#ifndef SXE_INSTALLER
+    if ( QCoreApplication::instance() )
+    {
+        QtopiaChannel *channel = new QtopiaChannel( QLatin1String("QPE/SXE"), this );
+        connect( channel, SIGNAL(received(QString,QByteArray)),
+                 this, SLOT(sxeMessage(QString,QByteArray)) );
+    }
+#endif
 }
 
 /*!
@@ -133,6 +156,7 @@ SXEPolicyManager::SXEPolicyManager()
 */
 SXEPolicyManager::~SXEPolicyManager()
 {
+    delete policyTable;
 }
 
 /*!
@@ -166,11 +190,12 @@ static int parseNumberInSquareBrackets( const QString &s )
 /*!
   Given the \a progId return a list of the profile names which that
   program is authorised to access.  The information is read from the
+  compiled policy table if there is one, and otherwise from the
   Qt Extended SXE policy file [qt_prefix]/etc/sxe.policy.  A caching algorithm
   is used to lessen the number of file accesses required for
-  recurring lookups.  The cache is checked for freshness against this
-  files last modify time, as the Qt Extended installer may have changed
-  it since it was last accessed.
+  recurring lookups of the text file.  The cache is checked for freshness
+  against this files last modify time, as the Qt Extended installer may have
+  changed it since it was last accessed.
 */
 QStringList SXEPolicyManager::findPolicy( unsigned char progId )
 {
@@ -182,7 +207,9 @@ QStringList SXEPolicyManager::findPolicy( unsigned char progId )
 
     QMutexLocker lock( &policyMutex );
 
-    // XXX Use notifcation from package installer rather than stat file.
+    if ( policyTable->isOpen() )
+        return policyTable->policy( progId );
+
     static time_t freshness = 0;
     time_t lastModified = fileModified( policyFileName );
     if ( lastModified != freshness ) {
@@ -305,20 +332,36 @@ QStringList SXEPolicyManager::findPolicy( unsigned char progId )
 */
 QString SXEPolicyManager::findRequest( QString request, QStringList prof )
 {
-    QMultiHash<QString,QString>::const_iterator it = requestHash.find(request);
-    if (it != requestHash.end()) {
-        if (prof.isEmpty()) {
-            return *it;
-        }
-        while (it != requestHash.end() && it.key() == request) {
-            const QString &value = *it;
+    QMutexLocker lock( &policyMutex );
+
+    if ( policyTable->isOpen() ) {
+        QStringList found = policyTable->requestProfiles( request );
+        if ( !found.isEmpty() && prof.isEmpty() )
+            return found.first();
+        foreach ( const QString &value, found ) {
             if (value == QLatin1String("deny")
                 || value == QLatin1String("allow")
                 || prof.contains(value))
             {
                 return value;
             }
-            ++it;
+        }
+    } else {
+        QMultiHash<QString,QString>::const_iterator it = requestHash.find(request);
+        if (it != requestHash.end()) {
+            if (prof.isEmpty()) {
+                return *it;
+            }
+            while (it != requestHash.end() && it.key() == request) {
+                const QString &value = *it;
+                if (value == QLatin1String("deny")
+                    || value == QLatin1String("allow")
+                    || prof.contains(value))
+                {
+                    return value;
+                }
+                ++it;
+            }
         }
     }
 
@@ -332,7 +375,8 @@ QString SXEPolicyManager::findRequest( QString request, QStringList prof )
 #endif
     }
 
-    QString buf = checkWildcards( request, prof );
+    QString buf = policyTable->isOpen() ? policyTable->matchWildcard( request, prof )
+                                        : checkWildcards( request, prof );
     if ( !buf.isEmpty() ) {
         return buf;
     }
@@ -347,52 +391,61 @@ bool SXEPolicyManager::readProfiles()
 #else
     QString policyFileName = Qtopia::qtopiaDir() + "etc/sxe.profiles";
 #endif
-    QFile profs( policyFileName );
-    QTextStream ts( &profs );
-    if ( ! profs.open( QFile::ReadOnly ))
-    {
-#ifndef SXE_INSTALLER
-        qWarning( "Could not open policy file %s!", policyFileName.toLocal8Bit().constData() );
-#endif
+    requestHash.clear();
+    wildcards.clear();
+    return SXEPolicyTable::readProfiles( policyFileName, &requestHash, &wildcards );
+}
+
+/*!
+  \internal
+  Map the compiled policy table, dropping the text file caches if it loads.
+  The installer itself always works from the text files it maintains.
+*/
+bool SXEPolicyManager::loadPolicyTable()
+{
+#ifdef SXE_INSTALLER
+    return false;
+#else
+    QString tableFileName = QPackageRegistry::getInstance()->sxeConfPath() +
+        "/" + QPackageRegistry::policyTableFileName;
+    if ( !policyTable->open( tableFileName ))
         return false;
-    }
 
-    unsigned int line = 1;
-    QString currentProf;
-    while( !ts.atEnd() )
+    qLog(SXE) << "Loaded SXE policy table generation" << policyTable->generation();
+    requestHash.clear();
+    wildcards.clear();
+    policyCache.clear();
+    return true;
+#endif
+}
+
+/*!
+  \internal
+  Reload the policy table when the installer announces a new generation of it
+  with the \a message policyChanged(int) and \a data.
+*/
+void SXEPolicyManager::sxeMessage( const QString &message, const QByteArray &data )
+{
+    if ( message == QLatin1String("policyChanged(int)") )
     {
-        QString buf = ts.readLine().trimmed();
-        if (buf.isEmpty())
-        {
-            ++line;
-            continue;
-        }
-        else if ( buf[0] == QLatin1Char('[') )
-        {
-            int rhb = buf.indexOf( QLatin1Char(']') );
-            if ( rhb == -1 )
-            {
-                qWarning( "Bad profile name in square brackets at line %d", line );
-                return false;
-            }
-            currentProf = buf.mid( 1, rhb - 1 );
-        }
-        else if ( buf[0] != QLatin1Char('#') )
-        {
-            if ( buf.endsWith( QLatin1Char('*') ))
-            {
-                buf.chop(1);
-                wildcards.insertMulti(currentProf, buf);
-            }
-            else
-            {
-                requestHash.insert(buf, currentProf);
-            }
-        }
-        line++;
+        QDataStream ds( data );
+        int generation;
+        ds >> generation;
+
+        if ( !policyTable->isOpen() || policyTable->generation() != (quint32)generation )
+            reloadPolicyTable();
     }
+}
 
-    return true;
+/*!
+  \internal
+  Remap the policy table, falling back to the text files if it has gone.
+*/
+void SXEPolicyManager::reloadPolicyTable()
+{
+    QMutexLocker lock( &policyMutex );
+    if ( !loadPolicyTable() && requestHash.isEmpty() && wildcards.isEmpty() )
+        readProfiles();
 }
 
 QString SXEPolicyManager::checkWildcards( const QString &request, const QStringList &profs )
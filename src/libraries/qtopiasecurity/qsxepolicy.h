@@ -32,6 +32,8 @@
 
 #include <time.h>
 
+class SXEPolicyTable;
+
 class QTOPIASECURITY_EXPORT SXEPolicyManager : public QObject
 {
     Q_OBJECT
@@ -43,15 +45,22 @@ public:
 public slots:
     void policyCheck( QTransportAuth::Data &, const QString & );
     void resetDateCheck();
+private slots:
+    void sxeMessage( const QString &, const QByteArray & );
 private:
     SXEPolicyManager();
     bool readProfiles();
+    bool loadPolicyTable();
+    void reloadPolicyTable();
     QString checkWildcards( const QString &, const QStringList & );
     QMultiHash<QString,QString> requestHash;
     QCache<unsigned char,QStringList> policyCache;
     QMap<QString,QString> wildcards;
+    SXEPolicyTable *policyTable;
     bool checkDate;
     QMutex policyMutex;
+
+    friend class QPackageRegistry;
 };
 
 #endif
@@ -0,0 +1,698 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qsxepolicytable_p.h"
+
+#include <QFile>
+#include <QSet>
+#include <QTextStream>
+#include <QVector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+/*
+  Layout of the compiled policy table.  All values are in host byte order
+  since the table is only ever written by the installer for the device that
+  reads it.
+
+    TableHeader
+    quint32[profileCount]   profile name string offsets, sorted by name
+    quint32[256]            profile list offset for each program identity
+    quint32[seedCount]      displacement seed for each first level bucket
+    TableSlot[slotCount]    request name and profile list for each slot
+    TableNode[nodeCount]    wildcard prefix trie, node 0 is the root
+    TableEdge[edgeCount]    trie children, sorted by character per node
+    pool                    strings (quint16 length, UTF-16 data) and
+                            profile lists (quint16 count, quint16 indices)
+
+  Request names are located with a hash-and-displace perfect hash: the
+  unseeded hash selects a bucket whose seed rehashes the name to a slot
+  that no other request occupies, so a lookup costs two hashes and one
+  string compare.  Offsets are from the start of the table, so zero means
+  "none" as nothing but the header lives there.
+*/
+
+static const quint32 TableMagic = 0x54505853;   // "SXPT"
+static const quint32 TableVersion = 1;
+
+struct TableHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 generation;
+    quint32 size;
+    quint32 profileCount;
+    quint32 profilesOffset;
+    quint32 programsOffset;
+    quint32 seedCount;
+    quint32 seedsOffset;
+    quint32 slotCount;
+    quint32 slotsOffset;
+    quint32 nodeCount;
+    quint32 nodesOffset;
+    quint32 edgeCount;
+    quint32 edgesOffset;
+};
+
+struct TableSlot
+{
+    quint32 name;
+    quint32 profiles;
+};
+
+struct TableNode
+{
+    quint32 firstEdge;
+    quint32 edgeCount;
+    quint32 profiles;
+};
+
+struct TableEdge
+{
+    quint32 ch;
+    quint32 node;
+};
+
+static quint32 requestHash( quint32 seed, const QString &request )
+{
+    quint32 h = 2166136261u ^ ( seed * 0x9e3779b9u );
+    const QChar *c = request.unicode();
+    for ( int i = 0; i < request.length(); ++i )
+    {
+        h ^= c[i].unicode();
+        h *= 16777619u;
+    }
+    return h ^ ( h >> 15 );
+}
+
+template <typename T>
+static inline const T *tableArray( const char *data, quint32 offset )
+{
+    return reinterpret_cast<const T *>( data + offset );
+}
+
+SXEPolicyTable::SXEPolicyTable()
+    : data( 0 )
+    , size( 0 )
+{
+}
+
+SXEPolicyTable::~SXEPolicyTable()
+{
+    close();
+}
+
+static bool sectionValid( quint32 offset, quint32 count, quint32 elementSize, quint32 size )
+{
+    if ( count == 0 )
+        return true;
+    if ( offset < sizeof(TableHeader) || offset > size || ( offset % 4 ) != 0 )
+        return false;
+    return count <= ( size - offset ) / elementSize;
+}
+
+/*
+  Map the compiled table in \a fileName, replacing any table already mapped.
+  Returns false, leaving no table mapped, if the file is missing or is not a
+  table of the current format version.
+*/
+bool SXEPolicyTable::open( const QString &fileName )
+{
+    close();
+
+    int fd = ::open( QFile::encodeName( fileName ).constData(), O_RDONLY );
+    if ( fd == -1 )
+        return false;
+
+    struct stat st;
+    if ( ::fstat( fd, &st ) != 0 || st.st_size < (off_t)sizeof(TableHeader) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    // the installer replaces the table by renaming a new file over it, so
+    // this mapping stays valid until it is closed
+    void *map = ::mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( map == MAP_FAILED )
+    {
+        qWarning( "Could not map policy table %s: %s", qPrintable( fileName ), strerror( errno ));
+        return false;
+    }
+
+    data = static_cast<const char *>( map );
+    size = st.st_size;
+
+    const TableHeader *h = tableArray<TableHeader>( data, 0 );
+    if ( h->magic != TableMagic || h->version != TableVersion || h->size != size
+            || !sectionValid( h->profilesOffset, h->profileCount, sizeof(quint32), size )
+            || !sectionValid( h->programsOffset, 256, sizeof(quint32), size )
+            || !sectionValid( h->seedsOffset, h->seedCount, sizeof(quint32), size )
+            || !sectionValid( h->slotsOffset, h->slotCount, sizeof(TableSlot), size )
+            || !sectionValid( h->nodesOffset, h->nodeCount, sizeof(TableNode), size )
+            || !sectionValid( h->edgesOffset, h->edgeCount, sizeof(TableEdge), size )
+            || ( h->slotCount != 0 && h->seedCount == 0 ))
+    {
+        qWarning( "Ignoring invalid policy table %s", qPrintable( fileName ));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SXEPolicyTable::close()
+{
+    if ( data )
+        ::munmap( const_cast<char *>( data ), size );
+    data = 0;
+    size = 0;
+}
+
+quint32 SXEPolicyTable::generation() const
+{
+    return data ? tableArray<TableHeader>( data, 0 )->generation : 0;
+}
+
+QString SXEPolicyTable::stringAt( quint32 offset ) const
+{
+    if ( offset == 0 || offset + sizeof(quint16) > size )
+        return QString();
+    const quint16 *s = tableArray<quint16>( data, offset );
+    if ( offset + sizeof(quint16) * ( s[0] + 1 ) > size )
+        return QString();
+    return QString( reinterpret_cast<const QChar *>( s + 1 ), s[0] );
+}
+
+bool SXEPolicyTable::stringEquals( quint32 offset, const QString &str ) const
+{
+    if ( offset == 0 || offset + sizeof(quint16) > size )
+        return false;
+    const quint16 *s = tableArray<quint16>( data, offset );
+    if ( s[0] != str.length() || offset + sizeof(quint16) * ( s[0] + 1 ) > size )
+        return false;
+    return ::memcmp( s + 1, str.unicode(), s[0] * sizeof(quint16) ) == 0;
+}
+
+const quint16 *SXEPolicyTable::listAt( quint32 offset, quint16 *count ) const
+{
+    *count = 0;
+    if ( offset == 0 || offset + sizeof(quint16) > size )
+        return 0;
+    const quint16 *l = tableArray<quint16>( data, offset );
+    if ( offset + sizeof(quint16) * ( l[0] + 1 ) > size )
+        return 0;
+    *count = l[0];
+    return l + 1;
+}
+
+/*
+  Return the profile names awarded to \a progId, as written to sxe.policy.
+*/
+QStringList SXEPolicyTable::policy( unsigned char progId ) const
+{
+    QStringList result;
+    if ( !data )
+        return result;
+
+    const TableHeader *h = tableArray<TableHeader>( data, 0 );
+    const quint32 *programs = tableArray<quint32>( data, h->programsOffset );
+    const quint32 *profiles = tableArray<quint32>( data, h->profilesOffset );
+    quint16 count;
+    const quint16 *list = listAt( programs[progId], &count );
+    for ( int i = 0; i < count; ++i )
+        if ( list[i] < h->profileCount )
+            result << stringAt( profiles[list[i]] );
+    return result;
+}
+
+/*
+  Return the profiles listing \a request exactly, in the order a QMultiHash
+  of the sxe.profiles entries would return them.
+*/
+QStringList SXEPolicyTable::requestProfiles( const QString &request ) const
+{
+    QStringList result;
+    if ( !data )
+        return result;
+
+    const TableHeader *h = tableArray<TableHeader>( data, 0 );
+    if ( h->slotCount == 0 )
+        return result;
+
+    const quint32 *seeds = tableArray<quint32>( data, h->seedsOffset );
+    quint32 seed = seeds[requestHash( 0, request ) % h->seedCount];
+    const TableSlot &slot = tableArray<TableSlot>( data, h->slotsOffset )[requestHash( seed, request ) % h->slotCount];
+    if ( !stringEquals( slot.name, request ))
+        return result;
+
+    const quint32 *profiles = tableArray<quint32>( data, h->profilesOffset );
+    quint16 count;
+    const quint16 *list = listAt( slot.profiles, &count );
+    for ( int i = 0; i < count; ++i )
+        if ( list[i] < h->profileCount )
+            result << stringAt( profiles[list[i]] );
+    return result;
+}
+
+/*
+  Walk the wildcard trie along \a request and return the first profile, in
+  name order, which is in \a profs and has a wildcard prefixing the request.
+*/
+QString SXEPolicyTable::matchWildcard( const QString &request, const QStringList &profs ) const
+{
+    if ( !data || profs.isEmpty() )
+        return QString();
+
+    const TableHeader *h = tableArray<TableHeader>( data, 0 );
+    if ( h->nodeCount == 0 )
+        return QString();
+
+    const quint32 *profiles = tableArray<quint32>( data, h->profilesOffset );
+    const TableNode *nodes = tableArray<TableNode>( data, h->nodesOffset );
+    const TableEdge *edges = tableArray<TableEdge>( data, h->edgesOffset );
+    const QChar *c = request.unicode();
+
+    int best = -1;
+    quint32 n = 0;
+    int pos = 0;
+    forever
+    {
+        quint16 count;
+        const quint16 *list = listAt( nodes[n].profiles, &count );
+        for ( int i = 0; i < count; ++i )
+        {
+            // lists are sorted, so nothing further can beat the best match
+            if ( best != -1 && list[i] >= best )
+                break;
+            if ( list[i] < h->profileCount && profs.contains( stringAt( profiles[list[i]] )))
+            {
+                best = list[i];
+                break;
+            }
+        }
+        if ( pos == request.length() )
+            break;
+
+        quint32 lo = nodes[n].firstEdge;
+        quint32 hi = lo + nodes[n].edgeCount;
+        if ( hi > h->edgeCount )
+            break;
+        quint32 ch = c[pos].unicode();
+        while ( lo < hi )
+        {
+            quint32 mid = ( lo + hi ) / 2;
+            if ( edges[mid].ch < ch )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if ( lo == nodes[n].firstEdge + nodes[n].edgeCount || edges[lo].ch != ch
+                || edges[lo].node >= h->nodeCount )
+            break;
+        n = edges[lo].node;
+        ++pos;
+    }
+
+    return best == -1 ? QString() : stringAt( profiles[best] );
+}
+
+/*
+  Return the generation of the table in \a fileName, or 0 if there is no
+  valid table there.
+*/
+quint32 SXEPolicyTable::readGeneration( const QString &fileName )
+{
+    SXEPolicyTable table;
+    table.open( fileName );
+    return table.generation();
+}
+
+/*
+  Parse the sxe.profiles file \a fileName into exact \a requests, keyed by
+  request name, and \a wildcards, keyed by profile name.  Sections are
+  introduced by a "[profile]" line, lines starting with a '#' are comments,
+  and a trailing '*' makes the request a wildcard prefix.
+*/
+bool SXEPolicyTable::readProfiles( const QString &fileName,
+                                   QMultiHash<QString,QString> *requests,
+                                   QMap<QString,QString> *wildcards )
+{
+    QFile profs( fileName );
+    QTextStream ts( &profs );
+    if ( ! profs.open( QFile::ReadOnly ))
+    {
+#ifndef SXE_INSTALLER
+        qWarning( "Could not open policy file %s!", fileName.toLocal8Bit().constData() );
+#endif
+        return false;
+    }
+
+    unsigned int line = 1;
+    QString currentProf;
+    while( !ts.atEnd() )
+    {
+        QString buf = ts.readLine().trimmed();
+        if (buf.isEmpty())
+        {
+            ++line;
+            continue;
+        }
+        else if ( buf[0] == QLatin1Char('[') )
+        {
+            int rhb = buf.indexOf( QLatin1Char(']') );
+            if ( rhb == -1 )
+            {
+                qWarning( "Bad profile name in square brackets at line %d", line );
+                return false;
+            }
+            currentProf = buf.mid( 1, rhb - 1 );
+        }
+        else if ( buf[0] != QLatin1Char('#') )
+        {
+            if ( buf.endsWith( QLatin1Char('*') ))
+            {
+                buf.chop(1);
+                wildcards->insertMulti(currentProf, buf);
+            }
+            else
+            {
+                requests->insert(buf, currentProf);
+            }
+        }
+        line++;
+    }
+
+    return true;
+}
+
+namespace {
+
+struct TrieNode
+{
+    QMap<quint16,int> children;
+    QList<quint16> profiles;
+};
+
+class TableWriter
+{
+public:
+    TableWriter() : poolBase( 0 ) {}
+
+    void setPoolBase( quint32 base ) { poolBase = base; }
+
+    quint32 addString( const QString &s )
+    {
+        QHash<QString,quint32>::const_iterator it = strings.find( s );
+        if ( it != strings.end() )
+            return *it;
+        quint32 offset = poolBase + pool.size();
+        append( s.length() );
+        pool.append( QByteArray( reinterpret_cast<const char *>( s.unicode() ), s.length() * sizeof(quint16) ));
+        strings.insert( s, offset );
+        return offset;
+    }
+
+    quint32 addList( const QList<quint16> &l )
+    {
+        if ( l.isEmpty() )
+            return 0;
+        quint32 offset = poolBase + pool.size();
+        append( l.count() );
+        foreach ( quint16 i, l )
+            append( i );
+        return offset;
+    }
+
+    QByteArray pool;
+
+private:
+    void append( quint16 v ) { pool.append( QByteArray( reinterpret_cast<const char *>( &v ), sizeof(v) )); }
+
+    quint32 poolBase;
+    QHash<QString,quint32> strings;
+};
+
+template <typename T>
+static void appendArray( QByteArray &out, const QVector<T> &v )
+{
+    if ( !v.isEmpty() )
+        out.append( QByteArray( reinterpret_cast<const char *>( v.constData() ), v.count() * sizeof(T) ));
+}
+
+}
+
+/*
+  Compile \a policies, keyed by program identity, and the sxe.profiles
+  \a requests and \a wildcards into a table stamped with \a generation.
+  The table is written beside \a fileName and then renamed over it, so
+  readers holding the previous table mapped are unaffected.
+*/
+bool SXEPolicyTable::compile( const QString &fileName,
+                              const QMap<unsigned char,QStringList> &policies,
+                              const QMultiHash<QString,QString> &requests,
+                              const QMap<QString,QString> &wildcards,
+                              quint32 generation )
+{
+    // profile indices follow name order, so the lowest matching index is
+    // the wildcard match a walk over the wildcards map would have found
+    QStringList profileNames;
+    {
+        QSet<QString> names;
+        QMap<unsigned char,QStringList>::const_iterator pit = policies.begin();
+        for ( ; pit != policies.end(); ++pit )
+            foreach ( const QString &p, *pit )
+                names.insert( p );
+        QMultiHash<QString,QString>::const_iterator rit = requests.begin();
+        for ( ; rit != requests.end(); ++rit )
+            names.insert( *rit );
+        QMap<QString,QString>::const_iterator wit = wildcards.begin();
+        for ( ; wit != wildcards.end(); ++wit )
+            names.insert( wit.key() );
+        names.insert( QLatin1String("allow") );
+        names.insert( QLatin1String("deny") );
+        profileNames = names.toList();
+        qSort( profileNames );
+    }
+    if ( profileNames.count() > 0xffff )
+    {
+        qWarning( "Too many SXE profiles to compile a policy table" );
+        return false;
+    }
+    QHash<QString,quint16> profileIndex;
+    for ( int i = 0; i < profileNames.count(); ++i )
+        profileIndex.insert( profileNames[i], i );
+
+    // perfect hash over the request names
+    QStringList names = requests.uniqueKeys();
+    quint32 slotCount = names.isEmpty() ? 0 : names.count() + names.count() / 4 + 1;
+    quint32 seedCount = names.isEmpty() ? 0 : names.count() / 4 + 1;
+    QVector<quint32> seeds( seedCount, 0 );
+    QVector<int> slotNames( slotCount, -1 );
+    if ( !names.isEmpty() )
+    {
+        QVector< QList<int> > buckets( seedCount );
+        for ( int i = 0; i < names.count(); ++i )
+            buckets[requestHash( 0, names[i] ) % seedCount].append( i );
+
+        // place the largest buckets first while the slots are still sparse
+        QMultiMap<int,int> bySize;
+        for ( quint32 b = 0; b < seedCount; ++b )
+            if ( !buckets[b].isEmpty() )
+                bySize.insert( -buckets[b].count(), b );
+
+        foreach ( int b, bySize )
+        {
+            const QList<int> &bucket = buckets[b];
+            quint32 seed = 1;
+            for ( ; seed < 0x100000; ++seed )
+            {
+                QList<quint32> taken;
+                foreach ( int i, bucket )
+                {
+                    quint32 s = requestHash( seed, names[i] ) % slotCount;
+                    if ( slotNames[s] != -1 || taken.contains( s ))
+                        break;
+                    taken.append( s );
+                }
+                if ( taken.count() == bucket.count() )
+                {
+                    for ( int i = 0; i < bucket.count(); ++i )
+                        slotNames[taken[i]] = bucket[i];
+                    break;
+                }
+            }
+            if ( seed == 0x100000 )
+            {
+                qWarning( "Could not find a perfect hash for the SXE request names" );
+                return false;
+            }
+            seeds[b] = seed;
+        }
+    }
+
+    // wildcard prefix trie
+    QVector<TrieNode> trie( 1 );
+    QMap<QString,QString>::const_iterator wit = wildcards.begin();
+    for ( ; wit != wildcards.end(); ++wit )
+    {
+        int n = 0;
+        const QString &prefix = *wit;
+        for ( int i = 0; i < prefix.length(); ++i )
+        {
+            quint16 ch = prefix[i].unicode();
+            QMap<quint16,int>::const_iterator cit = trie[n].children.find( ch );
+            if ( cit == trie[n].children.end() )
+            {
+                trie.append( TrieNode() );
+                trie[n].children.insert( ch, trie.count() - 1 );
+                n = trie.count() - 1;
+            }
+            else
+            {
+                n = *cit;
+            }
+        }
+        quint16 p = profileIndex.value( wit.key() );
+        if ( !trie[n].profiles.contains( p ))
+            trie[n].profiles.append( p );
+    }
+    if ( wildcards.isEmpty() )
+        trie.clear();
+
+    quint32 edgeCount = 0;
+    for ( int i = 0; i < trie.count(); ++i )
+        edgeCount += trie[i].children.count();
+
+    TableHeader h;
+    ::memset( &h, 0, sizeof(h) );
+    h.magic = TableMagic;
+    h.version = TableVersion;
+    h.generation = generation;
+    h.profileCount = profileNames.count();
+    h.profilesOffset = sizeof(TableHeader);
+    h.programsOffset = h.profilesOffset + h.profileCount * sizeof(quint32);
+    h.seedCount = seedCount;
+    h.seedsOffset = h.programsOffset + 256 * sizeof(quint32);
+    h.slotCount = slotCount;
+    h.slotsOffset = h.seedsOffset + seedCount * sizeof(quint32);
+    h.nodeCount = trie.count();
+    h.nodesOffset = h.slotsOffset + slotCount * sizeof(TableSlot);
+    h.edgeCount = edgeCount;
+    h.edgesOffset = h.nodesOffset + h.nodeCount * sizeof(TableNode);
+
+    TableWriter writer;
+    writer.setPoolBase( h.edgesOffset + edgeCount * sizeof(TableEdge) );
+
+    QVector<quint32> profiles( profileNames.count() );
+    for ( int i = 0; i < profileNames.count(); ++i )
+        profiles[i] = writer.addString( profileNames[i] );
+
+    QVector<quint32> programs( 256, 0 );
+    QMap<unsigned char,QStringList>::const_iterator pit = policies.begin();
+    for ( ; pit != policies.end(); ++pit )
+    {
+        QList<quint16> list;
+        foreach ( const QString &p, *pit )
+            list.append( profileIndex.value( p ));
+        programs[pit.key()] = writer.addList( list );
+    }
+
+    QVector<TableSlot> tableSlots( slotCount );
+    for ( quint32 s = 0; s < slotCount; ++s )
+    {
+        tableSlots[s].name = 0;
+        tableSlots[s].profiles = 0;
+        if ( slotNames[s] == -1 )
+            continue;
+        const QString &name = names[slotNames[s]];
+        QList<quint16> list;
+        foreach ( const QString &p, requests.values( name ))
+            list.append( profileIndex.value( p ));
+        tableSlots[s].name = writer.addString( name );
+        tableSlots[s].profiles = writer.addList( list );
+    }
+
+    QVector<TableNode> nodes( trie.count() );
+    QVector<TableEdge> edges;
+    for ( int i = 0; i < trie.count(); ++i )
+    {
+        nodes[i].firstEdge = edges.count();
+        nodes[i].edgeCount = trie[i].children.count();
+        QList<quint16> list = trie[i].profiles;
+        qSort( list );
+        nodes[i].profiles = writer.addList( list );
+        QMap<quint16,int>::const_iterator cit = trie[i].children.begin();
+        for ( ; cit != trie[i].children.end(); ++cit )
+        {
+            TableEdge e;
+            e.ch = cit.key();
+            e.node = *cit;
+            edges.append( e );
+        }
+    }
+
+    h.size = h.edgesOffset + edgeCount * sizeof(TableEdge) + writer.pool.size();
+
+    QByteArray out;
+    out.reserve( h.size );
+    out.append( QByteArray( reinterpret_cast<const char *>( &h ), sizeof(h) ));
+    appendArray( out, profiles );
+    appendArray( out, programs );
+    appendArray( out, seeds );
+    appendArray( out, tableSlots );
+    appendArray( out, nodes );
+    appendArray( out, edges );
+    out.append( writer.pool );
+    Q_ASSERT( (quint32)out.size() == h.size );
+
+    QString newFileName = fileName + QLatin1String(".new");
+    QFile tf( newFileName );
+    if ( !tf.open( QIODevice::WriteOnly | QIODevice::Truncate ))
+    {
+        qWarning( "error opening %s", qPrintable( newFileName ));
+        return false;
+    }
+    if ( tf.write( out ) != out.size() || !tf.flush() || ::fsync( tf.handle() ) != 0 )
+    {
+        qWarning( "error writing %s", qPrintable( newFileName ));
+        tf.close();
+        QFile::remove( newFileName );
+        return false;
+    }
+    tf.close();
+
+    if ( ::rename( QFile::encodeName( newFileName ).constData(),
+                   QFile::encodeName( fileName ).constData() ) != 0 )
+    {
+        qWarning( "error renaming %s: %s", qPrintable( newFileName ), strerror( errno ));
+        QFile::remove( newFileName );
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,73 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef QSXEPOLICYTABLE_P_H
+#define QSXEPOLICYTABLE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Extended API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+
+class SXEPolicyTable
+{
+public:
+    SXEPolicyTable();
+    ~SXEPolicyTable();
+
+    bool open( const QString &fileName );
+    void close();
+    bool isOpen() const { return data != 0; }
+    quint32 generation() const;
+
+    QStringList policy( unsigned char progId ) const;
+    QStringList requestProfiles( const QString &request ) const;
+    QString matchWildcard( const QString &request, const QStringList &profs ) const;
+
+    static quint32 readGeneration( const QString &fileName );
+    static bool readProfiles( const QString &fileName,
+                              QMultiHash<QString,QString> *requests,
+                              QMap<QString,QString> *wildcards );
+    static bool compile( const QString &fileName,
+                         const QMap<unsigned char,QStringList> &policies,
+                         const QMultiHash<QString,QString> &requests,
+                         const QMap<QString,QString> &wildcards,
+                         quint32 generation );
+
+private:
+    QString stringAt( quint32 offset ) const;
+    bool stringEquals( quint32 offset, const QString &s ) const;
+    const quint16 *listAt( quint32 offset, quint16 *count ) const;
+
+    const char *data;
+    quint32 size;
+};
+
+#endif
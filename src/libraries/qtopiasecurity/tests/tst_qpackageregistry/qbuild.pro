@@ -5,7 +5,8 @@ SOURCEPATH+=/src/libraries/qtopiasecurity
 requires(enable_sxe)
 
 TARGET=tst_qpackageregistry
-SOURCES=tst_qpackageregistry.cpp
+SOURCES=tst_qpackageregistry.cpp\
+    qsxepolicytable.cpp
 
 # VPATH+=$$QTOPIA_DEPOT_PATH/src/libraries/qtopiasecurity
 # INCLUDEPATH+=$$QTOPIA_DEPOT_PATH/src/libraries/qtopiasecurity
@@ -22,6 +22,7 @@
 #include <shared/qtopiaunittest.h>
 #include <qtopiaglobal.h>
 #include <qpackageregistry.h>
+#include "qsxepolicytable_p.h"
 #include <qtopianamespace.h>
 #include <qtransportauth_qws.h>
 #include <sys/mman.h>
@@ -105,6 +106,7 @@ private slots:
     void init();
     void cleanup();
     void tst_registerBinary_PackageDownload();
+    void tst_policyTable();
 private:
     void deletePath( const QFileInfo &p );
     static bool isByteStringInFile( const char *bytes, int len, const QString &fileName );
@@ -287,3 +289,59 @@ void tst_QPackageRegistry::tst_registerBinary_PackageDownload()
     QVERIFY( thePackage.id == 1 );
     QVERIFY( isByteStringInFile( thePackage.key, QSXE_KEY_LEN, thePackage.absolutePath() ));
 }
+
+/*?
+  Test that a compiled policy table answers policy, request and wildcard
+  lookups the same way as the text policy and profiles files.
+*/
+void tst_QPackageRegistry::tst_policyTable()
+{
+    QMap<unsigned char,QStringList> policies;
+    policies[0] = QStringList() << "none";
+    policies[1] = QStringList() << "test_domain" << "window";
+
+    QMultiHash<QString,QString> requests;
+    requests.insert( "openURL(QString)", "web" );
+    requests.insert( "raise()", "window" );
+    requests.insert( "raise()", "allow" );
+    requests.insert( "removeEvent(PimEvent)", "admin" );
+
+    QMap<QString,QString> wildcards;
+    wildcards.insertMulti( "window", "QPE/Application/" );
+    wildcards.insertMulti( "deny", "QPE/Application/secret" );
+    wildcards.insertMulti( "test_domain", "" );
+
+    QString tableFn = tmpPkr->sxeConfPath() + "/" + QPackageRegistry::policyTableFileName;
+    QVERIFY( SXEPolicyTable::compile( tableFn, policies, requests, wildcards, 7 ));
+    QCOMPARE( SXEPolicyTable::readGeneration( tableFn ), (quint32)7 );
+    QVERIFY( !QFile::exists( tableFn + ".new" ));
+
+    SXEPolicyTable table;
+    QVERIFY( table.open( tableFn ));
+    QCOMPARE( table.generation(), (quint32)7 );
+
+    QCOMPARE( table.policy( 0 ), QStringList() << "none" );
+    QCOMPARE( table.policy( 1 ), QStringList() << "test_domain" << "window" );
+    QVERIFY( table.policy( 2 ).isEmpty() );
+
+    QCOMPARE( table.requestProfiles( "openURL(QString)" ), QStringList() << "web" );
+    QCOMPARE( table.requestProfiles( "raise()" ), requests.values( "raise()" ));
+    QVERIFY( table.requestProfiles( "lower()" ).isEmpty() );
+    QVERIFY( table.requestProfiles( "" ).isEmpty() );
+
+    QStringList profs = QStringList() << "window" << "deny" << "allow";
+    QCOMPARE( table.matchWildcard( "QPE/Application/clock", profs ), QString( "window" ));
+    QCOMPARE( table.matchWildcard( "QPE/Application/secretStuff", profs ), QString( "deny" ));
+    QVERIFY( table.matchWildcard( "QPE/System", profs ).isNull() );
+    QCOMPARE( table.matchWildcard( "QPE/System", QStringList() << "test_domain" ), QString( "test_domain" ));
+    QVERIFY( table.matchWildcard( "QPE/Application/clock", QStringList() ).isNull() );
+
+    // a corrupt table must be refused so the text files are used instead
+    table.close();
+    QFile tf( tableFn );
+    QVERIFY( tf.open( QIODevice::ReadWrite ));
+    tf.resize( tf.size() - 2 );
+    tf.close();
+    QVERIFY( !table.open( tableFn ));
+    QVERIFY( !table.isOpen() );
+}
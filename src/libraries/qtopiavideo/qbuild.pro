@@ -21,9 +21,14 @@ HEADERS=\
     qcameratools.h\
     qtopiavideo.h\
     qvideoframe.h\
+    qvideoframepool.h\
     qimageplanetransform.h\
     qvideosurface.h
 
+PRIVATE_HEADERS=\
+    qvideoframepool_p.h\
+    qyuvconvert_p.h
+
 SOURCES=\
     qcameracontrol.cpp\
     qcameradeviceplugin.cpp\
@@ -31,7 +36,11 @@ SOURCES=\
     qcameratools.cpp\
     qtopiavideo.cpp\
     qvideoframe.cpp\
-    qimageplanetransform.cpp
+    qvideoframepool.cpp\
+    qimageplanetransform.cpp\
+    qyuvconvert.cpp\
+    qyuvconvert_sse2.cpp\
+    qyuvconvert_neon.cpp
 
 QWS [
     TYPE=CONDITIONAL_SOURCES
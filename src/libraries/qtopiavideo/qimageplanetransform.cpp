@@ -20,7 +20,9 @@
 #include "qimageplanetransform.h"
 #include <QVector>
 #include <QDebug>
+#include <string.h>
 #include "def_blendhelper.h"
+#include "qyuvconvert_p.h"
 
 #define CHECK_SRC_BOUNDARIES 0
 
@@ -172,6 +174,26 @@ static void makeJumpsTable( int *table, int from, int to, int multiplier = 1 )
     return;
 }
 
+/* internal:
+ * Turn a jumps table into absolute source coordinates, starting from "start".
+ * scalePlane() applies the jump before using the coordinate in the outer
+ * loop (preIncrement) and after it in the inner loop.
+ */
+static void makeIndexTable( int *table, int count, int start, bool preIncrement )
+{
+    int pos = start;
+    for ( int i=0; i<count; i++ ) {
+        int jump = table[i];
+        if ( preIncrement ) {
+            pos += jump;
+            table[i] = pos;
+        } else {
+            table[i] = pos;
+            pos += jump;
+        }
+    }
+}
+
 #ifdef QT_ARCH_ARMV5E
 #define PLD(src) \
     asm volatile("pld [%0, #32]\n\t" \
@@ -376,7 +398,7 @@ static void scalePlane( int* htable, int*vtable,
 
         int from_x = 0;
         int src_shift = 0; //since we are starting to copy src not from top/bottom, we need to calculate the shift
-        while ( from_x < dstRect.width()-1 ) {
+        while ( from_x < dstRect.width() ) {
             int to_x = qMin( from_x+columnWidth, dstRect.width() );
 
             int src_x = src_start_x;
@@ -431,7 +453,7 @@ static void scalePlane( int* htable, int*vtable,
 
         int from_x = 0;
         int src_shift = 0; //since we are starting to copy src not from top/bottom, we need to calculate the shift
-        while ( from_x < dstRect.width()-1 ) {
+        while ( from_x < dstRect.width() ) {
             int to_x = qMin( from_x+columnWidth, dstRect.width() );
 
             int src_x = src_start_x;
@@ -475,6 +497,114 @@ typedef void (*ScalePlaneFunction)(int*,int*,
                                QtopiaVideo::VideoRotation);
 
 
+/* internal:
+ * Source planes of a YUV image, line steps are in bytes.
+ * For packed formats only the first plane is used.
+ */
+struct YuvPlanes
+{
+    const uchar *data[3];
+    int lineStep[3];
+};
+
+class SampleHelperYUV420P {
+public:
+    static inline void sample( const YuvPlanes &src, int x, int y, uchar *py, uchar *pu, uchar *pv ) {
+        *py = src.data[0][y*src.lineStep[0] + x];
+        *pu = src.data[1][(y>>1)*src.lineStep[1] + (x>>1)];
+        *pv = src.data[2][(y>>1)*src.lineStep[2] + (x>>1)];
+    }
+};
+
+class SampleHelperUYVY {
+public:
+    static inline void sample( const YuvPlanes &src, int x, int y, uchar *py, uchar *pu, uchar *pv ) {
+        const uchar *macropixel = src.data[0] + y*src.lineStep[0] + (x & ~1)*2;
+        *pu = macropixel[0];
+        *py = macropixel[1 + ((x & 1) << 1)];
+        *pv = macropixel[2];
+    }
+};
+
+class SampleHelperYUYV {
+public:
+    static inline void sample( const YuvPlanes &src, int x, int y, uchar *py, uchar *pu, uchar *pv ) {
+        const uchar *macropixel = src.data[0] + y*src.lineStep[0] + (x & ~1)*2;
+        *py = macropixel[(x & 1) << 1];
+        *pu = macropixel[1];
+        *pv = macropixel[3];
+    }
+};
+
+/** Scale, rotate and convert the YUV image to RGB in one pass.
+ *  Destination lines follow the index tables built from the scalePlane()
+ *  jump tables; with 90 and 270 degrees rotations (transposed)
+ *  a destination line walks along a source column.
+ *  Samples are gathered into Y, U and V line buffers and converted while
+ *  still in cache. When upscaling horizontally the source line is converted
+ *  instead and the RGB pixels are gathered, so each pixel is converted once,
+ *  and repeated source lines are copied from the previous destination line.
+ *  lineBuffer must hold 3+sizeof(DstT) bytes for the longest line.
+ */
+template <class SampleHelper, typename DstT>
+static void scaleYuvPlane( const int *lineIndex, const int *pixelIndex, bool transposed,
+                           const YuvPlanes &src,
+                           void *vdst, int dstLineStep, const QRect& dstRect,
+                           QYuvToRgbFunction convert, uchar *lineBuffer )
+{
+    int w = dstRect.width();
+    int h = dstRect.height();
+
+    int from = qMin( pixelIndex[0], pixelIndex[w-1] );
+    int span = qAbs( pixelIndex[w-1] - pixelIndex[0] ) + 1;
+    bool convertSourceLine = !transposed && span < w;
+    int length = convertSourceLine ? span : w;
+
+    uchar *ybuf = lineBuffer;
+    uchar *ubuf = ybuf + length;
+    uchar *vbuf = ubuf + length;
+    DstT *rgbLine = (DstT*)( vbuf + length );
+
+    DstT *dst = (DstT *)vdst;
+    DstT *dstbits = dst + dstRect.top()*dstLineStep + dstRect.left();
+
+    for ( int y=0; y<h; y++, dstbits += dstLineStep ) {
+        int line = lineIndex[y];
+
+        if ( y > 0 && line == lineIndex[y-1] ) {
+            memcpy( dstbits, dstbits - dstLineStep, w*sizeof(DstT) );
+            continue;
+        }
+
+        if ( convertSourceLine ) {
+            for ( int x=0; x<span; x++ )
+                SampleHelper::sample( src, from+x, line, ybuf+x, ubuf+x, vbuf+x );
+
+            convert( ybuf, ubuf, vbuf, span, rgbLine );
+
+            const DstT *rgbbits = rgbLine - from;
+            for ( int x=0; x<w; x++ )
+                dstbits[x] = rgbbits[pixelIndex[x]];
+        } else {
+            if ( transposed ) {
+                for ( int x=0; x<w; x++ )
+                    SampleHelper::sample( src, line, pixelIndex[x], ybuf+x, ubuf+x, vbuf+x );
+            } else {
+                for ( int x=0; x<w; x++ )
+                    SampleHelper::sample( src, pixelIndex[x], line, ybuf+x, ubuf+x, vbuf+x );
+            }
+
+            convert( ybuf, ubuf, vbuf, w, dstbits );
+        }
+    }
+}
+
+typedef void (*ScaleYuvPlaneFunction)(const int*, const int*, bool,
+                                      const YuvPlanes&,
+                                      void*, int, const QRect&,
+                                      QYuvToRgbFunction, uchar*);
+
+
 
 
 class QImagePlaneTransformationPrivate
@@ -493,6 +623,11 @@ public:
     QVector<int> htable;
     QVector<int> vtable;
 
+    //absolute source coordinates for the YUV paths
+    QVector<int> lineIndex;
+    QVector<int> pixelIndex;
+    QVector<uchar> yuvLineBuffer;
+
     QtopiaVideo::VideoRotation rotation;
     int geometryAlignment;
 
@@ -501,6 +636,8 @@ public:
     void initTables();
     QRect aligned( const QRect& );
     ScalePlaneFunction scaleFunction( QVideoFrame::PixelFormat srcFormat, QVideoFrame::PixelFormat dstFormat );
+    bool isYuvTransformationSupported( QVideoFrame::PixelFormat srcFormat, QVideoFrame::PixelFormat dstFormat ) const;
+    void transformYuv( const YuvPlanes& src, QVideoFrame::PixelFormat srcFormat, void *dst, QVideoFrame::PixelFormat dstFormat );
 
 private:
     QMap<QVideoFrame::PixelFormat, QMap<QVideoFrame::PixelFormat, ScalePlaneFunction > > scaleFunctions;
@@ -555,6 +692,38 @@ void QImagePlaneTransformationPrivate::initTables()
         makeJumpsTable( htable.data(), sw, dh, -1 );
         makeJumpsTable( vtable.data(), sh, dw, srcLineStep );
     };
+
+    //the same sampling positions as scalePlane(), but independent of line step,
+    //since YUV planes have different ones
+    lineIndex.resize(dh);
+    pixelIndex.resize(dw);
+    yuvLineBuffer.resize( qMax( qMax(sw, sh), qMax(dw, dh) ) * ( 3 + sizeof(quint32) ) );
+
+    switch ( rotation ) {
+    case QtopiaVideo::Rotate0:
+        makeJumpsTable( lineIndex.data(), sh, dh );
+        makeJumpsTable( pixelIndex.data(), sw, dw );
+        makeIndexTable( lineIndex.data(), dh, srcClippedRect.top(), true );
+        makeIndexTable( pixelIndex.data(), dw, srcClippedRect.left(), false );
+        break;
+    case QtopiaVideo::Rotate180:
+        makeJumpsTable( lineIndex.data(), sh, dh, -1 );
+        makeJumpsTable( pixelIndex.data(), sw, dw, -1 );
+        makeIndexTable( lineIndex.data(), dh, srcClippedRect.bottom(), true );
+        makeIndexTable( pixelIndex.data(), dw, srcClippedRect.right(), false );
+        break;
+    case QtopiaVideo::Rotate90:
+        makeJumpsTable( lineIndex.data(), sw, dh );
+        makeJumpsTable( pixelIndex.data(), sh, dw, -1 );
+        makeIndexTable( lineIndex.data(), dh, srcClippedRect.left(), true );
+        makeIndexTable( pixelIndex.data(), dw, srcClippedRect.bottom(), false );
+        break;
+    case QtopiaVideo::Rotate270:
+        makeJumpsTable( lineIndex.data(), sw, dh, -1 );
+        makeJumpsTable( pixelIndex.data(), sh, dw );
+        makeIndexTable( lineIndex.data(), dh, srcClippedRect.right(), true );
+        makeIndexTable( pixelIndex.data(), dw, srcClippedRect.top(), false );
+    };
 }
 
 
@@ -616,11 +785,60 @@ ScalePlaneFunction QImagePlaneTransformationPrivate::scaleFunction( QVideoFrame:
     return scaleFunctions[ srcFormat ].value( dstFormat, 0 );
 }
 
+bool QImagePlaneTransformationPrivate::isYuvTransformationSupported( QVideoFrame::PixelFormat srcFormat, QVideoFrame::PixelFormat dstFormat ) const
+{
+    switch ( srcFormat ) {
+    case QVideoFrame::Format_YUV420P:
+    case QVideoFrame::Format_YV12:
+    case QVideoFrame::Format_UYVY:
+    case QVideoFrame::Format_YUYV:
+        break;
+    default:
+        return false;
+    }
+
+    return dstFormat == QVideoFrame::Format_RGB565 ||
+           dstFormat == QVideoFrame::Format_RGB32 ||
+           dstFormat == QVideoFrame::Format_ARGB32;
+}
+
+void QImagePlaneTransformationPrivate::transformYuv( const YuvPlanes& src, QVideoFrame::PixelFormat srcFormat, void *dst, QVideoFrame::PixelFormat dstFormat )
+{
+    bool rgb565 = dstFormat == QVideoFrame::Format_RGB565;
+
+    ScaleYuvPlaneFunction scaleYuvFunction = 0;
+    switch ( srcFormat ) {
+    case QVideoFrame::Format_YUV420P:
+    case QVideoFrame::Format_YV12:
+        scaleYuvFunction = rgb565 ? scaleYuvPlane<SampleHelperYUV420P,quint16> : scaleYuvPlane<SampleHelperYUV420P,quint32>;
+        break;
+    case QVideoFrame::Format_UYVY:
+        scaleYuvFunction = rgb565 ? scaleYuvPlane<SampleHelperUYVY,quint16> : scaleYuvPlane<SampleHelperUYVY,quint32>;
+        break;
+    case QVideoFrame::Format_YUYV:
+        scaleYuvFunction = rgb565 ? scaleYuvPlane<SampleHelperYUYV,quint16> : scaleYuvPlane<SampleHelperYUYV,quint32>;
+        break;
+    default:
+        return;
+    }
+
+    QYuvToRgbFunction convert = rgb565 ? q_yuvToRgb565Function() : q_yuvToRgb32Function();
+
+    bool transposed = rotation == QtopiaVideo::Rotate90 || rotation == QtopiaVideo::Rotate270;
+
+    scaleYuvFunction( lineIndex.constData(), pixelIndex.constData(), transposed,
+                      src,
+                      dst, dstLineStep, dstClippedRect,
+                      convert, yuvLineBuffer.data() );
+}
+
 
 QImagePlaneTransformation::QImagePlaneTransformation()
     :d( new QImagePlaneTransformationPrivate )
 {
     d->isModified = true;
+    d->srcLineStep = 0;
+    d->dstLineStep = 0;
     d->rotation = QtopiaVideo::Rotate0;
     d->geometryAlignment = 1;
 }
@@ -630,24 +848,40 @@ QImagePlaneTransformation::~QImagePlaneTransformation()
     delete d;
 }
 
+//the setters keep the tables if nothing changed, so they are cheap to call for every frame
 void QImagePlaneTransformation::setSrcGeometry( const QRect& srcRect, const QRect& srcClipRect, int srcLineStep )
 {
-    d->srcRect = srcRect.normalized();
-    d->srcArea = srcClipRect.normalized();
+    QRect rect = srcRect.normalized();
+    QRect area = srcClipRect.normalized();
+
+    if ( rect == d->srcRect && area == d->srcArea && srcLineStep == d->srcLineStep )
+        return;
+
+    d->srcRect = rect;
+    d->srcArea = area;
     d->srcLineStep = srcLineStep;
     d->isModified = true;
 }
 
 void QImagePlaneTransformation::setDstGeometry( const QRect& dstRect, const QRect& dstClipRect, int dstLineStep )
 {
-    d->dstRect = dstRect.normalized();
-    d->dstArea = dstClipRect.normalized();
+    QRect rect = dstRect.normalized();
+    QRect area = dstClipRect.normalized();
+
+    if ( rect == d->dstRect && area == d->dstArea && dstLineStep == d->dstLineStep )
+        return;
+
+    d->dstRect = rect;
+    d->dstArea = area;
     d->dstLineStep = dstLineStep;
     d->isModified = true;
 }
 
 void QImagePlaneTransformation::setRotation( QtopiaVideo::VideoRotation rotation )
 {
+    if ( rotation == d->rotation )
+        return;
+
     d->rotation = rotation;
     d->isModified = true;
 }
@@ -719,28 +953,84 @@ void QImagePlaneTransformation::transformPlane( const quint32 *src, quint32 *dst
    and RGB colorspace if necessary.
    Return true if the colorspace conversion is supported
    and plane was successwfully transformed.
+
+   Packed YUV sources (Format_UYVY, Format_YUYV) are converted to RGB
+   in the same pass, planar ones need the QVideoFrame overload.
 */
 bool QImagePlaneTransformation::transformPlane( const void *src, QVideoFrame::PixelFormat srcFormat, void *dst, QVideoFrame::PixelFormat dstFormat )
 {
     d->initTables();
 
+    ScalePlaneFunction scalePlaneFunction = d->scaleFunction( srcFormat, dstFormat );
+    bool packedYuv = !scalePlaneFunction &&
+                     !QVideoFrame::isPlanar( srcFormat ) &&
+                     d->isYuvTransformationSupported( srcFormat, dstFormat );
+
+    if ( !scalePlaneFunction && !packedYuv )
+        return false;
+
     if ( d->srcClippedRect.isEmpty() || d->dstClippedRect.isEmpty() )
         return true;
 
-    ScalePlaneFunction scalePlaneFunction = d->scaleFunction( srcFormat, dstFormat );
     if ( scalePlaneFunction ) {
         scalePlaneFunction( d->htable.data(), d->vtable.data(),
                             src, d->srcLineStep, d->srcClippedRect,
                             dst, d->dstLineStep, d->dstClippedRect,
                             d->rotation );
-        return true;
-    } else
+    } else {
+        YuvPlanes planes;
+        planes.data[0] = (const uchar*)src;
+        planes.lineStep[0] = d->srcLineStep*2;
+        d->transformYuv( planes, srcFormat, dst, dstFormat );
+    }
+
+    return true;
+}
+
+/*!
+   Transform the \a frame to \a dst, like the plane based overload does,
+   taking the planes and line steps from the frame itself.
+   Planar YUV frames are converted to RGB in one pass together with
+   scaling and rotation, without intermediate buffers.
+   Only the first plane is transformed for the other formats,
+   the source line step set with setSrcGeometry() is used for them.
+*/
+bool QImagePlaneTransformation::transformPlane( const QVideoFrame& frame, void *dst, QVideoFrame::PixelFormat dstFormat )
+{
+    QVideoFrame::PixelFormat srcFormat = frame.format();
+
+    if ( !QVideoFrame::isPlanar( srcFormat ) || d->scaleFunction( srcFormat, dstFormat ) )
+        return transformPlane( frame.planeData(0), srcFormat, dst, dstFormat );
+
+    if ( !d->isYuvTransformationSupported( srcFormat, dstFormat ) )
         return false;
+
+    d->initTables();
+
+    if ( d->srcClippedRect.isEmpty() || d->dstClippedRect.isEmpty() )
+        return true;
+
+    //YV12 stores V before U
+    int uPlane = srcFormat == QVideoFrame::Format_YV12 ? 2 : 1;
+    int vPlane = 3 - uPlane;
+
+    YuvPlanes planes;
+    planes.data[0] = frame.planeData(0);
+    planes.data[1] = frame.planeData(uPlane);
+    planes.data[2] = frame.planeData(vPlane);
+    planes.lineStep[0] = frame.bytesPerLine(0);
+    planes.lineStep[1] = frame.bytesPerLine(uPlane);
+    planes.lineStep[2] = frame.bytesPerLine(vPlane);
+
+    d->transformYuv( planes, srcFormat, dst, dstFormat );
+
+    return true;
 }
 
 
 
 bool QImagePlaneTransformation::isTransformationSupported( QVideoFrame::PixelFormat srcFormat, QVideoFrame::PixelFormat dstFormat )
 {
-    return d->scaleFunction( srcFormat, dstFormat ) != 0;
+    return d->scaleFunction( srcFormat, dstFormat ) != 0 ||
+           d->isYuvTransformationSupported( srcFormat, dstFormat );
 }
@@ -48,6 +48,7 @@ public:
 
     bool isTransformationSupported( QVideoFrame::PixelFormat srcFormat, QVideoFrame::PixelFormat dstFormat );
     bool transformPlane( const void *src, QVideoFrame::PixelFormat srcFormat, void *dst, QVideoFrame::PixelFormat dstFormat );
+    bool transformPlane( const QVideoFrame& frame, void *dst, QVideoFrame::PixelFormat dstFormat );
 
 
 private:
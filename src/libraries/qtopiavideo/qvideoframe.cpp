@@ -18,6 +18,7 @@
 ****************************************************************************/
 
 #include "qvideoframe.h"
+#include "qvideoframepool_p.h"
 #include <QImage>
 #include <QDebug>
 
@@ -107,17 +108,24 @@ QVideoFramePrivate::QVideoFramePrivate( const QVideoFramePrivate& other )
 
     allocateOwnPlanes();
 
+    bool copied = false;
+
     for ( int plane=0; plane < maxPlanesCount; ++plane ) {
         bytesPerLine[plane] = other.bytesPerLine[plane];
         constPlanes[plane] = 0;
 
         if ( other.planes[plane] ) {
             memcpy( planes[plane], other.planes[plane], planeSize(plane).height()*bytesPerLine[plane] );
+            copied = true;
         } else if ( other.constPlanes[plane] ) {
             memcpy( planes[plane], other.constPlanes[plane], planeSize(plane).height()*bytesPerLine[plane] );
+            copied = true;
         }
     }
 
+    if ( copied )
+        q_videoFrameCopied();
+
     aspectRatio = other.aspectRatio;
     isAspectRatioDefined = other.isAspectRatioDefined;
 }
@@ -159,6 +167,7 @@ void QVideoFramePrivate::allocateOwnPlanes()
 
     if ( totalSize ) {
         planes[0] = (uchar *)malloc( totalSize );
+        q_videoFrameAllocated();
         for ( int plane = 1; plane < maxPlanesCount; plane++ ) {
             if ( planeSizes[plane] )
                 planes[plane] = planes[plane-1] + planeSizes[plane-1];
@@ -183,7 +192,7 @@ void QVideoFramePrivate::copyPlanes()
     for ( int plane=0; plane < maxPlanesCount; ++plane ) {
         if ( constPlanes[plane] ) {
             Q_ASSERT( planes[plane] != 0 );
-            memcpy( planes[plane], constPlanes[plane], size.height()*bytesPerLine[plane] );
+            memcpy( planes[plane], constPlanes[plane], planeSize(plane).height()*bytesPerLine[plane] );
             constPlanes[plane] = 0;
             copied = true;
         }
@@ -193,6 +202,9 @@ void QVideoFramePrivate::copyPlanes()
 
     ownData = true;
 
+    if ( copied )
+        q_videoFrameCopied();
+
     if ( copied && bufferHelper ) {
         bufferHelper->unlock();
         bufferHelper = 0;
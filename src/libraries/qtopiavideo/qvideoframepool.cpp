@@ -0,0 +1,349 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qvideoframepool.h"
+#include "qvideoframepool_p.h"
+
+#include <QMutex>
+#include <QList>
+#include <QAtomicInt>
+
+#include <stdlib.h>
+#include <new>
+
+static QAtomicInt allocationCount;
+static QAtomicInt copyCount;
+static QAtomicInt recycleCount;
+
+void q_videoFrameAllocated()
+{
+    allocationCount.fetchAndAddRelaxed( 1 );
+}
+
+void q_videoFrameCopied()
+{
+    copyCount.fetchAndAddRelaxed( 1 );
+}
+
+
+/*
+    A pool buffer is a header followed by the frame data, the header is also
+    the QVideoFrame::BufferHelper of the frames using it, so frames reference
+    the buffer without any extra allocation.
+*/
+class QVideoFramePoolBuffer : public QVideoFrame::BufferHelper
+{
+public:
+    QVideoFramePoolBuffer( QVideoFramePoolPrivate *pool, int size )
+        : pool( pool ), size( size ), refs( 0 ) {}
+
+    void lock() { refs.ref(); }
+    void unlock();
+
+    uchar *data();
+    static QVideoFramePoolBuffer *fromData( uchar *data );
+
+    QVideoFramePoolPrivate *pool;
+    int size;
+    QAtomicInt refs;
+};
+
+// keeps the data as aligned as malloc() returns it
+static const int headerSize = ( sizeof(QVideoFramePoolBuffer) + 15 ) & ~15;
+
+inline uchar *QVideoFramePoolBuffer::data()
+{
+    return reinterpret_cast<uchar*>( this ) + headerSize;
+}
+
+inline QVideoFramePoolBuffer *QVideoFramePoolBuffer::fromData( uchar *data )
+{
+    return reinterpret_cast<QVideoFramePoolBuffer*>( data - headerSize );
+}
+
+
+class QVideoFramePoolPrivate
+{
+public:
+    QVideoFramePoolPrivate( int maxFreeBuffers )
+        : ref( 1 ), maxFreeBuffers( maxFreeBuffers ), closed( false ) {}
+
+    ~QVideoFramePoolPrivate()
+    {
+        clear();
+    }
+
+    QVideoFramePoolBuffer *acquire( int size );
+    void release( QVideoFramePoolBuffer *buffer );
+    void clear();
+
+    static void destroy( QVideoFramePoolBuffer *buffer );
+
+    //one reference for the pool, one for each buffer in use
+    QAtomicInt ref;
+    QMutex mutex;
+    QList<QVideoFramePoolBuffer*> freeBuffers;
+    int maxFreeBuffers;
+    bool closed;
+};
+
+QVideoFramePoolBuffer *QVideoFramePoolPrivate::acquire( int size )
+{
+    ref.ref();
+
+    {
+        QMutexLocker locker( &mutex );
+        for ( int i = 0; i < freeBuffers.count(); ++i ) {
+            if ( freeBuffers[i]->size == size ) {
+                recycleCount.fetchAndAddRelaxed( 1 );
+                return freeBuffers.takeAt( i );
+            }
+        }
+    }
+
+    void *memory = malloc( headerSize + size );
+    if ( !memory ) {
+        ref.deref();
+        return 0;
+    }
+
+    allocationCount.fetchAndAddRelaxed( 1 );
+    return new (memory) QVideoFramePoolBuffer( this, size );
+}
+
+void QVideoFramePoolPrivate::release( QVideoFramePoolBuffer *buffer )
+{
+    {
+        QMutexLocker locker( &mutex );
+        if ( !closed && freeBuffers.count() < maxFreeBuffers ) {
+            freeBuffers.append( buffer );
+            buffer = 0;
+        }
+    }
+
+    if ( buffer )
+        destroy( buffer );
+
+    if ( !ref.deref() )
+        delete this;
+}
+
+void QVideoFramePoolPrivate::clear()
+{
+    QList<QVideoFramePoolBuffer*> buffers;
+    {
+        QMutexLocker locker( &mutex );
+        buffers = freeBuffers;
+        freeBuffers.clear();
+    }
+
+    foreach ( QVideoFramePoolBuffer *buffer, buffers )
+        destroy( buffer );
+}
+
+void QVideoFramePoolPrivate::destroy( QVideoFramePoolBuffer *buffer )
+{
+    buffer->~QVideoFramePoolBuffer();
+    free( buffer );
+}
+
+void QVideoFramePoolBuffer::unlock()
+{
+    if ( !refs.deref() )
+        pool->release( this );
+}
+
+
+/*!
+    \class QVideoFramePool
+    \inpublicgroup QtMediaModule
+    \brief The QVideoFramePool class recycles video frame buffers between producers and video outputs.
+
+    Frames allocated from a pool return their buffer to it when the last copy
+    of the frame is destroyed, so a camera or decoder producing frames of the
+    same format and size at a steady rate stops allocating after the first few
+    frames.  The frame data can be written in place with
+    QVideoFrame::planeData() as long as the frame is not shared.
+
+    Producers which fill buffers of their own, like GStreamer elements,
+    can use allocateBuffer() and wrap the buffer with frameFromBuffer()
+    when it is ready for display, without copying it.
+
+    The pool is thread safe, and buffers may be released from any thread.
+    Frames may outlive the pool, their buffers are freed when released.
+
+    counters() reports how many frame buffers were allocated, copied
+    and recycled, by pools and by QVideoFrame itself, to verify that
+    a video path does not allocate or copy frames in steady state.
+*/
+
+/*!
+    \class QVideoFramePool::Counters
+    \inpublicgroup QtMediaModule
+    \brief The Counters class holds the video frame allocation statistics.
+
+    \c allocations counts the frame buffers allocated by pools or QVideoFrame,
+    \c copies counts the deep copies of frame data when frames are detached,
+    \c recycled counts the buffers reused by pools.
+*/
+
+/*!
+    Constructs a pool which keeps up to \a maxFreeBuffers released buffers for reuse.
+*/
+QVideoFramePool::QVideoFramePool( int maxFreeBuffers )
+    : d( new QVideoFramePoolPrivate( maxFreeBuffers ) )
+{
+}
+
+/*!
+    Destroys the pool and frees the released buffers.
+    Buffers still in use are freed when they are released.
+*/
+QVideoFramePool::~QVideoFramePool()
+{
+    {
+        QMutexLocker locker( &d->mutex );
+        d->closed = true;
+    }
+
+    d->clear();
+
+    if ( !d->ref.deref() )
+        delete d;
+}
+
+/*!
+    Returns a frame with the given \a format and \a size, with its data
+    in a buffer from the pool. The data is not initialized.
+*/
+QVideoFrame QVideoFramePool::allocateFrame( QVideoFrame::PixelFormat format, const QSize& size )
+{
+    int bufferSize = frameBufferSize( format, size );
+    if ( bufferSize == 0 )
+        return QVideoFrame();
+
+    QVideoFramePoolBuffer *buffer = d->acquire( bufferSize );
+    if ( !buffer )
+        return QVideoFrame();
+
+    //the frame locks the buffer, and releases it when the last copy is destroyed
+    return QVideoFrame( format, size, buffer->data(), buffer );
+}
+
+/*!
+    Returns a buffer of \a size bytes from the pool, or 0 if it could not
+    be allocated. The buffer must be released with releaseBuffer().
+*/
+uchar *QVideoFramePool::allocateBuffer( int size )
+{
+    QVideoFramePoolBuffer *buffer = d->acquire( size );
+    if ( !buffer )
+        return 0;
+
+    buffer->lock();
+    return buffer->data();
+}
+
+/*!
+    Releases the buffer \a data returned by allocateBuffer(). Frames created
+    with frameFromBuffer() keep it in use until they are destroyed.
+*/
+void QVideoFramePool::releaseBuffer( uchar *data )
+{
+    if ( data )
+        QVideoFramePoolBuffer::fromData( data )->unlock();
+}
+
+/*!
+    Returns a frame with the given \a format and \a size using the pool buffer
+    \a data returned by allocateBuffer() without copying it.
+    The buffer stays in use as long as the frame or any of its copies exist.
+*/
+QVideoFrame QVideoFramePool::frameFromBuffer( uchar *data, QVideoFrame::PixelFormat format, const QSize& size )
+{
+    return QVideoFrame( format, size, data, QVideoFramePoolBuffer::fromData( data ) );
+}
+
+/*!
+    Returns the number of released buffers kept for reuse.
+*/
+int QVideoFramePool::freeBufferCount() const
+{
+    QMutexLocker locker( &d->mutex );
+    return d->freeBuffers.count();
+}
+
+/*!
+    Frees the released buffers kept for reuse.
+*/
+void QVideoFramePool::clear()
+{
+    d->clear();
+}
+
+Q_GLOBAL_STATIC(QVideoFramePool, videoFramePool);
+
+/*!
+    Returns the pool shared by the video producers and outputs of the process.
+*/
+QVideoFramePool *QVideoFramePool::instance()
+{
+    return videoFramePool();
+}
+
+/*!
+    Returns the number of video frame buffers allocated, copied and recycled
+    since the process started or resetCounters() was called.
+*/
+QVideoFramePool::Counters QVideoFramePool::counters()
+{
+    Counters counters;
+    counters.allocations = allocationCount;
+    counters.copies = copyCount;
+    counters.recycled = recycleCount;
+    return counters;
+}
+
+/*!
+    Resets the counters() to zero.
+*/
+void QVideoFramePool::resetCounters()
+{
+    allocationCount = 0;
+    copyCount = 0;
+    recycleCount = 0;
+}
+
+/*!
+    Returns the number of bytes QVideoFrame uses for the planes of a frame
+    with the given \a format and \a size, with each line 32-bit aligned.
+*/
+int QVideoFramePool::frameBufferSize( QVideoFrame::PixelFormat format, const QSize& size )
+{
+    int total = 0;
+
+    for ( int plane = 0; plane < QVideoFrame::planesCount( format ); ++plane ) {
+        int depth = QVideoFrame::colorDepth( format, plane );
+        QSize planeSize = plane == 0 ? size : size/2;
+
+        total += (( planeSize.width() * depth + 31)/32) * 32 / 8 * planeSize.height();
+    }
+
+    return total;
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef QVIDEOFRAMEPOOL_H
+#define QVIDEOFRAMEPOOL_H
+
+#include "qvideoframe.h"
+
+class QVideoFramePoolPrivate;
+
+class QTOPIAVIDEO_EXPORT QVideoFramePool
+{
+public:
+    struct Counters
+    {
+        int allocations;
+        int copies;
+        int recycled;
+    };
+
+    explicit QVideoFramePool( int maxFreeBuffers = 4 );
+    ~QVideoFramePool();
+
+    QVideoFrame allocateFrame( QVideoFrame::PixelFormat format, const QSize& size );
+
+    uchar *allocateBuffer( int size );
+    static void releaseBuffer( uchar *data );
+    static QVideoFrame frameFromBuffer( uchar *data, QVideoFrame::PixelFormat format, const QSize& size );
+
+    int freeBufferCount() const;
+    void clear();
+
+    static QVideoFramePool *instance();
+
+    static Counters counters();
+    static void resetCounters();
+
+    static int frameBufferSize( QVideoFrame::PixelFormat format, const QSize& size );
+
+private:
+    Q_DISABLE_COPY( QVideoFramePool );
+    QVideoFramePoolPrivate *d;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qyuvconvert_p.h"
+
+void q_yuv_to_rgb565(const uchar *y, const uchar *u, const uchar *v, int count, void *dst)
+{
+    quint16 *out = (quint16 *)dst;
+    int r, g, b;
+
+    for ( int i = 0; i < count; ++i ) {
+        q_yuvToRgb(y[i], u[i], v[i], &r, &g, &b);
+        out[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+void q_yuv_to_rgb32(const uchar *y, const uchar *u, const uchar *v, int count, void *dst)
+{
+    quint32 *out = (quint32 *)dst;
+    int r, g, b;
+
+    for ( int i = 0; i < count; ++i ) {
+        q_yuvToRgb(y[i], u[i], v[i], &r, &g, &b);
+        out[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+/*
+    The SIMD converters are only built when the toolchain targets the
+    instruction set, in which case the whole library already requires it.
+*/
+QYuvToRgbFunction q_yuvToRgb565Function()
+{
+#if defined(QTOPIAVIDEO_HAVE_NEON)
+    return q_yuv_to_rgb565_neon;
+#elif defined(QTOPIAVIDEO_HAVE_SSE2)
+    return q_yuv_to_rgb565_sse2;
+#else
+    return q_yuv_to_rgb565;
+#endif
+}
+
+QYuvToRgbFunction q_yuvToRgb32Function()
+{
+#if defined(QTOPIAVIDEO_HAVE_NEON)
+    return q_yuv_to_rgb32_neon;
+#elif defined(QTOPIAVIDEO_HAVE_SSE2)
+    return q_yuv_to_rgb32_sse2;
+#else
+    return q_yuv_to_rgb32;
+#endif
+}
@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qyuvconvert_p.h"
+
+#ifdef QTOPIAVIDEO_HAVE_NEON
+
+#include <arm_neon.h>
+
+// converts 8 pixels to clamped 8 bit r, g and b
+static inline void yuvToRgb8_neon(const uchar *y, const uchar *u, const uchar *v,
+                                  uint8x8_t *r, uint8x8_t *g, uint8x8_t *b)
+{
+    const int16x8_t chromaBias = vdupq_n_s16(128);
+
+    int16x8_t uu = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u))), chromaBias);
+    int16x8_t vv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v))), chromaBias);
+
+    // Y*149 + 64 fits in 16 bits unsigned, so shift it logically before rebiasing
+    uint16x8_t yy = vaddq_u16(vmull_u8(vld1_u8(y), vdup_n_u8(149)), vdupq_n_u16(64));
+    int16x8_t y6 = vsubq_s16(vreinterpretq_s16_u16(vshrq_n_u16(yy, 1)), vdupq_n_s16(1192));
+
+    *r = vqmovun_s16(vshrq_n_s16(vmlaq_n_s16(y6, vv, 102), 6));
+    *g = vqmovun_s16(vshrq_n_s16(vmlsq_n_s16(vmlsq_n_s16(y6, uu, 25), vv, 52), 6));
+    // bright Y with large U exceeds 16 bits; saturating still clamps to 255
+    *b = vqmovun_s16(vshrq_n_s16(vqaddq_s16(y6, vmulq_n_s16(uu, 129)), 6));
+}
+
+void q_yuv_to_rgb565_neon(const uchar *y, const uchar *u, const uchar *v, int count, void *dst)
+{
+    quint16 *out = (quint16 *)dst;
+
+    while ( count >= 8 ) {
+        uint8x8_t r, g, b;
+        yuvToRgb8_neon(y, u, v, &r, &g, &b);
+
+        uint16x8_t pixels = vshll_n_u8(r, 8);
+        pixels = vsriq_n_u16(pixels, vshll_n_u8(g, 8), 5);
+        pixels = vsriq_n_u16(pixels, vshll_n_u8(b, 8), 11);
+        vst1q_u16(out, pixels);
+
+        y += 8;
+        u += 8;
+        v += 8;
+        out += 8;
+        count -= 8;
+    }
+
+    if ( count )
+        q_yuv_to_rgb565(y, u, v, count, out);
+}
+
+void q_yuv_to_rgb32_neon(const uchar *y, const uchar *u, const uchar *v, int count, void *dst)
+{
+    quint32 *out = (quint32 *)dst;
+    uint8x8x4_t pixels;
+    pixels.val[3] = vdup_n_u8(0xFF);
+
+    while ( count >= 8 ) {
+        // byte order b, g, r, a is 0xAARRGGBB in memory
+        yuvToRgb8_neon(y, u, v, &pixels.val[2], &pixels.val[1], &pixels.val[0]);
+        vst4_u8((uint8_t *)out, pixels);
+
+        y += 8;
+        u += 8;
+        v += 8;
+        out += 8;
+        count -= 8;
+    }
+
+    if ( count )
+        q_yuv_to_rgb32(y, u, v, count, out);
+}
+
+#endif
@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef QYUVCONVERT_P_H
+#define QYUVCONVERT_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt Extended API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <qglobal.h>
+
+/*
+    Line converters from ITU-R BT.601 YUV (video range) to RGB.  Each takes
+    one Y, U and V sample per output pixel, so chroma subsampling and scaling
+    are resolved by the caller (see QImagePlaneTransformation).
+
+    All variants use the same 16 bit fixed point arithmetic and produce
+    identical output:
+
+        y6 = ((Y*149 + 64) >> 1) - 1192           (1.164 * (Y-16), 6 bit fraction)
+        R  = (y6 + 102*(V-128)) >> 6
+        G  = (y6 -  25*(U-128) - 52*(V-128)) >> 6
+        B  = (y6 + 129*(U-128)) >> 6
+
+    clamped to [0,255].  Only the blue sum can leave the signed 16 bit range,
+    and then only above 255, so the SIMD variants saturate it.
+*/
+typedef void (*QYuvToRgbFunction)(const uchar *y, const uchar *u, const uchar *v, int count, void *dst);
+
+void q_yuv_to_rgb565(const uchar *y, const uchar *u, const uchar *v, int count, void *dst);
+void q_yuv_to_rgb32(const uchar *y, const uchar *u, const uchar *v, int count, void *dst);
+
+#if defined(__SSE2__)
+#define QTOPIAVIDEO_HAVE_SSE2
+void q_yuv_to_rgb565_sse2(const uchar *y, const uchar *u, const uchar *v, int count, void *dst);
+void q_yuv_to_rgb32_sse2(const uchar *y, const uchar *u, const uchar *v, int count, void *dst);
+#endif
+
+#if defined(__ARM_NEON__)
+#define QTOPIAVIDEO_HAVE_NEON
+void q_yuv_to_rgb565_neon(const uchar *y, const uchar *u, const uchar *v, int count, void *dst);
+void q_yuv_to_rgb32_neon(const uchar *y, const uchar *u, const uchar *v, int count, void *dst);
+#endif
+
+// the fastest converters the library was built with
+QYuvToRgbFunction q_yuvToRgb565Function();
+QYuvToRgbFunction q_yuvToRgb32Function();
+
+static inline void q_yuvToRgb(int y, int u, int v, int *r, int *g, int *b)
+{
+    int y6 = ((y * 149 + 64) >> 1) - 1192;
+    u -= 128;
+    v -= 128;
+
+    *r = qBound(0, (y6 + 102 * v) >> 6, 255);
+    *g = qBound(0, (y6 - 25 * u - 52 * v) >> 6, 255);
+    *b = qBound(0, (y6 + 129 * u) >> 6, 255);
+}
+
+#endif
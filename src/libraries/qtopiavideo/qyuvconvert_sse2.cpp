@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "qyuvconvert_p.h"
+
+#ifdef QTOPIAVIDEO_HAVE_SSE2
+
+#include <emmintrin.h>
+
+// converts 8 pixels to clamped 8 bit r, g and b in the low half of each register
+static inline void yuvToRgb8_sse2(const uchar *y, const uchar *u, const uchar *v,
+                                  __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i chromaBias = _mm_set1_epi16(128);
+
+    __m128i yy = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)y), zero);
+    __m128i uu = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)u), zero), chromaBias);
+    __m128i vv = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)v), zero), chromaBias);
+
+    // Y*149 + 64 fits in 16 bits unsigned, so shift it logically before rebiasing
+    __m128i y6 = _mm_sub_epi16(_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(yy, _mm_set1_epi16(149)),
+                                                            _mm_set1_epi16(64)), 1),
+                               _mm_set1_epi16(1192));
+
+    __m128i rr = _mm_srai_epi16(_mm_add_epi16(y6, _mm_mullo_epi16(vv, _mm_set1_epi16(102))), 6);
+    __m128i gg = _mm_srai_epi16(_mm_sub_epi16(_mm_sub_epi16(y6, _mm_mullo_epi16(uu, _mm_set1_epi16(25))),
+                                              _mm_mullo_epi16(vv, _mm_set1_epi16(52))), 6);
+    // bright Y with large U exceeds 16 bits; saturating still clamps to 255
+    __m128i bb = _mm_srai_epi16(_mm_adds_epi16(y6, _mm_mullo_epi16(uu, _mm_set1_epi16(129))), 6);
+
+    *r = _mm_packus_epi16(rr, rr);
+    *g = _mm_packus_epi16(gg, gg);
+    *b = _mm_packus_epi16(bb, bb);
+}
+
+void q_yuv_to_rgb565_sse2(const uchar *y, const uchar *u, const uchar *v, int count, void *dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i redMask = _mm_set1_epi16((short)0xF800);
+    const __m128i greenMask = _mm_set1_epi16(0x07E0);
+    quint16 *out = (quint16 *)dst;
+
+    while ( count >= 8 ) {
+        __m128i r, g, b;
+        yuvToRgb8_sse2(y, u, v, &r, &g, &b);
+
+        r = _mm_and_si128(_mm_slli_epi16(_mm_unpacklo_epi8(r, zero), 8), redMask);
+        g = _mm_and_si128(_mm_slli_epi16(_mm_unpacklo_epi8(g, zero), 3), greenMask);
+        b = _mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3);
+        _mm_storeu_si128((__m128i *)out, _mm_or_si128(_mm_or_si128(r, g), b));
+
+        y += 8;
+        u += 8;
+        v += 8;
+        out += 8;
+        count -= 8;
+    }
+
+    if ( count )
+        q_yuv_to_rgb565(y, u, v, count, out);
+}
+
+void q_yuv_to_rgb32_sse2(const uchar *y, const uchar *u, const uchar *v, int count, void *dst)
+{
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+    quint32 *out = (quint32 *)dst;
+
+    while ( count >= 8 ) {
+        __m128i r, g, b;
+        yuvToRgb8_sse2(y, u, v, &r, &g, &b);
+
+        // byte order b, g, r, a is 0xAARRGGBB in memory
+        __m128i bg = _mm_unpacklo_epi8(b, g);
+        __m128i ra = _mm_unpacklo_epi8(r, alpha);
+        _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi16(bg, ra));
+
+        y += 8;
+        u += 8;
+        v += 8;
+        out += 8;
+        count -= 8;
+    }
+
+    if ( count )
+        q_yuv_to_rgb32(y, u, v, count, out);
+}
+
+#endif
@@ -0,0 +1,6 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+SOURCEPATH+=/src/libraries/qtopiavideo
+QTOPIA*=video
+TARGET=tst_qimageplanetransform
+SOURCES+=tst_qimageplanetransform.cpp
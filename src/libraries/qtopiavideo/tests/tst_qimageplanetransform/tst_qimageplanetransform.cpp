@@ -0,0 +1,230 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QImagePlaneTransformation>
+#include <QVideoFrame>
+#include <QObject>
+#include <QTest>
+
+#include "qyuvconvert_p.h"
+
+class tst_QImagePlaneTransformation : public QObject
+{
+Q_OBJECT
+public:
+    tst_QImagePlaneTransformation() {};
+    virtual ~tst_QImagePlaneTransformation() {};
+
+private slots:
+    void initTestCase();
+    void supportedFormats();
+    void yuvColors();
+    void transformYuv_data();
+    void transformYuv();
+};
+
+Q_DECLARE_METATYPE(QVideoFrame::PixelFormat);
+
+static void fillRandom( QVideoFrame *frame )
+{
+    for ( int plane = 0; plane < QVideoFrame::planesCount( frame->format() ); plane++ ) {
+        uchar *data = frame->planeData( plane );
+        int size = frame->bytesPerLine( plane ) * frame->planeSize( plane ).height();
+        for ( int i = 0; i < size; i++ )
+            data[i] = qrand();
+    }
+}
+
+static void yuvAt( const QVideoFrame &frame, int x, int y, int *py, int *pu, int *pv )
+{
+    switch ( frame.format() ) {
+    case QVideoFrame::Format_YUV420P:
+    case QVideoFrame::Format_YV12:
+    {
+        int uPlane = frame.format() == QVideoFrame::Format_YV12 ? 2 : 1;
+        *py = frame.planeData(0)[y*frame.bytesPerLine(0) + x];
+        *pu = frame.planeData(uPlane)[y/2*frame.bytesPerLine(uPlane) + x/2];
+        *pv = frame.planeData(3-uPlane)[y/2*frame.bytesPerLine(3-uPlane) + x/2];
+        break;
+    }
+    case QVideoFrame::Format_UYVY:
+    {
+        const uchar *macropixel = frame.planeData(0) + y*frame.bytesPerLine(0) + x/2*4;
+        *pu = macropixel[0];
+        *py = macropixel[1 + (x%2)*2];
+        *pv = macropixel[2];
+        break;
+    }
+    case QVideoFrame::Format_YUYV:
+    {
+        const uchar *macropixel = frame.planeData(0) + y*frame.bytesPerLine(0) + x/2*4;
+        *py = macropixel[(x%2)*2];
+        *pu = macropixel[1];
+        *pv = macropixel[3];
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// straightforward conversion of the whole frame, to be scaled afterwards
+static QVideoFrame toRgb( const QVideoFrame &frame, QVideoFrame::PixelFormat format )
+{
+    QVideoFrame rgb( format, frame.size() );
+
+    for ( int y = 0; y < frame.size().height(); y++ ) {
+        uchar *line = rgb.planeData(0) + y*rgb.bytesPerLine(0);
+        for ( int x = 0; x < frame.size().width(); x++ ) {
+            int Y, U, V, r, g, b;
+            yuvAt( frame, x, y, &Y, &U, &V );
+            q_yuvToRgb( Y, U, V, &r, &g, &b );
+
+            if ( format == QVideoFrame::Format_RGB565 )
+                ((quint16*)line)[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+            else
+                ((quint32*)line)[x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    return rgb;
+}
+
+void tst_QImagePlaneTransformation::initTestCase()
+{
+    qRegisterMetaType<QVideoFrame::PixelFormat>("QVideoFrame::PixelFormat");
+}
+
+void tst_QImagePlaneTransformation::supportedFormats()
+{
+    QImagePlaneTransformation t;
+
+    QVERIFY( t.isTransformationSupported( QVideoFrame::Format_YUV420P, QVideoFrame::Format_RGB565 ) );
+    QVERIFY( t.isTransformationSupported( QVideoFrame::Format_YV12, QVideoFrame::Format_RGB32 ) );
+    QVERIFY( t.isTransformationSupported( QVideoFrame::Format_UYVY, QVideoFrame::Format_RGB565 ) );
+    QVERIFY( t.isTransformationSupported( QVideoFrame::Format_YUYV, QVideoFrame::Format_ARGB32 ) );
+    QVERIFY( !t.isTransformationSupported( QVideoFrame::Format_UYVY, QVideoFrame::Format_RGB24 ) );
+
+    // planar sources need the QVideoFrame overload
+    quint16 dst[4];
+    uchar src[4];
+    t.setSrcGeometry( QRect(0,0,2,2), QRect(0,0,2,2), 2 );
+    t.setDstGeometry( QRect(0,0,2,2), QRect(0,0,2,2), 2 );
+    QVERIFY( !t.transformPlane( src, QVideoFrame::Format_YUV420P, dst, QVideoFrame::Format_RGB565 ) );
+}
+
+void tst_QImagePlaneTransformation::yuvColors()
+{
+    struct { int y, u, v, r, g, b; } colors[] = {
+        {  16, 128, 128,   0,   0,   0 },
+        { 235, 128, 128, 255, 255, 255 },
+        { 126, 128, 128, 128, 128, 128 },
+        {  81,  90, 240, 255,   0,   0 },
+        { 145,  54,  34,   0, 255,   0 },
+        {  41, 240, 110,   0,   0, 255 }
+    };
+
+    for ( uint i = 0; i < sizeof(colors)/sizeof(colors[0]); i++ ) {
+        int r, g, b;
+        q_yuvToRgb( colors[i].y, colors[i].u, colors[i].v, &r, &g, &b );
+        QVERIFY( qAbs( r - colors[i].r ) <= 2 );
+        QVERIFY( qAbs( g - colors[i].g ) <= 2 );
+        QVERIFY( qAbs( b - colors[i].b ) <= 2 );
+    }
+}
+
+void tst_QImagePlaneTransformation::transformYuv_data()
+{
+    QTest::addColumn<QVideoFrame::PixelFormat>("srcFormat");
+    QTest::addColumn<QVideoFrame::PixelFormat>("dstFormat");
+    QTest::addColumn<int>("rotation");
+    QTest::addColumn<QSize>("srcSize");
+    QTest::addColumn<QRect>("srcRect");
+    QTest::addColumn<QSize>("dstSize");
+
+    struct { const char *name; QVideoFrame::PixelFormat format; } srcFormats[] = {
+        { "YUV420P", QVideoFrame::Format_YUV420P },
+        { "YV12", QVideoFrame::Format_YV12 },
+        { "UYVY", QVideoFrame::Format_UYVY },
+        { "YUYV", QVideoFrame::Format_YUYV }
+    };
+    struct { const char *name; QVideoFrame::PixelFormat format; } dstFormats[] = {
+        { "RGB565", QVideoFrame::Format_RGB565 },
+        { "RGB32", QVideoFrame::Format_RGB32 }
+    };
+
+    for ( int s = 0; s < 4; s++ ) {
+        for ( int d = 0; d < 2; d++ ) {
+            for ( int rotation = 0; rotation < 4; rotation++ ) {
+                QString name = QString("%1 %2 %3 ").arg(srcFormats[s].name).arg(dstFormats[d].name).arg(rotation*90);
+
+                QTest::newRow( (name + "same").toLatin1() ) << srcFormats[s].format << dstFormats[d].format << rotation
+                        << QSize(64,48) << QRect(0,0,64,48) << QSize(64,64);
+                QTest::newRow( (name + "up").toLatin1() ) << srcFormats[s].format << dstFormats[d].format << rotation
+                        << QSize(50,38) << QRect(3,1,45,35) << QSize(161,97);
+                QTest::newRow( (name + "down").toLatin1() ) << srcFormats[s].format << dstFormats[d].format << rotation
+                        << QSize(176,144) << QRect(-5,7,170,140) << QSize(33,41);
+            }
+        }
+    }
+}
+
+/*
+    The fused path must sample exactly the same pixels as converting the whole
+    frame first and scaling it with the RGB transformation.
+*/
+void tst_QImagePlaneTransformation::transformYuv()
+{
+    QFETCH( QVideoFrame::PixelFormat, srcFormat );
+    QFETCH( QVideoFrame::PixelFormat, dstFormat );
+    QFETCH( int, rotation );
+    QFETCH( QSize, srcSize );
+    QFETCH( QRect, srcRect );
+    QFETCH( QSize, dstSize );
+
+    QVideoFrame frame( srcFormat, srcSize );
+    fillRandom( &frame );
+    QVideoFrame rgbFrame = toRgb( frame, dstFormat );
+
+    int depth = QVideoFrame::colorDepth( dstFormat, 0 ) / 8;
+    QVideoFrame expected( dstFormat, dstSize );
+    QVideoFrame actual( dstFormat, dstSize );
+    memset( expected.planeData(0), 0, expected.bytesPerLine(0)*dstSize.height() );
+    memset( actual.planeData(0), 0, actual.bytesPerLine(0)*dstSize.height() );
+
+    QRect dstRect( 1, 2, dstSize.width()-2, dstSize.height()-3 );
+
+    QImagePlaneTransformation t;
+    t.setRotation( QtopiaVideo::VideoRotation(rotation) );
+    t.setDstGeometry( dstRect, QRect( QPoint(0,0), dstSize ), expected.bytesPerLine(0)/depth );
+
+    t.setSrcGeometry( srcRect, QRect( QPoint(0,0), srcSize ), rgbFrame.bytesPerLine(0)/depth );
+    QVERIFY( t.transformPlane( rgbFrame.planeData(0), dstFormat, expected.planeData(0), dstFormat ) );
+
+    t.setSrcGeometry( srcRect, QRect( QPoint(0,0), srcSize ),
+                      frame.bytesPerLine(0)/(QVideoFrame::colorDepth( srcFormat, 0 )/8) );
+    QVERIFY( t.transformPlane( frame, actual.planeData(0), dstFormat ) );
+
+    QVERIFY( !t.clippedDstGeometry().isEmpty() );
+    QVERIFY( memcmp( expected.planeData(0), actual.planeData(0), expected.bytesPerLine(0)*dstSize.height() ) == 0 );
+}
+
+QTEST_MAIN(tst_QImagePlaneTransformation)
+
+#include "tst_qimageplanetransform.moc"
@@ -0,0 +1,201 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QVideoFramePool>
+#include <QObject>
+#include <QTest>
+
+class tst_QVideoFramePool : public QObject
+{
+Q_OBJECT
+public:
+    tst_QVideoFramePool() {};
+    virtual ~tst_QVideoFramePool() {};
+
+private slots:
+    void init();
+    void frameBufferSize();
+    void recycleFrame();
+    void sharedFrame();
+    void differentSize();
+    void maxFreeBuffers();
+    void frameOutlivesPool();
+    void rawBuffer();
+    void frameCounters();
+};
+
+void tst_QVideoFramePool::init()
+{
+    QVideoFramePool::resetCounters();
+}
+
+void tst_QVideoFramePool::frameBufferSize()
+{
+    QCOMPARE( QVideoFramePool::frameBufferSize( QVideoFrame::Format_RGB32, QSize(10,10) ), 400 );
+    QCOMPARE( QVideoFramePool::frameBufferSize( QVideoFrame::Format_RGB565, QSize(10,10) ), 200 );
+    QCOMPARE( QVideoFramePool::frameBufferSize( QVideoFrame::Format_YUV420P, QSize(16,16) ), 16*16 + 2*8*8 );
+    QCOMPARE( QVideoFramePool::frameBufferSize( QVideoFrame::Format_YUV420P, QSize(10,10) ), 12*10 + 2*8*5 );
+}
+
+void tst_QVideoFramePool::recycleFrame()
+{
+    QVideoFramePool pool;
+    const uchar *data = 0;
+
+    {
+        QVideoFrame frame = pool.allocateFrame( QVideoFrame::Format_RGB565, QSize(32,16) );
+        QVERIFY( !frame.isNull() );
+        data = frame.constPlaneData(0);
+        QVERIFY( data != 0 );
+
+        //writing to an unshared frame doesn't copy it
+        QCOMPARE( const_cast<const uchar*>( frame.planeData(0) ), data );
+        QCOMPARE( pool.freeBufferCount(), 0 );
+    }
+
+    QCOMPARE( pool.freeBufferCount(), 1 );
+
+    QVideoFrame frame = pool.allocateFrame( QVideoFrame::Format_RGB565, QSize(32,16) );
+    QCOMPARE( frame.constPlaneData(0), data );
+    QCOMPARE( pool.freeBufferCount(), 0 );
+
+    QVideoFramePool::Counters counters = QVideoFramePool::counters();
+    QCOMPARE( counters.allocations, 1 );
+    QCOMPARE( counters.recycled, 1 );
+    QCOMPARE( counters.copies, 0 );
+}
+
+void tst_QVideoFramePool::sharedFrame()
+{
+    QVideoFramePool pool;
+
+    QVideoFrame frame = pool.allocateFrame( QVideoFrame::Format_YUV420P, QSize(16,16) );
+    QVideoFrame copy = frame;
+
+    frame = QVideoFrame();
+    QCOMPARE( pool.freeBufferCount(), 0 );
+
+    copy = QVideoFrame();
+    QCOMPARE( pool.freeBufferCount(), 1 );
+}
+
+void tst_QVideoFramePool::differentSize()
+{
+    QVideoFramePool pool;
+
+    pool.allocateFrame( QVideoFrame::Format_RGB32, QSize(16,16) );
+    QCOMPARE( pool.freeBufferCount(), 1 );
+
+    QVideoFrame frame = pool.allocateFrame( QVideoFrame::Format_RGB32, QSize(32,32) );
+    QCOMPARE( pool.freeBufferCount(), 1 );
+
+    QVideoFramePool::Counters counters = QVideoFramePool::counters();
+    QCOMPARE( counters.allocations, 2 );
+    QCOMPARE( counters.recycled, 0 );
+
+    pool.clear();
+    QCOMPARE( pool.freeBufferCount(), 0 );
+}
+
+void tst_QVideoFramePool::maxFreeBuffers()
+{
+    QVideoFramePool pool( 2 );
+
+    {
+        QList<QVideoFrame> frames;
+        for ( int i = 0; i < 4; ++i )
+            frames << pool.allocateFrame( QVideoFrame::Format_RGB565, QSize(8,8) );
+    }
+
+    QCOMPARE( pool.freeBufferCount(), 2 );
+}
+
+void tst_QVideoFramePool::frameOutlivesPool()
+{
+    QVideoFrame frame;
+
+    {
+        QVideoFramePool pool;
+        frame = pool.allocateFrame( QVideoFrame::Format_RGB32, QSize(8,8) );
+        memset( frame.planeData(0), 0x55, frame.bytesPerLine(0) * 8 );
+    }
+
+    QCOMPARE( frame.constPlaneData(0)[0], uchar(0x55) );
+    frame = QVideoFrame();
+}
+
+void tst_QVideoFramePool::rawBuffer()
+{
+    QVideoFramePool pool;
+    QSize size(16,16);
+    int bufferSize = QVideoFramePool::frameBufferSize( QVideoFrame::Format_YUV420P, size );
+
+    uchar *data = pool.allocateBuffer( bufferSize );
+    QVERIFY( data != 0 );
+    memset( data, 0x10, bufferSize );
+
+    QVideoFrame frame = QVideoFramePool::frameFromBuffer( data, QVideoFrame::Format_YUV420P, size );
+    QCOMPARE( frame.constPlaneData(0), const_cast<const uchar*>(data) );
+    QCOMPARE( frame.constPlaneData(1), const_cast<const uchar*>(data + 16*16) );
+
+    //the frame keeps the buffer in use after the producer released it
+    QVideoFramePool::releaseBuffer( data );
+    QCOMPARE( pool.freeBufferCount(), 0 );
+    QCOMPARE( frame.constPlaneData(2)[0], uchar(0x10) );
+
+    frame = QVideoFrame();
+    QCOMPARE( pool.freeBufferCount(), 1 );
+
+    QCOMPARE( pool.allocateBuffer( bufferSize ), data );
+    QVideoFramePool::releaseBuffer( data );
+
+    QCOMPARE( QVideoFramePool::counters().allocations, 1 );
+    QCOMPARE( QVideoFramePool::counters().recycled, 1 );
+}
+
+void tst_QVideoFramePool::frameCounters()
+{
+    QVideoFrame frame( QVideoFrame::Format_YUV420P, QSize(16,16) );
+    QCOMPARE( QVideoFramePool::counters().allocations, 1 );
+    QCOMPARE( QVideoFramePool::counters().copies, 0 );
+
+    QVideoFrame copy = frame;
+    QCOMPARE( QVideoFramePool::counters().copies, 0 );
+
+    //writing to a shared frame detaches it
+    copy.planeData(0);
+    QCOMPARE( QVideoFramePool::counters().allocations, 2 );
+    QCOMPARE( QVideoFramePool::counters().copies, 1 );
+
+    //writing to a frame wrapping constant data copies it
+    uchar data[16*16*2];
+    memset( data, 0, sizeof(data) );
+    QVideoFrame constFrame( QVideoFrame::Format_RGB565, QSize(16,16), const_cast<const uchar*>(data) );
+    constFrame.planeData(0);
+    QCOMPARE( QVideoFramePool::counters().allocations, 3 );
+    QCOMPARE( QVideoFramePool::counters().copies, 2 );
+
+    QVideoFramePool::resetCounters();
+    QCOMPARE( QVideoFramePool::counters().allocations, 0 );
+    QCOMPARE( QVideoFramePool::counters().copies, 0 );
+}
+
+QTEST_MAIN(tst_QVideoFramePool)
+
+#include "tst_qvideoframepool.moc"
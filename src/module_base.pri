@@ -18,6 +18,7 @@ PROJECTS*=\
     tools/dbmigrateservice \
     tools/qcop \
     tools/qdawggen \
+    tools/themecompiler \
     plugins/qtopiacore/iconengines/qtopiaiconengine \
     plugins/qtopiacore/iconengines/qtopiasvgiconengine \
     plugins/qtopiacore/iconengines/qtopiapiciconengine \
@@ -9,6 +9,7 @@ PROJECTS*=\
         plugins/composers/generic \
         plugins/viewers/generic \
         plugins/viewers/conversation \
+        tools/mailindex \
         tools/messageserver \
         tools/sysmessages
  
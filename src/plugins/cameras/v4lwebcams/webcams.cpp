@@ -72,65 +72,146 @@ void V4L2Webcam::close()
 
 
 ///////// PREVIEW /////////////
+
+Q_GLOBAL_STATIC(QMutex, frameBufferMutex);
+
+/*
+    A driver buffer shared with the frames emitted by the preview, it's queued
+    back to the driver when the last frame using it is destroyed.
+    Buffers still in use when the preview stops are detached from the driver
+    and unmapped on release.
+*/
+class V4L2FrameBuffer : public QVideoFrame::BufferHelper
+{
+public:
+    V4L2FrameBuffer(Preview *p, int i, uchar *d, int l)
+        : preview(p), index(i), data(d), length(l), refs(0) {}
+
+    void lock();
+    void unlock();
+
+    Preview *preview;
+    int index;
+    uchar *data;
+    int length;
+    int refs;
+};
+
+void V4L2FrameBuffer::lock()
+{
+    QMutexLocker locker(frameBufferMutex());
+    ++refs;
+}
+
+void V4L2FrameBuffer::unlock()
+{
+    QMutexLocker locker(frameBufferMutex());
+    if (--refs > 0)
+        return;
+
+    if (preview) {
+        preview->queueBuffer(this);
+    } else {
+        locker.unlock();
+        munmap(data, length);
+        delete this;
+    }
+}
+
+/*
+    The driver refuses to allocate new buffers while any of the old ones are
+    mapped, so a buffer still used by frames when capture stops has its
+    contents moved to anonymous memory at the same address.  The frames keep
+    their data and the device mapping is released.
+*/
+static bool detachFrameBuffer(V4L2FrameBuffer *frameBuffer)
+{
+    void *copy = mmap(NULL, frameBuffer->length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED)
+        return false;
+
+    memcpy(copy, frameBuffer->data, frameBuffer->length);
+
+    // replaces the device mapping in one step, so readers never see it unmapped
+    if (mremap(copy, frameBuffer->length, frameBuffer->length,
+               MREMAP_MAYMOVE | MREMAP_FIXED, frameBuffer->data) == MAP_FAILED) {
+        munmap(copy, frameBuffer->length);
+        return false;
+    }
+    return true;
+}
+
+void Preview::queueBuffer(V4L2FrameBuffer *frameBuffer)
+{
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.index = frameBuffer->index;
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+
+    if (ioctl(wc->fd, VIDIOC_QBUF, &buffer) == -1) {
+        if(errno == EAGAIN) {
+            qDebug()<<"nonblocking io slected O_NONBLOCK and no buffer was  in outgoing queue";
+        }  else if(errno == EINVAL) {
+            qDebug()<<"buffer type not supported or index OOB or no buffers have been alloced";
+        }else if(errno == ENOMEM) {
+            qDebug()<<"insufficient memory";
+        }else if(errno == EIO) {
+            qDebug()<<"internal error";
+        }
+    }
+}
+
 void Preview::startCapture()
 {
     memset(&wc->requestbuffers, 0, sizeof(wc->requestbuffers));
-    wc->requestbuffers.count = 1;
+    // frames are passed on without copying, so the driver can fill
+    // the next buffers while the previous frames are displayed
+    wc->requestbuffers.count = 4;
     wc->requestbuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     wc->requestbuffers.memory = V4L2_MEMORY_MMAP;
 
     if (ioctl(wc->fd, VIDIOC_REQBUFS, &wc->requestbuffers) == 0) {
-        memset(&wc->buffer, 0, sizeof(wc->buffer));
+        for (unsigned int i = 0; i < wc->requestbuffers.count; ++i) {
+            memset(&wc->buffer, 0, sizeof(wc->buffer));
 
-        wc->buffer.index = 0;
-        wc->buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        wc->buffer.memory = V4L2_MEMORY_MMAP;
+            wc->buffer.index = i;
+            wc->buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            wc->buffer.memory = V4L2_MEMORY_MMAP;
 
-        if (ioctl(wc->fd, VIDIOC_QUERYBUF, &wc->buffer) == 0) {
+            if (ioctl(wc->fd, VIDIOC_QUERYBUF, &wc->buffer) != 0) {
+                if(errno == EINVAL)
+                    qDebug()<<"EINVAL";
+                break;
+            }
 
-             wc->imageBuffer = (unsigned char*) mmap(NULL,
+            uchar *data = (uchar*) mmap(NULL,
                                  wc->buffer.length,
                                  PROT_READ | PROT_WRITE,
                                  MAP_SHARED,
                                  wc->fd,
                                  wc->buffer.m.offset);
-             if (wc->imageBuffer != (unsigned char*)MAP_FAILED) {
-                 wc->buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-             }
-             else {
-                 qDebug()<<"CAMERA MMAP FAIL!!!!!!!!!!!!!";
-             }
-
-            preview_buffer_data = wc->imageBuffer;
-            preview_buffer_bytesused = wc->buffer.length;
+            if (data == (uchar*)MAP_FAILED) {
+                qDebug()<<"CAMERA MMAP FAIL!!!!!!!!!!!!!";
+                break;
+            }
+
+            V4L2FrameBuffer *frameBuffer = new V4L2FrameBuffer(this, i, data, wc->buffer.length);
+            buffers.append(frameBuffer);
+            queueBuffer(frameBuffer);
+        }
+
+        if (!buffers.isEmpty()) {
+            preview_buffer_data = buffers.first()->data;
+            preview_buffer_bytesused = buffers.first()->length;
             preview_buffer_width = current_resolution.width();
             preview_buffer_height = current_resolution.height();
 
-
-             int ret=ioctl(wc->fd, VIDIOC_QBUF, &wc->buffer);
-             // queue up next buffer
-             if (ret != 0) {
-                 if(errno == EAGAIN) {
-                     qDebug()<<"nonblocking io slected O_NONBLOCK and no buffer was  in outgoing queue";
-                 }  else if(errno == EINVAL) {
-                     qDebug()<<"buffer type not supported or index OOB or no buffers have been alloced";
-                 }else if(errno == ENOMEM) {
-                     qDebug()<<"insufficient memory";
-                 }else if(errno == EIO) {
-                     qDebug()<<"internal error";
-                 }
-             }
-
-             if( ioctl(wc->fd, VIDIOC_STREAMON, &wc->buf_type) == 0) {
-                 wc->imageBufferLength = wc->buffer.length;
-             }
-             else {
-                 qDebug()<<"Cannot start Streaming!!!!!!!!!";
-             }
-
-        }else {
-            if(errno == EINVAL)
-                qDebug()<<"EINVAL";
+            wc->buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            if( ioctl(wc->fd, VIDIOC_STREAMON, &wc->buf_type) != 0) {
+                qDebug()<<"Cannot start Streaming!!!!!!!!!";
+            }
         }
      } else {
          if(errno == EBUSY) {
@@ -150,9 +231,19 @@ void Preview::stopCapture()
     if (ioctl(wc->fd, VIDIOC_STREAMOFF, &wc->buf_type) == -1) {
     }
 
-    if (munmap(wc->imageBuffer, wc->imageBufferLength) == -1) {
+    QMutexLocker locker(frameBufferMutex());
+    foreach (V4L2FrameBuffer *frameBuffer, buffers) {
+        if (frameBuffer->refs == 0) {
+            munmap(frameBuffer->data, frameBuffer->length);
+            delete frameBuffer;
+        } else {
+            // still displayed, unmapped when the last frame is released
+            if (!detachFrameBuffer(frameBuffer))
+                qWarning() << "v4lwebcam: could not detach a buffer in use, restarting capture may fail";
+            frameBuffer->preview = 0;
+        }
     }
-
+    buffers.clear();
 }
 
 void Preview::setupCapture(unsigned int fourcc, QSize resolution)
@@ -178,25 +269,18 @@ void Preview::captureFrame()
     if (poll(&wc->fpolls, 1, 50) > 0) {
         // dequeue buffer
         if (ioctl(wc->fd, VIDIOC_DQBUF, &wc->buffer) == 0) {
+            if (wc->buffer.index >= (unsigned int)buffers.count())
+                return;
+
+            V4L2FrameBuffer *frameBuffer = buffers[wc->buffer.index];
 
+            preview_buffer_data = frameBuffer->data;
+            preview_buffer_bytesused = wc->buffer.bytesused;
+
+            // the buffer is queued again when the frame and its copies are destroyed
             QVideoFrame vframe( pixelformat, QSize(preview_buffer_width, preview_buffer_height),
-                        reinterpret_cast<uchar*>(preview_buffer_data));
+                        frameBuffer->data, frameBuffer);
             emit frameReady(vframe);
-
-            int ret = ioctl(wc->fd, VIDIOC_QBUF, &wc->buffer);
-
-            // queue up next buffer
-            if(ret == -1) {
-                if(errno == EAGAIN) {
-                    qDebug()<<"nonblocking io slected O_NONBLOCK and no buffer was  in outgoing queue";
-                }  else if(errno == EINVAL) {
-                    qDebug()<<"buffer type not supported or index OOB or no buffers have been alloced";
-                }else if(errno == ENOMEM) {
-                    qDebug()<<"insufficient memory";
-                }else if(errno == EIO) {
-                    qDebug()<<"internal error";
-                }
-            }
         }
     }
 }
@@ -42,6 +42,7 @@
 
 
 class V4L2Webcam;
+class V4L2FrameBuffer;
 class Preview : public QCameraPreviewCapture
 {
     Q_OBJECT
@@ -49,7 +50,7 @@ public:
 
     Preview(V4L2Webcam* w);
 
-    virtual ~Preview() {}
+    virtual ~Preview() { stop(); }
 
     void start(unsigned int format, QSize resolution, int framerate);
     void stop() ;
@@ -90,6 +91,9 @@ public:
     void startCapture();
     void stopCapture();
     void setupCapture(unsigned int, QSize);
+    void queueBuffer(V4L2FrameBuffer*);
+
+    QList<V4L2FrameBuffer*> buffers;
 
     bool preview_active ;
 public slots:
@@ -185,9 +189,6 @@ public:
     v4l2_queryctrl queryctrl;
     v4l2_fmtdesc fmt;
 
-    unsigned char* imageBuffer;
-    int imageBufferLength;
-
     QList<unsigned int> supportedFormats;
     QtopiaCamera::FormatResolutionMap previewFormatMap;
     QtopiaCamera::FormatResolutionMap stillFormatMap;
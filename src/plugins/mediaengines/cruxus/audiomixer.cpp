@@ -0,0 +1,160 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "audiomixer.h"
+
+namespace cruxus
+{
+
+MixerRoutines mixerRoutines =
+{
+    generic_mix,
+    generic_monoToStereo,
+    generic_scale,
+    generic_resampleMono,
+    generic_resampleStereo
+};
+
+static MixerKernels currentKernels = GenericKernels;
+
+void generic_mix(qint16* dst, const qint16* src, int count)
+{
+    for (int i = 0; i < count; ++i)
+        dst[i] = saturate16(dst[i] + src[i]);
+}
+
+void generic_monoToStereo(qint16* dst, const qint16* src, int frames, bool mix)
+{
+    if (mix) {
+        for (int i = 0; i < frames; ++i) {
+            dst[i*2] = saturate16(dst[i*2] + src[i]);
+            dst[i*2+1] = saturate16(dst[i*2+1] + src[i]);
+        }
+    } else {
+        for (int i = 0; i < frames; ++i)
+            dst[i*2] = dst[i*2+1] = src[i];
+    }
+}
+
+void generic_scale(qint16* samples, int count, int gain)
+{
+    for (int i = 0; i < count; ++i)
+        samples[i] = (samples[i] * gain) >> 15;
+}
+
+struct GenericMonoFilter
+{
+    static const int channels = 1;
+
+    static inline void apply(const qint16* src, const qint16* c, int* left, int* right)
+    {
+        // independent sums keep the multiply-accumulate pipeline busy
+        int s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+        for (int k = 0; k < FilterTaps; k += 4) {
+            s1 += src[k] * c[k];
+            s2 += src[k+1] * c[k+1];
+            s3 += src[k+2] * c[k+2];
+            s4 += src[k+3] * c[k+3];
+        }
+
+        *left = *right = s1 + s2 + s3 + s4;
+    }
+};
+
+struct GenericStereoFilter
+{
+    static const int channels = 2;
+
+    static inline void apply(const qint16* src, const qint16* c, int* left, int* right)
+    {
+        int l1 = 0, l2 = 0, r1 = 0, r2 = 0;
+        for (int k = 0; k < FilterTaps; k += 2) {
+            l1 += src[k*2] * c[k];
+            r1 += src[k*2+1] * c[k];
+            l2 += src[k*2+2] * c[k+1];
+            r2 += src[k*2+3] * c[k+1];
+        }
+
+        *left = l1 + l2;
+        *right = r1 + r2;
+    }
+};
+
+int generic_resampleMono(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix)
+{
+    return polyphaseResample<GenericMonoFilter>(state, src, srcFrames, dst, dstFrames, mix);
+}
+
+int generic_resampleStereo(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix)
+{
+    return polyphaseResample<GenericStereoFilter>(state, src, srcFrames, dst, dstFrames, mix);
+}
+
+MixerKernels initMixerRoutines(bool simd)
+{
+    MixerRoutines generic =
+    {
+        generic_mix,
+        generic_monoToStereo,
+        generic_scale,
+        generic_resampleMono,
+        generic_resampleStereo
+    };
+
+    mixerRoutines = generic;
+    currentKernels = GenericKernels;
+
+    if (!simd)
+        return currentKernels;
+
+#if defined(CRUXUS_HAVE_NEON)
+    MixerRoutines neon =
+    {
+        neon_mix,
+        neon_monoToStereo,
+        neon_scale,
+        neon_resampleMono,
+        neon_resampleStereo
+    };
+
+    mixerRoutines = neon;
+    currentKernels = NEONKernels;
+#elif defined(CRUXUS_HAVE_SSE2)
+    MixerRoutines sse2 =
+    {
+        sse2_mix,
+        sse2_monoToStereo,
+        sse2_scale,
+        sse2_resampleMono,
+        sse2_resampleStereo
+    };
+
+    mixerRoutines = sse2;
+    currentKernels = SSE2Kernels;
+#endif
+
+    return currentKernels;
+}
+
+MixerKernels mixerKernels()
+{
+    return currentKernels;
+}
+
+}   // ns cruxus
@@ -0,0 +1,161 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <qglobal.h>
+
+namespace cruxus
+{
+
+/*
+    Kernels used by the output thread to mix 16 bit streams into the
+    interleaved stereo output frame.  Mixing saturates to the 16 bit range.
+
+    The SSE2 and NEON kernels are only built when the toolchain targets the
+    instruction set, and produce exactly the same output as the generic ones.
+*/
+
+// Number of taps of the polyphase filters, and of the legacy sinc table
+static const int FilterTaps = 16;
+
+// Coefficients are Q13, so each phase sums to 8192 (unity gain)
+static const int FilterShift = 13;
+
+struct PolyphaseState
+{
+    const qint16*   coefficients;   // phases x FilterTaps
+    int             phases;
+    int             step;           // whole source frames per output frame
+    int             stepFraction;   // phases to advance per output frame
+    int             phase;
+    int             position;       // source frame of the first tap
+};
+
+struct MixerRoutines
+{
+    // dst = dst + src
+    void (*mix)(qint16* dst, const qint16* src, int count);
+
+    // dst[2i] = dst[2i+1] = src[i], or added to dst when mixing
+    void (*monoToStereo)(qint16* dst, const qint16* src, int frames, bool mix);
+
+    // samples = samples * gain >> 15, gain in [0, 32767]
+    void (*scale)(qint16* samples, int count, int gain);
+
+    // Filter the mono or interleaved stereo source frames into dst, which is
+    // always stereo, until dstFrames are written or the source runs out.
+    // Returns the number of frames written and advances the state.
+    int (*resampleMono)(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+    int (*resampleStereo)(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+};
+
+extern MixerRoutines mixerRoutines;
+
+enum MixerKernels
+{
+    GenericKernels,
+    SSE2Kernels,
+    NEONKernels
+};
+
+// Selects the fastest kernels the plugin was built with, or the generic
+// ones if simd is false.  Returns the kernels in use.
+MixerKernels initMixerRoutines(bool simd);
+MixerKernels mixerKernels();
+
+void generic_mix(qint16* dst, const qint16* src, int count);
+void generic_monoToStereo(qint16* dst, const qint16* src, int frames, bool mix);
+void generic_scale(qint16* samples, int count, int gain);
+int generic_resampleMono(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+int generic_resampleStereo(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+
+#if defined(__SSE2__)
+#define CRUXUS_HAVE_SSE2
+void sse2_mix(qint16* dst, const qint16* src, int count);
+void sse2_monoToStereo(qint16* dst, const qint16* src, int frames, bool mix);
+void sse2_scale(qint16* samples, int count, int gain);
+int sse2_resampleMono(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+int sse2_resampleStereo(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+#endif
+
+#if defined(__ARM_NEON__)
+#define CRUXUS_HAVE_NEON
+void neon_mix(qint16* dst, const qint16* src, int count);
+void neon_monoToStereo(qint16* dst, const qint16* src, int frames, bool mix);
+void neon_scale(qint16* samples, int count, int gain);
+int neon_resampleMono(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+int neon_resampleStereo(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix);
+#endif
+
+static inline qint16 saturate16(int s)
+{
+    return s > 32767 ? 32767 : (s < -32768 ? -32768 : s);
+}
+
+static inline void storeFrame(qint16* dst, int left, int right, bool mix)
+{
+    left = (left + (1 << (FilterShift - 1))) >> FilterShift;
+    right = (right + (1 << (FilterShift - 1))) >> FilterShift;
+
+    if (mix) {
+        left += dst[0];
+        right += dst[1];
+    }
+
+    dst[0] = saturate16(left);
+    dst[1] = saturate16(right);
+}
+
+/*
+    The polyphase loop shared by the kernels, Filter provides the dot product
+    of FilterTaps source frames with the coefficients of one phase.
+*/
+template <typename Filter>
+static inline int polyphaseResample(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix)
+{
+    const int channels = Filter::channels;
+    int phase = state->phase;
+    int position = state->position;
+    int written = 0;
+
+    while (written < dstFrames && position + FilterTaps <= srcFrames) {
+        int left, right;
+        Filter::apply(src + position * channels, state->coefficients + phase * FilterTaps, &left, &right);
+        storeFrame(dst + written * 2, left, right, mix);
+
+        ++written;
+        position += state->step;
+        phase += state->stepFraction;
+        if (phase >= state->phases) {
+            phase -= state->phases;
+            ++position;
+        }
+    }
+
+    state->phase = phase;
+    state->position = position;
+
+    return written;
+}
+
+}   // ns cruxus
+
+#endif
@@ -0,0 +1,124 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "audiomixer.h"
+
+#ifdef CRUXUS_HAVE_NEON
+
+#include <arm_neon.h>
+
+namespace cruxus
+{
+
+void neon_mix(qint16* dst, const qint16* src, int count)
+{
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+
+    generic_mix(dst + i, src + i, count - i);
+}
+
+void neon_monoToStereo(qint16* dst, const qint16* src, int frames, bool mix)
+{
+    int i = 0;
+
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t frame;
+        frame.val[0] = frame.val[1] = vld1q_s16(src + i);
+
+        if (mix) {
+            int16x8x2_t d = vld2q_s16(dst + i*2);
+            frame.val[0] = vqaddq_s16(frame.val[0], d.val[0]);
+            frame.val[1] = vqaddq_s16(frame.val[1], d.val[1]);
+        }
+
+        vst2q_s16(dst + i*2, frame);
+    }
+
+    generic_monoToStereo(dst + i*2, src + i, frames - i, mix);
+}
+
+void neon_scale(qint16* samples, int count, int gain)
+{
+    int i = 0;
+
+    // vqdmulh gives (2 * s * gain) >> 16, and only saturates for gain -32768
+    for (; i + 8 <= count; i += 8)
+        vst1q_s16(samples + i, vqdmulhq_n_s16(vld1q_s16(samples + i), gain));
+
+    generic_scale(samples + i, count - i, gain);
+}
+
+static inline int horizontalSum(int32x4_t v)
+{
+    int32x2_t s = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+    return vget_lane_s32(vpadd_s32(s, s), 0);
+}
+
+static inline int32x4_t dot(int16x8_t s0, int16x8_t s1, int16x8_t c0, int16x8_t c1)
+{
+    int32x4_t sum = vmull_s16(vget_low_s16(s0), vget_low_s16(c0));
+    sum = vmlal_s16(sum, vget_high_s16(s0), vget_high_s16(c0));
+    sum = vmlal_s16(sum, vget_low_s16(s1), vget_low_s16(c1));
+    return vmlal_s16(sum, vget_high_s16(s1), vget_high_s16(c1));
+}
+
+struct NEONMonoFilter
+{
+    static const int channels = 1;
+
+    static inline void apply(const qint16* src, const qint16* c, int* left, int* right)
+    {
+        int32x4_t sum = dot(vld1q_s16(src), vld1q_s16(src + 8), vld1q_s16(c), vld1q_s16(c + 8));
+        *left = *right = horizontalSum(sum);
+    }
+};
+
+struct NEONStereoFilter
+{
+    static const int channels = 2;
+
+    static inline void apply(const qint16* src, const qint16* c, int* left, int* right)
+    {
+        // deinterleave the channels while loading
+        int16x8x2_t s0 = vld2q_s16(src);
+        int16x8x2_t s1 = vld2q_s16(src + 16);
+        int16x8_t c0 = vld1q_s16(c);
+        int16x8_t c1 = vld1q_s16(c + 8);
+
+        *left = horizontalSum(dot(s0.val[0], s1.val[0], c0, c1));
+        *right = horizontalSum(dot(s0.val[1], s1.val[1], c0, c1));
+    }
+};
+
+int neon_resampleMono(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix)
+{
+    return polyphaseResample<NEONMonoFilter>(state, src, srcFrames, dst, dstFrames, mix);
+}
+
+int neon_resampleStereo(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix)
+{
+    return polyphaseResample<NEONStereoFilter>(state, src, srcFrames, dst, dstFrames, mix);
+}
+
+}   // ns cruxus
+
+#endif
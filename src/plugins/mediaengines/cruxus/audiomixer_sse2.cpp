@@ -0,0 +1,145 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "audiomixer.h"
+
+#ifdef CRUXUS_HAVE_SSE2
+
+#include <emmintrin.h>
+
+namespace cruxus
+{
+
+void sse2_mix(qint16* dst, const qint16* src, int count)
+{
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(d, s));
+    }
+
+    generic_mix(dst + i, src + i, count - i);
+}
+
+void sse2_monoToStereo(qint16* dst, const qint16* src, int frames, bool mix)
+{
+    int i = 0;
+
+    for (; i + 8 <= frames; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi16(s, s);
+        __m128i hi = _mm_unpackhi_epi16(s, s);
+
+        if (mix) {
+            lo = _mm_adds_epi16(lo, _mm_loadu_si128((const __m128i*)(dst + i*2)));
+            hi = _mm_adds_epi16(hi, _mm_loadu_si128((const __m128i*)(dst + i*2 + 8)));
+        }
+
+        _mm_storeu_si128((__m128i*)(dst + i*2), lo);
+        _mm_storeu_si128((__m128i*)(dst + i*2 + 8), hi);
+    }
+
+    generic_monoToStereo(dst + i*2, src + i, frames - i, mix);
+}
+
+void sse2_scale(qint16* samples, int count, int gain)
+{
+    const __m128i g = _mm_set1_epi16(gain);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(samples + i));
+        // (s * gain) >> 15 from the high and low halves of the 32 bit products
+        __m128i hi = _mm_mulhi_epi16(s, g);
+        __m128i lo = _mm_mullo_epi16(s, g);
+        s = _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15));
+        _mm_storeu_si128((__m128i*)(samples + i), s);
+    }
+
+    generic_scale(samples + i, count - i, gain);
+}
+
+static inline int horizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+struct SSE2MonoFilter
+{
+    static const int channels = 1;
+
+    static inline void apply(const qint16* src, const qint16* c, int* left, int* right)
+    {
+        __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i s1 = _mm_loadu_si128((const __m128i*)(src + 8));
+        __m128i c0 = _mm_loadu_si128((const __m128i*)c);
+        __m128i c1 = _mm_loadu_si128((const __m128i*)(c + 8));
+
+        *left = *right = horizontalSum(_mm_add_epi32(_mm_madd_epi16(s0, c0), _mm_madd_epi16(s1, c1)));
+    }
+};
+
+struct SSE2StereoFilter
+{
+    static const int channels = 2;
+
+    // four interleaved frames l0 r0 l1 r1 l2 r2 l3 r3 against the coefficient
+    // pairs (c0 c1) (c0 c1) (c2 c3) (c2 c3) give l0c0+l1c1, r0c0+r1c1, ...
+    static inline __m128i madd(const qint16* src, __m128i coefficients)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        s = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 1, 2, 0));
+        s = _mm_shufflehi_epi16(s, _MM_SHUFFLE(3, 1, 2, 0));
+        return _mm_madd_epi16(s, coefficients);
+    }
+
+    static inline void apply(const qint16* src, const qint16* c, int* left, int* right)
+    {
+        __m128i c0 = _mm_loadu_si128((const __m128i*)c);
+        __m128i c1 = _mm_loadu_si128((const __m128i*)(c + 8));
+
+        __m128i sum = madd(src, _mm_shuffle_epi32(c0, _MM_SHUFFLE(1, 1, 0, 0)));
+        sum = _mm_add_epi32(sum, madd(src + 8, _mm_shuffle_epi32(c0, _MM_SHUFFLE(3, 3, 2, 2))));
+        sum = _mm_add_epi32(sum, madd(src + 16, _mm_shuffle_epi32(c1, _MM_SHUFFLE(1, 1, 0, 0))));
+        sum = _mm_add_epi32(sum, madd(src + 24, _mm_shuffle_epi32(c1, _MM_SHUFFLE(3, 3, 2, 2))));
+
+        // left in lanes 0 and 2, right in lanes 1 and 3
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        *left = _mm_cvtsi128_si32(sum);
+        *right = _mm_cvtsi128_si32(_mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    }
+};
+
+int sse2_resampleMono(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix)
+{
+    return polyphaseResample<SSE2MonoFilter>(state, src, srcFrames, dst, dstFrames, mix);
+}
+
+int sse2_resampleStereo(PolyphaseState* state, const qint16* src, int srcFrames, qint16* dst, int dstFrames, bool mix)
+{
+    return polyphaseResample<SSE2StereoFilter>(state, src, srcFrames, dst, dstFrames, mix);
+}
+
+}   // ns cruxus
+
+#endif
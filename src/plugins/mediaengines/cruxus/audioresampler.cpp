@@ -20,8 +20,12 @@
 #include "audioresampler.h"
 #include <QDebug>
 #include <QList>
+#include <QHash>
+#include <QPair>
 #include <qendian.h>
 
+#include <math.h>
+
 namespace cruxus
 {
 
@@ -29,8 +33,11 @@ namespace cruxus
 
 QCache <int,AudioResampler::ResampleTable> AudioResampler::m_resampleTables;
 
+// Ratios needing more phases use the sinc table, which has as many
+static const int MaxPhases = MAX_WEIGHT;
+
 
-AudioResampler::AudioResampler( int srcFrequency, int srcChannels, int dstFrequency, int duration )
+AudioResampler::AudioResampler( int srcFrequency, int srcChannels, int dstFrequency, int duration, Method method )
 {
     m_srcFrequency = srcFrequency;
     m_srcChannels = srcChannels;
@@ -38,8 +45,47 @@ AudioResampler::AudioResampler( int srcFrequency, int srcChannels, int dstFreque
     m_dstFrequency = dstFrequency;
     m_resampleTables.setMaxCost(100);
     m_samples = m_duration * m_dstFrequency / 1000;
+    m_method = Sinc;
 
     memset( m_prevSamples, 0, sizeof(m_prevSamples) );
+    memset( m_history, 0, sizeof(m_history) );
+    memset( &m_filterState, 0, sizeof(m_filterState) );
+    m_historyFrames = 0;
+
+    if ( method == Polyphase && m_srcFrequency != m_dstFrequency &&
+         m_srcFrequency > 0 && m_dstFrequency > 0 &&
+         ( m_srcChannels == 1 || m_srcChannels == 2 ) ) {
+        int a = m_srcFrequency;
+        int b = m_dstFrequency;
+        while ( b != 0 ) {
+            int r = a % b;
+            a = b;
+            b = r;
+        }
+
+        // output frame i is at source frame i*step/phases
+        const int phases = m_dstFrequency / a;
+        const int step = m_srcFrequency / a;
+
+        if ( phases <= MaxPhases ) {
+            m_method = Polyphase;
+            m_filterBank = filterBank( phases, step );
+
+            m_filterState.coefficients = m_filterBank.constData();
+            m_filterState.phases = phases;
+            m_filterState.step = step / phases;
+            m_filterState.stepFraction = step % phases;
+
+            // the filter is centred on its 8th tap, start with silence
+            // before the first source frame
+            m_historyFrames = FilterTaps/2 - 1;
+        }
+    }
+
+    // resample() runs on the stream's own thread, keep a copy of the
+    // shared table rather than looking it up in the cache there
+    if ( m_method == Sinc && m_srcFrequency != m_dstFrequency )
+        m_table = *resampleTable( m_srcFrequency );
 }
 
 static inline void checkOverflow16( qint32& s )
@@ -53,39 +99,20 @@ int AudioResampler::resample( const qint16* srcSamples, qint16* dstSamples, int
     if ( m_srcFrequency == m_dstFrequency ) {
         const int samplesCount = qMin( srcSamplesCount/m_srcChannels, m_samples );
         if ( m_srcChannels == 1 ) {
-            if ( mixWithExistingData ) {
-                for ( int i=0; i<samplesCount; i++ ) {
-                    int ch1 = dstSamples[i*2] + srcSamples[i];
-                    int ch2 = dstSamples[i*2+1] + srcSamples[i];
-                    checkOverflow16(ch1);
-                    checkOverflow16(ch2);
-                    dstSamples[i*2] = ch1;
-                    dstSamples[i*2+1] = ch2;
-                }
-            } else {
-                for ( int i=0; i<samplesCount; i++ )
-                    dstSamples[i*2] = dstSamples[i*2+1] = srcSamples[i];
-            }
+            mixerRoutines.monoToStereo( dstSamples, srcSamples, samplesCount, mixWithExistingData );
         } else {
-            if ( mixWithExistingData ) {
-                for ( int i=0; i<samplesCount*2; i+=2 ) {
-                    int ch1 = dstSamples[i] + srcSamples[i];
-                    int ch2 = dstSamples[i+1] + srcSamples[i+1];
-                    checkOverflow16(ch1);
-                    checkOverflow16(ch2);
-                    dstSamples[i] = ch1;
-                    dstSamples[i+1] = ch2;
-                }
-            } else
+            if ( mixWithExistingData )
+                mixerRoutines.mix( dstSamples, srcSamples, samplesCount*2 );
+            else
                 memcpy( dstSamples, srcSamples, samplesCount*4 );
         }
 
         return samplesCount*2;
+    } else if ( m_method == Polyphase ) {
+        return resamplePolyphase( srcSamples, dstSamples, srcSamplesCount, mixWithExistingData );
     } else {
-        ResampleTable *table = resampleTable( m_srcFrequency );
-
-        const int *fromTable = table->samples.constData();
-        const int *weightTable = table->weight.constData();
+        const int *fromTable = m_table.samples.constData();
+        const int *weightTable = m_table.weight.constData();
 
         qint16 delayedSrcSamples[srcSamplesCount+16*m_srcChannels];
         memcpy( delayedSrcSamples, m_prevSamples, 16*m_srcChannels*2 );
@@ -247,6 +274,86 @@ int AudioResampler::resample( const qint16* srcSamples, qint16* dstSamples, int
     }
 }
 
+int AudioResampler::resamplePolyphase( const qint16* srcSamples, qint16* dstSamples, int srcSamplesCount, bool mixWithExistingData )
+{
+    const int channels = m_srcChannels;
+    const int srcFrames = srcSamplesCount / channels;
+    const int totalFrames = m_historyFrames + srcFrames;
+
+    qint16 frames[totalFrames*channels];
+    memcpy( frames, m_history, m_historyFrames*channels*2 );
+    memcpy( frames + m_historyFrames*channels, srcSamples, srcFrames*channels*2 );
+
+    int written;
+    if ( channels == 2 )
+        written = mixerRoutines.resampleStereo( &m_filterState, frames, totalFrames, dstSamples, m_samples, mixWithExistingData );
+    else
+        written = mixerRoutines.resampleMono( &m_filterState, frames, totalFrames, dstSamples, m_samples, mixWithExistingData );
+
+    // Keep the frames still needed for the next output frames. If the
+    // stream delivers more than fits in the output frame, drop the oldest
+    int start = qMin( m_filterState.position, totalFrames );
+    start = qMax( start, totalFrames - MaxHistoryFrames );
+
+    m_filterState.position = qMax( 0, m_filterState.position - start );
+    m_historyFrames = totalFrames - start;
+    memcpy( m_history, frames + start*channels, m_historyFrames*channels*2 );
+
+    return written*2;
+}
+
+/*
+    Windowed sinc filters for each phase of the ratio phases:step, the
+    cutoff is lowered to the output Nyquist frequency when downsampling.
+    Banks are shared by the resamplers of the same ratio, they are only
+    created with the output thread lock held.
+*/
+QVector<qint16> AudioResampler::filterBank( int phases, int step )
+{
+    static QHash< QPair<int,int>, QVector<qint16> > banks;
+
+    QPair<int,int> ratio( phases, step );
+    if ( banks.contains( ratio ) )
+        return banks.value( ratio );
+
+    QVector<qint16> bank( phases * FilterTaps );
+    const double cutoff = qMin( 1.0, double(phases) / step );
+    const double centre = FilterTaps/2 - 1;
+    const double halfWidth = FilterTaps/2;
+
+    for ( int phase = 0; phase < phases; ++phase ) {
+        double taps[FilterTaps];
+        double sum = 0;
+
+        for ( int k = 0; k < FilterTaps; ++k ) {
+            // distance of the tap from the output position, in source frames
+            double t = k - centre - double(phase) / phases;
+            double x = M_PI * cutoff * t;
+            double sinc = x == 0 ? 1.0 : sin( x ) / x;
+            double window = qAbs( t ) >= halfWidth ? 0 :
+                            0.42 + 0.5*cos( M_PI*t/halfWidth ) + 0.08*cos( 2*M_PI*t/halfWidth );
+
+            taps[k] = sinc * window;
+            sum += taps[k];
+        }
+
+        // normalize to unity gain, the rounding error goes to the largest tap
+        qint16 *coefficients = bank.data() + phase * FilterTaps;
+        int total = 0;
+        int largest = 0;
+        for ( int k = 0; k < FilterTaps; ++k ) {
+            coefficients[k] = qRound( taps[k] / sum * (1 << FilterShift) );
+            total += coefficients[k];
+            if ( qAbs( coefficients[k] ) > qAbs( coefficients[largest] ) )
+                largest = k;
+        }
+        coefficients[largest] += (1 << FilterShift) - total;
+    }
+
+    banks.insert( ratio, bank );
+    return bank;
+}
+
 AudioResampler::ResampleTable* AudioResampler::resampleTable( int srcFrequency )
 {
     ResampleTable *table = m_resampleTables[srcFrequency];
@@ -24,30 +24,53 @@
 #include <QVector>
 #include <QCache>
 
+#include "audiomixer.h"
+
 namespace cruxus
 {
 
 class AudioResampler
 {
 public:
-    AudioResampler( int srcFrequency, int srcChannels, int dstFrequency, int duration );
+    enum Method {
+        Sinc,       // interpolated from a fixed 512 phase sinc table
+        Polyphase   // exact phases precomputed for the frequency ratio
+    };
+
+    AudioResampler( int srcFrequency, int srcChannels, int dstFrequency, int duration, Method method = Sinc );
 
     int resample( const qint16* srcSamples, qint16* dstBuffer, int srcSamplesCount, bool mixWithExistingData );
 
+    Method method() const { return m_method; }
+    int maxOutputSamples() const { return m_samples*2; }
+
 private:
     int m_srcFrequency;
     int m_srcChannels;
     int m_dstFrequency;
     int m_duration;
     int m_samples;//per channel
+    Method m_method;
 
     qint16 m_prevSamples[16*2];
 
+    // source frames not consumed by the polyphase filter yet
+    static const int MaxHistoryFrames = 4*FilterTaps;
+    qint16 m_history[MaxHistoryFrames*2];
+    int m_historyFrames;
+    QVector<qint16> m_filterBank;
+    PolyphaseState m_filterState;
+
+    int resamplePolyphase( const qint16* srcSamples, qint16* dstSamples, int srcSamplesCount, bool mixWithExistingData );
+    static QVector<qint16> filterBank( int phases, int step );
+
     struct ResampleTable {
         QVector<int> samples;
         QVector<int> weight;
     };
 
+    ResampleTable m_table;
+
     ResampleTable* resampleTable( int frequency );
     static QCache <int,ResampleTable> m_resampleTables;
 };
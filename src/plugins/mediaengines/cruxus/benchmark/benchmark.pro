@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = 
+CONFIG += console
+QT -= gui
+DEPENDPATH += .
+INCLUDEPATH += . ../
+VPATH += ../
+
+SOURCES += audioresampler.cpp audiomixer.cpp audiomixer_sse2.cpp audiomixer_neon.cpp
+HEADERS += audioresampler.h audiomixer.h sinctable.h
+
+# Input
+SOURCES += main.cpp
+
+LIBS += -lrt
@@ -0,0 +1,291 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+/*
+    Measures the cost of mixing overlapping streams the way the Cruxus output
+    thread does, for each stream and for the whole output frame.
+
+    An underrun is counted for each output frame that takes longer to mix
+    than the share of the CPU given with -budget allows, so a low-end
+    device can be approximated on a faster one.
+
+    usage: benchmark [-kernels auto|generic] [-resampler polyphase|sinc]
+                     [-streams music,ringtone,clicks,voice,radio]
+                     [-seconds n] [-frame ms] [-budget percent] [-verify]
+*/
+
+#include <QStringList>
+#include <QVector>
+#include <QList>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "audioresampler.h"
+#include "audiomixer.h"
+
+using namespace cruxus;
+
+static const int OutputFrequency = 44100;
+static const int MaxVolume = 100;
+
+struct StreamType
+{
+    const char *name;
+    int frequency;
+    int channels;
+    int volume;
+};
+
+static const StreamType streamTypes[] =
+{
+    { "music", 44100, 2, 100 },
+    { "ringtone", 22050, 1, 80 },
+    { "clicks", 8000, 1, 100 },
+    { "voice", 48000, 2, 60 },
+    { "radio", 32000, 2, 100 }
+};
+
+struct Stream
+{
+    StreamType type;
+    QVector<qint16> signal;     // a few seconds, looped
+    int position;
+    AudioResampler *resampler;
+    qint64 cpuTime;
+};
+
+static qint64 cpuTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// A loud sweep with a harmonic, so mixing saturates now and then
+static QVector<qint16> makeSignal(const StreamType &type, int seconds)
+{
+    QVector<qint16> signal(type.frequency * seconds * type.channels);
+    double phase = 0;
+
+    for (int i = 0; i < type.frequency * seconds; ++i) {
+        double f = 100 + 4000.0 * i / (type.frequency * seconds);
+        phase += 2 * M_PI * f / type.frequency;
+
+        double s = 0.7 * sin(phase) + 0.3 * sin(3 * phase);
+        if (type.frequency == 8000)
+            s *= (i % 800) < 80 ? 1.0 : 0.0;    // key clicks
+
+        for (int c = 0; c < type.channels; ++c)
+            signal[i * type.channels + c] = qint16(s * (c ? 24000 : 30000));
+    }
+
+    return signal;
+}
+
+static QList<Stream> makeStreams(const QStringList &names, int frameMs, AudioResampler::Method method)
+{
+    QList<Stream> streams;
+
+    foreach (QString name, names) {
+        for (uint i = 0; i < sizeof(streamTypes) / sizeof(streamTypes[0]); ++i) {
+            if (name != streamTypes[i].name)
+                continue;
+
+            Stream stream;
+            stream.type = streamTypes[i];
+            stream.signal = makeSignal(stream.type, 3);
+            stream.position = 0;
+            stream.resampler = new AudioResampler(stream.type.frequency, stream.type.channels,
+                                                  OutputFrequency, frameMs, method);
+            stream.cpuTime = 0;
+            streams.append(stream);
+        }
+    }
+
+    return streams;
+}
+
+// What OutputThreadPrivate::resampleAndMix() does for 16 bit streams
+static int mixStream(Stream &stream, int frameMs, qint16 *mixbuf, bool first)
+{
+    const int channels = stream.type.channels;
+    const int count = stream.type.frequency * frameMs / 1000 * channels;
+
+    qint16 samples[count];
+    for (int i = 0; i < count; ++i) {
+        samples[i] = stream.signal[stream.position];
+        stream.position = (stream.position + 1) % stream.signal.size();
+    }
+
+    if (stream.type.volume < MaxVolume)
+        mixerRoutines.scale(samples, count, stream.type.volume * 32768 / MaxVolume);
+
+    return stream.resampler->resample(samples, mixbuf, count, !first);
+}
+
+static int mixFrame(QList<Stream> &streams, int frameMs, qint16 *mixbuf, int mixbufSamples, bool timed)
+{
+    int mixLength = 0;
+
+    for (int i = 0; i < streams.count(); ++i) {
+        qint64 start = timed ? cpuTime() : 0;
+
+        mixLength = qMax(mixStream(streams[i], frameMs, mixbuf, i == 0), mixLength);
+        if (i == 0)
+            memset(mixbuf + mixLength, 0, (mixbufSamples - mixLength) * 2);
+
+        if (timed)
+            streams[i].cpuTime += cpuTime() - start;
+    }
+
+    return mixLength;
+}
+
+// Checks the selected kernels against the generic ones
+static int verify(const QStringList &names, int frameMs, AudioResampler::Method method, bool simd)
+{
+    const int mixbufSamples = OutputFrequency * frameMs / 1000 * 2 + 64;
+    QVector<qint16> reference(mixbufSamples);
+    QVector<qint16> mixed(mixbufSamples);
+
+    initMixerRoutines(false);
+    QList<Stream> genericStreams = makeStreams(names, frameMs, method);
+    initMixerRoutines(simd);
+    QList<Stream> streams = makeStreams(names, frameMs, method);
+
+    int mismatches = 0;
+    for (int frame = 0; frame < 50; ++frame) {
+        initMixerRoutines(false);
+        int referenceLength = mixFrame(genericStreams, frameMs, reference.data(), mixbufSamples, false);
+        initMixerRoutines(simd);
+        int length = mixFrame(streams, frameMs, mixed.data(), mixbufSamples, false);
+
+        if (length != referenceLength)
+            ++mismatches;
+        for (int i = 0; i < qMin(length, referenceLength); ++i) {
+            if (mixed[i] != reference[i])
+                ++mismatches;
+        }
+    }
+
+    foreach (Stream stream, genericStreams)
+        delete stream.resampler;
+    foreach (Stream stream, streams)
+        delete stream.resampler;
+
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    bool simd = true;
+    AudioResampler::Method method = AudioResampler::Polyphase;
+    QStringList names = QString("music,ringtone,clicks").split(',');
+    int seconds = 60;
+    int frameMs = 100;
+    int budget = 100;
+    bool verifyKernels = false;
+
+    for (int i = 1; i < argc; ++i) {
+        QString arg = argv[i];
+        QString value = i + 1 < argc ? QString(argv[i + 1]) : QString();
+
+        if (arg == "-kernels") {
+            simd = value != "generic";
+            ++i;
+        } else if (arg == "-resampler") {
+            method = value == "sinc" ? AudioResampler::Sinc : AudioResampler::Polyphase;
+            ++i;
+        } else if (arg == "-streams") {
+            names = value.split(',');
+            ++i;
+        } else if (arg == "-seconds") {
+            seconds = qMax(1, value.toInt());
+            ++i;
+        } else if (arg == "-frame") {
+            frameMs = qBound(10, value.toInt(), 100);
+            ++i;
+        } else if (arg == "-budget") {
+            budget = qBound(1, value.toInt(), 100);
+            ++i;
+        } else if (arg == "-verify") {
+            verifyKernels = true;
+        } else {
+            fprintf(stderr, "usage: %s [-kernels auto|generic] [-resampler polyphase|sinc] "
+                            "[-streams music,ringtone,clicks,voice,radio] [-seconds n] "
+                            "[-frame ms] [-budget percent] [-verify]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const char *kernelNames[] = { "generic", "sse2", "neon" };
+
+    if (verifyKernels) {
+        int mismatches = verify(names, frameMs, method, simd);
+        printf("verify %s against generic: %d mismatched samples\n",
+               kernelNames[initMixerRoutines(simd)], mismatches);
+        if (mismatches)
+            return 1;
+    }
+
+    MixerKernels kernels = initMixerRoutines(simd);
+    QList<Stream> streams = makeStreams(names, frameMs, method);
+
+    const int mixbufSamples = OutputFrequency * frameMs / 1000 * 2 + 64;
+    QVector<qint16> mixbuf(mixbufSamples);
+
+    const int frames = seconds * 1000 / frameMs;
+    const qint64 frameBudget = qint64(frameMs) * 1000000 * budget / 100;
+    qint64 totalTime = 0;
+    qint64 worstTime = 0;
+    int underruns = 0;
+
+    for (int frame = 0; frame < frames; ++frame) {
+        qint64 start = cpuTime();
+        mixFrame(streams, frameMs, mixbuf.data(), mixbufSamples, true);
+        qint64 elapsed = cpuTime() - start;
+
+        totalTime += elapsed;
+        worstTime = qMax(worstTime, elapsed);
+        if (elapsed > frameBudget)
+            ++underruns;
+    }
+
+    printf("kernels %s, resampler %s, %d ms frames, %d s of audio, budget %d%%\n",
+           kernelNames[kernels], method == AudioResampler::Polyphase ? "polyphase" : "sinc",
+           frameMs, seconds, budget);
+    printf("%-10s %6s %4s %10s %10s\n", "stream", "Hz", "ch", "us/frame", "% cpu");
+
+    foreach (Stream stream, streams) {
+        double perFrame = stream.cpuTime / 1000.0 / frames;
+        printf("%-10s %6d %4d %10.1f %10.3f\n", stream.type.name, stream.type.frequency,
+               stream.type.channels, perFrame, perFrame / (frameMs * 10.0));
+        delete stream.resampler;
+    }
+
+    double perFrame = totalTime / 1000.0 / frames;
+    printf("%-10s %6s %4s %10.1f %10.3f\n", "total", "", "", perFrame, perFrame / (frameMs * 10.0));
+    printf("worst frame %.1f us, underruns %d of %d frames\n", worstTime / 1000.0, underruns, frames);
+
+    return 0;
+}
@@ -29,6 +29,9 @@
 #include <QAudioOutput>
 #include <QDebug>
 #include <QFile>
+#include <QSettings>
+#include <QStringList>
+#include <QValueSpaceObject>
 
 #include <qtopialog.h>
 
@@ -36,6 +39,8 @@
 
 #include "cruxusoutputthread.h"
 #include "audioresampler.h"
+#include "audiomixer.h"
+#include "inputstream.h"
 
 //#define DEBUG_ENGINE
 
@@ -72,6 +77,15 @@ public:
                                           (request_bitsPerSample / 8) *
                                           request_channels;
 
+#ifndef ALSA_PERIOD_SIZE
+    static const int frame_samples = (request_frequency / (1000 / frame_milliseconds)) *
+                                     request_channels;
+#else
+    static const int frame_samples = ALSA_PERIOD_SIZE * request_channels;
+#endif
+
+    static const int status_interval = 1000;
+
     bool                    opened;
     bool                    running;
     bool                    quit;
@@ -81,8 +95,13 @@ public:
     QWaitCondition          condition;
     QAudioOutput*           audioOutput;
     QMediaDevice::Info      inputInfo;
-    QList<QMediaDevice*>    activeSessions;
-    QList<AudioResampler*>  audioResamplers;
+    QList<InputStream*>     streams;
+    int                     lastStreamId;
+    int                     latencySamples;
+    AudioResampler::Method  resamplerMethod;
+    QValueSpaceObject*      status;
+    QTimer*                 statusTimer;
+    QStringList             publishedStreams;
 
     char    mixbuf[default_frame_size];
 
@@ -91,12 +110,6 @@ public:
 
 protected:
     void run();
-
-private:
-    int readFromDevice(QMediaDevice* device, QMediaDevice::Info const& info, char* working);
-    int resampleAndMix(AudioResampler* audioResampler, QMediaDevice::Info const& deviceInfo, char* src, int dataAmt, bool first);
-    qint32 addSamples(qint32 s1,qint32 s2);
-
 };
 
 void OutputThreadPrivate::run()
@@ -128,7 +141,7 @@ void OutputThreadPrivate::run()
     {
         QMutexLocker    conditionLock(&mutex);
 
-        int             sc = activeSessions.size();
+        int             sc = streams.size();
 
         if (sc == 0 && silenceDuration >= max_silence_duration) {
             // No sessions to process, added silence, we are finished
@@ -146,28 +159,40 @@ void OutputThreadPrivate::run()
                 }
 
                 bool    first = true;
+                bool    filling = false;
                 int     mixLength = 0;
-                char    working[default_frame_size*8];
+                qint16  working[frame_samples];
 
                 for (int i = 0; i < sc; ++i) {
-                    QMediaDevice* input = activeSessions.at(i);
-                    QMediaDevice::Info const& info = input->dataType();
-                    AudioResampler *resampler = audioResamplers[i];
-
-                    int read = readFromDevice(input, info, working);
+                    InputStream* stream = streams.at(i);
+                    qint16* samples = first ? (qint16*)mixbuf : working;
 
+                    int read = stream->read(samples, frame_samples);
 
                     if (read > 0) {
-                        mixLength = qMax(resampleAndMix(resampler, info, working, read, first), mixLength);
+                        int volume = stream->device()->dataType().volume;
+                        if (volume < MAX_VOLUME)
+                            mixerRoutines.scale(samples, read, qMax(0, volume) * 32768 / MAX_VOLUME);
+
+                        if (first) {
+                            // later streams may be longer and mix into the rest of the frame
+                            memset(mixbuf + read*2, 0, sizeof(mixbuf) - read*2);
+                        } else {
+                            mixerRoutines.mix((qint16*)mixbuf, working, read);
+                        }
+                        mixLength = qMax(read*2, mixLength);
                         first = false;
                     }
-                    else {
-                        activeSessions.removeAt(i);
-                        delete audioResamplers[i];
-                        audioResamplers.removeAt(i);
+                    else if (stream->atEnd()) {
+                        streams.removeAt(i);
+                        delete stream;
                         --sc;
                         --i;
                     }
+                    else {
+                        // still buffering up to the latency target
+                        filling = true;
+                    }
                 }
 
                 if (mixLength > 0) {
@@ -193,8 +218,10 @@ void OutputThreadPrivate::run()
 #endif
                     audioOutput->write( mixbuf, mixLength );
                 }
-                if(silenceDuration >= max_silence_duration)
-                    timeout = activeSessions.size() > 0 ? 0 : 30000;
+                if (filling && mixLength == 0)
+                    timeout = qMax(1, frame_milliseconds / 4);
+                else if(silenceDuration >= max_silence_duration)
+                    timeout = streams.size() > 0 ? 0 : 30000;
                 else
                     timeout = 0;
             } else {
@@ -226,79 +253,13 @@ void OutputThreadPrivate::suspend()
 
 void OutputThreadPrivate::resume()
 {
-    if(audioOutput && !opened && !activeSessions.isEmpty() )
+    if(audioOutput && !opened && !streams.isEmpty() )
         opened = audioOutput->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
     silenceDuration = max_silence_duration;
     paused = false;
     qLog(Media) << "OutputThreadPrivate::resume()";
 }
 
-inline int OutputThreadPrivate::readFromDevice
-(
- QMediaDevice* device,
- QMediaDevice::Info const& info,
- char* working
-)
-{
-#ifndef ALSA_PERIOD_SIZE
-    int requestedDataSize = ( info.frequency / (1000 / frame_milliseconds)) *
-                                 (info.bitsPerSample / 8) *
-                                 info.channels;
-#else
-    int requestedDataSize = ALSA_PERIOD_SIZE *
-                            (info.bitsPerSample/8) * info.channels;
-#endif
-
-    return device->read(working, requestedDataSize);
-}
-
-int OutputThreadPrivate::resampleAndMix
-(
- AudioResampler* audioResampler,
- QMediaDevice::Info const& deviceInfo,
- char* src,
- int dataAmt,
- bool first
-)
-{
-    int converted = 0;
-
-    if ( deviceInfo.bitsPerSample == 16 && deviceInfo.volume == MAX_VOLUME ) {
-        converted = audioResampler->resample( (const qint16*)src, (qint16*)mixbuf, dataAmt/2, !first );
-    } else {
-        int samplesCount = dataAmt * 8 / deviceInfo.bitsPerSample;
-        qint16 samples[samplesCount];
-
-        switch ( deviceInfo.bitsPerSample ) {
-        case 8:
-            for ( int i=0; i<samplesCount; i++ )
-                samples[i] = (int(src[i]) - 128)*256;
-            break;
-        case 16:
-            memcpy( samples, src, dataAmt );
-            break;
-        case 32:
-            {
-                int *srcSamples = (int*)src;
-                for ( int i=0; i<samplesCount; i++ )
-                    samples[i] = srcSamples[i]; // is this correct?
-            }
-            break;
-        default:
-            qWarning() << deviceInfo.bitsPerSample << "bits per sample is not supported";
-            memset( samples, 0, sizeof(samples) );
-        }
-
-        if ( deviceInfo.volume < MAX_VOLUME ) {
-            for ( int i=0; i<samplesCount; i++ )
-                samples[i] = qint32(samples[i])*deviceInfo.volume/MAX_VOLUME;
-        }
-
-        converted = audioResampler->resample( samples, (qint16*)mixbuf, samplesCount, !first );
-    }
-
-    return converted*2;
-}
 // }}}
 
 // {{{ OutputThread
@@ -314,6 +275,32 @@ OutputThread::OutputThread():
     qLog(Media) << "OutputThread::OutputThread()";
     d->opened = false;
     d->paused = false;
+    d->lastStreamId = 0;
+
+    QSettings settings("Trolltech", "cruxus");
+    settings.beginGroup("Mixer");
+
+    bool simd = settings.value("Kernels", "auto").toString() != "generic";
+    MixerKernels kernels = initMixerRoutines(simd);
+
+    if (settings.value("Resampler", "polyphase").toString() == "sinc")
+        d->resamplerMethod = AudioResampler::Sinc;
+    else
+        d->resamplerMethod = AudioResampler::Polyphase;
+
+    // decoded audio buffered ahead of the output, never less than a frame
+    int latency = qMax(settings.value("Latency", 2 * d->frame_milliseconds).toInt(),
+                       int(d->frame_milliseconds));
+    d->latencySamples = qMax(latency * d->request_frequency / 1000 * d->request_channels,
+                             int(d->frame_samples));
+
+    qLog(Media) << "OutputThread::OutputThread(); mixer kernels" << kernels <<
+                "resampler" << d->resamplerMethod << "latency" << latency;
+
+    d->status = new QValueSpaceObject("/Media/Engines/Cruxus/Streams", this);
+    d->statusTimer = new QTimer(this);
+    connect(d->statusTimer, SIGNAL(timeout()), SLOT(updateStatus()));
+
     d->start(QThread::HighPriority);
 }
 
@@ -328,6 +315,8 @@ OutputThread::~OutputThread()
     d->condition.wakeOne();
     d->wait();
 
+    qDeleteAll(d->streams);
+
     delete d;
 }
 
@@ -352,17 +341,21 @@ bool OutputThread::connectToInput(QMediaDevice* input)
 
 void OutputThread::disconnectFromInput(QMediaDevice* input)
 {
-    QMutexLocker    lock(&d->mutex);
+    QList<InputStream*> removed;
 
-    input->disconnect(this);
+    {
+        QMutexLocker    lock(&d->mutex);
 
-    for ( int i=0; i<d->activeSessions.count(); i++ ) {
-        if ( d->activeSessions[i] == input ) {
-            d->activeSessions.removeAt(i);
-            delete d->audioResamplers[i];
-            d->audioResamplers.removeAt(i);
+        input->disconnect(this);
+
+        for ( int i=0; i<d->streams.count(); i++ ) {
+            if ( d->streams[i]->device() == input )
+                removed.append( d->streams.takeAt(i--) );
         }
     }
+
+    // Waits for a read in progress, keep the output thread mixing meanwhile
+    qDeleteAll(removed);
 }
 
 bool OutputThread::open(QIODevice::OpenMode mode)
@@ -392,18 +385,83 @@ void OutputThread::deviceReady()
     }
 
     QMediaDevice* mediaDevice = qobject_cast<QMediaDevice*>(sender());
-    QMediaDevice::Info const& info = mediaDevice->dataType();
 
+    for ( int i=0; i<d->streams.count(); i++ ) {
+        InputStream* stream = d->streams[i];
+        if ( stream->device() == mediaDevice ) {
+            // resumed before the buffered data played out
+            if ( stream->atEnd() )
+                stream->startProducing();
+            return;
+        }
+    }
+
+    QMediaDevice::Info const& info = mediaDevice->dataType();
 
     AudioResampler *resampler = new AudioResampler( info.frequency, info.channels,
-                                                    d->request_frequency, d->frame_milliseconds );
+                                                    d->request_frequency, d->frame_milliseconds,
+                                                    d->resamplerMethod );
 
-    d->activeSessions.append( mediaDevice );
-    d->audioResamplers.append( resampler );
+    InputStream *stream = new InputStream( ++d->lastStreamId, mediaDevice, resampler,
+                                           d->frame_milliseconds, d->latencySamples );
+
+    d->streams.append( stream );
+    stream->startProducing();
+
+    if ( !d->statusTimer->isActive() )
+        d->statusTimer->start( d->status_interval );
 
     d->condition.wakeOne();
 }
 
+/*
+    Publishes the fill level and underruns of each stream in the value
+    space, in milliseconds of output, for example
+    /Media/Engines/Cruxus/Streams/3/Fill.
+*/
+void OutputThread::updateStatus()
+{
+    // never hold up the output thread for statistics, retry next time
+    if ( !d->mutex.tryLock() )
+        return;
+
+    QStringList ids;
+    QList<int>  fill;
+    QList<int>  latency;
+    QList<int>  underruns;
+    QList<int>  missing;
+
+    for ( int i=0; i<d->streams.count(); i++ ) {
+        InputStream* stream = d->streams[i];
+
+        ids << QString::number( stream->id() );
+        fill << stream->fillLevel();
+        latency << stream->latency();
+        underruns << stream->underruns();
+        missing << stream->missingSamples();
+    }
+
+    d->mutex.unlock();
+
+    const int samplesPerMs = d->request_frequency * d->request_channels / 1000;
+
+    for ( int i=0; i<ids.count(); i++ ) {
+        d->status->setAttribute( ids[i] + "/Fill", fill[i] / samplesPerMs );
+        d->status->setAttribute( ids[i] + "/Latency", latency[i] / samplesPerMs );
+        d->status->setAttribute( ids[i] + "/Underruns", underruns[i] );
+        d->status->setAttribute( ids[i] + "/UnderrunTime", missing[i] / samplesPerMs );
+    }
+
+    for ( int i=0; i<d->publishedStreams.count(); i++ ) {
+        if ( !ids.contains( d->publishedStreams[i] ) )
+            d->status->removeAttribute( d->publishedStreams[i] );
+    }
+    d->publishedStreams = ids;
+
+    if ( ids.isEmpty() )
+        d->statusTimer->stop();
+}
+
 void OutputThread::suspend()
 {
     d->suspend();
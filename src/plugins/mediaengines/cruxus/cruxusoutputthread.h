@@ -45,6 +45,7 @@ public:
 
 private slots:
     void deviceReady();
+    void updateStatus();
 
 public slots:
     void suspend();
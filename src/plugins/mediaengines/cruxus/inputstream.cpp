@@ -0,0 +1,208 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <string.h>
+
+#include <QDebug>
+
+#include <qtopialog.h>
+
+#include <custom.h>
+
+#include "inputstream.h"
+#include "audioresampler.h"
+
+namespace cruxus
+{
+
+/*!
+    \class cruxus::InputStream
+    \internal
+
+    Decodes one input of the output thread on its own thread. Data is
+    read from the QMediaDevice, converted to 16 bit samples and resampled
+    to the output format into a StreamBuffer which is kept filled to the
+    latency target. The output thread takes complete frames with read()
+    and never waits for the device.
+*/
+
+InputStream::InputStream
+(
+ int id,
+ QMediaDevice* device,
+ AudioResampler* resampler,
+ int frameMilliseconds,
+ int latencySamples
+):
+    m_id(id),
+    m_device(device),
+    m_resampler(resampler),
+    m_buffer(latencySamples + resampler->maxOutputSamples()),
+    m_frameMilliseconds(frameMilliseconds),
+    m_latency(latencySamples),
+    m_started(false),
+    m_stop(0),
+    m_atEnd(0),
+    m_underruns(0),
+    m_missingSamples(0)
+{
+}
+
+InputStream::~InputStream()
+{
+    stopProducing();
+
+    qLog(Media) << "InputStream::~InputStream();" << m_id << ":" << m_underruns << "underruns," <<
+                m_missingSamples << "samples missing";
+
+    delete m_resampler;
+}
+
+/*!
+    Starts, or restarts after the device ran dry, the producer thread.
+    Data still buffered from before is kept.
+*/
+void InputStream::startProducing()
+{
+    wait();
+
+    m_stop = 0;
+    m_atEnd = 0;
+
+    start(QThread::HighPriority);
+}
+
+/*!
+    Stops the producer thread and waits for the device read in progress
+    to complete.
+*/
+void InputStream::stopProducing()
+{
+    m_stop = 1;
+    wait();
+}
+
+/*!
+    Returns true once the producer has stopped reading from the device.
+*/
+bool InputStream::atEnd() const
+{
+    return const_cast<QAtomicInt&>(m_atEnd).fetchAndAddAcquire(0) != 0;
+}
+
+/*!
+    Called from the output thread to take \a count samples for the next
+    frame into \a samples. Returns 0 while the buffer is filling up to the
+    latency target. A short buffer is padded with silence and counted as an
+    underrun unless the device has ended, in which case the remaining
+    samples are returned.
+*/
+int InputStream::read(qint16* samples, int count)
+{
+    // the end flag is published after the last write
+    const bool end = atEnd();
+
+    if (!m_started) {
+        if (m_buffer.available() < m_latency && !end)
+            return 0;
+        m_started = true;
+    }
+
+    int read = m_buffer.read(samples, count);
+
+    if (read < count && !end) {
+        memset(samples + read, 0, (count - read) * sizeof(qint16));
+
+        m_underruns.ref();
+        m_missingSamples.fetchAndAddRelaxed(count - read);
+
+        read = count;
+    }
+
+    return read;
+}
+
+void InputStream::run()
+{
+    qint16 converted[m_resampler->maxOutputSamples()];
+
+    while (!m_stop) {
+        if (m_buffer.available() >= m_latency) {
+            msleep(qMax(1, m_frameMilliseconds / 4));
+            continue;
+        }
+
+        QMediaDevice::Info const& info = m_device->dataType();
+
+#ifndef ALSA_PERIOD_SIZE
+        int requestedDataSize = ( info.frequency / (1000 / m_frameMilliseconds)) *
+                                     (info.bitsPerSample / 8) *
+                                     info.channels;
+#else
+        int requestedDataSize = ALSA_PERIOD_SIZE *
+                                (info.bitsPerSample/8) * info.channels;
+#endif
+
+        char working[requestedDataSize];
+
+        int read = m_device->read(working, requestedDataSize);
+        if (read <= 0)
+            break;
+
+        m_buffer.write(converted, decode(info, working, read, converted));
+    }
+
+    m_atEnd.fetchAndStoreRelease(1);
+}
+
+int InputStream::decode
+(
+ QMediaDevice::Info const& info,
+ char* src,
+ int dataAmt,
+ qint16* dst
+)
+{
+    if ( info.bitsPerSample == 16 )
+        return m_resampler->resample( (const qint16*)src, dst, dataAmt/2, false );
+
+    int samplesCount = dataAmt * 8 / info.bitsPerSample;
+    qint16 samples[samplesCount];
+
+    switch ( info.bitsPerSample ) {
+    case 8:
+        for ( int i=0; i<samplesCount; i++ )
+            samples[i] = (int(src[i]) - 128)*256;
+        break;
+    case 32:
+        {
+            int *srcSamples = (int*)src;
+            for ( int i=0; i<samplesCount; i++ )
+                samples[i] = srcSamples[i]; // is this correct?
+        }
+        break;
+    default:
+        qWarning() << info.bitsPerSample << "bits per sample is not supported";
+        memset( samples, 0, sizeof(samples) );
+    }
+
+    return m_resampler->resample( samples, dst, samplesCount, false );
+}
+
+}   // ns cruxus
@@ -0,0 +1,79 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef INPUTSTREAM_H
+#define INPUTSTREAM_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QMediaDevice>
+
+#include "streambuffer.h"
+
+namespace cruxus
+{
+
+class AudioResampler;
+
+class InputStream : public QThread
+{
+    Q_OBJECT
+
+public:
+    InputStream(int id, QMediaDevice* device, AudioResampler* resampler,
+                int frameMilliseconds, int latencySamples);
+    ~InputStream();
+
+    int id() const { return m_id; }
+    QMediaDevice* device() const { return m_device; }
+
+    void startProducing();
+    void stopProducing();
+    bool atEnd() const;
+
+    int read(qint16* samples, int count);
+
+    int fillLevel() const { return m_buffer.available(); }
+    int latency() const { return m_latency; }
+    int underruns() const { return m_underruns; }
+    int missingSamples() const { return m_missingSamples; }
+
+protected:
+    void run();
+
+private:
+    int decode(QMediaDevice::Info const& info, char* src, int dataAmt, qint16* dst);
+
+    int                 m_id;
+    QMediaDevice*       m_device;
+    AudioResampler*     m_resampler;
+    StreamBuffer        m_buffer;
+    int                 m_frameMilliseconds;
+    int                 m_latency;
+    bool                m_started;
+
+    QAtomicInt          m_stop;
+    QAtomicInt          m_atEnd;
+    QAtomicInt          m_underruns;
+    QAtomicInt          m_missingSamples;
+};
+
+}   // ns cruxus
+
+#endif
@@ -26,7 +26,10 @@ HEADERS=\
     cruxusurihandlers.h\
     cruxusoutputdevices.h\
     cruxusoutputthread.h\
-    audioresampler.h
+    audioresampler.h\
+    audiomixer.h\
+    streambuffer.h\
+    inputstream.h
 
 SOURCES=\
     contentdevice.cpp\
@@ -37,5 +40,16 @@ SOURCES=\
     cruxusurihandlers.cpp\
     cruxusoutputdevices.cpp\
     cruxusoutputthread.cpp\
-    audioresampler.cpp
+    audioresampler.cpp\
+    audiomixer.cpp\
+    audiomixer_sse2.cpp\
+    audiomixer_neon.cpp\
+    streambuffer.cpp\
+    inputstream.cpp
+
+settings [
+    hint=image
+    files=cruxus.conf
+    path=/etc/default/Trolltech
+]
 
@@ -0,0 +1,116 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <string.h>
+
+#include "streambuffer.h"
+
+namespace cruxus
+{
+
+/*!
+    \class cruxus::StreamBuffer
+    \internal
+
+    A ring of 16 bit samples with a single writer thread and a single
+    reader thread. Neither side takes a lock; each publishes its position
+    with release semantics after touching the data and reads the other
+    side's position with acquire semantics.
+*/
+
+StreamBuffer::StreamBuffer(int capacity):
+    m_written(0),
+    m_read(0)
+{
+    int size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_data = new qint16[size];
+    m_mask = size - 1;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    delete[] m_data;
+}
+
+/*!
+    Returns the number of samples the reader can take.
+*/
+int StreamBuffer::available() const
+{
+    return int(uint(m_written.fetchAndAddAcquire(0)) - uint(m_read.fetchAndAddAcquire(0)));
+}
+
+/*!
+    Returns the number of samples the writer can add.
+*/
+int StreamBuffer::space() const
+{
+    return capacity() - available();
+}
+
+/*!
+    Copies up to \a count samples into the buffer and returns how many
+    were written. Must only be called from the writer thread.
+*/
+int StreamBuffer::write(const qint16* samples, int count)
+{
+    const uint written = uint(int(m_written));
+
+    count = qMin(count, space());
+    if (count <= 0)
+        return 0;
+
+    const int start = written & m_mask;
+    const int first = qMin(count, capacity() - start);
+
+    memcpy(m_data + start, samples, first * sizeof(qint16));
+    memcpy(m_data, samples + first, (count - first) * sizeof(qint16));
+
+    m_written.fetchAndAddRelease(count);
+
+    return count;
+}
+
+/*!
+    Copies up to \a count samples out of the buffer and returns how many
+    were read. Must only be called from the reader thread.
+*/
+int StreamBuffer::read(qint16* samples, int count)
+{
+    const uint read = uint(int(m_read));
+
+    count = qMin(count, available());
+    if (count <= 0)
+        return 0;
+
+    const int start = read & m_mask;
+    const int first = qMin(count, capacity() - start);
+
+    memcpy(samples, m_data + start, first * sizeof(qint16));
+    memcpy(samples + first, m_data, (count - first) * sizeof(qint16));
+
+    m_read.fetchAndAddRelease(count);
+
+    return count;
+}
+
+}   // ns cruxus
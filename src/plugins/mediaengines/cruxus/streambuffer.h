@@ -0,0 +1,56 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <QAtomicInt>
+
+namespace cruxus
+{
+
+class StreamBuffer
+{
+public:
+    explicit StreamBuffer(int capacity);
+    ~StreamBuffer();
+
+    int capacity() const { return m_mask + 1; }
+
+    int available() const;
+    int space() const;
+
+    int write(const qint16* samples, int count);
+    int read(qint16* samples, int count);
+
+private:
+    Q_DISABLE_COPY(StreamBuffer)
+
+    qint16*     m_data;
+    int         m_mask;
+
+    // free running sample counts, only the writer advances m_written and
+    // only the reader advances m_read
+    mutable QAtomicInt  m_written;
+    mutable QAtomicInt  m_read;
+};
+
+}   // ns cruxus
+
+#endif
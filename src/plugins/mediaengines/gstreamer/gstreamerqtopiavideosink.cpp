@@ -22,6 +22,7 @@
 
 #include "gstreamersinkwidget.h"
 #include "qvideosurface.h"
+#include "qvideoframepool.h"
 
 #include "gstreamerqtopiavideosink.h"
 
@@ -148,6 +149,55 @@ GstStateChangeReturn QtopiaVideoSink::change_state(GstElement* element, GstState
     return GST_ELEMENT_CLASS(parentClass)->change_state(element, transition);
 }
 
+#if GST_CHECK_VERSION(0,10,22)
+static void releasePoolBuffer(gpointer data)
+{
+    QVideoFramePool::releaseBuffer(reinterpret_cast<uchar*>(data));
+}
+
+GstFlowReturn QtopiaVideoSink::buffer_alloc(GstBaseSink* sink, guint64 offset, guint size, GstCaps* caps, GstBuffer** buf)
+{
+    Q_UNUSED(sink);
+
+    // Upstream decodes into buffers from the shared frame pool, so the frames
+    // are displayed and recycled without being copied
+    uchar *data = QVideoFramePool::instance()->allocateBuffer(size);
+
+    if (data == 0) {
+        *buf = 0; // let the pad allocate the buffer
+        return GST_FLOW_OK;
+    }
+
+    GstBuffer* buffer = gst_buffer_new();
+    GST_BUFFER_DATA(buffer) = data;
+    GST_BUFFER_MALLOCDATA(buffer) = data;
+    GST_BUFFER_FREE_FUNC(buffer) = releasePoolBuffer;
+    GST_BUFFER_SIZE(buffer) = size;
+    GST_BUFFER_OFFSET(buffer) = offset;
+    gst_buffer_set_caps(buffer, caps);
+
+    *buf = buffer;
+
+    return GST_FLOW_OK;
+}
+#endif
+
+QVideoFrame QtopiaVideoSink::frameFromBuffer(GstBuffer* buf) const
+{
+    QSize size(width, height);
+
+#if GST_CHECK_VERSION(0,10,22)
+    if (GST_BUFFER_FREE_FUNC(buf) == releasePoolBuffer &&
+        GST_BUFFER_DATA(buf) == GST_BUFFER_MALLOCDATA(buf) &&
+        GST_BUFFER_SIZE(buf) >= guint(QVideoFramePool::frameBufferSize(pixelFormat, size))) {
+        // the frame keeps the pool buffer while in use, even after the GstBuffer is freed
+        return QVideoFramePool::frameFromBuffer(GST_BUFFER_DATA(buf), pixelFormat, size);
+    }
+#endif
+
+    return QVideoFrame(pixelFormat, size, GST_BUFFER_DATA(buf));
+}
+
 GstFlowReturn QtopiaVideoSink::render(GstBaseSink* sink, GstBuffer* buf)
 {
     GstFlowReturn   rc = GST_FLOW_OK;
@@ -163,9 +213,7 @@ GstFlowReturn QtopiaVideoSink::render(GstBaseSink* sink, GstBuffer* buf)
         self->lastBuffer = buf;
         gst_buffer_ref(self->lastBuffer);
 
-        QVideoFrame frame( self->pixelFormat,
-                           QSize( self->width, self->height ),
-                           GST_BUFFER_DATA(buf) );
+        QVideoFrame frame = self->frameFromBuffer(buf);
 
         if (self->widget)
             self->widget->paint( frame );
@@ -179,9 +227,7 @@ GstFlowReturn QtopiaVideoSink::render(GstBaseSink* sink, GstBuffer* buf)
 void QtopiaVideoSink::renderLastFrame()
 {
     if ( lastBuffer ) {
-        QVideoFrame frame( pixelFormat,
-                           QSize( width, height ),
-                           GST_BUFFER_DATA(lastBuffer) );
+        QVideoFrame frame = frameFromBuffer(lastBuffer);
 
         if (widget)
             widget->paint( frame );
@@ -239,7 +285,9 @@ void QtopiaVideoSinkClass::class_init(gpointer g_class, gpointer class_data)
     // base
     gstBaseSinkClass->get_caps = QtopiaVideoSink::get_caps;
     gstBaseSinkClass->set_caps = QtopiaVideoSink::set_caps;
-//    gstbasesink_class->buffer_alloc = buffer_alloc;
+#if GST_CHECK_VERSION(0,10,22)
+    gstBaseSinkClass->buffer_alloc = QtopiaVideoSink::buffer_alloc;
+#endif
 //    gstbasesink_class->get_times = get_times;
     gstBaseSinkClass->preroll = QtopiaVideoSink::render;
     gstBaseSinkClass->render = QtopiaVideoSink::render;
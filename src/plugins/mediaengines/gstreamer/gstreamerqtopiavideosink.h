@@ -43,11 +43,15 @@ public:
     GstBuffer       *lastBuffer;
 
     void renderLastFrame();
+    QVideoFrame frameFromBuffer(GstBuffer* buf) const;
 
     static GstCaps* get_caps(GstBaseSink* sink);
     static gboolean set_caps(GstBaseSink* sink, GstCaps* caps);
     static GstStateChangeReturn change_state(GstElement* element, GstStateChange transition);
     static GstFlowReturn render(GstBaseSink* sink, GstBuffer* buf);
+#if GST_CHECK_VERSION(0,10,22)
+    static GstFlowReturn buffer_alloc(GstBaseSink* sink, guint64 offset, guint size, GstCaps* caps, GstBuffer** buf);
+#endif
     static void base_init(gpointer g_class);
     static void instance_init(GTypeInstance *instance, gpointer g_class);
 };
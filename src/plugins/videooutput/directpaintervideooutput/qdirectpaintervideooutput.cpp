@@ -25,11 +25,13 @@
 #include <QDebug>
 #include <QTime>
 #include <QMutex>
+#include <qtopialog.h>
 
 #include <QtGui/qscreen_qws.h>
 #include <gfxpainter.h>
 
 #include "qimageplanetransform.h"
+#include "qvideoframepool.h"
 
 
 #define USE_GFX_PAINTER 0
@@ -39,7 +41,8 @@
 class QDirectPainterVideoOutputPrivate {
 public:
     QDirectPainterVideoOutputPrivate()
-        :blackRegionUpdates(0) {
+        :blackRegionUpdates(0),
+        renderedFrames(0) {
     }
     QRegion prevClipRegion;
 
@@ -55,6 +58,8 @@ public:
     QList<QImagePlaneTransformation*> imageTransformations;
     QVideoFormatList preferredFormats;
     QVideoFormatList supportedFormats;
+
+    int renderedFrames;
 };
 
 QDirectPainterVideoOutput::QDirectPainterVideoOutput( QScreen *_screen, QObject *parent )
@@ -94,6 +99,15 @@ void QDirectPainterVideoOutput::doRenderFrame( const QVideoFrame& frame )
 
     d->prevClipRegion = clipRegion();
 
+    // frames should be recycled rather than allocated or copied once playing
+    if ( ++d->renderedFrames % 100 == 0 ) {
+        QVideoFramePool::Counters counters = QVideoFramePool::counters();
+        qLog(Media) << "QDirectPainterVideoOutput:" << d->renderedFrames << "frames rendered,"
+                    << counters.allocations << "buffers allocated,"
+                    << counters.copies << "copied,"
+                    << counters.recycled << "recycled";
+    }
+
     if ( frame.size() != d->videoSize ) {
         d->videoSize = frame.size();
         setModified(true);
@@ -239,7 +253,8 @@ void QDirectPainterVideoOutput::doRenderFrame( const QVideoFrame& frame )
 
 #if USE_IMAGE_SCALLER
         foreach( QImagePlaneTransformation *transformation, d->imageTransformations ) {
-            transformation->transformPlane( imageData, frame.format(), screen()->base(), nativeScreenPixelFormat() );
+            //YUV frames are converted together with scaling and rotation
+            transformation->transformPlane( frame, screen()->base(), nativeScreenPixelFormat() );
         }
 #elif USE_GFX_PAINTER
         QImage frameImage( imageData,
@@ -0,0 +1,244 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "boottimeline.h"
+
+#include <QFile>
+#include <QSet>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+/*!
+    \class BootTimeline
+    \inpublicgroup QtBaseModule
+    \ingroup QtopiaServer
+    \brief The BootTimeline class records how long server tasks take to start.
+
+    The task system records an event for every task it constructs, every time
+    a thread blocks waiting for a task that is being constructed on another
+    thread and every group of tasks passed to QtopiaServerApplication::startup().
+    Events are recorded against the thread they happened on.
+
+    write() saves the events in the trace event format understood by
+    \c {chrome://tracing} and similar trace viewers.  Events on the critical
+    path, the chain of events that determined when startup finished, are
+    marked with a \c critical argument.
+
+    This class is part of the Qt Extended server and cannot be used by other Qt Extended
+    applications.
+*/
+
+/*!
+    \enum BootTimeline::EventType
+
+    \value Task A task was constructed.
+    \value Wait A thread waited for a task that another thread was constructing.
+    \value Group A group of tasks was started.
+*/
+
+/*!
+    Constructs an empty timeline.  Event times are relative to its construction.
+*/
+BootTimeline::BootTimeline()
+: m_origin(0)
+{
+    m_origin = now();
+}
+
+/*!
+    Records the start of an event of \a type called \a name on the current
+    thread and returns its identifier.  For a Wait event, \a target is the
+    task being waited for.
+*/
+int BootTimeline::begin(EventType type, const QByteArray &name, const QByteArray &target)
+{
+    QMutexLocker locker(&m_lock);
+    Event event;
+    event.type = type;
+    event.name = name;
+    event.target = target;
+    event.thread = threadIndex();
+    event.start = now();
+    event.end = -1;
+    m_events.append(event);
+    return m_events.count() - 1;
+}
+
+/*!
+    Records the end of the \a event returned by begin().
+*/
+void BootTimeline::end(int event)
+{
+    QMutexLocker locker(&m_lock);
+    if (event >= 0 && event < m_events.count())
+        m_events[event].end = now();
+}
+
+/*!
+    Records that \a task required \a dependency to be started before it.
+*/
+void BootTimeline::addDependency(const QByteArray &task, const QByteArray &dependency)
+{
+    QMutexLocker locker(&m_lock);
+    if (!m_dependencies[task].contains(dependency))
+        m_dependencies[task].append(dependency);
+}
+
+/*!
+    Returns the names of the events on the critical path, in the order they
+    happened.
+*/
+QList<QByteArray> BootTimeline::criticalPath() const
+{
+    QMutexLocker locker(&m_lock);
+    QList<QByteArray> rv;
+    foreach (int event, criticalEvents()) {
+        const Event &e = m_events.at(event);
+        rv.append(e.type == Wait ? "wait:" + e.target : e.name);
+    }
+    return rv;
+}
+
+/*!
+    \internal
+    Walks back from the last event to finish, each time to the linked event
+    that finished last.  Events are linked to the earlier events on their
+    thread, to the events nested inside them, to the task they waited for
+    and to the tasks they required.
+*/
+QList<int> BootTimeline::criticalEvents() const
+{
+    int current = -1;
+    for (int ii = 0; ii < m_events.count(); ++ii) {
+        const Event &e = m_events.at(ii);
+        if (e.type != Group && e.end >= 0 &&
+            (current == -1 || e.end > m_events.at(current).end))
+            current = ii;
+    }
+
+    QList<int> path;
+    QSet<int> visited;
+    while (current != -1) {
+        path.prepend(current);
+        visited.insert(current);
+
+        const Event &e = m_events.at(current);
+        QList<QByteArray> linked = m_dependencies.value(e.name);
+        if (e.type == Wait)
+            linked.append(e.target);
+
+        int next = -1;
+        for (int ii = 0; ii < m_events.count(); ++ii) {
+            const Event &c = m_events.at(ii);
+            if (visited.contains(ii) || c.type == Group || c.end < 0 || c.end > e.end)
+                continue;
+            bool link = false;
+            if (c.thread == e.thread)
+                link = c.end <= e.start || c.start >= e.start;
+            if (!link && c.type == Task)
+                link = linked.contains(c.name) ||
+                       (e.type == Wait && c.end >= e.start);   // woke the wait
+            if (link && (next == -1 || c.end > m_events.at(next).end))
+                next = ii;
+        }
+        current = next;
+    }
+    return path;
+}
+
+static QByteArray traceString(const QByteArray &str)
+{
+    QByteArray rv = str;
+    rv.replace('\\', "\\\\");
+    rv.replace('"', "\\\"");
+    return '"' + rv + '"';
+}
+
+/*!
+    Writes the timeline to \a fileName in trace event format.  Returns true
+    on success.
+*/
+bool BootTimeline::write(const QString &fileName) const
+{
+    QMutexLocker locker(&m_lock);
+
+    QSet<int> critical = criticalEvents().toSet();
+    QByteArray pid = QByteArray::number(::getpid());
+    QByteArray out("{\"traceEvents\":[\n");
+
+    for (int ii = 0; ii < m_threads.count(); ++ii) {
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid +
+               ",\"tid\":" + QByteArray::number(ii) + ",\"args\":{\"name\":" +
+               traceString(ii ? "worker " + QByteArray::number(ii) : QByteArray("main")) + "}},\n";
+    }
+
+    static const char * const categories[] = { "task", "wait", "group" };
+    for (int ii = 0; ii < m_events.count(); ++ii) {
+        const Event &e = m_events.at(ii);
+        if (e.end < 0)
+            continue;
+        QByteArray args;
+        if (e.type == Wait)
+            args += "\"task\":" + traceString(e.target);
+        if (critical.contains(ii))
+            args += QByteArray(args.isEmpty() ? "" : ",") + "\"critical\":true";
+        out += "{\"name\":" + traceString(e.type == Wait ? "wait:" + e.target : e.name) +
+               ",\"cat\":\"" + categories[e.type] + "\",\"ph\":\"X\"" +
+               ",\"ts\":" + QByteArray::number(e.start) +
+               ",\"dur\":" + QByteArray::number(e.end - e.start) +
+               ",\"pid\":" + pid + ",\"tid\":" + QByteArray::number(e.thread) +
+               ",\"args\":{" + args + "}},\n";
+    }
+    if (out.endsWith(",\n"))
+        out.chop(2);
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return file.write(out) == out.size();
+}
+
+/*!
+    \internal
+    Returns the time in microseconds.
+*/
+qint64 BootTimeline::now() const
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, 0);
+    return qint64(tv.tv_sec) * 1000000 + tv.tv_usec - m_origin;
+}
+
+/*!
+    \internal
+    Returns the index of the current thread, the first thread to record an
+    event being 0.
+*/
+int BootTimeline::threadIndex()
+{
+    Qt::HANDLE thread = QThread::currentThreadId();
+    QMap<Qt::HANDLE, int>::ConstIterator iter = m_threads.find(thread);
+    if (iter != m_threads.end())
+        return *iter;
+    int index = m_threads.count();
+    m_threads.insert(thread, index);
+    return index;
+}
@@ -0,0 +1,64 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef BOOTTIMELINE_H
+#define BOOTTIMELINE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QThread>
+
+class BootTimeline
+{
+public:
+    enum EventType { Task, Wait, Group };
+
+    BootTimeline();
+
+    int begin(EventType type, const QByteArray &name, const QByteArray &target = QByteArray());
+    void end(int event);
+    void addDependency(const QByteArray &task, const QByteArray &dependency);
+
+    QList<QByteArray> criticalPath() const;
+    bool write(const QString &fileName) const;
+
+private:
+    struct Event {
+        EventType type;
+        QByteArray name;
+        QByteArray target;
+        int thread;
+        qint64 start;
+        qint64 end;
+    };
+
+    qint64 now() const;
+    int threadIndex();
+    QList<int> criticalEvents() const;
+
+    mutable QMutex m_lock;
+    qint64 m_origin;
+    QList<Event> m_events;
+    QMap<Qt::HANDLE, int> m_threads;
+    QMap<QByteArray, QList<QByteArray> > m_dependencies;
+};
+
+#endif
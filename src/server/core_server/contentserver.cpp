@@ -28,6 +28,7 @@
 #include <qcategorymanager.h>
 #include <qtopiasql.h>
 #include <qdrmcontentplugin.h>
+#include <qtopia/private/qthumbnailcache_p.h>
 
 
 #include <QTimer>
@@ -38,15 +39,72 @@
 #include <QCryptographicHash>
 #include <QDirIterator>
 #include <QContentPlugin>
+#include <QFileMonitor>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QMutexLocker>
+#include <QWaitCondition>
 
 // Making this larger will cause the scanner to go more deeply into
 // subdirectories
 static const int MaxSearchDepth = 10;
 
+// Number of worker threads listing directories in parallel.
+static const int MaxScanThreads = 2;
+
+// Maximum number of directory listings queued on the workers at once.
+static const int MaxPendingListings = 16;
+
+// Maximum number of directories watched for changes after they are scanned.
+// Each one uses an inotify watch, of which a user typically has 8192.
+static const int MaxMonitoredDirectories = 1024;
+
+// Number of milliseconds to wait for changes to a monitored directory to
+// settle before rescanning it.
+static const int RescanDelay = 1000;
+
+// Number of days after which a scan of all documents verifies every directory
+// rather than trusting the scan journal.
+static const int JournalVerifyDays = 7;
+
+// Maximum number of thumbnails generated before the thumbnail cache is
+// written, so they become available while a large directory is processed.
+static const int ThumbnailsPerCommit = 50;
+
+/*
+  Generates thumbnails of newly installed and modified images and writes them
+  to the shared thumbnail cache.  This runs at idle priority so it never
+  competes with scanning or with the foreground application.
+ */
+class ThumbnailGenerator : public QThread
+{
+public:
+    ThumbnailGenerator();
+    ~ThumbnailGenerator();
+
+    void generate(const QString &fileName);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    QStringList m_pending;
+    bool m_stopped;
+};
+
 /*
   Recursive threaded background directory scanner for advanced use only.
   This class is used behind the scenes in the ContentServer and should
   not be needed unless undertaking advanced customization.
+
+  Directories are listed by a pool of worker threads; comparing the listings
+  against the database and installing content is done by the scanner itself.
+  A journal of the modification time and content count of each scanned
+  directory is kept so that directories which have not changed since they were
+  last scanned can be skipped without being listed.
  */
 
 class DirectoryScanner : public QObject
@@ -56,44 +114,241 @@ public:
     DirectoryScanner();
     ~DirectoryScanner();
 
+    struct DirectoryEntry {
+        QString name;
+        uint lastModified;
+        bool isDir;
+    };
+
+    struct PendingPath {
+        QString path;
+        int priority;
+        int depth;
+        bool force;
+        bool recurse;
+
+        bool operator<(const PendingPath &pp) const {
+            return priority < pp.priority;
+        }
+    };
+
+    struct DirectoryListing {
+        PendingPath pending;
+        bool exists;
+        uint lastModified;
+        uint listedAt;
+        QList<DirectoryEntry> entries;
+    };
+
+    void listed(const DirectoryListing &listing);
+
 public slots:
     void scan(const QString &path, int priority);
+    void rescan(const QString &path);
 
 signals:
     void scanning(bool scanning);
+    void monitor(const QString &path);
+    void unmonitor(const QString &path);
 
 private slots:
     void scan();
+    void processListings();
+    void rescanChanged();
 
 private:
-    void addPath(const QString &path, int depth, int priority);
-    void scanPath(const QString& path, int depth, int priority);
+    void addPath(const QString &path, int depth, int priority, bool force, bool recurse);
+    void removeMissingDirectories(const QString &path);
+    bool scanFromJournal(const PendingPath &pending);
+    void processListing(const DirectoryListing &listing);
+    void finishScan();
     void cleanupThumbnails(const QDateTime &threshold);
     QString thumbnailDir(const QString &path) const;
     QString thumbnailPath(const QString &thumbnailDir, const QString &fileName) const;
 
     void install(const QFileInfo &fi);
     void uninstall(QContentId id);
+    void commit(const QContent &content);
     void flushInstalls();
     void flushUninstalls();
+    void flushCommits();
 
-    struct PendingPath {
-        QString path;
-        int priority;
-        int depth;
+    struct JournalEntry {
+        JournalEntry() : lastModified(0), count(-1), depth(0) {}
 
-        bool operator<(const PendingPath &pp) const {
-            return priority < pp.priority;
-        }
+        uint lastModified;
+        int count;
+        int depth;
+        QStringList subDirectories;
     };
+    void loadJournal();
+    void saveJournal();
+    void removeJournalTree(const QString &path);
+
     QList<PendingPath> m_pendingPaths;
     QDateTime m_startTime;
     QFileInfoList m_pendingInstalls;
     QContentIdList m_pendingUninstalls;
+    QContentList m_pendingCommits;
+
+    QMutex m_listingMutex;
+    QList<DirectoryListing> m_listings;
+    int m_activeListings;
+
+    QHash<QString, JournalEntry> m_journal;
+    QDateTime m_journalVerified;
+    QStringList m_journalCounts;
+    bool m_journalLoaded;
+    bool m_journalDirty;
+    bool m_usedJournal;
+
+    QSet<QString> m_changedPaths;
+    QTimer *m_rescanTimer;
 
     bool m_scanning;
+
+    QThreadPool m_pool;
+
+    ThumbnailGenerator m_thumbnailGenerator;
 };
 
+/*
+  Lists a single directory on a worker thread and hands the result back to the
+  scanner.
+ */
+class DirectoryListJob : public QRunnable
+{
+public:
+    DirectoryListJob(DirectoryScanner *scanner, const DirectoryScanner::PendingPath &pending)
+        : m_scanner(scanner), m_pending(pending)
+    {
+    }
+
+    void run();
+
+private:
+    DirectoryScanner *m_scanner;
+    DirectoryScanner::PendingPath m_pending;
+};
+
+void DirectoryListJob::run()
+{
+    QThread::currentThread()->setPriority(QThread::LowPriority);
+
+    DirectoryScanner::DirectoryListing listing;
+    listing.pending = m_pending;
+    listing.listedAt = QDateTime::currentDateTime().toTime_t();
+
+    QFileInfo dirInfo(m_pending.path);
+    listing.exists = dirInfo.isDir();
+    listing.lastModified = listing.exists ? dirInfo.lastModified().toTime_t() : 0;
+
+    if (listing.exists) {
+        QFileInfoList entries = QDir(m_pending.path).entryInfoList(
+                QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+
+        foreach (const QFileInfo &fi, entries) {
+            DirectoryScanner::DirectoryEntry entry;
+            entry.name = fi.fileName();
+            entry.lastModified = fi.lastModified().toTime_t();
+            entry.isDir = fi.isDir();
+            listing.entries.append(entry);
+        }
+    }
+
+    m_scanner->listed(listing);
+}
+
+ThumbnailGenerator::ThumbnailGenerator()
+    : m_stopped(false)
+{
+}
+
+/*
+  Waits for the thumbnail currently being generated to be completed.
+ */
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+    stop();
+    wait();
+}
+
+/*
+  Queues the image \a fileName for its thumbnails to be generated.
+ */
+void ThumbnailGenerator::generate(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_stopped)
+        return;
+
+    m_pending.append(fileName);
+
+    if (!isRunning())
+        start(QThread::IdlePriority);
+    else
+        m_condition.wakeOne();
+}
+
+/*
+  Discards any thumbnails which have not yet been generated and stops the
+  thread once the cache has been written.
+ */
+void ThumbnailGenerator::stop()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_stopped = true;
+    m_pending.clear();
+
+    m_condition.wakeOne();
+}
+
+void ThumbnailGenerator::run()
+{
+    QThumbnailCacheWriter writer;
+
+    int generated = 0;
+
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_stopped) {
+        if (m_pending.isEmpty()) {
+            if (generated > 0) {
+                locker.unlock();
+
+                writer.commit();
+                generated = 0;
+
+                locker.relock();
+
+                continue;
+            }
+
+            m_condition.wait(&m_mutex);
+
+            continue;
+        }
+
+        QString fileName = m_pending.takeFirst();
+
+        locker.unlock();
+
+        if (writer.add(QContent(fileName, false)) && ++generated == ThumbnailsPerCommit) {
+            writer.commit();
+            generated = 0;
+        }
+
+        locker.relock();
+    }
+
+    locker.unlock();
+
+    if (generated > 0)
+        writer.commit();
+}
+
 // This value controls how many doclinks are processed at one go before firing off a single shot timer to yield processing
 // before continuing processing
 const int docsPerShot = 200;
@@ -117,6 +372,7 @@ const int docsPerShot = 200;
 
 ContentServer::ContentServer( QObject *parent )
     : QThread(parent)
+    , m_monitorsAvailable(true)
 {
     qLog(DocAPI) << "content server constructed";
 
@@ -153,8 +409,11 @@ void ContentServer::run()
     DirectoryScanner scanner;
 
     connect(this, SIGNAL(scan(QString,int)), &scanner, SLOT(scan(QString,int)));
+    connect(this, SIGNAL(rescan(QString)), &scanner, SLOT(rescan(QString)));
 
     connect(&scanner, SIGNAL(scanning(bool)), this, SLOT(scanning(bool)));
+    connect(&scanner, SIGNAL(monitor(QString)), this, SLOT(monitorDirectory(QString)));
+    connect(&scanner, SIGNAL(unmonitor(QString)), this, SLOT(unmonitorDirectory(QString)));
 
     exec();
 }
@@ -169,6 +428,59 @@ void ContentServer::scanning(bool scanning)
     scannerVSObject->setAttribute(QLatin1String("Scanning"), scanning);
 }
 
+/*!
+  Starts monitoring the directory \a path for changes.  Monitors are owned by
+  the ContentServer so that, like the other users of QFileMonitor, they live in
+  the main thread.
+
+  Only the INotify strategy is used, as DNotify would prevent removable media
+  from being unmounted.
+*/
+void ContentServer::monitorDirectory(const QString &path)
+{
+    if (!m_monitorsAvailable || m_monitors.contains(path)
+        || m_monitors.count() >= MaxMonitoredDirectories) {
+        return;
+    }
+
+    QFileMonitor *monitor = new QFileMonitor(path + QLatin1Char('/'), QFileMonitor::INotify, this);
+
+    if (!monitor->isValid()) {
+        qLog(DocAPI) << "inotify unavailable, not monitoring document directories";
+
+        m_monitorsAvailable = false;
+
+        delete monitor;
+
+        return;
+    }
+
+    connect(monitor, SIGNAL(fileChanged(QString)), this, SLOT(directoryChanged(QString)));
+
+    m_monitors.insert(path, monitor);
+}
+
+/*!
+  Stops monitoring the directory \a path and all directories beneath it.
+*/
+void ContentServer::unmonitorDirectory(const QString &path)
+{
+    const QString subPath = path + QLatin1Char('/');
+
+    QMap<QString, QFileMonitor *>::iterator it = m_monitors.lowerBound(path);
+
+    while (it != m_monitors.end() && (it.key() == path || it.key().startsWith(subPath))) {
+        delete it.value();
+
+        it = m_monitors.erase(it);
+    }
+}
+
+void ContentServer::directoryChanged(const QString &path)
+{
+    emit rescan(path.endsWith(QLatin1Char('/')) ? path.left(path.length() - 1) : path);
+}
+
 static bool binaryStringLessThan(const QString &string1, const QString &string2)
 {
   int length = qMin(string1.length(), string2.length()) * 2;
@@ -183,7 +495,7 @@ static bool binaryStringLessThan(const QString &string1, const QString &string2)
       return false;
 }
 
-static bool binaryStringCompare(const QString &string1, const QString &string2)
+static int binaryStringCompare(const QString &string1, const QString &string2)
 {
     int length = qMin(string1.length(), string2.length()) * 2;
 
@@ -192,47 +504,102 @@ static bool binaryStringCompare(const QString &string1, const QString &string2)
     return c == 0 ? string1.length() - string2.length() : c;
 }
 
+static bool directoryEntryLessThan(const DirectoryScanner::DirectoryEntry &entry1,
+                                   const DirectoryScanner::DirectoryEntry &entry2)
+{
+    return binaryStringLessThan(entry1.name, entry2.name);
+}
+
 /*!
    Construct a directory scanner object representing one thread scanning
    one directory
 */
 DirectoryScanner::DirectoryScanner()
-    : m_scanning(false)
+    : m_activeListings(0)
+    , m_journalLoaded(false)
+    , m_journalDirty(false)
+    , m_usedJournal(false)
+    , m_scanning(false)
 {
+    m_pool.setMaxThreadCount(MaxScanThreads);
+
+    m_rescanTimer = new QTimer(this);
+    m_rescanTimer->setSingleShot(true);
+    m_rescanTimer->setInterval(RescanDelay);
+    connect(m_rescanTimer, SIGNAL(timeout()), this, SLOT(rescanChanged()));
 }
 
 /*!
-    Destroy this directory scanner object, releasing a thread resource so
-    that other scans may start up.  A semaphore is used to ensure no more
-    than MaxDirThreads (typically 10) threads are scanning at once.
+    Destroy this directory scanner object, waiting for any directory listings
+    in progress to complete.
 */
 DirectoryScanner::~DirectoryScanner()
 {
+    m_pool.waitForDone();
+
+    if (m_journalDirty)
+        saveJournal();
 }
 
 void DirectoryScanner::scan(const QString &path, int priority)
 {
+    loadJournal();
+
     if (path == QLatin1String("all")) {
+        // Periodically verify every directory in case files have been
+        // modified in place without their directory changing.
+        bool force = m_journalVerified.isNull()
+                || m_journalVerified.daysTo(QDateTime::currentDateTime()) >= JournalVerifyDays;
+
         QFileSystemFilter fsf;
         fsf.documents = QFileSystemFilter::Set;
         foreach (QFileSystem *fs, QStorageMetaInfo::instance()->fileSystems(&fsf, true))
-            addPath(fs->documentsPath(), 0, priority);
+            addPath(fs->documentsPath(), 0, priority, force, true);
 
         if (m_startTime.isNull())
             m_startTime = QDateTime::currentDateTime();
     } else {
-        addPath(path, 0, priority);
+        // The requested directory is always verified, sub-directories are
+        // only listed if they have changed.
+        addPath(path, 0, priority, true, true);
     }
 }
 
-void DirectoryScanner::addPath(const QString &path, int depth, int priority)
+/*!
+    Schedules a rescan of the monitored directory \a path once changes to it
+    have settled.
+*/
+void DirectoryScanner::rescan(const QString &path)
+{
+    m_changedPaths.insert(QDir::cleanPath(path));
+
+    m_rescanTimer->start();
+}
+
+void DirectoryScanner::rescanChanged()
+{
+    foreach (const QString &path, m_changedPaths) {
+        QHash<QString, JournalEntry>::const_iterator it = m_journal.constFind(path);
+
+        // Only the changed directory and any new sub-directories are scanned.
+        addPath(path, it != m_journal.constEnd() ? it->depth : 0, 0, true, false);
+    }
+
+    m_changedPaths.clear();
+}
+
+void DirectoryScanner::addPath(const QString &path, int depth, int priority, bool force, bool recurse)
 {
     PendingPath pp;
-    pp.path = path;
+    pp.path = QDir::cleanPath(path);
     pp.priority = priority;
     pp.depth = depth;
+    pp.force = force;
+    pp.recurse = recurse;
     for (int i = 0; i < m_pendingPaths.count(); ++i) {
-        if (m_pendingPaths.at(i).path == path) {
+        if (m_pendingPaths.at(i).path == pp.path) {
+            pp.force |= m_pendingPaths.at(i).force;
+            pp.recurse |= m_pendingPaths.at(i).recurse;
             m_pendingPaths.removeAt(i);
             break;
         }
@@ -249,53 +616,171 @@ void DirectoryScanner::addPath(const QString &path, int depth, int priority)
 
 void DirectoryScanner::scan()
 {
-    if (!m_pendingPaths.isEmpty()) {
+    // Directories found unchanged in the journal are handled here without
+    // involving the workers; yield to the event loop every so often.
+    for (int checked = 0; checked < docsPerShot
+            && m_activeListings < MaxPendingListings
+            && !m_pendingPaths.isEmpty(); ++checked) {
         PendingPath pending = m_pendingPaths.takeLast();
 
-        scanPath(pending.path, pending.depth, pending.priority);
+        if (pending.depth == 0)
+            removeMissingDirectories(pending.path);
+
+        if (!pending.force && scanFromJournal(pending))
+            continue;
+
+        ++m_activeListings;
 
+        m_pool.start(new DirectoryListJob(this, pending), pending.priority);
+    }
+
+    if (!m_pendingPaths.isEmpty() && m_activeListings < MaxPendingListings)
         QTimer::singleShot(0, this, SLOT(scan()));
-    } else {
-        flushInstalls();
-        flushUninstalls();
+    else if (m_pendingPaths.isEmpty() && m_activeListings == 0 && m_scanning)
+        finishScan();
+}
 
-        if (!m_startTime.isNull()) {
-            cleanupThumbnails(m_startTime);
+/*!
+    Called on a worker thread when \a listing is complete.
+*/
+void DirectoryScanner::listed(const DirectoryListing &listing)
+{
+    QMutexLocker lock(&m_listingMutex);
 
-            m_startTime = QDateTime();
+    m_listings.append(listing);
 
-            QTimer::singleShot(0, this, SLOT(scan()));
-        } else {
-            emit scanning(m_scanning = false);
+    if (m_listings.count() == 1)
+        QMetaObject::invokeMethod(this, "processListings", Qt::QueuedConnection);
+}
+
+void DirectoryScanner::processListings()
+{
+    QList<DirectoryListing> listings;
+    {
+        QMutexLocker lock(&m_listingMutex);
+
+        listings = m_listings;
 
-            qLog(DocAPI) << "finished scanning";
+        m_listings.clear();
+    }
+
+    foreach (const DirectoryListing &listing, listings) {
+        --m_activeListings;
+
+        processListing(listing);
+    }
+
+    scan();
+}
+
+void DirectoryScanner::finishScan()
+{
+    flushInstalls();
+    flushCommits();
+    flushUninstalls();
+
+    // Record the content counts of the directories scanned now that the
+    // database is up to date.
+    foreach (const QString &path, m_journalCounts) {
+        QHash<QString, JournalEntry>::iterator it = m_journal.find(path);
+
+        if (it != m_journal.end())
+            it->count = QContentSet(QContentFilter::Directory, path).count();
+    }
+    m_journalCounts.clear();
+
+    if (!m_startTime.isNull()) {
+        // Unchanged directories are not listed so their thumbnails are not
+        // touched; only clean up after a pass which verified everything.
+        if (!m_usedJournal) {
+            cleanupThumbnails(m_startTime);
+
+            m_journalVerified = m_startTime;
+            m_journalDirty = true;
         }
+
+        m_startTime = QDateTime();
     }
+
+    m_usedJournal = false;
+
+    if (m_journalDirty)
+        saveJournal();
+
+    emit scanning(m_scanning = false);
+
+    qLog(DocAPI) << "finished scanning";
 }
 
-void DirectoryScanner::scanPath(const QString& path, int depth, int priority)
+/*!
+    Uninstalls the content of any directories beneath \a path which no longer
+    exist.
+*/
+void DirectoryScanner::removeMissingDirectories(const QString &path)
 {
-    const QString cleanPath = QDir::cleanPath(path);
-    const QString dirPath = cleanPath + QLatin1Char('/');
-    const QString unknownType(QLatin1String("application/octet-stream"));
-    qLog(DocAPI) << "scan called for path" << dirPath << "depth" << depth;
+    const QString dirPath = path + QLatin1Char('/');
 
-    if (depth==0) { // only do it for the top level of this directory
-        // Now scan for all files under this location, and check if they're valid or not, if not, add them to the removelist too.
-        QStringList paths = QContentFilter(QContentFilter::Location, dirPath)
-                .argumentMatches(QContentFilter::Directory, QString());
+    // Now scan for all files under this location, and check if they're valid or not, if not, add them to the removelist too.
+    QStringList paths = QContentFilter(QContentFilter::Location, dirPath)
+            .argumentMatches(QContentFilter::Directory, QString());
 
-        QContentFilter removedPaths;
+    foreach (QString path, paths) {
+        if (!QFile::exists(path)) {
+            QContentIdList contentIds = QContentSet(QContentFilter::Directory, path).itemIds();
 
-        foreach (QString path, paths) {
-            if (!QFile::exists(path)) {
-                QContentIdList contentIds = QContentSet(QContentFilter::Directory, path).itemIds();
+            foreach (QContentId contentId, contentIds)
+                uninstall(contentId);
 
-                foreach (QContentId contentId, contentIds)
-                    uninstall(contentId);
-            }
+            removeJournalTree(path);
+
+            emit unmonitor(path);
         }
     }
+}
+
+/*!
+    Skips listing the directory \a pending if the journal shows it has not
+    changed since it was last scanned.  Returns true if the directory was
+    skipped.
+*/
+bool DirectoryScanner::scanFromJournal(const PendingPath &pending)
+{
+    QHash<QString, JournalEntry>::const_iterator it = m_journal.constFind(pending.path);
+
+    if (it == m_journal.constEnd() || it->count < 0)
+        return false;
+
+    QFileInfo dirInfo(pending.path);
+
+    if (!dirInfo.isDir() || dirInfo.lastModified().toTime_t() != it->lastModified)
+        return false;
+
+    if (QContentSet(QContentFilter::Directory, pending.path).count() != it->count)
+        return false;
+
+    qLog(DocAPI) << "journal unchanged for path" << pending.path;
+
+    m_usedJournal = true;
+
+    emit monitor(pending.path);
+
+    if (pending.recurse && pending.depth < MaxSearchDepth) {
+        const QString dirPath = pending.path + QLatin1Char('/');
+
+        foreach (const QString &fileName, it->subDirectories)
+            addPath(dirPath + fileName, pending.depth + 1, pending.priority - 1, false, true);
+    }
+
+    return true;
+}
+
+void DirectoryScanner::processListing(const DirectoryListing &listing)
+{
+    const PendingPath &pending = listing.pending;
+    const QString &cleanPath = pending.path;
+    const QString dirPath = cleanPath + QLatin1Char('/');
+    const QString unknownType(QLatin1String("application/octet-stream"));
+    qLog(DocAPI) << "scan called for path" << dirPath << "depth" << pending.depth;
 
     const QString thumbDir = thumbnailDir(cleanPath);
 
@@ -303,33 +788,34 @@ void DirectoryScanner::scanPath(const QString& path, int depth, int priority)
     dirContents.setCriteria(QContentFilter::Directory, cleanPath);
     dirContents.setSortCriteria(QContentSortCriteria(QContentSortCriteria::FileName));
 
-    QStringList fileNames = QDir(dirPath).entryList(
-            QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    QList<DirectoryEntry> entries = listing.entries;
 
-    qSort(fileNames.begin(), fileNames.end(), binaryStringLessThan);
+    qSort(entries.begin(), entries.end(), directoryEntryLessThan);
 
     int db = 0;
     int fs = 0;
 
     const int dbCount = dirContents.count();
-    const int fsCount = fileNames.count();
+    const int fsCount = entries.count();
 
     char buffer[16];
 
+    QStringList subDirectories;
+
     while (db < dbCount && fs < fsCount) {
         QContent content = dirContents.content(db);
-        const QString fsName = fileNames.at(fs);
+        const DirectoryEntry &entry = entries.at(fs);
         const QString dbName = content.fileName().mid(dirPath.length());
 
-        int comparison = binaryStringCompare(dbName, fsName);
+        int comparison = binaryStringCompare(dbName, entry.name);
 
         if (comparison == 0) {
             if (content.type() == unknownType && QMimeType::fromFileName(content.fileName()).id() != unknownType) {
                 content.setName(QString());
                 content.setType(QString());
-                content.commit();
-            } else if (QFileInfo(content.fileName()).lastModified() > content.lastUpdated()) {
-                content.commit();
+                commit(content);
+            } else if (QDateTime::fromTime_t(entry.lastModified) > content.lastUpdated()) {
+                commit(content);
             } else if (!thumbDir.isNull()) {
                 QFile thumb(thumbnailPath(thumbDir, content.fileName()));
  
@@ -345,7 +831,7 @@ void DirectoryScanner::scanPath(const QString& path, int depth, int priority)
 
             ++db;
         } else if (comparison > 0) {
-            install(QFileInfo(dirPath + fsName));
+            install(QFileInfo(dirPath + entry.name));
 
             ++fs;
         }
@@ -354,11 +840,147 @@ void DirectoryScanner::scanPath(const QString& path, int depth, int priority)
     while(db < dbCount)
         uninstall(dirContents.contentId(db++));
     while(fs < fsCount)
-        install(QFileInfo(dirPath + fileNames.at(fs++)));
+        install(QFileInfo(dirPath + entries.at(fs++).name));
+
+    foreach (const DirectoryEntry &entry, entries)
+        if (entry.isDir)
+            subDirectories.append(entry.name);
+
+    if (!listing.exists) {
+        removeJournalTree(cleanPath);
+
+        emit unmonitor(cleanPath);
+
+        return;
+    }
+
+    JournalEntry &journal = m_journal[cleanPath];
+
+    foreach (const QString &fileName, journal.subDirectories) {
+        if (!subDirectories.contains(fileName)) {
+            removeJournalTree(dirPath + fileName);
 
-    if (depth < MaxSearchDepth)
-        foreach (QString fileName, QDir(dirPath).entryList(QDir::Dirs | QDir::NoDotAndDotDot))
-            addPath(dirPath + fileName, depth + 1, priority - 1);
+            emit unmonitor(dirPath + fileName);
+        }
+    }
+
+    // A directory modified in the same second as it was listed may change
+    // again without its modification time changing, so it can't be trusted.
+    if (listing.lastModified + 1 < listing.listedAt) {
+        journal.lastModified = listing.lastModified;
+        journal.count = -1;
+        m_journalCounts.append(cleanPath);
+    } else {
+        journal.lastModified = 0;
+        journal.count = -1;
+    }
+    journal.depth = pending.depth;
+    journal.subDirectories = subDirectories;
+    m_journalDirty = true;
+
+    emit monitor(cleanPath);
+
+    if (pending.depth < MaxSearchDepth) {
+        foreach (const QString &fileName, subDirectories) {
+            const QString subPath = dirPath + fileName;
+
+            if (pending.recurse || !m_journal.contains(subPath))
+                addPath(subPath, pending.depth + 1, pending.priority - 1, false, true);
+        }
+    }
+}
+
+void DirectoryScanner::loadJournal()
+{
+    if (m_journalLoaded)
+        return;
+
+    m_journalLoaded = true;
+
+    QFile file(Qtopia::applicationFileName(QLatin1String("ContentServer"), QLatin1String("scanjournal")));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+
+    quint32 magic;
+    quint32 version;
+
+    stream >> magic >> version;
+
+    if (magic != 0x5343414e || version != 1)
+        return;
+
+    qint32 count;
+
+    stream >> m_journalVerified >> count;
+
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString path;
+        JournalEntry entry;
+        quint32 lastModified;
+        qint32 contentCount;
+        qint32 depth;
+
+        stream >> path >> lastModified >> contentCount >> depth >> entry.subDirectories;
+
+        entry.lastModified = lastModified;
+        entry.count = contentCount;
+        entry.depth = depth;
+
+        m_journal.insert(path, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "DirectoryScanner: discarding corrupt scan journal";
+
+        m_journal.clear();
+        m_journalVerified = QDateTime();
+    }
+}
+
+void DirectoryScanner::saveJournal()
+{
+    QFile file(Qtopia::applicationFileName(QLatin1String("ContentServer"), QLatin1String("scanjournal")));
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "DirectoryScanner: couldn't write scan journal" << file.fileName();
+
+        return;
+    }
+
+    QDataStream stream(&file);
+
+    stream << quint32(0x5343414e) << quint32(1);
+    stream << m_journalVerified << qint32(m_journal.count());
+
+    for (QHash<QString, JournalEntry>::const_iterator it = m_journal.constBegin(); it != m_journal.constEnd(); ++it) {
+        stream << it.key() << quint32(it->lastModified) << qint32(it->count)
+               << qint32(it->depth) << it->subDirectories;
+    }
+
+    m_journalDirty = false;
+}
+
+/*!
+    Removes the journal entries for \a path and all directories beneath it.
+*/
+void DirectoryScanner::removeJournalTree(const QString &path)
+{
+    const QString subPath = path + QLatin1Char('/');
+
+    QHash<QString, JournalEntry>::iterator it = m_journal.begin();
+
+    while (it != m_journal.end()) {
+        if (it.key() == path || it.key().startsWith(subPath)) {
+            it = m_journal.erase(it);
+
+            m_journalDirty = true;
+        } else {
+            ++it;
+        }
+    }
 }
 
 void DirectoryScanner::cleanupThumbnails(const QDateTime &startTime)
@@ -420,34 +1042,57 @@ void DirectoryScanner::install(const QFileInfo &fi)
     if (!QtopiaSql::instance()->isDatabase(fi.absoluteFilePath())) {
         m_pendingInstalls.append(fi);
 
-        if (m_pendingInstalls.count() == docsPerShot) {
-            QContent::installBatch(m_pendingInstalls);
-
-            m_pendingInstalls.clear();
-        }
+        if (m_pendingInstalls.count() == docsPerShot)
+            flushInstalls();
     }
 }
 
-void DirectoryScanner::DirectoryScanner::flushInstalls()
+void DirectoryScanner::flushInstalls()
 {
     if (!m_pendingInstalls.isEmpty()) {
         QContent::installBatch(m_pendingInstalls);
 
+        foreach (const QFileInfo &fi, m_pendingInstalls) {
+            QString fileName = fi.absoluteFilePath();
+
+            if (QMimeType::fromFileName(fileName).id().startsWith(QLatin1String("image/")))
+                m_thumbnailGenerator.generate(fileName);
+        }
+
         m_pendingInstalls.clear();
     }
 }
 
-void DirectoryScanner::uninstall(QContentId id)
+void DirectoryScanner::commit(const QContent &content)
 {
-    m_pendingUninstalls.append(id);
+    m_pendingCommits.append(content);
 
-    if (m_pendingUninstalls.count() == docsPerShot) {
-        QContent::uninstallBatch(m_pendingUninstalls);
+    if (m_pendingCommits.count() == docsPerShot)
+        flushCommits();
+}
 
-        m_pendingUninstalls.clear();
+void DirectoryScanner::flushCommits()
+{
+    if (!m_pendingCommits.isEmpty()) {
+        QContent::commitBatch(m_pendingCommits);
+
+        foreach (const QContent &content, m_pendingCommits) {
+            if (content.type().startsWith(QLatin1String("image/")))
+                m_thumbnailGenerator.generate(content.fileName());
+        }
+
+        m_pendingCommits.clear();
     }
 }
 
+void DirectoryScanner::uninstall(QContentId id)
+{
+    m_pendingUninstalls.append(id);
+
+    if (m_pendingUninstalls.count() == docsPerShot)
+        flushUninstalls();
+}
+
 void DirectoryScanner::flushUninstalls()
 {
     if (!m_pendingUninstalls.isEmpty()) {
@@ -23,6 +23,7 @@
 #include <QThread>
 #include <QStringList>
 #include <QSet>
+#include <QMap>
 #include <QTimer>
 
 #include <qcontent.h>
@@ -34,6 +35,7 @@
 #include <QMutex>
 
 class ServerInterface;
+class QFileMonitor;
 class AppLoaderPrivate;
 class QValueSpaceObject;
 
@@ -48,16 +50,22 @@ public:
 
 signals:
     void scan(const QString &path, int priority);
+    void rescan(const QString &path);
 
 public slots:
     void scanAll();
 
 private slots:
     void scanning(bool scanning);
+    void monitorDirectory(const QString &path);
+    void unmonitorDirectory(const QString &path);
+    void directoryChanged(const QString &path);
 
 private:
     QtopiaIpcAdaptor *requestQueue;
     QValueSpaceObject *scannerVSObject;
+    QMap<QString, QFileMonitor *> m_monitors;
+    bool m_monitorsAvailable;
 };
 
 // declare ContentServerTask
@@ -31,6 +31,9 @@
 #include <QFile>
 #include <QMap>
 #include <QByteArray>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 #include <QValueSpaceObject>
 #include <qtopianamespace.h>
 #include <qconstcstring.h>
@@ -232,6 +235,24 @@ Tasks are constructed in one of two ways: preemptively or on-demand.
   A tutorial on how to develop new server tasks can be found in 
   the \l{Integration guide#Server Tasks}{Device Integration guide}.
 
+  \section2 Parallel Task Startup
+
+  Tasks are normally constructed one after another on the GUI thread.  A task
+  whose constructor does not touch widgets, the value space or IPC channels
+  can be marked with QTOPIA_TASK_THREAD_SAFE() and have the interfaces it uses
+  declared with QTOPIA_TASK_REQUIRES().  During the preemptive startup groups
+  such tasks are constructed on a worker thread as soon as the
+  \c {QtopiaApplication} task and the tasks providing their required
+  interfaces have started, while the remaining tasks continue on the GUI
+  thread.  Once constructed, every task object is moved to the GUI thread.
+
+  The server records when each task was constructed, on which thread and how
+  long it waited for other tasks.  The timeline is written in the Chrome trace
+  event format to \c {boottimeline.json} in Qtopia::tempDir() once the
+  preemptive groups, and again once the idle group, have started.  Events on
+  the critical path - the chain of tasks that determined how long startup
+  took - are marked as such and logged to the \c QtopiaServer log category.
+
   \section2 Server task plug-ins
   
   The above server tasks are linked into the Qt Extended server at build time. To increase the flexibility server tasks can be provided via a plug-in mechanism. This allows the addition of new tasks after the deployment of the server binary. Server task plugins must implement the ServerTaskPlugin interface in order to be recognized by the system. 
@@ -439,6 +460,32 @@ Tasks are constructed in one of two ways: preemptively or on-demand.
   be used to aggregate a task with another object.
  */
 
+/*!
+  \macro QTOPIA_TASK_REQUIRES(TaskName, Interface)
+  \relates QtopiaServerApplication
+
+  Indicate that the task \a TaskName uses \a Interface, as previously
+  declared by QTOPIA_TASK_INTERFACE, during its construction.  A task can
+  require more than one interface.
+
+  The task providing \a Interface is started before \a TaskName, and a
+  task marked with QTOPIA_TASK_THREAD_SAFE() is not handed to a worker thread
+  until its required tasks have started.
+ */
+
+/*!
+  \macro QTOPIA_TASK_THREAD_SAFE(TaskName)
+  \relates QtopiaServerApplication
+
+  Indicate that the task \a TaskName may be constructed on a worker thread
+  while other tasks start.  The task must not create widgets, value space
+  objects or IPC channels in its constructor, and may only use the
+  interfaces it declares with QTOPIA_TASK_REQUIRES().  Objects created during
+  construction are moved to the GUI thread along with the task.
+
+  Only tasks in the preemptive startup groups are started in parallel.
+ */
+
 /*!
   \fn T *qtopiaTask(bool onlyActive = false)
   \relates QtopiaServerApplication
@@ -1148,6 +1195,27 @@ QObject* QtopiaServerTasksPrivate::taskForInterface(Task *task, const QConstCStr
 
 QObject* QtopiaServerTasksPrivate::startTask(Task *task, bool onlyActive)
 {
+    if(!onlyActive && !task->requirements.isEmpty()) {
+        // Start the tasks this task requires before it is constructed
+        m_lock.lock();
+        bool resolve = !task->launchOrder && !task->excluded &&
+                       !task->constructingThread && !task->resolvingRequirements;
+        task->resolvingRequirements = resolve;
+        m_lock.unlock();
+
+        if(resolve) {
+            for(int ii = 0; ii < task->requirements.count(); ++ii) {
+                Task *required = requiredTask(task->requirements.at(ii));
+                if(required && required != task)
+                    startTask(required, false);
+            }
+            QMutexLocker locker(&m_lock);
+            task->resolvingRequirements = false;
+        }
+    }
+
+    QMutexLocker locker(&m_lock);
+
     if(task->launchOrder > 0)
         return task->object;
 
@@ -1157,25 +1225,66 @@ QObject* QtopiaServerTasksPrivate::startTask(Task *task, bool onlyActive)
     if(onlyActive)
         return 0;
 
+    if(task->constructingThread) {
+        // Requested by its own constructor
+        if(task->constructingThread == QThread::currentThreadId())
+            return 0;
+
+        int wait = m_timeline.begin(BootTimeline::Wait, QByteArray(),
+                                    task->name.toByteArray());
+        while(!task->launchOrder)
+            m_taskStarted.wait(&m_lock);
+        m_timeline.end(wait);
+        return task->object;
+    }
+
+    bool guiThread = isGuiThread();
+    if(!guiThread && !task->threadSafe) {
+        qWarning() << "Task" << task->name.toByteArray()
+                   << "was requested from a worker thread, but is not thread safe";
+        return 0;
+    }
+
+    QObject *object = 0;
+    QList<QObject *> aggregates;
     if(task->create || task->plugin) {
-        bool wasConstructing = m_constructingTask;
-        m_constructingTask = true;
+        task->constructingThread = QThread::currentThreadId();
+        ++m_constructingTask;
+        locker.unlock();
+
+        int event = m_timeline.begin(BootTimeline::Task, task->name.toByteArray());
         if ( task->create )
-            task->object = task->create(task->createArg);
+            object = task->create(task->createArg);
         else
-            task->object = task->plugin->initTask(task->createArg);
-        if(task->object) {
+            object = task->plugin->initTask(task->createArg);
+        m_timeline.end(event);
+
+        locker.relock();
+        if(object) {
             QMap<QObject *, QList<QObject *> >::Iterator iter =
-                m_constructingAggregates.find(task->object);
+                m_constructingAggregates.find(object);
             if(iter != m_constructingAggregates.end()) {
-                task->aggregates += *iter;
+                aggregates = *iter;
                 m_constructingAggregates.erase(iter);
             }
         }
-        m_constructingTask = wasConstructing;
+        --m_constructingTask;
         Q_ASSERT(m_constructingTask || m_constructingAggregates.isEmpty());
+
+        if(object && !guiThread) {
+            // Tasks live on the GUI thread, whichever thread built them
+            locker.unlock();
+            QThread *thread = QCoreApplication::instance()->thread();
+            object->moveToThread(thread);
+            for(int ii = 0; ii < aggregates.count(); ++ii)
+                if(!aggregates.at(ii)->parent())
+                    aggregates.at(ii)->moveToThread(thread);
+            locker.relock();
+        }
     }
 
+    task->object = object;
+    task->aggregates += aggregates;
     if(task->object) {
         m_activeTasks.insert(task->object, task);
         QPointer<QObject> pointer = task->object;
@@ -1185,16 +1294,166 @@ QObject* QtopiaServerTasksPrivate::startTask(Task *task, bool onlyActive)
     if(!application && QConstCString("QtopiaApplication", 17) == task->name)
         application = qobject_cast<QtopiaApplication *>(task->object);
 
-    static unsigned int tasksStarted = 0;
-    ++tasksStarted;
-    task->launchOrder = tasksStarted;
-    if(taskList) {
-        QByteArray name = task->name.toByteArray();
+    task->launchOrder = ++m_tasksStarted;
+    task->constructingThread = 0;
+    m_unreportedTasks.append(task);
+    m_taskStarted.wakeAll();
+    locker.unlock();
+
+    // The value space may only be used from the GUI thread
+    if(guiThread)
+        reportStartedTasks();
+
+    return task->object;
+}
+
+void QtopiaServerTasksPrivate::reportStartedTasks()
+{
+    QMutexLocker locker(&m_lock);
+    QList<Task *> tasks = m_unreportedTasks;
+    m_unreportedTasks.clear();
+    locker.unlock();
+
+    if(!taskList)
+        return;
+
+    for(int ii = 0; ii < tasks.count(); ++ii) {
+        QByteArray name = tasks.at(ii)->name.toByteArray();
         taskList->setAttribute(name + "/State", "Active");
-        taskList->setAttribute(name + "/Order/Launch", task->launchOrder);
+        taskList->setAttribute(name + "/Order/Launch", tasks.at(ii)->launchOrder);
     }
+}
 
-    return task->object;
+bool QtopiaServerTasksPrivate::isGuiThread() const
+{
+    return !m_guiThread || m_guiThread == QThread::currentThreadId();
+}
+
+QtopiaServerTasksPrivate::Task *QtopiaServerTasksPrivate::requiredTask(const QConstCString &iface) const
+{
+    QMap<QConstCString, QList<Task *> >::ConstIterator iter =
+        m_availableInterfaces.find(iface);
+    if(iter == m_availableInterfaces.end() || iter->isEmpty())
+        return 0;
+    return iter->at(0);
+}
+
+// Must be called with m_lock held
+bool QtopiaServerTasksPrivate::requirementsStarted(Task *task)
+{
+    for(int ii = 0; ii < task->requirements.count(); ++ii) {
+        Task *required = requiredTask(task->requirements.at(ii));
+        if(required && !required->excluded && !required->launchOrder)
+            return false;
+    }
+    return true;
+}
+
+void QtopiaServerTasksPrivate::taskFinished()
+{
+    QMutexLocker locker(&m_lock);
+    --m_runningWorkers;
+    m_taskStarted.wakeAll();
+}
+
+class TaskRunnable : public QRunnable
+{
+public:
+    TaskRunnable(QtopiaServerTasksPrivate *qst, QtopiaServerTasksPrivate::Task *task)
+    : m_qst(qst), m_task(task) {}
+
+    void run()
+    {
+        m_qst->startTask(m_task, false);
+        m_qst->taskFinished();
+    }
+
+private:
+    QtopiaServerTasksPrivate *m_qst;
+    QtopiaServerTasksPrivate::Task *m_task;
+};
+
+/*
+    Starts the tasks in \a order.  Thread safe tasks are handed to the thread
+    pool as soon as the tasks they require have started, all other tasks are
+    started on the GUI thread in order.
+*/
+void QtopiaServerTasksPrivate::startTasks(const QList<Task *> &order)
+{
+    QList<Task *> gui;
+    QList<Task *> pending;
+    for(int ii = 0; ii < order.count(); ++ii) {
+        Task *task = order.at(ii);
+        if (task->launchOrder > 0) {
+            qLog(QtopiaServer) << "Would start task, but already started:" << task->name.toByteArray();
+            continue;
+        }
+        for(int jj = 0; jj < task->requirements.count(); ++jj) {
+            Task *required = requiredTask(task->requirements.at(jj));
+            if(required)
+                m_timeline.addDependency(task->name.toByteArray(), required->name.toByteArray());
+        }
+        if(task->threadSafe && task->create)
+            pending.append(task);
+        else
+            gui.append(task);
+    }
+
+    int next = 0;
+    forever {
+        QMutexLocker locker(&m_lock);
+        for(int ii = 0; application && ii < pending.count();) {
+            Task *task = pending.at(ii);
+            if(task->launchOrder > 0 || task->constructingThread) {
+                // Already requested by another task
+                pending.removeAt(ii);
+            } else if(requirementsStarted(task)) {
+                pending.removeAt(ii);
+                ++m_runningWorkers;
+                qLog(QtopiaServer) << "Starting task" << task->name.toByteArray() << "on a worker thread";
+                QThreadPool::globalInstance()->start(new TaskRunnable(this, task));
+            } else {
+                ++ii;
+            }
+        }
+
+        if(next < gui.count()) {
+            locker.unlock();
+            Task *task = gui.at(next++);
+            qLog(QtopiaServer) << "Starting task" << task->name.toByteArray();
+            startTask(task, false);
+            continue;
+        }
+
+        if(!m_runningWorkers) {
+            if(pending.isEmpty())
+                break;
+            // Nothing running will start what the rest require
+            gui += pending;
+            pending.clear();
+            continue;
+        }
+
+        int wait = m_timeline.begin(BootTimeline::Wait, QByteArray(), "workers");
+        m_taskStarted.wait(&m_lock);
+        m_timeline.end(wait);
+    }
+
+    reportStartedTasks();
+}
+
+void QtopiaServerTasksPrivate::writeBootTimeline()
+{
+    QString fileName = Qtopia::tempDir() + "boottimeline.json";
+    if(!m_timeline.write(fileName)) {
+        qLog(QtopiaServer) << "Unable to write boot timeline" << fileName;
+        return;
+    }
+
+    QByteArray path;
+    foreach(QByteArray name, m_timeline.criticalPath())
+        path += (path.isEmpty() ? "" : " > ") + name;
+    qLog(QtopiaServer) << "Boot timeline written to" << fileName << "critical path:" << path;
 }
 
 void QtopiaServerTasksPrivate::cleanupTasks()
@@ -1322,6 +1581,8 @@ bool QtopiaServerApplication::startup(int &argc, char **argv, const QList<QByteA
 
     qst->argc = &argc;
     qst->argv = argv;
+    if (!qst->m_guiThread)
+        qst->m_guiThread = QThread::currentThreadId();
 
     QList<QtopiaServerTasksPrivate::Task *> startupOrder;
     // Determine startup order
@@ -1333,15 +1594,13 @@ bool QtopiaServerApplication::startup(int &argc, char **argv, const QList<QByteA
 
     if (type == ImmediateStartup) {
         // Actually start the tasks
-        for(int ii = 0; ii < startupOrder.count(); ++ii) {
-            QtopiaServerTasksPrivate::Task* task = startupOrder.at(ii);
-            if (task->launchOrder > 0) {
-                qLog(QtopiaServer) << "Would start task, but already started:" << task->name.toByteArray();
-            } else {
-                qLog(QtopiaServer) << "Starting task" << task->name.toByteArray();
-                qst->startTask(task, false);
-            }
-        }
+        QByteArray groups;
+        for (int ii = 0; ii < startupGroups.count(); ++ii)
+            groups += (ii ? "," : "") + startupGroups.at(ii);
+        int event = qst->m_timeline.begin(BootTimeline::Group, groups);
+        qst->startTasks(startupOrder);
+        qst->m_timeline.end(event);
+        qst->writeBootTimeline();
     }
 
     else if (type == IdleStartup) {
@@ -1350,6 +1609,8 @@ bool QtopiaServerApplication::startup(int &argc, char **argv, const QList<QByteA
         // Delete the task starter when it completes its duty.
         if (!connect(idler, SIGNAL(finished()), idler, SLOT(deleteLater())))
             Q_ASSERT(0);
+        if (!connect(idler, SIGNAL(finished()), qst, SLOT(writeBootTimeline())))
+            Q_ASSERT(0);
 
         // Start the task starter once we get to the event loop.
         QTimer::singleShot(0, idler, SLOT(start()));
@@ -1475,6 +1736,7 @@ void QtopiaServerApplication::addAggregateObject(QObject *me, QObject *them)
     QtopiaServerTasksPrivate *qst = qtopiaServerTasks();
     if(!qst) return;
 
+    QMutexLocker locker(&qst->m_lock);
     QMap<QObject *, QtopiaServerTasksPrivate::Task *>::Iterator iter = qst->m_activeTasks.find(me);
     if(iter == qst->m_activeTasks.end()) {
 
@@ -1527,6 +1789,40 @@ void QtopiaServerApplication::addTaskProvide(const char *task, const char *inter
     (*iter)->interfaces.append(interface);
 }
 
+/*! \internal */
+void QtopiaServerApplication::addTaskRequire(const char *task, const char *interface)
+{
+    if(!task || !interface) return;
+
+    QtopiaServerTasksPrivate *qst = qtopiaServerTasks();
+    if(!qst) return;
+
+    QConstCString t(task);
+    QMap<QConstCString, QtopiaServerTasksPrivate::Task *>::Iterator iter =
+        qst->m_availableTasks.find(t);
+    if(qst->m_availableTasks.end() == iter)
+        iter = qst->m_availableTasks.insert(t, new QtopiaServerTasksPrivate::Task(t));
+
+    (*iter)->requirements.append(interface);
+}
+
+/*! \internal */
+void QtopiaServerApplication::setTaskThreadSafe(const char *task)
+{
+    if(!task) return;
+
+    QtopiaServerTasksPrivate *qst = qtopiaServerTasks();
+    if(!qst) return;
+
+    QConstCString t(task);
+    QMap<QConstCString, QtopiaServerTasksPrivate::Task *>::Iterator iter =
+        qst->m_availableTasks.find(t);
+    if(qst->m_availableTasks.end() == iter)
+        iter = qst->m_availableTasks.insert(t, new QtopiaServerTasksPrivate::Task(t));
+
+    (*iter)->threadSafe = true;
+}
+
 /*! 
   \internal 
  */
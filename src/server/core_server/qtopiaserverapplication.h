@@ -73,6 +73,8 @@ public:
     typedef QObject *(*CreateTaskFunc)(void *);
     static void addTask(const char *, bool, CreateTaskFunc, void *);
     static void addTaskProvide(const char *, const char *);
+    static void addTaskRequire(const char *, const char *);
+    static void setTaskThreadSafe(const char *);
     static QObject *_qtopiaTask(const char *, bool);
     static QList<QObject *> _qtopiaTasks(const char *, bool);
     static void addTaskInterface(const char *, QObject *);
@@ -157,6 +159,22 @@ inline void qtopiaProvidesInterface(QObject *me)
     }; \
     static _task_install_provides_ ## name ## _ ## interface _task_install_provides_instance_ ## name ## _ ## interface;
 
+#define QTOPIA_TASK_REQUIRES(name, interface) \
+    struct _task_install_requires_ ## name ## _ ## interface { \
+        _task_install_requires_ ## name ## _ ## interface() { \
+            QtopiaServerApplication::addTaskRequire(# name, qtopiaTask_InterfaceName<interface>()); \
+        } \
+    }; \
+    static _task_install_requires_ ## name ## _ ## interface _task_install_requires_instance_ ## name ## _ ## interface;
+
+#define QTOPIA_TASK_THREAD_SAFE(name) \
+    struct _task_install_thread_safe_ ## name { \
+        _task_install_thread_safe_ ## name() { \
+            QtopiaServerApplication::setTaskThreadSafe(# name); \
+        } \
+    }; \
+    static _task_install_thread_safe_ ## name _task_install_thread_safe_instance_ ## name;
+
 #define QTOPIA_STATIC_TASK(name, function) \
     static QObject *_task_install_create_ ## name(void *) { \
         function;\
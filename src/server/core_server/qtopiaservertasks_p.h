@@ -32,11 +32,14 @@
 //
 
 #include <qtopiaserverapplication.h>
+#include "boottimeline.h"
 
 #include <QConstCString>
 #include <QPluginManager>
 #include <QPointer>
 #include <QValueSpaceObject>
+#include <QMutex>
+#include <QWaitCondition>
 
 class QPluginManager;
 class ServerTaskPlugin;
@@ -50,7 +53,9 @@ public:
     QtopiaServerTasksPrivate() : argc(0), argv(0),
                                  taskList(0), application(0),
                                  m_shutdown(QtopiaServerApplication::NoShutdown),
-                                 m_constructingTask(false), m_taskPluginLoader(0) {}
+                                 m_constructingTask(0), m_taskPluginLoader(0),
+                                 m_tasksStarted(0), m_runningWorkers(0),
+                                 m_guiThread(0) {}
     virtual inline ~QtopiaServerTasksPrivate() {
         qDeleteAll(m_availableTasks);
         delete taskList;
@@ -67,6 +72,7 @@ public:
                                TaskStartupInfo &);
 
     void setupInterfaceList(const QList<Task *> &);
+    void startTasks(const QList<Task *> &);
     QObject* startTask(Task *, bool onlyActive);
     QObject* taskForInterface(Task *task, const QConstCString &iface, bool onlyActive);
 
@@ -87,6 +93,9 @@ public:
                                            createArg(0),
                                            excluded(false),
                                            demand(false),
+                                           threadSafe(false),
+                                           resolvingRequirements(false),
+                                           constructingThread(0),
                                            plugin(0) {}
         inline
         Task(const Task &other) : name(other.name),
@@ -97,8 +106,12 @@ public:
                                   create(other.create),
                                   createArg(other.createArg),
                                   interfaces(other.interfaces),
+                                  requirements(other.requirements),
                                   excluded(other.excluded),
-                                  demand(other.demand) {}
+                                  demand(other.demand),
+                                  threadSafe(other.threadSafe),
+                                  resolvingRequirements(false),
+                                  constructingThread(0) {}
 
         QConstCString name;
         QObject *object;
@@ -109,8 +122,12 @@ public:
         QtopiaServerApplication::CreateTaskFunc create;
         void *createArg;
         QList<QConstCString> interfaces;
+        QList<QConstCString> requirements;
         bool excluded;
         bool demand;
+        bool threadSafe;
+        bool resolvingRequirements;
+        Qt::HANDLE constructingThread;
         ServerTaskPlugin* plugin;
         QByteArray taskPluginName;     //required as store for plugin names (QConstCString) only keeps references
     };
@@ -129,12 +146,29 @@ public:
     void ackShutdownObject(SystemShutdownHandler *obj);
     void cleanupTasks();
 
-    bool m_constructingTask;
+    int m_constructingTask;
     QPluginManager* m_taskPluginLoader;
     QMap<QObject *, QList<QObject *> > m_constructingAggregates;
 
+    // Parallel startup
+    Task *requiredTask(const QConstCString &iface) const;
+    bool requirementsStarted(Task *);
+    void taskFinished();
+    bool isGuiThread() const;
+    void reportStartedTasks();
+
+    QMutex m_lock;
+    QWaitCondition m_taskStarted;
+    unsigned int m_tasksStarted;
+    int m_runningWorkers;
+    Qt::HANDLE m_guiThread;
+    QList<Task *> m_unreportedTasks;
+
+    BootTimeline m_timeline;
+
 public slots:
     void shutdownProceed();
+    void writeBootTimeline();
 };
 
 #endif
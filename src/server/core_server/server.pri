@@ -3,6 +3,7 @@ UNIFIED_NCT_LUPDATE=1
 
 HEADERS+=\
          alarmcontrol.h \
+         boottimeline.h \
          applicationlauncher.h\
          contentserver.h\
          defaultbattery.h\
@@ -31,6 +32,7 @@ HEADERS+=\
 SOURCES+=\
          alarmcontrol.cpp \
          applicationlauncher.cpp\
+         boottimeline.cpp \
          contentserver.cpp\
          devicebuttontask.cpp \
          defaultbattery.cpp\
@@ -0,0 +1,23 @@
+TEMPLATE=app
+TARGET=tst_qtopiaservertasks
+CONFIG+=qtopia unittest
+
+SOURCEPATH+=/src/server/core_server
+
+HEADERS += qtopiaserverapplication.h \
+           qtopiaservertasks_p.h \
+           idletaskstartup.h \
+           windowmanagement.h \
+           boottimeline.h
+SOURCES += tst_qtopiaservertasks.cpp \
+           qtopiaserverapplication.cpp \
+           idletaskstartup.cpp \
+           boottimeline.cpp
+
+X11.TYPE=CONDITIONAL_SOURCES
+X11.CONDITION=x11
+X11.SOURCES=windowmanagement_x11.cpp
+
+QWS.TYPE=CONDITIONAL_SOURCES
+QWS.CONDITION=qws
+QWS.SOURCES=windowmanagement.cpp
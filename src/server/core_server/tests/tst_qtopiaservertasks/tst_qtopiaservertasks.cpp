@@ -0,0 +1,253 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QtopiaApplication>
+#include <QTest>
+#include <QThread>
+#include <QFile>
+#include <QTemporaryFile>
+#include <shared/qtopiaunittest.h>
+
+#include "qtopiaservertasks_p.h"
+#include "boottimeline.h"
+
+#include <unistd.h>
+
+//TESTED_CLASS=QtopiaServerTasksPrivate,BootTimeline
+//TESTED_FILES=src/server/core_server/qtopiaserverapplication.cpp,src/server/core_server/boottimeline.cpp
+
+typedef QtopiaServerTasksPrivate::Task Task;
+
+static QAtomicInt sequence;
+
+/*
+    A dummy thread safe task.  Records the thread it was constructed on and
+    the order it started and finished in, optionally requesting another task
+    part way through construction.
+*/
+struct DummyTask
+{
+    DummyTask() : qst(0), request(0), requestDelay(0), duration(0),
+                  thread(0), started(0), finished(0), requested(0) {}
+
+    QtopiaServerTasksPrivate *qst;
+    Task *request;
+    int requestDelay;
+    int duration;
+
+    Qt::HANDLE thread;
+    int started;
+    int finished;
+    QObject *requested;
+};
+
+static QObject *createDummyTask(void *arg)
+{
+    DummyTask *dummy = static_cast<DummyTask *>(arg);
+    dummy->thread = QThread::currentThreadId();
+    dummy->started = sequence.fetchAndAddOrdered(1);
+    if (dummy->request) {
+        ::usleep(dummy->requestDelay * 1000);
+        dummy->requested = dummy->qst->startTask(dummy->request, false);
+    }
+    ::usleep(dummy->duration * 1000);
+    dummy->finished = sequence.fetchAndAddOrdered(1);
+    return new QObject;
+}
+
+class TimelineThread : public QThread
+{
+public:
+    TimelineThread(BootTimeline *timeline, const QByteArray &name, int duration)
+    : m_timeline(timeline), m_name(name), m_duration(duration) {}
+
+protected:
+    void run()
+    {
+        int event = m_timeline->begin(BootTimeline::Task, m_name);
+        ::usleep(m_duration * 1000);
+        m_timeline->end(event);
+    }
+
+private:
+    BootTimeline *m_timeline;
+    QByteArray m_name;
+    int m_duration;
+};
+
+class tst_QtopiaServerTasks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void requirementOrder();
+    void crossThreadWait();
+    void criticalPath();
+
+private:
+    Task *addTask(const char *name, DummyTask *dummy, bool threadSafe);
+    QObject *requestTask(Task *task);
+
+    QtopiaServerTasksPrivate *qst;
+};
+
+QTEST_APP_MAIN( tst_QtopiaServerTasks, QtopiaApplication )
+#include "tst_qtopiaservertasks.moc"
+
+void tst_QtopiaServerTasks::init()
+{
+    qst = new QtopiaServerTasksPrivate;
+    qst->m_guiThread = QThread::currentThreadId();
+    qst->application = qobject_cast<QtopiaApplication *>(qApp);
+    QVERIFY(qst->application);
+}
+
+void tst_QtopiaServerTasks::cleanup()
+{
+    foreach (Task *task, qst->m_availableTasks)
+        delete task->object;
+    delete qst;
+    qst = 0;
+}
+
+Task *tst_QtopiaServerTasks::addTask(const char *name, DummyTask *dummy, bool threadSafe)
+{
+    Task *task = new Task(QConstCString(name));
+    task->create = createDummyTask;
+    task->createArg = dummy;
+    task->threadSafe = threadSafe;
+    dummy->qst = qst;
+    qst->m_availableTasks.insert(task->name, task);
+    return task;
+}
+
+/*?
+    Test that a thread safe task is not constructed on a worker thread until
+    the tasks providing the interfaces it requires have started, even when it
+    is listed first, and that the tasks built on worker threads are moved to
+    the GUI thread.
+*/
+void tst_QtopiaServerTasks::requirementOrder()
+{
+    DummyTask provider;
+    provider.duration = 50;
+    DummyTask consumer;
+    DummyTask gui;
+
+    Task *providerTask = addTask("Provider", &provider, true);
+    providerTask->interfaces.append(QConstCString("ProviderInterface"));
+    Task *consumerTask = addTask("Consumer", &consumer, true);
+    consumerTask->requirements.append(QConstCString("ProviderInterface"));
+    Task *guiTask = addTask("GuiTask", &gui, false);
+
+    QList<Task *> order;
+    order << consumerTask << providerTask << guiTask;
+    qst->setupInterfaceList(order);
+    qst->startTasks(order);
+
+    QVERIFY(providerTask->launchOrder > 0);
+    QVERIFY(consumerTask->launchOrder > providerTask->launchOrder);
+    QVERIFY(guiTask->launchOrder > 0);
+    QVERIFY(consumer.started > provider.finished);
+
+    QVERIFY(provider.thread != qst->m_guiThread);
+    QVERIFY(consumer.thread != qst->m_guiThread);
+    QCOMPARE(gui.thread, qst->m_guiThread);
+
+    QCOMPARE(providerTask->object->thread(), qApp->thread());
+    QCOMPARE(consumerTask->object->thread(), qApp->thread());
+    QCOMPARE(guiTask->object->thread(), qApp->thread());
+    QCOMPARE(qst->m_runningWorkers, 0);
+}
+
+/*?
+    Test that a task requested from the GUI thread while a worker thread is
+    constructing it is waited for rather than constructed twice, and that the
+    wait appears on the critical path between the two tasks.
+*/
+void tst_QtopiaServerTasks::crossThreadWait()
+{
+    DummyTask slow;
+    slow.duration = 200;
+    DummyTask gui;
+    gui.requestDelay = 50;
+
+    Task *slowTask = addTask("Slow", &slow, true);
+    Task *guiTask = addTask("GuiTask", &gui, false);
+    gui.request = slowTask;
+
+    QList<Task *> order;
+    order << slowTask << guiTask;
+    qst->setupInterfaceList(order);
+    qst->startTasks(order);
+
+    QVERIFY(slow.thread != qst->m_guiThread);
+    QCOMPARE(gui.thread, qst->m_guiThread);
+    QVERIFY(gui.requested != 0);
+    QCOMPARE(gui.requested, slowTask->object);
+    QVERIFY(gui.finished > slow.finished);
+    QVERIFY(guiTask->launchOrder > slowTask->launchOrder);
+
+    QList<QByteArray> path = qst->m_timeline.criticalPath();
+    int slowIndex = path.indexOf("Slow");
+    int waitIndex = path.indexOf("wait:Slow");
+    int guiIndex = path.indexOf("GuiTask");
+    QVERIFY(slowIndex != -1);
+    QVERIFY(waitIndex > slowIndex);
+    QVERIFY(guiIndex > waitIndex);
+}
+
+/*?
+    Test that the critical path follows the required task on another thread
+    rather than a shorter task on the same thread, and that write() marks the
+    events on it.
+*/
+void tst_QtopiaServerTasks::criticalPath()
+{
+    BootTimeline timeline;
+    timeline.addDependency("Dependent", "Required");
+
+    int group = timeline.begin(BootTimeline::Group, "startup");
+    TimelineThread worker(&timeline, "Required", 50);
+    worker.start();
+
+    int event = timeline.begin(BootTimeline::Task, "Short");
+    timeline.end(event);
+    QVERIFY(worker.wait(5000));
+
+    event = timeline.begin(BootTimeline::Task, "Dependent");
+    timeline.end(event);
+    timeline.end(group);
+
+    QList<QByteArray> expected;
+    expected << "Required" << "Dependent";
+    QCOMPARE(timeline.criticalPath(), expected);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(timeline.write(file.fileName()));
+    QByteArray trace = file.readAll();
+    QVERIFY(trace.startsWith("{\"traceEvents\":["));
+    QVERIFY(trace.contains("\"name\":\"Required\""));
+    QVERIFY(trace.contains("\"name\":\"Short\""));
+    QCOMPARE(trace.count("\"critical\":true"), 2);
+}
@@ -25,11 +25,14 @@
 #include <Qtopia>
 #include <QtopiaChannel>
 #include <QtopiaIpcEnvelope>
+#include <QSettings>
+#include <qtopialog.h>
 
 // Qt includes
 #include <QProcess>
 #include <QFile>
 #include <QTimer>
+#include <QTime>
 
 // Systme includes
 #include <sys/types.h>
@@ -40,6 +43,12 @@
 #include <sys/resource.h>
 // Constants
 static const int NUM_POOLED_QLPROCESSES = 2;
+static const int NUM_PRELOADED_PLUGINS = 3;
+// Upper bounds, in milliseconds, of the launch latency histogram buckets.  A
+// final bucket counts the launches slower than the last bound.
+static const int LAUNCH_LATENCY_BUCKETS[] = { 250, 500, 1000, 2000, 4000 };
+static const int NUM_LAUNCH_LATENCY_BUCKETS =
+    sizeof(LAUNCH_LATENCY_BUCKETS) / sizeof(LAUNCH_LATENCY_BUCKETS[0]) + 1;
 
 // ============================================================================
 //
@@ -82,8 +91,14 @@ public:
     bool shutdown() const { return isShutdown; }
     QString quicklaunchExecutable();
 
+    void launchStarted( const QString &app );
+    void launchFinished( const QString &app, bool running );
+
 private:
     void killAll();
+    void updatePreloadedPlugins( QSettings &config );
+
+    QMap<QString, QTime> mLaunchTimes;
     bool isShutdown;
 
     QString mQlExecutable;
@@ -109,6 +124,79 @@ QString QuickExeApplicationLauncherPrivate::quicklaunchExecutable()
     return mQlExecutable;
 }
 
+void QuickExeApplicationLauncherPrivate::launchStarted( const QString &app )
+{
+    mLaunchTimes[app].start();
+}
+
+/*
+  Records how long \a app took from being handed to a quicklauncher until it
+  reported itself running, in the histogram for \a app.
+ */
+void QuickExeApplicationLauncherPrivate::launchFinished( const QString &app, bool running )
+{
+    QMap<QString, QTime>::Iterator iter = mLaunchTimes.find( app );
+    if ( iter == mLaunchTimes.end() )
+        return;
+    int elapsed = iter->elapsed();
+    mLaunchTimes.erase( iter );
+    if ( !running )
+        return;
+
+    qLog(Quicklauncher) << "Launched" << app << "in" << elapsed << "ms";
+
+    QSettings config( "Trolltech", "QuickLauncher" );
+    config.beginGroup( "LaunchLatency" );
+    config.beginGroup( app );
+
+    QStringList histogram = config.value( "Histogram" ).toStringList();
+    while ( histogram.count() < NUM_LAUNCH_LATENCY_BUCKETS )
+        histogram.append( "0" );
+    int bucket = 0;
+    while ( bucket < NUM_LAUNCH_LATENCY_BUCKETS - 1 &&
+            elapsed > LAUNCH_LATENCY_BUCKETS[bucket] )
+        ++bucket;
+    histogram[bucket] = QString::number( histogram.at(bucket).toInt() + 1 );
+
+    config.setValue( "Histogram", histogram );
+    config.setValue( "Count", config.value( "Count", 0 ).toInt() + 1 );
+    config.setValue( "Total", config.value( "Total", 0 ).toInt() + elapsed );
+    config.endGroup();
+    config.endGroup();
+
+    updatePreloadedPlugins( config );
+}
+
+/*
+  Chooses the application plugins the quicklauncher loads in advance: those
+  whose launches have cost the user the most time in total.
+ */
+void QuickExeApplicationLauncherPrivate::updatePreloadedPlugins( QSettings &config )
+{
+    config.beginGroup( "Preload" );
+    int count = config.value( "Count", NUM_PRELOADED_PLUGINS ).toInt();
+    config.endGroup();
+
+    QMultiMap<int, QString> ranked;
+    config.beginGroup( "LaunchLatency" );
+    foreach ( QString app, config.childGroups() ) {
+        ranked.insert( config.value( app + "/Total", 0 ).toInt(), app );
+        if ( ranked.count() > count )
+            ranked.erase( ranked.begin() );
+    }
+    config.endGroup();
+
+    QStringList preload;
+    for ( QMultiMap<int, QString>::ConstIterator iter = ranked.constEnd();
+          iter != ranked.constBegin(); )
+        preload.append( *(--iter) );
+
+    config.beginGroup( "Preload" );
+    if ( config.value( "Applications" ).toStringList() != preload )
+        config.setValue( "Applications", preload );
+    config.endGroup();
+}
+
 bool QuickExeApplicationLauncherPrivate::systemRestart()
 {
     isShutdown = true;
@@ -252,6 +340,18 @@ bool QuickExeApplicationLauncherPrivate::createProcess() const
   the paths returned by the Qtopia::installPaths() method for the
   \c {plugins/application/lib<application name>.so} application plugin.
 
+  Each quicklauncher instance also loads the plugins of the applications
+  whose launches have taken longest in total before it reports itself
+  available, so that they only need to be instantiated when launched.  The
+  QuickExeApplicationLauncher measures the time from handing an application
+  to a quicklauncher until the application reports itself running, and keeps
+  a histogram of these latencies for every application in the
+  \c {LaunchLatency/<application>} group of the \c {Trolltech/QuickLauncher}
+  configuration file.  The chosen plugins are stored in the
+  \c {Preload/Applications} key of the same file; the \c {Preload/Count} key
+  limits their number and defaults to 3.  Every preloaded plugin stays mapped
+  in the application the quicklauncher becomes, so this should be kept small.
+
   \i {Note:} \c {quicklauncher} itself does not correctly search the install paths 
   for applications.  This functionality is planned for a future Qt Extended version.
   
@@ -273,6 +373,10 @@ QuickExeApplicationLauncher::QuickExeApplicationLauncher()
              SIGNAL(received(QString,QByteArray)),
              this,
              SLOT(quickLauncherChannel(QString,QByteArray)) );
+    connect( this,
+             SIGNAL(applicationStateChanged(QString,ApplicationTypeLauncher::ApplicationState)),
+             this,
+             SLOT(launchStateChanged(QString,ApplicationTypeLauncher::ApplicationState)) );
 
     // No point starting in less than 10secs - the server will take at least
     // that long to startup.
@@ -330,6 +434,7 @@ void QuickExeApplicationLauncher::launch(const QString &app)
     env << args;
 
     process->disconnect(); // We don't want error signals anymore
+    d->launchStarted( app );
     addStartingApplication( app, process );
 
     if ( d->createProcess() )
@@ -419,6 +524,14 @@ void QuickExeApplicationLauncher::qlProcessError( QProcess::ProcessError /*error
     }
 }
 
+/*! \internal */
+void QuickExeApplicationLauncher::launchStateChanged( const QString &app,
+                                                     ApplicationTypeLauncher::ApplicationState state )
+{
+    if ( state != Starting )
+        d->launchFinished( app, state == Running );
+}
+
 /*! \internal */
 void QuickExeApplicationLauncher::respawnQuicklauncher( bool fast )
 {
@@ -39,6 +39,7 @@ private slots:
     void startNewQuicklauncher();
     void qlProcessExited(int);
     void qlProcessError(QProcess::ProcessError);
+    void launchStateChanged(const QString &, ApplicationTypeLauncher::ApplicationState);
 
 private:
     void respawnQuicklauncher(bool);
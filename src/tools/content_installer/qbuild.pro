@@ -34,6 +34,8 @@ SOURCES=\
     qcontentfilter.cpp\
     qcontent.cpp\
     qthumbnail.cpp\
+    qthumbnailcache.cpp\
+    qexifimageheader.cpp\
     thumbnailview_p.cpp\
     qcontentset.cpp\
     qdrmcontent.cpp\
@@ -63,7 +65,8 @@ SOURCES=\
     qcontentsetengine.cpp\
     qmimetypedata.cpp\
     qcontentsortcriteria.cpp\
-    qsqlcontentsetengine.cpp
+    qsqlcontentsetengine.cpp\
+    qsqlpagedcontentsetengine.cpp
 
 HEADERS=\
     qsystemsemaphore.h\
@@ -80,6 +83,8 @@ HEADERS=\
     drmcontent_p.h\
     qcontentplugin.h\
     qthumbnail.h\
+    qthumbnailcache_p.h\
+    qexifimageheader.h\
     contentpluginmanager_p.h\
     qcategorymanager.h\
     qtopiaipcadaptor.h\
@@ -100,7 +105,8 @@ HEADERS=\
     qsqlcontentstore_p.h\
     qcontentsetengine_p.h\
     qmimetypedata_p.h\
-    qsqlcontentsetengine_p.h
+    qsqlcontentsetengine_p.h\
+    qsqlpagedcontentsetengine_p.h
 
 SEM [
     TYPE=CONDITIONAL_SOURCES
@@ -93,7 +93,7 @@ static QMap<QString, int> expectedVersions()
         versions.insert("contactaddresses", 110);
         versions.insert("contactcategories", 110);
         versions.insert("contactcustom", 111); // 111 adds some indices
-        versions.insert("contactphonenumbers", 111); // 111 adds some indices
+        versions.insert("contactphonenumbers", 112); // 111 adds some indices, 112 adds reversed_local_number
         versions.insert("emailaddresses", 110);
         versions.insert("contactpresence", 112); // 111 is new, 112 adds avatar
 
@@ -148,6 +148,8 @@ bool PimMigrate::migrate()
     // 4.2.2 brings in a change to rec id's.
     // 4.4 adds the label field to contacts (version 111)
     // and the 'contactpresence' table in a temporary db
+    // contactphonenumbers 112 adds the reversed local number used for caller id,
+    // it is left empty here and filled in by libqtopiapim on first use
     // first ensure changelog exists.
     CHECK(mi->ensureSchema("changelog"));
     CHECK(mi->setTableVersion("changelog", 110));
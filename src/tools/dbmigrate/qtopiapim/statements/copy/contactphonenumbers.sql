@@ -1,2 +1,2 @@
 INSERT INTO contactphonenumbers (recid, phone_number, phone_type)
-    SELECT convertRecId(recid), phone_number, phone_type FROM contactphonenumbers_old;
+    SELECT CASE WHEN typeof(recid) = 'blob' THEN convertRecId(recid) ELSE recid END, phone_number, phone_type FROM contactphonenumbers_old;
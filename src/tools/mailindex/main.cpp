@@ -0,0 +1,58 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QMailStore>
+#include <QtopiaApplication>
+#include <QTime>
+
+#include <stdio.h>
+
+#ifdef SINGLE_EXEC
+QTOPIA_ADD_APPLICATION(QTOPIA_TARGET,mailindex)
+#define MAIN_FUNC main_mailindex
+#else
+#define MAIN_FUNC main
+#endif
+
+// Rebuilds the body index for a mail store whose messages were added before
+// the index was introduced, or whose index has become inconsistent.
+QSXE_APP_KEY
+int MAIN_FUNC(int argc, char** argv)
+{
+    QSXE_SET_APP_KEY(argv[0])
+
+    QtopiaApplication app(argc, argv);
+
+    QMailStore *store = QMailStore::instance();
+    if (!store->initialized()) {
+        fprintf(stderr, "mailindex: unable to open the mail store\n");
+        return 1;
+    }
+
+    QTime time;
+    time.start();
+
+    if (!store->rebuildBodyIndex()) {
+        fprintf(stderr, "mailindex: unable to rebuild the body index\n");
+        return 1;
+    }
+
+    fprintf(stdout, "mailindex: indexed %d messages in %d ms\n", store->countMessages(), time.elapsed());
+    return 0;
+}
@@ -0,0 +1,23 @@
+TEMPLATE=app
+TARGET=mailindex
+
+CONFIG+=qtopia singleexec
+QTOPIA*=mail
+
+pkg [
+    name=mailindex
+    desc="Mail store body index rebuilding tool for Qt Extended."
+    version=$$QTOPIA_VERSION
+    license=$$QTOPIA_LICENSE
+    maintainer=$$QTOPIA_MAINTAINER
+]
+
+SOURCES=\
+    main.cpp
+
+# Install rules
+
+target [
+    hint=sxe
+    domain=trusted
+]
@@ -125,8 +125,6 @@ EmailHandler::EmailHandler(QObject* parent)
     LongStream::cleanupTempFiles();
 
     totalSendSize = 0;
-    totalRetrievalSize = 0;
-    mRetrievalInProgress = false;
     mCountEmailMessages = true;
     
     smtpClient = new SmtpClient(this);
@@ -502,8 +500,15 @@ void EmailHandler::sendProgress(const QMailMessageId& id, uint percentage)
 
 void EmailHandler::retrievalProgress(const QString& uid, uint bytesReceived)
 {
-    RetrievalMap::iterator it = retrievalSize.find(uid);
-    if (it != retrievalSize.end()) {
+    const Client* client = static_cast<const Client*>(sender());
+    if (!client)
+        return;
+
+    QMailAccountId accountId = accountForClient(client);
+    RetrievalMap &accountRetrievals(retrievalSize[accountId]);
+
+    RetrievalMap::iterator it = accountRetrievals.find(uid);
+    if (it != accountRetrievals.end()) {
         QPair< QPair<uint, uint>, uint> &values = it.value();
 
         // Calculate the percentage of the retrieval completed
@@ -515,19 +520,21 @@ void EmailHandler::retrievalProgress(const QString& uid, uint bytesReceived)
 
             // Update the progress figure to count the sent portion of this message
             uint partialSize = values.first.first * percentage / 100;
-            emit retrievalProgress(totalRetrievalSize + partialSize);
+            emit retrievalProgress(accountId, totalRetrievalSize[accountId] + partialSize);
         }
     }
 }
 
 void EmailHandler::fetchTotal(uint total)
 {
-    emit retrievalTotal(total);
+    if (const Client* client = static_cast<const Client*>(sender()))
+        emit retrievalTotal(accountForClient(client), total);
 }
 
 void EmailHandler::fetchProgress(uint progress)
 {
-    emit retrievalProgress(progress);
+    if (const Client* client = static_cast<const Client*>(sender()))
+        emit retrievalProgress(accountForClient(client), progress);
 }
 
 void EmailHandler::messageProcessed(const QMailMessageId& id)
@@ -550,13 +557,22 @@ void EmailHandler::messageProcessed(const QMailMessageId& id)
 
 void EmailHandler::messageProcessed(const QString& uid)
 {
-    RetrievalMap::iterator it = retrievalSize.find(uid);
-    if (it != retrievalSize.end()) {
+    if (const Client* client = static_cast<const Client*>(sender()))
+        messageProcessed(accountForClient(client), uid);
+}
+
+void EmailHandler::messageProcessed(const QMailAccountId& accountId, const QString& uid)
+{
+    RetrievalMap &accountRetrievals(retrievalSize[accountId]);
+
+    RetrievalMap::iterator it = accountRetrievals.find(uid);
+    if (it != accountRetrievals.end()) {
         // Update the progress figure
-        totalRetrievalSize += it.value().first.first;
-        emit retrievalProgress(totalRetrievalSize);
+        uint &total(totalRetrievalSize[accountId]);
+        total += it.value().first.first;
+        emit retrievalProgress(accountId, total);
 
-        retrievalSize.erase(it);
+        accountRetrievals.erase(it);
     }
 }
 
@@ -598,11 +614,9 @@ Client* EmailHandler::clientForType(QMailMessage::MessageType type) const
 
 void EmailHandler::setMailAccount(const QMailAccountId &accountId)
 {
-    mailAccountId = accountId;
-
-    QMailAccount account(mailAccountId);
+    QMailAccount account(accountId);
     if (account.messageType() == QMailMessage::Email) {
-        Client *client = clientForAccount(mailAccountId, true);
+        Client *client = clientForAccount(accountId, true);
         if (!client) {
             if (account.messageSources().contains("imap4", Qt::CaseInsensitive)) {
                 client = new ImapClient(this);
@@ -614,21 +628,21 @@ void EmailHandler::setMailAccount(const QMailAccountId &accountId)
             
             connectClient(client, Receiving|SyncRetrieval|AsyncDeletion, QMailMessage::Email, SLOT(mailError(int,QString&)));
         }
-        setClientAccount(client, mailAccountId);
+        setClientAccount(client, accountId);
     } else {
-        setClientAccount(clientForType(account.messageType()), mailAccountId);
+        setClientAccount(clientForType(account.messageType()), accountId);
     }
 }
 
-bool EmailHandler::retrievalInProgress()
+bool EmailHandler::retrievalInProgress(const QMailAccountId& accountId) const
 {
-    return mRetrievalInProgress;
+    return retrievingAccounts.contains(accountId);
 }
 
 void EmailHandler::retrieve(const QMailAccountId& accountId, bool foldersOnly, bool countEmailMessages)
 {
-    if (mRetrievalInProgress) {
-        qLog(Messaging) << "Unable to initiate retrieval while operation is in progress";
+    if (retrievingAccounts.contains(accountId)) {
+        qLog(Messaging) << "Unable to initiate retrieval while operation is in progress for account:" << accountId;
         return;
     }
 
@@ -640,7 +654,7 @@ void EmailHandler::retrieve(const QMailAccountId& accountId, bool foldersOnly, b
         client->foldersOnly(foldersOnly);
         client->headersOnly(true, 2000);        //less than 2000, download all
 
-        mRetrievalInProgress = true;
+        retrievingAccounts.insert(accountId);
         client->newConnection();
     } else {
         qLog(Messaging) << "Unable to retrieve messages for unknown account:" << accountId;
@@ -649,49 +663,58 @@ void EmailHandler::retrieve(const QMailAccountId& accountId, bool foldersOnly, b
 
 void EmailHandler::partialRetrievalComplete()
 {
-    emit partialRetrievalCompleted();
+    if (const Client* client = static_cast<const Client*>(sender()))
+        emit partialRetrievalCompleted(accountForClient(client));
 }
 
 void EmailHandler::retrievalComplete()
 {
-    mRetrievalInProgress = false;
-    emit retrievalCompleted();
+    if (const Client* client = static_cast<const Client*>(sender())) {
+        QMailAccountId accountId = accountForClient(client);
+
+        retrievingAccounts.remove(accountId);
+        emit retrievalCompleted(accountId);
+    }
 }
 
 void EmailHandler::clientError(int, QString&)
 {
-    mRetrievalInProgress = false;
+    if (Client* client = static_cast<Client*>(sender())) {
+        QMailAccountId accountId = accountForClient(client);
+
+        // Only a failure of the retrieving client terminates the retrieval
+        if (clientForAccount(accountId, true) == client)
+            retrievingAccounts.remove(accountId);
+    }
 }
 
-void EmailHandler::completeRetrieval(const QMailMessageIdList& mailList)
+void EmailHandler::completeRetrieval(const QMailAccountId& accountId, const QMailMessageIdList& mailList)
 {
     // We shouldn't have anything left in our retrieval list...
-    if (!retrievalSize.isEmpty()) {
-        foreach (const QString& uid, retrievalSize.keys())
+    RetrievalMap &accountRetrievals(retrievalSize[accountId]);
+    if (!accountRetrievals.isEmpty()) {
+        foreach (const QString& uid, accountRetrievals.keys())
             qLog(Messaging) << "Message" << uid << "still in retrieve map...";
 
-        retrievalSize.clear();
+        accountRetrievals.clear();
     }
 
     if (mailList.isEmpty()) {
-        mRetrievalInProgress = false;
+        retrievingAccounts.remove(accountId);
 
         // There are no message bodies to be retrieved
-        if (QMailAccount(mailAccountId).messageType() == QMailMessage::Email) {
+        if (QMailAccount(accountId).messageType() == QMailMessage::Email) {
             // The mail client will not have closed its connection - do that now
-            if (Client *client = clientForAccount(mailAccountId, true))
+            if (Client *client = clientForAccount(accountId, true))
                 client->closeConnection();
         }
         return;
     }
 
-    QMailMessageMetaData first(mailList.first());
-    QMailAccountId accountId = first.parentAccountId();
-
     setMailAccount(accountId);
 
-    if (Client *client = clientForAccount(mailAccountId, true)) {
-        mRetrievalInProgress = true;
+    if (Client *client = clientForAccount(accountId, true)) {
+        retrievingAccounts.insert(accountId);
         client->newConnection();
 
         uint totalSize = 0;
@@ -712,7 +735,7 @@ void EmailHandler::completeRetrieval(const QMailMessageIdList& mailList)
 
                 selectionMap[message.parentFolderId()].insert(uid,id);
 
-                retrievalSize.insert(uid, qMakePair(qMakePair(size, bytes), 0u));
+                accountRetrievals.insert(uid, qMakePair(qMakePair(size, bytes), 0u));
                 totalSize += size;
                 totalBytes += bytes;
             } else {
@@ -723,13 +746,13 @@ void EmailHandler::completeRetrieval(const QMailMessageIdList& mailList)
         // Ensure that we have space to retrieve these messages into
         // Conservative estimate: we need twice the reported size plus 10 KB
         if (!LongStream::freeSpace( "", totalBytes * 2 + 1024*10 )) {
-            mRetrievalInProgress = false;
-            retrievalSize.clear();
-            reportFailure(mailAccountId, QString(), QMailMessageServer::ErrFileSystemFull);
+            retrievingAccounts.remove(accountId);
+            accountRetrievals.clear();
+            reportFailure(accountId, QString(), QMailMessageServer::ErrFileSystemFull);
         } else {
             // Emit the total size we will receive
-            totalRetrievalSize = 0;
-            emit retrievalTotal(totalSize);
+            totalRetrievalSize[accountId] = 0;
+            emit retrievalTotal(accountId, totalSize);
 
             client->foldersOnly(false);
             client->headersOnly(false, 0);
@@ -782,7 +805,8 @@ void EmailHandler::newClientMessage(QMailMessage& message, bool partial)
         emit messageRetrieved(message);
 
         // Report that the this message has been processed
-        messageProcessed(message.serverUid());
+        if (const Client* client = static_cast<const Client*>(sender()))
+            messageProcessed(accountForClient(client), message.serverUid());
     }
 }
 
@@ -806,9 +830,9 @@ void EmailHandler::nonexistentMessage(const QString& uid, Client::DefunctReason
             // We must have a deletion record for this message
             QMailStore::instance()->purgeMessageRemovalRecords(accountId, QStringList() << uid);
         }
-    }
 
-    messageProcessed(uid);
+        messageProcessed(accountId, uid);
+    }
 }
 
 void EmailHandler::messagesReceived()
@@ -850,7 +874,7 @@ void EmailHandler::clientStatus(QMailMessageServer::Operation op, const QString&
 {
     if (const Client* client = static_cast<const Client*>(sender())) {
         QMailAccountId accountId = accountForClient(client);
-        emit statusChanged(op, QMailAccount(accountId).accountName(), status);
+        emit statusChanged(accountId, op, QMailAccount(accountId).accountName(), status);
     }
 }
 
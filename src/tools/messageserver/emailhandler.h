@@ -64,12 +64,12 @@ public:
         SyncRetrieval = 0x10
     };
 
-    bool retrievalInProgress();
+    bool retrievalInProgress(const QMailAccountId& accountId) const;
 
 public slots:
     void send(const QMailMessageIdList& mailList);
     void retrieve(const QMailAccountId& accountId, bool foldersOnly, bool countEmailMessages = false);
-    void completeRetrieval(const QMailMessageIdList& mailList);
+    void completeRetrieval(const QMailAccountId& accountId, const QMailMessageIdList& mailList);
     void cancelTransfer();
     void acknowledgeNewMessages(const QMailMessageTypeList& types);
 
@@ -77,17 +77,17 @@ public slots:
 
 signals:
     void simReady(bool);
-    void statusChanged(QMailMessageServer::Operation, const QString&, const QString&);
+    void statusChanged(const QMailAccountId&, QMailMessageServer::Operation, const QString&, const QString&);
     void errorOccurred(const QMailAccountId&, const QString&, int);
     void newCountChanged();
     void newCountDetermined();
     void partialMessageRetrieved(QMailMessageMetaData&);
-    void partialRetrievalCompleted();
-    void retrievalTotal(uint);
-    void retrievalProgress(uint);
+    void partialRetrievalCompleted(const QMailAccountId&);
+    void retrievalTotal(const QMailAccountId&, uint);
+    void retrievalProgress(const QMailAccountId&, uint);
     void messageRetrieved(QMailMessage&);
 
-    void retrievalCompleted();
+    void retrievalCompleted(const QMailAccountId&);
     void sendTotal(uint);
     void sendProgress(uint);
     void messageSent(const QMailMessageId&);
@@ -125,6 +125,7 @@ private slots:
 private:
     void connectClient(Client *client, int type, QMailMessage::MessageType messageType, QString sigName);
     void setMailAccount(const QMailAccountId &accountId);
+    void messageProcessed(const QMailAccountId &accountId, const QString& uid);
     void transmissionFailed(const Client* client);
     void clientSynchronised(const Client* client);
 
@@ -145,8 +146,6 @@ private:
     bool appendErrorText(QString& message, const int code, const ErrorMap& map);
     bool appendErrorText(QString& message, const int code, const ErrorSet& mapList);
 
-    QMailAccountId mailAccountId;
-
     SmtpClient *smtpClient;
 #ifndef QTOPIA_NO_SMS
     SmsClient *smsClient;
@@ -168,8 +167,10 @@ private:
 
     // RetrievalMap maps uid -> ((units, bytes) to be retrieved, percentage retrieved)
     typedef QMap<QString, QPair< QPair<uint, uint>, uint> > RetrievalMap;
-    RetrievalMap retrievalSize;
-    uint totalRetrievalSize;
+
+    // Each account may be retrieving concurrently
+    QMap<QMailAccountId, RetrievalMap> retrievalSize;
+    QMap<QMailAccountId, uint> totalRetrievalSize;
 
     QList<ConnectionDetails> connectionList;
 
@@ -177,7 +178,7 @@ private:
 
     QMap<QMailMessageId, Client*> clientForOutgoing;
 
-    bool mRetrievalInProgress;
+    QSet<QMailAccountId> retrievingAccounts;
     bool mCountEmailMessages;
 };
 
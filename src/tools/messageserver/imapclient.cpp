@@ -23,6 +23,8 @@
 #include <QMailAccount>
 #include <QMailStore>
 #include <QMailFolder>
+#include <QSet>
+#include <QSettings>
 
 
 namespace QtMail
@@ -175,8 +177,560 @@ namespace QtMail
 
 }
 
+/*  The mailbox state (UIDVALIDITY and HIGHESTMODSEQ) at our last synchronization
+    with the mailbox
+*/
+static bool syncState(const QMailFolderId &boxId, QString *uidValidity, quint64 *modSeq)
+{
+    QSettings settings("Trolltech", "messageserver");
+    settings.beginGroup("imap-sync");
+
+    QStringList state = settings.value(QString::number(boxId.toULongLong())).toStringList();
+    if (state.count() != 2) {
+        *uidValidity = QString();
+        *modSeq = 0;
+        return false;
+    }
+
+    *uidValidity = state.at(0);
+    *modSeq = state.at(1).toULongLong();
+    return true;
+}
+
+static void setSyncState(const QMailFolderId &boxId, const QString &uidValidity, quint64 modSeq)
+{
+    QSettings settings("Trolltech", "messageserver");
+    settings.beginGroup("imap-sync");
+
+    QString key(QString::number(boxId.toULongLong()));
+    if (uidValidity.isEmpty()) {
+        settings.remove(key);
+    } else {
+        settings.setValue(key, QStringList() << uidValidity << QString::number(modSeq));
+    }
+}
+
+static QStringList inFirstAndSecond(const QStringList &first, const QStringList &second)
+{
+    QStringList result;
+
+    foreach (const QString &value, first)
+        if (second.contains(value))
+            result.append(value);
+
+    return result;
+}
+
+static QStringList inFirstButNotSecond(const QStringList &first, const QStringList &second)
+{
+    QStringList result;
+
+    foreach (const QString &value, first)
+        if (!second.contains(value))
+            result.append(value);
+
+    return result;
+}
+
+enum LoginProgress
+{
+    LoginPending,       // A further login command has been issued
+    LoginAuthenticate,  // The connection is ready for the credentials to be sent
+    LoginComplete,      // The connection is logged in
+    LoginNotApplicable  // The command is not part of the login sequence
+};
+
+/*  Advances the login of \a connection once \a command has completed.  Both the client
+    connection and synchronization connections log in with the same sequence: CAPABILITY,
+    STARTTLS and CAPABILITY again if encryption is configured, LOGIN, then ENABLE QRESYNC
+    if the server supports it.  The caller sends LOGIN when asked to authenticate, as the
+    client connection may first log in its idle connection.
+*/
+static LoginProgress continueLogin(ImapProtocol *connection, const AccountConfiguration &config, ImapCommand command, bool *tlsEnabled)
+{
+    switch (command) {
+        case IMAP_Init:
+        {
+            connection->capability();
+            return LoginPending;
+        }
+        case IMAP_Capability:
+        {
+#ifndef QT_NO_OPENSSL
+            if (!*tlsEnabled && (config.mailEncryption() == AccountConfiguration::Encrypt_TLS)) {
+                if (connection->supportsCapability("STARTTLS")) {
+                    connection->startTLS();
+                    return LoginPending;
+                } else {
+                    // TODO: request user direction
+                    qWarning() << "No TLS support - continuing unencrypted";
+                }
+            }
+#else
+            Q_UNUSED(config);
+            Q_UNUSED(tlsEnabled);
+#endif
+            return LoginAuthenticate;
+        }
+        case IMAP_StartTLS:
+        {
+            // We are now in TLS mode; check capabilities for encrypted mode
+            *tlsEnabled = true;
+            connection->capability();
+            return LoginPending;
+        }
+        case IMAP_Login:
+        {
+            if (connection->supportsCapability("ENABLE") && connection->supportsCapability("QRESYNC")) {
+                // Have the server report mailbox changes in response to SELECT
+                connection->enable("QRESYNC");
+                return LoginPending;
+            }
+            return LoginComplete;
+        }
+        case IMAP_Enable:
+        {
+            return LoginComplete;
+        }
+        default:
+            break;
+    }
+
+    return LoginNotApplicable;
+}
+
+/*  A null connection means the synchronizer opens a connection of its own, which
+    it logs in before emitting ready()
+*/
+ImapMailboxSync::ImapMailboxSync(const QMailAccountId &id, const AccountConfiguration &config, ImapProtocol *connection, QObject *parent)
+    : QObject(parent),
+      accountId(id),
+      _config(config),
+      client(connection),
+      ownConnection(connection == 0),
+      tlsEnabled(false),
+      active(false),
+      _searchStatus(Seen),
+      _expungeRequired(false)
+{
+    if (ownConnection) {
+        client = new ImapProtocol;
+        connect(client, SIGNAL(finished(ImapCommand&,OperationState&)),
+                this, SLOT(connectionDone(ImapCommand&,OperationState&)) );
+        connect(client, SIGNAL(connectionError(int,QString)),
+                this, SLOT(connectionError(int,QString)) );
+    }
+}
+
+ImapMailboxSync::~ImapMailboxSync()
+{
+    if (ownConnection)
+        delete client;
+}
+
+void ImapMailboxSync::open()
+{
+    Q_ASSERT(ownConnection);
+
+    tlsEnabled = false;
+    client->open(_config);
+}
+
+void ImapMailboxSync::close()
+{
+    active = false;
+    currentMailbox = QMailFolder();
+
+    if (ownConnection) {
+        // Any further responses are of no interest to us
+        client->disconnect(this);
+        if (client->inUse())
+            client->close();
+    }
+}
+
+bool ImapMailboxSync::isActive() const
+{
+    return active;
+}
+
+QMailFolder ImapMailboxSync::mailbox() const
+{
+    return currentMailbox;
+}
+
+void ImapMailboxSync::synchronize(const QMailFolder &mailbox, bool selectable)
+{
+    currentMailbox = mailbox;
+    active = true;
+
+    _seenUids = QStringList();
+    _unseenUids = QStringList();
+    _readUids = QStringList();
+    _removedUids = QStringList();
+    _expungeRequired = false;
+    _searchStatus = Seen;
+
+    if (!selectable) {
+        // Bypass the actual select, and go directly to the search result handler
+        searchCompleted();
+    } else {
+        // Provide our last synchronized state, for servers able to report changes since then
+        QString uidValidity;
+        quint64 modSeq;
+        syncState(currentMailbox.id(), &uidValidity, &modSeq);
+        client->select( currentMailbox.name(), uidValidity, modSeq );
+    }
+}
+
+void ImapMailboxSync::connectionDone(ImapCommand &command, OperationState &state)
+{
+    if ( state != OpOk ) {
+        switch ( command ) {
+            case IMAP_UIDStore:
+            {
+                // Couldn't set a flag, ignore as we can stil continue
+                qLog(IMAP) << "could not store message flag";
+                break;
+            }
+
+            case IMAP_Enable:
+            {
+                // Not critical, we can synchronize without the extension
+                qLog(IMAP) << "could not enable extension";
+                break;
+            }
+
+            default:
+            {
+                qLog(IMAP) << "synchronization connection failed:" << client->lastError();
+                emit failed();
+                return;
+            }
+        }
+    }
+
+    switch (continueLogin(client, _config, command, &tlsEnabled)) {
+        case LoginPending:
+            break;
+        case LoginAuthenticate:
+            client->login(_config.mailUserName(), _config.mailPassword());
+            break;
+        case LoginComplete:
+            emit ready();
+            break;
+        case LoginNotApplicable:
+            operationDone(command);
+            break;
+    }
+}
+
+void ImapMailboxSync::connectionError(int code, QString msg)
+{
+    qLog(IMAP) << "synchronization connection error:" << code << msg;
+    emit failed();
+}
+
+void ImapMailboxSync::operationDone(ImapCommand command)
+{
+    switch( command ) {
+        case IMAP_Select:
+        {
+            handleSelect();
+            break;
+        }
+        case IMAP_UIDSearch:
+        {
+            handleSearch();
+            break;
+        }
+        case IMAP_UIDFetch:
+        {
+            // We have retrieved flag changes
+            synchronizeChanges();
+            break;
+        }
+        case IMAP_UIDStore:
+        {
+            if (!setNextSeen())
+                if (!setNextDeleted())
+                    completed();
+            break;
+        }
+        case IMAP_Expunge:
+        {
+            // Deleted messages, we are finished with this mailbox
+            completed();
+            break;
+        }
+        default:
+        {
+            qLog(IMAP) << "Unexpected synchronization response" << command;
+            break;
+        }
+    }
+}
+
+void ImapMailboxSync::handleSelect()
+{
+    QString uidValidity;
+    quint64 modSeq;
+    if ((client->exists() > 0) && (client->highestModSeq() != 0) &&
+        syncState(currentMailbox.id(), &uidValidity, &modSeq) && (uidValidity == client->uidValidity())) {
+        if (client->isEnabled("QRESYNC") || (client->highestModSeq() == modSeq)) {
+            // Any changes since our last synchronization have already been reported
+            synchronizeChanges();
+        } else {
+            // Find the messages that have changed since our last synchronization
+            client->uidFetch( F_Uid | F_Flags, "1:*", modSeq );
+        }
+    } else if (client->exists() > 0) {
+        // Start by looking for previously-seen messages
+        client->uidSearch(MFlag_Seen);
+    } else {
+        // No messages, so no need to perform search
+        searchCompleted();
+    }
+}
+
+void ImapMailboxSync::handleSearch()
+{
+    switch(_searchStatus)
+    {
+    case Seen:
+    {
+        _seenUids = client->mailboxUidList();
+
+        _searchStatus = Unseen;
+        client->uidSearch(MFlag_Unseen);
+        break;
+    }
+    case Unseen:
+    {
+        _unseenUids = client->mailboxUidList();
+
+        if ((_unseenUids.count() + _seenUids.count()) == client->exists()) {
+            // We have a consistent set of search results
+            searchCompleted();
+        } else {
+            qLog(IMAP) << "Inconsistent UID SEARCH result using SEEN/UNSEEN; reverting to ALL";
+
+            // Try doing a search for ALL messages
+            _unseenUids.clear();
+            _seenUids.clear();
+            _searchStatus = All;
+            client->uidSearch(MFlag_All);
+        }
+        break;
+    }
+    case All:
+    {
+        _unseenUids = client->mailboxUidList();
+        if (_unseenUids.count() != client->exists()) {
+            qLog(IMAP) << "Inconsistent UID SEARCH result";
+
+            // No consistent search result, so don't delete anything
+            _searchStatus = Inconclusive;
+        }
+
+        searchCompleted();
+        break;
+    }
+    default:
+        qLog(IMAP) << "Unknown search status";
+    }
+}
+
+/*  Determine the server state of the mailbox from our previous state and the changes
+    reported since then, without searching the entire mailbox
+*/
+void ImapMailboxSync::synchronizeChanges()
+{
+    QMailFolderId boxId = currentMailbox.id();
+
+    QMailAccount account(accountId);
+    QStringList readElsewhereUids = account.serverUids(boxId, QMailMessage::ReadElsewhere);
+    QStringList unreadElsewhereUids = account.serverUids(boxId, QMailMessage::ReadElsewhere, false);
+    QStringList deletedUids = account.deletedMessages(boxId);
+
+    QStringList storedUids = readElsewhereUids + unreadElsewhereUids + deletedUids;
+    QSet<QString> storedSet = storedUids.toSet();
+    QSet<QString> readElsewhereSet = readElsewhereUids.toSet();
+    QSet<QString> vanishedSet = client->vanishedUids(storedUids).toSet();
+    QMap<QString, MessageFlags> changes = client->changedFlags();
+
+    _seenUids.clear();
+    _unseenUids.clear();
+
+    foreach (const QString &uid, storedUids) {
+        if (vanishedSet.contains(uid))
+            continue;
+
+        bool seen;
+        QMap<QString, MessageFlags>::const_iterator it = changes.find(uid);
+        if (it != changes.end())
+            seen = (it.value() & MFlag_Seen);
+        else
+            seen = readElsewhereSet.contains(uid);
+
+        if (seen)
+            _seenUids.append(uid);
+        else
+            _unseenUids.append(uid);
+    }
+
+    // Messages added since our last synchronization
+    QMap<QString, MessageFlags>::const_iterator it = changes.begin(), end = changes.end();
+    for ( ; it != end; ++it) {
+        if (!storedSet.contains(it.key())) {
+            if (it.value() & MFlag_Seen)
+                _seenUids.append(it.key());
+            else
+                _unseenUids.append(it.key());
+        }
+    }
+
+    if ((_seenUids.count() + _unseenUids.count()) == client->exists()) {
+        searchCompleted();
+    } else {
+        qLog(IMAP) << "Inconsistent mailbox state after synchronizing changes; reverting to UID SEARCH";
+
+        _seenUids.clear();
+        _unseenUids.clear();
+        _searchStatus = Seen;
+        client->uidSearch(MFlag_Seen);
+    }
+}
+
+void ImapMailboxSync::searchCompleted()
+{
+    QMailFolderId boxId = currentMailbox.id();
+
+    if ((_searchStatus != Inconclusive) &&
+        (client->selected() == currentMailbox.name()) && (client->highestModSeq() != 0)) {
+        // Record the state we have synchronized with
+        setSyncState(boxId, client->uidValidity(), client->highestModSeq());
+    }
+
+    if ((currentMailbox.status() & QMailFolder::SynchronizationEnabled) &&
+        !(currentMailbox.status() & QMailFolder::Synchronized)) {
+        // We have just synchronized this folder
+        QMailFolder folder(boxId);
+        folder.setStatus(QMailFolder::Synchronized, true);
+        bool ok = QMailStore::instance()->updateFolder(&folder);
+        Q_ASSERT(ok);
+        Q_UNUSED(ok);
+    }
+
+    // Compare the server message list with our message list
+    QStringList reportedUids = _seenUids + _unseenUids;
+
+    QMailAccount account(accountId);
+    QStringList readElsewhereUids = account.serverUids(boxId, QMailMessage::ReadElsewhere);
+    QStringList unreadElsewhereUids = account.serverUids(boxId, QMailMessage::ReadElsewhere, false);
+    QStringList deletedUids = account.deletedMessages(boxId);
+
+    QStringList storedUids = readElsewhereUids + unreadElsewhereUids + deletedUids;
+
+    // New messages reported by the server that we don't yet have
+    QStringList newUids = inFirstButNotSecond(reportedUids, storedUids);
+    if (!newUids.isEmpty()) {
+        // Add this folder to the list to retrieve from later
+        emit newMessages(boxId, newUids);
+    }
+
+    if (_searchStatus == Inconclusive) {
+        // Don't mark or delete any messages without a correct server listing
+        completed();
+    } else {
+        // Only delete messages the server still has
+        _removedUids = inFirstAndSecond(deletedUids, reportedUids);
+        _expungeRequired = !_removedUids.isEmpty();
+
+        // Messages marked read locally that the server reports are unseen
+        _readUids = inFirstAndSecond(account.serverUids(boxId, QMailMessage::Read), _unseenUids);
+
+        // Report any messages that are no longer returned by the server
+        foreach (const QString &uid, inFirstButNotSecond(storedUids, reportedUids))
+            emit nonexistentMessage(uid, Client::Removed);
+
+        // Update any messages that are reported read-elsewhere, that we didn't previously know about
+        markReadElsewhere(inFirstAndSecond(_seenUids, unreadElsewhereUids));
+
+        // Mark any messages that we have read that the server thinks are unread
+        if (!setNextSeen())
+            if (!setNextDeleted())
+                completed();
+    }
+}
+
+void ImapMailboxSync::markReadElsewhere(const QStringList &uids)
+{
+    // Update the messages a group at a time, each group in a single store transaction,
+    // keeping the statement within SQLite's limit on bound parameters
+    static const int GroupSize = 100;
+
+    for (int i = 0; i < uids.count(); i += GroupSize) {
+        QMailMessageKey uidKey;
+        foreach (const QString &uid, uids.mid(i, GroupSize))
+            uidKey |= QMailMessageKey(QMailMessageKey::ServerUid, uid);
+
+        QMailMessageKey key(QMailMessageKey(QMailMessageKey::ParentAccountId, accountId) & uidKey);
+        if (!QMailStore::instance()->updateMessagesMetaData(key, QMailMessage::ReadElsewhere, true))
+            qLog(IMAP) << "Unable to mark messages read elsewhere in" << currentMailbox.name();
+    }
+}
+
+bool ImapMailboxSync::setNextSeen()
+{
+    if (!_readUids.isEmpty()) {
+        QString msgUidl = _readUids.takeFirst();
+
+        emit updateStatus( tr("Marking message %1 read").arg(msgUidl) );
+        client->uidStore(MFlag_Seen, ImapProtocol::uid(msgUidl));
+        return true;
+    }
+
+    return false;
+}
+
+bool ImapMailboxSync::setNextDeleted()
+{
+    if (_config.canDeleteMail()) {
+        if (!_removedUids.isEmpty()) {
+            QString msgUidl = _removedUids.takeFirst();
+
+            emit updateStatus( tr("Deleting message %1").arg(msgUidl) );
+
+            //remove records of deleted messages
+            QMailStore::instance()->purgeMessageRemovalRecords(accountId, QStringList() << msgUidl);
+
+            client->uidStore(MFlag_Deleted, ImapProtocol::uid(msgUidl));
+            return true;
+        } else if (_expungeRequired) {
+            // All messages flagged as deleted, expunge them
+            _expungeRequired = false;
+            client->expunge();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ImapMailboxSync::completed()
+{
+    active = false;
+    currentMailbox = QMailFolder();
+
+    emit mailboxSynchronized();
+}
+
 ImapClient::ImapClient(QObject* parent)
     : Client(parent),
+      clientSync(0),
+      maximumConnections(1),
+      synchronizing(false),
       supportsIdle(false),
       idling(false),
       retryDelay(5), // seconds
@@ -189,10 +743,8 @@ ImapClient::ImapClient(QObject* parent)
             this, SLOT(mailboxListed(QString&,QString&,QString&)) );
     connect(&client, SIGNAL(messageFetched(QMailMessage&)),
             this, SLOT(messageFetched(QMailMessage&)) );
-    connect(&client, SIGNAL(nonexistentMessage(QString,Client::DefunctReason)),
-            this, SIGNAL(nonexistentMessage(QString,Client::DefunctReason)) );
-    connect(&client, SIGNAL(downloadSize(int)),
-            this, SLOT(downloadSize(int)) );
+    connect(&client, SIGNAL(downloadSize(QString,int)),
+            this, SLOT(downloadSize(QString,int)) );
     connect(&client, SIGNAL(updateStatus(QString)),
             this, SLOT(transportStatus(QString)) );
     connect(&client, SIGNAL(connectionError(int,QString)),
@@ -210,6 +762,7 @@ ImapClient::ImapClient(QObject* parent)
 
 ImapClient::~ImapClient()
 {
+    closeSynchronizationConnections();
 }
 
 void ImapClient::newConnection()
@@ -227,6 +780,14 @@ void ImapClient::newConnection()
 
     status = Init;
 
+    closeSynchronizationConnections();
+    delete clientSync;
+    clientSync = new ImapMailboxSync(accountId, _config, &client, this);
+    connect(clientSync, SIGNAL(mailboxSynchronized()), this, SLOT(mailboxSynchronized()));
+    connect(clientSync, SIGNAL(newMessages(QMailFolderId,QStringList)), this, SLOT(newMessages(QMailFolderId,QStringList)));
+    connect(clientSync, SIGNAL(nonexistentMessage(QString,Client::DefunctReason)), this, SIGNAL(nonexistentMessage(QString,Client::DefunctReason)));
+    connect(clientSync, SIGNAL(updateStatus(QString)), this, SLOT(transportStatus(QString)));
+
     folderStatus.clear();
     selected = false;
     tlsEnabled = false;
@@ -237,6 +798,15 @@ void ImapClient::newConnection()
     mailboxList.clear();
 
     _retrieveUids.clear();
+    retrieveUids.clear();
+
+    // The number of messages requested by each FETCH command
+    QSettings settings("Trolltech", "messageserver");
+    settings.beginGroup("imap");
+    fetchWindow = qMax(1, settings.value("FetchWindow", 10).toInt());
+
+    // The number of connections used to synchronize mailboxes concurrently
+    maximumConnections = qMax(1, settings.value("MaximumConnections", 2).toInt());
 
     client.open(_config);
 }
@@ -326,6 +896,13 @@ void ImapClient::operationDone(ImapCommand &command, OperationState &state)
                 return;
             }
 
+            case IMAP_Enable:
+            {
+                // Not critical, we can synchronize without the extension
+                qLog(IMAP) << "could not enable extension";
+                break;
+            }
+
             case IMAP_Full:
             {
                 errorHandling(QMailMessageServer::ErrFileSystemFull, client.lastError() );
@@ -340,27 +917,23 @@ void ImapClient::operationDone(ImapCommand &command, OperationState &state)
         }
     }
 
-    switch( command ) {
-        case IMAP_Init:
+    if (synchronizing && clientSync->isActive()) {
+        // This response belongs to the mailbox being synchronized on our connection
+        clientSync->operationDone(command);
+        return;
+    }
+
+    switch (continueLogin(&client, _config, command, &tlsEnabled)) {
+        case LoginPending:
         {
-            emit updateStatus( QMailMessageServer::None, tr("Checking capabilities" ) );
-            client.capability();
-            break;
+            if (command == IMAP_Init)
+                emit updateStatus( QMailMessageServer::None, tr("Checking capabilities" ) );
+            else if (command == IMAP_Capability)
+                emit updateStatus( QMailMessageServer::None, tr("Starting TLS" ) );
+            return;
         }
-        case IMAP_Capability:
+        case LoginAuthenticate:
         {
-#ifndef QT_NO_OPENSSL
-            if (!tlsEnabled && (_config.mailEncryption() == AccountConfiguration::Encrypt_TLS)) {
-                if (client.supportsCapability("STARTTLS")) {
-                    emit updateStatus( QMailMessageServer::None, tr("Starting TLS" ) );
-                    client.startTLS();
-                    break;
-                } else {
-                    // TODO: request user direction
-                    qWarning() << "No TLS support - continuing unencrypted";
-                }
-            }
-#endif
             supportsIdle = client.supportsCapability("IDLE");
             if (!idleConnection.connected() 
                 && supportsIdle 
@@ -374,8 +947,14 @@ void ImapClient::operationDone(ImapCommand &command, OperationState &state)
                 emit updateStatus( QMailMessageServer::None, tr("Logging in" ) );
                 client.login(_config.mailUserName(), _config.mailPassword());
             }
-            break;
+            return;
         }
+        case LoginComplete:
+        case LoginNotApplicable:
+            break;
+    }
+
+    switch( command ) {
         case IMAP_Idle_Continuation:
         {
             waitingForIdle = false;
@@ -383,17 +962,10 @@ void ImapClient::operationDone(ImapCommand &command, OperationState &state)
             client.login(_config.mailUserName(), _config.mailPassword());
             break;
         }
-        case IMAP_StartTLS:
-        {
-            // We are now in TLS mode
-            tlsEnabled = true;
-
-            // Check capabilities for encrypted mode
-            client.capability();
-            break;
-        }
         case IMAP_Login:
+        case IMAP_Enable:
         {
+            // Logged in
             emit updateStatus( QMailMessageServer::None, tr("Retrieving folders") );
             mailboxNames.clear();
 
@@ -413,9 +985,8 @@ void ImapClient::operationDone(ImapCommand &command, OperationState &state)
                 // We have retrieved all the folders
                 retrieveOperationCompleted();
                 closeConnection();
-            } else if (!selectNextMailbox()) {
-                // Could be no mailbox has been selected to be stored locally
-                retrieveOperationCompleted();
+            } else {
+                synchronizeMailboxes();
             }
             break;
         }
@@ -424,29 +995,17 @@ void ImapClient::operationDone(ImapCommand &command, OperationState &state)
             handleSelect();
             break;
         }
-        case IMAP_UIDSearch:
-        {
-            handleSearch();
-            break;
-        }
         case IMAP_UIDFetch:
         {
             handleUidFetch();
             break;
         }
 
+        case IMAP_UIDSearch:
         case IMAP_UIDStore:
-        {
-            if (!setNextSeen())
-                if (!setNextDeleted())
-                    handleUid();
-            break;
-        }
-
         case IMAP_Expunge:
         {
-            // Deleted messages, we can handle UID now
-            handleUid();
+            qLog(IMAP) << "Unexpected synchronization response" << command;
             break;
         }
 
@@ -474,237 +1033,201 @@ void ImapClient::operationDone(ImapCommand &command, OperationState &state)
     }
 }
 
-bool ImapClient::selectNextMailbox()
+/*  Synchronize each mailbox enabled for synchronization, sharing the mailboxes
+    between our own connection and up to MaximumConnections - 1 additional ones
+*/
+void ImapClient::synchronizeMailboxes()
 {
-    _seenUids = QStringList();
-    _unseenUids = QStringList();
-    _newUids = QStringList();
-    _readUids = QStringList();
-    _removedUids = QStringList();
-    _expungeRequired = false;
-    _searchStatus = Seen;
+    QMailFolderIdList boxes;
+    foreach (const QMailFolderId &boxId, mailboxList)
+        if (QMailFolder(boxId).status() & QMailFolder::SynchronizationEnabled)
+            boxes.append(boxId);
 
-    if (nextMailbox()) {
-        if (status == List) {
-            emit updateStatus( QMailMessageServer::Retrieve, tr("Checking", "Checking <mailbox name>") + QChar(' ') + currentMailbox.displayName() );
-        }
+    mailboxList = boxes;
+    synchronizationOrder = boxes;
 
-        FolderStatus folderState = folderStatus[currentMailbox.id()];
-        if (folderState & NoSelect) {
-            // Bypass the actual select, and go directly to the search result handler
-            searchCompleted();
-        } else {
-            client.select( currentMailbox.name() );
-        }
-        return true;
-    } else {
-        return false;
+    if (mailboxList.isEmpty()) {
+        // Could be no mailbox has been selected to be stored locally
+        retrieveOperationCompleted();
+        return;
     }
-}
 
-void ImapClient::handleUidFetch()
-{
-    if (status == Fetch) {    //getting headers
-        handleUid();
-    } else if (status == Retrieve) {    //getting complete messages
-        fetchNextMail();
+    synchronizing = true;
+
+    // Each additional connection must log in before it can be used, so open them first
+    int additional = qMin(maximumConnections - 1, mailboxList.count() - 1);
+    for (int i = 0; i < additional; ++i) {
+        ImapMailboxSync *sync = new ImapMailboxSync(accountId, _config, 0, this);
+        connect(sync, SIGNAL(ready()), this, SLOT(connectionReady()));
+        connect(sync, SIGNAL(failed()), this, SLOT(connectionFailed()));
+        connect(sync, SIGNAL(mailboxSynchronized()), this, SLOT(mailboxSynchronized()));
+        connect(sync, SIGNAL(newMessages(QMailFolderId,QStringList)), this, SLOT(newMessages(QMailFolderId,QStringList)));
+        connect(sync, SIGNAL(nonexistentMessage(QString,Client::DefunctReason)), this, SIGNAL(nonexistentMessage(QString,Client::DefunctReason)));
+        connect(sync, SIGNAL(updateStatus(QString)), this, SLOT(transportStatus(QString)));
+
+        syncConnections.append(sync);
+        sync->open();
     }
+
+    synchronizeNextMailbox(clientSync);
 }
 
-void ImapClient::handleSearch()
+bool ImapClient::synchronizeNextMailbox(ImapMailboxSync *sync)
 {
-    switch(_searchStatus)
-    {
-    case Seen:
-    {
-        _seenUids = client.mailboxUidList();
+    if (mailboxList.isEmpty())
+        return false;
 
-        _searchStatus = Unseen;
-        client.uidSearch(MFlag_Unseen);
-        break;
-    }
-    case Unseen:
-    {
-        _unseenUids = client.mailboxUidList();
+    QMailFolder mailbox(mailboxList.takeFirst());
+    emit updateStatus( QMailMessageServer::Retrieve, tr("Checking", "Checking <mailbox name>") + QChar(' ') + mailbox.displayName() );
 
-        if ((_unseenUids.count() + _seenUids.count()) == client.exists()) {
-            // We have a consistent set of search results
-            searchCompleted();
-        } else {
-            qLog(IMAP) << "Inconsistent UID SEARCH result using SEEN/UNSEEN; reverting to ALL";
+    sync->synchronize(mailbox, !(folderStatus[mailbox.id()] & NoSelect));
+    return true;
+}
 
-            // Try doing a search for ALL messages
-            _unseenUids.clear();
-            _seenUids.clear();
-            _searchStatus = All;
-            client.uidSearch(MFlag_All);
-        }
-        break;
-    }
-    case All:
-    {
-        _unseenUids = client.mailboxUidList();
-        if (_unseenUids.count() != client.exists()) {
-            qLog(IMAP) << "Inconsistent UID SEARCH result";
+void ImapClient::mailboxSynchronized()
+{
+    ImapMailboxSync *sync = static_cast<ImapMailboxSync *>(sender());
+    if (!synchronizing)
+        return;
 
-            // No consistent search result, so don't delete anything
-            _searchStatus = Inconclusive;
-        }
+    if (!synchronizeNextMailbox(sync)) {
+        if (sync != clientSync)
+            closeSynchronizationConnection(sync);
 
-        searchCompleted();
-        break;
-    }
-    default:
-        qLog(IMAP) << "Unknown search status";
+        checkMailboxesSynchronized();
     }
 }
 
-static QStringList inFirstAndSecond(const QStringList &first, const QStringList &second)
+void ImapClient::connectionReady()
 {
-    QStringList result;
-
-    foreach (const QString &value, first)
-        if (second.contains(value))
-            result.append(value);
+    ImapMailboxSync *sync = static_cast<ImapMailboxSync *>(sender());
 
-    return result;
+    if (!synchronizeNextMailbox(sync)) {
+        // The other connections have already handled every mailbox
+        closeSynchronizationConnection(sync);
+        checkMailboxesSynchronized();
+    }
 }
 
-static QStringList inFirstButNotSecond(const QStringList &first, const QStringList &second)
+void ImapClient::connectionFailed()
 {
-    QStringList result;
+    ImapMailboxSync *sync = static_cast<ImapMailboxSync *>(sender());
 
-    foreach (const QString &value, first)
-        if (!second.contains(value))
-            result.append(value);
+    // Leave any unfinished mailbox to the remaining connections
+    if (sync->isActive())
+        mailboxList.prepend(sync->mailbox().id());
+    closeSynchronizationConnection(sync);
 
-    return result;
+    if (!clientSync->isActive())
+        synchronizeNextMailbox(clientSync);
+
+    checkMailboxesSynchronized();
 }
 
-void ImapClient::searchCompleted()
+void ImapClient::newMessages(const QMailFolderId &boxId, const QStringList &uids)
 {
-    QMailFolderId boxId = currentMailbox.id();
+    _retrieveUids.append(qMakePair(boxId, uids));
+}
 
-    if ((currentMailbox.status() & QMailFolder::SynchronizationEnabled) &&
-        !(currentMailbox.status() & QMailFolder::Synchronized)) {
-        // We have just synchronized this folder
-        QMailFolder folder(boxId);
-        folder.setStatus(QMailFolder::Synchronized, true);
-        bool ok = QMailStore::instance()->updateFolder(&folder);
-        Q_ASSERT(ok);
-        Q_UNUSED(ok);
+void ImapClient::closeSynchronizationConnection(ImapMailboxSync *sync)
+{
+    syncConnections.removeAll(sync);
+    sync->close();
+    sync->deleteLater();
+}
+
+void ImapClient::closeSynchronizationConnections()
+{
+    foreach (ImapMailboxSync *sync, syncConnections) {
+        sync->close();
+        sync->deleteLater();
     }
+    syncConnections.clear();
 
-    // Compare the server message list with our message list
-    QStringList reportedUids = _seenUids + _unseenUids;
+    if (clientSync)
+        clientSync->close();
 
-    QMailAccount account(accountId);
-    QStringList readElsewhereUids = account.serverUids(boxId, QMailMessage::ReadElsewhere);
-    QStringList unreadElsewhereUids = account.serverUids(boxId, QMailMessage::ReadElsewhere, false);
-    QStringList deletedUids = account.deletedMessages(boxId);
+    synchronizing = false;
+}
 
-    QStringList storedUids = readElsewhereUids + unreadElsewhereUids + deletedUids;
+void ImapClient::checkMailboxesSynchronized()
+{
+    if (!synchronizing || clientSync->isActive() || !syncConnections.isEmpty() || !mailboxList.isEmpty())
+        return;
 
-    // New messages reported by the server that we don't yet have
-    QStringList newUids = inFirstButNotSecond(reportedUids, storedUids);
-    if (!newUids.isEmpty()) {
-        // Add this folder to the list to retrieve from later
-        _retrieveUids.append(qMakePair(boxId, newUids));
-    }
+    synchronizing = false;
 
-    if (_searchStatus == Inconclusive) {
-        // Don't mark or delete any messages without a correct server listing
-        handleUid();
-    } else {
-        // Only delete messages the server still has
-        _removedUids = inFirstAndSecond(deletedUids, reportedUids);
-        _expungeRequired = !_removedUids.isEmpty();
+    if (_retrieveUids.isEmpty()) {
+        previewCompleted();
+        return;
+    }
 
-        // Messages marked read locally that the server reports are unseen
-        _readUids = inFirstAndSecond(account.serverUids(boxId, QMailMessage::Read), _unseenUids);
+    // Preview messages in mailbox order, regardless of which connection found them
+    QList<QPair<QMailFolderId, QStringList> > ordered;
+    foreach (const QMailFolderId &boxId, synchronizationOrder) {
+        QList<QPair<QMailFolderId, QStringList> >::const_iterator it = _retrieveUids.begin(), end = _retrieveUids.end();
+        for ( ; it != end; ++it)
+            if (it->first == boxId)
+                ordered.append(*it);
+    }
+    _retrieveUids = ordered;
 
-        // Report any messages that are no longer returned by the server
-        foreach (const QString &uid, inFirstButNotSecond(storedUids, reportedUids))
-            emit nonexistentMessage(uid, Client::Removed);
+    // We now have a list of all messages to be retrieved for each mailbox
+    uint totalMessages = 0;
+    QList<QPair<QMailFolderId, QStringList> >::const_iterator it = _retrieveUids.begin(), end = _retrieveUids.end();
+    for ( ; it != end; ++it)
+        totalMessages += it->second.count();
 
-        // Update any messages that are reported read-elsewhere, that we didn't previously know about
-        foreach (const QString &uid, inFirstAndSecond(_seenUids, unreadElsewhereUids)) {
-            // We know of this message, but we have it marked as unread
-            QMailMessageMetaData metaData(uid, accountId);
-            metaData.setStatus(QMailMessage::ReadElsewhere, true);
-            bool ok = QMailStore::instance()->updateMessage(&metaData);
-            Q_ASSERT(ok);
-            Q_UNUSED(ok);
-        }
+    emit fetchTotal(totalMessages);
+    emit updateStatus(QMailMessageServer::Retrieve, tr("Previewing", "Previewing <number of messages>") +QChar(' ') + QString::number(totalMessages));
 
-        // Mark any messages that we have read that the server thinks are unread
-        if (!setNextSeen())
-            if (!setNextDeleted())
-                handleUid();
-    }
+    fetchedCount = 0;
+    status = Fetch;
+    selectNextMailbox();
 }
 
-bool ImapClient::setNextSeen()
+/*  In fetch mode, select the mailboxes where retrievable messages are located
+*/
+bool ImapClient::selectNextMailbox()
 {
-    if (!_readUids.isEmpty()) {
-        msgUidl = _readUids.first();
-        _readUids.removeAll( msgUidl );
-
-        emit updateStatus( QMailMessageServer::None, tr("Marking message %1 read").arg(msgUidl) );
-        client.uidStore(MFlag_Seen, ImapProtocol::uid(msgUidl));
-        return true;
+    if (_retrieveUids.isEmpty()) {
+        currentMailbox = QMailFolder();
+        return false;
     }
 
-    return false;
+    QPair<QMailFolderId, QStringList> next = _retrieveUids.takeFirst();
+    currentMailbox = QMailFolder(next.first);
+    _newUids = next.second;
+
+    client.select( currentMailbox.name() );
+    return true;
 }
 
-bool ImapClient::setNextDeleted()
+void ImapClient::handleUidFetch()
 {
-    if (_config.canDeleteMail()) {
-        if (!_removedUids.isEmpty()) {
-            msgUidl = _removedUids.first();
-            _removedUids.removeAll( msgUidl );
-
-            emit updateStatus( QMailMessageServer::None, tr("Deleting message %1").arg(msgUidl) );
-
-            //remove records of deleted messages
-            QMailStore::instance()->purgeMessageRemovalRecords(accountId, QStringList() << msgUidl);
+    if (status == Fetch) {    //getting headers
+        handleUid();
+    } else if (status == Retrieve) {    //getting complete messages
+        // Any message not returned by the server no longer exists
+        foreach (const QString &uid, retrieveUids)
+            emit nonexistentMessage(uid, Client::Removed);
+        retrieveUids.clear();
 
-            client.uidStore(MFlag_Deleted, ImapProtocol::uid(msgUidl));
-            return true;
-        } else if (_expungeRequired) {
-            // All messages flagged as deleted, expunge them
-            client.expunge();
-            return true;
-        }
+        fetchNextMail();
     }
-
-    return false;
 }
 
 void ImapClient::handleUid()
 {
     if (_newUids.count() > 0) {
-        // TODO: We should find a compromise between retrieving all messages and retrieving messages individually:
-        //client.uidFetch(F_Uid | F_Rfc822_Size | F_Rfc822_Header, ImapProtocol::uidRange(_newUids.first(), _newUids.last()) );
-        client.uidFetch(F_Uid | F_Rfc822_Size | F_Rfc822_Header, ImapProtocol::uid(_newUids.takeFirst()));
-    } else if (!selectNextMailbox()) {
-        if ((status == Fetch) || (_retrieveUids.isEmpty())) {
-            previewCompleted();
-        } else {
-            // We now have a list of all messages to be retrieved for each mailbox
-            uint totalMessages = 0;
-            QList<QPair<QMailFolderId, QStringList> >::const_iterator it = _retrieveUids.begin(), end = _retrieveUids.end();
-            for ( ; it != end; ++it)
-                totalMessages += it->second.count();
-
-            emit fetchTotal(totalMessages);
-            emit updateStatus(QMailMessageServer::Retrieve, tr("Previewing", "Previewing <number of messages>") +QChar(' ') + QString::number(totalMessages));
+        // Retrieve the headers for a batch of messages with each command
+        QStringList batch;
+        while (!_newUids.isEmpty() && (batch.count() < fetchWindow))
+            batch.append(_newUids.takeFirst());
 
-            fetchedCount = 0;
-            status = Fetch;
-            selectNextMailbox();
-        }
+        client.uidFetch(F_Uid | F_Rfc822_Size | F_Rfc822_Header, ImapProtocol::uidSet(batch));
+    } else if (!selectNextMailbox()) {
+        previewCompleted();
     }
 }
 
@@ -714,51 +1237,20 @@ void ImapClient::handleSelect()
     if (status == Retrieve) {
         // We're completing a message
         emit updateStatus( QMailMessageServer::Retrieve, tr("Completing %1 / %2").arg(messageCount).arg(listSize) );
-        client.uidFetch( F_Uid | F_Rfc822_Size | F_Rfc822, ImapProtocol::uid(msgUidl) );
-        return;
+        client.uidFetch( F_Uid | F_Rfc822_Size | F_Rfc822, ImapProtocol::uidSet(retrieveUids) );
     } else if (status == Fetch) {
         // We're retrieving message metadata
         handleUid();
-    } else {
-        // We're searching mailboxes
-        if (client.exists() > 0) {
-            // Start by looking for previously-seen messages
-            client.uidSearch(MFlag_Seen);
-        } else {
-            // No messages, so no need to perform search
-            searchCompleted();
-        }
-    }
-}
-
-bool ImapClient::nextMailbox()
-{
-    while (!mailboxList.isEmpty()) {
-        currentMailbox = QMailFolder(mailboxList.takeFirst());
-        if (currentMailbox.status() & QMailFolder::SynchronizationEnabled)
-            return true;
     }
-
-    // We have exhausted the list of mailboxes
-    if ((status == Fetch) && !_retrieveUids.isEmpty()) {
-        // In fetch mode, return the mailboxes where retrievable messages are located
-        QPair<QMailFolderId, QStringList> next = _retrieveUids.takeFirst();
-        currentMailbox = QMailFolder(next.first);
-        _newUids = next.second;
-        return true;
-    }
-
-    currentMailbox = QMailFolder();
-    return false;
 }
 
 void ImapClient::fetchNextMail()
 {
     QMailFolderId mailboxId;
+    retrieveUids.clear();
 
     MessageMap::ConstIterator selectionEnd = folderItr.value().end();
 
-    QString serverUid;
     if (selectionItr == selectionEnd) {
         ++folderItr;
         if (folderItr != selectionMap.end()) {
@@ -767,8 +1259,9 @@ void ImapClient::fetchNextMail()
         }
     } 
 
-    if (selectionItr != selectionEnd) {
-        serverUid = selectionItr.key();
+    // Retrieve a batch of messages from the same mailbox with each command
+    while ((selectionItr != selectionEnd) && (retrieveUids.count() < fetchWindow)) {
+        retrieveUids.append(selectionItr.key());
         mailboxId = folderItr.key();
 
         ++selectionItr;
@@ -780,15 +1273,12 @@ void ImapClient::fetchNextMail()
             currentMailbox = QMailFolder(mailboxId);
 
         status = Retrieve;
-        retrieveUid = serverUid;
         if ((currentMailbox.name()) == client.selected()) {
             emit updateStatus( QMailMessageServer::Retrieve, tr("Completing %1 / %2").arg(messageCount).arg(listSize) );
-            msgUidl = serverUid;
-            client.uidFetch( F_Uid | F_Rfc822_Size | F_Rfc822, ImapProtocol::uid(msgUidl) );
+            client.uidFetch( F_Uid | F_Rfc822_Size | F_Rfc822, ImapProtocol::uidSet(retrieveUids) );
             return;
 
         } else {
-            msgUidl = serverUid;
             client.select( currentMailbox.name() );
             return;
         }
@@ -850,15 +1340,18 @@ void ImapClient::messageFetched(QMailMessage& mail)
     bool isPartial(status == Fetch);
     mail.setStatus(QMailMessage::Downloaded, !isPartial);
 
-    if (selected && folderItr.value().contains(retrieveUid)) {
-        mail.setId(folderItr.value().value(retrieveUid));
+    QString serverUid(mail.serverUid());
+    bool retrieving((status == Retrieve) && retrieveUids.contains(serverUid));
+
+    if (retrieving && selected && folderItr.value().contains(serverUid)) {
+        mail.setId(folderItr.value().value(serverUid));
     }
 
     emit newMessage(mail, isPartial);
 
-    if (!retrieveUid.isEmpty()) {
-        emit messageProcessed(retrieveUid);
-        retrieveUid = QString();
+    if (retrieving) {
+        retrieveUids.removeAll(serverUid);
+        emit messageProcessed(serverUid);
     }
 
     if (isPartial) {
@@ -884,6 +1377,8 @@ QMailAccountId ImapClient::account() const
 
 void ImapClient::errorHandling(int code, QString msg)
 {
+    closeSynchronizationConnections();
+
     if ( client.inUse() || (status == Init) ) {
         client.close();
     }
@@ -961,19 +1456,30 @@ void ImapClient::removeDeletedMailboxes()
     mailboxList = account.mailboxes();
 
     QMailFolderIdList nonexistent;
+    QMailFolderId inboxId;
     foreach (const QMailFolderId &boxId, mailboxList) {
         QMailFolder mailbox(boxId);
         bool exists = mailboxNames.contains(mailbox.name());
         if (!exists) {
             nonexistent.append(mailbox.id());
+        } else if (mailbox.name().compare("INBOX", Qt::CaseInsensitive) == 0) {
+            inboxId = mailbox.id();
         }
     }
 
+    if (inboxId.isValid()) {
+        // Synchronize the inbox ahead of other mailboxes
+        mailboxList.removeAll(inboxId);
+        mailboxList.prepend(inboxId);
+    }
+
     foreach (const QMailFolderId &boxId, nonexistent) {
         // Any messages in this box should be removed also
         foreach (const QString& uid, account.serverUids(boxId))
             emit nonexistentMessage(uid, Client::FolderRemoved);
 
+        setSyncState(boxId, QString(), 0);
+
         bool result = QMailStore::instance()->removeFolder(boxId);
         Q_ASSERT(result);
         Q_UNUSED(result);
@@ -1002,10 +1508,10 @@ void ImapClient::previewCompleted()
     emit partialRetrievalCompleted();
 }
 
-void ImapClient::downloadSize(int length)
+void ImapClient::downloadSize(const QString &uid, int length)
 {
-    if (!retrieveUid.isEmpty())
-        emit retrievalProgress(retrieveUid, length);
+    if ((status == Retrieve) && retrieveUids.contains(uid))
+        emit retrievalProgress(uid, length);
 }
 
 void ImapClient::retrieveOperationCompleted()
@@ -1016,4 +1522,3 @@ void ImapClient::retrieveOperationCompleted()
     // Or it may have been requested by a waiting client
     emit retrievalCompleted();
 }
-
@@ -36,6 +36,69 @@
 
 class QMailAccount;
 
+// Synchronizes the message lists of mailboxes with the server, one mailbox at a time.
+// A synchronizer either shares the connection of its client, which passes it the
+// responses to its commands, or opens and logs in a connection of its own.
+class ImapMailboxSync : public QObject
+{
+    Q_OBJECT
+
+public:
+    ImapMailboxSync(const QMailAccountId &accountId, const AccountConfiguration &config, ImapProtocol *connection, QObject *parent);
+    ~ImapMailboxSync();
+
+    void open();
+    void close();
+
+    bool isActive() const;
+    QMailFolder mailbox() const;
+
+    void synchronize(const QMailFolder &mailbox, bool selectable);
+    void operationDone(ImapCommand command);
+
+signals:
+    void ready();
+    void failed();
+    void updateStatus(const QString &);
+    void mailboxSynchronized();
+    void newMessages(const QMailFolderId &boxId, const QStringList &uids);
+    void nonexistentMessage(const QString &uid, Client::DefunctReason reason);
+
+private slots:
+    void connectionDone(ImapCommand &command, OperationState &state);
+    void connectionError(int code, QString msg);
+
+private:
+    enum SearchStatus
+    {
+        All, Seen, Unseen, Inconclusive
+    };
+
+    void handleSelect();
+    void handleSearch();
+    void synchronizeChanges();
+    void searchCompleted();
+    void markReadElsewhere(const QStringList &uids);
+    bool setNextSeen();
+    bool setNextDeleted();
+    void completed();
+
+    QMailAccountId accountId;
+    AccountConfiguration _config;
+    ImapProtocol *client;
+    bool ownConnection;
+    bool tlsEnabled;
+    bool active;
+    QMailFolder currentMailbox;
+
+    SearchStatus _searchStatus;
+    QStringList _unseenUids;
+    QStringList _seenUids;
+    QStringList _readUids;
+    QStringList _removedUids;
+    bool _expungeRequired;
+};
+
 class ImapClient: public Client
 {
     Q_OBJECT
@@ -76,8 +139,12 @@ public slots:
 protected slots:
     void operationDone(ImapCommand &, OperationState &);
     void mailboxListed(QString &, QString &, QString &);
+    void mailboxSynchronized();
+    void connectionReady();
+    void connectionFailed();
+    void newMessages(const QMailFolderId &boxId, const QStringList &uids);
     void messageFetched(QMailMessage& mail);
-    void downloadSize(int);
+    void downloadSize(const QString&, int);
     void transportStatus(const QString& status);
 
     void idleOperationDone(ImapCommand &, OperationState &);
@@ -89,29 +156,29 @@ private:
         Init, List, Fetch, Retrieve
     };
 
-    enum SearchStatus
-    {
-        All, Seen, Unseen, Inconclusive
-    };
-
     void removeDeletedMailboxes();
+    void synchronizeMailboxes();
+    bool synchronizeNextMailbox(ImapMailboxSync *sync);
+    void closeSynchronizationConnection(ImapMailboxSync *sync);
+    void closeSynchronizationConnections();
+    void checkMailboxesSynchronized();
     bool selectNextMailbox();
-    bool nextMailbox();
     void handleSelect();
     void handleUid();
     void handleUidFetch();
-    void handleSearch();
 
-    bool setNextSeen();
-    bool setNextDeleted();
     void fetchNextMail();
-    void searchCompleted();
     void previewCompleted();
     void retrieveOperationCompleted();
 
 private:
     ImapProtocol client;
     ImapProtocol idleConnection;
+    ImapMailboxSync *clientSync;
+    QList<ImapMailboxSync *> syncConnections;
+    QMailFolderIdList synchronizationOrder;
+    int maximumConnections;
+    bool synchronizing;
 
     QMailAccountId accountId;
     AccountConfiguration _config;
@@ -119,15 +186,8 @@ private:
     SelectionMap::ConstIterator folderItr;
     MessageMap::ConstIterator selectionItr;
     int listSize;
-    QString msgUidl;
 
-    SearchStatus _searchStatus;
-    QStringList _unseenUids;
-    QStringList _seenUids;
     QStringList _newUids;
-    QStringList _readUids;
-    QStringList _removedUids;
-    bool _expungeRequired;
 
     QList<QPair<QMailFolderId, QStringList> > _retrieveUids;
 
@@ -140,7 +200,8 @@ private:
     QMailFolder currentMailbox;
     QMailFolderIdList mailboxList;
 
-    QString retrieveUid;
+    QStringList retrieveUids;
+    int fetchWindow;
     bool tlsEnabled;
 
     QMap<QMailFolderId, FolderStatus> folderStatus;
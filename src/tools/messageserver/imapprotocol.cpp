@@ -20,11 +20,11 @@
 #include "imapprotocol.h"
 
 #include <QApplication>
+#include <QFileInfo>
 #include <QTemporaryFile>
 
 #include "mailtransport.h"
 #include <private/longstream_p.h>
-#include <private/longstring_p.h>
 #include <QMailMessage>
 
 #ifndef QT_NO_OPENSSL
@@ -107,69 +107,150 @@ static QString messageUid(const QString& mailbox, const QString& id)
     return mailbox + '|' + id;
 }
 
-static QString extractUid(const QString& field, const QString& mailbox)
+// Returns the length of the literal announced at the end of a response line, or -1
+static int literalLength(const QByteArray& line)
 {
-    QRegExp uidFormat("UID *(\\d+)");
-    if (uidFormat.indexIn(field) != -1) {
-        return messageUid(mailbox, uidFormat.cap(1));
-    }
+    int end = line.length();
+    while ((end > 0) && ((line[end - 1] == '\n') || (line[end - 1] == '\r')))
+        --end;
+
+    if ((end == 0) || (line[end - 1] != '}'))
+        return -1;
 
-    return QString();
+    int begin = line.lastIndexOf('{', end - 1);
+    if (begin == -1)
+        return -1;
+
+    bool ok;
+    int length = line.mid(begin + 1, end - begin - 2).toInt(&ok);
+    return (ok ? length : -1);
 }
 
-static uint extractSize(const QString& field)
+// True if the response is an untagged FETCH response
+static bool isFetchResponse(const QByteArray& response)
 {
-    QRegExp sizeFormat("RFC822\\.SIZE *(\\d+)");
-    if (sizeFormat.indexIn(field) != -1) {
-        return sizeFormat.cap(1).toUInt();
+    if (!response.startsWith("* "))
+        return false;
+
+    int index = 2;
+    while ((index < response.length()) && (response[index] >= '0') && (response[index] <= '9'))
+        ++index;
+
+    return ((index > 2) && (qstrnicmp(response.constData() + index, " FETCH ", 7) == 0));
+}
+
+// True if the literal about to be received contains message data
+static bool isMessageData(const QByteArray& response)
+{
+    if (!isFetchResponse(response))
+        return false;
+
+    int end = response.length();
+    while ((end > 0) && (response[end - 1] == ' '))
+        --end;
+
+    int begin = end;
+    while ((begin > 0) && (response[begin - 1] != ' ') && (response[begin - 1] != '('))
+        --begin;
+
+    QByteArray item(response.mid(begin, end - begin).toUpper());
+    return (item.startsWith("BODY[") || item.startsWith("BODY.PEEK[") || item.startsWith("RFC822"));
+}
+
+// Extract the value following the named data item in a FETCH response; 
+// for parenthesized values, the content of the parentheses is returned
+static bool fetchItem(const QByteArray& response, const char* name, QByteArray* value)
+{
+    const int nameLength = qstrlen(name);
+
+    int index = 0;
+    while ((index = response.indexOf(name, index)) != -1) {
+        int end = index + nameLength;
+
+        // The name must be a complete token followed by a value
+        if (((index == 0) || (response[index - 1] == ' ') || (response[index - 1] == '(')) &&
+            ((end + 1) < response.length()) && (response[end] == ' ')) {
+            ++end;
+            if (response[end] == '(') {
+                int close = response.indexOf(')', end);
+                if (close == -1)
+                    return false;
+
+                *value = response.mid(end + 1, close - end - 1);
+            } else {
+                int stop = end;
+                while ((stop < response.length()) && 
+                       (response[stop] != ' ') && (response[stop] != ')') && (response[stop] != '\r'))
+                    ++stop;
+
+                *value = response.mid(end, stop - end);
+            }
+            return true;
+        }
+
+        index = end;
     }
 
-    return 0;
+    return false;
 }
 
-static bool parseFlags(const QString& field, MessageFlags& flags)
+static MessageFlags parseFlags(const QByteArray& field)
 {
-    QRegExp pattern("FLAGS *\\((.*)\\)");
-    pattern.setMinimal(true);
+    MessageFlags flags = 0;
+
+    foreach (const QByteArray& flag, field.toUpper().split(' ')) {
+        if (flag == "\\SEEN")
+            flags |= MFlag_Seen;
+        else if (flag == "\\ANSWERED")
+            flags |= MFlag_Answered;
+        else if (flag == "\\FLAGGED")
+            flags |= MFlag_Flagged;
+        else if (flag == "\\DELETED")
+            flags |= MFlag_Deleted;
+        else if (flag == "\\DRAFT")
+            flags |= MFlag_Draft;
+        else if (flag == "\\RECENT")
+            flags |= MFlag_Recent;
+    }
 
-    if (pattern.indexIn(field) == -1)
-        return false;
+    return flags;
+}
+
+// True if the numeric value is a member of the IMAP sequence set
+static bool inSequenceSet(const QString& set, uint value)
+{
+    foreach (const QString& range, set.split(',', QString::SkipEmptyParts)) {
+        int index = range.indexOf(':');
+        if (index == -1) {
+            if (range.trimmed().toUInt() == value)
+                return true;
+        } else {
+            uint first = range.left(index).toUInt();
+            uint last = range.mid(index + 1).trimmed().toUInt();
+            if (first > last)
+                qSwap(first, last);
 
-    QString messageFlags = pattern.cap(1);
-
-    flags = 0;
-    if (messageFlags.indexOf("\\Seen") != -1)
-        flags |= MFlag_Seen;
-    if (messageFlags.indexOf("\\Answered") != -1)
-        flags |= MFlag_Answered;
-    if (messageFlags.indexOf("\\Flagged") != -1)
-        flags |= MFlag_Flagged;
-    if (messageFlags.indexOf("\\Deleted") != -1)
-        flags |= MFlag_Deleted;
-    if (messageFlags.indexOf("\\Draft") != -1)
-        flags |= MFlag_Draft;
-    if (messageFlags.indexOf("\\Recent") != -1)
-        flags |= MFlag_Recent;
+            if ((value >= first) && (value <= last))
+                return true;
+        }
+    }
 
-    return true;
+    return false;
 }
 
 ImapProtocol::ImapProtocol()
 {
-    read = 0;
-    firstParseFetch = true;
     transport = 0;
-    d = new LongStream();
-    newMessage = true;
-    fetchAllFailed = false;
-    nonExistentMsg = false;
+    literalRemaining = 0;
+    literalFile = 0;
+    _highestModSeq = 0;
     connect(&incomingDataTimer, SIGNAL(timeout()),
             this, SLOT(incomingData()));
 }
 
 ImapProtocol::~ImapProtocol()
 {
-    delete d;
+    resetParser();
     delete transport;
 }
 
@@ -185,11 +266,11 @@ bool ImapProtocol::open( const AccountConfiguration& config )
     status = IMAP_Init;
 
     errorList.clear();
+    _enabled.clear();
 
     requestCount = 0;
     request.clear();
-    d->reset();
-    newMessage = true;
+    resetParser();
 
     if (!transport) {
         transport = new ImapTransport("IMAP");
@@ -214,8 +295,7 @@ void ImapProtocol::close()
     _name = "";
     if (transport)
         transport->close();
-    d->reset();
-    newMessage = true;
+    resetParser();
 }
 
 bool ImapProtocol::connected() const
@@ -243,6 +323,11 @@ QString ImapProtocol:: mailboxUid()
     return _mailboxUid;
 }
 
+QString ImapProtocol::uidValidity()
+{
+    return _uidValidity;
+}
+
 QString ImapProtocol::flags()
 {
     return _flags;
@@ -258,6 +343,35 @@ QString ImapProtocol::selected()
     return _name;
 }
 
+quint64 ImapProtocol::highestModSeq()
+{
+    return _highestModSeq;
+}
+
+QStringList ImapProtocol::vanishedUids(const QStringList &candidates)
+{
+    QStringList result;
+
+    if (!_vanished.isEmpty()) {
+        foreach (const QString &candidate, candidates) {
+            uint value = messageId(candidate).toUInt();
+            foreach (const QString &set, _vanished) {
+                if (inSequenceSet(set, value)) {
+                    result.append(candidate);
+                    break;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+QMap<QString, MessageFlags> ImapProtocol::changedFlags()
+{
+    return _changes;
+}
+
 void ImapProtocol::capability()
 {
     status = IMAP_Capability;
@@ -297,17 +411,36 @@ void ImapProtocol::idleDone()
     qLog(IMAP) << "SEND:" << "DONE";
 }
 
+void ImapProtocol::enable( const QString &extension )
+{
+    status = IMAP_Enable;
+    sendCommand( "ENABLE " + extension );
+}
+
 void ImapProtocol::list( QString reference, QString mailbox )
 {
     status = IMAP_List;
     sendCommand( "LIST " + quoteImapString(reference) + " " + quoteImapString(mailbox) );
 }
 
-void ImapProtocol::select( QString mailbox )
+/*  If QRESYNC is enabled and the mailbox state at modification sequence \a modSeq is
+    known, the server reports the changes since that state in the SELECT response */
+void ImapProtocol::select( QString mailbox, const QString &uidValidity, quint64 modSeq )
 {
     status = IMAP_Select;
     _name = mailbox;
-    sendCommand( "SELECT " + quoteImapString(mailbox) );
+    _highestModSeq = 0;
+    _vanished.clear();
+    _changes.clear();
+
+    QString cmd( "SELECT " + quoteImapString(mailbox) );
+    if (isEnabled("QRESYNC") && !uidValidity.isEmpty() && (modSeq != 0)) {
+        cmd += QString(" (QRESYNC (%1 %2))").arg(uidValidity).arg(modSeq);
+    } else if (supportsCapability("CONDSTORE") || isEnabled("QRESYNC")) {
+        cmd += " (CONDSTORE)";
+    }
+
+    sendCommand( cmd );
 }
 
 void ImapProtocol::uidSearch( MessageFlags flags, const QString &range)
@@ -340,7 +473,10 @@ void ImapProtocol::uidSearch( MessageFlags flags, const QString &range)
     sendCommand( QString("UID SEARCH %1%2").arg( range ).arg( str ) );
 }
 
-void ImapProtocol::uidFetch( FetchItemFlags items, const QString &range)
+/*  The range may be a set of UIDs; each message is reported by messageFetched() as
+    soon as its data has been received.  If \a changedSince is non-zero, only messages
+    modified after that modification sequence are reported (requires CONDSTORE) */
+void ImapProtocol::uidFetch( FetchItemFlags items, const QString &range, quint64 changedSince )
 {
     dataItems = items;
 
@@ -351,22 +487,16 @@ void ImapProtocol::uidFetch( FetchItemFlags items, const QString &range)
         flags += " RFC822.SIZE";
     if (dataItems & F_Rfc822_Header)
         flags += " RFC822.HEADER";
-    if (dataItems & F_Rfc822) {
+    if (dataItems & F_Rfc822)
         flags += " BODY.PEEK[]";
-
-        int index = range.indexOf(':');
-        if (index != -1) {
-            fetchUid = range.left(index);
-        } else {
-            fetchUid = range;
-        }
-    }
-
     flags += ")";
 
+    if (changedSince != 0)
+        flags += QString(" (CHANGEDSINCE %1)").arg(changedSince);
+
+    _changes.clear();
     messageLength = 0;
     status = IMAP_UIDFetch;
-    firstParseFetch = true;
     sendCommand( QString( "UID FETCH %1 %2" ).arg( range ).arg( flags ) );
 }
 
@@ -427,71 +557,149 @@ void ImapProtocol::sendCommand( QString cmd )
     QString command = newCommandId() + " " + cmd;
 
     request = command;
-    d->reset();
-    newMessage = true;
+    untaggedResponses.clear();
 
     transport->stream() << command << "\r\n" << flush;
     qLog(IMAP) << "SEND:" << qPrintable(command);
 }
 
+void ImapProtocol::resetParser()
+{
+    responseData.clear();
+    untaggedResponses.clear();
+    literalRemaining = 0;
+    literalUid = QString();
+
+    if (literalFile) {
+        QString fileName(literalFile->fileName());
+        delete literalFile;
+        literalFile = 0;
+        QFile::remove(fileName);
+    }
+    if (!literalFileName.isEmpty()) {
+        QFile::remove(literalFileName);
+        literalFileName = QString();
+    }
+}
+
+void ImapProtocol::fileSystemFull()
+{
+    resetParser();
+
+    operationState = OpFailed;
+    _lastError += LongStream::errorMessage( "\n" );
+    status = IMAP_Full;
+    emit finished(status, operationState);
+}
+
+bool ImapProtocol::beginLiteral(int length)
+{
+    literalRemaining = length;
+
+    if (isMessageData(responseData)) {
+        // Message data is written directly to the file that will become the message body
+        if (!LongStream::freeSpace(QString(), length + 102400)) {
+            fileSystemFull();
+            return false;
+        }
+
+        if (!literalFileName.isEmpty())
+            QFile::remove(literalFileName);
+
+        literalFile = new QTemporaryFile(LongStream::tempDir() + QLatin1String("/qtopiamail.XXXXXX"));
+        literalFile->setAutoRemove(false);
+        if (!literalFile->open()) {
+            fileSystemFull();
+            return false;
+        }
+        literalFile->setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+
+        // Servers report the UID ahead of the message data, when it is requested
+        QByteArray value;
+        if (fetchItem(responseData.toUpper(), "UID", &value))
+            literalUid = messageUid(_name, QString(value));
+
+        messageLength = 0;
+        responseData.append("NIL");
+    } else {
+        // Other literals are retained in the response as quoted strings
+        responseData.append('"');
+    }
+
+    if (literalRemaining == 0)
+        endLiteral();
+
+    return true;
+}
+
+void ImapProtocol::endLiteral()
+{
+    if (literalFile) {
+        literalFileName = literalFile->fileName();
+        literalFile->close();
+        delete literalFile;
+        literalFile = 0;
+
+        emit downloadSize(literalUid, messageLength);
+    } else {
+        responseData.append('"');
+    }
+}
+
 void ImapProtocol::incomingData()
 {
     int readLines = 0;
-    while (transport->canReadLine()) {
-        response = transport->readLine();
-        readLines++;
-        read += response.length();
-
-        if (response.length() > 1)
-            qLog(IMAP) << "RECV:" << qPrintable(response.left(response.length() - 2));
-
-        if (status == IMAP_Idle || status == IMAP_Idle_Done) {
-            emit finished(status, operationState);
-            response = "";
-            read = 0;
-            return;
-        }
-        if (status != IMAP_Init) {
-            if (status == IMAP_UIDFetch && newMessage) {
-                QString str = response;
-                QRegExp fetchResponsePattern("\\*\\s+\\d+\\s+(\\w+)");
-                if (fetchResponsePattern.indexIn(str) == 0) {
-                    if (fetchResponsePattern.cap(1).compare("FETCH", Qt::CaseInsensitive) == 0) {
-                        newMessage = false;
-                        newMsgUid = extractUid(str, _name);
-                        newMsgSize = extractSize(str);
-                        newMsgFlags = 0;
-                        newMsgFlagsParsed = parseFlags(str, newMsgFlags);
-                        d->reset();
-                    }
-                } else if (str.toUpper().startsWith("* NO")) {
-                    newMessage = false;
-                    fetchAllFailed = true;
-                    fetchAllFailMsg = str;
-                } else {
-                    nonExistentMsg = true;
-                    nonExistentMsgStr = messageUid(_name, fetchUid);
+    while (transport->inUse()) {
+        if (literalRemaining > 0) {
+            // Literal data is consumed without regard to line structure
+            qint64 available = transport->bytesAvailable();
+            if (available <= 0)
+                break;
+
+            QByteArray data = transport->read(qMin<qint64>(qMin<qint64>(available, literalRemaining), MAX_READ));
+            literalRemaining -= data.length();
+            readLines++;
+
+            if (literalFile) {
+                if (literalFile->write(data) != data.length()) {
+                    fileSystemFull();
+                    return;
                 }
+
+                messageLength += data.length();
+                if (readLines > MAX_LINES)
+                    emit downloadSize(literalUid, messageLength);
             } else {
-                d->append( response );
-            }
-            if (d->status() == LongStream::OutOfSpace) {
-                operationState = OpFailed;
-                _lastError += LongStream::errorMessage( "\n" );
-                status = IMAP_Full;
-                emit finished(status, operationState);
-                response = "";
-                read = 0;
-                return;
+                data.replace('\\', "\\\\");
+                data.replace('"', "\\\"");
+                responseData.append(data);
             }
-        }
 
-        if ((status == IMAP_UIDFetch) && (dataItems & F_Rfc822)) {
-            if (!response.startsWith("* "))
-                messageLength += response.length();
+            if (literalRemaining == 0)
+                endLiteral();
+        } else {
+            if (!transport->canReadLine())
+                break;
+
+            QByteArray line = transport->readLine();
+            readLines++;
 
-            if (readLines > MAX_LINES)
-                emit downloadSize(messageLength);
+            if (line.length() > 2)
+                qLog(IMAP) << "RECV:" << qPrintable(QString(line.left(line.length() - 2)));
+
+            int length = literalLength(line);
+            if (length != -1) {
+                // The response continues after the literal
+                responseData.append(line.left(line.lastIndexOf('{')));
+                if (!beginLiteral(length))
+                    return;
+            } else {
+                responseData.append(line);
+
+                QByteArray data(responseData);
+                responseData.clear();
+                processResponse(data);
+            }
         }
 
         if (readLines > MAX_LINES) {
@@ -501,15 +709,41 @@ void ImapProtocol::incomingData()
     }
 
     incomingDataTimer.stop();
+}
 
-    nextAction();
+void ImapProtocol::processResponse(const QByteArray &data)
+{
+    if (status == IMAP_Idle || status == IMAP_Idle_Done) {
+        emit finished(status, operationState);
+        return;
+    }
+
+    if (status == IMAP_Init) {
+        // The server greeting
+        response = QString::fromAscii(data);
+        nextAction();
+        return;
+    }
+
+    if (data.startsWith("* ")) {
+        if (isFetchResponse(data)) {
+            parseFetch(data);
+        } else {
+            if (data.startsWith("* NO"))
+                qLog(IMAP) << qPrintable("untagged failure: " + QString::fromAscii(data).trimmed());
+
+            untaggedResponses.append(QString::fromAscii(data));
+        }
+    } else if (!data.startsWith("+")) {
+        response = QString::fromAscii(data);
+        nextAction();
+    }
 }
 
 void ImapProtocol::operationCompleted(ImapCommand &status, OperationState &operationState)
 {
     emit finished(status, operationState);
     response = "";
-    read = 0;
 }
 
 void ImapProtocol::nextAction()
@@ -522,21 +756,16 @@ void ImapProtocol::nextAction()
 
     if (status == IMAP_Logout) {
         transport->close();
-        d->reset();
-        newMessage = true;
+        resetParser();
         _name = "";
         operationState = OpOk;
         operationCompleted(status, operationState);
         return;
     }
 
-    if ((status == IMAP_UIDFetch) && (dataItems & F_Rfc822))
-        emit downloadSize( messageLength );
-
     /* Applies to all functions below   */
     if (!response.startsWith( commandId( request ))) {
         response = "";
-        read = 0;
 
         /* TODO - what's going on here?
         QString msg("Protocol error - unhandled server response.");
@@ -570,7 +799,6 @@ void ImapProtocol::nextAction()
         transport->switchToEncrypted();
 #endif
         response = "";
-        read = 0;
         return;
     }
 
@@ -579,8 +807,15 @@ void ImapProtocol::nextAction()
         return;
     }
 
+    if (status == IMAP_Enable) {
+        parseEnabled();
+
+        operationCompleted(status, operationState);
+        return;
+    }
+
     if (status == IMAP_List) {
-        for (QString str = d->first(); str != QString::null; str = d->next()) {
+        foreach (const QString &str, untaggedResponses) {
             if (str.startsWith("* LIST"))
                 parseList( str.mid(7) );
         }
@@ -604,18 +839,8 @@ void ImapProtocol::nextAction()
     }
 
     if (status == IMAP_UIDFetch) {
-        //temporary for now
-        bool parsedInput = false;
-        if (dataItems & F_Rfc822_Header) {
-            parsedInput = parseFetch();
-        } else {
-            parsedInput = parseFetchAll();
-        }
-        
-        if (parsedInput)
-            operationCompleted(status, operationState);
-
-        fetchUid = QString();
+        // Fetched messages have already been reported as their responses completed
+        operationCompleted(status, operationState);
         return;
     }
 
@@ -630,7 +855,6 @@ void ImapProtocol::nextAction()
     }
 
     response = "";
-    read = 0;
 }
 
 QString ImapProtocol::newCommandId()
@@ -705,27 +929,48 @@ void ImapProtocol::parseList( QString in )
 
 void ImapProtocol::parseCapability()
 {
-    for (QString str = d->first(); str != QString::null; str = d->next()) {
+    foreach (const QString &str, untaggedResponses) {
         if (str.startsWith("* CAPABILITY")) {
             _capabilities = str.mid(12).trimmed().split(" ", QString::SkipEmptyParts);
         }
     }
 }
 
+void ImapProtocol::parseEnabled()
+{
+    foreach (const QString &str, untaggedResponses) {
+        if (str.startsWith("* ENABLED")) {
+            _enabled += str.mid(9).trimmed().toUpper().split(" ", QString::SkipEmptyParts);
+        }
+    }
+}
+
 void ImapProtocol::parseSelect()
 {
     int start;
     bool result;
-    QString str, temp;
+    QString temp;
 
     // reset all attributes in case some are not reported
     _exists = 0;
     _recent = 0;
     _flags = "";
     _mailboxUid = "";
-    for (str = d->first(); str != QString::null; str = d->next()) {
-
-        if (str.indexOf("EXISTS", 0) != -1) {
+    _uidValidity = "";
+    foreach (const QString &str, untaggedResponses) {
+        if (str.startsWith("* VANISHED")) {
+            // Reported in response to a QRESYNC select
+            temp = str.mid(10).trimmed();
+            if (temp.startsWith("(EARLIER)", Qt::CaseInsensitive))
+                temp = temp.mid(9).trimmed();
+            _vanished.append(temp);
+        } else if (str.indexOf("[HIGHESTMODSEQ ", 0) != -1) {
+            start = 0;
+            temp = token( str, '[', ']', &start );
+            _highestModSeq = temp.mid( 14 ).trimmed().toULongLong();
+        } else if (str.indexOf("[NOMODSEQ]", 0) != -1) {
+            _highestModSeq = 0;
+        } else if (str.indexOf("EXISTS", 0) != -1) {
             start = 0;
             temp = token(str, ' ', ' ', &start);
             _exists =  temp.toInt(&result);
@@ -743,157 +988,53 @@ void ImapProtocol::parseSelect()
         } else if (str.indexOf("UIDVALIDITY", 0) != -1) {
             start = 0;
             temp = token( str, '[', ']', &start );
-            _mailboxUid = messageUid(_name, temp.mid( 12 ));
+            _uidValidity = temp.mid( 12 ).trimmed();
+            _mailboxUid = messageUid(_name, _uidValidity);
         }
     }
 }
 
-bool ImapProtocol::parseFetch()
+void ImapProtocol::parseFetch(const QByteArray &data)
 {
-    static const QByteArray crlfSequence( QMailMessage::CRLF );
-    static const QByteArray headerTerminator( crlfSequence + crlfSequence );
-    static const QByteArray popTerminator( crlfSequence + '.' + crlfSequence );
-
-    if (fetchAllFailed) {
-        qLog(IMAP) << qPrintable("fetch all failed: " + fetchAllFailMsg);
-        fetchAllFailed = false;
-        nonExistentMsg = false;
-        return false;
-    }
-    
-    QString str;
-    if (firstParseFetch) {
-        firstParseFetch = false;
-        str = d->first();
-    } else {
-        str = d->current();
+    // Any message data has been diverted to a file, so the response is small
+    QByteArray items(data.toUpper());
+    QByteArray value;
+
+    QString uid(literalUid);
+    if (fetchItem(items, "UID", &value))
+        uid = messageUid(_name, QString(value));
+
+    uint size = 0;
+    if (fetchItem(items, "RFC822.SIZE", &value))
+        size = value.toUInt();
+
+    MessageFlags flags = 0;
+    bool flagsParsed = fetchItem(items, "FLAGS", &value);
+    if (flagsParsed)
+        flags = parseFlags(value);
+
+    if (!literalFileName.isEmpty()) {
+        QString fileName(literalFileName);
+        literalFileName = QString();
+        literalUid = QString();
+
+        if (size == 0)
+            size = QFileInfo(fileName).size();
+
+        createMail( uid, size, flags, fileName );
+    } else if (!uid.isEmpty() && flagsParsed) {
+        // A flag change reported by a CHANGEDSINCE fetch or a QRESYNC select
+        _changes.insert(uid, flags);
     }
-
-    bool moreData(false);
-    do {
-        moreData = false;
-
-        if (str == QString::null) {
-            // We have exhausted the input
-            return true;
-        } else {
-            MessageFlags flags = newMsgFlags;
-            bool flagsParsed = newMsgFlagsParsed;
-            QString msg;
-
-            while (!str.startsWith("* ") && str != QString::null) {
-                msg += str;
-                str = d->next();
-            }
-
-            int endMsg = msg.indexOf( headerTerminator );
-            if (endMsg != -1) {
-                if (!flagsParsed) {
-                    // See if the flags are trailing the header
-                    QString trailer = msg.mid(endMsg + 2);
-                    flagsParsed = parseFlags(trailer, flags);
-                }
-
-                msg.truncate(endMsg);
-            }
-            msg.truncate(newMsgSize);
-
-            //to work with pop standard
-            endMsg = msg.indexOf( popTerminator, -popTerminator.length() );
-            if (endMsg == -1)
-                msg.append( popTerminator );
-
-            createMail( newMsgUid, newMsgSize, flags );
-            return true;
-        }
-    } while (moreData);
-
-    return false;
-}
-
-bool ImapProtocol::parseFetchAll()
-{
-    QString str;
-    
-    if (fetchAllFailed) {
-        qLog(IMAP) << qPrintable("fetch all failed: " + fetchAllFailMsg);
-        fetchAllFailed = false;
-        nonExistentMsg = false;
-        return false;
-    }
-    if (nonExistentMsg) {
-        emit nonexistentMessage(nonExistentMsgStr, Client::Removed);
-        fetchAllFailed = false;
-        nonExistentMsg = false;
-        return true;
-    }
-    
-    if (firstParseFetch) {
-        firstParseFetch = false;
-        str = d->first();
-    } else {
-        str = d->current();
-    }
-
-    bool moreData(false);
-    do {
-        moreData = false;
-
-        if (str == QString::null) {
-            // We have exhausted the input
-            return true;
-        } else {
-            uint msgSize = newMsgSize;
-            MessageFlags flags = newMsgFlags;
-            bool flagsParsed = newMsgFlagsParsed;
-            QString msg;
-
-            // Read the body data from the file
-            LongString ls(d->fileName());
-                    
-            const QByteArray& orgData(ls.toQByteArray());
-            uint remainder(orgData.length());
-            if (msgSize)
-                remainder = qMin(msgSize, (uint)orgData.length());
-
-            QByteArray trailer;
-            if (msgSize == 0) {
-                // Find the trailing part of the imap server traffic
-                trailer = QByteArray( (QByteArray( QMailMessage::CRLF ) + ')' + QMailMessage::CRLF) );
-                int pos = orgData.lastIndexOf(trailer);
-                if ((pos != -1) && (pos < (int)remainder)) {
-                    // Leave the terminating CRLF
-                    trailer = orgData.mid(pos + 2);
-                    QFile::resize(d->fileName(), pos + 2);
-                    msgSize = pos + 2;
-                } else {
-                    msgSize = orgData.length();
-                }
-            } else {
-                trailer = QByteArray(orgData.constData() + remainder, orgData.length() - remainder);
-                QFile::resize(d->fileName(), msgSize);
-            }
-
-            if (!flagsParsed) {
-                // See if the flags follow the message data
-                flagsParsed = parseFlags(QString(trailer), flags);
-            }
-
-            createMail( newMsgUid, msgSize, flags );
-            return true;
-        }
-    } while (moreData);
-
-    return false;
 }
 
 void ImapProtocol::parseUid()
 {
     int index;
-    QString str, temp;
+    QString temp;
 
     uidList.clear();
-    for (str = d->first(); str != QString::null; str = d->next()) {
+    foreach (const QString &str, untaggedResponses) {
         if (str.startsWith("* SEARCH")) {
             index = 7;
             while ((temp = token( str, ' ', ' ', &index )) != QString::null) {
@@ -955,15 +1096,46 @@ QString ImapProtocol::uidRange( const QString &from, const QString &to )
     return messageId(from) + ':' + messageId(to);
 }
 
+QString ImapProtocol::uidSet( const QStringList &identifiers )
+{
+    QList<uint> values;
+    foreach (const QString &identifier, identifiers)
+        values.append(messageId(identifier).toUInt());
+
+    qSort(values);
+
+    // Describe runs of consecutive UIDs as ranges
+    QStringList ranges;
+    int i = 0;
+    while (i < values.count()) {
+        int j = i;
+        while ((j + 1 < values.count()) && (values.at(j + 1) <= values.at(j) + 1))
+            ++j;
+
+        if (values.at(i) == values.at(j))
+            ranges.append(sequence(values.at(i)));
+        else
+            ranges.append(sequenceRange(values.at(i), values.at(j)));
+
+        i = j + 1;
+    }
+
+    return ranges.join(",");
+}
+
 bool ImapProtocol::supportsCapability(const QString& name) const
 {
     return _capabilities.contains(name);
 }
 
-void ImapProtocol::createMail( QString& id, int size, uint flags )
+bool ImapProtocol::isEnabled(const QString& name) const
+{
+    return _enabled.contains(name.toUpper());
+}
+
+void ImapProtocol::createMail( const QString& id, int size, uint flags, const QString &fileName )
 {
-    QString detachedFile = d->detach();
-    QMailMessage mail = QMailMessage::fromRfc2822File( detachedFile );
+    QMailMessage mail = QMailMessage::fromRfc2822File( fileName );
 
     if (flags & MFlag_Seen)
         mail.setStatus( QMailMessage::ReadElsewhere, true );
@@ -973,10 +1145,9 @@ void ImapProtocol::createMail( QString& id, int size, uint flags )
     mail.setSize( size );
     mail.setServerUid( id.trimmed() );
     mail.setMessageType( QMailMessage::Email );
-    mail.setHeaderField( "X-qtopia-internal-filename", detachedFile );
+    mail.setHeaderField( "X-qtopia-internal-filename", fileName );
 
     emit messageFetched(mail);
     // Catch all cleanup of detached file
-    QFile::remove(detachedFile);
+    QFile::remove(fileName);
 }
-
@@ -23,6 +23,7 @@
 #include "client.h"
 
 #include <qobject.h>
+#include <qmap.h>
 #include <qstring.h>
 #include <qstringlist.h>
 #include <qtimer.h>
@@ -36,6 +37,7 @@ enum ImapCommand
     IMAP_Idle_Continuation,
     IMAP_StartTLS,
     IMAP_Login,
+    IMAP_Enable,
     IMAP_Logout,
     IMAP_List,
     IMAP_Select,
@@ -82,9 +84,9 @@ enum OperationState
     OpBad
 };
 
-class LongStream;
 class Email;
 class ImapTransport;
+class QTemporaryFile;
 
 class ImapProtocol: public QObject
 {
@@ -106,12 +108,13 @@ public:
     void login(QString user, QString password);
 
     /* Valid in authenticated state only    */
+    void enable(const QString &extension);
     void list(QString reference, QString mailbox);
-    void select(QString mailbox);
+    void select(QString mailbox, const QString &uidValidity = QString(), quint64 modSeq = 0);
 
     /*  Valid in Selected state only */
     void uidSearch(MessageFlags flags, const QString &range = QString());
-    void uidFetch(FetchItemFlags items, const QString &range);
+    void uidFetch(FetchItemFlags items, const QString &range, quint64 changedSince = 0);
     void uidStore(MessageFlags flags, const QString &range);
     void expunge();
     void idle();
@@ -122,9 +125,15 @@ public:
     int exists();
     int recent();
     QString mailboxUid();
+    QString uidValidity();
     QString flags();
     QStringList mailboxUidList();
 
+    /*  Mailbox changes reported by CONDSTORE/QRESYNC (stored from selected mailbox)    */
+    quint64 highestModSeq();
+    QStringList vanishedUids(const QStringList &candidates);
+    QMap<QString, MessageFlags> changedFlags();
+
     /*  Valid in all states */
     void logout();
 
@@ -133,18 +142,21 @@ public:
     /* Query whether a capability is supported */
     bool supportsCapability(const QString& name) const;
 
+    /* Query whether an extension has been enabled */
+    bool isEnabled(const QString& name) const;
+
     static QString token(QString str, QChar c1, QChar c2, int *index);
 
     static QString sequence(uint identifier);
     static QString uid(const QString &identifier);
     static QString sequenceRange(uint from, uint to);
     static QString uidRange(const QString &from, const QString &to);
+    static QString uidSet(const QStringList &identifiers);
 
 signals:
     void mailboxListed(QString &flags, QString &delimiter, QString &name);
     void messageFetched(QMailMessage& mail);
-    void downloadSize(int);
-    void nonexistentMessage(const QString& uid, Client::DefunctReason);
+    void downloadSize(const QString& uid, int);
 
     void finished(ImapCommand &, OperationState &);
     void updateStatus(const QString &);
@@ -164,55 +176,58 @@ private:
     OperationState commandResponse(QString in);
     void sendCommand(QString cmd);
 
+    bool beginLiteral(int length);
+    void endLiteral();
+    void processResponse(const QByteArray &data);
+    void resetParser();
+    void fileSystemFull();
+
     void parseCapability();
+    void parseEnabled();
     void parseSelect();
-    bool parseFetch();
-    bool parseFetchAll();
+    void parseFetch(const QByteArray &data);
     void parseUid();
-    void parseChange();
     void parseList(QString in);
 
-    void createMail( QString& uid, int size, uint flags);
+    void createMail(const QString& uid, int size, uint flags, const QString &fileName);
 
 private:
     ImapTransport *transport;
 
     ImapCommand status;
     OperationState operationState;
-    MessageFlags messageFlags;
     FetchItemFlags dataItems;
 
     /*  Associated with the Mailbox */
     QString _name;
     int _exists, _recent;
-    QString _flags, _mailboxUid;
+    QString _flags, _mailboxUid, _uidValidity;
     QStringList uidList;
+    quint64 _highestModSeq;
+    QStringList _vanished;
+    QMap<QString, MessageFlags> _changes;
 
     QString request;
     QStringList errorList;
-    LongStream *d;
+    QStringList untaggedResponses;
     int requestCount, internalId;
     int messageLength;
 
     QString _lastError;
     QString response;
-    int read;
     QTimer incomingDataTimer;
-    bool firstParseFetch;
-    QString fetchUid;
     QStringList _capabilities;
+    QStringList _enabled;
 
-    bool newMessage;
-    QString newMsgUid;
-    uint newMsgSize;
-    MessageFlags newMsgFlags;
-    bool newMsgFlagsParsed;
-    bool fetchAllFailed;
-    QString fetchAllFailMsg;
-    bool nonExistentMsg;
-    QString nonExistentMsgStr;
+    /*  Streaming response parser state */
+    QByteArray responseData;
+    qint64 literalRemaining;
+    QTemporaryFile *literalFile;
+    QString literalFileName;
+    QString literalUid;
 
     static const int MAX_LINES = 30;
+    static const int MAX_READ = 16384;
 };
 
 #endif
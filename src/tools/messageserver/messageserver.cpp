@@ -72,9 +72,10 @@ static QMailFolderId serverFolderId()
 }
 
 
-MessageServer::MessageSearch::MessageSearch(const QMailMessageIdList &ids, const QString &text)
+MessageServer::MessageSearch::MessageSearch(const QMailMessageIdList &ids, const QString &text, bool verify)
     : _ids(ids), 
       _text(text),
+      _verify(verify),
       _active(false),
       _total(ids.count()),
       _progress(0)
@@ -86,6 +87,11 @@ const QString &MessageServer::MessageSearch::bodyText() const
     return _text;
 }
 
+bool MessageServer::MessageSearch::requiresVerification() const
+{
+    return _verify;
+}
+
 bool MessageServer::MessageSearch::pending() const
 {
     return !_active;
@@ -117,7 +123,7 @@ QMailMessageIdList MessageServer::MessageSearch::takeBatch()
     static const int BatchSize = 10;
 
     QMailMessageIdList result;
-    if (_ids.count() <= BatchSize) {
+    if (!_verify || (_ids.count() <= BatchSize)) {
         result = _ids;
         _ids.clear();
     } else {
@@ -135,7 +141,8 @@ MessageServer::MessageServer(QObject *parent)
       handler(new EmailHandler(this)),
       client(new MailMessageClient(this)),
       unacknowledgedFlashSms(0),
-      intervalCheckRetrievalInProgress(false),
+      userRetrievalFoldersOnly(false),
+      backgroundRetrievalPerformed(false),
       roamingMode("/Telephony/Status/Roaming"),
       messageCountUpdate("QPE/Messages/MessageCountUpdated"),
       telephonyValueSpace("/Telephony/Status"),
@@ -162,6 +169,10 @@ MessageServer::MessageServer(QObject *parent)
         // Ensure we have a folder to use
         QMailFolderId folderId(serverFolderId());
 
+        // Index the bodies of messages stored before the body index existed
+        if (!store->isBodyIndexComplete())
+            QTimer::singleShot(0, this, SLOT(continueBodyIndex()));
+
         connect(store, SIGNAL(accountsAdded(QMailAccountIdList)),
                 this, SLOT(initIntervalChecking()));
         connect(store, SIGNAL(accountsRemoved(QMailAccountIdList)),
@@ -175,12 +186,12 @@ MessageServer::MessageServer(QObject *parent)
                 this, SLOT(messagesRemoved(QMailMessageIdList)));
         
         // Propagate email handler signals to the client
-        connect(handler, SIGNAL(statusChanged(QMailMessageServer::Operation,QString,QString)),
-                this, SLOT(statusChanged(QMailMessageServer::Operation,QString,QString)));
-        connect(handler, SIGNAL(retrievalTotal(uint)),
-                this, SLOT(retrievalTotal(uint)));
-        connect(handler, SIGNAL(retrievalProgress(uint)),
-                this, SLOT(retrievalProgress(uint)));
+        connect(handler, SIGNAL(statusChanged(QMailAccountId,QMailMessageServer::Operation,QString,QString)),
+                this, SLOT(statusChanged(QMailAccountId,QMailMessageServer::Operation,QString,QString)));
+        connect(handler, SIGNAL(retrievalTotal(QMailAccountId,uint)),
+                this, SLOT(retrievalTotal(QMailAccountId,uint)));
+        connect(handler, SIGNAL(retrievalProgress(QMailAccountId,uint)),
+                this, SLOT(retrievalProgress(QMailAccountId,uint)));
         connect(handler, SIGNAL(sendTotal(uint)),
                 client, SIGNAL(sendTotal(uint)));
         connect(handler, SIGNAL(sendProgress(uint)),
@@ -199,10 +210,10 @@ MessageServer::MessageServer(QObject *parent)
                 this, SLOT(partialMessageRetrieved(QMailMessageMetaData&)));
         connect(handler, SIGNAL(messageRetrieved(QMailMessage&)),
                 this, SLOT(messageRetrieved(QMailMessage&)));
-        connect(handler, SIGNAL(partialRetrievalCompleted()),
-                this, SLOT(partialRetrievalCompleted()));
-        connect(handler, SIGNAL(retrievalCompleted()),
-                this, SLOT(retrievalCompleted()));
+        connect(handler, SIGNAL(partialRetrievalCompleted(QMailAccountId)),
+                this, SLOT(partialRetrievalCompleted(QMailAccountId)));
+        connect(handler, SIGNAL(retrievalCompleted(QMailAccountId)),
+                this, SLOT(retrievalCompleted(QMailAccountId)));
         connect(handler, SIGNAL(newMailDiscovered(QMailAccountId)),
                 this, SLOT(newMailDiscovered(QMailAccountId)));
         connect(handler, SIGNAL(simReady(bool)),
@@ -212,9 +223,9 @@ MessageServer::MessageServer(QObject *parent)
         connect(client, SIGNAL(send(QMailMessageIdList)),
                 handler, SLOT(send(QMailMessageIdList)));
         connect(client, SIGNAL(retrieve(QMailAccountId, bool)),
-                handler, SLOT(retrieve(QMailAccountId, bool)));
+                this, SLOT(retrieve(QMailAccountId, bool)));
         connect(client, SIGNAL(completeRetrieval(QMailMessageIdList)),
-                handler, SLOT(completeRetrieval(QMailMessageIdList)));
+                this, SLOT(completeRetrieval(QMailMessageIdList)));
         connect(client, SIGNAL(cancelTransfer()),
                 handler, SLOT(cancelTransfer()));
         connect(client, SIGNAL(cancelSearch()),
@@ -235,6 +246,12 @@ MessageServer::MessageServer(QObject *parent)
 #endif
 #endif
 
+        // Retrievals are started by the scheduler
+        connect(&scheduler, SIGNAL(synchronize(QMailAccountId,SyncScheduler::Priority)),
+                this, SLOT(synchronize(QMailAccountId,SyncScheduler::Priority)));
+        connect(&scheduler, SIGNAL(idle()),
+                this, SLOT(synchronizationIdle()));
+
         netState = new QNetworkState(this);
         connect(netState, SIGNAL(connected()),
                 this, SLOT(initIntervalChecking()));
@@ -256,11 +273,11 @@ MessageServer::~MessageServer()
 void MessageServer::initIntervalChecking()
 {
     QMailAccountIdList accountIds = QMailStore::instance()->queryAccounts();
-    bool pushAccountsExist = false;
 
     //Remove deleted accounts
     foreach(QTimer *timer, intervalCheckMap.keys())
         if (!accountIds.contains(intervalCheckMap[timer])) {
+            scheduler.unschedule(intervalCheckMap[timer]);
             intervalCheckMap.remove(timer);
             delete timer;
         }
@@ -272,10 +289,8 @@ void MessageServer::initIntervalChecking()
 
         QTimer *timer = intervalCheckMap.key(id);
         if (config.pushEnabled()) {
-            if (!intervalAccountIds.contains(id)) {
-                intervalAccountIds.insert(id);
-                pushAccountsExist = true;
-            }
+            //kick off mail checking for push accounts
+            scheduler.schedule(id, SyncScheduler::NewMailNotification);
         }
         if (checkInterval <= 0) {
             if (timer)
@@ -292,89 +307,108 @@ void MessageServer::initIntervalChecking()
             timer->start();
         }
     }
-    if (pushAccountsExist) //kick off mail checking for push accounts
-        QTimer::singleShot(0, this, SLOT(intervalCheckTimeout()));
 }
 
 void MessageServer::newMailDiscovered(const QMailAccountId &accountId)
 {
-    if (!intervalAccountIds.contains(accountId))
-        intervalAccountIds.insert(accountId);
-    intervalCheckTimeout();
+    scheduler.schedule(accountId, SyncScheduler::NewMailNotification);
 }
 
 void MessageServer::intervalCheckTimeout()
 {
-    if (sender()) {
-        if (QTimer *timer = qobject_cast<QTimer*>(sender())) {
-            QMailAccountId id = intervalCheckMap[timer];
-            if (id.isValid()) {
-                if (!intervalAccountIds.contains(id)) {
-                    intervalAccountIds.insert(id);
-                } else {
-                    // Something is wrong, if we haven't completed our previous check!
-                    qLog(Messaging) << "Account" << id << "already waiting for interval check!";
-                }
-            }
-        }
+    if (QTimer *timer = qobject_cast<QTimer*>(sender())) {
+        QMailAccountId id = intervalCheckMap[timer];
+        if (id.isValid())
+            scheduler.schedule(id, SyncScheduler::IntervalCheck);
+    }
+}
+
+void MessageServer::retrieve(const QMailAccountId &accountId, bool foldersOnly)
+{
+    if (userRetrievalAccountId.isValid() || scheduler.isPending(accountId)) {
+        qLog(Messaging) << "Unable to initiate retrieval while retrieval is in progress";
+        return;
     }
 
-    if (!intervalAccountIds.isEmpty()) {
-        if (!handler->retrievalInProgress()) {
-            QMailAccountId accountId = *intervalAccountIds.begin();
-            intervalAccountIds.remove(accountId);
+    // Start ahead of any background retrievals, once any current retrieval for this account completes
+    userRetrievalFoldersOnly = foldersOnly;
+    scheduler.schedule(accountId, SyncScheduler::UserRequest);
+}
 
-            AccountConfiguration config(accountId);
-            if (roamingMode.value().toBool() && !config.intervalCheckRoamingEnabled())
-                return;
+void MessageServer::completeRetrieval(const QMailMessageIdList &mailList)
+{
+    if (userRetrievalAccountId.isValid()) {
+        bool retrieving(handler->retrievalInProgress(userRetrievalAccountId));
 
-            connect(handler, SIGNAL(errorOccurred(QMailAccountId,QString,int)),
-                    this, SLOT(intervalCheckingErrorOccurred(QMailAccountId,QString,int)));
-            connect(handler, SIGNAL(retrievalCompleted()),
-                    this, SLOT(intervalCheckingRetrievalComplete()));
+        handler->completeRetrieval(userRetrievalAccountId, mailList);
 
-            qLog(Messaging) << "Performing interval check for account " 
-                            << accountId 
-                            << " name "
-                            << QMailAccount(accountId).displayName();
-            intervalCheckRetrievalInProgress = true;
-            handler->retrieve(accountId, false, true);
+        if (!retrieving && !handler->retrievalInProgress(userRetrievalAccountId)) {
+            // The connection is already closed; no further events will be reported
+            scheduler.completed(userRetrievalAccountId);
+            userRetrievalAccountId = QMailAccountId();
         }
+    } else if (!mailList.isEmpty()) {
+        // No retrieval precedes this request; retrieve the messages from their account
+        QMailAccountId accountId(QMailMessageMetaData(mailList.first()).parentAccountId());
+        if (!accountId.isValid() || !userCompletionIds.isEmpty()) {
+            qLog(Messaging) << "Unable to complete retrieval for account:" << accountId;
+            return;
+        }
+
+        userCompletionIds = mailList;
+        scheduler.schedule(accountId, SyncScheduler::UserRequest);
     }
 }
 
-void MessageServer::intervalCheckingErrorOccurred(const QMailAccountId &id, const QString &txt, int code)
+void MessageServer::synchronize(const QMailAccountId &accountId, SyncScheduler::Priority priority)
 {
-    disconnect(handler, SIGNAL(errorOccurred(QMailAccountId,QString,int)),
-            this, SLOT(intervalCheckingErrorOccurred(QMailAccountId,QString,int)));
-    disconnect(handler, SIGNAL(retrievalCompleted()),
-            this, SLOT(intervalCheckingRetrievalComplete()));
+    if (priority == SyncScheduler::UserRequest) {
+        userRetrievalAccountId = accountId;
+        if (!userCompletionIds.isEmpty()) {
+            handler->completeRetrieval(accountId, userCompletionIds);
+            userCompletionIds.clear();
+        } else {
+            handler->retrieve(accountId, userRetrievalFoldersOnly);
+        }
+    } else {
+        AccountConfiguration config(accountId);
+        if (roamingMode.value().toBool() && !config.intervalCheckRoamingEnabled()) {
+            scheduler.completed(accountId);
+            return;
+        }
 
-    intervalCheckRetrievalInProgress = false;
-    qLog(Messaging) << "Error performing interval check for account" << id << "-" << txt << ":" << code;
-}
+        qLog(Messaging) << "Performing interval check for account " 
+                        << accountId 
+                        << " name "
+                        << QMailAccount(accountId).displayName();
+        backgroundRetrievalPerformed = true;
+        handler->retrieve(accountId, false, true);
+    }
 
-void MessageServer::intervalCheckingRetrievalComplete()
-{
-    if (!intervalAccountIds.isEmpty()) {
-        QMailAccountId accountId = *intervalAccountIds.begin();
-        intervalAccountIds.remove(accountId);
+    if (!handler->retrievalInProgress(accountId)) {
+        // This retrieval could not be started
+        if (accountId == userRetrievalAccountId)
+            userRetrievalAccountId = QMailAccountId();
 
-        qLog(Messaging) << "Performing interval check for account:" << accountId;
-        handler->retrieve(accountId, false, true);
-    } else {
-        disconnect(handler, SIGNAL(errorOccurred(QMailAccountId,QString,int)),
-                   this, SLOT(intervalCheckingErrorOccurred(QMailAccountId,QString,int)));
-        disconnect(handler, SIGNAL(retrievalCompleted()),
-                   this, SLOT(intervalCheckingRetrievalComplete()));
+        scheduler.completed(accountId);
+    }
+}
 
-        intervalCheckRetrievalInProgress = false;
+void MessageServer::synchronizationIdle()
+{
+    if (backgroundRetrievalPerformed) {
+        backgroundRetrievalPerformed = false;
 
-        // Emit any updates arising from this check
+        // Emit any updates arising from background checks
         handler->synchroniseClients();
     }
 }
 
+bool MessageServer::isBackgroundRetrieval(const QMailAccountId &accountId) const
+{
+    return (scheduler.isActive(accountId) && (accountId != userRetrievalAccountId));
+}
+
 void MessageServer::partialMessageRetrieved(QMailMessageMetaData& message)
 {
     message.setStatus(QMailMessage::Incoming, true);
@@ -405,7 +439,8 @@ void MessageServer::partialMessageRetrieved(QMailMessageMetaData& message)
         }
     }
 
-    if (intervalCheckRetrievalInProgress) {
+    bool background(isBackgroundRetrieval(message.parentAccountId()));
+    if (background) {
         if (message.parentAccountId().isValid()) {
             AccountConfiguration config(message.parentAccountId());
             uint maxSize = static_cast<uint> ( config.maxMailSize() * 1024 );
@@ -415,17 +450,18 @@ void MessageServer::partialMessageRetrieved(QMailMessageMetaData& message)
     }
 
     if (complete) {
-        autoCompleteIds.append(message.id());
-    } else if (!intervalCheckRetrievalInProgress) {
+        autoCompleteIds[message.parentAccountId()].append(message.id());
+    } else if (!background) {
         emit client->partialMessageRetrieved(QMailStore::instance()->messageMetaData(message.id()));
     }
 }
 
-void MessageServer::partialRetrievalCompleted()
+void MessageServer::partialRetrievalCompleted(const QMailAccountId &accountId)
 {
-    if (!autoCompleteIds.isEmpty() || intervalCheckRetrievalInProgress) {
+    QMailMessageIdList ids(autoCompleteIds.value(accountId));
+    if (!ids.isEmpty() || isBackgroundRetrieval(accountId)) {
         // Do not report this event until we have retrieved the auto-completed messages
-        handler->completeRetrieval(autoCompleteIds);
+        handler->completeRetrieval(accountId, ids);
     } else {
         // Ensure the client receives any resulting events before the completion notification
         QMailStore::instance()->flushIpcNotifications();
@@ -468,30 +504,42 @@ void MessageServer::messageRetrieved(QMailMessage& message)
         QMailStore::instance()->addMessage(&message);
     }
 
-    if (!autoCompleteIds.contains(message.id())) {
+    if (!autoCompleteIds.value(message.parentAccountId()).contains(message.id())) {
         // Send only the header information to the client
         emit client->messageRetrieved(QMailStore::instance()->messageMetaData(message.id()));
     }
 }
 
-void MessageServer::retrievalCompleted()
+void MessageServer::retrievalCompleted(const QMailAccountId &accountId)
 {
-    if (!autoCompleteIds.isEmpty()) {
+    QMailMessageIdList ids(autoCompleteIds.take(accountId));
+    bool background(isBackgroundRetrieval(accountId));
+
+    if (!ids.isEmpty()) {
         // We have only completed the partial retrieval stage now
         QMailStore::instance()->flushIpcNotifications();
-        emit client->partialRetrievalCompleted();
+        if (!background)
+            emit client->partialRetrievalCompleted();
 
-        foreach (const QMailMessageId &id, autoCompleteIds) {
+        foreach (const QMailMessageId &id, ids) {
             emit client->messageRetrieved(QMailStore::instance()->messageMetaData(id));
         }
 
-        autoCompleteIds.clear();
-    } else {
+        if (!background) {
+            // The client will request any remaining messages
+            return;
+        }
+    } else if (!background) {
         // Ensure the client receives any resulting events before the completion notification
         QMailStore::instance()->flushIpcNotifications();
 
         emit client->retrievalCompleted();
     }
+
+    if (accountId == userRetrievalAccountId)
+        userRetrievalAccountId = QMailAccountId();
+
+    scheduler.completed(accountId);
 }
 
 static QMap<QMailMessage::MessageType, QString> typeSignatureInit()
@@ -724,61 +772,83 @@ void MessageServer::messageSent(const QMailMessageId &id)
 
 void MessageServer::errorOccurred(const QMailAccountId &id, const QString &txt, int code)
 {
-    if (!autoCompleteIds.isEmpty())
-        autoCompleteIds.clear();
+    autoCompleteIds.remove(id);
+
+    if (scheduler.isActive(id) && !handler->retrievalInProgress(id)) {
+        // The retrieval for this account has failed
+        if (id == userRetrievalAccountId)
+            userRetrievalAccountId = QMailAccountId();
+        else
+            qLog(Messaging) << "Error performing interval check for account" << id << "-" << txt << ":" << code;
+
+        scheduler.completed(id);
+    }
 
     emit client->errorOccurred(id, txt, code);
 }
 
-void MessageServer::statusChanged(QMailMessageServer::Operation op, const QString &accountName, const QString &status)
+void MessageServer::statusChanged(const QMailAccountId &id, QMailMessageServer::Operation op, const QString &accountName, const QString &status)
 {
-    if (!intervalCheckRetrievalInProgress) {
+    if (!isBackgroundRetrieval(id)) {
         emit client->statusChanged(op, accountName, status);
     }
 }
 
-void MessageServer::retrievalTotal(uint n)
+void MessageServer::retrievalTotal(const QMailAccountId &id, uint n)
 {
-    if (!intervalCheckRetrievalInProgress) {
+    if (id == userRetrievalAccountId) {
         emit client->retrievalTotal(n);
     }
 }
 
-void MessageServer::retrievalProgress(uint n)
+void MessageServer::retrievalProgress(const QMailAccountId &id, uint n)
 {
-    if (!intervalCheckRetrievalInProgress) {
+    if (id == userRetrievalAccountId) {
         emit client->retrievalProgress(n);
     }
 }
 
+void MessageServer::continueBodyIndex()
+{
+    // Index a few messages at a time, so that other requests are not held up
+    static const int BatchSize = 20;
+
+    QMailStore *store = QMailStore::instance();
+    if (!store->updateBodyIndex(BatchSize)) {
+        qLog(Messaging) << "Unable to update the message body index";
+        return;
+    }
+
+    if (!store->isBodyIndexComplete())
+        QTimer::singleShot(0, this, SLOT(continueBodyIndex()));
+}
+
 void MessageServer::searchMessages(const QMailMessageKey& filter, const QString& bodyText)
 {
-    // Find the messages that match the filter criteria
-    QMailMessageIdList searchIds = QMailStore::instance()->queryMessages(filter);
+    // Find the messages that match the filter criteria, and whose indexed body text
+    // contains each of the words in the search text
+    QMailMessageIdList searchIds = QMailStore::instance()->queryMessageBodies(filter, bodyText);
 
-    // Schedule this search
-    searches.append(MessageSearch(searchIds, bodyText));
+    // Schedule this search - phrases, and messages not yet indexed, must still be
+    // matched against the message content
+    bool verify = !QMailStore::isBodyIndexWord(bodyText) || !QMailStore::instance()->isBodyIndexComplete();
+    searches.append(MessageSearch(searchIds, bodyText, verify));
     QTimer::singleShot(0, this, SLOT(continueSearch()));
 }
 
-static bool messageBodyContainsText(const QMailMessage &message, const QString& text)
+static bool messageBodyContainsText(const QMailMessagePartContainer &container, const QString& text)
 {
-    // Search only messages or message parts that are of type 'text/*'
-    if (message.hasBody()) {
-        if (message.contentType().type().toLower() == "text") {
-            if (message.body().data().contains(text, Qt::CaseInsensitive))
+    // Search only messages or message parts that are of type 'text/*', at any depth,
+    // to match the parts that the body index covers
+    if (container.hasBody()) {
+        if (container.contentType().type().toLower() == "text") {
+            if (container.body().data().contains(text, Qt::CaseInsensitive))
                 return true;
         }
-    } else if (message.multipartType() != QMailMessage::MultipartNone) {
-        // We could do a recursive search for text elements, but since we can't currently
-        // display generic multipart messages anyway, let's just search the top level
-        for (uint i = 0; i < message.partCount(); ++i) {
-            const QMailMessagePart &part = message.partAt(i);
-
-            if (part.contentType().type().toLower() == "text") {
-                if (part.body().data().contains(text, Qt::CaseInsensitive))
-                    return true;
-            }
+    } else if (container.multipartType() != QMailMessage::MultipartNone) {
+        for (uint i = 0; i < container.partCount(); ++i) {
+            if (messageBodyContainsText(container.partAt(i), text))
+                return true;
         }
     }
 
@@ -800,10 +870,14 @@ void MessageServer::continueSearch()
         }
 
         if (!currentSearch.isEmpty()) {
-            foreach (const QMailMessageId &id, currentSearch.takeBatch()) {
-                QMailMessage message(id);
-                if (messageBodyContainsText(message, currentSearch.bodyText()))
-                    matchingIds.append(id);
+            if (currentSearch.requiresVerification()) {
+                foreach (const QMailMessageId &id, currentSearch.takeBatch()) {
+                    QMailMessage message(id);
+                    if (messageBodyContainsText(message, currentSearch.bodyText()))
+                        matchingIds.append(id);
+                }
+            } else {
+                matchingIds += currentSearch.takeBatch();
             }
 
             emit client->searchProgress(currentSearch.progress());
@@ -21,6 +21,7 @@
 #define MESSAGESERVER_H
 
 #include "messageclassifier.h"
+#include "syncscheduler.h"
 
 #include <QUniqueId>
 #include <QMailMessageServer>
@@ -49,12 +50,17 @@ signals:
 
 private slots:
     void initIntervalChecking();
+    void retrieve(const QMailAccountId &accountId, bool foldersOnly);
+    void completeRetrieval(const QMailMessageIdList &mailList);
+    void synchronize(const QMailAccountId &accountId, SyncScheduler::Priority priority);
+    void synchronizationIdle();
+
     void partialMessageRetrieved(QMailMessageMetaData&);
-    void partialRetrievalCompleted();
-    void retrievalTotal(uint);
-    void retrievalProgress(uint);
+    void partialRetrievalCompleted(const QMailAccountId &accountId);
+    void retrievalTotal(const QMailAccountId &accountId, uint);
+    void retrievalProgress(const QMailAccountId &accountId, uint);
     void messageRetrieved(QMailMessage&);
-    void retrievalCompleted();
+    void retrievalCompleted(const QMailAccountId &accountId);
     void acknowledgeNewMessages(const QMailMessageTypeList&);
     void newMailDiscovered(const QMailAccountId &accountId);
 
@@ -65,14 +71,13 @@ private slots:
     void messageSent(const QMailMessageId &);
 
     void errorOccurred(const QMailAccountId &id, const QString &txt, int code);
-    void statusChanged(QMailMessageServer::Operation, const QString&, const QString&);
+    void statusChanged(const QMailAccountId &id, QMailMessageServer::Operation, const QString&, const QString&);
     void intervalCheckTimeout();
-    void intervalCheckingErrorOccurred(const QMailAccountId &id, const QString &txt, int code);
-    void intervalCheckingRetrievalComplete();
 
     void searchMessages(const QMailMessageKey &filter, const QString &bodyText);
     void continueSearch();
     void cancelSearch();
+    void continueBodyIndex();
 
     void actionResponse(const QUniqueId &uid, const QDSData &responseData);
     void actionError(const QUniqueId &uid, const QString &message);
@@ -88,9 +93,10 @@ private:
     class MessageSearch
     {
     public:
-        MessageSearch(const QMailMessageIdList &ids, const QString &text);
+        MessageSearch(const QMailMessageIdList &ids, const QString &text, bool verify);
 
         const QString &bodyText() const;
+        bool requiresVerification() const;
 
         bool pending() const;
         void inProgress();
@@ -105,6 +111,7 @@ private:
     private:
         QMailMessageIdList _ids;
         QString _text;
+        bool _verify;
         bool _active;
         uint _total;
         uint _progress;
@@ -116,19 +123,24 @@ private:
 
     void updateNewMessageCounts();
 
+    bool isBackgroundRetrieval(const QMailAccountId &accountId) const;
+
     EmailHandler *handler;
     MailMessageClient *client;
     uint unacknowledgedFlashSms;
     MessageClassifier classifier;
-    QMailMessageIdList autoCompleteIds;
+    QMap<QMailAccountId, QMailMessageIdList> autoCompleteIds;
     QMailMessageCountMap messageCounts;
     QList<MessageSearch> searches;
     QMailMessageIdList matchingIds;
 
-    //Interval checking variables
-    bool intervalCheckRetrievalInProgress;
+    //Retrieval scheduling variables
+    SyncScheduler scheduler;
+    QMailAccountId userRetrievalAccountId;
+    bool userRetrievalFoldersOnly;
+    QMailMessageIdList userCompletionIds;
+    bool backgroundRetrievalPerformed;
     QMap<QTimer*, QMailAccountId> intervalCheckMap;
-    QSet<QMailAccountId> intervalAccountIds;
     QValueSpaceItem roamingMode;
     QNetworkState *netState;
 
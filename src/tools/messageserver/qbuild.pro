@@ -36,6 +36,7 @@ HEADERS=\
     messagearrivalservice.h\
     messageclassifier.h\
     messageserver.h\
+    syncscheduler.h\
     popclient.h\
     smsclient.h\
     smsdecoder.h\
@@ -53,6 +54,7 @@ SOURCES=\
     messagearrivalservice.cpp\
     messageclassifier.cpp\
     messageserver.cpp\
+    syncscheduler.cpp\
     popclient.cpp\
     smsclient.cpp\
     smsdecoder.cpp\
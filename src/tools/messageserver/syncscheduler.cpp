@@ -0,0 +1,161 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "syncscheduler.h"
+
+#include <QSettings>
+#include <QTimer>
+#include <qtopialog.h>
+
+/*
+    The SyncScheduler class determines when each account should be synchronized.
+
+    Requests are started in priority order; user requests precede notifications of new
+    mail, which precede interval checks.  Only one synchronization is active for any
+    account, but different accounts are synchronized concurrently, up to the limit
+    configured by the "sync/MaximumConcurrent" messageserver setting.  User requests
+    are not subject to that limit, so that they are never delayed by background activity.
+*/
+
+SyncScheduler::SyncScheduler(QObject *parent)
+    : QObject(parent),
+      startScheduled(false)
+{
+    QSettings settings("Trolltech", "messageserver");
+    settings.beginGroup("sync");
+    maximum = qMax(1, settings.value("MaximumConcurrent", 2).toInt());
+}
+
+SyncScheduler::~SyncScheduler()
+{
+}
+
+void SyncScheduler::schedule(const QMailAccountId &accountId, Priority priority)
+{
+    if ((priority != UserRequest) && active.contains(accountId)) {
+        // The active synchronization will find any changes
+        qLog(Messaging) << "Account" << accountId << "already synchronizing";
+        return;
+    }
+
+    // Merge with any pending request for this account, retaining the more urgent priority
+    QList<Request>::iterator it = pending.begin(), end = pending.end();
+    for ( ; it != end; ++it) {
+        if ((*it).second == accountId) {
+            if ((*it).first <= priority)
+                return;
+
+            pending.erase(it);
+            break;
+        }
+    }
+
+    // Requests of equal priority are started in the order they are made
+    int index = 0;
+    while ((index < pending.count()) && (pending.at(index).first <= priority))
+        ++index;
+
+    pending.insert(index, qMakePair(priority, accountId));
+
+    if (!startScheduled) {
+        startScheduled = true;
+        QTimer::singleShot(0, this, SLOT(startPending()));
+    }
+}
+
+void SyncScheduler::unschedule(const QMailAccountId &accountId)
+{
+    QList<Request>::iterator it = pending.begin();
+    while (it != pending.end()) {
+        if ((*it).second == accountId)
+            it = pending.erase(it);
+        else
+            ++it;
+    }
+}
+
+void SyncScheduler::completed(const QMailAccountId &accountId)
+{
+    if (active.remove(accountId)) {
+        if (!startScheduled) {
+            startScheduled = true;
+            QTimer::singleShot(0, this, SLOT(startPending()));
+        }
+    }
+}
+
+bool SyncScheduler::isActive(const QMailAccountId &accountId) const
+{
+    return active.contains(accountId);
+}
+
+bool SyncScheduler::isPending(const QMailAccountId &accountId) const
+{
+    foreach (const Request &request, pending)
+        if (request.second == accountId)
+            return true;
+
+    return false;
+}
+
+bool SyncScheduler::isIdle() const
+{
+    return (active.isEmpty() && pending.isEmpty());
+}
+
+int SyncScheduler::maximumActive() const
+{
+    return maximum;
+}
+
+void SyncScheduler::setMaximumActive(int max)
+{
+    maximum = qMax(1, max);
+}
+
+void SyncScheduler::startPending()
+{
+    startScheduled = false;
+
+    QList<Request>::iterator it = pending.begin();
+    while (it != pending.end()) {
+        Request request(*it);
+
+        if (active.contains(request.second)) {
+            // Wait for the current synchronization of this account to complete
+            ++it;
+            continue;
+        }
+        if ((request.first != UserRequest) && (active.count() >= maximum)) {
+            // All remaining requests are background requests
+            break;
+        }
+
+        pending.erase(it);
+        active.insert(request.second);
+
+        emit synchronize(request.second, request.first);
+
+        // The receiver may have changed our state
+        it = pending.begin();
+    }
+
+    if (isIdle())
+        emit idle();
+}
@@ -0,0 +1,72 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#ifndef SYNCSCHEDULER_H
+#define SYNCSCHEDULER_H
+
+#include <QMailAccountId>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+
+class SyncScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority
+    {
+        UserRequest = 0,
+        NewMailNotification,
+        IntervalCheck
+    };
+
+    SyncScheduler(QObject *parent = 0);
+    ~SyncScheduler();
+
+    void schedule(const QMailAccountId &accountId, Priority priority);
+    void unschedule(const QMailAccountId &accountId);
+
+    void completed(const QMailAccountId &accountId);
+
+    bool isActive(const QMailAccountId &accountId) const;
+    bool isPending(const QMailAccountId &accountId) const;
+    bool isIdle() const;
+
+    int maximumActive() const;
+    void setMaximumActive(int maximum);
+
+signals:
+    void synchronize(const QMailAccountId &accountId, SyncScheduler::Priority priority);
+    void idle();
+
+private slots:
+    void startPending();
+
+private:
+    typedef QPair<Priority, QMailAccountId> Request;
+
+    QList<Request> pending;
+    QSet<QMailAccountId> active;
+    int maximum;
+    bool startScheduled;
+};
+
+#endif
@@ -0,0 +1,19 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+TARGET=tst_imapclient
+QTOPIA*=mail
+
+SOURCEPATH+=/src/tools/messageserver
+
+HEADERS=\
+    client.h\
+    imapclient.h\
+    imapprotocol.h\
+    mailtransport.h
+
+SOURCES=\
+    tst_imapclient.cpp\
+    client.cpp\
+    imapclient.cpp\
+    imapprotocol.cpp\
+    mailtransport.cpp
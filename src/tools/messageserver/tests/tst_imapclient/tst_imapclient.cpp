@@ -0,0 +1,305 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "imapclient.h"
+
+#include <QMailAccount>
+#include <QMailFolder>
+#include <QMailStore>
+#include <QSettings>
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTest>
+#include <QTimer>
+#include <QtopiaApplication>
+#include <shared/qtopiaunittest.h>
+
+//TESTED_CLASS=ImapClient
+//TESTED_FILES=src/tools/messageserver/imapclient.cpp
+
+// A minimal IMAP server, serving a fixed set of mailboxes to any number of connections
+class FakeImapServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    FakeImapServer(QObject *parent = 0);
+
+    void addMailbox(const QString &name, const QStringList &seen = QStringList(), const QStringList &unseen = QStringList());
+
+    int connectionCount() const { return connections.count(); }
+
+    // Delay SELECT responses, as a remote server would
+    void setSelectDelay(int milliseconds) { selectDelay = milliseconds; }
+
+    // The commands received, prefixed with the index of the connection they arrived on
+    QStringList commands;
+
+private slots:
+    void newClient();
+    void readCommands();
+    void sendDelayed();
+
+private:
+    void respond(QTcpSocket *socket, const QString &tag, const QString &command, const QString &arguments);
+
+    QMap<QString, QPair<QStringList, QStringList> > mailboxes;
+    QStringList mailboxOrder;
+    QList<QTcpSocket *> connections;
+    QMap<QTcpSocket *, QString> selected;
+    QList<QPair<QTcpSocket *, QByteArray> > delayed;
+    int selectDelay;
+};
+
+FakeImapServer::FakeImapServer(QObject *parent)
+    : QTcpServer(parent),
+      selectDelay(0)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(newClient()));
+}
+
+void FakeImapServer::addMailbox(const QString &name, const QStringList &seen, const QStringList &unseen)
+{
+    mailboxOrder.append(name);
+    mailboxes.insert(name, qMakePair(seen, unseen));
+}
+
+void FakeImapServer::newClient()
+{
+    while (QTcpSocket *socket = nextPendingConnection()) {
+        connections.append(socket);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readCommands()));
+        socket->write("* OK Fake IMAP server ready\r\n");
+    }
+}
+
+void FakeImapServer::readCommands()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+
+    while (socket->canReadLine()) {
+        QString line = QString::fromAscii(socket->readLine()).trimmed();
+        commands.append(QString::number(connections.indexOf(socket)) + ' ' + line.section(' ', 1));
+
+        QString tag = line.section(' ', 0, 0);
+        QString command = line.section(' ', 1, 1).toUpper();
+        if (command == "UID")
+            command += ' ' + line.section(' ', 2, 2).toUpper();
+
+        respond(socket, tag, command, line.section(' ', (command.startsWith("UID ") ? 3 : 2)));
+    }
+}
+
+void FakeImapServer::respond(QTcpSocket *socket, const QString &tag, const QString &command, const QString &arguments)
+{
+    QString response;
+
+    if (command == "CAPABILITY") {
+        response = "* CAPABILITY IMAP4rev1\r\n";
+    } else if (command == "LIST") {
+        foreach (const QString &name, mailboxOrder)
+            response += "* LIST () \"/\" \"" + name + "\"\r\n";
+    } else if (command == "SELECT") {
+        QString name = arguments.section(' ', 0, 0);
+        name.remove('"');
+        selected[socket] = name;
+
+        const QPair<QStringList, QStringList> &uids = mailboxes[name];
+        response = QString("* %1 EXISTS\r\n").arg(uids.first.count() + uids.second.count());
+        response += "* OK [UIDVALIDITY 1] UIDs valid\r\n";
+    } else if (command == "UID SEARCH") {
+        const QPair<QStringList, QStringList> &uids = mailboxes[selected[socket]];
+        QStringList found;
+        if (arguments.contains("UNSEEN"))
+            found = uids.second;
+        else if (arguments.contains("SEEN"))
+            found = uids.first;
+        else
+            found = uids.first + uids.second;
+
+        response = "* SEARCH";
+        foreach (const QString &uid, found)
+            response += ' ' + uid;
+        response += "\r\n";
+    } else if (command == "LOGOUT") {
+        response = "* BYE Fake IMAP server logging out\r\n";
+    }
+
+    response += tag + ' ' + "OK " + command + " completed\r\n";
+
+    if ((command == "SELECT") && (selectDelay > 0)) {
+        delayed.append(qMakePair(socket, response.toAscii()));
+        QTimer::singleShot(selectDelay, this, SLOT(sendDelayed()));
+    } else {
+        socket->write(response.toAscii());
+    }
+}
+
+void FakeImapServer::sendDelayed()
+{
+    QPair<QTcpSocket *, QByteArray> next = delayed.takeFirst();
+    next.first->write(next.second);
+}
+
+class tst_ImapClient : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void cleanupTestCase();
+
+    void synchronizeConcurrently();
+    void previewNewMessages();
+
+private:
+    bool waitForSignal(const QSignalSpy &spy, int timeout = 10000);
+    QStringList selectCommands(const QString &mailbox) const;
+
+    FakeImapServer *m_server;
+    QMailAccountId m_accountId;
+};
+
+QTEST_APP_MAIN( tst_ImapClient, QtopiaApplication )
+
+#include "tst_imapclient.moc"
+
+void tst_ImapClient::initTestCase()
+{
+    QSettings settings("Trolltech", "messageserver");
+    settings.beginGroup("imap");
+    settings.setValue("MaximumConnections", 2);
+}
+
+void tst_ImapClient::init()
+{
+    m_server = new FakeImapServer(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+
+    QMailAccount account;
+    account.setAccountName("tst_imapclient");
+
+    AccountConfiguration config;
+    config.setMailServer("127.0.0.1");
+    config.setMailPort(m_server->serverPort());
+    config.setMailUserName("user");
+    config.setMailPassword("password");
+
+    QVERIFY(QMailStore::instance()->addAccount(&account, &config));
+    m_accountId = account.id();
+}
+
+void tst_ImapClient::cleanup()
+{
+    QMailStore::instance()->removeAccount(m_accountId);
+    delete m_server;
+}
+
+void tst_ImapClient::cleanupTestCase()
+{
+    QSettings settings("Trolltech", "messageserver");
+    settings.remove("imap/MaximumConnections");
+    settings.remove("imap-sync");
+}
+
+bool tst_ImapClient::waitForSignal(const QSignalSpy &spy, int timeout)
+{
+    for (int elapsed = 0; spy.isEmpty() && (elapsed < timeout); elapsed += 50)
+        QTest::qWait(50);
+
+    return !spy.isEmpty();
+}
+
+QStringList tst_ImapClient::selectCommands(const QString &mailbox) const
+{
+    return m_server->commands.filter(QRegExp("^\\d+ SELECT \"?" + mailbox + "\"?(\\s|$)"));
+}
+
+/*?
+    Test that the mailboxes of an account are shared between the client connection
+    and an additional connection, and that each mailbox is synchronized exactly once.
+*/
+void tst_ImapClient::synchronizeConcurrently()
+{
+    QStringList names;
+    names << "INBOX" << "Archive" << "Drafts" << "Sent" << "Trash";
+    foreach (const QString &name, names)
+        m_server->addMailbox(name);
+    m_server->setSelectDelay(200);
+
+    ImapClient client(0);
+    QSignalSpy previewed(&client, SIGNAL(partialRetrievalCompleted()));
+    QSignalSpy failed(&client, SIGNAL(errorOccurred(int,QString&)));
+
+    client.setAccount(m_accountId);
+    client.newConnection();
+
+    QVERIFY(waitForSignal(previewed));
+    QCOMPARE(failed.count(), 0);
+    QCOMPARE(m_server->connectionCount(), 2);
+
+    QSet<QString> connectionsUsed;
+    foreach (const QString &name, names) {
+        QStringList selects = selectCommands(name);
+        QCOMPARE(selects.count(), 1);
+        connectionsUsed.insert(selects.first().section(' ', 0, 0));
+
+        QMailFolderId boxId = QMailAccount(m_accountId).getMailbox(name);
+        QVERIFY(boxId.isValid());
+        QVERIFY(QMailFolder(boxId).status() & QMailFolder::Synchronized);
+    }
+    QCOMPARE(connectionsUsed.count(), 2);
+
+    // The inbox is always synchronized first, on the client connection
+    QCOMPARE(selectCommands("INBOX").first().section(' ', 0, 0), QString("0"));
+}
+
+/*?
+    Test that new messages found by any connection are previewed on the client
+    connection, once every mailbox has been synchronized.
+*/
+void tst_ImapClient::previewNewMessages()
+{
+    m_server->addMailbox("INBOX");
+    m_server->addMailbox("Archive", QStringList() << "5", QStringList() << "6");
+    m_server->addMailbox("Sent", QStringList(), QStringList() << "9");
+
+    ImapClient client(0);
+    QSignalSpy previewed(&client, SIGNAL(partialRetrievalCompleted()));
+    QSignalSpy total(&client, SIGNAL(fetchTotal(uint)));
+
+    client.setAccount(m_accountId);
+    client.newConnection();
+
+    QVERIFY(waitForSignal(previewed));
+    QCOMPARE(total.count(), 1);
+    QCOMPARE(total.first().first().toUInt(), 3u);
+
+    // Headers are fetched on the client connection, in mailbox order
+    QStringList fetches = m_server->commands.filter(QRegExp("^\\d+ UID FETCH"));
+    QCOMPARE(fetches.count(), 2);
+    QVERIFY(fetches.at(0).startsWith("0 "));
+    QVERIFY(fetches.at(0).contains("5") && fetches.at(0).contains("6"));
+    QVERIFY(fetches.at(1).startsWith("0 "));
+    QVERIFY(fetches.at(1).contains("9"));
+
+    // No connection searched a mailbox more than once
+    QCOMPARE(m_server->commands.filter(QRegExp("^\\d+ UID SEARCH SEEN")).count(), 2);
+}
@@ -0,0 +1,13 @@
+TEMPLATE=app
+CONFIG+=qtopia unittest
+TARGET=tst_syncscheduler
+QTOPIA*=mail
+
+SOURCEPATH+=/src/tools/messageserver
+
+HEADERS=\
+    syncscheduler.h
+
+SOURCES=\
+    tst_syncscheduler.cpp\
+    syncscheduler.cpp
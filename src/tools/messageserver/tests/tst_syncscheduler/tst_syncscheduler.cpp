@@ -0,0 +1,272 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include "syncscheduler.h"
+
+#include <QTest>
+#include <QtopiaApplication>
+#include <shared/qtopiaunittest.h>
+
+//TESTED_CLASS=SyncScheduler
+//TESTED_FILES=src/tools/messageserver/syncscheduler.cpp
+
+class tst_SyncScheduler : public QObject
+{
+    Q_OBJECT
+private slots:
+    void init();
+
+    void priorityOrder();
+    void concurrencyLimit();
+    void userRequestBypassesLimit();
+    void oneSynchronizationPerAccount();
+    void mergeRequests();
+    void unschedule();
+    void idle();
+
+private slots:
+    void synchronize(const QMailAccountId &accountId, SyncScheduler::Priority priority);
+    void becameIdle();
+
+private:
+    void connectScheduler(SyncScheduler *scheduler);
+
+    QList<QPair<QMailAccountId, SyncScheduler::Priority> > m_started;
+    int m_idleCount;
+};
+
+QTEST_APP_MAIN( tst_SyncScheduler, QtopiaApplication )
+
+#include "tst_syncscheduler.moc"
+
+static const QMailAccountId firstAccount(1);
+static const QMailAccountId secondAccount(2);
+static const QMailAccountId thirdAccount(3);
+
+void tst_SyncScheduler::init()
+{
+    m_started.clear();
+    m_idleCount = 0;
+}
+
+void tst_SyncScheduler::synchronize(const QMailAccountId &accountId, SyncScheduler::Priority priority)
+{
+    m_started.append(qMakePair(accountId, priority));
+}
+
+void tst_SyncScheduler::becameIdle()
+{
+    ++m_idleCount;
+}
+
+void tst_SyncScheduler::connectScheduler(SyncScheduler *scheduler)
+{
+    connect(scheduler, SIGNAL(synchronize(QMailAccountId,SyncScheduler::Priority)),
+            this, SLOT(synchronize(QMailAccountId,SyncScheduler::Priority)));
+    connect(scheduler, SIGNAL(idle()), this, SLOT(becameIdle()));
+}
+
+/*?
+    Test that pending requests are started in priority order, and that requests of
+    equal priority are started in the order they were made.
+*/
+void tst_SyncScheduler::priorityOrder()
+{
+    SyncScheduler scheduler;
+    scheduler.setMaximumActive(3);
+    connectScheduler(&scheduler);
+
+    scheduler.schedule(firstAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(secondAccount, SyncScheduler::NewMailNotification);
+    scheduler.schedule(thirdAccount, SyncScheduler::NewMailNotification);
+
+    // Nothing is started until control returns to the event loop
+    QVERIFY(m_started.isEmpty());
+    QVERIFY(scheduler.isPending(firstAccount));
+
+    QTest::qWait(0);
+
+    QCOMPARE(m_started.count(), 3);
+    QCOMPARE(m_started.at(0).first, secondAccount);
+    QCOMPARE(m_started.at(1).first, thirdAccount);
+    QCOMPARE(m_started.at(2).first, firstAccount);
+    QCOMPARE(m_started.at(2).second, SyncScheduler::IntervalCheck);
+    QVERIFY(scheduler.isActive(firstAccount));
+    QVERIFY(!scheduler.isPending(firstAccount));
+}
+
+/*?
+    Test that background requests wait while the maximum number of synchronizations
+    are active, and are started when an active synchronization completes.
+*/
+void tst_SyncScheduler::concurrencyLimit()
+{
+    SyncScheduler scheduler;
+    scheduler.setMaximumActive(2);
+    QCOMPARE(scheduler.maximumActive(), 2);
+    connectScheduler(&scheduler);
+
+    scheduler.schedule(firstAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(secondAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(thirdAccount, SyncScheduler::IntervalCheck);
+    QTest::qWait(0);
+
+    QCOMPARE(m_started.count(), 2);
+    QVERIFY(scheduler.isPending(thirdAccount));
+
+    scheduler.completed(firstAccount);
+    QVERIFY(!scheduler.isActive(firstAccount));
+    QTest::qWait(0);
+
+    QCOMPARE(m_started.count(), 3);
+    QCOMPARE(m_started.at(2).first, thirdAccount);
+    QVERIFY(scheduler.isActive(thirdAccount));
+}
+
+/*?
+    Test that a user request is started immediately, even when background
+    synchronizations occupy every slot.
+*/
+void tst_SyncScheduler::userRequestBypassesLimit()
+{
+    SyncScheduler scheduler;
+    scheduler.setMaximumActive(1);
+    connectScheduler(&scheduler);
+
+    scheduler.schedule(firstAccount, SyncScheduler::IntervalCheck);
+    QTest::qWait(0);
+    QCOMPARE(m_started.count(), 1);
+
+    scheduler.schedule(secondAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(thirdAccount, SyncScheduler::UserRequest);
+    QTest::qWait(0);
+
+    QCOMPARE(m_started.count(), 2);
+    QCOMPARE(m_started.at(1).first, thirdAccount);
+    QCOMPARE(m_started.at(1).second, SyncScheduler::UserRequest);
+    QVERIFY(scheduler.isPending(secondAccount));
+}
+
+/*?
+    Test that an account is never synchronized twice at once: background requests
+    for an active account are dropped, and user requests wait for it to complete.
+*/
+void tst_SyncScheduler::oneSynchronizationPerAccount()
+{
+    SyncScheduler scheduler;
+    connectScheduler(&scheduler);
+
+    scheduler.schedule(firstAccount, SyncScheduler::IntervalCheck);
+    QTest::qWait(0);
+    QCOMPARE(m_started.count(), 1);
+
+    scheduler.schedule(firstAccount, SyncScheduler::NewMailNotification);
+    QVERIFY(!scheduler.isPending(firstAccount));
+
+    scheduler.schedule(firstAccount, SyncScheduler::UserRequest);
+    QTest::qWait(0);
+    QCOMPARE(m_started.count(), 1);
+    QVERIFY(scheduler.isPending(firstAccount));
+
+    scheduler.completed(firstAccount);
+    QTest::qWait(0);
+    QCOMPARE(m_started.count(), 2);
+    QCOMPARE(m_started.at(1).second, SyncScheduler::UserRequest);
+}
+
+/*?
+    Test that repeated requests for an account are merged into a single request
+    with the most urgent priority.
+*/
+void tst_SyncScheduler::mergeRequests()
+{
+    SyncScheduler scheduler;
+    scheduler.setMaximumActive(1);
+    connectScheduler(&scheduler);
+
+    scheduler.schedule(firstAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(secondAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(thirdAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(thirdAccount, SyncScheduler::NewMailNotification);
+    scheduler.schedule(thirdAccount, SyncScheduler::IntervalCheck);
+    QTest::qWait(0);
+
+    QCOMPARE(m_started.count(), 1);
+    QCOMPARE(m_started.at(0).first, thirdAccount);
+    QCOMPARE(m_started.at(0).second, SyncScheduler::NewMailNotification);
+
+    scheduler.completed(thirdAccount);
+    QTest::qWait(0);
+    scheduler.completed(firstAccount);
+    QTest::qWait(0);
+    scheduler.completed(secondAccount);
+    QTest::qWait(0);
+
+    QCOMPARE(m_started.count(), 3);
+    QCOMPARE(m_started.at(1).first, firstAccount);
+    QCOMPARE(m_started.at(2).first, secondAccount);
+}
+
+/*?
+    Test that unscheduled requests are never started.
+*/
+void tst_SyncScheduler::unschedule()
+{
+    SyncScheduler scheduler;
+    connectScheduler(&scheduler);
+
+    scheduler.schedule(firstAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(secondAccount, SyncScheduler::UserRequest);
+    scheduler.unschedule(firstAccount);
+    QVERIFY(!scheduler.isPending(firstAccount));
+    QTest::qWait(0);
+
+    QCOMPARE(m_started.count(), 1);
+    QCOMPARE(m_started.at(0).first, secondAccount);
+}
+
+/*?
+    Test that idle() is emitted once no synchronization is active or pending.
+*/
+void tst_SyncScheduler::idle()
+{
+    SyncScheduler scheduler;
+    connectScheduler(&scheduler);
+    QVERIFY(scheduler.isIdle());
+
+    scheduler.schedule(firstAccount, SyncScheduler::IntervalCheck);
+    scheduler.schedule(secondAccount, SyncScheduler::IntervalCheck);
+    QVERIFY(!scheduler.isIdle());
+    QTest::qWait(0);
+    QCOMPARE(m_idleCount, 0);
+
+    scheduler.completed(firstAccount);
+    QTest::qWait(0);
+    QCOMPARE(m_idleCount, 0);
+
+    scheduler.completed(secondAccount);
+    QTest::qWait(0);
+    QCOMPARE(m_idleCount, 1);
+    QVERIFY(scheduler.isIdle());
+
+    // Completing an inactive account changes nothing
+    scheduler.completed(secondAccount);
+    QTest::qWait(0);
+    QCOMPARE(m_idleCount, 1);
+}
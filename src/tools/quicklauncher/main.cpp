@@ -124,6 +124,7 @@ int MAIN_FUNC( int argc, char** argv )
         QtopiaSql::instance()->systemDatabase();
 
         QSoftMenuBar::menuKey(); // read config.
+        QuickLauncher::preloadPlugins(); // load frequently launched apps
 
         // Create a widget to force initialization of title bar images, etc.
         QObject::disconnect(QuickLauncher::app, SIGNAL(lastWindowClosed()), QuickLauncher::app, SLOT(hideOrQuit()));
@@ -30,6 +30,8 @@
 #include <qtopiaapplication.h>
 #include <qpluginmanager.h>
 #include <qapplicationplugin.h>
+#include <QLibrary>
+#include <QSettings>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -139,6 +141,34 @@ QuickLauncher::QuickLauncher()
     env << ::getpid();
 }
 
+/*
+  Loads the plugins of the applications the server expects to launch most, so
+  that launching one of them only has to instantiate it.  The libraries are
+  not unloaded again: whichever application this process becomes keeps them
+  mapped.
+*/
+void QuickLauncher::preloadPlugins()
+{
+#ifndef SINGLE_EXEC
+    QSettings config( "Trolltech", "QuickLauncher" );
+    QStringList apps = config.value( "Preload/Applications" ).toStringList();
+    QStringList paths = Qtopia::installPaths();
+    foreach ( QString app, apps ) {
+        for ( int ii = 0; ii < paths.count(); ++ii ) {
+            QString plugin = paths.at(ii) + "plugins/application/lib" + app + ".so";
+            if ( QFile::exists( plugin ) ) {
+                QLibrary library( plugin );
+                if ( library.load() )
+                    qLog(Quicklauncher) << "Preloaded" << plugin;
+                else
+                    qLog(Quicklauncher) << "Cannot preload" << plugin << library.errorString();
+                break;
+            }
+        }
+    }
+#endif
+}
+
 void QuickLauncher::exec( int argc, char **argv )
 {
     QString appName = argv[0];
@@ -40,6 +40,7 @@ public:
     QuickLauncher();
 
     static void exec( int argc, char **argv );
+    static void preloadPlugins();
 
 private slots:
     void message(const QString &msg, const QByteArray & data);
@@ -18,7 +18,8 @@ HEADERS=\
     qpackageregistry.h\
     qtopianamespace.h\
     keyfiler_p.h\
-    qsxepolicy.h
+    qsxepolicy.h\
+    qsxepolicytable_p.h
 
 SOURCES=\
     main.cpp\
@@ -26,5 +27,6 @@ SOURCES=\
     qpackageregistry.cpp\
     qtopianamespace_lock.cpp\
     keyfiler.cpp\
-    qsxepolicy.cpp
+    qsxepolicy.cpp\
+    qsxepolicytable.cpp
 
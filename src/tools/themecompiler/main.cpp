@@ -0,0 +1,118 @@
+/****************************************************************************
+**
+** This file is part of the Qt Extended Opensource Package.
+**
+** Copyright (C) 2009 Trolltech ASA.
+**
+** Contact: Qt Extended Information (info@qtextended.org)
+**
+** This file may be used under the terms of the GNU General Public License
+** version 2.0 as published by the Free Software Foundation and appearing
+** in the file LICENSE.GPL included in the packaging of this file.
+**
+** Please review the following information to ensure GNU General Public
+** Licensing requirements will be met:
+**     http://www.fsf.org/licensing/licenses/info/GPLv2.html.
+**
+**
+****************************************************************************/
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+
+#include <QDateTime>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <utime.h>
+
+#include "qcompiledtheme_p.h"
+
+static void usage( const char *progname )
+{
+    printf("%s compiles theme XML files into the memory mapped .qtb format\n", progname);
+    printf("Usage:\n");
+    printf("\t%s [-e] <output directory> <input file> [input file...]\n", progname);
+    printf("\t  [-e]  Reverse endianness of resulting file\n");
+    exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+    QFile e(argv[0]);
+    bool error=false;
+    bool swapbytes=false;
+    if (argc < 3)
+        error=true;
+    // Parse the command-line.
+    QString path( argc > 1 ? argv[1] : "" );
+
+    while ( !error && path.startsWith('-') ) {
+        if ( path == "-e" ) swapbytes=!swapbytes;
+        else error=true;
+        --argc; ++argv; path=argc > 1 ? argv[1] : "";
+        if (argc < 3)
+            error=true;
+    }
+
+    if (error)
+        usage(e.fileName().toLocal8Bit().constData());
+
+    QDir d;
+    d.setPath(path);
+    if ( !d.exists() ) {
+        bool ok = d.mkpath( path );
+        if ( !ok ) {
+            printf( "Could not create directory %s\n", path.toLocal8Bit().constData() );
+            return 1;
+        }
+    }
+
+    int result = 0;
+    for (int index = 2; index < argc; index++) {
+        QFile xmlFile(QString(argv[index]));
+        QString compiled = QString("%1/%2").arg(path)
+            .arg(QFileInfo(QCompiledTheme::compiledFileName(xmlFile.fileName())).fileName());
+
+        if (!xmlFile.open(QIODevice::ReadOnly)) {
+            printf("Cannot open %s\n", xmlFile.fileName().toLocal8Bit().constData());
+            result = 1;
+            continue;
+        }
+        // Write beside the destination and rename, as a running process may have the old file mapped
+        QFile out(compiled + ".new");
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            printf("Cannot write %s\n", out.fileName().toLocal8Bit().constData());
+            result = 1;
+            continue;
+        }
+        bool ok = QCompiledTheme::compile(&xmlFile, &out, swapbytes);
+        out.close();
+        if (!ok) {
+            printf("Cannot compile %s\n", xmlFile.fileName().toLocal8Bit().constData());
+            out.remove();
+            result = 1;
+            continue;
+        }
+        QFile::remove(compiled);
+        if (!out.rename(compiled)) {
+            printf("Cannot write %s\n", compiled.toLocal8Bit().constData());
+            out.remove();
+            result = 1;
+            continue;
+        }
+
+        // QCompiledTheme::load() only trusts the XML's timestamp if the compiled file is
+        // newer, but the XML was usually installed in the same second it was compiled
+        uint modified = QFileInfo(xmlFile.fileName()).lastModified().toTime_t();
+        if (QFileInfo(compiled).lastModified().toTime_t() <= modified) {
+            struct utimbuf times;
+            times.actime = times.modtime = modified + 1;
+            utime(QFile::encodeName(compiled).constData(), &times);
+        }
+    }
+
+    return result;
+}
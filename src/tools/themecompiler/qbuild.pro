@@ -0,0 +1,24 @@
+TEMPLATE=app
+TARGET=themecompiler
+
+CONFIG+=qt
+MODULES*=\
+    qtopia::headers\
+    qtopiabase::headers
+
+SOURCEPATH+=\
+    /src/libraries/qtopiabase\
+    /src/tools/qdawggen
+
+HEADERS=\
+    qcompiledtheme_p.h\
+    qmemoryfile_p.h\
+    global.h
+
+SOURCES=\
+    main.cpp\
+    qcompiledtheme.cpp\
+    qmemoryfile.cpp\
+    qmemoryfile_unix.cpp\
+    global.cpp
+